@@ -0,0 +1,142 @@
+#
+# This file is part of LiteX.
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+"""Storage on the blockdev sim module, behind LiteSATA compatible sector DMAs."""
+
+from migen import *
+
+from litex.gen.common import reverse_bytes
+
+from litex.build.generic_platform import Pins, Subsignal
+from litex.soc.interconnect.csr import *
+from litex.soc.interconnect import wishbone
+from litex.soc.cores.dma import WishboneDMAReader, WishboneDMAWriter
+
+# IOs ----------------------------------------------------------------------------------------------
+
+def blockdev_io(data_width=32):
+    return ("blockdev", 0,
+        Subsignal("cmd_valid",  Pins(1)),
+        Subsignal("cmd_write",  Pins(1)),
+        Subsignal("cmd_sector", Pins(32)),
+        Subsignal("error",      Pins(1)),
+        Subsignal("rd_valid",   Pins(1)),
+        Subsignal("rd_ack",     Pins(1)),
+        Subsignal("rd_data",    Pins(data_width)),
+        Subsignal("wr_valid",   Pins(1)),
+        Subsignal("wr_data",    Pins(data_width)),
+    )
+
+# CSRs ---------------------------------------------------------------------------------------------
+
+class SimSATAPHY(Module, AutoCSR):
+    def __init__(self):
+        self.enable = CSRStorage(reset=1)
+        self.status = CSRStatus()
+
+        # # #
+
+        self.comb += self.status.status.eq(self.enable.storage)
+
+class SimSATADMA(Module, AutoCSR):
+    def __init__(self):
+        self.sector = CSRStorage(48)
+        self.base   = CSRStorage(64)
+        self.start  = CSR()
+        self.done   = CSRStatus()
+        self.error  = CSRStatus()
+
+# SimSATA ------------------------------------------------------------------------------------------
+
+class SimSATA(Module):
+    """Sector DMAs of the blockdev sim module
+
+    Exposes the CSRs of the LiteSATA PHY, Sector2Mem and Mem2Sector DMAs (phy, sector2mem and
+    mem2sector, to add to the SoC as sata_phy, sata_sector2mem and sata_mem2sector) so that
+    liblitesata and sataboot() run unchanged on a disk image. One sector is transferred at a
+    time, reads through sector2mem_bus and writes through mem2sector_bus.
+    """
+    def __init__(self, pads, data_width=32, endianness="little", sector_size=512):
+        assert len(pads.rd_data) == data_width
+        self.phy        = SimSATAPHY()
+        self.sector2mem = sector2mem = SimSATADMA()
+        self.mem2sector = mem2sector = SimSATADMA()
+        self.sector2mem_bus = wishbone.Interface(data_width=data_width)
+        self.mem2sector_bus = wishbone.Interface(data_width=data_width)
+
+        # # #
+
+        words     = sector_size*8//data_width
+        adr_shift = log2_int(data_width//8)
+        count     = Signal(max=words)
+
+        self.submodules.writer = writer = WishboneDMAWriter(self.sector2mem_bus, endianness)
+        self.submodules.reader = reader = WishboneDMAReader(self.mem2sector_bus, endianness)
+
+        # The pads are registered: the module sees the values the RTL acted upon on the clock
+        # edge. It packs the bytes in memory order, the DMA streams carry the first byte in the
+        # MSBs.
+        cmd_valid = Signal()
+        cmd_write = Signal()
+        rd_ack    = Signal()
+        self.sync += [
+            pads.cmd_valid.eq(cmd_valid),
+            pads.cmd_write.eq(cmd_write),
+            pads.cmd_sector.eq(Mux(cmd_write, mem2sector.sector.storage, sector2mem.sector.storage)),
+            pads.rd_ack.eq(rd_ack),
+            pads.wr_valid.eq(reader.source.valid),
+            pads.wr_data.eq(reverse_bytes(reader.source.data)),
+        ]
+        self.comb += [
+            writer.sink.address.eq(sector2mem.base.storage[adr_shift:] + count),
+            writer.sink.data.eq(reverse_bytes(pads.rd_data)),
+            reader.sink.address.eq(mem2sector.base.storage[adr_shift:] + count),
+            reader.sink.last.eq(count == (words - 1)),
+            reader.source.ready.eq(1),
+        ]
+
+        self.submodules.fsm = fsm = FSM(reset_state="IDLE")
+        self.comb += [
+            sector2mem.done.status.eq(fsm.ongoing("IDLE")),
+            mem2sector.done.status.eq(fsm.ongoing("IDLE")),
+        ]
+        fsm.act("IDLE",
+            NextValue(count, 0),
+            If(sector2mem.start.re,
+                NextState("READ-CMD")
+            ).Elif(mem2sector.start.re,
+                NextState("WRITE-CMD")
+            )
+        )
+        fsm.act("READ-CMD",
+            cmd_valid.eq(1),
+            NextState("READ-DATA")
+        )
+        fsm.act("READ-DATA",
+            writer.sink.valid.eq(pads.rd_valid),
+            If(writer.sink.valid & writer.sink.ready,
+                rd_ack.eq(1),
+                NextValue(count, count + 1),
+                If(count == (words - 1),
+                    NextValue(sector2mem.error.status, pads.error),
+                    NextState("IDLE")
+                )
+            )
+        )
+        fsm.act("WRITE-CMD",
+            cmd_valid.eq(1),
+            cmd_write.eq(1),
+            NextState("WRITE-DATA")
+        )
+        fsm.act("WRITE-DATA",
+            reader.sink.valid.eq(1),
+            If(reader.sink.ready,
+                NextValue(count, count + 1),
+                If(reader.sink.last,
+                    NextValue(mem2sector.error.status, pads.error),
+                    NextState("IDLE")
+                )
+            )
+        )
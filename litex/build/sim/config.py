@@ -66,42 +66,20 @@ def _calculate_timebase_ps(clockers):
     Clock edges happen at time instants:
         t(n) = n * T/2 + P/360 * T
     where: T - clock period, P - clock phase [deg]
-    We must be able to represent clock edges with the timebase B:
-        t(n) mod B = 0, for all n
-    In this function checks that:
-        ((T/2) mod B = 0) AND ((P/360 * T) mod B = 0)
 
-    Currently we allow only for integer periods (in ps), which it's quite restrictive.
+    The clocker module schedules its own edges (rounded to 1ps, with the fractional part carried
+    over) and the simulation jumps from edge to edge, so the timebase is only the fixed step used
+    when edge scheduling is not available: the greatest common divisor of the rounded half periods
+    and phase shifts.
     """
     # convert to picoseconds, 1ps is our finest timebase for dumping simulation data
     periods_ps = [1e12 / c["args"]["freq_hz"] for c in clockers]
     phase_shifts_ps = [p * c["args"]["phase_deg"]/360 for c, p in zip(clockers, periods_ps)]
 
     # calculate timebase as greatest common denominator
-    timebase_ps = None
+    timebase_ps = 0
     for period, phase_shift in zip(periods_ps, phase_shifts_ps):
-        if timebase_ps is None:
-            timebase_ps = int(period/2)
-        timebase_ps = math.gcd(timebase_ps, int(period/2))
-        timebase_ps = math.gcd(timebase_ps, int(phase_shift))
+        timebase_ps = math.gcd(timebase_ps, round(period/2))
+        timebase_ps = math.gcd(timebase_ps, round(phase_shift))
 
-    # check correctness
-    for clocker, period, phase_shift in zip(clockers, periods_ps, phase_shifts_ps):
-        def error(description):
-            return f"""
-SimConfig:
-{description}:
-  timebase = {timebase_ps}ps, period = {period}ps, phase_shift = {phase_shift}ps,
-  clocker[args] = {clocker["args"]}
-Adjust clock definitions so that integer multiple of 1ps can be used as a timebase.
-            """.strip()
-
-        assert int(period) == period, error("Non-integer period")
-        assert int(phase_shift) == phase_shift, error("Non-integer phase_shift")
-
-        assert (period/2 % timebase_ps) == 0, \
-            error("Could not find an integer timebase for period")
-        assert (phase_shift % timebase_ps) == 0, \
-            error("Could not find an integer timebase for phase shift")
-
-    return timebase_ps
+    return max(timebase_ps, 1)
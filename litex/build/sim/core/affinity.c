@@ -0,0 +1,327 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include "error.h"
+#include "affinity.h"
+
+/*
+ * CPU placement: LITEX_SIM_AFFINITY="<role>=<cpus>;..." (or the --affinity
+ * option of Vsim, which takes precedence) pins the threads of the simulator
+ * so that they neither float across cores nor collide with the builds and
+ * the other simulations of a shared host. Roles:
+ *   sim        the simulation thread (evals and ticks)
+ *   io         the I/O thread running the event loop, and the threads the
+ *              modules start (sockets, TAP)
+ *   verilator  the threads started with the model (Verilator workers of
+ *              THREADS builds, trace writers)
+ *   workers    the tick workers (LITEX_SIM_TICK_THREADS)
+ * <cpus> lists CPUs, ranges and NUMA nodes, e.g. "2,4-7" or "node1". The
+ * sim and io threads may run on any CPU of their set, the verilator and
+ * workers threads each get one, round robin. Memory is placed by first
+ * touch, close to the threads using it.
+ */
+
+#ifdef __linux__
+
+static const char *affinity_names[AFFINITY_ROLES] = {
+  [AFFINITY_SIM] = "sim",
+  [AFFINITY_IO] = "io",
+  [AFFINITY_VERILATOR] = "verilator",
+  [AFFINITY_WORKERS] = "workers",
+};
+
+struct affinity_s {
+  int ncpus;
+  int cpus[CPU_SETSIZE];
+  cpu_set_t set;
+};
+
+static struct affinity_s affinity[AFFINITY_ROLES];
+
+/* Threads alive at litex_sim_affinity_mark(), sorted */
+static pid_t *marked;
+static int nmarked;
+
+static int litex_sim_affinity_parse_cpus(const char *list, cpu_set_t *set);
+
+static int litex_sim_affinity_parse_node(int node, cpu_set_t *set)
+{
+  char path[64];
+  char list[1024];
+  FILE *f;
+  int ret;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  f = fopen(path, "r");
+  if(!f)
+  {
+    eprintf("Unknown NUMA node %d\n", node);
+    return RC_INVARG;
+  }
+  ret = fgets(list, sizeof(list), f) ? RC_OK : RC_ERROR;
+  fclose(f);
+  if(RC_OK != ret)
+    return ret;
+  list[strcspn(list, "\n")] = 0;
+  return litex_sim_affinity_parse_cpus(list, set);
+}
+
+static int litex_sim_affinity_parse_cpus(const char *list, cpu_set_t *set)
+{
+  const char *p = list;
+  char *end;
+  long first, last;
+  int ret;
+
+  while(*p)
+  {
+    if(!strncmp(p, "node", 4))
+    {
+      first = strtol(p + 4, &end, 10);
+      if(end == p + 4)
+        goto err;
+      if(RC_OK != (ret = litex_sim_affinity_parse_node(first, set)))
+        return ret;
+    }
+    else
+    {
+      first = last = strtol(p, &end, 10);
+      if(end == p)
+        goto err;
+      if('-' == *end)
+      {
+        p = end + 1;
+        last = strtol(p, &end, 10);
+        if(end == p)
+          goto err;
+      }
+      if(first < 0 || last < first || last >= CPU_SETSIZE)
+        goto err;
+      for(; first <= last; first++)
+        CPU_SET(first, set);
+    }
+    p = end;
+    if(',' == *p)
+      p++;
+    else if(*p)
+      goto err;
+  }
+  return RC_OK;
+err:
+  eprintf("Invalid CPU list \"%s\"\n", list);
+  return RC_INVARG;
+}
+
+static int litex_sim_affinity_parse(char *spec)
+{
+  char *entry, *cpus, *saveptr;
+  int role, cpu;
+  int ret = RC_OK;
+
+  for(entry = strtok_r(spec, ";", &saveptr); entry; entry = strtok_r(NULL, ";", &saveptr))
+  {
+    cpus = strchr(entry, '=');
+    if(!cpus)
+    {
+      eprintf("Expected <role>=<cpus> in \"%s\"\n", entry);
+      return RC_INVARG;
+    }
+    *cpus++ = 0;
+    for(role = 0; role < AFFINITY_ROLES; role++)
+    {
+      if(!strcmp(entry, affinity_names[role]))
+        break;
+    }
+    if(AFFINITY_ROLES == role)
+    {
+      eprintf("Unknown thread role \"%s\" (sim, io, verilator, workers)\n", entry);
+      return RC_INVARG;
+    }
+    CPU_ZERO(&affinity[role].set);
+    if(RC_OK != (ret = litex_sim_affinity_parse_cpus(cpus, &affinity[role].set)))
+      return ret;
+    affinity[role].ncpus = 0;
+    for(cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+      if(CPU_ISSET(cpu, &affinity[role].set))
+        affinity[role].cpus[affinity[role].ncpus++] = cpu;
+    }
+  }
+  return ret;
+}
+
+/* The CPUs of a thread: all of the set for sim/io, one for the others */
+static int litex_sim_affinity_get(enum affinity_role role, int index, cpu_set_t *set)
+{
+  struct affinity_s *a = &affinity[role];
+
+  if(!a->ncpus)
+    return 0;
+  if(AFFINITY_SIM == role || AFFINITY_IO == role)
+  {
+    *set = a->set;
+  }
+  else
+  {
+    CPU_ZERO(set);
+    CPU_SET(a->cpus[index % a->ncpus], set);
+  }
+  return 1;
+}
+
+int litex_sim_init_affinity(int argc, char *argv[])
+{
+  char *spec = getenv("LITEX_SIM_AFFINITY");
+  int ret;
+  int i;
+
+  for(i = 1; i < argc - 1; i++)
+  {
+    if(!strcmp(argv[i], "--affinity"))
+      spec = argv[i + 1];
+  }
+  if(!spec)
+    return RC_OK;
+
+  spec = strdup(spec);
+  if(!spec)
+  {
+    eprintf("Not enough memory\n");
+    return RC_NOENMEM;
+  }
+  ret = litex_sim_affinity_parse(spec);
+  free(spec);
+  if(RC_OK != ret)
+    return ret;
+
+  /* Threads created from now on by this one inherit the io placement */
+  litex_sim_affinity_set(AFFINITY_IO, 0);
+  return RC_OK;
+}
+
+/* Places the calling thread */
+void litex_sim_affinity_set(enum affinity_role role, int index)
+{
+  cpu_set_t set;
+  int err;
+
+  if(!litex_sim_affinity_get(role, index, &set))
+    return;
+  err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if(err)
+    eprintf("Can't place %s thread %d: %s\n", affinity_names[role], index, strerror(err));
+}
+
+static int litex_sim_affinity_cmp(const void *a, const void *b)
+{
+  return *(const pid_t *)a - *(const pid_t *)b;
+}
+
+/* Calls fn on each thread of the process */
+static void litex_sim_affinity_tasks(void (*fn)(pid_t tid, void *arg), void *arg)
+{
+  struct dirent *d;
+  DIR *dir;
+
+  dir = opendir("/proc/self/task");
+  if(!dir)
+    return;
+  while((d = readdir(dir)))
+  {
+    if('.' != d->d_name[0])
+      fn((pid_t)atoi(d->d_name), arg);
+  }
+  closedir(dir);
+}
+
+static void litex_sim_affinity_mark_task(pid_t tid, void *arg)
+{
+  pid_t *tids;
+
+  tids = (pid_t *)realloc(marked, (nmarked + 1) * sizeof(pid_t));
+  if(!tids)
+    return;
+  marked = tids;
+  marked[nmarked++] = tid;
+}
+
+/* Remembers the threads alive now, see litex_sim_affinity_place() */
+void litex_sim_affinity_mark(void)
+{
+  if(!affinity[AFFINITY_VERILATOR].ncpus)
+    return;
+  nmarked = 0;
+  litex_sim_affinity_tasks(litex_sim_affinity_mark_task, NULL);
+  qsort(marked, nmarked, sizeof(pid_t), litex_sim_affinity_cmp);
+}
+
+struct affinity_place_s {
+  enum affinity_role role;
+  int index;
+  int placed;
+};
+
+static void litex_sim_affinity_place_task(pid_t tid, void *arg)
+{
+  struct affinity_place_s *p = (struct affinity_place_s *)arg;
+  cpu_set_t set;
+
+  if(bsearch(&tid, marked, nmarked, sizeof(pid_t), litex_sim_affinity_cmp))
+    return;
+  litex_sim_affinity_get(p->role, p->index, &set);
+  if(sched_setaffinity(tid, sizeof(set), &set))
+    eprintf("Can't place %s thread %d: %s\n", affinity_names[p->role], p->index, strerror(errno));
+  else
+    p->placed++;
+  p->index++;
+}
+
+/* Places the threads created since litex_sim_affinity_mark(), which the
+ * sim core doesn't start itself (Verilator's) */
+void litex_sim_affinity_place(enum affinity_role role)
+{
+  struct affinity_place_s p = { role, 0, 0 };
+
+  if(!affinity[role].ncpus)
+    return;
+  litex_sim_affinity_tasks(litex_sim_affinity_place_task, &p);
+  if(p.placed)
+    printf("[sim] %d %s threads placed\n", p.placed, affinity_names[role]);
+}
+
+#else
+
+int litex_sim_init_affinity(int argc, char *argv[])
+{
+  int i;
+
+  for(i = 1; i < argc; i++)
+  {
+    if(!strcmp(argv[i], "--affinity"))
+      break;
+  }
+  if(getenv("LITEX_SIM_AFFINITY") || i < argc)
+    eprintf("Thread placement is only supported on Linux, ignoring\n");
+  return RC_OK;
+}
+
+void litex_sim_affinity_set(enum affinity_role role, int index)
+{
+}
+
+void litex_sim_affinity_mark(void)
+{
+}
+
+void litex_sim_affinity_place(enum affinity_role role)
+{
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __AFFINITY_H_
+#define __AFFINITY_H_
+
+/* Thread placement, see affinity.c */
+enum affinity_role {
+  AFFINITY_SIM,
+  AFFINITY_IO,
+  AFFINITY_VERILATOR,
+  AFFINITY_WORKERS,
+  AFFINITY_ROLES
+};
+
+int litex_sim_init_affinity(int argc, char *argv[]);
+void litex_sim_affinity_set(enum affinity_role role, int index);
+void litex_sim_affinity_mark(void);
+void litex_sim_affinity_place(enum affinity_role role);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef __ARGS_H_
+#define __ARGS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <json-c/json.h>
+#include "error.h"
+
+/*
+ * Module arguments: new_sess() gets the "args" object of its session from
+ * the configuration as a JSON string. Modules parse it once with
+ * litex_sim_args_parse() and look every key up in the returned object,
+ * released with litex_sim_args_free(). Missing or empty args give an empty
+ * object, so that optional arguments need no special case.
+ */
+
+static inline json_object *litex_sim_args_parse(const char *module, const char *args)
+{
+  json_object *obj;
+
+  if(!args || !*args)
+    return json_object_new_object();
+  obj = json_tokener_parse(args);
+  if(!obj || !json_object_is_type(obj, json_type_object))
+  {
+    fprintf(stderr, "[%s] args must be a JSON object: %s\n", module, args);
+    if(obj)
+      json_object_put(obj);
+    return NULL;
+  }
+  return obj;
+}
+
+static inline void litex_sim_args_free(json_object *args)
+{
+  if(args)
+    json_object_put(args);
+}
+
+/* Required argument, as a string the caller frees */
+static inline int litex_sim_args_get_string(json_object *args, const char *name, char **val)
+{
+  json_object *obj = NULL;
+
+  *val = NULL;
+  if(!json_object_object_get_ex(args, name, &obj))
+  {
+    fprintf(stderr, "Could not find argument \"%s\" (%s)\n", name, json_object_to_json_string(args));
+    return RC_JSERROR;
+  }
+  *val = strdup(json_object_get_string(obj));
+  return *val ? RC_OK : RC_NOENMEM;
+}
+
+/* Optional arguments, def when missing. Strings live as long as args. */
+static inline const char *litex_sim_args_opt_string(json_object *args, const char *name, const char *def)
+{
+  json_object *obj = NULL;
+
+  if(!json_object_object_get_ex(args, name, &obj))
+    return def;
+  return json_object_get_string(obj);
+}
+
+static inline int64_t litex_sim_args_opt_int(json_object *args, const char *name, int64_t def)
+{
+  json_object *obj = NULL;
+
+  if(!json_object_object_get_ex(args, name, &obj))
+    return def;
+  return json_object_get_int64(obj);
+}
+
+#endif
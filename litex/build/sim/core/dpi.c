@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "dpi.h"
+
+static struct dpi_channel_s *channels[DPI_MAX_CHANNELS];
+static int nchannels = 0;
+
+static int litex_sim_dpi_find(const char *name)
+{
+  struct dpi_channel_s *c;
+  int i;
+
+  for(i = 0; i < nchannels; i++)
+  {
+    if(!strcmp(channels[i]->name, name))
+      return i;
+  }
+  if(nchannels == DPI_MAX_CHANNELS)
+  {
+    eprintf("Too many DPI channels\n");
+    return -1;
+  }
+  c = (struct dpi_channel_s *)malloc(sizeof(struct dpi_channel_s));
+  if(!c)
+  {
+    eprintf("Not enough memory\n");
+    return -1;
+  }
+  memset(c, 0, sizeof(struct dpi_channel_s));
+  c->name = strdup(name);
+  if(ring_init(&c->to_rtl, DPI_RING_SIZE, 1) || ring_init(&c->from_rtl, DPI_RING_SIZE, 1))
+  {
+    eprintf("Not enough memory\n");
+    return -1;
+  }
+  channels[nchannels] = c;
+  return nchannels++;
+}
+
+struct dpi_channel_s *litex_sim_dpi_channel(const char *name)
+{
+  int i = litex_sim_dpi_find(name);
+
+  return i < 0 ? NULL : channels[i];
+}
+
+int litex_sim_dpi_open(const char *name)
+{
+  int i = litex_sim_dpi_find(name);
+
+  if(i < 0)
+    exit(1);
+  return i;
+}
+
+/* Pops a word of len bytes (little-endian) if fully available, returns the
+ * number of bytes read */
+int litex_sim_dpi_read(int chan, long long *data, int len)
+{
+  ring_t *r = &channels[chan]->to_rtl;
+  uint8_t buf[8];
+  uint64_t v = 0;
+  int i;
+
+  if(ring_count(r) < (size_t)len)
+    return 0;
+  ring_pop(r, buf, len);
+  for(i = len - 1; i >= 0; i--)
+    v = (v << 8) | buf[i];
+  *data = v;
+  return len;
+}
+
+void litex_sim_dpi_write(int chan, long long data, int len)
+{
+  uint8_t buf[8];
+  int i;
+
+  for(i = 0; i < len; i++)
+    buf[i] = (uint64_t)data >> (8 * i);
+  ring_push(&channels[chan]->from_rtl, buf, len);
+}
+
+int litex_sim_dpi_space(int chan)
+{
+  return ring_space(&channels[chan]->from_rtl);
+}
@@ -0,0 +1,36 @@
+#ifndef __DPI_H_
+#define __DPI_H_
+
+#include "ring.h"
+
+/*
+ * Byte channels between sim modules and the DPI-C stream endpoints of the
+ * RTL (litex_sim_dpi_source/litex_sim_dpi_sink, verilog/litex_sim_dpi.sv).
+ * The RTL side moves a whole word per clock with a direct call made during
+ * the model evaluation, the module side uses the rings directly from its I/O
+ * handlers, so no pads and no ticks are involved. Each ring has a single
+ * producer and a single consumer thread.
+ */
+
+#define DPI_RING_SIZE 65536
+#define DPI_MAX_CHANNELS 32
+
+struct dpi_channel_s {
+  char *name;
+  // module -> RTL source
+  ring_t to_rtl;
+  // RTL sink -> module
+  ring_t from_rtl;
+};
+
+/* Channel of the given name, created on first use by either side. Only to
+ * be called at startup (new_sess/add_pads, RTL initial blocks). */
+struct dpi_channel_s *litex_sim_dpi_channel(const char *name);
+
+/* DPI-C imports of litex_sim_dpi.sv */
+int litex_sim_dpi_open(const char *name);
+int litex_sim_dpi_read(int chan, long long *data, int len);
+void litex_sim_dpi_write(int chan, long long data, int len);
+int litex_sim_dpi_space(int chan);
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef __ETHQUEUE_H_
+#define __ETHQUEUE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <event2/event.h>
+#include <json-c/json.h>
+#include "args.h"
+#include "pktpool.h"
+#include "stim.h"
+
+/*
+ * Queue settings and counts of the TAP interface of the Ethernet modules:
+ * - "queue": frame buffers per direction (default 64, rounded up to a power
+ *   of two), allocated once,
+ * - "backpressure": with all RX buffers in flight, TAP reads are paused
+ *   until the simulation frees one (the host kernel queues or drops the
+ *   frames) instead of the frames being read and dropped (tail drop).
+ * The counts are printed when the simulation closes.
+ *
+ * Frames are counted by the simulation thread (eth_queue_rx/tx), the TAP
+ * reads paused and resumed by the I/O thread (eth_queue_rx_full/resume).
+ *
+ * With a stimulus log (see stim.h), the frames fed to the simulation are
+ * logged when popped from the RX ring, and replayed instead of any other
+ * input, on the simulation thread, with no TAP interface.
+ */
+
+#define ETH_QUEUE_DEFAULT 64
+
+struct eth_queue_s {
+  size_t depth;
+  int backpressure;
+  int paused;
+  uint64_t rx_frames;
+  uint64_t rx_bytes;
+  uint64_t rx_dropped;
+  uint64_t rx_pauses;
+  uint64_t tx_frames;
+  uint64_t tx_bytes;
+  uint64_t tx_dropped;
+};
+
+static inline void eth_queue_args(struct eth_queue_s *q, json_object *args)
+{
+  int64_t depth = litex_sim_args_opt_int(args, "queue", ETH_QUEUE_DEFAULT);
+
+  q->depth = 1;
+  while(q->depth < (size_t)depth)
+    q->depth <<= 1;
+  q->backpressure = litex_sim_args_opt_int(args, "backpressure", 0) != 0;
+  q->paused = 0;
+}
+
+/* Counts a frame of len bytes fed to the simulation */
+static inline void eth_queue_rx(struct eth_queue_s *q, size_t len)
+{
+  q->rx_frames++;
+  q->rx_bytes += len;
+}
+
+/* No RX buffer for the frame the TAP event ev signals: returns 1 when reads
+ * are paused, 0 when the frame is to be read and dropped */
+static inline int eth_queue_rx_full(struct eth_queue_s *q, struct event *ev)
+{
+  if(q->backpressure) {
+    event_del(ev);
+    q->paused = 1;
+    q->rx_pauses++;
+    return 1;
+  }
+  q->rx_dropped++;
+  return 0;
+}
+
+/* Resumes the TAP reads paused by eth_queue_rx_full() once a buffer is free */
+static inline void eth_queue_rx_resume(struct eth_queue_s *q, pkt_pool_t *pool, struct event *ev)
+{
+  if(q->paused && ring_count(&pool->free)) {
+    q->paused = 0;
+    event_add(ev, NULL);
+  }
+}
+
+/* Stream of the n-th session of the module, named after its order in the
+ * configuration as the interfaces may differ between runs */
+static inline struct stim_stream_s *eth_queue_stim_open(const char *module, int n)
+{
+  char name[64];
+
+  snprintf(name, sizeof(name), "%s:%d", module, n);
+  return litex_sim_stim_open(name);
+}
+
+static inline int eth_queue_stim_replaying(struct stim_stream_s *st)
+{
+  return st && litex_sim_stim_mode() == STIM_REPLAY;
+}
+
+/* Pushes the logged frames due at time_ps to the RX ring */
+static inline void eth_queue_stim_poll(struct stim_stream_s *st, pkt_pool_t *pool, ring_t *ring,
+  size_t maxlen, uint64_t time_ps)
+{
+  struct pkt_s *pkt;
+
+  while((pkt = pkt_pool_get(pool)))
+  {
+    pkt->len = litex_sim_stim_replay(st, time_ps, pkt->data, maxlen);
+    if(!pkt->len)
+    {
+      pkt_pool_put(pool, pkt);
+      return;
+    }
+    ring_push(ring, &pkt, 1);
+  }
+}
+
+static inline void eth_queue_stim_record(struct stim_stream_s *st, struct pkt_s *pkt, uint64_t time_ps)
+{
+  if(litex_sim_stim_mode() == STIM_RECORD)
+    litex_sim_stim_record(st, time_ps, pkt->data, pkt->len);
+}
+
+static inline void eth_queue_tx(struct eth_queue_s *q, size_t len)
+{
+  q->tx_frames++;
+  q->tx_bytes += len;
+}
+
+static inline void eth_queue_print(const char *module, struct eth_queue_s *q)
+{
+  printf("[%s] RX %llu frames (%llu bytes), %llu dropped, %llu pauses; "
+         "TX %llu frames (%llu bytes), %llu dropped\n", module,
+         (unsigned long long)q->rx_frames, (unsigned long long)q->rx_bytes,
+         (unsigned long long)q->rx_dropped, (unsigned long long)q->rx_pauses,
+         (unsigned long long)q->tx_frames, (unsigned long long)q->tx_bytes,
+         (unsigned long long)q->tx_dropped);
+}
+
+#endif
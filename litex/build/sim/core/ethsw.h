@@ -0,0 +1,271 @@
+#ifndef __ETHSW_H_
+#define __ETHSW_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pktpool.h"
+
+/*
+ * Shared memory Ethernet switch between simulation instances, used by the
+ * Ethernet modules instead of a TAP interface (backend "shm"). The switch is
+ * a POSIX shared memory segment (/dev/shm/litex-ethsw-<name>) of ETHSW_PORTS
+ * ports, each with a byte ring of received frames. Senders copy their frames
+ * straight into the rings of the destination ports, the owner of a port
+ * drains all its queued frames at once on the simulation thread: no syscall
+ * per frame, no I/O thread and no root privileges.
+ *
+ * Destinations are learned from the source MAC addresses, multicast and
+ * unknown destinations are flooded to all the other ports. Frames are
+ * dropped when the ring of a port is full, as a switch does. Ports (and
+ * locks) of processes that are gone are reclaimed.
+ */
+
+#define ETHSW_MAGIC 0x57534c4c
+#define ETHSW_PORTS 16
+#define ETHSW_RING_SIZE (1 << 20)
+#define ETHSW_RING_MASK (ETHSW_RING_SIZE - 1)
+
+/* Frames are stored as a 32-bit length followed by the data, 8-byte aligned */
+#define ETHSW_REC_LEN(len) ((sizeof(uint32_t) + (len) + 7) & ~(uint64_t)7)
+
+struct ethsw_port_s {
+  _Atomic int32_t pid;
+  _Atomic int32_t lock;
+  _Atomic int mac_valid;
+  uint8_t mac[6];
+  _Atomic uint64_t drops;
+  _Atomic uint64_t head __attribute__((aligned(64)));
+  _Atomic uint64_t tail __attribute__((aligned(64)));
+  uint8_t ring[ETHSW_RING_SIZE] __attribute__((aligned(64)));
+};
+
+struct ethsw_shm_s {
+  _Atomic uint32_t magic;
+  struct ethsw_port_s ports[ETHSW_PORTS];
+};
+
+typedef struct ethsw {
+  struct ethsw_shm_s *shm;
+  struct ethsw_port_s *port;
+} ethsw_t;
+
+static inline int ethsw_alive(int32_t pid)
+{
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+/* Senders of a port are serialized by a spinlock holding their pid */
+static inline void ethsw_lock(struct ethsw_port_s *p)
+{
+  int32_t pid = getpid();
+  int32_t holder;
+  uint32_t spins = 0;
+
+  for(;;)
+  {
+    holder = 0;
+    if(atomic_compare_exchange_weak(&p->lock, &holder, pid))
+      return;
+    if(!(++spins & 0xffff) && holder && !ethsw_alive(holder))
+      atomic_compare_exchange_strong(&p->lock, &holder, 0);
+  }
+}
+
+static inline void ethsw_unlock(struct ethsw_port_s *p)
+{
+  atomic_store_explicit(&p->lock, 0, memory_order_release);
+}
+
+static inline void ethsw_copy_in(struct ethsw_port_s *p, uint64_t pos, const void *data, size_t len)
+{
+  size_t off = pos & ETHSW_RING_MASK;
+  size_t first = len < ETHSW_RING_SIZE - off ? len : ETHSW_RING_SIZE - off;
+
+  memcpy(p->ring + off, data, first);
+  memcpy(p->ring, (const uint8_t *)data + first, len - first);
+}
+
+static inline void ethsw_copy_out(struct ethsw_port_s *p, uint64_t pos, void *data, size_t len)
+{
+  size_t off = pos & ETHSW_RING_MASK;
+  size_t first = len < ETHSW_RING_SIZE - off ? len : ETHSW_RING_SIZE - off;
+
+  memcpy(data, p->ring + off, first);
+  memcpy((uint8_t *)data + first, p->ring, len - first);
+}
+
+/* Map the switch, creating it if needed, and take a free port */
+static inline int ethsw_open(ethsw_t *sw, const char *name)
+{
+  char path[256];
+  struct stat st;
+  int32_t pid = getpid();
+  int32_t owner;
+  int fd, creator, i;
+
+  memset(sw, 0, sizeof(ethsw_t));
+  snprintf(path, sizeof(path), "/litex-ethsw-%s", name);
+  fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+  creator = fd >= 0;
+  if(!creator)
+    fd = shm_open(path, O_RDWR, 0600);
+  if(fd < 0)
+    return -1;
+  if(creator && ftruncate(fd, sizeof(struct ethsw_shm_s)))
+  {
+    close(fd);
+    shm_unlink(path);
+    return -1;
+  }
+  /* Wait for the creator to size it */
+  do {
+    fstat(fd, &st);
+  } while(st.st_size < sizeof(struct ethsw_shm_s) && !usleep(10000));
+
+  sw->shm = (struct ethsw_shm_s *)mmap(NULL, sizeof(struct ethsw_shm_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(MAP_FAILED == sw->shm)
+  {
+    sw->shm = NULL;
+    return -1;
+  }
+  if(creator)
+    atomic_store(&sw->shm->magic, ETHSW_MAGIC);
+  else
+    while(atomic_load(&sw->shm->magic) != ETHSW_MAGIC)
+      usleep(10000);
+
+  for(i = 0; i < ETHSW_PORTS; i++)
+  {
+    struct ethsw_port_s *p = &sw->shm->ports[i];
+
+    owner = atomic_load(&p->pid);
+    if(owner && ethsw_alive(owner))
+      continue;
+    if(!atomic_compare_exchange_strong(&p->pid, &owner, pid))
+      continue;
+    /* Frames queued for a previous owner are stale */
+    ethsw_lock(p);
+    atomic_store(&p->mac_valid, 0);
+    atomic_store(&p->drops, 0);
+    atomic_store(&p->head, atomic_load(&p->tail));
+    ethsw_unlock(p);
+    sw->port = p;
+    return i;
+  }
+  munmap(sw->shm, sizeof(struct ethsw_shm_s));
+  sw->shm = NULL;
+  return -1;
+}
+
+static inline void ethsw_close(ethsw_t *sw)
+{
+  if(!sw->shm)
+    return;
+  atomic_store(&sw->port->pid, 0);
+  munmap(sw->shm, sizeof(struct ethsw_shm_s));
+  sw->shm = NULL;
+  sw->port = NULL;
+}
+
+static inline void ethsw_push(struct ethsw_port_s *p, const uint8_t *data, uint32_t len)
+{
+  uint64_t tail, head;
+
+  ethsw_lock(p);
+  tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+  head = atomic_load_explicit(&p->head, memory_order_acquire);
+  if(ETHSW_RING_SIZE - (tail - head) < ETHSW_REC_LEN(len))
+  {
+    atomic_fetch_add(&p->drops, 1);
+    ethsw_unlock(p);
+    return;
+  }
+  ethsw_copy_in(p, tail, &len, sizeof(uint32_t));
+  ethsw_copy_in(p, tail + sizeof(uint32_t), data, len);
+  atomic_store_explicit(&p->tail, tail + ETHSW_REC_LEN(len), memory_order_release);
+  ethsw_unlock(p);
+}
+
+/* Send a frame to the port owning its destination MAC, or to all the others */
+static inline void ethsw_send(ethsw_t *sw, const uint8_t *data, size_t len)
+{
+  struct ethsw_port_s *p;
+  int i;
+
+  if(len < 12)
+    return;
+  if(!(data[6] & 1) && (!atomic_load(&sw->port->mac_valid) || memcmp(sw->port->mac, data + 6, 6)))
+  {
+    atomic_store(&sw->port->mac_valid, 0);
+    memcpy(sw->port->mac, data + 6, 6);
+    atomic_store(&sw->port->mac_valid, 1);
+  }
+  if(!(data[0] & 1))
+  {
+    for(i = 0; i < ETHSW_PORTS; i++)
+    {
+      p = &sw->shm->ports[i];
+      if(p != sw->port && atomic_load(&p->pid) && atomic_load(&p->mac_valid) && !memcmp(p->mac, data, 6))
+      {
+        ethsw_push(p, data, len);
+        return;
+      }
+    }
+  }
+  for(i = 0; i < ETHSW_PORTS; i++)
+  {
+    p = &sw->shm->ports[i];
+    if(p != sw->port && atomic_load(&p->pid))
+      ethsw_push(p, data, len);
+  }
+}
+
+static inline int ethsw_pending(ethsw_t *sw)
+{
+  return atomic_load_explicit(&sw->port->head, memory_order_relaxed)
+    != atomic_load_explicit(&sw->port->tail, memory_order_acquire);
+}
+
+/*
+ * Move all the frames received on the port into a module RX ring, on the
+ * simulation thread, as long as buffers are free. Frames longer than maxlen
+ * are truncated, frames shorter than minlen are zero padded.
+ */
+static inline void ethsw_poll(ethsw_t *sw, pkt_pool_t *pool, ring_t *ring, size_t maxlen, size_t minlen)
+{
+  struct ethsw_port_s *p = sw->port;
+  struct pkt_s *pkt;
+  uint64_t head, tail;
+  uint32_t len;
+
+  head = atomic_load_explicit(&p->head, memory_order_relaxed);
+  tail = atomic_load_explicit(&p->tail, memory_order_acquire);
+  while(head != tail)
+  {
+    pkt = pkt_pool_get(pool);
+    if(!pkt)
+      break;
+    ethsw_copy_out(p, head, &len, sizeof(uint32_t));
+    pkt->len = len < maxlen ? len : maxlen;
+    ethsw_copy_out(p, head + sizeof(uint32_t), pkt->data, pkt->len);
+    if(pkt->len < minlen)
+    {
+      memset(pkt->data + pkt->len, 0, minlen - pkt->len);
+      pkt->len = minlen;
+    }
+    ring_push(ring, &pkt, 1);
+    head += ETHSW_REC_LEN(len);
+  }
+  atomic_store_explicit(&p->head, head, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "iss.h"
+#include "veril.h"
+
+/*
+ * Fast-forward: LITEX_SIM_FF="pc=<addr>,insns=<n>,reset=<addr>,uart=<addr>,hold=<ps>"
+ * runs the software on the ISS, directly on the public Verilated memories
+ * listed in LITEX_SIM_FF_MEMS="<mem>:<base>,...", until pc is reached or n
+ * instructions were executed. The architectural state is then handed to the
+ * RTL CPU by a trampoline written at the reset address, which loads the CSRs
+ * and registers and mret's to the ISS pc. The original words are put back
+ * after hold ps, once the CPU has left the trampoline.
+ */
+
+#define FF_TRAMPOLINE_MAX 128
+
+static struct iss_s iss;
+static uint32_t ff_reset;
+static uint32_t ff_saved[FF_TRAMPOLINE_MAX];
+static int ff_nsaved=0;
+static uint64_t ff_restore_ps=0;
+
+static const uint32_t ff_csrs[] = {
+  ISS_CSR_MTVEC,
+  ISS_CSR_MSCRATCH,
+  ISS_CSR_MIE,
+  0xbc0, /* VexRiscv interrupt mask */
+};
+
+static inline void ff_li(uint32_t *code, int *n, uint32_t rd, uint32_t v)
+{
+  uint32_t hi = ((v + 0x800) >> 12) & 0xfffff;
+
+  code[(*n)++] = (hi << 12) | (rd << 7) | 0x37;                  /* lui rd, hi */
+  code[(*n)++] = ((v & 0xfff) << 20) | (rd << 15) | (rd << 7) | 0x13; /* addi rd, rd, lo */
+}
+
+static inline void ff_csrw(uint32_t *code, int *n, uint32_t csr, uint32_t v)
+{
+  ff_li(code, n, 1, v);
+  code[(*n)++] = (csr << 20) | (1 << 15) | (1 << 12) | 0x73;     /* csrrw x0, csr, x1 */
+}
+
+static int ff_trampoline(uint32_t *code)
+{
+  uint32_t mstatus;
+  int n = 0;
+  unsigned int i;
+
+  for(i = 0; i < sizeof(ff_csrs) / sizeof(ff_csrs[0]); i++)
+  {
+    if(iss.csr[ff_csrs[i]])
+      ff_csrw(code, &n, ff_csrs[i], iss.csr[ff_csrs[i]]);
+  }
+  /* mret restores MIE from MPIE, and returns to machine mode */
+  mstatus = iss.csr[ISS_CSR_MSTATUS];
+  mstatus = (mstatus & ~(1 << 3) & ~(1 << 7)) | (3 << 11) | ((mstatus & (1 << 3)) << 4);
+  ff_csrw(code, &n, ISS_CSR_MSTATUS, mstatus);
+  ff_csrw(code, &n, ISS_CSR_MEPC, iss.pc);
+  for(i = 1; i < 32; i++)
+  {
+    ff_li(code, &n, i, iss.x[i]);
+  }
+  code[n++] = 0x30200073; /* mret */
+  return n;
+}
+
+static int ff_parse_mems(char *list)
+{
+  char *entry, *saveptr, *base;
+  uint8_t *data;
+  uint32_t width, ent, size;
+
+  for(entry = strtok_r(list, ",", &saveptr); entry; entry = strtok_r(NULL, ",", &saveptr))
+  {
+    base = strchr(entry, ':');
+    if(!base)
+    {
+      eprintf("[fastforward] invalid memory %s, expected <mem>:<base>\n", entry);
+      return RC_ERROR;
+    }
+    *base++ = 0;
+    if(litex_sim_find_mem(entry, &data, &width, &ent, &size))
+    {
+      eprintf("[fastforward] memory %s not found, is it public?\n", entry);
+      return RC_ERROR;
+    }
+    if(RC_OK != iss_add_mem(&iss, strtoul(base, NULL, 0), size, data, width, ent))
+      return RC_ERROR;
+  }
+  return RC_OK;
+}
+
+static int ff_parse_args(char *list, uint32_t *stop_pc, uint64_t *max_insns)
+{
+  char *entry, *saveptr, *value;
+
+  for(entry = strtok_r(list, ",", &saveptr); entry; entry = strtok_r(NULL, ",", &saveptr))
+  {
+    value = strchr(entry, '=');
+    if(!value)
+    {
+      eprintf("[fastforward] invalid argument %s, expected <name>=<value>\n", entry);
+      return RC_ERROR;
+    }
+    *value++ = 0;
+    if(!strcmp(entry, "pc"))
+      *stop_pc = strtoul(value, NULL, 0);
+    else if(!strcmp(entry, "insns"))
+      *max_insns = strtoull(value, NULL, 0);
+    else if(!strcmp(entry, "reset"))
+      ff_reset = strtoul(value, NULL, 0);
+    else if(!strcmp(entry, "uart"))
+      iss.uart = strtoul(value, NULL, 0);
+    else if(!strcmp(entry, "hold"))
+      ff_restore_ps = strtoull(value, NULL, 0);
+    else
+    {
+      eprintf("[fastforward] unknown argument %s\n", entry);
+      return RC_ERROR;
+    }
+  }
+  return RC_OK;
+}
+
+int litex_sim_fast_forward(void *vsim)
+{
+  static const char *reasons[] = {"pc reached", "instruction count reached", "unsupported instruction"};
+  char *env = getenv("LITEX_SIM_FF");
+  char *mems = getenv("LITEX_SIM_FF_MEMS");
+  char *args = NULL;
+  uint32_t code[FF_TRAMPOLINE_MAX];
+  uint32_t stop_pc = 0xffffffff;
+  uint64_t max_insns = UINT64_MAX;
+  iss_stop_t stop;
+  int ret = RC_OK;
+  int i, n;
+
+  if(!env)
+    return RC_OK;
+
+  /* Let the initial blocks load the memory init files first */
+  litex_sim_eval(vsim, 0);
+
+  ff_restore_ps = 10000000000ULL;
+  args = strdup(env);
+  mems = strdup(mems ? mems : "");
+  if(RC_OK != (ret = ff_parse_args(args, &stop_pc, &max_insns)) ||
+     RC_OK != (ret = ff_parse_mems(mems)))
+  {
+    goto out;
+  }
+
+  iss_reset(&iss, ff_reset);
+  stop = iss_run(&iss, stop_pc, max_insns);
+  printf("[fastforward] %s at pc 0x%08x after %lu instructions\n", reasons[stop], iss.pc, (unsigned long)iss.insns);
+
+  n = ff_trampoline(code);
+  if(iss.pc - ff_reset < (uint32_t)n * 4)
+  {
+    eprintf("[fastforward] pc 0x%08x lies in the trampoline, can't hand over\n", iss.pc);
+    ret = RC_ERROR;
+    goto out;
+  }
+  for(i = 0; i < n; i++)
+  {
+    if(RC_OK != iss_read32(&iss, ff_reset + 4 * i, &ff_saved[i]) ||
+       RC_OK != iss_write32(&iss, ff_reset + 4 * i, code[i]))
+    {
+      eprintf("[fastforward] reset address 0x%08x is not in a fast-forward memory\n", ff_reset);
+      ret = RC_ERROR;
+      goto out;
+    }
+  }
+  ff_nsaved = n;
+out:
+  free(args);
+  free(mems);
+  return ret;
+}
+
+void litex_sim_fast_forward_restore(uint64_t time_ps)
+{
+  int i;
+
+  if(!ff_nsaved || time_ps < ff_restore_ps)
+    return;
+  for(i = 0; i < ff_nsaved; i++)
+  {
+    iss_write32(&iss, ff_reset + 4 * i, ff_saved[i]);
+  }
+  ff_nsaved = 0;
+}
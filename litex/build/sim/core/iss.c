@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <string.h>
+#include "error.h"
+#include "iss.h"
+
+/* UART CSRs (32-bit CSR data width) */
+#define UART_RXTX 0x00
+#define UART_RXEMPTY 0x08
+
+void iss_reset(struct iss_s *iss, uint32_t pc)
+{
+  int nmems = iss->nmems;
+  struct iss_mem_s mems[ISS_MAX_MEMS];
+  uint32_t uart = iss->uart;
+
+  memcpy(mems, iss->mems, sizeof(mems));
+  memset(iss, 0, sizeof(struct iss_s));
+  memcpy(iss->mems, mems, sizeof(mems));
+  iss->nmems = nmems;
+  iss->uart = uart;
+  iss->pc = pc;
+  /* Machine mode only */
+  iss->csr[ISS_CSR_MSTATUS] = 3 << 11;
+}
+
+int iss_add_mem(struct iss_s *iss, uint32_t base, uint32_t size, uint8_t *data, uint32_t width, uint32_t ent)
+{
+  struct iss_mem_s *m;
+
+  if(iss->nmems == ISS_MAX_MEMS)
+  {
+    eprintf("Too many fast-forward memories\n");
+    return RC_ERROR;
+  }
+  m = &iss->mems[iss->nmems++];
+  m->base = base;
+  m->size = size;
+  m->data = data;
+  m->width = width;
+  m->ent = ent;
+  return RC_OK;
+}
+
+static inline uint8_t *iss_byte(struct iss_s *iss, uint32_t addr)
+{
+  struct iss_mem_s *m;
+  uint32_t off;
+  int i;
+
+  for(i = 0; i < iss->nmems; i++)
+  {
+    m = &iss->mems[i];
+    off = addr - m->base;
+    if(off < m->size)
+      return m->data + (off / m->width) * m->ent + off % m->width;
+  }
+  return NULL;
+}
+
+static inline uint32_t iss_load(struct iss_s *iss, uint32_t addr, int size)
+{
+  uint32_t value = 0;
+  uint8_t *p;
+  int i;
+
+  for(i = 0; i < size; i++)
+  {
+    p = iss_byte(iss, addr + i);
+    if(!p)
+      break;
+    value |= (uint32_t)*p << (8 * i);
+  }
+  if(i == size)
+    return value;
+
+  /* Peripherals read as 0, except the UART which never has data */
+  if(iss->uart && addr == iss->uart + UART_RXEMPTY)
+    return 1;
+  return 0;
+}
+
+static inline void iss_store(struct iss_s *iss, uint32_t addr, int size, uint32_t value)
+{
+  uint8_t *p;
+  int i;
+
+  if(iss->uart && addr == iss->uart + UART_RXTX)
+  {
+    putchar(value & 0xff);
+    fflush(stdout);
+    return;
+  }
+  for(i = 0; i < size; i++)
+  {
+    p = iss_byte(iss, addr + i);
+    if(p)
+      *p = value >> (8 * i);
+  }
+}
+
+int iss_read32(struct iss_s *iss, uint32_t addr, uint32_t *value)
+{
+  *value = iss_load(iss, addr, 4);
+  return iss_byte(iss, addr) ? RC_OK : RC_ERROR;
+}
+
+int iss_write32(struct iss_s *iss, uint32_t addr, uint32_t value)
+{
+  if(!iss_byte(iss, addr) || !iss_byte(iss, addr + 3))
+    return RC_ERROR;
+  iss_store(iss, addr, 4, value);
+  return RC_OK;
+}
+
+static inline uint32_t iss_csr_read(struct iss_s *iss, uint32_t csr)
+{
+  switch(csr)
+  {
+    /* cycle/instret and their machine mode aliases count instructions */
+    case 0xc00: case 0xc02: case 0xb00: case 0xb02:
+      return iss->insns;
+    case 0xc80: case 0xc82: case 0xb80: case 0xb82:
+      return iss->insns >> 32;
+    case 0xf14:
+      return 0;
+    default:
+      return iss->csr[csr];
+  }
+}
+
+static inline uint32_t iss_mulh(int64_t a, int64_t b)
+{
+  return (uint64_t)(a * b) >> 32;
+}
+
+static inline int iss_muldiv(uint32_t funct3, uint32_t a, uint32_t b, uint32_t *rd)
+{
+  switch(funct3)
+  {
+    case 0: *rd = a * b; break;
+    case 1: *rd = iss_mulh((int32_t)a, (int32_t)b); break;
+    case 2: *rd = ((__int128)(int32_t)a * (uint64_t)b) >> 32; break;
+    case 3: *rd = ((uint64_t)a * b) >> 32; break;
+    case 4:
+      if(b == 0)
+        *rd = 0xffffffff;
+      else if(a == 0x80000000 && b == 0xffffffff)
+        *rd = a;
+      else
+        *rd = (int32_t)a / (int32_t)b;
+      break;
+    case 5: *rd = b ? a / b : 0xffffffff; break;
+    case 6:
+      if(b == 0)
+        *rd = a;
+      else if(a == 0x80000000 && b == 0xffffffff)
+        *rd = 0;
+      else
+        *rd = (int32_t)a % (int32_t)b;
+      break;
+    case 7: *rd = b ? a % b : a; break;
+  }
+  return RC_OK;
+}
+
+static inline int iss_amo(struct iss_s *iss, uint32_t insn, uint32_t addr, uint32_t src, uint32_t *rd)
+{
+  uint32_t funct5 = insn >> 27;
+  uint32_t old;
+  uint32_t new;
+
+  if(((insn >> 12) & 7) != 2)
+    return RC_ERROR;
+
+  switch(funct5)
+  {
+    case 0x02: /* lr.w */
+      *rd = iss_load(iss, addr, 4);
+      iss->reservation = addr;
+      iss->reserved = 1;
+      return RC_OK;
+    case 0x03: /* sc.w */
+      if(iss->reserved && iss->reservation == addr)
+      {
+        iss_store(iss, addr, 4, src);
+        *rd = 0;
+      }
+      else
+      {
+        *rd = 1;
+      }
+      iss->reserved = 0;
+      return RC_OK;
+  }
+
+  old = iss_load(iss, addr, 4);
+  switch(funct5)
+  {
+    case 0x01: new = src; break;
+    case 0x00: new = old + src; break;
+    case 0x04: new = old ^ src; break;
+    case 0x0c: new = old & src; break;
+    case 0x08: new = old | src; break;
+    case 0x10: new = (int32_t)old < (int32_t)src ? old : src; break;
+    case 0x14: new = (int32_t)old > (int32_t)src ? old : src; break;
+    case 0x18: new = old < src ? old : src; break;
+    case 0x1c: new = old > src ? old : src; break;
+    default: return RC_ERROR;
+  }
+  iss_store(iss, addr, 4, new);
+  *rd = old;
+  return RC_OK;
+}
+
+/* Executes up to max_insns instructions or until pc reaches stop_pc. Any
+ * instruction the ISS doesn't model (compressed, traps, wfi, ...) stops it
+ * with pc pointing at that instruction, for the RTL CPU to execute. */
+iss_stop_t iss_run(struct iss_s *iss, uint32_t stop_pc, uint64_t max_insns)
+{
+  uint32_t insn, opcode, rd, rs1, rs2, funct3, funct7;
+  uint32_t a, b, v, imm, next_pc, csr;
+  int32_t simm;
+
+  while(iss->insns < max_insns)
+  {
+    if(iss->pc == stop_pc)
+      return ISS_STOP_PC;
+
+    insn = iss_load(iss, iss->pc, 4);
+    if((insn & 3) != 3 || !iss_byte(iss, iss->pc))
+      return ISS_STOP_UNSUPPORTED;
+
+    opcode = insn & 0x7f;
+    rd = (insn >> 7) & 0x1f;
+    funct3 = (insn >> 12) & 7;
+    rs1 = (insn >> 15) & 0x1f;
+    rs2 = (insn >> 20) & 0x1f;
+    funct7 = insn >> 25;
+    a = iss->x[rs1];
+    b = iss->x[rs2];
+    next_pc = iss->pc + 4;
+    v = 0;
+
+    switch(opcode)
+    {
+      case 0x37: /* lui */
+        v = insn & 0xfffff000;
+        break;
+      case 0x17: /* auipc */
+        v = iss->pc + (insn & 0xfffff000);
+        break;
+      case 0x6f: /* jal */
+        simm = ((int32_t)(insn & 0x80000000) >> 11) | (insn & 0xff000) | ((insn >> 9) & 0x800) | ((insn >> 20) & 0x7fe);
+        v = next_pc;
+        next_pc = iss->pc + simm;
+        break;
+      case 0x67: /* jalr */
+        v = next_pc;
+        next_pc = (a + ((int32_t)insn >> 20)) & ~1;
+        break;
+      case 0x63: /* branches */
+        simm = ((int32_t)(insn & 0x80000000) >> 19) | ((insn << 4) & 0x800) | ((insn >> 20) & 0x7e0) | ((insn >> 7) & 0x1e);
+        switch(funct3)
+        {
+          case 0: v = a == b; break;
+          case 1: v = a != b; break;
+          case 4: v = (int32_t)a < (int32_t)b; break;
+          case 5: v = (int32_t)a >= (int32_t)b; break;
+          case 6: v = a < b; break;
+          case 7: v = a >= b; break;
+          default: return ISS_STOP_UNSUPPORTED;
+        }
+        if(v)
+          next_pc = iss->pc + simm;
+        rd = 0;
+        break;
+      case 0x03: /* loads */
+        imm = a + ((int32_t)insn >> 20);
+        switch(funct3)
+        {
+          case 0: v = (int8_t)iss_load(iss, imm, 1); break;
+          case 1: v = (int16_t)iss_load(iss, imm, 2); break;
+          case 2: v = iss_load(iss, imm, 4); break;
+          case 4: v = iss_load(iss, imm, 1); break;
+          case 5: v = iss_load(iss, imm, 2); break;
+          default: return ISS_STOP_UNSUPPORTED;
+        }
+        break;
+      case 0x23: /* stores */
+        imm = a + (((int32_t)insn >> 20 & ~0x1f) | rd);
+        if(funct3 > 2)
+          return ISS_STOP_UNSUPPORTED;
+        iss_store(iss, imm, 1 << funct3, b);
+        if(iss->reserved && (imm & ~3) == iss->reservation)
+          iss->reserved = 0;
+        rd = 0;
+        break;
+      case 0x13: /* alu immediate */
+        simm = (int32_t)insn >> 20;
+        switch(funct3)
+        {
+          case 0: v = a + simm; break;
+          case 2: v = (int32_t)a < simm; break;
+          case 3: v = a < (uint32_t)simm; break;
+          case 4: v = a ^ simm; break;
+          case 6: v = a | simm; break;
+          case 7: v = a & simm; break;
+          case 1: v = a << rs2; break;
+          case 5: v = funct7 & 0x20 ? (uint32_t)((int32_t)a >> rs2) : a >> rs2; break;
+        }
+        break;
+      case 0x33: /* alu register */
+        if(funct7 == 1)
+        {
+          iss_muldiv(funct3, a, b, &v);
+          break;
+        }
+        switch(funct3)
+        {
+          case 0: v = funct7 & 0x20 ? a - b : a + b; break;
+          case 1: v = a << (b & 0x1f); break;
+          case 2: v = (int32_t)a < (int32_t)b; break;
+          case 3: v = a < b; break;
+          case 4: v = a ^ b; break;
+          case 5: v = funct7 & 0x20 ? (uint32_t)((int32_t)a >> (b & 0x1f)) : a >> (b & 0x1f); break;
+          case 6: v = a | b; break;
+          case 7: v = a & b; break;
+        }
+        break;
+      case 0x2f: /* atomics */
+        if(RC_OK != iss_amo(iss, insn, a, b, &v))
+          return ISS_STOP_UNSUPPORTED;
+        break;
+      case 0x0f: /* fence, fence.i */
+        rd = 0;
+        break;
+      case 0x73: /* system */
+        if(funct3 == 0 || funct3 == 4)
+          return ISS_STOP_UNSUPPORTED;
+        csr = insn >> 20;
+        v = iss_csr_read(iss, csr);
+        imm = funct3 & 4 ? rs1 : a;
+        switch(funct3 & 3)
+        {
+          case 1: iss->csr[csr] = imm; break;
+          case 2: if(rs1) iss->csr[csr] = v | imm; break;
+          case 3: if(rs1) iss->csr[csr] = v & ~imm; break;
+        }
+        break;
+      default:
+        return ISS_STOP_UNSUPPORTED;
+    }
+
+    if(rd)
+      iss->x[rd] = v;
+    iss->pc = next_pc;
+    iss->insns++;
+  }
+  return ISS_STOP_INSNS;
+}
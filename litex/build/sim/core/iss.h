@@ -0,0 +1,57 @@
+#ifndef __ISS_H_
+#define __ISS_H_
+
+#include <stdint.h>
+
+/* Minimal RV32IMA machine mode instruction set simulator, used to fast
+ * forward the simulated software before handing over to the RTL CPU. */
+
+#define ISS_MAX_MEMS 8
+
+#define ISS_CSR_MSTATUS 0x300
+#define ISS_CSR_MIE 0x304
+#define ISS_CSR_MTVEC 0x305
+#define ISS_CSR_MSCRATCH 0x340
+#define ISS_CSR_MEPC 0x341
+#define ISS_CSR_MCAUSE 0x342
+#define ISS_CSR_MTVAL 0x343
+
+struct iss_mem_s {
+  uint32_t base;
+  uint32_t size;
+  uint8_t *data;
+  /* Words of width bytes stored in ent bytes wide elements */
+  uint32_t width;
+  uint32_t ent;
+};
+
+typedef enum iss_stop {
+  ISS_STOP_PC,
+  ISS_STOP_INSNS,
+  ISS_STOP_UNSUPPORTED,
+} iss_stop_t;
+
+struct iss_s {
+  uint32_t x[32];
+  uint32_t pc;
+  uint32_t csr[4096];
+  uint64_t insns;
+  uint32_t reservation;
+  int reserved;
+  /* Base of the UART CSRs, TX writes are printed, RX always reads empty */
+  uint32_t uart;
+  int nmems;
+  struct iss_mem_s mems[ISS_MAX_MEMS];
+};
+
+void iss_reset(struct iss_s *iss, uint32_t pc);
+int iss_add_mem(struct iss_s *iss, uint32_t base, uint32_t size, uint8_t *data, uint32_t width, uint32_t ent);
+iss_stop_t iss_run(struct iss_s *iss, uint32_t stop_pc, uint64_t max_insns);
+int iss_write32(struct iss_s *iss, uint32_t addr, uint32_t value);
+int iss_read32(struct iss_s *iss, uint32_t addr, uint32_t *value);
+
+/* Fast-forward, see fastforward.c */
+int litex_sim_fast_forward(void *vsim);
+void litex_sim_fast_forward_restore(uint64_t time_ps);
+
+#endif
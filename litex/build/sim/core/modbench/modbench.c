@@ -0,0 +1,500 @@
+/*
+ * Standalone microbenchmark of the sim modules: loads a module .so through
+ * litex_sim_ext_module_init() like the simulator, binds it to synthetic
+ * pads, runs its tick() under a clock the harness drives (or the module
+ * drives, for clockers) and reports the cost of a tick, without Verilator
+ * nor a SoC. The I/O thread runs the libevent loop as in the simulator.
+ *
+ *   modbench [-a args] [-i iface,...] [-p iface=pad:bits,...] [-d iface.pad=mode]
+ *            [-n cycles] [-f freq_hz] [-t timebase_ps] [-j] module.so
+ *
+ * The module gets sys_clk and the interfaces given with -i (predefined for
+ * the modules of the tree: serial, eth, xgmii_eth, gmii_eth, i2c) or -p.
+ * -d drives an input pad on every rising edge: counter, random, toggle or a
+ * constant value. The cost of a tick is the difference with the same loop
+ * calling an empty tick().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <event2/event.h>
+#include "error.h"
+#include "modules.h"
+#include "pads.h"
+
+#define MODBENCH_MAX_IFACES 16
+#define MODBENCH_MAX_PADS 32
+#define MODBENCH_MAX_DRIVES 16
+
+struct iface_s
+{
+  char *name;
+  int index;
+  int used;
+  struct pad_s pads[MODBENCH_MAX_PADS + 1];
+};
+
+enum drive_mode { DRIVE_CONST, DRIVE_COUNTER, DRIVE_RANDOM, DRIVE_TOGGLE };
+
+struct drive_s
+{
+  struct pad_s *pad;
+  size_t size;
+  uint64_t mask;
+  enum drive_mode mode;
+  uint64_t value;
+};
+
+/* Interfaces of the modules of the tree, as litex_sim defines them */
+static const char *presets[] = {
+  "sys_clk=sys_clk:1",
+  "serial=sink_data:8,sink_valid:1,sink_ready:1,source_data:8,source_valid:1,source_ready:1",
+  "eth=sink_data:8,sink_valid:1,sink_ready:1,source_data:8,source_valid:1,source_ready:1",
+  "xgmii_eth=rx_data:64,rx_ctl:8,tx_data:64,tx_ctl:8",
+  "gmii_eth=rx_data:8,rx_dv:1,rx_er:1,tx_data:8,tx_en:1,tx_er:1",
+  "i2c=scl:1,sda_in:1,sda_out:1",
+  NULL
+};
+
+static struct iface_s ifaces[MODBENCH_MAX_IFACES];
+static int nifaces;
+/* Set while the presets are added, unused unless given with -i */
+static int nifaces_preset;
+static struct drive_s drives[MODBENCH_MAX_DRIVES];
+static int ndrives;
+
+static struct ext_module_s *module;
+static void *session;
+static struct event_base *base;
+static atomic_int bench_done;
+
+static uint64_t cycles = 1000000;
+static uint64_t freq_hz = 100000000;
+static uint64_t timebase_ps;
+static int json;
+
+/* External definitions for the clock edge helpers when not inlined */
+extern bool clk_pos_edge(clk_edge_state_t *edge_state, int new_clk);
+extern bool clk_neg_edge(clk_edge_state_t *edge_state, int new_clk);
+extern clk_edge_t clk_edge(clk_edge_state_t *edge_state, int new_clk);
+
+static inline uint64_t modbench_time_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Bytes of the Verilator storage of a signal */
+static size_t modbench_storage(size_t bits)
+{
+  if(bits <= 8)
+    return 1;
+  if(bits <= 16)
+    return 2;
+  if(bits <= 32)
+    return 4;
+  if(bits <= 64)
+    return 8;
+  return 4 * ((bits + 31) / 32);
+}
+
+/* "iface[:index]=pad:bits,..." */
+static int modbench_add_iface(const char *spec)
+{
+  struct iface_s *it;
+  char *s, *p, *pad, *save;
+  int n = 0;
+  int i;
+
+  s = strdup(spec);
+  p = strchr(s, '=');
+  if(!p)
+  {
+    eprintf("Invalid interface %s\n", spec);
+    return RC_INVARG;
+  }
+  *p++ = 0;
+  it = NULL;
+  for(i = 0; i < nifaces; i++)
+  {
+    if(!strcmp(ifaces[i].name, s))
+      it = &ifaces[i];
+  }
+  if(!it)
+  {
+    if(nifaces == MODBENCH_MAX_IFACES)
+    {
+      eprintf("Too many interfaces\n");
+      return RC_ERROR;
+    }
+    it = &ifaces[nifaces++];
+  }
+  memset(it, 0, sizeof(*it));
+  pad = strchr(s, ':');
+  if(pad)
+  {
+    *pad++ = 0;
+    it->index = atoi(pad);
+  }
+  it->name = s;
+  it->used = !nifaces_preset;
+  for(pad = strtok_r(p, ",", &save); pad; pad = strtok_r(NULL, ",", &save))
+  {
+    if(n == MODBENCH_MAX_PADS)
+    {
+      eprintf("Too many pads in %s\n", spec);
+      return RC_ERROR;
+    }
+    it->pads[n].name = pad;
+    it->pads[n].len = 1;
+    if((p = strchr(pad, ':')))
+    {
+      *p++ = 0;
+      it->pads[n].len = atoi(p);
+    }
+    it->pads[n].signal = aligned_alloc(8, (modbench_storage(it->pads[n].len) + 7) & ~7);
+    memset(it->pads[n].signal, 0, modbench_storage(it->pads[n].len));
+    n++;
+  }
+  return RC_OK;
+}
+
+static struct pad_s *modbench_find_pad(const char *iface, const char *name)
+{
+  struct pad_s *p;
+  int i;
+
+  for(i = 0; i < nifaces; i++)
+  {
+    if(strcmp(ifaces[i].name, iface))
+      continue;
+    for(p = ifaces[i].pads; p->name; p++)
+    {
+      if(!strcmp(p->name, name))
+        return p;
+    }
+  }
+  return NULL;
+}
+
+static int modbench_use_ifaces(const char *list)
+{
+  char *s, *name, *save;
+  int i;
+
+  s = strdup(list);
+  for(name = strtok_r(s, ",", &save); name; name = strtok_r(NULL, ",", &save))
+  {
+    for(i = 0; i < nifaces; i++)
+    {
+      if(!strcmp(ifaces[i].name, name))
+        break;
+    }
+    if(i == nifaces)
+    {
+      eprintf("Unknown interface %s, define its pads with -p\n", name);
+      return RC_INVARG;
+    }
+    ifaces[i].used = 1;
+  }
+  free(s);
+  return RC_OK;
+}
+
+/* "iface.pad=counter|random|toggle|<value>" */
+static int modbench_add_drive(const char *spec)
+{
+  struct drive_s *d;
+  char *s, *pad, *mode;
+
+  if(ndrives == MODBENCH_MAX_DRIVES)
+  {
+    eprintf("Too many driven pads\n");
+    return RC_ERROR;
+  }
+  s = strdup(spec);
+  pad = strchr(s, '.');
+  mode = strchr(s, '=');
+  if(!pad || !mode || mode < pad)
+  {
+    eprintf("Invalid drive %s\n", spec);
+    return RC_INVARG;
+  }
+  *pad++ = 0;
+  *mode++ = 0;
+  d = &drives[ndrives];
+  d->pad = modbench_find_pad(s, pad);
+  if(!d->pad)
+  {
+    eprintf("Unknown pad %s.%s\n", s, pad);
+    return RC_INVARG;
+  }
+  d->size = modbench_storage(d->pad->len);
+  if(d->size > 8)
+    d->size = 8;
+  d->mask = d->pad->len < 64 ? (1ull << d->pad->len) - 1 : ~0ull;
+  d->value = 0;
+  if(!strcmp(mode, "counter"))
+    d->mode = DRIVE_COUNTER;
+  else if(!strcmp(mode, "random"))
+  {
+    d->mode = DRIVE_RANDOM;
+    d->value = 0x9e3779b97f4a7c15ull;
+  }
+  else if(!strcmp(mode, "toggle"))
+    d->mode = DRIVE_TOGGLE;
+  else
+  {
+    d->mode = DRIVE_CONST;
+    d->value = strtoull(mode, NULL, 0);
+  }
+  ndrives++;
+  return RC_OK;
+}
+
+static inline void modbench_drive(void)
+{
+  struct drive_s *d;
+  uint64_t v;
+  int i;
+
+  for(i = 0; i < ndrives; i++)
+  {
+    d = &drives[i];
+    switch(d->mode)
+    {
+      case DRIVE_COUNTER:
+        d->value++;
+        break;
+      case DRIVE_RANDOM:
+        d->value ^= d->value << 13;
+        d->value ^= d->value >> 7;
+        d->value ^= d->value << 17;
+        break;
+      case DRIVE_TOGGLE:
+        d->value ^= 1;
+        break;
+      default:
+        break;
+    }
+    /* Little endian hosts: the low bytes of the value */
+    v = d->value & d->mask;
+    memcpy(d->pad->signal, &v, d->size);
+  }
+}
+
+static int modbench_null_tick(void *sess, uint64_t time_ps)
+{
+  return RC_OK;
+}
+
+/* Runs cycles clock cycles calling tick() as the core does, returns ns */
+static uint64_t modbench_loop(int (*tick)(void *, uint64_t), clk_edge_t edge, char *clk,
+  int module_clock, uint64_t *calls)
+{
+  clk_edge_state_t state = { 0 };
+  uint64_t time_ps = 0;
+  uint64_t start, n = 0;
+  uint64_t steps = 2 * cycles;
+  clk_edge_t e;
+  uint64_t i;
+
+  start = modbench_time_ns();
+  for(i = 0; i < steps; i++)
+  {
+    time_ps += timebase_ps;
+    if(!module_clock)
+      *clk = !*clk;
+    if(edge == CLK_EDGE_NONE)
+    {
+      /* No clock domain: ticked at every timestep */
+      tick(session, time_ps);
+      n++;
+      continue;
+    }
+    e = clk_edge(&state, *clk);
+    if(e == CLK_EDGE_RISING)
+      modbench_drive();
+    if(e & edge)
+    {
+      tick(session, time_ps);
+      n++;
+    }
+  }
+  *calls = n;
+  return modbench_time_ns() - start;
+}
+
+static void *modbench_thread(void *arg)
+{
+  clk_edge_t edge = CLK_EDGE_NONE;
+  char *clk = NULL;
+  int module_clock;
+  uint64_t warmup, calls, base_calls;
+  uint64_t ns, base_ns;
+  double per_tick;
+
+  if(module->clock_domain && RC_OK != module->clock_domain(session, &clk, &edge))
+  {
+    eprintf("Module %s did not report a clock signal\n", module->name);
+    goto out;
+  }
+  /* Clockers drive sys_clk themselves */
+  module_clock = !module->clock_domain;
+  if(!clk)
+    clk = (char *)modbench_find_pad("sys_clk", "sys_clk")->signal;
+
+  warmup = cycles;
+  cycles = warmup / 100 + 1;
+  modbench_loop(module->tick, edge, clk, module_clock, &calls);
+  cycles = warmup;
+  ns = modbench_loop(module->tick, edge, clk, module_clock, &calls);
+  base_ns = modbench_loop(modbench_null_tick, edge, clk, module_clock, &base_calls);
+  per_tick = calls ? ((double)ns - (double)base_ns) / calls : 0;
+  if(per_tick < 0)
+    per_tick = 0;
+
+  if(json)
+    printf("{\"module\": \"%s\", \"cycles\": %llu, \"ticks\": %llu, \"ns\": %llu, "
+      "\"baseline_ns\": %llu, \"ns_per_tick\": %.2f}\n", module->name,
+      (unsigned long long)cycles, (unsigned long long)calls, (unsigned long long)ns,
+      (unsigned long long)base_ns, per_tick);
+  else
+    printf("[modbench] %s: %llu ticks in %.3f ms (loop %.3f ms), %.2f ns/tick\n",
+      module->name, (unsigned long long)calls, ns / 1e6, base_ns / 1e6, per_tick);
+out:
+  atomic_store(&bench_done, 1);
+  return NULL;
+}
+
+static void modbench_poll(int sock, short which, void *arg)
+{
+  if(atomic_load(&bench_done))
+    event_base_loopbreak(base);
+}
+
+static int modbench_register(struct ext_module_s *mod)
+{
+  if(module)
+  {
+    eprintf("Only one module per library is benchmarked\n");
+    return RC_ERROR;
+  }
+  module = mod;
+  return RC_OK;
+}
+
+static void modbench_usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-a args] [-i iface,...] [-p iface[:index]=pad:bits,...]\n"
+    "          [-d iface.pad=counter|random|toggle|value] [-n cycles] [-f freq_hz]\n"
+    "          [-t timebase_ps] [-j] module.so\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+  int (*init)(int (*reg)(struct ext_module_s *));
+  const char *drive_specs[MODBENCH_MAX_DRIVES];
+  struct pad_list_s *plist, *pl;
+  struct event *ev;
+  struct timeval tv = {0, 10000};
+  pthread_t thread;
+  char *args = "";
+  void *lib;
+  int ndrive_specs = 0;
+  int ret = RC_OK;
+  int i, c;
+
+  nifaces_preset = 1;
+  for(i = 0; presets[i]; i++)
+    modbench_add_iface(presets[i]);
+  nifaces_preset = 0;
+  ifaces[0].used = 1;
+  while((c = getopt(argc, argv, "a:i:p:d:n:f:t:j")) != -1)
+  {
+    switch(c)
+    {
+      case 'a': args = optarg; break;
+      case 'i': if(RC_OK != modbench_use_ifaces(optarg)) return 1; break;
+      case 'p': if(RC_OK != modbench_add_iface(optarg)) return 1; break;
+      case 'd':
+        if(ndrive_specs == MODBENCH_MAX_DRIVES)
+          return 1;
+        drive_specs[ndrive_specs++] = optarg;
+        break;
+      case 'n': cycles = strtoull(optarg, NULL, 0); break;
+      case 'f': freq_hz = strtoull(optarg, NULL, 0); break;
+      case 't': timebase_ps = strtoull(optarg, NULL, 0); break;
+      case 'j': json = 1; break;
+      default: modbench_usage(argv[0]); return 1;
+    }
+  }
+  if(optind != argc - 1 || !cycles || !freq_hz)
+  {
+    modbench_usage(argv[0]);
+    return 1;
+  }
+  if(!timebase_ps)
+    timebase_ps = 500000000000ull / freq_hz;
+  /* The pads seen by add_pads() are set: drives resolved after -p */
+  for(i = 0; i < ndrive_specs; i++)
+  {
+    if(RC_OK != modbench_add_drive(drive_specs[i]))
+      return 1;
+  }
+
+  lib = dlopen(argv[optind], RTLD_NOW | RTLD_LOCAL);
+  if(!lib)
+  {
+    eprintf("Can't load %s: %s\n", argv[optind], dlerror());
+    return 1;
+  }
+  init = (int (*)(int (*)(struct ext_module_s *)))dlsym(lib, "litex_sim_ext_module_init");
+  if(!init || RC_OK != init(modbench_register) || !module)
+  {
+    eprintf("%s is not a sim module\n", argv[optind]);
+    return 1;
+  }
+
+  base = event_base_new();
+  for(i = 0; i < nifaces; i++)
+  {
+    if(ifaces[i].used)
+      litex_sim_register_pads(ifaces[i].pads, ifaces[i].name, ifaces[i].index);
+  }
+  if(module->start && RC_OK != (ret = module->start(base)))
+    goto out;
+  if(RC_OK != (ret = module->new_sess(&session, args)))
+    goto out;
+  litex_sim_pads_get_list(&plist);
+  for(pl = plist; pl; pl = pl->next)
+  {
+    if(RC_OK != (ret = module->add_pads(session, pl)))
+      goto out;
+  }
+
+  /* As in the simulator: the I/O thread (this one) owns the event base */
+  if(pthread_create(&thread, NULL, modbench_thread, NULL))
+  {
+    eprintf("Can't create benchmark thread\n");
+    ret = RC_ERROR;
+    goto out;
+  }
+  ev = event_new(base, -1, EV_PERSIST, modbench_poll, NULL);
+  event_add(ev, &tv);
+  event_base_dispatch(base);
+  pthread_join(thread, NULL);
+  if(module->close)
+    module->close(session);
+out:
+  return ret == RC_OK ? 0 : 1;
+}
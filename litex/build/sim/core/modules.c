@@ -16,6 +16,19 @@
 
 static struct ext_module_list_s *modlist=NULL;
 
+/* Modules linked into the simulator, see STATIC_MODULES in the Makefile */
+#ifndef LITEX_SIM_STATIC_MODULES
+#define LITEX_SIM_STATIC_MODULES
+#endif
+#define X(mod) int litex_sim_ext_module_init_##mod(int (*reg)(struct ext_module_s *));
+LITEX_SIM_STATIC_MODULES
+#undef X
+
+/* External definitions for the clock edge helpers when not inlined */
+extern bool clk_pos_edge(clk_edge_state_t *edge_state, int new_clk);
+extern bool clk_neg_edge(clk_edge_state_t *edge_state, int new_clk);
+extern clk_edge_t clk_edge(clk_edge_state_t *edge_state, int new_clk);
+
 int litex_sim_register_ext_module(struct ext_module_s *mod)
 {
   int ret=RC_OK;
@@ -43,25 +56,102 @@ out:
   return ret;
 }
 
-int litex_sim_load_ext_modules(struct ext_module_list_s **mlist)
+static int litex_sim_register_static_modules()
 {
   int ret = RC_OK;
-  tinydir_dir dir;
-  tinydir_file file;
+
+#define X(mod) if(RC_OK != (ret = litex_sim_ext_module_init_##mod(litex_sim_register_ext_module))) return ret;
+  LITEX_SIM_STATIC_MODULES
+#undef X
+  return ret;
+}
+
+static struct ext_module_s *litex_sim_registered(const char *name)
+{
+  struct ext_module_list_s *ml;
+
+  for(ml = modlist; ml; ml = ml->next)
+  {
+    if(!strcmp(name, ml->module->name))
+      return ml->module;
+  }
+  return NULL;
+}
+
+static int litex_sim_load_ext_module(char *name)
+{
   dylib_ref lib;
   int (*litex_sim_ext_module_init)(int (*reg)(struct ext_module_s *));
-  char name[300];
-  if (tinydir_open(&dir, "./modules/") == -1)
+
+  lib = libdylib_open(name);
+  if(!lib)
   {
-    ret = RC_ERROR;
-    eprintf("Error opening file");
-    goto out;
+    eprintf("Can't load library %s\n", libdylib_last_error());
+    return RC_ERROR;
+  }
+  if(!libdylib_find(lib, "litex_sim_ext_module_init"))
+  {
+    eprintf("Module has no litex_sim_ext_module_init function\n");
+    return RC_ERROR;
   }
+  LIBDYLIB_BINDNAME(lib, litex_sim_ext_module_init);
+  if(!litex_sim_ext_module_init)
+  {
+    eprintf("Can't bind %s\n", libdylib_last_error());
+    return RC_ERROR;
+  }
+  return litex_sim_ext_module_init(litex_sim_register_ext_module);
+}
+
+/* Only the modules referenced by the configuration are loaded, from
+ * ./modules/<name>.so. Should one of them be registered by a library named
+ * differently, the remaining libraries of ./modules are all loaded. */
+int litex_sim_load_ext_modules(struct module_s *used, struct ext_module_list_s **mlist)
+{
+  int ret = RC_OK;
+  tinydir_dir dir;
+  tinydir_file file;
+  struct module_s *m;
+  FILE *f;
+  int missing = 0;
+  char name[300];
   if(modlist)
   {
     ret=RC_ERROR;
     eprintf("modules already loaded !\n");
-    goto out;
+    return ret;
+  }
+  ret = litex_sim_register_static_modules();
+  if(RC_OK != ret)
+    return ret;
+  for(m = used; m; m = m->next)
+  {
+    if(litex_sim_registered(m->name))
+      continue;
+    snprintf(name, sizeof(name), "./modules/%s.%s", m->name, LIBEXT);
+    f = fopen(name, "rb");
+    if(f)
+    {
+      fclose(f);
+      ret = litex_sim_load_ext_module(name);
+      if(RC_OK != ret)
+        return ret;
+    }
+    if(!litex_sim_registered(m->name))
+      missing = 1;
+  }
+  *mlist = modlist;
+  if(!missing)
+    return RC_OK;
+
+  if (tinydir_open(&dir, "./modules/") == -1)
+  {
+    /* Fine when some modules are linked in, the missing ones are reported */
+    if(modlist)
+      return RC_OK;
+    ret = RC_ERROR;
+    eprintf("Error opening file");
+    return ret;
   }
   while(dir.has_next)
   {
@@ -73,32 +163,15 @@ int litex_sim_load_ext_modules(struct ext_module_list_s **mlist)
 
     if(!strcmp(file.extension, LIBEXT))
     {
-      sprintf(name, "./modules/%s", file.name);
-      lib = libdylib_open(name);
-      if(!lib)
-      {
-	ret = RC_ERROR;
-	eprintf("Can't load library %s\n", libdylib_last_error());
-	goto out;
-      }
-
-      if(!libdylib_find(lib, "litex_sim_ext_module_init"))
+      /* Skip the libraries loaded by name above */
+      snprintf(name, sizeof(name), "%s", file.name);
+      name[strlen(name) - strlen(LIBEXT) - 1] = 0;
+      if(!litex_sim_registered(name))
       {
-	ret = RC_ERROR;
-	eprintf("Module has no litex_sim_ext_module_init function\n");
-	goto out;
-      }
-      LIBDYLIB_BINDNAME(lib, litex_sim_ext_module_init);
-      if(!litex_sim_ext_module_init)
-      {
-	ret = RC_ERROR;
-	eprintf("Can't bind %s\n", libdylib_last_error());
-	goto out;
-      }
-      ret = litex_sim_ext_module_init(litex_sim_register_ext_module);
-      if(RC_OK != ret)
-      {
-	goto out;
+        snprintf(name, sizeof(name), "./modules/%s", file.name);
+        ret = litex_sim_load_ext_module(name);
+        if(RC_OK != ret)
+          goto out;
       }
     }
     if(-1 == tinydir_next(&dir))
@@ -119,10 +192,10 @@ int litex_sim_find_ext_module(struct ext_module_list_s *first, char *name , stru
   struct ext_module_list_s *list = NULL;
   int ret=RC_OK;
 
-  if(!first || !name || !found)
+  if(!name || !found)
   {
     ret = RC_INVARG;
-    eprintf("Invalid first:%s arg:%s found:%p\n", first->module->name, name, found);
+    eprintf("Invalid arg:%s found:%p\n", name, found);
     goto out;
   }
 
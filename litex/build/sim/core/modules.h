@@ -3,6 +3,7 @@
 #ifndef __MODULE_H_
 #define __MODULE_H_
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "pads.h"
@@ -11,6 +12,7 @@ typedef enum clk_edge {
     CLK_EDGE_NONE,
     CLK_EDGE_RISING,
     CLK_EDGE_FALLING,
+    CLK_EDGE_BOTH,
 } clk_edge_t;
 
 struct interface_s {
@@ -34,8 +36,43 @@ struct ext_module_s {
   int (*add_pads)(void *, struct pad_list_s *);
   int (*close)(void*);
   int (*tick)(void*, uint64_t);
+  /* Optional: report the clock signal and edge(s) tick() depends on. When
+   * provided, the core detects the edges itself and only calls tick() on
+   * them, so the module must not do its own edge detection. */
+  int (*clock_domain)(void *, char **, clk_edge_t *);
+  /* Optional (tickfirst modules): report the time of the next input change
+   * strictly after the given time, letting the core skip idle timesteps. */
+  int (*next_edge)(void *, uint64_t, uint64_t *);
+  /* Optional: non-zero while host data is buffered waiting for the
+   * simulation, making the core return to the event loop more often. */
+  int (*io_pending)(void *);
+  /* Optional: write/read the session state to/from a checkpoint. restore()
+   * is called after add_pads() and before the simulation starts. */
+  int (*save)(void *, FILE *);
+  int (*restore)(void *, FILE *);
+  /* EXT_MODULE_* flags */
+  unsigned int flags;
+  /* Optional: NULL terminated list of the signals an idle session waits on,
+   * called after add_pads(). Once tick() returns EXT_MODULE_IDLE, the core
+   * doesn't call it again until one of these signals changes. */
+  char **(*wake_signals)(void *);
+  /* Optional (sessions with a clock domain): report the number of cycles of
+   * the domain that can go by without evaluating the model, 0 when busy.
+   * When every such session allows it, the core only runs the clocks over
+   * these cycles (idle skipping), then calls skipped() with their number
+   * before the next evaluated edge. */
+  int (*idle)(void *, uint64_t *);
+  int (*skipped)(void *, uint64_t);
 };
 
+/* tick() only touches the session's own state and pads, so sessions may be
+ * ticked concurrently with the other sessions (not with the model eval). */
+#define EXT_MODULE_THREAD_SAFE (1 << 0)
+
+/* tick() return value: nothing to do until a wake signal changes */
+#define EXT_MODULE_IDLE 1
+#define EXT_MODULE_WAKE_MAX 8
+
 struct ext_module_list_s {
   struct ext_module_s *module;
   struct ext_module_list_s *next;
@@ -46,7 +83,7 @@ typedef struct clk_edge_state {
 } clk_edge_state_t;
 
 int litex_sim_file_parse(char *filename, struct module_s **mod, uint64_t *timebase);
-int litex_sim_load_ext_modules(struct ext_module_list_s **mlist);
+int litex_sim_load_ext_modules(struct module_s *used, struct ext_module_list_s **mlist);
 int litex_sim_find_ext_module(struct ext_module_list_s *first, char *name , struct ext_module_list_s **found);
 
 inline bool clk_pos_edge(clk_edge_state_t *edge_state, int new_clk) {
@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <json-c/json.h>
+#include "error.h"
+#include "modules.h"
+#include "args.h"
+
+/*
+ * Block device on a sector interface, backed by a disk image mapped in
+ * memory. The image is mapped privately by default: sectors written by the
+ * simulation land in copy-on-write pages and the image is left untouched.
+ * Sectors written can be kept in an overlay file, applied again when the
+ * next simulation starts, or written back to the image itself.
+ *
+ * Every signal driven by the RTL is registered, so that the values seen on
+ * the clock edge are the ones the RTL acted upon:
+ * - cmd_valid is high for one cycle with cmd_write/cmd_sector, the module
+ *   answers with error (sector out of the image) for the whole transfer.
+ * - Reads: the module presents the words of the sector on rd_data/rd_valid,
+ *   rd_ack is high on the cycle after each word is taken.
+ * - Writes: the RTL sends the words of the sector, one per wr_valid cycle.
+ * Sectors are transferred in full, as zeros/discarded on errors.
+ */
+
+#define SECTOR_SIZE 512
+#define OVERLAY_MAGIC 0x4c56424c /* "LBVL" */
+
+enum {
+  BLOCKDEV_IDLE,
+  BLOCKDEV_READ,
+  BLOCKDEV_WRITE,
+};
+
+struct session_s {
+  char *cmd_valid;
+  char *cmd_write;
+  uint32_t *cmd_sector;
+  char *error;
+  char *rd_valid;
+  char *rd_ack;
+  void *rd_data;
+  char *wr_valid;
+  void *wr_data;
+  char *sys_clk;
+  char *wake[2];
+  int data_bytes;
+  // Disk image
+  uint8_t *disk;
+  size_t size;
+  uint32_t nsectors;
+  uint8_t *dirty;
+  char *overlay;
+  int writeback;
+  // Sector transfer in progress
+  int state;
+  uint32_t sector;
+  uint32_t pos;
+};
+
+static int blockdev_start(void *b)
+{
+  printf("[blockdev] loaded\n");
+  return RC_OK;
+}
+
+static inline void blockdev_set_dirty(struct session_s *s, uint32_t sector)
+{
+  s->dirty[sector / 8] |= 1 << (sector % 8);
+}
+
+static inline int blockdev_is_dirty(struct session_s *s, uint32_t sector)
+{
+  return s->dirty[sector / 8] & (1 << (sector % 8));
+}
+
+/* Sector records: a 32-bit sector number followed by its data, ended by a
+ * 0xffffffff sector number. Used by both overlays and checkpoints. */
+static int blockdev_write_sectors(struct session_s *s, FILE *f)
+{
+  uint32_t i;
+
+  for(i = 0; i < s->nsectors; i++) {
+    if(!blockdev_is_dirty(s, i))
+      continue;
+    if(fwrite(&i, sizeof(i), 1, f) != 1 || fwrite(s->disk + (size_t)i * SECTOR_SIZE, SECTOR_SIZE, 1, f) != 1)
+      return RC_ERROR;
+  }
+  i = 0xffffffff;
+  if(fwrite(&i, sizeof(i), 1, f) != 1)
+    return RC_ERROR;
+  return RC_OK;
+}
+
+static int blockdev_read_sectors(struct session_s *s, FILE *f)
+{
+  uint8_t drop[SECTOR_SIZE];
+  uint32_t i;
+
+  for(;;) {
+    if(fread(&i, sizeof(i), 1, f) != 1)
+      return RC_ERROR;
+    if(i == 0xffffffff)
+      break;
+    if(i >= s->nsectors) {
+      if(fread(drop, SECTOR_SIZE, 1, f) != 1)
+        return RC_ERROR;
+      continue;
+    }
+    if(fread(s->disk + (size_t)i * SECTOR_SIZE, SECTOR_SIZE, 1, f) != 1)
+      return RC_ERROR;
+    blockdev_set_dirty(s, i);
+  }
+  return RC_OK;
+}
+
+static int blockdev_load_overlay(struct session_s *s)
+{
+  uint32_t hdr[2];
+  int ret = RC_OK;
+  FILE *f;
+
+  f = fopen(s->overlay, "rb");
+  if(!f)
+    return RC_OK;
+  if(fread(hdr, sizeof(hdr), 1, f) != 1 || hdr[0] != OVERLAY_MAGIC || hdr[1] != s->nsectors) {
+    eprintf("%s is not an overlay of this image\n", s->overlay);
+    ret = RC_ERROR;
+    goto out;
+  }
+  ret = blockdev_read_sectors(s, f);
+  if(RC_OK != ret)
+    eprintf("Can't read overlay %s\n", s->overlay);
+out:
+  fclose(f);
+  return ret;
+}
+
+static int blockdev_map(struct session_s *s, const char *image)
+{
+  struct stat st;
+  int fd;
+
+  fd = open(image, s->writeback ? O_RDWR : O_RDONLY);
+  if(fd < 0 || fstat(fd, &st)) {
+    eprintf("Can't open %s\n", image);
+    if(fd >= 0)
+      close(fd);
+    return RC_ERROR;
+  }
+  s->size = st.st_size;
+  s->nsectors = s->size / SECTOR_SIZE;
+  if(!s->nsectors) {
+    eprintf("%s is smaller than a sector\n", image);
+    close(fd);
+    return RC_ERROR;
+  }
+  s->disk = mmap(NULL, s->size, PROT_READ | PROT_WRITE, s->writeback ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(s->disk == MAP_FAILED) {
+    s->disk = NULL;
+    eprintf("Can't map %s\n", image);
+    return RC_ERROR;
+  }
+  s->dirty = (uint8_t *)calloc((s->nsectors + 7) / 8, 1);
+  if(!s->dirty)
+    return RC_NOENMEM;
+  printf("[blockdev] %s: %u sectors%s\n", image, s->nsectors, s->writeback ? ", written back" : "");
+  return RC_OK;
+}
+
+/* args: image (required), overlay (file keeping the written sectors across
+ * runs) or writeback (1: write to the image) */
+static int blockdev_new(void **sess, char *args)
+{
+  int ret = RC_OK;
+  char *image = NULL;
+  const char *overlay;
+  json_object *jargs = NULL;
+  struct session_s *s = NULL;
+
+  if(!sess) {
+    ret = RC_INVARG;
+    goto out;
+  }
+
+  jargs = litex_sim_args_parse("blockdev", args);
+  if(!jargs) {
+    ret = RC_JSERROR;
+    goto out;
+  }
+
+  s = (struct session_s*)malloc(sizeof(struct session_s));
+  if(!s) {
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  memset(s, 0, sizeof(struct session_s));
+
+  ret = litex_sim_args_get_string(jargs, "image", &image);
+  if(RC_OK != ret)
+    goto out;
+  s->writeback = litex_sim_args_opt_int(jargs, "writeback", 0);
+  overlay = litex_sim_args_opt_string(jargs, "overlay", NULL);
+  if(overlay && s->writeback) {
+    eprintf("overlay and writeback are exclusive\n");
+    ret = RC_INVARG;
+    goto out;
+  }
+
+  ret = blockdev_map(s, image);
+  if(RC_OK != ret)
+    goto out;
+  if(overlay) {
+    s->overlay = strdup(overlay);
+    if(!s->overlay) {
+      ret = RC_NOENMEM;
+      goto out;
+    }
+    ret = blockdev_load_overlay(s);
+  }
+out:
+  free(image);
+  litex_sim_args_free(jargs);
+  *sess = (void*)s;
+  return ret;
+}
+
+static int blockdev_add_pads(void *sess, struct pad_list_s *plist)
+{
+  int ret = RC_OK;
+  struct session_s *s = (struct session_s*)sess;
+  struct pad_s *rd_data;
+
+  if(!sess || !plist) {
+    ret = RC_INVARG;
+    goto out;
+  }
+  if(!strcmp(plist->name, "blockdev")) {
+    struct pad_bind_s binds[] = {
+      PAD_BIND("cmd_valid", &s->cmd_valid),
+      PAD_BIND("cmd_write", &s->cmd_write),
+      PAD_BIND("cmd_sector", &s->cmd_sector),
+      PAD_BIND("error", &s->error),
+      PAD_BIND("rd_valid", &s->rd_valid),
+      PAD_BIND("rd_ack", &s->rd_ack),
+      PAD_BIND("rd_data", &s->rd_data),
+      PAD_BIND("wr_valid", &s->wr_valid),
+      PAD_BIND("wr_data", &s->wr_data),
+      PAD_BIND_END
+    };
+    ret = litex_sim_pads_bind(plist, binds);
+    if(RC_OK != ret) {
+      eprintf("Missing block device signals\n");
+      goto out;
+    }
+    rd_data = litex_sim_pad_get(plist, "rd_data");
+    s->data_bytes = rd_data->len / 8;
+    if(s->data_bytes != 4 && s->data_bytes != 8) {
+      ret = RC_ERROR;
+      eprintf("Unsupported data width %d\n", (int)rd_data->len);
+      goto out;
+    }
+  }
+
+  if(!strcmp(plist->name, "sys_clk"))
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
+
+out:
+  return ret;
+}
+
+static void blockdev_rd_word(struct session_s *s)
+{
+  if(*s->error)
+    memset(s->rd_data, 0, s->data_bytes);
+  else
+    memcpy(s->rd_data, s->disk + (size_t)s->sector * SECTOR_SIZE + s->pos, s->data_bytes);
+  *s->rd_valid = 1;
+}
+
+static int blockdev_tick(void *sess, uint64_t time_ps)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  if(*s->cmd_valid) {
+    s->sector = *s->cmd_sector;
+    s->state = *s->cmd_write ? BLOCKDEV_WRITE : BLOCKDEV_READ;
+    s->pos = 0;
+    *s->error = s->sector >= s->nsectors;
+    if(s->state == BLOCKDEV_READ)
+      blockdev_rd_word(s);
+    return RC_OK;
+  }
+
+  switch(s->state) {
+  case BLOCKDEV_READ:
+    if(!*s->rd_ack)
+      break;
+    s->pos += s->data_bytes;
+    if(s->pos < SECTOR_SIZE) {
+      blockdev_rd_word(s);
+      break;
+    }
+    *s->rd_valid = 0;
+    s->state = BLOCKDEV_IDLE;
+    break;
+  case BLOCKDEV_WRITE:
+    if(!*s->wr_valid)
+      break;
+    if(!*s->error)
+      memcpy(s->disk + (size_t)s->sector * SECTOR_SIZE + s->pos, s->wr_data, s->data_bytes);
+    s->pos += s->data_bytes;
+    if(s->pos < SECTOR_SIZE)
+      break;
+    if(!*s->error)
+      blockdev_set_dirty(s, s->sector);
+    s->state = BLOCKDEV_IDLE;
+    break;
+  default:
+    return EXT_MODULE_IDLE;
+  }
+  return RC_OK;
+}
+
+static int blockdev_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static char **blockdev_wake_signals(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  s->wake[0] = s->cmd_valid;
+  s->wake[1] = NULL;
+  return s->wake;
+}
+
+static int blockdev_close(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+  uint32_t hdr[2] = {OVERLAY_MAGIC, s->nsectors};
+  int ret = RC_OK;
+  FILE *f;
+
+  if(!s->disk)
+    return RC_OK;
+  if(s->overlay) {
+    f = fopen(s->overlay, "wb");
+    if(!f || fwrite(hdr, sizeof(hdr), 1, f) != 1 || blockdev_write_sectors(s, f) != RC_OK) {
+      eprintf("Can't write overlay %s\n", s->overlay);
+      ret = RC_ERROR;
+    }
+    if(f)
+      fclose(f);
+  }
+  if(s->writeback)
+    msync(s->disk, s->size, MS_SYNC);
+  munmap(s->disk, s->size);
+  s->disk = NULL;
+  return ret;
+}
+
+static int blockdev_save(void *sess, FILE *f)
+{
+  struct session_s *s = (struct session_s*)sess;
+  uint32_t state[3] = {s->state, s->sector, s->pos};
+
+  if(blockdev_write_sectors(s, f) != RC_OK || fwrite(state, sizeof(state), 1, f) != 1
+     || fwrite(s->error, 1, 1, f) != 1 || fwrite(s->rd_valid, 1, 1, f) != 1
+     || fwrite(s->rd_data, s->data_bytes, 1, f) != 1)
+    return RC_ERROR;
+  return RC_OK;
+}
+
+static int blockdev_restore(void *sess, FILE *f)
+{
+  struct session_s *s = (struct session_s*)sess;
+  uint32_t state[3];
+
+  if(blockdev_read_sectors(s, f) != RC_OK || fread(state, sizeof(state), 1, f) != 1
+     || fread(s->error, 1, 1, f) != 1 || fread(s->rd_valid, 1, 1, f) != 1
+     || fread(s->rd_data, s->data_bytes, 1, f) != 1)
+    return RC_ERROR;
+  s->state = state[0];
+  s->sector = state[1];
+  s->pos = state[2];
+  return RC_OK;
+}
+
+static struct ext_module_s ext_mod = {
+  "blockdev",
+  blockdev_start,
+  blockdev_new,
+  blockdev_add_pads,
+  blockdev_close,
+  blockdev_tick,
+  blockdev_clock_domain,
+  NULL,
+  NULL,
+  blockdev_save,
+  blockdev_restore,
+  EXT_MODULE_THREAD_SAFE,
+  blockdev_wake_signals
+};
+
+int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
+{
+  int ret = RC_OK;
+  ret = register_module(&ext_mod);
+  return ret;
+}
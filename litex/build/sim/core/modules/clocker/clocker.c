@@ -5,39 +5,29 @@
 #include "error.h"
 #include "modules.h"
 
+#define PS_IN_SEC 1000000000000ull
+
+/*
+ * Edge j happens at floor((j * 180 + phase_deg) * PS_IN_SEC / (360 * freq_hz))
+ * ps, even edges are rising. The schedule is stepped incrementally with the
+ * remainder carried over, so frequencies with a non-integer period in ps
+ * don't drift and don't need a finer timebase.
+ */
 struct session_s {
   char *clk;
   char *name;
   uint32_t freq_hz;
   uint16_t phase_deg;
+  uint64_t den;       // 360 * freq_hz
+  uint64_t step_ps;   // half period, integer part
+  uint64_t step_rem;  // half period, fractional part (in 1/den ps)
+  int64_t edge;       // index of the next edge
+  uint64_t last_ps;   // time the schedule was last synced to
+  uint64_t next_ps;   // time of the next edge
+  uint64_t rem;       // fractional part of next_ps
+  char level;         // clock level before the next edge
 };
 
-static int litex_sim_module_pads_get( struct pad_s *pads, char *name, void **signal)
-{
-  int ret = RC_OK;
-  void *sig=NULL;
-  int i;
-
-  if(!pads || !name || !signal) {
-    ret=RC_INVARG;
-    goto out;
-  }
-
-  i = 0;
-  while(pads[i].name) {
-    if(!strcmp(pads[i].name, name))
-    {
-      sig=(void*)pads[i].signal;
-      break;
-    }
-    i++;
-  }
-
-out:
-  *signal=sig;
-  return ret;
-}
-
 static int clocker_parse_args(struct session_s *s, const char *args)
 {
   int ret = RC_OK;
@@ -91,6 +81,47 @@ static int clocker_start()
   return RC_OK;
 }
 
+// Recomputes the schedule for an arbitrary time, e.g. after a restore
+static void clocker_seek(struct session_s *s, uint64_t time_ps)
+{
+  const __int128 step = 180 * (__int128)PS_IN_SEC;
+  __int128 num, x;
+  int64_t j;
+
+  // First edge after time_ps. Edge -1 is the falling edge preceding a
+  // rising edge shifted by half a period or more.
+  num = ((__int128)time_ps + 1) * s->den - (__int128)s->phase_deg * PS_IN_SEC;
+  j = num > 0 ? (num + step - 1) / step : -(-num / step);
+  if(j < (s->phase_deg >= 180 ? -1 : 0))
+    j = s->phase_deg >= 180 ? -1 : 0;
+
+  x = j * step + (__int128)s->phase_deg * PS_IN_SEC;
+  s->edge = j;
+  s->next_ps = x / s->den;
+  s->rem = x % s->den;
+  s->level = j & 1;
+  s->last_ps = time_ps;
+}
+
+static inline void clocker_sync(struct session_s *s, uint64_t time_ps)
+{
+  if(time_ps < s->last_ps || time_ps >= s->next_ps + s->step_ps) {
+    clocker_seek(s, time_ps);
+    return;
+  }
+  s->last_ps = time_ps;
+  if(time_ps < s->next_ps)
+    return;
+  s->edge++;
+  s->level ^= 1;
+  s->next_ps += s->step_ps;
+  s->rem += s->step_rem;
+  if(s->rem >= s->den) {
+    s->rem -= s->den;
+    s->next_ps++;
+  }
+}
+
 static int clocker_new(void **sess, char *args)
 {
   int ret = RC_OK;
@@ -109,7 +140,13 @@ static int clocker_new(void **sess, char *args)
   }
   memset(s, 0, sizeof(struct session_s));
 
-  clocker_parse_args(s, args);
+  ret = clocker_parse_args(s, args);
+  if(RC_OK != ret)
+    goto out;
+  s->den = 360ull * s->freq_hz;
+  s->step_ps = 180 * PS_IN_SEC / s->den;
+  s->step_rem = 180 * PS_IN_SEC % s->den;
+  clocker_seek(s, 0);
 out:
   *sess=(void*)s;
   return ret;
@@ -119,16 +156,15 @@ static int clocker_add_pads(void *sess, struct pad_list_s *plist)
 {
   int ret = RC_OK;
   struct session_s *s = (struct session_s*)sess;
-  struct pad_s *pads;
 
   if(!sess || !plist) {
     ret = RC_INVARG;
     goto out;
   }
-  pads = plist->pads;
 
-  ret = litex_sim_module_pads_get(pads, plist->name, (void**)&s->clk);
+  ret = litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND(plist->name, &s->clk), PAD_BIND_END });
   if (ret != RC_OK) {
+    eprintf("Could not find clock signal %s\n", plist->name);
     goto out;
   }
 
@@ -141,30 +177,33 @@ out:
 
 static int clocker_tick(void *sess, uint64_t time_ps)
 {
-  static const uint64_t ps_in_sec = 1000000000000ull;
   struct session_s *s = (struct session_s*) sess;
 
-  uint64_t period_ps = ps_in_sec / s->freq_hz;
-  uint64_t phase_shift_ps = period_ps * s->phase_deg / 360;
-
-  // phase-shifted time relative to start of current period
-  uint64_t rel_time_ps = (time_ps - phase_shift_ps) % period_ps;
-  if (rel_time_ps < (period_ps/2)) {
-    *s->clk = 1;
-  } else {
-    *s->clk = 0;
-  }
+  clocker_sync(s, time_ps);
+  *s->clk = s->level;
 
   return 0;
 }
 
+static int clocker_next_edge(void *sess, uint64_t time_ps, uint64_t *next_ps)
+{
+  struct session_s *s = (struct session_s*) sess;
+
+  clocker_sync(s, time_ps);
+  *next_ps = s->next_ps;
+
+  return RC_OK;
+}
+
 static struct ext_module_s ext_mod = {
   "clocker",
   clocker_start,
   clocker_new,
   clocker_add_pads,
   NULL,
-  clocker_tick
+  clocker_tick,
+  NULL,
+  clocker_next_edge
 };
 
 int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
@@ -9,12 +9,14 @@
 #include <json-c/json.h>
 #include "tapcfg.h"
 #include "modules.h"
+#include "args.h"
+#include "ring.h"
+#include "pktpool.h"
+#include "pcap.h"
+#include "ethsw.h"
+#include "ethqueue.h"
 
-struct eth_packet_s {
-  char data[2000];
-  size_t len;
-  struct eth_packet_s *next;
-};
+#define ETH_LEN 2000
 
 struct session_s {
   char *tx;
@@ -26,104 +28,130 @@ struct session_s {
   char *sys_clk;
   tapcfg_t *tapcfg;
   int fd;
-  char databuf[2000];
-  int datalen;
-  char inbuf[2000];
-  int inlen;
-  int insent;
-  struct eth_packet_s *ethpack;
+  // Packet being received from the sim, and sent to it
+  struct pkt_s *txp;
+  struct pkt_s *rxp;
+  size_t insent;
+  int txdrop;
+  // TAP (I/O thread) -> sim, struct pkt_s pointers from rx_pool
+  pkt_pool_t rx_pool;
+  ring_t rx_ring;
+  // sim -> TAP (I/O thread), struct pkt_s pointers from tx_pool
+  pkt_pool_t tx_pool;
+  ring_t tx_ring;
   struct event *ev;
+  struct event *tx_ev;
+  struct eth_queue_s q;
+  // Offline (pcap_in/pcap_out given, or the shm backend): frames are
+  // replayed from and recorded to capture files, and exchanged with the
+  // shared memory switch, on the simulation thread, no TAP interface is used
+  int offline;
+  struct pcap_replay_s pcap_in;
+  pcap_t pcap_out;
+  ethsw_t sw;
+  struct stim_stream_s *stim;
 };
 
 static struct event_base *base=NULL;
+static int nsessions = 0;
 
-int litex_sim_module_get_args(char *args, char *arg, char **val)
+static int ethernet_start(void *b)
 {
-  int ret = RC_OK;
-  json_object *jsobj = NULL;
-  json_object *obj = NULL;
-  char *value = NULL;
-  int r;
-
-  jsobj = json_tokener_parse(args);
-  if(NULL == jsobj) {
-    fprintf(stderr, "Error parsing json arg: %s \n", args);
-    ret = RC_JSERROR;
-    goto out;
-  }
+  base = (struct event_base *) b;
+  printf("[ethernet] loaded (%p)\n", base);
+  return RC_OK;
+}
 
-  if(!json_object_is_type(jsobj, json_type_object)) {
-    fprintf(stderr, "Arg must be type object! : %s \n", args);
-    ret = RC_JSERROR;
-    goto out;
-  }
+void event_handler(int fd, short event, void *arg)
+{
+  struct  session_s *s = (struct session_s*)arg;
+  struct pkt_s *pkt;
+  char drop[ETH_LEN];
+  int len;
 
-  obj=NULL;
-  r = json_object_object_get_ex(jsobj, arg, &obj);
-  if(!r) {
-    fprintf(stderr, "Could not find object: \"%s\" (%s)\n", arg, args);
-    ret = RC_JSERROR;
-    goto out;
+  if (event & EV_READ) {
+    pkt = pkt_pool_get(&s->rx_pool);
+    if(!pkt) {
+      if(eth_queue_rx_full(&s->q, s->ev))
+        return;
+      if(s->q.rx_dropped == 1)
+        eprintf("RX queue full, dropping packets\n");
+      tapcfg_read(s->tapcfg, drop, ETH_LEN);
+      return;
+    }
+    len = tapcfg_read(s->tapcfg, pkt->data, ETH_LEN);
+    if(len < 0) {
+      pkt_pool_put(&s->rx_pool, pkt);
+      return;
+    }
+    if(len < 60) {
+      memset(pkt->data + len, 0, 60 - len);
+      len = 60;
+    }
+    pkt->len = len;
+    ring_push(&s->rx_ring, &pkt, 1);
   }
-  value = strdup(json_object_get_string(obj));
-
-out:
-  *val = value;
-  return ret;
 }
 
-static int litex_sim_module_pads_get(struct pad_s *pads, char *name, void **signal)
+static void tx_handler(int fd, short event, void *arg)
 {
-  int ret = RC_OK;
-  void *sig = NULL;
-  int i;
+  struct session_s *s = (struct session_s*)arg;
+  struct pkt_s *pkt;
 
-  if(!pads || !name || !signal) {
-    ret=RC_INVARG;
-    goto out;
+  while(ring_pop(&s->tx_ring, &pkt, 1)) {
+    tapcfg_write(s->tapcfg, pkt->data, pkt->len);
+    pkt_pool_put(&s->tx_pool, pkt);
   }
-
-  i = 0;
-  while(pads[i].name) {
-    if(!strcmp(pads[i].name, name)) {
-      sig=(void*)pads[i].signal;
-      break;
-    }
-    i++;
-  }
-
-out:
-  *signal=sig;
-  return ret;
+  eth_queue_rx_resume(&s->q, &s->rx_pool, s->ev);
 }
 
-static int ethernet_start(void *b)
+/* pacing selects how pcap_in is replayed: "timestamp" (default) at the capture
+ * time relative to the first frame, "fast" as soon as a buffer is free */
+static int ethernet_open_pcap(struct session_s *s, json_object *args)
 {
-  base = (struct event_base *) b;
-  printf("[ethernet] loaded (%p)\n", base);
+  const char *pcap_in = litex_sim_args_opt_string(args, "pcap_in", NULL);
+  const char *pcap_out = litex_sim_args_opt_string(args, "pcap_out", NULL);
+
+  if(pcap_in) {
+    if(pcap_open_read(&s->pcap_in.pcap, pcap_in)) {
+      eprintf("Can't read capture %s\n", pcap_in);
+      return RC_ERROR;
+    }
+    s->offline = 1;
+  }
+  if(pcap_out) {
+    if(pcap_open_write(&s->pcap_out, pcap_out, ETH_LEN)) {
+      eprintf("Can't write capture %s\n", pcap_out);
+      return RC_ERROR;
+    }
+    s->offline = 1;
+  }
+  s->pcap_in.fast = !strcmp(litex_sim_args_opt_string(args, "pacing", "timestamp"), "fast");
   return RC_OK;
 }
 
-void event_handler(int fd, short event, void *arg)
+/* backend "shm" connects to the shared memory switch named by switch
+ * (default "litex") instead of a TAP interface, see ethsw.h */
+static int ethernet_open_switch(struct session_s *s, json_object *args)
 {
-  struct  session_s *s = (struct session_s*)arg;
-  struct eth_packet_s *ep;
-  struct eth_packet_s *tep;
+  const char *backend = litex_sim_args_opt_string(args, "backend", "tap");
+  const char *name = litex_sim_args_opt_string(args, "switch", "litex");
+  int port;
 
-  if (event & EV_READ) {
-    ep = malloc(sizeof(struct eth_packet_s));
-    memset(ep, 0, sizeof(struct eth_packet_s));
-    ep->len = tapcfg_read(s->tapcfg, ep->data, 2000);
-    if(ep->len < 60)
-      ep->len = 60;
-
-    if(!s->ethpack)
-      s->ethpack = ep;
-    else {
-      for(tep=s->ethpack; tep->next; tep=tep->next);
-      tep->next = ep;
-    }
+  if(!strcmp(backend, "tap"))
+    return RC_OK;
+  if(strcmp(backend, "shm")) {
+    eprintf("Unknown backend %s\n", backend);
+    return RC_ERROR;
   }
+  port = ethsw_open(&s->sw, name);
+  if(port < 0) {
+    eprintf("Can't attach to switch %s\n", name);
+    return RC_ERROR;
+  }
+  printf("[ethernet] switch %s, port %d\n", name, port);
+  s->offline = 1;
+  return RC_OK;
 }
 
 static const char macadr[6] = {0xaa, 0xb6, 0x24, 0x69, 0x77, 0x21};
@@ -133,31 +161,52 @@ static int ethernet_new(void **sess, char *args)
   int ret = RC_OK;
   char *c_tap = NULL;
   char *c_tap_ip = NULL;
+  json_object *jargs = NULL;
   struct session_s *s = NULL;
   struct timeval tv = {10, 0};
+  struct timeval tx_tv = {0, 1000};
   if(!sess) {
     ret = RC_INVARG;
     goto out;
   }
 
+  jargs = litex_sim_args_parse("ethernet", args);
+  if(!jargs) {
+    ret = RC_JSERROR;
+    goto out;
+  }
+
   s=(struct session_s*)malloc(sizeof(struct session_s));
   if(!s) {
     ret=RC_NOENMEM;
     goto out;
   }
   memset(s, 0, sizeof(struct session_s));
-
-  ret = litex_sim_module_get_args(args, "interface", &c_tap);
-  {
-    if(RC_OK != ret)
-      goto out;
-  }
-  ret = litex_sim_module_get_args(args, "ip", &c_tap_ip);
-  {
-    if(RC_OK != ret)
-      goto out;
+  eth_queue_args(&s->q, jargs);
+  if(pkt_pool_init(&s->rx_pool, s->q.depth, ETH_LEN)
+     || pkt_pool_init(&s->tx_pool, s->q.depth, ETH_LEN)
+     || ring_init(&s->rx_ring, s->q.depth, sizeof(struct pkt_s *))
+     || ring_init(&s->tx_ring, s->q.depth, sizeof(struct pkt_s *))) {
+    ret=RC_NOENMEM;
+    goto out;
   }
 
+  ret = ethernet_open_pcap(s, jargs);
+  if(RC_OK == ret)
+    ret = ethernet_open_switch(s, jargs);
+  s->stim = eth_queue_stim_open("ethernet", nsessions++);
+  if(eth_queue_stim_replaying(s->stim))
+    s->offline = 1;
+  if(RC_OK != ret || s->offline)
+    goto out;
+
+  ret = litex_sim_args_get_string(jargs, "interface", &c_tap);
+  if(RC_OK != ret)
+    goto out;
+  ret = litex_sim_args_get_string(jargs, "ip", &c_tap_ip);
+  if(RC_OK != ret)
+    goto out;
+
   s->tapcfg = tapcfg_init();
   tapcfg_start(s->tapcfg, c_tap, 0);
   s->fd = tapcfg_get_fd(s->tapcfg);
@@ -169,8 +218,11 @@ static int ethernet_new(void **sess, char *args)
 
   s->ev = event_new(base, s->fd, EV_READ | EV_PERSIST, event_handler, s);
   event_add(s->ev, &tv);
+  s->tx_ev = event_new(base, -1, EV_PERSIST, tx_handler, s);
+  event_add(s->tx_ev, &tx_tv);
 
 out:
+  litex_sim_args_free(jargs);
   *sess=(void*)s;
   return ret;
 }
@@ -179,22 +231,24 @@ static int ethernet_add_pads(void *sess, struct pad_list_s *plist)
 {
   int ret = RC_OK;
   struct session_s *s = (struct session_s*)sess;
-  struct pad_s *pads;
   if(!sess || !plist) {
     ret = RC_INVARG;
     goto out;
   }
-  pads = plist->pads;
   if(!strcmp(plist->name, "eth")) {
-    litex_sim_module_pads_get(pads, "sink_data", (void**)&s->rx);
-    litex_sim_module_pads_get(pads, "sink_valid", (void**)&s->rx_valid);
-    litex_sim_module_pads_get(pads, "sink_ready", (void**)&s->rx_ready);
-    litex_sim_module_pads_get(pads, "source_data", (void**)&s->tx);
-    litex_sim_module_pads_get(pads, "source_valid", (void**)&s->tx_valid);
-    litex_sim_module_pads_get(pads, "source_ready", (void**)&s->tx_ready);
+    struct pad_bind_s binds[] = {
+      PAD_BIND("sink_data", &s->rx),
+      PAD_BIND("sink_valid", &s->rx_valid),
+      PAD_BIND("sink_ready", &s->rx_ready),
+      PAD_BIND("source_data", &s->tx),
+      PAD_BIND("source_valid", &s->tx_valid),
+      PAD_BIND("source_ready", &s->tx_ready),
+      PAD_BIND_END
+    };
+    litex_sim_pads_bind(plist, binds);
   }
   if(!strcmp(plist->name, "sys_clk"))
-    litex_sim_module_pads_get(pads, "sys_clk", (void**)&s->sys_clk);
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
 
 out:
   return ret;
@@ -202,53 +256,110 @@ out:
 
 static int ethernet_tick(void *sess, uint64_t time_ps)
 {
-  static clk_edge_state_t edge;
-  char c;
   struct session_s *s = (struct session_s*)sess;
-  struct eth_packet_s *pep;
-
-  if(!clk_pos_edge(&edge, *s->sys_clk)) {
-    return RC_OK;
-  }
 
   *s->tx_ready = 1;
   if(*s->tx_valid == 1) {
-    c = *s->tx;
-    s->databuf[s->datalen++]=c;
+    // Frames are built in place, dropped when no buffer is free
+    if(!s->txp && !s->txdrop) {
+      s->txp = pkt_pool_get(&s->tx_pool);
+      if(s->txp)
+        s->txp->len = 0;
+      else {
+        s->txdrop = 1;
+        s->q.tx_dropped++;
+      }
+    }
+    if(s->txp && s->txp->len < ETH_LEN)
+      s->txp->data[s->txp->len++] = *s->tx;
   } else {
-    if(s->datalen) {
-      tapcfg_write(s->tapcfg, s->databuf, s->datalen);
-      s->datalen=0;
+    if(s->txp)
+      eth_queue_tx(&s->q, s->txp->len);
+    if(s->txp && s->offline) {
+      if(s->pcap_out.f && pcap_write(&s->pcap_out, s->txp->data, s->txp->len, time_ps))
+        eprintf("Capture write error\n");
+      if(s->sw.shm)
+        ethsw_send(&s->sw, s->txp->data, s->txp->len);
+      pkt_pool_put(&s->tx_pool, s->txp);
+      s->txp = NULL;
+    } else if(s->txp) {
+      ring_push(&s->tx_ring, &s->txp, 1);
+      s->txp = NULL;
     }
+    s->txdrop = 0;
   }
 
   *s->rx_valid=0;
-  if(s->inlen) {
+  if(s->rxp) {
     *s->rx_valid=1;
-    *s->rx = s->inbuf[s->insent++];
-    if(s->insent == s->inlen) {
-      s->insent =0;
-      s->inlen = 0;
+    *s->rx = s->rxp->data[s->insent++];
+    if(s->insent == s->rxp->len) {
+      s->insent = 0;
+      pkt_pool_put(&s->rx_pool, s->rxp);
+      s->rxp = NULL;
     }
   } else {
-    if(s->ethpack) {
-      memcpy(s->inbuf, s->ethpack->data, s->ethpack->len);
-      s->inlen = s->ethpack->len;
-      pep=s->ethpack->next;
-      free(s->ethpack);
-      s->ethpack=pep;
+    if(eth_queue_stim_replaying(s->stim))
+      eth_queue_stim_poll(s->stim, &s->rx_pool, &s->rx_ring, ETH_LEN, time_ps);
+    else {
+      if(s->sw.shm)
+        ethsw_poll(&s->sw, &s->rx_pool, &s->rx_ring, ETH_LEN, 60);
+      if(s->offline)
+        pcap_replay_poll(&s->pcap_in, &s->rx_pool, &s->rx_ring, ETH_LEN, 60, time_ps);
+    }
+    if(ring_pop(&s->rx_ring, &s->rxp, 1)) {
+      eth_queue_rx(&s->q, s->rxp->len);
+      eth_queue_stim_record(s->stim, s->rxp, time_ps);
     }
   }
   return RC_OK;
 }
 
+static int ethernet_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static int ethernet_close(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  eth_queue_print("ethernet", &s->q);
+  pcap_close(&s->pcap_in.pcap);
+  pcap_close(&s->pcap_out);
+  ethsw_close(&s->sw);
+  return RC_OK;
+}
+
+static int ethernet_io_pending(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  if(s->sw.shm && ethsw_pending(&s->sw))
+    return 1;
+  if(s->offline && !s->sw.shm)
+    return 0;
+
+  return ring_count(&s->rx_ring) != 0 || s->rxp != NULL;
+}
+
 static struct ext_module_s ext_mod = {
   "ethernet",
   ethernet_start,
   ethernet_new,
   ethernet_add_pads,
+  ethernet_close,
+  ethernet_tick,
+  ethernet_clock_domain,
+  NULL,
+  ethernet_io_pending,
+  NULL,
   NULL,
-  ethernet_tick
+  EXT_MODULE_THREAD_SAFE
 };
 
 int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
@@ -0,0 +1,752 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <json-c/json.h>
+#include <zlib.h>
+#include "error.h"
+#include "modules.h"
+#include "args.h"
+
+/*
+ * Synthetic Ethernet traffic on the pads of a GMII (gmii_eth) or 64-bit XGMII
+ * (xgmii_eth) PHY, in place of gmii_ethernet/xgmii_ethernet: UDP frames are
+ * generated onto the RX pads at a configurable share of the line rate, the
+ * frames transmitted by the gateware are counted and checked, so LiteEth
+ * cores and firmware stacks can be benchmarked at line rate without host
+ * networking. The line rate is one byte (GMII) or eight bytes (XGMII) per
+ * sys_clk cycle.
+ *
+ * Generated frames carry a magic, their flow and sequence number and a
+ * payload derived from them. The ones the gateware sends back (firmware
+ * echoing them, loopback) are checked: lost, reordered and corrupted frames
+ * are counted per flow. Statistics are printed every report_us and on exit.
+ *
+ * Optional args:
+ *   "sizes":     frame sizes (FCS included) with their weight, "64" (default),
+ *                "64:7,594:4,1518:1" (IMIX) or a range "64-1518" (uniform),
+ *   "rate":      share of the line rate, in percent (default 100),
+ *   "count":     frames to send, 0 for no limit (default 0),
+ *   "start_us":  simulated time of the first frame (default 0),
+ *   "flows":     UDP flows, from source ports src_port.. (default 1),
+ *   "dst_mac", "src_mac": "xx:xx:xx:xx:xx:xx" (broadcast, 02:00:00:00:00:01),
+ *   "dst_ip", "src_ip": "a.b.c.d" (192.168.1.50, 192.168.1.100),
+ *   "dst_port", "src_port": (7 (echo), 10000),
+ *   "seed":      of the size distribution (default 1),
+ *   "report_us": statistics period, 0 for only on exit (default 0),
+ *   "output":    JSON file the final statistics are written to.
+ */
+
+#define ETHGEN_LEN_MIN   64   /* Frame sizes, with FCS */
+#define ETHGEN_LEN_MAX   9018
+#define ETHGEN_SIZES_MAX 16
+#define ETHGEN_FLOWS_MAX 1024
+#define ETHGEN_IFG       12
+#define ETHGEN_PREAMBLE  8
+
+#define ETHGEN_MAGIC     0x4c585447 /* "LXTG" */
+/* Ethernet (14) + IPv4 (20) + UDP (8) headers, then magic, flow, sequence */
+#define ETHGEN_HDR_LEN   42
+#define ETHGEN_TAG_LEN   10
+
+#define XGMII_START 0xfb
+#define XGMII_END   0xfd
+#define XGMII_IDLE  0x07
+
+enum {
+  ETHGEN_GMII,
+  ETHGEN_XGMII,
+};
+
+struct ethgen_stats_s {
+  uint64_t frames;
+  uint64_t bytes;
+  uint64_t first_ps;
+  uint64_t last_ps;
+};
+
+struct ethgen_flow_s {
+  uint32_t tx_seq;
+  uint32_t rx_seq;
+};
+
+struct session_s {
+  int mode;
+  char *sys_clk;
+  /* GMII */
+  uint8_t *gmii_rx_data;
+  char *gmii_rx_dv;
+  char *gmii_rx_er;
+  uint8_t *gmii_tx_data;
+  char *gmii_tx_en;
+  char *gmii_tx_er;
+  /* XGMII */
+  uint64_t *xgmii_rx_data;
+  uint8_t *xgmii_rx_ctl;
+  uint64_t *xgmii_tx_data;
+  uint8_t *xgmii_tx_ctl;
+  /* Configuration */
+  int nsizes;
+  uint32_t sizes[ETHGEN_SIZES_MAX];
+  uint32_t weights[ETHGEN_SIZES_MAX];
+  uint32_t weight_total;
+  int size_range;
+  uint32_t rate;
+  uint64_t count;
+  uint64_t start_ps;
+  uint32_t nflows;
+  uint8_t dst_mac[6];
+  uint8_t src_mac[6];
+  uint32_t dst_ip;
+  uint32_t src_ip;
+  uint16_t dst_port;
+  uint16_t src_port;
+  uint32_t rng;
+  uint64_t report_ps;
+  uint64_t next_report_ps;
+  char *output;
+  /* Generator: the frame on the wire (preamble, data, FCS), its position
+   * and the idle byte times left before the next one may start */
+  uint8_t wire[ETHGEN_PREAMBLE + ETHGEN_LEN_MAX + 8];
+  uint32_t wire_len;
+  uint32_t wire_pos;
+  int sending;
+  uint64_t gap;
+  uint64_t byte_time;
+  uint64_t next_start;
+  uint32_t flow;
+  struct ethgen_flow_s *flows;
+  struct ethgen_stats_s tx;
+  /* Checker of the frames sent by the gateware */
+  uint8_t rx_buf[ETHGEN_PREAMBLE + ETHGEN_LEN_MAX];
+  uint32_t rx_len;
+  int rx_active;
+  int rx_bad;
+  struct ethgen_stats_s rx;
+  uint64_t rx_errors;
+  uint64_t rx_tagged;
+  uint64_t rx_lost;
+  uint64_t rx_reordered;
+  uint64_t rx_corrupted;
+  uint64_t cycles;
+  uint64_t time_ps;
+};
+
+static uint32_t ethgen_rand(struct session_s *s)
+{
+  /* xorshift32 */
+  s->rng ^= s->rng << 13;
+  s->rng ^= s->rng >> 17;
+  s->rng ^= s->rng << 5;
+  return s->rng;
+}
+
+static int ethgen_parse_sizes(struct session_s *s, const char *str)
+{
+  char *end;
+  unsigned long size, weight;
+
+  s->nsizes = 0;
+  s->weight_total = 0;
+  size = strtoul(str, &end, 0);
+  if('-' == *end)
+  {
+    s->sizes[0] = size;
+    s->sizes[1] = strtoul(end + 1, &end, 0);
+    s->nsizes = 2;
+    s->size_range = 1;
+  } else for(;;) {
+    weight = 1;
+    if(':' == *end)
+      weight = strtoul(end + 1, &end, 0);
+    if(s->nsizes == ETHGEN_SIZES_MAX || !weight)
+      return RC_INVARG;
+    s->sizes[s->nsizes] = size;
+    s->weights[s->nsizes++] = weight;
+    s->weight_total += weight;
+    if(',' != *end)
+      break;
+    size = strtoul(end + 1, &end, 0);
+  }
+  if(*end)
+    return RC_INVARG;
+  for(int i = 0; i < s->nsizes; i++)
+    if(s->sizes[i] < ETHGEN_LEN_MIN || s->sizes[i] > ETHGEN_LEN_MAX)
+      return RC_INVARG;
+  if(s->size_range && s->sizes[1] < s->sizes[0])
+    return RC_INVARG;
+  return RC_OK;
+}
+
+static int ethgen_parse_mac(uint8_t *mac, const char *str)
+{
+  unsigned int b[6];
+
+  if(6 != sscanf(str, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]))
+    return RC_INVARG;
+  for(int i = 0; i < 6; i++)
+    mac[i] = b[i];
+  return RC_OK;
+}
+
+static int ethgen_parse_ip(uint32_t *ip, const char *str)
+{
+  unsigned int b[4];
+
+  if(4 != sscanf(str, "%u.%u.%u.%u", &b[0], &b[1], &b[2], &b[3]))
+    return RC_INVARG;
+  *ip = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+  return RC_OK;
+}
+
+static inline void ethgen_put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static inline void ethgen_put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static inline uint32_t ethgen_get32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint8_t ethgen_pattern(uint32_t flow, uint32_t seq, uint32_t i)
+{
+  return (seq * 7 + flow * 13 + i) & 0xff;
+}
+
+static uint32_t ethgen_next_size(struct session_s *s)
+{
+  uint32_t r;
+  int i;
+
+  if(s->size_range)
+    return s->sizes[0] + ethgen_rand(s) % (s->sizes[1] - s->sizes[0] + 1);
+  if(1 == s->nsizes)
+    return s->sizes[0];
+  r = ethgen_rand(s) % s->weight_total;
+  for(i = 0; r >= s->weights[i]; i++)
+    r -= s->weights[i];
+  return s->sizes[i];
+}
+
+/* Build the next frame on the wire: preamble/SFD, headers, tagged payload, FCS */
+static void ethgen_build(struct session_s *s)
+{
+  uint32_t len = ethgen_next_size(s) - 4;
+  uint8_t *f = s->wire + ETHGEN_PREAMBLE;
+  struct ethgen_flow_s *flow = &s->flows[s->flow];
+  uint32_t sum, crc, i;
+
+  memset(s->wire, 0x55, ETHGEN_PREAMBLE - 1);
+  s->wire[ETHGEN_PREAMBLE - 1] = 0xd5;
+  if(ETHGEN_XGMII == s->mode)
+    s->wire[0] = XGMII_START;
+
+  /* Ethernet */
+  memcpy(f + 0, s->dst_mac, 6);
+  memcpy(f + 6, s->src_mac, 6);
+  ethgen_put16(f + 12, 0x0800);
+  /* IPv4 */
+  f[14] = 0x45;
+  f[15] = 0;
+  ethgen_put16(f + 16, len - 14);
+  ethgen_put16(f + 18, flow->tx_seq);
+  ethgen_put16(f + 20, 0x4000);
+  f[22] = 64;
+  f[23] = 17;
+  ethgen_put16(f + 24, 0);
+  ethgen_put32(f + 26, s->src_ip);
+  ethgen_put32(f + 30, s->dst_ip);
+  for(sum = 0, i = 14; i < 34; i += 2)
+    sum += (f[i] << 8) | f[i + 1];
+  while(sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  ethgen_put16(f + 24, ~sum);
+  /* UDP, no checksum */
+  ethgen_put16(f + 34, s->src_port + s->flow);
+  ethgen_put16(f + 36, s->dst_port);
+  ethgen_put16(f + 38, len - 34);
+  ethgen_put16(f + 40, 0);
+  /* Payload */
+  ethgen_put32(f + 42, ETHGEN_MAGIC);
+  ethgen_put16(f + 46, s->flow);
+  ethgen_put32(f + 48, flow->tx_seq);
+  for(i = ETHGEN_HDR_LEN + ETHGEN_TAG_LEN; i < len; i++)
+    f[i] = ethgen_pattern(s->flow, flow->tx_seq, i);
+  crc = crc32(0, f, len);
+  f[len + 0] = crc;
+  f[len + 1] = crc >> 8;
+  f[len + 2] = crc >> 16;
+  f[len + 3] = crc >> 24;
+
+  s->wire_len = ETHGEN_PREAMBLE + len + 4;
+  s->wire_pos = 0;
+  flow->tx_seq++;
+  s->flow = (s->flow + 1) % s->nflows;
+}
+
+/* Throughputs are measured from the start of the first frame to the end of the last one */
+static void ethgen_stats_begin(struct ethgen_stats_s *st, uint64_t time_ps)
+{
+  if(!st->frames && !st->first_ps)
+    st->first_ps = time_ps;
+}
+
+static void ethgen_stats_add(struct ethgen_stats_s *st, uint64_t bytes, uint64_t time_ps)
+{
+  st->frames++;
+  st->bytes += bytes;
+  st->last_ps = time_ps;
+}
+
+/* Whether a new frame may start at this byte time: count, start time, rate */
+static int ethgen_ready(struct session_s *s)
+{
+  if(s->count && s->tx.frames >= s->count)
+    return 0;
+  if(s->time_ps < s->start_ps)
+    return 0;
+  return s->byte_time >= s->next_start;
+}
+
+static void ethgen_start_frame(struct session_s *s)
+{
+  uint64_t wire_bytes;
+
+  ethgen_build(s);
+  ethgen_stats_begin(&s->tx, s->time_ps);
+  /* Frames spaced by their wire size (with preamble and IFG) over the rate */
+  wire_bytes = s->wire_len + ETHGEN_IFG;
+  if(s->next_start < s->byte_time)
+    s->next_start = s->byte_time;
+  s->next_start += wire_bytes * 100 / s->rate;
+  s->sending = 1;
+}
+
+static void ethgen_frame_sent(struct session_s *s)
+{
+  s->sending = 0;
+  s->gap = ETHGEN_IFG;
+  ethgen_stats_add(&s->tx, s->wire_len - ETHGEN_PREAMBLE, s->time_ps);
+}
+
+/* Check a frame sent by the gateware (without preamble, with FCS) */
+static void ethgen_check(struct session_s *s, const uint8_t *f, uint32_t len)
+{
+  struct ethgen_flow_s *flow;
+  uint32_t crc, seq, i, n;
+  uint16_t id;
+
+  if(len < ETHGEN_LEN_MIN || s->rx_bad)
+  {
+    s->rx_errors++;
+    return;
+  }
+  n = len - 4;
+  crc = crc32(0, f, n);
+  if(f[n] != (crc & 0xff) || f[n + 1] != ((crc >> 8) & 0xff) ||
+     f[n + 2] != ((crc >> 16) & 0xff) || f[n + 3] != ((crc >> 24) & 0xff))
+  {
+    s->rx_errors++;
+    return;
+  }
+  ethgen_stats_add(&s->rx, len, s->time_ps);
+
+  /* Generated frame sent back? */
+  if(n < ETHGEN_HDR_LEN + ETHGEN_TAG_LEN || f[12] != 0x08 || f[13] != 0x00 ||
+     f[14] != 0x45 || f[23] != 17 || ethgen_get32(f + 42) != ETHGEN_MAGIC)
+    return;
+  id = (f[46] << 8) | f[47];
+  seq = ethgen_get32(f + 48);
+  if(id >= s->nflows)
+  {
+    s->rx_corrupted++;
+    return;
+  }
+  s->rx_tagged++;
+  for(i = ETHGEN_HDR_LEN + ETHGEN_TAG_LEN; i < n; i++)
+  {
+    if(f[i] != ethgen_pattern(id, seq, i))
+    {
+      s->rx_corrupted++;
+      break;
+    }
+  }
+  flow = &s->flows[id];
+  if(seq < flow->rx_seq)
+  {
+    s->rx_reordered++;
+    return;
+  }
+  s->rx_lost += seq - flow->rx_seq;
+  flow->rx_seq = seq + 1;
+}
+
+static void ethgen_rx_end(struct session_s *s)
+{
+  if(s->rx_active)
+    ethgen_check(s, s->rx_buf, s->rx_len);
+  s->rx_active = 0;
+  s->rx_len = 0;
+  s->rx_bad = 0;
+}
+
+static inline void ethgen_rx_byte(struct session_s *s, uint8_t b)
+{
+  if(s->rx_len < sizeof(s->rx_buf))
+    s->rx_buf[s->rx_len++] = b;
+  else
+    s->rx_bad = 1;
+}
+
+/* GMII: one byte per cycle, preamble/SFD checked before the frame */
+static void ethgen_gmii_tick(struct session_s *s)
+{
+  if(*s->gmii_tx_en)
+  {
+    if(!s->rx_active && 0xd5 == *s->gmii_tx_data)
+    {
+      s->rx_active = 1;
+      ethgen_stats_begin(&s->rx, s->time_ps);
+    }
+    else if(s->rx_active)
+      ethgen_rx_byte(s, *s->gmii_tx_data);
+    if(*s->gmii_tx_er)
+      s->rx_bad = 1;
+  } else if(s->rx_active || s->rx_len) {
+    ethgen_rx_end(s);
+  }
+
+  *s->gmii_rx_er = 0;
+  if(!s->sending)
+  {
+    if(s->gap)
+      s->gap--;
+    else if(ethgen_ready(s))
+      ethgen_start_frame(s);
+  }
+  if(s->sending)
+  {
+    *s->gmii_rx_data = s->wire[s->wire_pos++];
+    *s->gmii_rx_dv = 1;
+    if(s->wire_pos == s->wire_len)
+      ethgen_frame_sent(s);
+  } else {
+    *s->gmii_rx_data = 0;
+    *s->gmii_rx_dv = 0;
+  }
+  s->byte_time += 1;
+}
+
+/* XGMII: eight lanes per cycle, frames start on lane 0 */
+static void ethgen_xgmii_tick(struct session_s *s)
+{
+  uint64_t data = *s->xgmii_tx_data;
+  uint8_t ctl = *s->xgmii_tx_ctl;
+  uint8_t b;
+  int i;
+
+  for(i = 0; i < 8; i++)
+  {
+    b = data >> (8 * i);
+    if(!(ctl & (1 << i)))
+    {
+      if(s->rx_active)
+        ethgen_rx_byte(s, b);
+    } else if(XGMII_START == b && 0 == i) {
+      /* Preamble and SFD fill the rest of the word */
+      s->rx_active = 1;
+      s->rx_len = 0;
+      s->rx_bad = 0;
+      ethgen_stats_begin(&s->rx, s->time_ps);
+      break;
+    } else if(s->rx_active) {
+      if(XGMII_END != b)
+        s->rx_bad = 1;
+      ethgen_rx_end(s);
+    }
+  }
+
+  data = 0;
+  ctl = 0;
+  if(!s->sending)
+  {
+    if(s->gap)
+      s->gap = s->gap > 8 ? s->gap - 8 : 0;
+    else if(ethgen_ready(s))
+      ethgen_start_frame(s);
+  }
+  for(i = 0; i < 8; i++)
+  {
+    if(s->sending && s->wire_pos < s->wire_len)
+    {
+      b = s->wire[s->wire_pos++];
+      if(1 == s->wire_pos)
+        ctl |= 1 << i;
+    } else if(s->sending) {
+      /* Terminate, the rest of the word counts in the IFG */
+      b = XGMII_END;
+      ctl |= 1 << i;
+      ethgen_frame_sent(s);
+      s->gap = ETHGEN_IFG > 7 - i ? ETHGEN_IFG - (7 - i) : 0;
+    } else {
+      b = XGMII_IDLE;
+      ctl |= 1 << i;
+    }
+    data |= (uint64_t)b << (8 * i);
+  }
+  *s->xgmii_rx_data = data;
+  *s->xgmii_rx_ctl = ctl;
+  s->byte_time += 8;
+}
+
+static void ethgen_print_stats(struct session_s *s, const char *name, struct ethgen_stats_s *st)
+{
+  uint64_t ps = st->last_ps - st->first_ps;
+  uint64_t width = ETHGEN_XGMII == s->mode ? 8 : 1;
+  double cycle_ps, wire_bytes;
+
+  printf("[ethgen] %s: %lu frames, %lu bytes", name, (unsigned long)st->frames, (unsigned long)st->bytes);
+  if(ps && s->cycles)
+  {
+    /* Share of the line rate: bytes on the wire (with preamble and IFG)
+     * over the bytes the bus could carry between the first and last frame */
+    cycle_ps = (double)s->time_ps / s->cycles;
+    wire_bytes = st->bytes + st->frames * (ETHGEN_PREAMBLE + ETHGEN_IFG);
+    printf(", %.1f Mbps (%.1f%% of line rate)", st->bytes * 8 * 1e6 / ps,
+      100.0 * wire_bytes * cycle_ps / ((double)ps * width));
+  }
+  printf("\n");
+}
+
+static void ethgen_report(struct session_s *s)
+{
+  ethgen_print_stats(s, "tx", &s->tx);
+  ethgen_print_stats(s, "rx", &s->rx);
+  printf("[ethgen] rx: %lu errors, %lu generated frames back, %lu lost, %lu reordered, %lu corrupted\n",
+    (unsigned long)s->rx_errors, (unsigned long)s->rx_tagged, (unsigned long)s->rx_lost,
+    (unsigned long)s->rx_reordered, (unsigned long)s->rx_corrupted);
+}
+
+static int ethgen_write_output(struct session_s *s)
+{
+  FILE *f = fopen(s->output, "w");
+
+  if(!f)
+  {
+    eprintf("Can't write %s\n", s->output);
+    return RC_ERROR;
+  }
+  fprintf(f, "{\n"
+    "    \"tx_frames\": %lu,\n    \"tx_bytes\": %lu,\n    \"tx_ps\": %lu,\n"
+    "    \"rx_frames\": %lu,\n    \"rx_bytes\": %lu,\n    \"rx_ps\": %lu,\n"
+    "    \"rx_errors\": %lu,\n    \"rx_tagged\": %lu,\n    \"rx_lost\": %lu,\n"
+    "    \"rx_reordered\": %lu,\n    \"rx_corrupted\": %lu,\n"
+    "    \"cycles\": %lu,\n    \"time_ps\": %lu\n}\n",
+    (unsigned long)s->tx.frames, (unsigned long)s->tx.bytes, (unsigned long)(s->tx.last_ps - s->tx.first_ps),
+    (unsigned long)s->rx.frames, (unsigned long)s->rx.bytes, (unsigned long)(s->rx.last_ps - s->rx.first_ps),
+    (unsigned long)s->rx_errors, (unsigned long)s->rx_tagged, (unsigned long)s->rx_lost,
+    (unsigned long)s->rx_reordered, (unsigned long)s->rx_corrupted,
+    (unsigned long)s->cycles, (unsigned long)s->time_ps);
+  fclose(f);
+  return RC_OK;
+}
+
+static int ethgen_start(void *b)
+{
+  printf("[ethgen] loaded\n");
+  return RC_OK;
+}
+
+static int ethgen_new(void **sess, char *args)
+{
+  int ret = RC_OK;
+  json_object *jargs = NULL;
+  struct session_s *s = NULL;
+  const char *output;
+
+  if(!sess) {
+    ret = RC_INVARG;
+    goto out;
+  }
+
+  jargs = litex_sim_args_parse("ethgen", args);
+  if(!jargs) {
+    ret = RC_JSERROR;
+    goto out;
+  }
+
+  s = (struct session_s*)malloc(sizeof(struct session_s));
+  if(!s) {
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  memset(s, 0, sizeof(struct session_s));
+  s->mode = -1;
+  s->rate = litex_sim_args_opt_int(jargs, "rate", 100);
+  s->count = litex_sim_args_opt_int(jargs, "count", 0);
+  s->start_ps = litex_sim_args_opt_int(jargs, "start_us", 0) * 1000000;
+  s->nflows = litex_sim_args_opt_int(jargs, "flows", 1);
+  s->dst_port = litex_sim_args_opt_int(jargs, "dst_port", 7);
+  s->src_port = litex_sim_args_opt_int(jargs, "src_port", 10000);
+  s->rng = litex_sim_args_opt_int(jargs, "seed", 1) | 1;
+  s->report_ps = litex_sim_args_opt_int(jargs, "report_us", 0) * 1000000;
+  s->next_report_ps = s->report_ps;
+  if(!s->rate || s->rate > 100 || !s->nflows || s->nflows > ETHGEN_FLOWS_MAX) {
+    eprintf("Invalid rate/flows\n");
+    ret = RC_INVARG;
+    goto out;
+  }
+  if(RC_OK != ethgen_parse_sizes(s, litex_sim_args_opt_string(jargs, "sizes", "64")) ||
+     RC_OK != ethgen_parse_mac(s->dst_mac, litex_sim_args_opt_string(jargs, "dst_mac", "ff:ff:ff:ff:ff:ff")) ||
+     RC_OK != ethgen_parse_mac(s->src_mac, litex_sim_args_opt_string(jargs, "src_mac", "02:00:00:00:00:01")) ||
+     RC_OK != ethgen_parse_ip(&s->dst_ip, litex_sim_args_opt_string(jargs, "dst_ip", "192.168.1.50")) ||
+     RC_OK != ethgen_parse_ip(&s->src_ip, litex_sim_args_opt_string(jargs, "src_ip", "192.168.1.100"))) {
+    eprintf("Invalid sizes/MAC/IP argument\n");
+    ret = RC_INVARG;
+    goto out;
+  }
+  output = litex_sim_args_opt_string(jargs, "output", NULL);
+  if(output)
+    s->output = strdup(output);
+  s->flows = calloc(s->nflows, sizeof(struct ethgen_flow_s));
+  if(!s->flows)
+    ret = RC_NOENMEM;
+out:
+  litex_sim_args_free(jargs);
+  *sess = (void*)s;
+  return ret;
+}
+
+static int ethgen_add_pads(void *sess, struct pad_list_s *plist)
+{
+  int ret = RC_OK;
+  struct session_s *s = (struct session_s*)sess;
+
+  if(!sess || !plist) {
+    ret = RC_INVARG;
+    goto out;
+  }
+  if(!strcmp(plist->name, "gmii_eth")) {
+    struct pad_bind_s binds[] = {
+      PAD_BIND("rx_data", &s->gmii_rx_data),
+      PAD_BIND("rx_dv", &s->gmii_rx_dv),
+      PAD_BIND("rx_er", &s->gmii_rx_er),
+      PAD_BIND("tx_data", &s->gmii_tx_data),
+      PAD_BIND("tx_en", &s->gmii_tx_en),
+      PAD_BIND("tx_er", &s->gmii_tx_er),
+      PAD_BIND_END
+    };
+    ret = litex_sim_pads_bind(plist, binds);
+    s->mode = ETHGEN_GMII;
+  }
+  if(!strcmp(plist->name, "xgmii_eth")) {
+    struct pad_bind_s binds[] = {
+      PAD_BIND("rx_data", &s->xgmii_rx_data),
+      PAD_BIND("rx_ctl", &s->xgmii_rx_ctl),
+      PAD_BIND("tx_data", &s->xgmii_tx_data),
+      PAD_BIND("tx_ctl", &s->xgmii_tx_ctl),
+      PAD_BIND_END
+    };
+    ret = litex_sim_pads_bind(plist, binds);
+    s->mode = ETHGEN_XGMII;
+  }
+  if(RC_OK != ret)
+    eprintf("Missing %s signals\n", plist->name);
+
+  if(!strcmp(plist->name, "sys_clk"))
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
+
+out:
+  return ret;
+}
+
+static int ethgen_tick(void *sess, uint64_t time_ps)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  s->time_ps = time_ps;
+  s->cycles++;
+  if(ETHGEN_GMII == s->mode)
+    ethgen_gmii_tick(s);
+  else if(ETHGEN_XGMII == s->mode)
+    ethgen_xgmii_tick(s);
+
+  if(s->report_ps && time_ps >= s->next_report_ps)
+  {
+    ethgen_report(s);
+    s->next_report_ps += s->report_ps;
+  }
+  return RC_OK;
+}
+
+static int ethgen_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+/* No idle skipping while frames are generated */
+static int ethgen_idle(void *sess, uint64_t *cycles)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *cycles = 0;
+  if(!s->sending && s->count && s->tx.frames >= s->count)
+    *cycles = UINT64_MAX;
+  return RC_OK;
+}
+
+static int ethgen_close(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+  int ret = RC_OK;
+
+  ethgen_report(s);
+  if(s->output)
+    ret = ethgen_write_output(s);
+  free(s->output);
+  free(s->flows);
+  return ret;
+}
+
+static struct ext_module_s ext_mod = {
+  "ethgen",
+  ethgen_start,
+  ethgen_new,
+  ethgen_add_pads,
+  ethgen_close,
+  ethgen_tick,
+  ethgen_clock_domain,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  EXT_MODULE_THREAD_SAFE,
+  NULL,
+  ethgen_idle,
+  NULL
+};
+
+int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
+{
+  int ret = RC_OK;
+
+  /* zlib's CRC32 table computed once, crc32() is then thread safe */
+  get_crc_table();
+
+  ret = register_module(&ext_mod);
+  return ret;
+}
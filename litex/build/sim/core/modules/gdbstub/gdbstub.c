@@ -0,0 +1,816 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include <unistd.h>
+#include <event2/listener.h>
+#include <event2/util.h>
+#include <event2/event.h>
+
+#include <json-c/json.h>
+#include "modules.h"
+#include "args.h"
+#include "ring.h"
+
+/*
+ * GDB remote serial protocol stub for the VexRiscv debug plugin, instead of
+ * jtagremote + OpenOCD and their bit-banged JTAG. GDB connects to the TCP
+ * port, the stub masters the SoC bus through the sim_gdb pads: the CPU is
+ * halted, stepped and resumed, and its registers read and written (by
+ * injected instructions), through the debug plugin registers at debug_base,
+ * one bus transaction each. Memory is read and written directly on the bus.
+ *
+ * Registers are read on every halt and written back before resuming. GDB
+ * inserts breakpoints itself by writing ebreak instructions (Z packets are
+ * not supported), the caches are flushed before resuming after memory
+ * writes. Only the 32-bit RISC-V integer registers and pc are provided.
+ */
+
+#define RING_SIZE 65536
+#define PKT_MAX 16384
+// Largest m/M/X access, in bytes
+#define MEM_MAX 4096
+#define OPS_MAX (MEM_MAX / 4 + 256)
+// Cycles between two halt checks while the CPU runs
+#define POLL_CYCLES 1024
+
+// Debug plugin registers, and control/status bits
+#define DBG_CTRL 0x0
+#define DBG_INSN 0x4
+#define DBG_HALT (1 << 1)
+#define DBG_PIP_BUSY (1 << 2)
+#define DBG_STEP (1 << 4)
+#define DBG_RESET_SET (1 << 16)
+#define DBG_HALT_SET (1 << 17)
+#define DBG_RESET_CLEAR (1 << 24)
+#define DBG_HALT_CLEAR (1 << 25)
+
+#define NREGS 33
+#define REG_PC 32
+
+#define INSN_LUI(rd, imm) ((((imm) + 0x800) & 0xfffff000) | ((rd) << 7) | 0x37)
+#define INSN_ADDI(rd, rs, imm) ((((imm) & 0xfff) << 20) | ((rs) << 15) | ((rd) << 7) | 0x13)
+#define INSN_AUIPC_X0 0x00000017
+#define INSN_JALR_X1 (0x67 | (1 << 15))
+#define INSN_FENCE_I 0x0000100f
+#define INSN_FLUSH_DCACHE 0x0000500f
+
+enum { STATE_RUNNING, STATE_HALTED };
+
+struct op_s {
+  uint32_t addr;
+  uint32_t data;
+  uint8_t sel;
+  uint8_t we;
+  // Reads are repeated while (data & mask) != want
+  uint32_t mask;
+  uint32_t want;
+  uint32_t *result;
+};
+
+struct session_s;
+typedef void (*done_t)(struct session_s *s);
+
+struct session_s {
+  uint32_t *adr;
+  uint32_t *dat_w;
+  uint32_t *dat_r;
+  uint8_t *sel;
+  uint8_t *cyc;
+  uint8_t *stb;
+  uint8_t *ack;
+  uint8_t *we;
+  char *sys_clk;
+  struct event *ev;
+  struct event *tx_ev;
+  int fd;
+  // socket (I/O thread) -> sim
+  ring_t rx_ring;
+  // sim -> socket (I/O thread)
+  ring_t tx_ring;
+  atomic_int new_conn;
+  uint32_t debug_base;
+  // Bus transactions in flight, done is called once all of them completed
+  struct op_s ops[OPS_MAX];
+  int op_rd;
+  int op_wr;
+  int bus_busy;
+  done_t done;
+  // Target state
+  int state;
+  int stop_sig;
+  uint32_t ctrl;
+  uint32_t regs[NREGS];
+  uint64_t dirty;
+  int mem_dirty;
+  uint32_t poll;
+  // Memory access in progress
+  uint32_t mem_addr;
+  uint32_t mem_len;
+  uint32_t mem[MEM_MAX / 4 + 2];
+  // Packet parser and replies
+  char pkt[PKT_MAX];
+  int pkt_len;
+  int pkt_state;
+  uint8_t pkt_cs;
+  int noack;
+  char reply[2 * MEM_MAX + 16];
+};
+
+struct event_base *base;
+
+static int gdbstub_start(void *b)
+{
+  base = (struct event_base *)b;
+  printf("[gdbstub] loaded (%p)\n", base);
+  return RC_OK;
+}
+
+static void read_handler(int fd, short event, void *arg)
+{
+  struct session_s *s = (struct session_s*)arg;
+  char buffer[1024];
+  ssize_t read_len;
+
+  read_len = read(fd, buffer, 1024);
+  if(read_len == 0) {
+    // Remote has closed the connection, the target is left as it is
+    event_del(s->ev);
+    event_free(s->ev);
+    s->ev = NULL;
+    s->fd = 0;
+    close(fd);
+  }
+  if(read_len > 0)
+    ring_push(&s->rx_ring, buffer, read_len);
+}
+
+static void tx_handler(int fd, short event, void *arg)
+{
+  struct session_s *s = (struct session_s*)arg;
+  char buffer[4096];
+  size_t len;
+
+  while((len = ring_pop(&s->tx_ring, buffer, sizeof(buffer)))) {
+    if(s->fd && -1 == write(s->fd, buffer, len)) {
+      eprintf("Error writing on socket\n");
+      break;
+    }
+  }
+}
+
+static void event_handler(int fd, short event, void *arg)
+{
+  if(event & EV_READ)
+    read_handler(fd, event, arg);
+}
+
+static void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *address, int socklen, void *ctx)
+{
+  struct session_s *s = (struct session_s*)ctx;
+
+  if(s->ev) {
+    eprintf("GDB already connected, refusing connection\n");
+    close(fd);
+    return;
+  }
+  s->fd = fd;
+  atomic_store(&s->new_conn, 1);
+  s->ev = event_new(base, fd, EV_READ | EV_PERSIST, event_handler, s);
+  event_add(s->ev, NULL);
+}
+
+static void accept_error_cb(struct evconnlistener *listener, void *ctx)
+{
+  struct event_base *base = evconnlistener_get_base(listener);
+  eprintf("ERROR\n");
+
+  event_base_loopexit(base, NULL);
+}
+
+/*---------------- Bus transactions ----------------*/
+
+static struct op_s *gdbstub_op(struct session_s *s, int we, uint32_t addr, uint32_t data)
+{
+  struct op_s *op = &s->ops[s->op_wr++];
+
+  memset(op, 0, sizeof(struct op_s));
+  op->we = we;
+  op->addr = addr;
+  op->data = data;
+  op->sel = 0xf;
+  return op;
+}
+
+static void gdbstub_write_ctrl(struct session_s *s, uint32_t v)
+{
+  gdbstub_op(s, 1, s->debug_base + DBG_CTRL, v);
+}
+
+static void gdbstub_wait(struct session_s *s, uint32_t mask, uint32_t want)
+{
+  struct op_s *op = gdbstub_op(s, 0, s->debug_base + DBG_CTRL, 0);
+
+  op->mask = mask;
+  op->want = want;
+  op->result = &s->ctrl;
+}
+
+/* Execute an instruction on the halted CPU, its result read into result */
+static void gdbstub_insn(struct session_s *s, uint32_t insn, uint32_t *result)
+{
+  gdbstub_op(s, 1, s->debug_base + DBG_INSN, insn);
+  gdbstub_wait(s, DBG_PIP_BUSY, 0);
+  if(result)
+    gdbstub_op(s, 0, s->debug_base + DBG_INSN, 0)->result = result;
+}
+
+static void gdbstub_set_reg(struct session_s *s, int reg, uint32_t v)
+{
+  gdbstub_insn(s, INSN_LUI(reg, v), NULL);
+  gdbstub_insn(s, INSN_ADDI(reg, reg, v), NULL);
+}
+
+/*---------------- Replies ----------------*/
+
+static void gdbstub_send(struct session_s *s, const char *payload)
+{
+  char trailer[4];
+  uint8_t cs = 0;
+  size_t len = strlen(payload);
+  size_t i;
+
+  for(i = 0; i < len; i++)
+    cs += payload[i];
+  snprintf(trailer, sizeof(trailer), "#%02x", cs);
+  ring_push(&s->tx_ring, "$", 1);
+  ring_push(&s->tx_ring, payload, len);
+  ring_push(&s->tx_ring, trailer, 3);
+}
+
+static char *gdbstub_hex32(char *p, uint32_t v)
+{
+  int i;
+
+  // Little-endian byte order, as in target memory
+  for(i = 0; i < 4; i++, v >>= 8)
+    p += sprintf(p, "%02x", v & 0xff);
+  return p;
+}
+
+static int gdbstub_unhex(int c)
+{
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static uint32_t gdbstub_parse_reg(const char *p)
+{
+  uint32_t v = 0;
+  int i;
+
+  for(i = 0; i < 4 && gdbstub_unhex(p[2*i]) >= 0 && gdbstub_unhex(p[2*i + 1]) >= 0; i++)
+    v |= (uint32_t)((gdbstub_unhex(p[2*i]) << 4) | gdbstub_unhex(p[2*i + 1])) << (8*i);
+  return v;
+}
+
+static void gdbstub_reply_ok(struct session_s *s)
+{
+  gdbstub_send(s, "OK");
+}
+
+/*---------------- Target control ----------------*/
+
+static void gdbstub_stopped(struct session_s *s)
+{
+  s->regs[0] = 0;
+  s->dirty = 0;
+  s->state = STATE_HALTED;
+  sprintf(s->reply, "S%02x", s->stop_sig);
+  gdbstub_send(s, s->reply);
+}
+
+/* Read all registers of the halted CPU, then call done */
+static void gdbstub_load_regs(struct session_s *s, done_t done)
+{
+  int i;
+
+  gdbstub_wait(s, DBG_HALT | DBG_PIP_BUSY, DBG_HALT);
+  for(i = 1; i < 32; i++)
+    gdbstub_insn(s, INSN_ADDI(0, i, 0), &s->regs[i]);
+  gdbstub_insn(s, INSN_AUIPC_X0, &s->regs[REG_PC]);
+  s->done = done;
+}
+
+static void gdbstub_halt(struct session_s *s, int sig)
+{
+  s->stop_sig = sig;
+  gdbstub_write_ctrl(s, DBG_HALT_SET);
+  gdbstub_load_regs(s, gdbstub_stopped);
+}
+
+static void gdbstub_running(struct session_s *s)
+{
+  s->state = STATE_RUNNING;
+  s->poll = 0;
+}
+
+static void gdbstub_reset_done(struct session_s *s)
+{
+  s->regs[0] = 0;
+  s->dirty = 0;
+  s->state = STATE_HALTED;
+  s->stop_sig = 5;
+  gdbstub_reply_ok(s);
+}
+
+static void gdbstub_detached(struct session_s *s)
+{
+  gdbstub_running(s);
+  gdbstub_reply_ok(s);
+}
+
+/* Write back the modified registers, flush the caches and let the CPU run */
+static void gdbstub_resume(struct session_s *s, int step, done_t done)
+{
+  int i;
+
+  if(s->dirty & (1ULL << REG_PC)) {
+    gdbstub_set_reg(s, 1, s->regs[REG_PC]);
+    gdbstub_insn(s, INSN_JALR_X1, NULL);
+    s->dirty |= 1 << 1;
+  }
+  for(i = 1; i < 32; i++)
+    if(s->dirty & (1ULL << i))
+      gdbstub_set_reg(s, i, s->regs[i]);
+  if(s->mem_dirty) {
+    gdbstub_insn(s, INSN_FENCE_I, NULL);
+    gdbstub_insn(s, INSN_FLUSH_DCACHE, NULL);
+    s->mem_dirty = 0;
+  }
+  s->dirty = 0;
+  s->stop_sig = 5;
+  gdbstub_write_ctrl(s, DBG_HALT_CLEAR | (step ? DBG_STEP : 0));
+  s->done = done;
+}
+
+static void gdbstub_check_halt(struct session_s *s)
+{
+  if(s->state == STATE_RUNNING && (s->ctrl & DBG_HALT))
+    gdbstub_load_regs(s, gdbstub_stopped);
+}
+
+/*---------------- Memory ----------------*/
+
+static void gdbstub_mem_reply(struct session_s *s)
+{
+  uint32_t off = s->mem_addr & 3;
+  char *p = s->reply;
+  uint32_t i;
+
+  // Words are little-endian, as on the CPU
+  for(i = off; i < off + s->mem_len; i++)
+    p += sprintf(p, "%02x", (s->mem[i / 4] >> (8 * (i & 3))) & 0xff);
+  *p = 0;
+  gdbstub_send(s, s->reply);
+}
+
+static void gdbstub_mem_read(struct session_s *s, uint32_t addr, uint32_t len)
+{
+  uint32_t a;
+  int i = 0;
+
+  s->mem_addr = addr;
+  s->mem_len = len;
+  for(a = addr & ~3; a < addr + len; a += 4)
+    gdbstub_op(s, 0, a, 0)->result = &s->mem[i++];
+  s->done = gdbstub_mem_reply;
+}
+
+static void gdbstub_mem_write(struct session_s *s, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+  struct op_s *op = NULL;
+  uint32_t i, a;
+
+  for(i = 0; i < len; i++) {
+    a = addr + i;
+    if(!op || (a & 3) == 0) {
+      op = gdbstub_op(s, 1, a & ~3, 0);
+      op->sel = 0;
+    }
+    op->data |= (uint32_t)data[i] << (8 * (a & 3));
+    op->sel |= 1 << (a & 3);
+  }
+  s->mem_dirty = 1;
+  s->done = gdbstub_reply_ok;
+}
+
+/*---------------- Packets ----------------*/
+
+static int gdbstub_parse_addr_len(const char *p, uint32_t *addr, uint32_t *len, char **end)
+{
+  char *e;
+
+  *addr = strtoul(p, &e, 16);
+  if(*e != ',')
+    return -1;
+  *len = strtoul(e + 1, &e, 16);
+  if(*len > MEM_MAX)
+    return -1;
+  *end = e;
+  return 0;
+}
+
+static void gdbstub_monitor(struct session_s *s, const char *hex)
+{
+  char cmd[64];
+  int i;
+
+  for(i = 0; i < sizeof(cmd) - 1 && gdbstub_unhex(hex[0]) >= 0 && gdbstub_unhex(hex[1]) >= 0; i++, hex += 2)
+    cmd[i] = (gdbstub_unhex(hex[0]) << 4) | gdbstub_unhex(hex[1]);
+  cmd[i] = 0;
+  if(!strcmp(cmd, "reset") || !strcmp(cmd, "reset halt")) {
+    // The CPU restarts from its reset address, halted
+    gdbstub_write_ctrl(s, DBG_RESET_SET | DBG_HALT_SET);
+    gdbstub_write_ctrl(s, DBG_RESET_CLEAR);
+    gdbstub_load_regs(s, gdbstub_reset_done);
+    return;
+  }
+  gdbstub_send(s, "");
+}
+
+static void gdbstub_packet(struct session_s *s, char *pkt, int len)
+{
+  uint8_t data[MEM_MAX];
+  uint32_t addr, n, i;
+  char *p, *e;
+  int reg;
+
+  pkt[len] = 0;
+  if(s->state == STATE_RUNNING && pkt[0] != '?') {
+    // Only a stop request makes sense while the CPU runs
+    gdbstub_send(s, "E01");
+    return;
+  }
+  switch(pkt[0]) {
+  case '?':
+    if(s->state == STATE_RUNNING)
+      gdbstub_halt(s, 5);
+    else {
+      sprintf(s->reply, "S%02x", s->stop_sig);
+      gdbstub_send(s, s->reply);
+    }
+    break;
+  case 'g':
+    p = s->reply;
+    for(reg = 0; reg < NREGS; reg++)
+      p = gdbstub_hex32(p, s->regs[reg]);
+    *p = 0;
+    gdbstub_send(s, s->reply);
+    break;
+  case 'G':
+    for(reg = 1, p = pkt + 1 + 8; reg < NREGS && p + 8 <= pkt + len; reg++, p += 8) {
+      s->regs[reg] = gdbstub_parse_reg(p);
+      s->dirty |= 1ULL << reg;
+    }
+    gdbstub_reply_ok(s);
+    break;
+  case 'p':
+    reg = strtoul(pkt + 1, NULL, 16);
+    if(reg < NREGS) {
+      *gdbstub_hex32(s->reply, s->regs[reg]) = 0;
+      gdbstub_send(s, s->reply);
+    } else
+      gdbstub_send(s, "xxxxxxxx");
+    break;
+  case 'P':
+    reg = strtoul(pkt + 1, &e, 16);
+    if(*e != '=' || reg >= NREGS) {
+      gdbstub_send(s, "E01");
+      break;
+    }
+    if(reg) {
+      s->regs[reg] = gdbstub_parse_reg(e + 1);
+      s->dirty |= 1ULL << reg;
+    }
+    gdbstub_reply_ok(s);
+    break;
+  case 'm':
+    if(gdbstub_parse_addr_len(pkt + 1, &addr, &n, &e)) {
+      gdbstub_send(s, "E01");
+      break;
+    }
+    if(!n)
+      gdbstub_send(s, "");
+    else
+      gdbstub_mem_read(s, addr, n);
+    break;
+  case 'M':
+    if(gdbstub_parse_addr_len(pkt + 1, &addr, &n, &e) || *e != ':') {
+      gdbstub_send(s, "E01");
+      break;
+    }
+    for(i = 0, p = e + 1; i < n; i++, p += 2) {
+      if(gdbstub_unhex(p[0]) < 0 || gdbstub_unhex(p[1]) < 0)
+        break;
+      data[i] = (gdbstub_unhex(p[0]) << 4) | gdbstub_unhex(p[1]);
+    }
+    if(i < n) {
+      gdbstub_send(s, "E01");
+      break;
+    }
+    if(!n)
+      gdbstub_reply_ok(s);
+    else
+      gdbstub_mem_write(s, addr, data, n);
+    break;
+  case 'X':
+    if(gdbstub_parse_addr_len(pkt + 1, &addr, &n, &e) || *e != ':') {
+      gdbstub_send(s, "E01");
+      break;
+    }
+    for(i = 0, p = e + 1; i < n && p < pkt + len; i++, p++) {
+      if(*p == '}')
+        data[i] = *++p ^ 0x20;
+      else
+        data[i] = *p;
+    }
+    if(i < n) {
+      gdbstub_send(s, "E01");
+      break;
+    }
+    if(!n)
+      gdbstub_reply_ok(s);
+    else
+      gdbstub_mem_write(s, addr, data, n);
+    break;
+  case 'c':
+  case 's':
+    if(pkt[1]) {
+      s->regs[REG_PC] = strtoul(pkt + 1, NULL, 16);
+      s->dirty |= 1ULL << REG_PC;
+    }
+    gdbstub_resume(s, pkt[0] == 's', gdbstub_running);
+    break;
+  case 'D':
+    gdbstub_resume(s, 0, gdbstub_detached);
+    break;
+  case 'k':
+    gdbstub_resume(s, 0, gdbstub_running);
+    break;
+  case 'H':
+  case 'T':
+    gdbstub_reply_ok(s);
+    break;
+  case 'q':
+    if(!strncmp(pkt, "qSupported", 10)) {
+      sprintf(s->reply, "PacketSize=%x;QStartNoAckMode+", PKT_MAX - 16);
+      gdbstub_send(s, s->reply);
+    } else if(!strcmp(pkt, "qAttached"))
+      gdbstub_send(s, "1");
+    else if(!strncmp(pkt, "qRcmd,", 6))
+      gdbstub_monitor(s, pkt + 6);
+    else
+      gdbstub_send(s, "");
+    break;
+  case 'Q':
+    if(!strcmp(pkt, "QStartNoAckMode")) {
+      gdbstub_reply_ok(s);
+      s->noack = 1;
+    } else
+      gdbstub_send(s, "");
+    break;
+  default:
+    gdbstub_send(s, "");
+    break;
+  }
+}
+
+/* Parse what GDB sent, until a packet needs bus transactions */
+static void gdbstub_rx(struct session_s *s)
+{
+  char c;
+  uint8_t cs;
+  int i;
+
+  while(s->op_wr == 0 && ring_pop(&s->rx_ring, &c, 1)) {
+    switch(s->pkt_state) {
+    case 0:
+      if(c == '$') {
+        s->pkt_len = 0;
+        s->pkt_state = 1;
+      } else if(c == 0x03 && s->state == STATE_RUNNING)
+        gdbstub_halt(s, 2);
+      break;
+    case 1:
+      if(c == '#')
+        s->pkt_state = 2;
+      else if(s->pkt_len < PKT_MAX - 1)
+        s->pkt[s->pkt_len++] = c;
+      break;
+    case 2:
+      s->pkt_cs = gdbstub_unhex(c) << 4;
+      s->pkt_state = 3;
+      break;
+    case 3:
+      s->pkt_state = 0;
+      for(cs = 0, i = 0; i < s->pkt_len; i++)
+        cs += s->pkt[i];
+      if(cs != (uint8_t)(s->pkt_cs | gdbstub_unhex(c)) && !s->noack) {
+        ring_push(&s->tx_ring, "-", 1);
+        break;
+      }
+      if(!s->noack)
+        ring_push(&s->tx_ring, "+", 1);
+      gdbstub_packet(s, s->pkt, s->pkt_len);
+      break;
+    }
+  }
+}
+
+/*---------------- Module ----------------*/
+
+static int gdbstub_new(void **sess, char *args)
+{
+  int ret = RC_OK;
+  struct session_s *s = NULL;
+  json_object *jargs = NULL;
+  int port;
+  struct evconnlistener *listener;
+  struct sockaddr_in sin;
+  struct timeval tx_tv = {0, 1000};
+
+  if(!sess) {
+    ret = RC_INVARG;
+    goto out;
+  }
+  jargs = litex_sim_args_parse("gdbstub", args);
+  if(!jargs) {
+    ret = RC_JSERROR;
+    goto out;
+  }
+  port = litex_sim_args_opt_int(jargs, "port", 3333);
+
+  s = (struct session_s*)malloc(sizeof(struct session_s));
+  if(!s) {
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  memset(s, 0, sizeof(struct session_s));
+  s->debug_base = litex_sim_args_opt_int(jargs, "debug_base", 0xf00f0000);
+  // The CPU runs until GDB stops it
+  s->state = STATE_RUNNING;
+  s->stop_sig = 5;
+  if(ring_init(&s->rx_ring, RING_SIZE, 1) || ring_init(&s->tx_ring, RING_SIZE, 1)) {
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  s->tx_ev = event_new(base, -1, EV_PERSIST, tx_handler, s);
+  event_add(s->tx_ev, &tx_tv);
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(0);
+  sin.sin_port = htons(port);
+  listener = evconnlistener_new_bind(base, accept_conn_cb, s, LEV_OPT_CLOSE_ON_FREE|LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&sin, sizeof(sin));
+  if(!listener) {
+    ret = RC_ERROR;
+    eprintf("Can't bind port %d\n", port);
+    goto out;
+  }
+  evconnlistener_set_error_cb(listener, accept_error_cb);
+  printf("[gdbstub] listening on port %d\n", port);
+
+out:
+  litex_sim_args_free(jargs);
+  *sess = (void*)s;
+  return ret;
+}
+
+static int gdbstub_add_pads(void *sess, struct pad_list_s *plist)
+{
+  int ret = RC_OK;
+  struct session_s *s = (struct session_s*)sess;
+
+  if(!sess || !plist) {
+    ret = RC_INVARG;
+    goto out;
+  }
+  if(!strcmp(plist->name, "sim_gdb")) {
+    struct pad_bind_s binds[] = {
+      PAD_BIND("adr", &s->adr),
+      PAD_BIND("dat_w", &s->dat_w),
+      PAD_BIND("dat_r", &s->dat_r),
+      PAD_BIND("sel", &s->sel),
+      PAD_BIND("cyc", &s->cyc),
+      PAD_BIND("stb", &s->stb),
+      PAD_BIND("ack", &s->ack),
+      PAD_BIND("we", &s->we),
+      PAD_BIND_END
+    };
+    litex_sim_pads_bind(plist, binds);
+  }
+  if(!strcmp(plist->name, "sys_clk"))
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
+
+out:
+  return ret;
+}
+
+static int gdbstub_tick(void *sess, uint64_t time_ps)
+{
+  struct session_s *s = (struct session_s*)sess;
+  struct op_s *op;
+  done_t done;
+
+  if(s->bus_busy) {
+    if(!*s->ack)
+      return RC_OK;
+    // One idle cycle between transactions
+    op = &s->ops[s->op_rd];
+    *s->cyc = 0;
+    *s->stb = 0;
+    *s->we = 0;
+    s->bus_busy = 0;
+    if(op->result)
+      *op->result = *s->dat_r;
+    if(op->we || (*s->dat_r & op->mask) == op->want)
+      s->op_rd++;
+    return RC_OK;
+  }
+  if(s->op_rd < s->op_wr) {
+    op = &s->ops[s->op_rd];
+    *s->adr = op->addr >> 2;
+    *s->dat_w = op->data;
+    *s->sel = op->sel;
+    *s->we = op->we;
+    *s->cyc = 1;
+    *s->stb = 1;
+    s->bus_busy = 1;
+    return RC_OK;
+  }
+  if(s->op_wr) {
+    s->op_rd = s->op_wr = 0;
+    done = s->done;
+    s->done = NULL;
+    if(done)
+      done(s);
+    return RC_OK;
+  }
+
+  if(atomic_exchange(&s->new_conn, 0)) {
+    s->pkt_state = 0;
+    s->noack = 0;
+  }
+  // Stop request or packets from GDB first, then halt checks while running
+  gdbstub_rx(s);
+  if(s->op_wr == 0 && s->state == STATE_RUNNING && s->fd && ++s->poll >= POLL_CYCLES) {
+    s->poll = 0;
+    gdbstub_op(s, 0, s->debug_base + DBG_CTRL, 0)->result = &s->ctrl;
+    s->done = gdbstub_check_halt;
+  }
+  return RC_OK;
+}
+
+static int gdbstub_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static int gdbstub_io_pending(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  return ring_count(&s->rx_ring) != 0 || s->op_wr != 0;
+}
+
+static struct ext_module_s ext_mod = {
+  "gdbstub",
+  gdbstub_start,
+  gdbstub_new,
+  gdbstub_add_pads,
+  NULL,
+  gdbstub_tick,
+  gdbstub_clock_domain,
+  NULL,
+  gdbstub_io_pending,
+  NULL,
+  NULL,
+  EXT_MODULE_THREAD_SAFE
+};
+
+int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
+{
+  int ret = RC_OK;
+  ret = register_module(&ext_mod);
+  return ret;
+}
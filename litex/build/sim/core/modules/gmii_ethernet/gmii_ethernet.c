@@ -12,6 +12,12 @@
 #include <zlib.h>
 #include "tapcfg.h"
 #include "modules.h"
+#include "args.h"
+#include "ring.h"
+#include "pktpool.h"
+#include "pcap.h"
+#include "ethsw.h"
+#include "ethqueue.h"
 
 // ---------- SETTINGS ---------- //
 
@@ -34,14 +40,6 @@ static const char macadr[6] = {0xaa, 0xb6, 0x24, 0x69, 0x77, 0x21};
 
 #define MIN_ETH_LEN 60
 
-// RX incoming (TAP -> Sim) Ethernet packet queue structs
-typedef struct eth_packet_queue {
-    // Does not contain the trailing CRC32 checksum
-    uint8_t data[ETH_LEN];
-    size_t len;
-    struct eth_packet_queue *next;
-} eth_packet_queue_t;
-
 typedef struct gmii_state {
     // ---------- SIMULATION & BUS STATE ----------
     // GMII bus signals
@@ -75,8 +73,9 @@ typedef struct gmii_state {
 
     // ---------- TX (Sim -> TAP) STATE ---------
 
-    // Packet currently being transmitted over the GMII bus (Sim -> TAP).
-    uint8_t current_tx_pkt[ETH_LEN];
+    // Packet currently being transmitted over the GMII bus (Sim -> TAP),
+    // taken from tx_pool and built in place.
+    struct pkt_s *current_tx_pkt;
     size_t current_tx_len;
 
     bool prev_tx_en;
@@ -86,23 +85,45 @@ typedef struct gmii_state {
 
     // ---------- RX (TAP -> Sim) STATE ---------
 
-    // Packet currently being received over the GMII bus (TAP -> Sim). Packets
-    // copied here are already removed from the TAP incoming queue. Fields are
-    // valid if current_rx_len != 0. This field includes the CRC32 checksum.
-    uint8_t current_rx_pkt[ETH_LEN + sizeof(uint32_t)];
+    // Packet currently being received over the GMII bus (TAP -> Sim), owned
+    // by the simulation until it is given back to rx_pool. Fields are valid if
+    // current_rx_len != 0. The CRC32 checksum is appended in place.
+    struct pkt_s *current_rx_pkt;
     uint8_t current_rx_preamble_state;
     size_t current_rx_len;
     size_t current_rx_progress;
 
-    // Linked list of pending RX (TAP -> Sim) packets. `tail` is only valid when
-    // head != NULL.
-    eth_packet_queue_t *pending_rx_pkt_head;
-    eth_packet_queue_t *pending_rx_pkt_tail;
+    // Pending RX (TAP -> Sim) packets, filled by the I/O thread
+    pkt_pool_t rx_pool;
+    ring_t rx_ring;
     struct event *ev;
+
+    // Pending TX (Sim -> TAP) packets, drained by the I/O thread
+    pkt_pool_t tx_pool;
+    ring_t tx_ring;
+    struct event *tx_ev;
+
+    // Queue depth, backpressure and frame/drop counts
+    struct eth_queue_s q;
+
+    // ---------- OFFLINE (PCAP/SWITCH) STATE ---------
+    // Set when pcap_in and/or pcap_out are given, or with the shm backend:
+    // frames are replayed from and recorded to capture files, and exchanged
+    // with the shared memory switch, on the simulation thread, no TAP
+    // interface is used.
+    bool offline;
+    struct pcap_replay_s pcap_in;
+    pcap_t pcap_out;
+    ethsw_t sw;
+
+    // Stimulus log stream, replacing all the RX inputs when replaying
+    struct stim_stream_s *stim;
 } gmii_ethernet_state_t;
 
 // Shared libevent state, set on module init
 static struct event_base *base = NULL;
+// Sessions created, naming their stimulus log streams
+static int nsessions = 0;
 
 /**
  * Advance the RX (TAP -> Sim) state machine, producing a new bus snapshot
@@ -140,7 +161,7 @@ static void gmii_ethernet_rx_adv(gmii_ethernet_state_t *s,
             *s->rx_er_signal = false;
             s->current_rx_preamble_state++;
         } else if (s->current_rx_progress < s->current_rx_len) {
-            *s->rx_data_signal = s->current_rx_pkt[s->current_rx_progress++];
+            *s->rx_data_signal = s->current_rx_pkt->data[s->current_rx_progress++];
             *s->rx_dv_signal = true; // Data on the bus is valid
             *s->rx_er_signal = false; // No receive error in this data word
         } else {
@@ -151,6 +172,8 @@ static void gmii_ethernet_rx_adv(gmii_ethernet_state_t *s,
             s->current_rx_preamble_state = 0;
             s->current_rx_progress = 0;
             s->current_rx_len = 0;
+            pkt_pool_put(&s->rx_pool, s->current_rx_pkt);
+            s->current_rx_pkt = NULL;
 
             *s->rx_data_signal = 0;
             *s->rx_dv_signal = 0;
@@ -167,45 +190,45 @@ static void gmii_ethernet_rx_adv(gmii_ethernet_state_t *s,
     if (!s->current_rx_len) {
         // No packet is currently in transit (or one has just completed
         // reception). Check if there is an outstanding packet from the TAP
-        // interface and copy it into the input buffer
-        if (s->pending_rx_pkt_head) {
-            eth_packet_queue_t* popped_rx_pkt;
-
-            // CRITICAL REGION {
-            // Advance the pending packets queue, removing the copied
-            // packet and freeing its allocated memory.
-            popped_rx_pkt = s->pending_rx_pkt_head;
-            s->pending_rx_pkt_head = s->pending_rx_pkt_head->next;
-            // } CRITICAL REGION
-
-            // Determine the maximum length to copy. We must not copy
-            // beyond the length of s->current_rx_pkt and need to
-            // reserve at least 4 bytes for the CRC32 to be appended.
-            size_t copy_len =
-                (popped_rx_pkt->len
-                 <= sizeof(s->current_rx_pkt) - sizeof(uint32_t))
-                  ? popped_rx_pkt->len
-                  : sizeof(s->current_rx_pkt) - sizeof(uint32_t);
-
-            // Copy the packet into the buffer
-            memcpy(s->current_rx_pkt, popped_rx_pkt->data, copy_len);
-
-            // Calculate the CRC32 checksum and append it to the
-            // packet data. This uses the original packet's length. If
-            // the original packet didn't fit into the buffer, the CRC
-            // is going to be wrong and thus the packet being cut off
-            // can be detected.
-            uint32_t crc = crc32(0, popped_rx_pkt->data, popped_rx_pkt->len);
-            s->current_rx_pkt[copy_len + 3] = (crc >> 24) & 0xFF;
-            s->current_rx_pkt[copy_len + 2] = (crc >> 16) & 0xFF;
-            s->current_rx_pkt[copy_len + 1] = (crc >>  8) & 0xFF;
-            s->current_rx_pkt[copy_len + 0] = (crc >>  0) & 0xFF;
+        // interface and take it over
+        struct pkt_s *popped_rx_pkt;
+
+        // Offline, the packets received from the switch and the replayed
+        // packets due by now are queued first
+        if (eth_queue_stim_replaying(s->stim)) {
+            eth_queue_stim_poll(s->stim, &s->rx_pool, &s->rx_ring, ETH_LEN,
+                                time_ps);
+        } else {
+            if (s->sw.shm) {
+                ethsw_poll(&s->sw, &s->rx_pool, &s->rx_ring, ETH_LEN,
+                           MIN_ETH_LEN);
+            }
+            if (s->offline) {
+                pcap_replay_poll(&s->pcap_in, &s->rx_pool, &s->rx_ring,
+                                 ETH_LEN, MIN_ETH_LEN, time_ps);
+            }
+        }
+
+        // Pop the oldest packet handed over by the I/O thread. The ring is
+        // lock-free, this is the only consumer.
+        if (ring_pop(&s->rx_ring, &popped_rx_pkt, 1)) {
+            eth_queue_rx(&s->q, popped_rx_pkt->len);
+            eth_queue_stim_record(s->stim, popped_rx_pkt, time_ps);
+            // Packets are read with at most ETH_LEN bytes, leaving room for
+            // the CRC32 checksum appended to the packet data in place
+            size_t copy_len = popped_rx_pkt->len;
+            uint32_t crc = crc32(0, popped_rx_pkt->data, copy_len);
+            popped_rx_pkt->data[copy_len + 3] = (crc >> 24) & 0xFF;
+            popped_rx_pkt->data[copy_len + 2] = (crc >> 16) & 0xFF;
+            popped_rx_pkt->data[copy_len + 1] = (crc >>  8) & 0xFF;
+            popped_rx_pkt->data[copy_len + 0] = (crc >>  0) & 0xFF;
+            s->current_rx_pkt = popped_rx_pkt;
 
 #ifdef GMII_RX_DEBUG
             fprintf(stderr, "\n----------------------------------\n"
                     "Received packet with %ld bytes\n", copy_len);
             for (size_t i = 0; i < copy_len; i++) {
-                fprintf(stderr, "%02x", s->current_rx_pkt[i] & 0xff);
+                fprintf(stderr, "%02x", s->current_rx_pkt->data[i] & 0xff);
                 if (i != 0 && (i + 1) % 16 == 0) {
                     fprintf(stderr, "\n");
                 } else if (i != 0 && (i + 1) % 8 == 0) {
@@ -219,11 +242,54 @@ static void gmii_ethernet_rx_adv(gmii_ethernet_state_t *s,
             // indicate that a packet is ready to be transmitted over
             // the GMII interface
             s->current_rx_len = copy_len + sizeof(uint32_t);
+        }
+    }
+}
 
-            // Release the packet data memory
-            free(popped_rx_pkt);
+/**
+ * Queue the transmitted (Sim -> TAP) packet for the I/O thread
+ *
+ * The packet buffer itself is handed over, a new one is taken from the pool on
+ * the next transmission. The actual TAP write happens in tx_handler() on the
+ * I/O thread, keeping syscalls out of the simulation loop. Offline, the packet
+ * is recorded right away, timestamped with the simulation time.
+ */
+static void gmii_ethernet_tx_push(gmii_ethernet_state_t *s, size_t len, uint64_t time_ps) {
+    eth_queue_tx(&s->q, len);
+    if (s->offline) {
+        if (s->pcap_out.f
+            && pcap_write(&s->pcap_out, s->current_tx_pkt->data, len, time_ps)) {
+            fprintf(stderr, "[gmii_ethernet]: capture write error\n");
+        }
+        if (s->sw.shm) {
+            ethsw_send(&s->sw, s->current_tx_pkt->data, len);
         }
+        pkt_pool_put(&s->tx_pool, s->current_tx_pkt);
+        s->current_tx_pkt = NULL;
+        return;
     }
+    s->current_tx_pkt->len = len;
+    ring_push(&s->tx_ring, &s->current_tx_pkt, 1);
+    s->current_tx_pkt = NULL;
+}
+
+/**
+ * Take a buffer for a new transmitted (Sim -> TAP) packet
+ *
+ * The buffer of an aborted transmission is reused. Returns false when all
+ * buffers are still queued for the I/O thread.
+ */
+static bool gmii_ethernet_tx_get(gmii_ethernet_state_t *s) {
+    if (!s->current_tx_pkt) {
+        s->current_tx_pkt = pkt_pool_get(&s->tx_pool);
+    }
+    if (!s->current_tx_pkt) {
+        if (s->q.tx_dropped++ == 0) {
+            fprintf(stderr, "[gmii_ethernet]: TX queue full, dropping packets\n");
+        }
+        return false;
+    }
+    return true;
 }
 
 /**
@@ -243,7 +309,7 @@ static void gmii_ethernet_tx_adv(gmii_ethernet_state_t *s, uint64_t time_ps) {
         // abort state
         s->current_tx_len = 0;
         s->current_tx_preamble_state = 0;
-        s->current_tx_abrt = false;
+        s->current_tx_abrt = !gmii_ethernet_tx_get(s);
         s->current_tx_drop_warning = false;
     }
 
@@ -287,7 +353,7 @@ static void gmii_ethernet_tx_adv(gmii_ethernet_state_t *s, uint64_t time_ps) {
                 preamble_error = true;
             }
         } else {
-            s->current_tx_pkt[s->current_tx_len++] = *s->tx_data_signal;
+            s->current_tx_pkt->data[s->current_tx_len++] = *s->tx_data_signal;
         }
 
         if (preamble_error) {
@@ -313,7 +379,7 @@ static void gmii_ethernet_tx_adv(gmii_ethernet_state_t *s, uint64_t time_ps) {
         fprintf(stderr, "\n----------------------------------\n"
                 "Transmitted packet with %ld bytes\n", pkt_len);
         for (size_t i = 0; i < pkt_len; i++) {
-            fprintf(stderr, "%02x", s->current_tx_pkt[i] & 0xff);
+            fprintf(stderr, "%02x", s->current_tx_pkt->data[i] & 0xff);
             if (i != 0 && (i + 1) % 16 == 0) {
                 fprintf(stderr, "\n");
             } else if (i != 0 && (i + 1) % 8 == 0) {
@@ -327,22 +393,22 @@ static void gmii_ethernet_tx_adv(gmii_ethernet_state_t *s, uint64_t time_ps) {
             fprintf(stderr, "[gmii_ethernet]: TX packet too short to contain "
                     "frame check sequence\n");
         } else {
-            uint32_t crc = crc32(0, s->current_tx_pkt, pkt_len);
-            if (!((s->current_tx_pkt[pkt_len + 0] == ((crc >>  0) & 0xFF))
-                  && (s->current_tx_pkt[pkt_len + 1] == ((crc >>  8) & 0xFF))
-                  && (s->current_tx_pkt[pkt_len + 2] == ((crc >> 16) & 0xFF))
-                  && (s->current_tx_pkt[pkt_len + 3] == ((crc >> 24) & 0xFF))))
+            uint32_t crc = crc32(0, s->current_tx_pkt->data, pkt_len);
+            if (!((s->current_tx_pkt->data[pkt_len + 0] == ((crc >>  0) & 0xFF))
+                  && (s->current_tx_pkt->data[pkt_len + 1] == ((crc >>  8) & 0xFF))
+                  && (s->current_tx_pkt->data[pkt_len + 2] == ((crc >> 16) & 0xFF))
+                  && (s->current_tx_pkt->data[pkt_len + 3] == ((crc >> 24) & 0xFF))))
             {
                 fprintf(stderr, "[gmii_ethernet]: TX packet FCS mismatch. "
                         "Expected: %08x. Actual: %08x.\n", crc,
-                        (uint32_t) s->current_tx_pkt[pkt_len + 0] << 0
-                        | (uint32_t) s->current_tx_pkt[pkt_len + 1] << 8
-                        | (uint32_t) s->current_tx_pkt[pkt_len + 2] << 16
-                        | (uint32_t) s->current_tx_pkt[pkt_len + 3] << 24);
+                        (uint32_t) s->current_tx_pkt->data[pkt_len + 0] << 0
+                        | (uint32_t) s->current_tx_pkt->data[pkt_len + 1] << 8
+                        | (uint32_t) s->current_tx_pkt->data[pkt_len + 2] << 16
+                        | (uint32_t) s->current_tx_pkt->data[pkt_len + 3] << 24);
             }
         }
 
-        tapcfg_write(s->tapcfg, s->current_tx_pkt, pkt_len);
+        gmii_ethernet_tx_push(s, pkt_len, time_ps);
     }
 
     // Store the previous tx_en_signal for edge detection
@@ -363,74 +429,27 @@ static int gmii_ethernet_tick(void *state, uint64_t time_ps) {
     return RC_OK;
 }
 
-int litex_sim_module_get_args(char *args, char *arg, char **val) {
-    int ret = RC_OK;
-    json_object *jsobj = NULL;
-    json_object *obj = NULL;
-    char *value = NULL;
-    int r;
-
-    jsobj = json_tokener_parse(args);
-    if (NULL == jsobj) {
-        fprintf(stderr, "[gmii_ethernet]: error parsing json arg: %s\n", args);
-        ret = RC_JSERROR;
-        goto out;
-    }
-
-    if (!json_object_is_type(jsobj, json_type_object)) {
-        fprintf(stderr, "[gmii_ethernet]: arg must be type object!: %s\n",
-                args);
-        ret = RC_JSERROR;
-        goto out;
-    }
-
-    obj = NULL;
-    r = json_object_object_get_ex(jsobj, arg, &obj);
-    if (!r) {
-        fprintf(stderr, "[gmii_ethernet]: could not find object: \"%s\" "
-                "(%s)\n", arg, args);
-        ret = RC_JSERROR;
-        goto out;
-    }
-    value = strdup(json_object_get_string(obj));
-
- out:
-    *val = value;
-    return ret;
-}
-
-static int litex_sim_module_pads_get(struct pad_s *pads, char *name,
-                                     void **signal) {
-    int ret = RC_OK;
-    void *sig = NULL;
-    int i;
-
-    if (!pads || !name || !signal) {
-        ret=RC_INVARG;
-        goto out;
-    }
-
-    i = 0;
-    while (pads[i].name) {
-        if (!strcmp(pads[i].name, name)) {
-            sig=(void*)pads[i].signal;
-            break;
-        }
-        i++;
-    }
-
- out:
-    *signal=sig;
-    return ret;
-}
-
 void event_handler(int tap_fd, short event, void *arg) {
     gmii_ethernet_state_t *s = arg;
 
     // Expect a new TAP packet if the socket has become readable
     if (event & EV_READ) {
-        eth_packet_queue_t *rx_pkt =
-            malloc(sizeof(eth_packet_queue_t));
+        struct pkt_s *rx_pkt = pkt_pool_get(&s->rx_pool);
+        uint8_t drop[ETH_LEN];
+
+        if (!rx_pkt) {
+            // All buffers are queued or in use by the simulation: leave the
+            // frames to the host with backpressure, drain the TAP interface
+            // (tail drop) otherwise.
+            if (eth_queue_rx_full(&s->q, s->ev)) {
+                return;
+            }
+            if (s->q.rx_dropped == 1) {
+                fprintf(stderr, "[gmii_ethernet]: RX queue full, dropping packets\n");
+            }
+            tapcfg_read(s->tapcfg, drop, ETH_LEN);
+            return;
+        }
 
         // Read the TAP packet into the buffer, extending its length
         // to the minimum required Ethernet frame length if necessary.
@@ -439,7 +458,7 @@ void event_handler(int tap_fd, short event, void *arg) {
             // An error occured while reading from the TAP interface,
             // report, free the packet and abort.
             fprintf(stderr, "[gmii_ethernet]: TAP read error %d\n", read_len);
-            free(rx_pkt);
+            pkt_pool_put(&s->rx_pool, rx_pkt);
             return;
         } else if (read_len < MIN_ETH_LEN) {
             // To avoid leaking any data, set the packet's contents
@@ -452,45 +471,51 @@ void event_handler(int tap_fd, short event, void *arg) {
             rx_pkt->len = read_len;
         }
 
-        // Packet is inserted into the back of the queue, thus no next
-        // packet.
-        rx_pkt->next = NULL;
+        // Hand the received packet over to the simulation thread. This is
+        // the only producer of the ring, which can hold the whole pool.
+        ring_push(&s->rx_ring, &rx_pkt, 1);
+    }
+}
+
+void tx_handler(int fd, short event, void *arg) {
+    gmii_ethernet_state_t *s = arg;
+    struct pkt_s *tx_pkt;
 
-        // CRITICAL REGION {
-        // Append the received packet to the packet queue
-        if (!s->pending_rx_pkt_head) {
-            s->pending_rx_pkt_head = rx_pkt;
-            s->pending_rx_pkt_tail = rx_pkt;
-        } else {
-            s->pending_rx_pkt_tail->next = rx_pkt;
-            s->pending_rx_pkt_tail = rx_pkt;
-        }
-        // } CRITICAL REGION
+    // Write out all packets transmitted by the simulation since the last call
+    // and give their buffers back to the simulation
+    while (ring_pop(&s->tx_ring, &tx_pkt, 1)) {
+        tapcfg_write(s->tapcfg, tx_pkt->data, tx_pkt->len);
+        pkt_pool_put(&s->tx_pool, tx_pkt);
     }
+
+    // RX buffers were freed by the simulation since TAP reads were paused
+    eth_queue_rx_resume(&s->q, &s->rx_pool, s->ev);
 }
 
 static int gmii_ethernet_add_pads(void *state, struct pad_list_s *plist) {
     int ret = RC_OK;
     gmii_ethernet_state_t *s = (gmii_ethernet_state_t*) state;
-    struct pad_s *pads;
     if (!state || !plist) {
         ret = RC_INVARG;
         goto out;
     }
-    pads = plist->pads;
     if (!strcmp(plist->name, "gmii_eth")) {
-        litex_sim_module_pads_get(pads, "rx_data", (void**) &s->rx_data_signal);
-        litex_sim_module_pads_get(pads, "rx_dv", (void**) &s->rx_dv_signal);
-        litex_sim_module_pads_get(pads, "rx_er", (void**) &s->rx_er_signal);
-        litex_sim_module_pads_get(pads, "tx_data", (void**) &s->tx_data_signal);
-        litex_sim_module_pads_get(pads, "tx_en", (void**) &s->tx_en_signal);
-        litex_sim_module_pads_get(pads, "tx_er", (void**) &s->tx_er_signal);
+        struct pad_bind_s binds[] = {
+            PAD_BIND("rx_data", &s->rx_data_signal),
+            PAD_BIND("rx_dv", &s->rx_dv_signal),
+            PAD_BIND("rx_er", &s->rx_er_signal),
+            PAD_BIND("tx_data", &s->tx_data_signal),
+            PAD_BIND("tx_en", &s->tx_en_signal),
+            PAD_BIND("tx_er", &s->tx_er_signal),
+            PAD_BIND_END
+        };
+        litex_sim_pads_bind(plist, binds);
     }
 
     if (!strcmp(plist->name, "sys_clk")) {
         // TODO: currently the single sys_clk signal is used for both the RX and
         // TX GMII clock signals. This should be changed.
-        litex_sim_module_pads_get(pads, "sys_clk", (void**)&s->rx_clk);
+        litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->rx_clk), PAD_BIND_END });
         s->tx_clk = s->rx_clk;
     }
 
@@ -504,30 +529,117 @@ static int gmii_ethernet_start(void *b) {
   return RC_OK;
 }
 
+/**
+ * Open the optional pcap_in/pcap_out capture files, switching to offline mode
+ *
+ * The pacing argument selects how pcap_in is replayed: "timestamp" (default)
+ * queues packets at their capture time relative to the first one, "fast" as
+ * soon as a buffer is free.
+ */
+static int gmii_ethernet_open_pcap(gmii_ethernet_state_t *s, json_object *args) {
+    const char *pcap_in = litex_sim_args_opt_string(args, "pcap_in", NULL);
+    const char *pcap_out = litex_sim_args_opt_string(args, "pcap_out", NULL);
+    const char *pacing = litex_sim_args_opt_string(args, "pacing", "timestamp");
+
+    if (pcap_in) {
+        if (pcap_open_read(&s->pcap_in.pcap, pcap_in)) {
+            fprintf(stderr, "[gmii_ethernet]: can't read capture %s\n", pcap_in);
+            return RC_ERROR;
+        }
+        s->offline = true;
+    }
+    if (pcap_out) {
+        if (pcap_open_write(&s->pcap_out, pcap_out, ETH_LEN)) {
+            fprintf(stderr, "[gmii_ethernet]: can't write capture %s\n", pcap_out);
+            return RC_ERROR;
+        }
+        s->offline = true;
+    }
+    s->pcap_in.fast = !strcmp(pacing, "fast");
+    return RC_OK;
+}
+
+/**
+ * Attach to a shared memory switch, switching to offline mode
+ *
+ * Backend "shm" connects to the switch named by the switch argument (default
+ * "litex") instead of a TAP interface, see ethsw.h. Backend "tap" (default)
+ * leaves the TAP interface in use.
+ */
+static int gmii_ethernet_open_switch(gmii_ethernet_state_t *s, json_object *args) {
+    const char *backend = litex_sim_args_opt_string(args, "backend", "tap");
+    const char *name = litex_sim_args_opt_string(args, "switch", "litex");
+    int port;
+
+    if (!strcmp(backend, "tap")) {
+        return RC_OK;
+    }
+    if (strcmp(backend, "shm")) {
+        fprintf(stderr, "[gmii_ethernet]: unknown backend %s\n", backend);
+        return RC_ERROR;
+    }
+    port = ethsw_open(&s->sw, name);
+    if (port < 0) {
+        fprintf(stderr, "[gmii_ethernet]: can't attach to switch %s\n", name);
+        return RC_ERROR;
+    }
+    printf("[gmii_ethernet] switch %s, port %d\n", name, port);
+    s->offline = true;
+    return RC_OK;
+}
+
 static int gmii_ethernet_new(void **state, char *args) {
     int ret = RC_OK;
     char *c_tap = NULL;
     char *c_tap_ip = NULL;
+    json_object *jargs = NULL;
     gmii_ethernet_state_t *s = NULL;
     struct timeval tv = {10, 0};
+    struct timeval tx_tv = {0, 1000};
 
     if (!state) {
         ret = RC_INVARG;
         goto out;
     }
 
+    jargs = litex_sim_args_parse("gmii_ethernet", args);
+    if (!jargs) {
+        ret = RC_JSERROR;
+        goto out;
+    }
+
     s = (gmii_ethernet_state_t*)malloc(sizeof(gmii_ethernet_state_t));
     if (!s) {
         ret = RC_NOENMEM;
         goto out;
     }
     memset(s, 0, sizeof(gmii_ethernet_state_t));
+    eth_queue_args(&s->q, jargs);
+    if (pkt_pool_init(&s->rx_pool, s->q.depth, ETH_LEN + sizeof(uint32_t))
+        || pkt_pool_init(&s->tx_pool, s->q.depth, ETH_LEN)
+        || ring_init(&s->rx_ring, s->q.depth, sizeof(struct pkt_s *))
+        || ring_init(&s->tx_ring, s->q.depth, sizeof(struct pkt_s *))) {
+        ret = RC_NOENMEM;
+        goto out;
+    }
+
+    ret = gmii_ethernet_open_pcap(s, jargs);
+    if (ret == RC_OK) {
+        ret = gmii_ethernet_open_switch(s, jargs);
+    }
+    s->stim = eth_queue_stim_open("gmii_ethernet", nsessions++);
+    if (eth_queue_stim_replaying(s->stim)) {
+        s->offline = true;
+    }
+    if (ret != RC_OK || s->offline) {
+        goto out;
+    }
 
-    ret = litex_sim_module_get_args(args, "interface", &c_tap);
+    ret = litex_sim_args_get_string(jargs, "interface", &c_tap);
     if (ret != RC_OK) {
         goto out;
     }
-    ret = litex_sim_module_get_args(args, "ip", &c_tap_ip);
+    ret = litex_sim_args_get_string(jargs, "ip", &c_tap_ip);
     if (ret != RC_OK) {
         goto out;
     }
@@ -543,19 +655,55 @@ static int gmii_ethernet_new(void **state, char *args) {
 
     s->ev = event_new(base, s->tap_fd, EV_READ | EV_PERSIST, event_handler, s);
     event_add(s->ev, &tv);
+    s->tx_ev = event_new(base, -1, EV_PERSIST, tx_handler, s);
+    event_add(s->tx_ev, &tx_tv);
 
 out:
+    litex_sim_args_free(jargs);
     *state = (void*) s;
     return ret;
 }
 
+static int gmii_ethernet_close(void *state) {
+    gmii_ethernet_state_t *s = (gmii_ethernet_state_t*) state;
+
+    eth_queue_print("gmii_ethernet", &s->q);
+    pcap_close(&s->pcap_in.pcap);
+    pcap_close(&s->pcap_out);
+    ethsw_close(&s->sw);
+    return RC_OK;
+}
+
+static int gmii_ethernet_io_pending(void *state) {
+    gmii_ethernet_state_t *s = (gmii_ethernet_state_t*) state;
+
+    // Frames sent by the other switch ports are waiting
+    if (s->sw.shm && ethsw_pending(&s->sw)) {
+        return 1;
+    }
+
+    // Nothing comes from the host while replaying captures
+    if (s->offline && !s->sw.shm) {
+        return 0;
+    }
+
+    // Received packets are still queued or being fed into the simulation
+    return ring_count(&s->rx_ring) != 0 || s->current_rx_len != 0;
+}
+
 static struct ext_module_s ext_mod = {
     "gmii_ethernet",
     gmii_ethernet_start,
     gmii_ethernet_new,
     gmii_ethernet_add_pads,
+    gmii_ethernet_close,
+    gmii_ethernet_tick,
+    NULL,
+    NULL,
+    gmii_ethernet_io_pending,
+    NULL,
     NULL,
-    gmii_ethernet_tick
+    EXT_MODULE_THREAD_SAFE
 };
 
 int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *)) {
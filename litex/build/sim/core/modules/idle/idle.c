@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <json-c/json.h>
+#include "error.h"
+#include "modules.h"
+#include "args.h"
+
+/*
+ * Idle skipping (see SimIdle in litex/build/sim/platform.py): while the idle
+ * pad is set, the core may jump over up to budget sys_clk cycles without
+ * evaluating the model. The number of cycles skipped is then driven on the
+ * skip pad for the next evaluated rising edge, so that the gateware can
+ * advance its timers by it.
+ *
+ * Optional args: "max_cycles", upper bound of a single jump (bounds the
+ * latency of host inputs not seen by io_pending(), default 1000000).
+ */
+
+struct session_s {
+  char *idle;
+  uint32_t *budget;
+  uint32_t *skip;
+  char *sys_clk;
+  uint64_t max_cycles;
+  uint64_t jumps;
+  uint64_t skipped;
+};
+
+static int idle_start(void *b)
+{
+  printf("[idle] loaded\n");
+  return RC_OK;
+}
+
+static int idle_new(void **sess, char *args)
+{
+  int ret = RC_OK;
+  json_object *jargs = NULL;
+  struct session_s *s = NULL;
+
+  if(!sess) {
+    ret = RC_INVARG;
+    goto out;
+  }
+
+  jargs = litex_sim_args_parse("idle", args);
+  if(!jargs) {
+    ret = RC_JSERROR;
+    goto out;
+  }
+
+  s = (struct session_s*)malloc(sizeof(struct session_s));
+  if(!s) {
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  memset(s, 0, sizeof(struct session_s));
+  s->max_cycles = litex_sim_args_opt_int(jargs, "max_cycles", 1000000);
+out:
+  litex_sim_args_free(jargs);
+  *sess = (void*)s;
+  return ret;
+}
+
+static int idle_add_pads(void *sess, struct pad_list_s *plist)
+{
+  int ret = RC_OK;
+  struct session_s *s = (struct session_s*)sess;
+
+  if(!sess || !plist) {
+    ret = RC_INVARG;
+    goto out;
+  }
+  if(!strcmp(plist->name, "sim_idle")) {
+    struct pad_bind_s binds[] = {
+      PAD_BIND("idle", &s->idle),
+      PAD_BIND("budget", &s->budget),
+      PAD_BIND("skip", &s->skip),
+      PAD_BIND_END
+    };
+    ret = litex_sim_pads_bind(plist, binds);
+    if(RC_OK != ret) {
+      eprintf("Missing idle signals\n");
+      goto out;
+    }
+  }
+
+  if(!strcmp(plist->name, "sys_clk"))
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
+
+out:
+  return ret;
+}
+
+static int idle_tick(void *sess, uint64_t time_ps)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  /* The skipped cycles were seen on this edge */
+  *s->skip = 0;
+  return RC_OK;
+}
+
+static int idle_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static int idle_idle(void *sess, uint64_t *cycles)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *cycles = 0;
+  if(*s->idle && !*s->skip)
+    *cycles = *s->budget < s->max_cycles ? *s->budget : s->max_cycles;
+  return RC_OK;
+}
+
+static int idle_skipped(void *sess, uint64_t cycles)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *s->skip = cycles;
+  s->jumps++;
+  s->skipped += cycles;
+  return RC_OK;
+}
+
+static int idle_close(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  printf("[idle] skipped %lu cycles in %lu jumps\n",
+    (unsigned long)s->skipped, (unsigned long)s->jumps);
+  return RC_OK;
+}
+
+static struct ext_module_s ext_mod = {
+  "idle",
+  idle_start,
+  idle_new,
+  idle_add_pads,
+  idle_close,
+  idle_tick,
+  idle_clock_domain,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  EXT_MODULE_THREAD_SAFE,
+  NULL,
+  idle_idle,
+  idle_skipped
+};
+
+int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
+{
+  int ret = RC_OK;
+  ret = register_module(&ext_mod);
+  return ret;
+}
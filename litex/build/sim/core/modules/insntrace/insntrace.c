@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <json-c/json.h>
+#include "error.h"
+#include "modules.h"
+#include "args.h"
+
+/*
+ * Instruction trace: samples the insn_valid/insn_pc (and optional
+ * mem_valid/mem_addr) pads on every sys_clk cycle and writes one record per
+ * cycle where one of them is valid, delta encoded against the previous
+ * record (see litex_sim_insntrace for the decoder):
+ *
+ *   tag: bit 7     mem_addr follows (zigzag varint, delta to the last one)
+ *        bits 6-5  0: pc+4, 1: pc+2, 2: pc follows (zigzag varint, delta
+ *                  to the last pc+4), 3: no instruction (mem_addr only)
+ *        bits 4-0  cycles since the last record, 0: varint follows
+ *
+ * Sequential instructions on consecutive cycles take a single byte. The
+ * file starts with "LXIT" and a 32-bit version.
+ */
+
+#define INSNTRACE_MAGIC "LXIT"
+#define INSNTRACE_VERSION 1
+#define INSNTRACE_BUF_SIZE (1 << 20)
+
+#define TAG_MEM (1 << 7)
+#define TAG_PC_SEQ4 (0 << 5)
+#define TAG_PC_SEQ2 (1 << 5)
+#define TAG_PC_DELTA (2 << 5)
+#define TAG_PC_NONE (3 << 5)
+#define TAG_CYCLES_MAX 31
+
+struct session_s {
+  char *insn_valid;
+  uint32_t *insn_pc;
+  char *mem_valid;
+  uint32_t *mem_addr;
+  char *sys_clk;
+  FILE *f;
+  char *buf;
+  uint64_t cycle;
+  uint64_t last_cycle;
+  uint32_t last_pc;
+  uint32_t last_addr;
+  uint64_t records;
+};
+
+static int insntrace_start(void *b)
+{
+  printf("[insntrace] loaded\n");
+  return RC_OK;
+}
+
+static int insntrace_new(void **sess, char *args)
+{
+  int ret = RC_OK;
+  const char *filename;
+  json_object *jargs = NULL;
+  struct session_s *s = NULL;
+  uint32_t version = INSNTRACE_VERSION;
+
+  if(!sess) {
+    ret = RC_INVARG;
+    goto out;
+  }
+
+  jargs = litex_sim_args_parse("insntrace", args);
+  if(!jargs) {
+    ret = RC_JSERROR;
+    goto out;
+  }
+
+  s = (struct session_s*)malloc(sizeof(struct session_s));
+  if(!s) {
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  memset(s, 0, sizeof(struct session_s));
+
+  filename = litex_sim_args_opt_string(jargs, "file", "insn.trace");
+  s->f = fopen(filename, "wb");
+  s->buf = (char *)malloc(INSNTRACE_BUF_SIZE);
+  if(!s->f || !s->buf) {
+    eprintf("Can't open %s\n", filename);
+    ret = RC_ERROR;
+    goto out;
+  }
+  setvbuf(s->f, s->buf, _IOFBF, INSNTRACE_BUF_SIZE);
+  fwrite(INSNTRACE_MAGIC, 4, 1, s->f);
+  fwrite(&version, sizeof(version), 1, s->f);
+  printf("[insntrace] writing %s\n", filename);
+out:
+  litex_sim_args_free(jargs);
+  *sess = (void*)s;
+  return ret;
+}
+
+static int insntrace_add_pads(void *sess, struct pad_list_s *plist)
+{
+  int ret = RC_OK;
+  struct session_s *s = (struct session_s*)sess;
+
+  if(!sess || !plist) {
+    ret = RC_INVARG;
+    goto out;
+  }
+  if(!strcmp(plist->name, "insntrace")) {
+    struct pad_bind_s binds[] = {
+      PAD_BIND("insn_valid", &s->insn_valid),
+      PAD_BIND("insn_pc", &s->insn_pc),
+      PAD_BIND_END
+    };
+    ret = litex_sim_pads_bind(plist, binds);
+    if(RC_OK != ret) {
+      eprintf("Missing instruction trace signals\n");
+      goto out;
+    }
+    // Memory accesses are optional
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) {
+      PAD_BIND("mem_valid", &s->mem_valid),
+      PAD_BIND("mem_addr", &s->mem_addr),
+      PAD_BIND_END
+    });
+    if(!s->mem_valid || !s->mem_addr)
+      s->mem_valid = NULL;
+  }
+
+  if(!strcmp(plist->name, "sys_clk"))
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
+
+out:
+  return ret;
+}
+
+static inline void insntrace_varint(FILE *f, uint64_t v)
+{
+  while(v >= 0x80) {
+    putc_unlocked((v & 0x7f) | 0x80, f);
+    v >>= 7;
+  }
+  putc_unlocked(v, f);
+}
+
+static inline uint64_t insntrace_zigzag(int32_t v)
+{
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int insntrace_tick(void *sess, uint64_t time_ps)
+{
+  struct session_s *s = (struct session_s*)sess;
+  int insn = *s->insn_valid;
+  int mem = s->mem_valid && *s->mem_valid;
+  uint64_t cycles;
+  uint8_t tag;
+
+  s->cycle++;
+  if(!insn && !mem)
+    return RC_OK;
+
+  cycles = s->cycle - s->last_cycle;
+  tag = cycles <= TAG_CYCLES_MAX ? cycles : 0;
+  if(mem)
+    tag |= TAG_MEM;
+  if(!insn)
+    tag |= TAG_PC_NONE;
+  else if(*s->insn_pc == s->last_pc + 4)
+    tag |= TAG_PC_SEQ4;
+  else if(*s->insn_pc == s->last_pc + 2)
+    tag |= TAG_PC_SEQ2;
+  else
+    tag |= TAG_PC_DELTA;
+
+  putc_unlocked(tag, s->f);
+  if(cycles > TAG_CYCLES_MAX)
+    insntrace_varint(s->f, cycles);
+  if((tag & TAG_PC_NONE) == TAG_PC_DELTA)
+    insntrace_varint(s->f, insntrace_zigzag(*s->insn_pc - (s->last_pc + 4)));
+  if(mem) {
+    insntrace_varint(s->f, insntrace_zigzag(*s->mem_addr - s->last_addr));
+    s->last_addr = *s->mem_addr;
+  }
+  if(insn)
+    s->last_pc = *s->insn_pc;
+  s->last_cycle = s->cycle;
+  s->records++;
+  return RC_OK;
+}
+
+static int insntrace_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static int insntrace_close(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+  long size;
+
+  if(!s->f)
+    return RC_OK;
+  size = ftell(s->f);
+  fclose(s->f);
+  s->f = NULL;
+  free(s->buf);
+  printf("[insntrace] %lu records over %lu cycles, %ld bytes\n",
+    (unsigned long)s->records, (unsigned long)s->cycle, size);
+  return RC_OK;
+}
+
+static struct ext_module_s ext_mod = {
+  "insntrace",
+  insntrace_start,
+  insntrace_new,
+  insntrace_add_pads,
+  insntrace_close,
+  insntrace_tick,
+  insntrace_clock_domain,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  EXT_MODULE_THREAD_SAFE
+};
+
+int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
+{
+  int ret = RC_OK;
+  ret = register_module(&ext_mod);
+  return ret;
+}
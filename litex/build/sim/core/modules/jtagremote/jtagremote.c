@@ -9,6 +9,13 @@
 
 #include <json-c/json.h>
 #include "modules.h"
+#include "args.h"
+#include "ring.h"
+#include "stim.h"
+
+#define RING_SIZE 65536
+// sys_clk ticks between two JTAG pin updates, override with the tck_div argument
+#define TCK_DIV 10
 
 struct session_s {
 	char *tdi;
@@ -17,73 +24,21 @@ struct session_s {
 	char *tms;
 	char *sys_clk;
 	struct event *ev;
-	char databuf[2048];
-	int data_start;
-	int datalen;
+	struct event *tx_ev;
+	// socket (I/O thread) -> sim
+	ring_t rx_ring;
+	// sim -> socket (I/O thread)
+	ring_t tx_ring;
 	int cntticks;
+	int tck_div;
 	int fd;
+	// Commands logged per tick that ran them, replayed with no socket (the
+	// TDO replies are dropped), see stim.h
+	struct stim_stream_s *stim;
 };
 
 struct event_base *base;
 
-int litex_sim_module_get_args( char *args, char *arg, char **val)
-{
-  int ret = RC_OK;
-  json_object *jsobj = NULL;
-  json_object *obj = NULL;
-  char *value = NULL;
-  int r;
-
-  jsobj = json_tokener_parse(args);
-  if(NULL==jsobj) {
-    fprintf(stderr, "Error parsing json arg: %s \n", args);
-    ret=RC_JSERROR;
-    goto out;
-  }
-  if(!json_object_is_type(jsobj, json_type_object)) {
-    fprintf(stderr, "Arg must be type object! : %s \n", args);
-    ret=RC_JSERROR;
-    goto out;
-  }
-  obj=NULL;
-  r = json_object_object_get_ex(jsobj, arg, &obj);
-  if(!r) {
-    fprintf(stderr, "Could not find object: \"%s\" (%s)\n", arg, args);
-    ret=RC_JSERROR;
-    goto out;
-  }
-  value=strdup(json_object_get_string(obj));
-
-out:
-  *val = value;
-  return ret;
-}
-
-static int litex_sim_module_pads_get( struct pad_s *pads, char *name, void **signal)
-{
-  int ret;
-  void *sig = NULL;
-  int i;
-
-  if(!pads || !name || !signal) {
-    ret = RC_INVARG;
-    goto out;
-  }
-
-  i = 0;
-  while(pads[i].name) {
-    if(!strcmp(pads[i].name, name)) {
-      sig = (void*)pads[i].signal;
-      break;
-    }
-    i++;
-  }
-
-out:
-  *signal = sig;
-  return ret;
-}
-
 static int jtagremote_start(void *b)
 {
   base = (struct event_base *)b;
@@ -94,16 +49,32 @@ static int jtagremote_start(void *b)
 void read_handler(int fd, short event, void *arg)
 {
   struct session_s *s = (struct session_s*)arg;
-  char buffer[1024];
+  char buffer[4096];
+  size_t len = ring_space(&s->rx_ring);
   ssize_t read_len;
 
-  int i;
+  // Leave what doesn't fit in the socket, the event fires again
+  if(len > sizeof(buffer))
+    len = sizeof(buffer);
+  if(!len)
+    return;
+  read_len = read(fd, buffer, len);
+  if(read_len > 0)
+    ring_push(&s->rx_ring, buffer, read_len);
+}
 
-  read_len = read(fd, buffer, 1024);
-  for(i = 0; i < read_len; i++)
-  {
-    s->databuf[(s->data_start +  s->datalen ) % 2048] = buffer[i];
-    s->datalen++;
+static void tx_handler(int fd, short event, void *arg)
+{
+  struct session_s *s = (struct session_s*)arg;
+  char buffer[4096];
+  size_t len;
+
+  // All the TDO replies queued since the last call go out in bulk
+  while((len = ring_pop(&s->tx_ring, buffer, sizeof(buffer)))) {
+    if(s->fd && -1 == write(s->fd, buffer, len)) {
+      eprintf("Error writing on socket\n");
+      break;
+    }
   }
 }
 
@@ -137,16 +108,24 @@ static int jtagremote_new(void **sess, char *args)
   int ret = RC_OK;
   struct session_s *s = NULL;
   char *cport = NULL;
-  int port;
+  json_object *jargs = NULL;
+  int port = 0;
   struct evconnlistener *listener;
   struct sockaddr_in sin;
+  struct timeval tx_tv = {0, 1000};
+  char name[32];
 
   if(!sess) {
     ret = RC_INVARG;
     goto out;
   }
 
-  ret = litex_sim_module_get_args(args, "port", &cport);
+  jargs = litex_sim_args_parse("jtagremote", args);
+  if(!jargs) {
+    ret = RC_JSERROR;
+    goto out;
+  }
+  ret = litex_sim_args_get_string(jargs, "port", &cport);
   if(RC_OK != ret)
     goto out;
 
@@ -165,6 +144,19 @@ static int jtagremote_new(void **sess, char *args)
     goto out;
   }
   memset(s, 0, sizeof(struct session_s));
+  s->tck_div = litex_sim_args_opt_int(jargs, "tck_div", TCK_DIV);
+  if(s->tck_div <= 0)
+    s->tck_div = 1;
+  if(ring_init(&s->rx_ring, RING_SIZE, 1) || ring_init(&s->tx_ring, RING_SIZE, 1)) {
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  snprintf(name, sizeof(name), "jtagremote:%d", port);
+  s->stim = litex_sim_stim_open(name);
+  if(litex_sim_stim_mode() == STIM_REPLAY)
+    goto out;
+  s->tx_ev = event_new(base, -1, EV_PERSIST, tx_handler, s);
+  event_add(s->tx_ev, &tx_tv);
 
   memset(&sin, 0, sizeof(sin));
   sin.sin_family = AF_INET;
@@ -179,6 +171,7 @@ static int jtagremote_new(void **sess, char *args)
   evconnlistener_set_error_cb(listener, accept_error_cb);
 
 out:
+  litex_sim_args_free(jargs);
   *sess=(void*)s;
   return ret;
 }
@@ -187,74 +180,117 @@ static int jtagremote_add_pads(void *sess, struct pad_list_s *plist)
 {
   int ret=RC_OK;
   struct session_s *s=(struct session_s*)sess;
-  struct pad_s *pads;
   if(!sess || !plist) {
     ret = RC_INVARG;
     goto out;
   }
-  pads = plist->pads;
   printf("plist name: %s\n", plist->name);
   if(!strcmp(plist->name, "jtag")) {
-    litex_sim_module_pads_get(pads, "tck", (void**)&s->tck);
-    litex_sim_module_pads_get(pads, "tdi", (void**)&s->tdi);
-    litex_sim_module_pads_get(pads, "tdo", (void**)&s->tdo);
-    litex_sim_module_pads_get(pads, "tms", (void**)&s->tms);
+    struct pad_bind_s binds[] = {
+      PAD_BIND("tck", &s->tck),
+      PAD_BIND("tdi", &s->tdi),
+      PAD_BIND("tdo", &s->tdo),
+      PAD_BIND("tms", &s->tms),
+      PAD_BIND_END
+    };
+    litex_sim_pads_bind(plist, binds);
   }
 
   if(!strcmp(plist->name, "sys_clk"))
-    litex_sim_module_pads_get(pads, "sys_clk", (void**)&s->sys_clk);
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
 
 out:
   return ret;
 
 }
+/*
+ * Runs the queued remote_bitbang commands in bulk: every command that leaves
+ * the pins unchanged ('R' reads, blink, reset...) is handled in the same tick,
+ * up to and including the next pin update, which needs a new evaluation. The
+ * TDO replies are collected and pushed to the socket ring at once.
+ */
 static int jtagremote_tick(void *sess, uint64_t time_ps)
 {
-  static clk_edge_state_t edge;
-	char c, val;
+	char buffer[256];
+	char replies[256];
+	size_t i, n, nreplies = 0;
+	char c, tck, tms, tdi;
 	int ret = RC_OK;
 
   struct session_s *s = (struct session_s*)sess;
-  if(!clk_pos_edge(&edge, *s->sys_clk)) {
-    return RC_OK;
-  }
 
   s->cntticks++;
-  if(s->cntticks % 10)
+  if(s->cntticks % s->tck_div)
 	  return RC_OK;
 
-  if(s->datalen)
+  if(s->stim && litex_sim_stim_mode() == STIM_REPLAY) {
+	  // Events are at most sizeof(buffer) bytes, left in the log while they may not fit
+	  while(ring_space(&s->rx_ring) >= sizeof(buffer)
+		&& (n = litex_sim_stim_replay(s->stim, time_ps, buffer, sizeof(buffer))))
+		  ring_push(&s->rx_ring, buffer, n);
+  }
+
+  n = ring_copy(&s->rx_ring, buffer, sizeof(buffer));
+  if(n > ring_space(&s->tx_ring))
+	  n = ring_space(&s->tx_ring);
+
+  for(i = 0; i < n; i++)
   {
-	  c = s->databuf[s->data_start];
+	  c = buffer[i];
 
-	  if((c >= '0') && (c <= '7')){
-		  *s->tck = ((c - '0') >> 2) & 1;
-		  *s->tms = ((c - '0') >> 1) & 1;
-		  *s->tdi = (c - '0')  & 1;
+	  if(c == 'R') {
+		  replies[nreplies++] = *s->tdo + '0';
+		  continue;
 	  }
-	  if(c == 'R'){
-		  val = *s->tdo + '0';
-		  if(-1 == write(s->fd, &val, 1)) {
-			  eprintf("Error writing on socket\n");
-			  ret = RC_ERROR;
-			  goto out;
+	  if((c >= '0') && (c <= '7')){
+		  tck = ((c - '0') >> 2) & 1;
+		  tms = ((c - '0') >> 1) & 1;
+		  tdi = (c - '0')  & 1;
+		  if(tck != *s->tck || tms != *s->tms || tdi != *s->tdi) {
+			  *s->tck = tck;
+			  *s->tms = tms;
+			  *s->tdi = tdi;
+			  i++;
+			  break;
 		  }
 	  }
-	  s->data_start = (s->data_start + 1) % 2048;
-	  s->datalen--;
   }
 
-out:
+  ring_drop(&s->rx_ring, i);
+  if(i && litex_sim_stim_mode() == STIM_RECORD)
+	  litex_sim_stim_record(s->stim, time_ps, buffer, i);
+  if(nreplies && litex_sim_stim_mode() != STIM_REPLAY)
+	  ring_push(&s->tx_ring, replies, nreplies);
+
   return ret;
 }
 
+static int jtagremote_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static int jtagremote_io_pending(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  return ring_count(&s->rx_ring) != 0;
+}
+
 static struct ext_module_s ext_mod = {
   "jtagremote",
   jtagremote_start,
   jtagremote_new,
   jtagremote_add_pads,
   NULL,
-  jtagremote_tick
+  jtagremote_tick,
+  jtagremote_clock_domain,
+  NULL,
+  jtagremote_io_pending
 };
 
 int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
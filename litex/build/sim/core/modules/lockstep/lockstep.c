@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <json-c/json.h>
+#include "error.h"
+#include "modules.h"
+
+/*
+ * Deterministic point-to-point stream link between two simulation processes.
+ *
+ * Both processes map the same shared memory segment holding one ring of
+ * timestamped bytes per direction and the time each node has completed.
+ * A byte sent at time t is delivered to the peer at t + quantum_ps, and a
+ * node only simulates time T once its peer has completed T - quantum_ps, so
+ * every byte due at T is already in the ring: the exchange does not depend
+ * on the relative speed of the processes. quantum_ps must be at least one
+ * sys_clk period, larger values let the nodes drift further apart and wait
+ * less often.
+ */
+
+#define LINK_MAGIC 0x4c58534d4c4e4b31ULL
+#define LINK_RING_SIZE 4096
+#define LINK_SPINS 1000
+
+struct link_msg_s {
+  uint64_t time_ps;
+  uint8_t data;
+};
+
+struct link_ring_s {
+  _Atomic uint64_t wr;
+  _Atomic uint64_t rd;
+  struct link_msg_s msgs[LINK_RING_SIZE];
+};
+
+struct link_shm_s {
+  _Atomic uint64_t magic;
+  _Atomic uint64_t done_ps[2];
+  /* ring[n] is written by node n */
+  struct link_ring_s ring[2];
+};
+
+struct session_s {
+  char *tx;
+  char *tx_valid;
+  char *tx_ready;
+  char *rx;
+  char *rx_valid;
+  char *rx_ready;
+  char *sys_clk;
+  char *shm_name;
+  int node;
+  uint64_t quantum_ps;
+  struct link_shm_s *shm;
+};
+
+static int lockstep_parse_args(struct session_s *s, const char *args)
+{
+  int ret = RC_OK;
+  json_object *args_json = NULL;
+  json_object *obj = NULL;
+
+  args_json = json_tokener_parse(args);
+  if (!args_json) {
+    ret = RC_JSERROR;
+    fprintf(stderr, "[lockstep] Could not parse args: %s\n", args);
+    goto out;
+  }
+
+  if(!json_object_object_get_ex(args_json, "shm", &obj)) {
+    ret = RC_JSERROR;
+    fprintf(stderr, "[lockstep] \"shm\" not found in args: %s\n", json_object_to_json_string(args_json));
+    goto out;
+  }
+  s->shm_name = strdup(json_object_get_string(obj));
+
+  if(!json_object_object_get_ex(args_json, "node", &obj)) {
+    ret = RC_JSERROR;
+    fprintf(stderr, "[lockstep] \"node\" not found in args: %s\n", json_object_to_json_string(args_json));
+    goto out;
+  }
+  s->node = json_object_get_int(obj);
+  if(s->node != 0 && s->node != 1) {
+    ret = RC_JSERROR;
+    fprintf(stderr, "[lockstep] \"node\" must be 0 or 1\n");
+    goto out;
+  }
+
+  if(!json_object_object_get_ex(args_json, "quantum_ps", &obj)) {
+    ret = RC_JSERROR;
+    fprintf(stderr, "[lockstep] \"quantum_ps\" not found in args: %s\n", json_object_to_json_string(args_json));
+    goto out;
+  }
+  s->quantum_ps = json_object_get_int64(obj);
+  if(!s->quantum_ps) {
+    ret = RC_JSERROR;
+    fprintf(stderr, "[lockstep] \"quantum_ps\" must be different than 0\n");
+    goto out;
+  }
+out:
+  if(args_json) json_object_put(args_json);
+  return ret;
+}
+
+static int lockstep_map(struct session_s *s)
+{
+  int fd;
+
+  /* Node 0 creates a fresh segment, node 1 waits for it to be initialized */
+  if(s->node == 0) {
+    shm_unlink(s->shm_name);
+    fd = shm_open(s->shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  } else {
+    printf("[lockstep] waiting for node 0 on %s\n", s->shm_name);
+    while((fd = shm_open(s->shm_name, O_RDWR, 0600)) < 0)
+      usleep(10000);
+  }
+  if(fd < 0) {
+    eprintf("Can't open shared memory %s\n", s->shm_name);
+    return RC_ERROR;
+  }
+  if(s->node == 0 && ftruncate(fd, sizeof(struct link_shm_s))) {
+    eprintf("Can't size shared memory %s\n", s->shm_name);
+    close(fd);
+    return RC_ERROR;
+  }
+  if(s->node == 1) {
+    struct stat st;
+    do {
+      fstat(fd, &st);
+    } while(st.st_size < sizeof(struct link_shm_s) && !usleep(10000));
+  }
+
+  s->shm = (struct link_shm_s *)mmap(NULL, sizeof(struct link_shm_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(MAP_FAILED == s->shm) {
+    s->shm = NULL;
+    eprintf("Can't map shared memory %s\n", s->shm_name);
+    return RC_ERROR;
+  }
+
+  if(s->node == 0)
+    atomic_store(&s->shm->magic, LINK_MAGIC);
+  else
+    while(atomic_load(&s->shm->magic) != LINK_MAGIC)
+      usleep(10000);
+  return RC_OK;
+}
+
+static int lockstep_start(void *b)
+{
+  printf("[lockstep] loaded\n");
+  return RC_OK;
+}
+
+static int lockstep_new(void **sess, char *args)
+{
+  int ret = RC_OK;
+  struct session_s *s = NULL;
+
+  if(!sess) {
+    ret = RC_INVARG;
+    goto out;
+  }
+
+  s=(struct session_s*)malloc(sizeof(struct session_s));
+  if(!s) {
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  memset(s, 0, sizeof(struct session_s));
+
+  ret = lockstep_parse_args(s, args);
+  if(RC_OK != ret)
+    goto out;
+  ret = lockstep_map(s);
+  if(RC_OK != ret)
+    goto out;
+  printf("[lockstep] %s: node %d, quantum %lu ps\n", s->shm_name, s->node, (unsigned long)s->quantum_ps);
+out:
+  *sess=(void*)s;
+  return ret;
+}
+
+static int lockstep_add_pads(void *sess, struct pad_list_s *plist)
+{
+  int ret = RC_OK;
+  struct session_s *s=(struct session_s*)sess;
+  if(!sess || !plist) {
+    ret = RC_INVARG;
+    goto out;
+  }
+  if(!strcmp(plist->name, "serial")) {
+    struct pad_bind_s binds[] = {
+      PAD_BIND("sink_data", &s->rx),
+      PAD_BIND("sink_valid", &s->rx_valid),
+      PAD_BIND("sink_ready", &s->rx_ready),
+      PAD_BIND("source_data", &s->tx),
+      PAD_BIND("source_valid", &s->tx_valid),
+      PAD_BIND("source_ready", &s->tx_ready),
+      PAD_BIND_END
+    };
+    litex_sim_pads_bind(plist, binds);
+  }
+
+  if(!strcmp(plist->name, "sys_clk"))
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
+
+out:
+  return ret;
+}
+
+static int lockstep_tick(void *sess, uint64_t time_ps)
+{
+  struct session_s *s = (struct session_s*)sess;
+  struct link_ring_s *out = &s->shm->ring[s->node];
+  struct link_ring_s *in = &s->shm->ring[!s->node];
+  struct link_msg_s *msg;
+  uint64_t wr, rd;
+  int spins = 0;
+
+  /* Wait for the peer to have sent everything due up to now */
+  while(time_ps > s->quantum_ps &&
+        atomic_load_explicit(&s->shm->done_ps[!s->node], memory_order_acquire) < time_ps - s->quantum_ps) {
+    if(spins < LINK_SPINS)
+      spins++;
+    else
+      sched_yield();
+  }
+
+  wr = atomic_load_explicit(&out->wr, memory_order_relaxed);
+  rd = atomic_load_explicit(&out->rd, memory_order_acquire);
+  *s->tx_ready = wr - rd < LINK_RING_SIZE;
+  if(*s->tx_valid && *s->tx_ready) {
+    msg = &out->msgs[wr % LINK_RING_SIZE];
+    msg->time_ps = time_ps + s->quantum_ps;
+    msg->data = *s->tx;
+    atomic_store_explicit(&out->wr, wr + 1, memory_order_release);
+  }
+
+  *s->rx_valid = 0;
+  rd = atomic_load_explicit(&in->rd, memory_order_relaxed);
+  wr = atomic_load_explicit(&in->wr, memory_order_acquire);
+  if(wr != rd) {
+    msg = &in->msgs[rd % LINK_RING_SIZE];
+    if(msg->time_ps <= time_ps) {
+      *s->rx = msg->data;
+      *s->rx_valid = 1;
+      if(*s->rx_ready)
+        atomic_store_explicit(&in->rd, rd + 1, memory_order_release);
+    }
+  }
+
+  atomic_store_explicit(&s->shm->done_ps[s->node], time_ps, memory_order_release);
+  return RC_OK;
+}
+
+static int lockstep_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static int lockstep_close(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  if(!s->shm)
+    return RC_OK;
+  /* Never hold the peer back once this node has stopped */
+  atomic_store(&s->shm->done_ps[s->node], UINT64_MAX);
+  munmap(s->shm, sizeof(struct link_shm_s));
+  s->shm = NULL;
+  if(s->node == 0)
+    shm_unlink(s->shm_name);
+  return RC_OK;
+}
+
+static struct ext_module_s ext_mod = {
+  "lockstep",
+  lockstep_start,
+  lockstep_new,
+  lockstep_add_pads,
+  lockstep_close,
+  lockstep_tick,
+  lockstep_clock_domain,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  EXT_MODULE_THREAD_SAFE
+};
+
+int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
+{
+  int ret = RC_OK;
+  ret = register_module(&ext_mod);
+  return ret;
+}
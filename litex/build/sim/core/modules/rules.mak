@@ -3,19 +3,24 @@ UNAME_S := $(shell uname -s)
 
 ifeq ($(UNAME_S),Darwin)
     CFLAGS += -I/usr/local/include/
-    LDFLAGS += -L/usr/local/lib -ljson-c
+    LDFLAGS += -L/usr/local/lib -ljson-c -undefined dynamic_lookup
     CFLAGS += -Wall -O3 -ggdb -fPIC
 else
     CFLAGS += -Wall -O3 -ggdb -fPIC -Werror
 endif
 LDFLAGS += -levent -shared -fPIC
 
+include $(SRC_DIR)/pgo.mak
+CFLAGS += $(PGO_CFLAGS)
+LDFLAGS += $(PGO_LDFLAGS)
+
 MOD_SRC_DIR=$(SRC_DIR)/modules/$(MOD)
+OBJS ?= $(MOD).o
 
 all: $(MOD).so
 
 %.o: $(MOD_SRC_DIR)/%.c
-	$(CC) -c $(CFLAGS) -I$(MOD_SRC_DIR)/../.. -o $@ $<
+	$(CCACHE) $(CC) -c $(CFLAGS) -I$(MOD_SRC_DIR)/../.. -o $@ $<
 
 %.so: %.o
 ifeq ($(UNAME_S),Darwin)
@@ -24,6 +29,15 @@ else
 	$(CC) $(LDFLAGS) -Wl,-soname,$@ -o $@ $<
 endif
 
+# Static build (STATIC_MODULES): a single relocatable object, optimized as a
+# whole with LTO, in which only the renamed init function is left global so
+# that modules don't clash with each other or with the core.
+.SECONDEXPANSION:
+$(MOD)_static.o: CFLAGS += -flto -fPIE -Dlitex_sim_ext_module_init=litex_sim_ext_module_init_$(MOD)
+$(MOD)_static.o: $$(OBJS)
+	$(CC) $(CFLAGS) -r -nostdlib -flinker-output=nolto-rel -o $@ $^
+	objcopy --keep-global-symbol=litex_sim_ext_module_init_$(MOD) $@
+
 .PHONY: clean
 clean:
 	rm -f *.o *.so
@@ -8,7 +8,17 @@
 #include <event2/event.h>
 #include <termios.h>
 
+#include <json-c/json.h>
 #include "modules.h"
+#include "args.h"
+#include "ring.h"
+#include "dpi.h"
+
+// Default ring sizes, override with the rx_ring_size/tx_ring_size arguments
+// (powers of two)
+#define RING_SIZE 65536
+// Transmitted characters are batched before being pushed to the TX ring
+#define TX_BATCH 256
 
 struct session_s {
   char *tx;
@@ -19,37 +29,24 @@ struct session_s {
   char *rx_ready;
   char *sys_clk;
   struct event *ev;
-  char databuf[2048];
-  int data_start;
-  int datalen;
+  struct event *tx_ev;
+  // stdin (I/O thread) -> sim
+  ring_t rx_ring;
+  // sim -> stdout (I/O thread)
+  ring_t tx_ring;
+  // Characters not pushed to tx_ring yet, flushed on newline, when full or
+  // when the UART goes idle (sim thread only)
+  char txbuf[TX_BATCH];
+  size_t txlen;
+  // With the dpi argument, stdin/stdout are connected to the rings of that
+  // DPI channel instead of the pads, and the session is never ticked
+  struct dpi_channel_s *dpi;
+  ring_t *stdin_ring;
+  ring_t *stdout_ring;
+  char *wake[1];
 };
 
 struct event_base *base;
-static int litex_sim_module_pads_get(struct pad_s *pads, char *name, void **signal)
-{
-  int ret = RC_OK;
-  void *sig = NULL;
-  int i;
-
-  if(!pads || !name || !signal) {
-    ret=RC_INVARG;
-    goto out;
-  }
-
-  i = 0;
-  while(pads[i].name) {
-    if(!strcmp(pads[i].name, name)) {
-      sig = (void*)pads[i].signal;
-      break;
-    }
-    i++;
-  }
-
-out:
-  *signal = sig;
-  return ret;
-}
-
 void set_conio_terminal_mode(void)
 {
   struct termios new_termios;
@@ -73,12 +70,25 @@ void read_handler(int fd, short event, void *arg)
   char buffer[1024];
   ssize_t read_len;
 
-  int i;
   read_len = read(fd, buffer, 1024);
-  for(i = 0; i < read_len; i++) {
-    s->databuf[(s->data_start + s->datalen ) % 2048] = buffer[i];
-    s->datalen++;
+  if(read_len > 0)
+    ring_push(s->stdin_ring, buffer, read_len);
+}
+
+static void tx_handler(int fd, short event, void *arg)
+{
+  struct session_s *s = (struct session_s*)arg;
+  char buffer[4096];
+  size_t len;
+  int flush = 0;
+
+  // Drain everything transmitted since the last call, in bulk
+  while((len = ring_pop(s->stdout_ring, buffer, sizeof(buffer)))) {
+    fwrite(buffer, 1, len, stdout);
+    flush = 1;
   }
+  if(flush)
+    fflush(stdout);
 }
 
 static void event_handler(int fd, short event, void *arg)
@@ -88,27 +98,64 @@ static void event_handler(int fd, short event, void *arg)
   }
 }
 
+static int serial2console_init_rings(struct session_s *s, json_object *args)
+{
+  size_t rx_size = litex_sim_args_opt_int(args, "rx_ring_size", RING_SIZE);
+  size_t tx_size = litex_sim_args_opt_int(args, "tx_ring_size", RING_SIZE);
+
+  if(ring_init(&s->rx_ring, rx_size, 1) || ring_init(&s->tx_ring, tx_size, 1)) {
+    eprintf("Invalid ring sizes %zu/%zu, must be powers of two\n", rx_size, tx_size);
+    return RC_NOENMEM;
+  }
+  return RC_OK;
+}
+
 static int serial2console_new(void **sess, char *args)
 {
   int ret = RC_OK;
   struct timeval tv = {1, 0};
+  struct timeval tx_tv = {0, 1000};
   struct session_s *s = NULL;
+  json_object *jargs = NULL;
 
   if(!sess) {
     ret = RC_INVARG;
     goto out;
   }
 
+  jargs = litex_sim_args_parse("serial2console", args);
+  if(!jargs) {
+    ret = RC_JSERROR;
+    goto out;
+  }
+
   s = (struct session_s*) malloc(sizeof(struct session_s));
   if(!s) {
     ret=RC_NOENMEM;
     goto out;
   }
   memset(s, 0, sizeof(struct session_s));
+  ret = serial2console_init_rings(s, jargs);
+  if(RC_OK != ret)
+    goto out;
+  s->stdin_ring = &s->rx_ring;
+  s->stdout_ring = &s->tx_ring;
+  if(litex_sim_args_opt_string(jargs, "dpi", NULL)) {
+    s->dpi = litex_sim_dpi_channel(litex_sim_args_opt_string(jargs, "dpi", NULL));
+    if(!s->dpi) {
+      ret = RC_ERROR;
+      goto out;
+    }
+    s->stdin_ring = &s->dpi->to_rtl;
+    s->stdout_ring = &s->dpi->from_rtl;
+  }
   s->ev = event_new(base, fileno(stdin), EV_READ | EV_PERSIST , event_handler, s);
   event_add(s->ev, &tv);
+  s->tx_ev = event_new(base, -1, EV_PERSIST, tx_handler, s);
+  event_add(s->tx_ev, &tx_tv);
 
 out:
+  litex_sim_args_free(jargs);
   *sess = (void*) s;
   return ret;
 }
@@ -117,61 +164,103 @@ static int serial2console_add_pads(void *sess, struct pad_list_s *plist)
 {
   int ret = RC_OK;
   struct session_s *s = (struct session_s*) sess;
-  struct pad_s *pads;
 
   if(!sess || !plist) {
     ret = RC_INVARG;
     goto out;
   }
-  pads = plist->pads;
   if(!strcmp(plist->name, "serial")) {
-    litex_sim_module_pads_get(pads, "sink_data", (void**)&s->rx);
-    litex_sim_module_pads_get(pads, "sink_valid", (void**)&s->rx_valid);
-    litex_sim_module_pads_get(pads, "sink_ready", (void**)&s->rx_ready);
-    litex_sim_module_pads_get(pads, "source_data", (void**)&s->tx);
-    litex_sim_module_pads_get(pads, "source_valid", (void**)&s->tx_valid);
-    litex_sim_module_pads_get(pads, "source_ready", (void**)&s->tx_ready);
+    struct pad_bind_s binds[] = {
+      PAD_BIND("sink_data", &s->rx),
+      PAD_BIND("sink_valid", &s->rx_valid),
+      PAD_BIND("sink_ready", &s->rx_ready),
+      PAD_BIND("source_data", &s->tx),
+      PAD_BIND("source_valid", &s->tx_valid),
+      PAD_BIND("source_ready", &s->tx_ready),
+      PAD_BIND_END
+    };
+    litex_sim_pads_bind(plist, binds);
   }
 
   if(!strcmp(plist->name, "sys_clk"))
-    litex_sim_module_pads_get(pads, "sys_clk", (void**) &s->sys_clk);
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
 
 out:
   return ret;
 }
 
+static void serial2console_tx_flush(struct session_s *s)
+{
+  size_t n;
+
+  n = ring_push(&s->tx_ring, s->txbuf, s->txlen);
+  if(n < s->txlen)
+    memmove(s->txbuf, s->txbuf + n, s->txlen - n);
+  s->txlen -= n;
+}
+
 static int serial2console_tick(void *sess, uint64_t time_ps) {
-  static clk_edge_state_t edge;
   struct session_s *s = (struct session_s*)sess;
 
-  if(!clk_pos_edge(&edge, *s->sys_clk)) {
-    return RC_OK;
-  }
+  if(s->dpi)
+    return EXT_MODULE_IDLE;
 
-  *s->tx_ready = 1;
-  if(*s->tx_valid) {
-    printf("%c", *s->tx);
-    fflush(stdout);
+  if(*s->tx_valid && *s->tx_ready) {
+    s->txbuf[s->txlen++] = *s->tx;
   }
+  if(s->txlen && (!*s->tx_valid || s->txlen == TX_BATCH || s->txbuf[s->txlen - 1] == '\n'))
+    serial2console_tx_flush(s);
+  // Back-pressure the UART instead of dropping characters when the I/O thread
+  // falls behind
+  *s->tx_ready = s->txlen < TX_BATCH;
 
   *s->rx_valid = 0;
-  if(s->datalen) {
-    *s->rx = s->databuf[s->data_start];
-    s->data_start = (s->data_start + 1) % 2048;
-    s->datalen--;
+  if(ring_pop(&s->rx_ring, s->rx, 1)) {
     *s->rx_valid = 1;
   }
 
   return RC_OK;
 }
 
+static int serial2console_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static int serial2console_io_pending(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  return ring_count(s->stdin_ring) != 0;
+}
+
+static char **serial2console_wake_signals(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  // Parked for good in DPI mode
+  s->wake[0] = NULL;
+  return s->dpi ? s->wake : NULL;
+}
+
 static struct ext_module_s ext_mod = {
   "serial2console",
   serial2console_start,
   serial2console_new,
   serial2console_add_pads,
   NULL,
-  serial2console_tick
+  serial2console_tick,
+  serial2console_clock_domain,
+  NULL,
+  serial2console_io_pending,
+  NULL,
+  NULL,
+  EXT_MODULE_THREAD_SAFE,
+  serial2console_wake_signals
 };
 
 int litex_sim_ext_module_init(int (*register_module) (struct ext_module_s *))
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include "error.h"
 #include <unistd.h>
 #include <event2/listener.h>
@@ -9,6 +10,15 @@
 
 #include <json-c/json.h>
 #include "modules.h"
+#include "args.h"
+#include "ring.h"
+#include "stim.h"
+
+// Default ring sizes, override with the rx_ring_size/tx_ring_size arguments
+// (powers of two)
+#define RING_SIZE 65536
+// Transmitted characters are batched before being pushed to the TX ring
+#define TX_BATCH 256
 
 struct session_s {
   char *tx;
@@ -19,84 +29,27 @@ struct session_s {
   char *rx_ready;
   char *sys_clk;
   struct event *ev;
-  char databuf[2048];
-  int data_start;
-  int datalen;
+  struct event *tx_ev;
+  // socket (I/O thread) -> sim
+  ring_t rx_ring;
+  // sim -> socket (I/O thread)
+  ring_t tx_ring;
+  // Characters not pushed to tx_ring yet, flushed on newline, when full or
+  // when the UART goes idle (sim thread only)
+  char txbuf[TX_BATCH];
+  size_t txlen;
   int fd;
+  // Socket reads paused while rx_ring is full, resumed by tx_handler (I/O
+  // thread only)
+  int rx_paused;
+  // Received bytes logged when first presented to the UART, injected at the
+  // same times with no socket when replaying (see stim.h)
+  struct stim_stream_s *stim;
+  int rx_shown;
 };
 
 struct event_base *base;
 
-int litex_sim_module_get_args( char *args, char *arg, char **val)
-{
-  int ret = RC_OK;
-  json_object *jsobj = NULL;
-  json_object *obj = NULL;
-  char *value = NULL;
-  int r;
-
-  if(!arg) {
-    fprintf(stderr, "litex_sim_module_get_args(): `arg` (requested .json key) is NULL!\n");
-    ret=RC_JSERROR;
-    goto out;
-  }
-
-  if(!args) {
-    fprintf(stderr, "missing key in .json file: %s\n", arg);
-    ret=RC_JSERROR;
-    goto out;
-  }
-
-  jsobj = json_tokener_parse(args);
-  if(NULL==jsobj) {
-    fprintf(stderr, "Error parsing json arg: %s \n", args);
-    ret=RC_JSERROR;
-    goto out;
-  }
-  if(!json_object_is_type(jsobj, json_type_object)) {
-    fprintf(stderr, "Arg must be type object! : %s \n", args);
-    ret=RC_JSERROR;
-    goto out;
-  }
-  obj=NULL;
-  r = json_object_object_get_ex(jsobj, arg, &obj);
-  if(!r) {
-    fprintf(stderr, "Could not find object: \"%s\" (%s)\n", arg, args);
-    ret=RC_JSERROR;
-    goto out;
-  }
-  value=strdup(json_object_get_string(obj));
-
-out:
-  *val = value;
-  return ret;
-}
-
-static int litex_sim_module_pads_get( struct pad_s *pads, char *name, void **signal)
-{
-  int ret = RC_OK;
-  void *sig = NULL;
-  int i;
-
-  if(!pads || !name || !signal) {
-    ret = RC_INVARG;
-    goto out;
-  }
-
-  i = 0;
-  while(pads[i].name) {
-    if(!strcmp(pads[i].name, name)) {
-      sig = (void*)pads[i].signal;
-      break;
-    }
-    i++;
-  }
-
-out:
-  *signal = sig;
-  return ret;
-}
-
 static int serial2tcp_start(void *b)
 {
   base = (struct event_base *)b;
@@ -108,10 +61,20 @@ void read_handler(int fd, short event, void *arg)
 {
   struct session_s *s = (struct session_s*)arg;
   char buffer[1024];
+  size_t len = ring_space(&s->rx_ring);
   ssize_t read_len;
-  int i, ret;
-
-  read_len = read(fd, buffer, 1024);
+  int ret;
+
+  // Nothing is read past the free space: the bytes wait in the socket, its
+  // reads paused until the simulation has consumed some
+  if(len > sizeof(buffer))
+    len = sizeof(buffer);
+  if(!len) {
+    event_del(s->ev);
+    s->rx_paused = 1;
+    return;
+  }
+  read_len = read(fd, buffer, len);
   if (read_len == 0) {
     // Received EOF, remote has closed the connection
     ret = event_del(s->ev);
@@ -122,13 +85,52 @@ void read_handler(int fd, short event, void *arg)
     event_free(s->ev);
     s->ev = NULL;
   }
-  for(i = 0; i < read_len; i++)
-  {
-    s->databuf[(s->data_start +  s->datalen ) % 2048] = buffer[i];
-    s->datalen++;
+  if(read_len > 0)
+    ring_push(&s->rx_ring, buffer, read_len);
+}
+
+static void tx_handler(int fd, short event, void *arg)
+{
+  struct session_s *s = (struct session_s*)arg;
+  struct timeval tv = {1, 0};
+  char buffer[4096];
+  ssize_t written;
+  size_t len;
+
+  if(s->rx_paused && s->ev && ring_space(&s->rx_ring)) {
+    s->rx_paused = 0;
+    event_add(s->ev, &tv);
+  }
+
+  // Drain everything transmitted since the last call, in bulk. Only what the
+  // socket accepted is consumed, the rest is sent on the next call.
+  while((len = ring_copy(&s->tx_ring, buffer, sizeof(buffer)))) {
+    if(!s->fd) {
+      ring_drop(&s->tx_ring, len);
+      continue;
+    }
+    written = write(s->fd, buffer, len);
+    if(written < 0) {
+      if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        break;
+      // Connection lost, nobody to send to until the next one
+      eprintf("Error writing on socket\n");
+      s->fd = 0;
+      continue;
+    }
+    ring_drop(&s->tx_ring, written);
+    if((size_t)written < len)
+      break;
   }
 }
 
+static void tx_drop_handler(int fd, short event, void *arg)
+{
+  struct session_s *s = (struct session_s*)arg;
+
+  ring_drop(&s->tx_ring, ring_count(&s->tx_ring));
+}
+
 static void event_handler(int fd, short event, void *arg)
 {
   if (event & EV_READ)
@@ -154,20 +156,40 @@ accept_error_cb(struct evconnlistener *listener, void *ctx)
   event_base_loopexit(base, NULL);
 }
 
+static int serial2tcp_init_rings(struct session_s *s, json_object *args)
+{
+  size_t rx_size = litex_sim_args_opt_int(args, "rx_ring_size", RING_SIZE);
+  size_t tx_size = litex_sim_args_opt_int(args, "tx_ring_size", RING_SIZE);
+
+  if(ring_init(&s->rx_ring, rx_size, 1) || ring_init(&s->tx_ring, tx_size, 1)) {
+    eprintf("Invalid ring sizes %zu/%zu, must be powers of two\n", rx_size, tx_size);
+    return RC_NOENMEM;
+  }
+  return RC_OK;
+}
+
 static int serial2tcp_new(void **sess, char *args)
 {
   int ret = RC_OK;
   struct session_s *s = NULL;
   char *cport = NULL;
-  int port;
+  json_object *jargs = NULL;
+  int port = 0;
   struct evconnlistener *listener;
   struct sockaddr_in sin;
+  struct timeval tx_tv = {0, 1000};
+  char name[32];
 
   if(!sess) {
     ret = RC_INVARG;
     goto out;
   }
-  ret = litex_sim_module_get_args(args, "port", &cport);
+  jargs = litex_sim_args_parse("serial2tcp", args);
+  if(!jargs) {
+    ret = RC_JSERROR;
+    goto out;
+  }
+  ret = litex_sim_args_get_string(jargs, "port", &cport);
   if(RC_OK != ret)
     goto out;
 
@@ -186,6 +208,19 @@ static int serial2tcp_new(void **sess, char *args)
     goto out;
   }
   memset(s, 0, sizeof(struct session_s));
+  ret = serial2tcp_init_rings(s, jargs);
+  if(RC_OK != ret)
+    goto out;
+  snprintf(name, sizeof(name), "serial2tcp:%d", port);
+  s->stim = litex_sim_stim_open(name);
+  if(litex_sim_stim_mode() == STIM_REPLAY) {
+    // No client, what the UART transmits is dropped
+    s->tx_ev = event_new(base, -1, EV_PERSIST, tx_drop_handler, s);
+    event_add(s->tx_ev, &tx_tv);
+    goto out;
+  }
+  s->tx_ev = event_new(base, -1, EV_PERSIST, tx_handler, s);
+  event_add(s->tx_ev, &tx_tv);
 
   memset(&sin, 0, sizeof(sin));
   sin.sin_family = AF_INET;
@@ -200,6 +235,7 @@ static int serial2tcp_new(void **sess, char *args)
   evconnlistener_set_error_cb(listener, accept_error_cb);
 
 out:
+  litex_sim_args_free(jargs);
   *sess=(void*)s;
   return ret;
 }
@@ -208,61 +244,129 @@ static int serial2tcp_add_pads(void *sess, struct pad_list_s *plist)
 {
   int ret = RC_OK;
   struct session_s *s=(struct session_s*)sess;
-  struct pad_s *pads;
   if(!sess || !plist) {
     ret = RC_INVARG;
     goto out;
   }
-  pads = plist->pads;
   if(!strcmp(plist->name, "serial")) {
-    litex_sim_module_pads_get(pads, "sink_data", (void**)&s->rx);
-    litex_sim_module_pads_get(pads, "sink_valid", (void**)&s->rx_valid);
-    litex_sim_module_pads_get(pads, "sink_ready", (void**)&s->rx_ready);
-    litex_sim_module_pads_get(pads, "source_data", (void**)&s->tx);
-    litex_sim_module_pads_get(pads, "source_valid", (void**)&s->tx_valid);
-    litex_sim_module_pads_get(pads, "source_ready", (void**)&s->tx_ready);
+    struct pad_bind_s binds[] = {
+      PAD_BIND("sink_data", &s->rx),
+      PAD_BIND("sink_valid", &s->rx_valid),
+      PAD_BIND("sink_ready", &s->rx_ready),
+      PAD_BIND("source_data", &s->tx),
+      PAD_BIND("source_valid", &s->tx_valid),
+      PAD_BIND("source_ready", &s->tx_ready),
+      PAD_BIND_END
+    };
+    litex_sim_pads_bind(plist, binds);
   }
 
   if(!strcmp(plist->name, "sys_clk"))
-    litex_sim_module_pads_get(pads, "sys_clk", (void**)&s->sys_clk);
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
 
 out:
   return ret;
 
 }
-static int serial2tcp_tick(void *sess, uint64_t time_ps)
+static void serial2tcp_tx_flush(struct session_s *s)
 {
-  static clk_edge_state_t edge;
-  char c;
-  int ret = RC_OK;
+  size_t n;
+
+  n = ring_push(&s->tx_ring, s->txbuf, s->txlen);
+  if(n < s->txlen)
+    memmove(s->txbuf, s->txbuf + n, s->txlen - n);
+  s->txlen -= n;
+}
 
+static int serial2tcp_tick(void *sess, uint64_t time_ps)
+{
+  char *c;
+  char buffer[1];
+  size_t len;
   struct session_s *s = (struct session_s*)sess;
-  if(!clk_pos_edge(&edge, *s->sys_clk)) {
-    return RC_OK;
-  }
 
-  *s->tx_ready = 1;
-  if(s->fd && *s->tx_valid) {
-    c = *s->tx;
-    if(-1 ==write(s->fd, &c, 1)) {
-      eprintf("Error writing on socket\n");
-      ret = RC_ERROR;
-      goto out;
-    }
+  if(*s->tx_valid && *s->tx_ready) {
+    s->txbuf[s->txlen++] = *s->tx;
+  }
+  if(s->txlen && (!*s->tx_valid || s->txlen == TX_BATCH || s->txbuf[s->txlen - 1] == '\n'))
+    serial2tcp_tx_flush(s);
+  // Back-pressure the UART instead of dropping characters when the I/O thread
+  // falls behind
+  *s->tx_ready = s->txlen < TX_BATCH;
+
+  // With no I/O thread producing, the simulation thread feeds rx_ring
+  if(s->stim && litex_sim_stim_mode() == STIM_REPLAY) {
+    // Bytes are logged one per event, left in the log while the ring is full
+    while(ring_space(&s->rx_ring)
+          && (len = litex_sim_stim_replay(s->stim, time_ps, buffer, 1)))
+      ring_push(&s->rx_ring, buffer, len);
   }
 
   *s->rx_valid=0;
-  if(s->datalen) {
-    c = s->databuf[s->data_start];
-    *s->rx = c;
+  if((c = ring_peek(&s->rx_ring))) {
+    *s->rx = *c;
     *s->rx_valid=1;
+    if(!s->rx_shown && litex_sim_stim_mode() == STIM_RECORD)
+      litex_sim_stim_record(s->stim, time_ps, c, 1);
+    s->rx_shown = 1;
     if (*s->rx_ready) {
-      s->data_start = (s->data_start + 1) % 2048;
-      s->datalen--;
+      ring_drop(&s->rx_ring, 1);
+      s->rx_shown = 0;
     }
   }
 
-out:
+  return RC_OK;
+}
+
+static int serial2tcp_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static int serial2tcp_io_pending(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  return ring_count(&s->rx_ring) != 0;
+}
+
+static int serial2tcp_save(void *sess, FILE *f)
+{
+  struct session_s *s = (struct session_s*)sess;
+  char *buffer = malloc(s->rx_ring.mask + 1);
+  uint32_t len;
+  int ret = RC_OK;
+
+  if(!buffer)
+    return RC_NOENMEM;
+  // Only the received bytes not yet consumed by the simulation are kept, the
+  // TCP connection itself has to be reopened after a restore.
+  len = ring_copy(&s->rx_ring, buffer, s->rx_ring.mask + 1);
+  if(fwrite(&len, sizeof(len), 1, f) != 1 || fwrite(buffer, 1, len, f) != len)
+    ret = RC_ERROR;
+  free(buffer);
+  return ret;
+}
+
+static int serial2tcp_restore(void *sess, FILE *f)
+{
+  struct session_s *s = (struct session_s*)sess;
+  char *buffer = malloc(s->rx_ring.mask + 1);
+  uint32_t len;
+  int ret = RC_OK;
+
+  if(!buffer)
+    return RC_NOENMEM;
+  if(fread(&len, sizeof(len), 1, f) != 1 || len > s->rx_ring.mask + 1 || fread(buffer, 1, len, f) != len)
+    ret = RC_ERROR;
+  // Called before the I/O thread runs, so pushing from here is safe
+  else if(ring_push(&s->rx_ring, buffer, len) != len)
+    ret = RC_ERROR;
+  free(buffer);
   return ret;
 }
 
@@ -272,7 +376,13 @@ static struct ext_module_s ext_mod = {
   serial2tcp_new,
   serial2tcp_add_pads,
   NULL,
-  serial2tcp_tick
+  serial2tcp_tick,
+  serial2tcp_clock_domain,
+  NULL,
+  serial2tcp_io_pending,
+  serial2tcp_save,
+  serial2tcp_restore,
+  EXT_MODULE_THREAD_SAFE
 };
 
 int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include "error.h"
 #include "modules.h"
 
@@ -49,6 +50,8 @@ struct session_s {
   char *sda_in;
   char *sda_out;
   char *scl;
+  // pads waking the module up when idle
+  char *wake[3];
   // SPD EEPROM memory contents
   unsigned char mem[256];
   // state machine
@@ -59,6 +62,9 @@ struct session_s {
   unsigned int bit_counter;
   unsigned int devaddr;
   unsigned int addr;
+  // bus state for edge detection
+  int sda_last;
+  int scl_last;
 };
 
 // Module interface
@@ -66,12 +72,15 @@ static int spdeeprom_start();
 static int spdeeprom_new(void **sess, char *args);
 static int spdeeprom_add_pads(void *sess, struct pad_list_s *plist);
 static int spdeeprom_tick(void *sess, uint64_t time_ps);
+static int spdeeprom_clock_domain(void *sess, char **clk, clk_edge_t *edge);
+static int spdeeprom_save(void *sess, FILE *f);
+static int spdeeprom_restore(void *sess, FILE *f);
+static char **spdeeprom_wake_signals(void *sess);
 // EEPROM simulation
 static void fsm_tick(struct session_s *s);
 static enum SerialState state_serial_next(struct session_s *s);
 // Helper functions
 static void spdeeprom_from_file(struct session_s *s, FILE *file);
-static int litex_sim_module_pads_get(struct pad_s *pads, char *name, void **signal);
 
 /*** Module interface *****************************************************************************/
 
@@ -81,7 +90,14 @@ static struct ext_module_s ext_mod = {
   spdeeprom_new,
   spdeeprom_add_pads,
   NULL,
-  spdeeprom_tick
+  spdeeprom_tick,
+  spdeeprom_clock_domain,
+  NULL,
+  NULL,
+  spdeeprom_save,
+  spdeeprom_restore,
+  0,
+  spdeeprom_wake_signals
 };
 
 int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
@@ -117,6 +133,8 @@ static int spdeeprom_new(void **sess, char *args)
     goto out;
   }
   memset(s, 0, sizeof(struct session_s));
+  s->sda_last = 1;
+  s->scl_last = 1;
 
   spd_filename = getenv("SPD_EEPROM_FILE");
   if (spd_filename != NULL) {
@@ -141,42 +159,88 @@ static int spdeeprom_add_pads(void *sess, struct pad_list_s *plist)
 {
   int ret = RC_OK;
   struct session_s *s = (struct session_s*) sess;
-  struct pad_s *pads;
 
   if(!sess || !plist) {
     ret = RC_INVARG;
     goto out;
   }
-  pads = plist->pads;
 
   if(!strcmp(plist->name, "i2c")) {
-    litex_sim_module_pads_get(pads, "sda_in", (void**) &s->sda_in);
-    litex_sim_module_pads_get(pads, "sda_out", (void**) &s->sda_out);
-    litex_sim_module_pads_get(pads, "scl", (void**) &s->scl);
+    struct pad_bind_s binds[] = {
+      PAD_BIND("sda_in", &s->sda_in),
+      PAD_BIND("sda_out", &s->sda_out),
+      PAD_BIND("scl", &s->scl),
+      PAD_BIND_END
+    };
+    litex_sim_pads_bind(plist, binds);
   }
 
   if(!strcmp(plist->name, "sys_clk"))
-    litex_sim_module_pads_get(pads, "sys_clk", (void**) &s->sys_clk);
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
 
 out:
   return ret;
 }
 
+static int spdeeprom_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
 static int spdeeprom_tick(void *sess, uint64_t time_ps)
 {
-  static clk_edge_state_t edge;
   struct session_s *s = (struct session_s*) sess;
 
   if (s->sda_in == 0 || s->sda_out == 0 || s->scl == 0) {
       return RC_OK;
   }
 
-  if(!clk_pos_edge(&edge, *s->sys_clk)) {
-    return RC_OK;
-  }
-
   fsm_tick(s);
 
+  // The EEPROM is only accessed during SDRAM init, park until the next START
+  if (s->state_serial == IDLE)
+    return EXT_MODULE_IDLE;
+
+  return RC_OK;
+}
+
+static char **spdeeprom_wake_signals(void *sess)
+{
+  struct session_s *s = (struct session_s*) sess;
+
+  if (s->sda_out == 0 || s->scl == 0)
+    return NULL;
+  s->wake[0] = s->sda_out;
+  s->wake[1] = s->scl;
+  s->wake[2] = NULL;
+  return s->wake;
+}
+
+/*** Checkpointing ********************************************************************************/
+
+// Everything but the pads is plain session state
+#define SPDEEPROM_STATE_OFFSET offsetof(struct session_s, mem)
+#define SPDEEPROM_STATE_SIZE   (sizeof(struct session_s) - SPDEEPROM_STATE_OFFSET)
+
+static int spdeeprom_save(void *sess, FILE *f)
+{
+  struct session_s *s = (struct session_s*) sess;
+
+  if (fwrite((char*) s + SPDEEPROM_STATE_OFFSET, SPDEEPROM_STATE_SIZE, 1, f) != 1)
+    return RC_ERROR;
+  return RC_OK;
+}
+
+static int spdeeprom_restore(void *sess, FILE *f)
+{
+  struct session_s *s = (struct session_s*) sess;
+
+  if (fread((char*) s + SPDEEPROM_STATE_OFFSET, SPDEEPROM_STATE_SIZE, 1, f) != 1)
+    return RC_ERROR;
   return RC_OK;
 }
 
@@ -210,9 +274,6 @@ static inline const char *state_transaction_str(enum TransactionState s)
 
 static void fsm_tick(struct session_s *s)
 {
-  static int sda_last = 1;
-  static int scl_last = 1;
-
   enum SerialState last_state_serial;
   int sda_rising_edge;
   int sda_falling_edge;
@@ -221,15 +282,15 @@ static void fsm_tick(struct session_s *s)
   int scl_rising;
   int scl_falling;
 
-  sda_rising_edge  = !sda_last && *s->sda_out;
-  sda_falling_edge = sda_last && !*s->sda_out;
+  sda_rising_edge  = !s->sda_last && *s->sda_out;
+  sda_falling_edge = s->sda_last && !*s->sda_out;
   start_cond       = sda_falling_edge && *s->scl;
   stop_cond        = sda_rising_edge && *s->scl;
-  scl_rising       = !scl_last && *s->scl;
-  scl_falling      = scl_last && !*s->scl;
+  scl_rising       = !s->scl_last && *s->scl;
+  scl_falling      = s->scl_last && !*s->scl;
 
-  sda_last = *s->sda_out;
-  scl_last = *s->scl;
+  s->sda_last = *s->sda_out;
+  s->scl_last = *s->scl;
 
   if (start_cond) {
     DBG("[spdeeprom] START condition\n");
@@ -401,29 +462,3 @@ static void spdeeprom_from_file(struct session_s *s, FILE *file)
   if (line != NULL)
     free(line);
 }
-
-static int litex_sim_module_pads_get(struct pad_s *pads, char *name, void **signal)
-{
-  int ret = RC_OK;
-  void *sig=NULL;
-  int i;
-
-  if(!pads || !name || !signal) {
-    ret = RC_INVARG;
-    goto out;
-  }
-
-  i = 0;
-  while(pads[i].name) {
-    if(!strcmp(pads[i].name, name))
-    {
-      sig = (void*) pads[i].signal;
-      break;
-    }
-    i++;
-  }
-
-out:
-  *signal = sig;
-  return ret;
-}
@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <event2/listener.h>
+#include <event2/util.h>
+#include <event2/event.h>
+#include <json-c/json.h>
+#include "error.h"
+#include "modules.h"
+#include "args.h"
+#include "ring.h"
+
+/*
+ * Live waveform streaming: samples every signal of the interfaces the module
+ * is attached to on each rising sys_clk edge and streams their changes to a
+ * TCP client (see litex_sim_wavestream for a receiver writing a VCD file or
+ * feeding a viewer). The optional "signals" argument (comma separated
+ * "interface.signal" or "interface" names) restricts the streamed signals.
+ *
+ * On connection the client gets "LXWS", a 32-bit version, the 32-bit number
+ * of signals and, for each, its 16-bit width, 8-bit name length and name
+ * ("interface.signal"). Records follow, one per cycle with changes:
+ *
+ *   varint  ps since the last record << 1 | full (all values, absolute time)
+ *   varint  number of changed signals
+ *   per changed signal: varint index, (width + 7) / 8 value bytes, LSB first
+ *
+ * All integers are little endian. The first record after the connection, or
+ * after records were dropped because the client did not keep up, is full.
+ */
+
+#define WAVESTREAM_MAGIC "LXWS"
+#define WAVESTREAM_VERSION 1
+#define WAVESTREAM_RING_SIZE (1 << 20)
+
+struct signal_s {
+  char *name;
+  size_t bits;
+  size_t size;
+  uint8_t *value;
+  uint8_t *last;
+};
+
+struct session_s {
+  struct signal_s *signals;
+  size_t nsignals;
+  char *filter;
+  char *sys_clk;
+  uint8_t *values;
+  uint8_t *record;
+  size_t record_max;
+  // sim -> socket (I/O thread)
+  ring_t ring;
+  struct event *ev;
+  struct event *tx_ev;
+  int fd;
+  // Set by the I/O thread once the header is sent
+  _Atomic int connected;
+  // Sim thread only
+  int resync;
+  uint64_t last_time;
+  uint64_t records;
+  uint64_t dropped;
+};
+
+static struct event_base *base;
+
+static int wavestream_start(void *b)
+{
+  base = (struct event_base *)b;
+  printf("[wavestream] loaded (%p)\n", base);
+  return RC_OK;
+}
+
+static size_t wavestream_put_varint(uint8_t *p, uint64_t v)
+{
+  size_t n = 0;
+
+  while(v >= 0x80) {
+    p[n++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  p[n++] = v;
+  return n;
+}
+
+static void wavestream_disconnect(struct session_s *s)
+{
+  atomic_store(&s->connected, 0);
+  if(s->ev) {
+    event_del(s->ev);
+    event_free(s->ev);
+    s->ev = NULL;
+  }
+  if(s->fd > 0)
+    close(s->fd);
+  s->fd = 0;
+  ring_drop(&s->ring, ring_count(&s->ring));
+}
+
+static void read_handler(int fd, short event, void *arg)
+{
+  struct session_s *s = (struct session_s*)arg;
+  char buffer[256];
+
+  // Nothing is expected from the client, only the end of the connection
+  if(read(fd, buffer, sizeof(buffer)) == 0) {
+    printf("[wavestream] client disconnected\n");
+    wavestream_disconnect(s);
+  }
+}
+
+static void tx_handler(int fd, short event, void *arg)
+{
+  struct session_s *s = (struct session_s*)arg;
+  uint8_t buffer[16384];
+  size_t len;
+  ssize_t n;
+
+  if(!atomic_load(&s->connected))
+    return;
+  // Partial writes leave the rest in the ring for the next call
+  while((len = ring_copy(&s->ring, buffer, sizeof(buffer)))) {
+    n = send(s->fd, buffer, len, MSG_NOSIGNAL);
+    if(n <= 0)
+      break;
+    ring_drop(&s->ring, n);
+  }
+}
+
+static int wavestream_send_header(struct session_s *s, int fd)
+{
+  uint32_t version = WAVESTREAM_VERSION;
+  uint32_t count = s->nsignals;
+  size_t len = 12, i, namelen;
+  uint8_t *header, *p;
+  uint16_t bits;
+  int ret = RC_OK;
+
+  for(i = 0; i < s->nsignals; i++)
+    len += 3 + strlen(s->signals[i].name);
+  p = header = (uint8_t *)malloc(len);
+  if(!header)
+    return RC_NOENMEM;
+  memcpy(p, WAVESTREAM_MAGIC, 4);
+  memcpy(p + 4, &version, 4);
+  memcpy(p + 8, &count, 4);
+  p += 12;
+  for(i = 0; i < s->nsignals; i++) {
+    bits = s->signals[i].bits;
+    namelen = strlen(s->signals[i].name);
+    memcpy(p, &bits, 2);
+    p[2] = namelen;
+    memcpy(p + 3, s->signals[i].name, namelen);
+    p += 3 + namelen;
+  }
+  // Sent before any record, while the socket buffer is still empty
+  if(write(fd, header, len) != (ssize_t)len)
+    ret = RC_ERROR;
+  free(header);
+  return ret;
+}
+
+static void accept_conn_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *address, int socklen, void *ctx)
+{
+  struct session_s *s = (struct session_s*)ctx;
+
+  if(atomic_load(&s->connected)) {
+    eprintf("[wavestream] a client is already connected\n");
+    close(fd);
+    return;
+  }
+  // Records pushed by the sim thread while the last client was leaving
+  ring_drop(&s->ring, ring_count(&s->ring));
+  if(RC_OK != wavestream_send_header(s, fd)) {
+    eprintf("[wavestream] error writing on socket\n");
+    close(fd);
+    return;
+  }
+  s->fd = fd;
+  s->ev = event_new(base, fd, EV_READ | EV_PERSIST, read_handler, s);
+  event_add(s->ev, NULL);
+  atomic_store(&s->connected, 1);
+  printf("[wavestream] streaming %zu signals\n", s->nsignals);
+}
+
+static void accept_error_cb(struct evconnlistener *listener, void *ctx)
+{
+  struct event_base *base = evconnlistener_get_base(listener);
+  eprintf("ERROR\n");
+
+  event_base_loopexit(base, NULL);
+}
+
+static int wavestream_new(void **sess, char *args)
+{
+  int ret = RC_OK;
+  struct session_s *s = NULL;
+  json_object *jargs = NULL;
+  int port;
+  size_t ring_size;
+  struct evconnlistener *listener;
+  struct sockaddr_in sin;
+  struct timeval tx_tv = {0, 1000};
+
+  if(!sess) {
+    ret = RC_INVARG;
+    goto out;
+  }
+  jargs = litex_sim_args_parse("wavestream", args);
+  if(!jargs) {
+    ret = RC_JSERROR;
+    goto out;
+  }
+  port = litex_sim_args_opt_int(jargs, "port", 0);
+  if(port <= 0) {
+    ret = RC_ERROR;
+    eprintf("Invalid port selected!\n");
+    goto out;
+  }
+
+  s = (struct session_s*)malloc(sizeof(struct session_s));
+  if(!s) {
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  memset(s, 0, sizeof(struct session_s));
+  atomic_init(&s->connected, 0);
+  s->filter = strdup(litex_sim_args_opt_string(jargs, "signals", ""));
+  ring_size = litex_sim_args_opt_int(jargs, "ring_size", WAVESTREAM_RING_SIZE);
+  if(ring_init(&s->ring, ring_size, 1)) {
+    eprintf("Invalid ring size %zu, must be a power of two\n", ring_size);
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  s->tx_ev = event_new(base, -1, EV_PERSIST, tx_handler, s);
+  event_add(s->tx_ev, &tx_tv);
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(0);
+  sin.sin_port = htons(port);
+  listener = evconnlistener_new_bind(base, accept_conn_cb, s, LEV_OPT_CLOSE_ON_FREE|LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&sin, sizeof(sin));
+  if(!listener) {
+    ret = RC_ERROR;
+    eprintf("Can't bind port %d\n!\n", port);
+    goto out;
+  }
+  evconnlistener_set_error_cb(listener, accept_error_cb);
+  printf("[wavestream] listening on port %d\n", port);
+
+out:
+  litex_sim_args_free(jargs);
+  *sess = (void*)s;
+  return ret;
+}
+
+/* Whether name ("interface.signal") is selected by the "signals" argument */
+static int wavestream_selected(struct session_s *s, const char *iface, const char *name)
+{
+  const char *p = s->filter;
+  size_t ilen = strlen(iface), len;
+
+  if(!*p)
+    return 1;
+  while(*p) {
+    len = strcspn(p, ",");
+    if(len == ilen && !strncmp(p, iface, ilen))
+      return 1;
+    if(len == ilen + 1 + strlen(name) && !strncmp(p, iface, ilen) && p[ilen] == '.' && !strncmp(p + ilen + 1, name, len - ilen - 1))
+      return 1;
+    p += len;
+    if(*p == ',')
+      p++;
+  }
+  return 0;
+}
+
+static int wavestream_add_pads(void *sess, struct pad_list_s *plist)
+{
+  int ret = RC_OK;
+  struct session_s *s = (struct session_s*)sess;
+  struct signal_s *signals, *sig;
+  char iface[64];
+  struct pad_s *p;
+
+  if(!sess || !plist) {
+    ret = RC_INVARG;
+    goto out;
+  }
+  if(!strcmp(plist->name, "sys_clk")) {
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
+    goto out;
+  }
+
+  if(plist->index)
+    snprintf(iface, sizeof(iface), "%s%d", plist->name, plist->index);
+  else
+    snprintf(iface, sizeof(iface), "%s", plist->name);
+  for(p = plist->pads; p->name; p++) {
+    if(!p->signal || !wavestream_selected(s, iface, p->name) || strlen(iface) + strlen(p->name) >= 255)
+      continue;
+    signals = (struct signal_s *)realloc(s->signals, (s->nsignals + 1) * sizeof(struct signal_s));
+    if(!signals) {
+      ret = RC_NOENMEM;
+      goto out;
+    }
+    s->signals = signals;
+    sig = &s->signals[s->nsignals++];
+    sig->name = (char *)malloc(strlen(iface) + strlen(p->name) + 2);
+    if(!sig->name) {
+      ret = RC_NOENMEM;
+      goto out;
+    }
+    sprintf(sig->name, "%s.%s", iface, p->name);
+    sig->bits = p->len;
+    sig->size = (p->len + 7) / 8;
+    // Verilator stores signals little endian, in at least (len + 7) / 8 bytes
+    sig->value = (uint8_t *)p->signal;
+  }
+
+out:
+  return ret;
+}
+
+/* Previous values and record buffer, once all the pads are known */
+static int wavestream_alloc(struct session_s *s)
+{
+  size_t i, len = 0;
+
+  for(i = 0; i < s->nsignals; i++)
+    len += s->signals[i].size;
+  s->values = (uint8_t *)calloc(1, len + 1);
+  s->record_max = 20 + len;
+  for(i = 0; i < s->nsignals; i++)
+    s->record_max += 10;
+  s->record = (uint8_t *)malloc(s->record_max);
+  if(!s->values || !s->record)
+    return RC_NOENMEM;
+  for(len = 0, i = 0; i < s->nsignals; i++) {
+    s->signals[i].last = s->values + len;
+    len += s->signals[i].size;
+  }
+  s->resync = 1;
+  return RC_OK;
+}
+
+static int wavestream_tick(void *sess, uint64_t time_ps)
+{
+  struct session_s *s = (struct session_s*)sess;
+  uint8_t changes[10];
+  size_t i, n, len, nlen;
+  struct signal_s *sig;
+  int all;
+
+  if(!s->record && RC_OK != wavestream_alloc(s))
+    return RC_NOENMEM;
+  if(!atomic_load_explicit(&s->connected, memory_order_acquire)) {
+    s->resync = 1;
+    return RC_OK;
+  }
+
+  // The changes first go after a header of the maximum size, moved next to
+  // the real one once their number is known
+  all = s->resync;
+  len = 20;
+  for(n = 0, i = 0; i < s->nsignals; i++) {
+    sig = &s->signals[i];
+    if(!all && !memcmp(sig->value, sig->last, sig->size))
+      continue;
+    memcpy(sig->last, sig->value, sig->size);
+    len += wavestream_put_varint(s->record + len, i);
+    memcpy(s->record + len, sig->value, sig->size);
+    len += sig->size;
+    n++;
+  }
+  if(!n)
+    return RC_OK;
+
+  nlen = wavestream_put_varint(changes, n);
+  i = 20 - nlen;
+  memcpy(s->record + i, changes, nlen);
+  nlen = wavestream_put_varint(changes, all ? time_ps << 1 | 1 : (time_ps - s->last_time) << 1);
+  i -= nlen;
+  memcpy(s->record + i, changes, nlen);
+
+  if(ring_space(&s->ring) < len - i) {
+    // Dropped: the next record carries all the values again
+    s->dropped++;
+    s->resync = 1;
+    return RC_OK;
+  }
+  ring_push(&s->ring, s->record + i, len - i);
+  s->last_time = time_ps;
+  s->resync = 0;
+  s->records++;
+  return RC_OK;
+}
+
+static int wavestream_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static int wavestream_close(void *sess)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  printf("[wavestream] %lu records streamed, %lu dropped\n",
+    (unsigned long)s->records, (unsigned long)s->dropped);
+  return RC_OK;
+}
+
+static struct ext_module_s ext_mod = {
+  "wavestream",
+  wavestream_start,
+  wavestream_new,
+  wavestream_add_pads,
+  wavestream_close,
+  wavestream_tick,
+  wavestream_clock_domain,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  EXT_MODULE_THREAD_SAFE
+};
+
+int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
+{
+  int ret = RC_OK;
+  ret = register_module(&ext_mod);
+  return ret;
+}
@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <json-c/json.h>
+#include "error.h"
+#include "modules.h"
+
+/*
+ * Behavioral memory on a Wishbone slave interface, standing in for the
+ * DRAM controller or SRAM RTL. Contents are kept in a sparse store of 4 KiB
+ * host pages allocated on first write, reads of untouched memory return 0.
+ * Accesses are acked one cycle after the request, the data width (32 or 64
+ * bits) comes from the dat_w pad.
+ *
+ * The optional sim_load pads let software have one of the "load" files of
+ * the args written into the store at a given offset, in zero simulated time
+ * (see SimLoad in litex/build/sim/platform.py).
+ */
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define L2_BITS 10
+#define L1_BITS (32 - PAGE_SHIFT - L2_BITS)
+
+struct session_s {
+  uint32_t *adr;
+  void *dat_w;
+  void *dat_r;
+  uint8_t *sel;
+  uint8_t *cyc;
+  uint8_t *stb;
+  uint8_t *ack;
+  uint8_t *we;
+  char *sys_clk;
+  int data_bytes;
+  /* sim_load channel */
+  uint8_t *load_index;
+  uint32_t *load_addr;
+  uint8_t *load_start;
+  uint8_t *load_done;
+  uint32_t *load_length;
+  uint8_t *load_error;
+  char **load_files;
+  int load_count;
+  /* Two level page table of the 32-bit byte address space */
+  uint8_t **pages[1 << L1_BITS];
+};
+
+static uint8_t *wishbone_memory_page(struct session_s *s, uint32_t addr, int alloc)
+{
+  uint8_t ***l2 = &s->pages[addr >> (PAGE_SHIFT + L2_BITS)];
+  uint8_t **page;
+
+  if(!*l2) {
+    if(!alloc)
+      return NULL;
+    *l2 = (uint8_t **)calloc(1 << L2_BITS, sizeof(uint8_t *));
+    if(!*l2)
+      return NULL;
+  }
+  page = &(*l2)[(addr >> PAGE_SHIFT) & ((1 << L2_BITS) - 1)];
+  if(!*page && alloc)
+    *page = (uint8_t *)calloc(1, PAGE_SIZE);
+  return *page;
+}
+
+static int wishbone_memory_load(struct session_s *s, const char *filename, uint32_t offset, uint64_t *loaded)
+{
+  FILE *f;
+  uint8_t *page;
+  size_t len;
+  uint64_t total = 0;
+
+  f = fopen(filename, "rb");
+  if(!f) {
+    eprintf("Can't open %s\n", filename);
+    return RC_ERROR;
+  }
+  for(;;) {
+    page = wishbone_memory_page(s, offset, 1);
+    if(!page) {
+      fclose(f);
+      return RC_NOENMEM;
+    }
+    len = fread(page + (offset & (PAGE_SIZE - 1)), 1, PAGE_SIZE - (offset & (PAGE_SIZE - 1)), f);
+    if(!len)
+      break;
+    offset += len;
+    total += len;
+  }
+  fclose(f);
+  printf("[wishbone_memory] loaded %lu bytes from %s\n", (unsigned long)total, filename);
+  if(loaded)
+    *loaded = total;
+  return RC_OK;
+}
+
+static int wishbone_memory_parse_args(struct session_s *s, const char *args)
+{
+  int ret = RC_OK;
+  json_object *args_json = NULL;
+  json_object *init_json = NULL;
+  json_object *offset_json = NULL;
+  json_object *load_json = NULL;
+  int i;
+
+  if(!args)
+    return RC_OK;
+
+  args_json = json_tokener_parse(args);
+  if (!args_json) {
+    ret = RC_JSERROR;
+    fprintf(stderr, "[wishbone_memory] Could not parse args: %s\n", args);
+    goto out;
+  }
+
+  /* Optional raw image, loaded at an optional byte offset */
+  if(json_object_object_get_ex(args_json, "init", &init_json)) {
+    json_object_object_get_ex(args_json, "offset", &offset_json);
+    ret = wishbone_memory_load(s, json_object_get_string(init_json),
+      offset_json ? json_object_get_int64(offset_json) : 0, NULL);
+    if(RC_OK != ret)
+      goto out;
+  }
+
+  /* Optional files for sim_load requests, by index */
+  if(json_object_object_get_ex(args_json, "load", &load_json)) {
+    if(!json_object_is_type(load_json, json_type_array)) {
+      ret = RC_JSERROR;
+      eprintf("load must be an array of file names\n");
+      goto out;
+    }
+    s->load_count = json_object_array_length(load_json);
+    s->load_files = (char **)calloc(s->load_count, sizeof(char *));
+    if(!s->load_files) {
+      ret = RC_NOENMEM;
+      goto out;
+    }
+    for(i = 0; i < s->load_count; i++) {
+      s->load_files[i] = strdup(json_object_get_string(json_object_array_get_idx(load_json, i)));
+      if(!s->load_files[i]) {
+        ret = RC_NOENMEM;
+        goto out;
+      }
+    }
+  }
+out:
+  if(args_json) json_object_put(args_json);
+  return ret;
+}
+
+static int wishbone_memory_start(void *b)
+{
+  printf("[wishbone_memory] loaded\n");
+  return RC_OK;
+}
+
+static int wishbone_memory_new(void **sess, char *args)
+{
+  int ret = RC_OK;
+  struct session_s *s = NULL;
+
+  if(!sess) {
+    ret = RC_INVARG;
+    goto out;
+  }
+
+  s=(struct session_s*)malloc(sizeof(struct session_s));
+  if(!s) {
+    ret = RC_NOENMEM;
+    goto out;
+  }
+  memset(s, 0, sizeof(struct session_s));
+
+  ret = wishbone_memory_parse_args(s, args);
+out:
+  *sess=(void*)s;
+  return ret;
+}
+
+static int wishbone_memory_add_pads(void *sess, struct pad_list_s *plist)
+{
+  int ret = RC_OK;
+  struct session_s *s=(struct session_s*)sess;
+  struct pad_s *dat_w;
+
+  if(!sess || !plist) {
+    ret = RC_INVARG;
+    goto out;
+  }
+  if(!strcmp(plist->name, "wishbone_mem")) {
+    struct pad_bind_s binds[] = {
+      PAD_BIND("adr", &s->adr),
+      PAD_BIND("dat_w", &s->dat_w),
+      PAD_BIND("dat_r", &s->dat_r),
+      PAD_BIND("sel", &s->sel),
+      PAD_BIND("cyc", &s->cyc),
+      PAD_BIND("stb", &s->stb),
+      PAD_BIND("ack", &s->ack),
+      PAD_BIND("we", &s->we),
+      PAD_BIND_END
+    };
+    ret = litex_sim_pads_bind(plist, binds);
+    if(RC_OK != ret) {
+      eprintf("Missing Wishbone signals\n");
+      goto out;
+    }
+    dat_w = litex_sim_pad_get(plist, "dat_w");
+    s->data_bytes = dat_w->len / 8;
+    if(s->data_bytes != 4 && s->data_bytes != 8) {
+      ret = RC_ERROR;
+      eprintf("Unsupported data width %d\n", (int)dat_w->len);
+      goto out;
+    }
+  }
+
+  if(!strcmp(plist->name, "sim_load")) {
+    struct pad_bind_s binds[] = {
+      PAD_BIND("index", &s->load_index),
+      PAD_BIND("addr", &s->load_addr),
+      PAD_BIND("start", &s->load_start),
+      PAD_BIND("done", &s->load_done),
+      PAD_BIND("length", &s->load_length),
+      PAD_BIND("error", &s->load_error),
+      PAD_BIND_END
+    };
+    ret = litex_sim_pads_bind(plist, binds);
+    if(RC_OK != ret) {
+      eprintf("Missing sim_load signals\n");
+      goto out;
+    }
+  }
+
+  if(!strcmp(plist->name, "sys_clk"))
+    litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->sys_clk), PAD_BIND_END });
+
+out:
+  return ret;
+}
+
+/* Serves a sim_load request: done is held until the gateware drops start */
+static void wishbone_memory_sim_load(struct session_s *s)
+{
+  uint64_t len = 0;
+  int idx = *s->load_index;
+
+  if(!*s->load_start) {
+    *s->load_done = 0;
+    return;
+  }
+  if(*s->load_done)
+    return;
+  if(idx < s->load_count && RC_OK == wishbone_memory_load(s, s->load_files[idx], *s->load_addr, &len)) {
+    *s->load_length = len;
+    *s->load_error = 0;
+  } else {
+    if(idx >= s->load_count)
+      eprintf("No load file %d\n", idx);
+    *s->load_length = 0;
+    *s->load_error = 1;
+  }
+  *s->load_done = 1;
+}
+
+static int wishbone_memory_tick(void *sess, uint64_t time_ps)
+{
+  struct session_s *s = (struct session_s*)sess;
+  uint8_t data[8];
+  uint8_t *page;
+  uint32_t addr;
+  int i;
+
+  if(s->load_start)
+    wishbone_memory_sim_load(s);
+
+  /* One access per two cycles: ack, then idle while the master moves on */
+  if(*s->ack) {
+    *s->ack = 0;
+    return RC_OK;
+  }
+  if(!*s->cyc || !*s->stb)
+    return RC_OK;
+
+  addr = *s->adr * s->data_bytes;
+  if(*s->we) {
+    page = wishbone_memory_page(s, addr, 1);
+    if(!page)
+      return RC_NOENMEM;
+    memcpy(data, s->dat_w, s->data_bytes);
+    for(i = 0; i < s->data_bytes; i++) {
+      if(*s->sel & (1 << i))
+        page[(addr & (PAGE_SIZE - 1)) + i] = data[i];
+    }
+  } else {
+    page = wishbone_memory_page(s, addr, 0);
+    if(page)
+      memcpy(s->dat_r, page + (addr & (PAGE_SIZE - 1)), s->data_bytes);
+    else
+      memset(s->dat_r, 0, s->data_bytes);
+  }
+  *s->ack = 1;
+  return RC_OK;
+}
+
+static int wishbone_memory_clock_domain(void *sess, char **clk, clk_edge_t *edge)
+{
+  struct session_s *s = (struct session_s*)sess;
+
+  *clk = s->sys_clk;
+  *edge = CLK_EDGE_RISING;
+  return RC_OK;
+}
+
+static int wishbone_memory_save(void *sess, FILE *f)
+{
+  struct session_s *s = (struct session_s*)sess;
+  uint32_t addr;
+  int i, j;
+
+  /* Allocated pages only, tagged with their address, ended by a 0xffffffff tag */
+  for(i = 0; i < (1 << L1_BITS); i++) {
+    if(!s->pages[i])
+      continue;
+    for(j = 0; j < (1 << L2_BITS); j++) {
+      if(!s->pages[i][j])
+        continue;
+      addr = ((uint32_t)i << (PAGE_SHIFT + L2_BITS)) | ((uint32_t)j << PAGE_SHIFT);
+      if(fwrite(&addr, sizeof(addr), 1, f) != 1 || fwrite(s->pages[i][j], PAGE_SIZE, 1, f) != 1)
+        return RC_ERROR;
+    }
+  }
+  addr = 0xffffffff;
+  if(fwrite(&addr, sizeof(addr), 1, f) != 1 || fwrite(s->ack, 1, 1, f) != 1)
+    return RC_ERROR;
+  return RC_OK;
+}
+
+static int wishbone_memory_restore(void *sess, FILE *f)
+{
+  struct session_s *s = (struct session_s*)sess;
+  uint32_t addr;
+  uint8_t *page;
+
+  for(;;) {
+    if(fread(&addr, sizeof(addr), 1, f) != 1)
+      return RC_ERROR;
+    if(addr == 0xffffffff)
+      break;
+    page = wishbone_memory_page(s, addr, 1);
+    if(!page)
+      return RC_NOENMEM;
+    if(fread(page, PAGE_SIZE, 1, f) != 1)
+      return RC_ERROR;
+  }
+  if(fread(s->ack, 1, 1, f) != 1)
+    return RC_ERROR;
+  return RC_OK;
+}
+
+static struct ext_module_s ext_mod = {
+  "wishbone_memory",
+  wishbone_memory_start,
+  wishbone_memory_new,
+  wishbone_memory_add_pads,
+  NULL,
+  wishbone_memory_tick,
+  wishbone_memory_clock_domain,
+  NULL,
+  NULL,
+  wishbone_memory_save,
+  wishbone_memory_restore,
+  EXT_MODULE_THREAD_SAFE
+};
+
+int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *))
+{
+  int ret = RC_OK;
+  ret = register_module(&ext_mod);
+  return ret;
+}
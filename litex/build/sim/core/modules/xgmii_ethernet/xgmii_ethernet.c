@@ -12,6 +12,12 @@
 #include <zlib.h>
 #include "tapcfg.h"
 #include "modules.h"
+#include "args.h"
+#include "ring.h"
+#include "pktpool.h"
+#include "pcap.h"
+#include "ethsw.h"
+#include "ethqueue.h"
 
 // ---------- SETTINGS ---------- //
 
@@ -59,6 +65,25 @@ typedef struct xgmii_bus_snapshot {
     xgmii_ctl_t ctl;
 } xgmii_bus_snapshot_t;
 
+// Packet data is moved to and from the bus a full word at a time, lane 0 being
+// the first byte of the packet (the lowest byte of the bus word)
+static inline xgmii_data_t xgmii_load_le64(const uint8_t *p) {
+    xgmii_data_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline void xgmii_store_le64(uint8_t *p, xgmii_data_t v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    memcpy(p, &v, sizeof(v));
+}
+
 #if XGMII_WIDTH == 64
     typedef uint64_t xgmii_data_signal_t;
     typedef uint8_t xgmii_ctl_signal_t;
@@ -66,6 +91,9 @@ typedef struct xgmii_bus_snapshot {
     #define XGMII_DATA_SIGNAL_MASK 0xFFFFFFFFFFFFFFFF
     #define XGMII_CTL_SIGNAL_MASK 0xFF
 
+    // Edges of the XGMII clock the module is ticked on
+    #define XGMII_CLK_EDGES CLK_EDGE_RISING
+
     // TODO: remove legacy defines
     #define DW_64
 #elif XGMII_WIDTH == 32
@@ -76,6 +104,11 @@ typedef struct xgmii_bus_snapshot {
     #define XGMII_CTL_SIGNAL_MASK 0x0F
     #define XGMII_UPPER_DATA_SHIFT 32
     #define XGMII_UPPER_CTL_SHIFT 4
+
+    // Edges of the XGMII clock the module is ticked on, the lower half of
+    // the bus word is transferred on the rising one, the upper half on the
+    // falling one
+    #define XGMII_CLK_EDGES CLK_EDGE_BOTH
 #else
 #error "Invalid XGMII data width!"
 #endif
@@ -108,14 +141,6 @@ typedef enum xgmii_tx_state {
     XGMII_TX_STATE_TRANSMIT,
 } xgmii_tx_state_t;
 
-// RX incoming (TAP -> Sim) Ethernet packet queue structs
-typedef struct eth_packet_queue {
-    // Does not contain the trailing CRC32 checksum
-    uint8_t data[ETH_LEN];
-    size_t len;
-    struct eth_packet_queue *next;
-} eth_packet_queue_t;
-
 typedef struct xgmii_state {
     // ---------- SIMULATION & BUS STATE ----------
     // XGMII bus signals
@@ -124,13 +149,10 @@ typedef struct xgmii_state {
     xgmii_data_signal_t *rx_data_signal;
     xgmii_ctl_signal_t  *rx_ctl_signal;
 
-    // RX clock signal and edge state
+    // RX and TX clock signals, the edges being detected by the core (clock
+    // domain of the module)
     uint8_t *rx_clk;
-    clk_edge_state_t rx_clk_edge;
-
-    // TX clock signal and edge state
     uint8_t *tx_clk;
-    clk_edge_state_t tx_clk_edge;
 
 #if XGMII_WIDTH == 32
     // Internal XGMII DDR transmit (Sim -> TAP) state latched from the bus on
@@ -155,30 +177,53 @@ typedef struct xgmii_state {
     // ---------- TX (Sim -> TAP) STATE ---------
     xgmii_tx_state_t tx_state;
 
-    // Packet currently being transmitted over the XGMII bus (Sim -> TAP).
-    uint8_t current_tx_pkt[ETH_LEN];
+    // Packet currently being transmitted over the XGMII bus (Sim -> TAP),
+    // taken from tx_pool and built in place.
+    struct pkt_s *current_tx_pkt;
     size_t current_tx_len;
 
     // ---------- RX (TAP -> Sim) STATE ---------
     xgmii_rx_state_t rx_state;
 
     // Packet currently being received over the XGMII bus (TAP ->
-    // Sim). Packets copied here are already removed from the TAP
-    // incoming queue. Fields are valid if current_rx_len != 0. This
-    // field includes the CRC32 checksum.
-    uint8_t current_rx_pkt[ETH_LEN + sizeof(uint32_t)];
+    // Sim), owned by the simulation until it is given back to
+    // rx_pool. Fields are valid if current_rx_len != 0. The CRC32
+    // checksum is appended in place.
+    struct pkt_s *current_rx_pkt;
     size_t current_rx_len;
     size_t current_rx_progress;
 
-    // Linked list of pending RX (TAP -> Sim) packets. tail is only
-    // valid when head != NULL.
-    eth_packet_queue_t *pending_rx_pkt_head;
-    eth_packet_queue_t *pending_rx_pkt_tail;
+    // Pending RX (TAP -> Sim) packets, filled by the I/O thread
+    pkt_pool_t rx_pool;
+    ring_t rx_ring;
     struct event *ev;
+
+    // Pending TX (Sim -> TAP) packets, drained by the I/O thread
+    pkt_pool_t tx_pool;
+    ring_t tx_ring;
+    struct event *tx_ev;
+
+    // Queue depth, backpressure and frame/drop counts
+    struct eth_queue_s q;
+
+    // ---------- OFFLINE (PCAP/SWITCH) STATE ---------
+    // Set when pcap_in and/or pcap_out are given, or with the shm backend:
+    // frames are replayed from and recorded to capture files, and exchanged
+    // with the shared memory switch, on the simulation thread, no TAP
+    // interface is used.
+    bool offline;
+    struct pcap_replay_s pcap_in;
+    pcap_t pcap_out;
+    ethsw_t sw;
+
+    // Stimulus log stream, replacing all the RX inputs when replaying
+    struct stim_stream_s *stim;
 } xgmii_ethernet_state_t;
 
 // Shared libevent state, set on module init
 static struct event_base *base = NULL;
+// Sessions created, naming their stimulus log streams
+static int nsessions = 0;
 
 /**
  * Advance the RX (TAP->Sim) state machine, producing a 64-bit bus word
@@ -219,46 +264,41 @@ static xgmii_bus_snapshot_t xgmii_ethernet_rx_adv(xgmii_ethernet_state_t *s,
         } else if (s->rx_state == XGMII_RX_STATE_RECEIVE) {
             // Reception of the packet has been initiated, transfer as much as
             // required.
-
-	    // Initialize ctl and data to zero
-	    bus.ctl = 0;
-	    bus.data = 0;
-
-            // Place the bytes one by one: either with data, end of frame
-            // delimiters or idle markers
-            for (int idx = 0; idx < sizeof(bus.data); idx++) {
-                if (s->current_rx_progress < s->current_rx_len) {
-                    // Actual data byte to transmit
-                    bus.data |=
-                        ((uint64_t)
-                         (s->current_rx_pkt[s->current_rx_progress] & 0xFF))
-                        << (idx * 8);
-                    s->current_rx_progress++;
-                } else if (s->current_rx_progress == s->current_rx_len) {
-                    // End of frame delimiter to transmit
-                    bus.data |=
-                        ((uint64_t) XGMII_CTLCHAR_END)
-                        << (idx * 8);
-                    bus.ctl  |= 1 << idx;
-
-                    // We deliberately let the progress advance beyond the
-                    // length here, to indicate that we've already transmitted
-                    // the end-of-frame buffer
-                    s->current_rx_progress++;
-
-                    // Furthermore, set the packet length to zero to mark
-                    // that a new packet can be transmitted (invalidating
-                    // the current one).
-                    s->current_rx_len = 0;
-
-                    // We return into the idle state here, there's nothing more
-                    // to send.
-                    s->rx_state = XGMII_RX_STATE_IDLE;
-                } else {
-                    // Fill the rest of this bus word with idle indicators
-                    bus.data |= ((uint64_t) XGMII_CTLCHAR_IDLE) << (idx * 8);
-                    bus.ctl  |= 1 << idx;
+            size_t remaining = s->current_rx_len - s->current_rx_progress;
+            uint8_t *data = &s->current_rx_pkt->data[s->current_rx_progress];
+
+            if (remaining >= sizeof(bus.data)) {
+                // A full bus word of payload, no control characters
+                bus.data = xgmii_load_le64(data);
+                bus.ctl  = 0;
+                s->current_rx_progress += sizeof(bus.data);
+            } else {
+                // Last bus word: the remaining payload bytes, followed by the
+                // end of frame delimiter and idle markers in the other lanes.
+                // The packet buffer has room for the word read past its end.
+                bus.data = xgmii_load_le64(data)
+                    & ((UINT64_C(1) << (remaining * 8)) - 1);
+                bus.data |= ((uint64_t) XGMII_CTLCHAR_END) << (remaining * 8);
+                if (remaining < sizeof(bus.data) - 1) {
+                    bus.data |= XGMII_IDLE_DATA << ((remaining + 1) * 8);
                 }
+                bus.ctl = XGMII_IDLE_CTL & ~((1 << remaining) - 1);
+
+                // We deliberately let the progress advance beyond the
+                // length here, to indicate that we've already transmitted
+                // the end-of-frame buffer
+                s->current_rx_progress = s->current_rx_len + 1;
+
+                // Furthermore, set the packet length to zero to mark
+                // that a new packet can be transmitted (invalidating
+                // the current one) and release its buffer.
+                s->current_rx_len = 0;
+                pkt_pool_put(&s->rx_pool, s->current_rx_pkt);
+                s->current_rx_pkt = NULL;
+
+                // We return into the idle state here, there's nothing more
+                // to send.
+                s->rx_state = XGMII_RX_STATE_IDLE;
             }
 
             // If not transitioned to IDLE state above, remain in RECEIVE
@@ -273,39 +313,39 @@ static xgmii_bus_snapshot_t xgmii_ethernet_rx_adv(xgmii_ethernet_state_t *s,
     if (!s->current_rx_len) {
         // No packet is currently in transit (or one has just completed
         // reception). Check if there is an outstanding packet from the TAP
-        // interface and copy it into the input buffer
-        if (s->pending_rx_pkt_head) {
-            eth_packet_queue_t* popped_rx_pkt;
-
-            // CRITICAL REGION {
-            // Advance the pending packets queue, removing the copied
-            // packet and freeing its allocated memory.
-            popped_rx_pkt = s->pending_rx_pkt_head;
-            s->pending_rx_pkt_head = s->pending_rx_pkt_head->next;
-            // } CRITICAL REGION
-
-            // Determine the maximum length to copy. We must not copy
-            // beyond the length of s->current_rx_pkt and need to
-            // reserve at least 4 bytes for the CRC32 to be appended.
-            size_t copy_len =
-                (popped_rx_pkt->len
-                 <= sizeof(s->current_rx_pkt) - sizeof(uint32_t))
-                  ? popped_rx_pkt->len
-                  : sizeof(s->current_rx_pkt) - sizeof(uint32_t);
-
-            // Copy the packet into the buffer
-            memcpy(s->current_rx_pkt, popped_rx_pkt->data, copy_len);
-
-            // Calculate the CRC32 checksum and append it to the
-            // packet data. This uses the original packet's length. If
-            // the original packet didn't fit into the buffer, the CRC
-            // is going to be wrong and thus the packet being cut off
-            // can be detected.
-            uint32_t crc = crc32(0, popped_rx_pkt->data, popped_rx_pkt->len);
-            s->current_rx_pkt[copy_len + 0] = (crc >> 24) & 0xFF;
-            s->current_rx_pkt[copy_len + 1] = (crc >> 16) & 0xFF;
-            s->current_rx_pkt[copy_len + 2] = (crc >>  8) & 0xFF;
-            s->current_rx_pkt[copy_len + 3] = (crc >>  0) & 0xFF;
+        // interface and take it over
+        struct pkt_s *popped_rx_pkt;
+
+        // Offline, the packets received from the switch and the replayed
+        // packets due by now are queued first
+        if (eth_queue_stim_replaying(s->stim)) {
+            eth_queue_stim_poll(s->stim, &s->rx_pool, &s->rx_ring, ETH_LEN,
+                                time_ps);
+        } else {
+            if (s->sw.shm) {
+                ethsw_poll(&s->sw, &s->rx_pool, &s->rx_ring, ETH_LEN,
+                           MIN_ETH_LEN);
+            }
+            if (s->offline) {
+                pcap_replay_poll(&s->pcap_in, &s->rx_pool, &s->rx_ring,
+                                 ETH_LEN, MIN_ETH_LEN, time_ps);
+            }
+        }
+
+        // Pop the oldest packet handed over by the I/O thread. The ring is
+        // lock-free, this is the only consumer.
+        if (ring_pop(&s->rx_ring, &popped_rx_pkt, 1)) {
+            eth_queue_rx(&s->q, popped_rx_pkt->len);
+            eth_queue_stim_record(s->stim, popped_rx_pkt, time_ps);
+            // Packets are read with at most ETH_LEN bytes, leaving room for
+            // the CRC32 checksum appended to the packet data in place
+            size_t copy_len = popped_rx_pkt->len;
+            uint32_t crc = crc32(0, popped_rx_pkt->data, copy_len);
+            popped_rx_pkt->data[copy_len + 0] = (crc >> 24) & 0xFF;
+            popped_rx_pkt->data[copy_len + 1] = (crc >> 16) & 0xFF;
+            popped_rx_pkt->data[copy_len + 2] = (crc >>  8) & 0xFF;
+            popped_rx_pkt->data[copy_len + 3] = (crc >>  0) & 0xFF;
+            s->current_rx_pkt = popped_rx_pkt;
 
 #ifdef XGMII_RX_DEBUG
             fprintf(stderr, "\n----------------------------------\n"
@@ -325,15 +365,58 @@ static xgmii_bus_snapshot_t xgmii_ethernet_rx_adv(xgmii_ethernet_state_t *s,
             // indicate that a packet is ready to be transmitted over
             // the XGMII interface
             s->current_rx_len = copy_len + sizeof(uint32_t);
-
-            // Release the packet data memory
-            free(popped_rx_pkt);
         }
     }
 
     return bus;
 }
 
+/**
+ * Queue the transmitted (Sim -> TAP) packet for the I/O thread
+ *
+ * The packet buffer itself is handed over, a new one is taken from the pool on
+ * the next transmission. The actual TAP write happens in tx_handler() on the
+ * I/O thread, keeping syscalls out of the simulation loop. Offline, the packet
+ * is recorded right away, timestamped with the simulation time.
+ */
+static void xgmii_ethernet_tx_push(xgmii_ethernet_state_t *s, size_t len, uint64_t time_ps) {
+    eth_queue_tx(&s->q, len);
+    if (s->offline) {
+        if (s->pcap_out.f
+            && pcap_write(&s->pcap_out, s->current_tx_pkt->data, len, time_ps)) {
+            fprintf(stderr, "[xgmii_ethernet]: capture write error\n");
+        }
+        if (s->sw.shm) {
+            ethsw_send(&s->sw, s->current_tx_pkt->data, len);
+        }
+        pkt_pool_put(&s->tx_pool, s->current_tx_pkt);
+        s->current_tx_pkt = NULL;
+        return;
+    }
+    s->current_tx_pkt->len = len;
+    ring_push(&s->tx_ring, &s->current_tx_pkt, 1);
+    s->current_tx_pkt = NULL;
+}
+
+/**
+ * Take a buffer for a new transmitted (Sim -> TAP) packet
+ *
+ * The buffer of an aborted transmission is reused. Returns false when all
+ * buffers are still queued for the I/O thread.
+ */
+static bool xgmii_ethernet_tx_get(xgmii_ethernet_state_t *s) {
+    if (!s->current_tx_pkt) {
+        s->current_tx_pkt = pkt_pool_get(&s->tx_pool);
+    }
+    if (!s->current_tx_pkt) {
+        if (s->q.tx_dropped++ == 0) {
+            fprintf(stderr, "[xgmii_ethernet]: TX queue full, dropping packets\n");
+        }
+        return false;
+    }
+    return true;
+}
+
 /**
  * Advance the TX (Sim -> TAP) state machine based on a 64-bit bus word
  *
@@ -366,8 +449,11 @@ static void xgmii_ethernet_tx_adv(xgmii_ethernet_state_t *s, uint64_t time_ps,
                 // Reset the current progress
                 s->current_tx_len = 0;
 
-                // Switch to the TRANSMIT state
-                s->tx_state = XGMII_TX_STATE_TRANSMIT;
+                // Switch to the TRANSMIT state, unless there is no buffer
+                // left to receive the frame into
+                if (xgmii_ethernet_tx_get(s)) {
+                    s->tx_state = XGMII_TX_STATE_TRANSMIT;
+                }
             } else {
                 fprintf(stderr, "[xgmii_ethernet]: got XGMII start character, "
                         "but either Ethernet preamble or start of frame "
@@ -392,6 +478,13 @@ static void xgmii_ethernet_tx_adv(xgmii_ethernet_state_t *s, uint64_t time_ps,
             }
 #endif
         }
+    } else if (s->tx_state == XGMII_TX_STATE_TRANSMIT
+               && bus.ctl == 0
+               && s->current_tx_len + sizeof(xgmii_data_t) <= ETH_LEN) {
+        // A full bus word of payload, which is the common case while inside
+        // a frame: store it at once
+        xgmii_store_le64(&s->current_tx_pkt->data[s->current_tx_len], bus.data);
+        s->current_tx_len += sizeof(xgmii_data_t);
     } else if (s->tx_state == XGMII_TX_STATE_TRANSMIT) {
         // Iterate over all bytes until we hit an XGMII end of frame control
         // character
@@ -403,8 +496,8 @@ static void xgmii_ethernet_tx_adv(xgmii_ethernet_state_t *s, uint64_t time_ps,
             if ((bus.ctl & (1 << idx)) == 0) {
                 // We are reading a data character. If ETH_LEN is reached, drop
                 // other bytes and issue a warning once.
-                if (s->current_tx_len <= ETH_LEN) {
-                    s->current_tx_pkt[s->current_tx_len++] =
+                if (s->current_tx_len < ETH_LEN) {
+                    s->current_tx_pkt->data[s->current_tx_len++] =
                         (uint8_t) (bus.data >> (idx * 8) & 0xFF);
                 } else if (!drop_warning_issued) {
                     drop_warning_issued = true;
@@ -461,7 +554,7 @@ static void xgmii_ethernet_tx_adv(xgmii_ethernet_state_t *s, uint64_t time_ps,
             fprintf(stderr, "\n----------------------------------\n"
                     "Transmitted packet with %ld bytes\n", pkt_len);
             for (size_t i = 0; i < pkt_len; i++) {
-                fprintf(stderr, "%02x", s->current_tx_pkt[i] & 0xff);
+                fprintf(stderr, "%02x", s->current_tx_pkt->data[i] & 0xff);
                 if (i != 0 && (i + 1) % 16 == 0) {
                     fprintf(stderr, "\n");
                 } else if (i != 0 && (i + 1) % 8 == 0) {
@@ -475,106 +568,74 @@ static void xgmii_ethernet_tx_adv(xgmii_ethernet_state_t *s, uint64_t time_ps,
 		fprintf(stderr, "[xgmii_ethernet]: TX packet too short to contain "
 			"frame check sequence\n");
 	    } else {
-		uint32_t crc = crc32(0, s->current_tx_pkt, pkt_len);
-		if (!((s->current_tx_pkt[pkt_len + 0] == ((crc >>  0) & 0xFF))
-		      && (s->current_tx_pkt[pkt_len + 1] == ((crc >>  8) & 0xFF))
-		      && (s->current_tx_pkt[pkt_len + 2] == ((crc >> 16) & 0xFF))
-		      && (s->current_tx_pkt[pkt_len + 3] == ((crc >> 24) & 0xFF))))
+		uint32_t crc = crc32(0, s->current_tx_pkt->data, pkt_len);
+		if (!((s->current_tx_pkt->data[pkt_len + 0] == ((crc >>  0) & 0xFF))
+		      && (s->current_tx_pkt->data[pkt_len + 1] == ((crc >>  8) & 0xFF))
+		      && (s->current_tx_pkt->data[pkt_len + 2] == ((crc >> 16) & 0xFF))
+		      && (s->current_tx_pkt->data[pkt_len + 3] == ((crc >> 24) & 0xFF))))
 		    {
 			fprintf(stderr, "[xgmii_ethernet]: TX packet FCS mismatch. "
 				"Expected: %08x. Actual: %08x.\n", crc,
-				(uint32_t) s->current_tx_pkt[pkt_len + 0] << 0
-				| (uint32_t) s->current_tx_pkt[pkt_len + 1] << 8
-				| (uint32_t) s->current_tx_pkt[pkt_len + 2] << 16
-				| (uint32_t) s->current_tx_pkt[pkt_len + 3] << 24);
+				(uint32_t) s->current_tx_pkt->data[pkt_len + 0] << 0
+				| (uint32_t) s->current_tx_pkt->data[pkt_len + 1] << 8
+				| (uint32_t) s->current_tx_pkt->data[pkt_len + 2] << 16
+				| (uint32_t) s->current_tx_pkt->data[pkt_len + 3] << 24);
 		    }
 	    }
 
 
             // Packet read completely, place it on the TAP interface
-            tapcfg_write(s->tapcfg, s->current_tx_pkt, s->current_tx_len);
+            xgmii_ethernet_tx_push(s, s->current_tx_len, time_ps);
             s->tx_state = XGMII_TX_STATE_IDLE;
         }
     }
 }
 
+// Ticked by the core on the XGMII_CLK_EDGES edges of the XGMII clock only (see
+// xgmii_ethernet_clock_domain()), the RX and TX buses sharing that clock: the
+// level of the clock tells the edge, without any edge detection here.
 static int xgmii_ethernet_tick(void *state, uint64_t time_ps) {
     xgmii_ethernet_state_t *s = (xgmii_ethernet_state_t*) state;
 
-    // ---------- TX BUS (Sim -> TAP) ----------
-
-    // Determine the current TX clock edge. Depending on the XGMII_WIDTH, we
-    // must act on both the rising and falling clock edge.
-    clk_edge_t tx_edge = clk_edge(&s->tx_clk_edge, *s->tx_clk);
-
 #if XGMII_WIDTH == 64
-    // 64-bit bus. Sample the entire data on the rising clock edge and process
-    // accordingly.
-    if (tx_edge == CLK_EDGE_RISING) {
-        xgmii_bus_snapshot_t tx_bus = {
-            .data = *s->tx_data_signal,
-            .ctl = *s->tx_ctl_signal,
-        };
-
-        xgmii_ethernet_tx_adv(s, time_ps, tx_bus);
-    }
+    // 64-bit bus. Sample the entire TX word, then advance the RX state and
+    // place the new contents on the RX bus.
+    xgmii_bus_snapshot_t tx_bus = {
+        .data = *s->tx_data_signal,
+        .ctl = *s->tx_ctl_signal,
+    };
+    xgmii_ethernet_tx_adv(s, time_ps, tx_bus);
+
+    xgmii_bus_snapshot_t rx_bus = xgmii_ethernet_rx_adv(s, time_ps);
+    *s->rx_data_signal = rx_bus.data;
+    *s->rx_ctl_signal = rx_bus.ctl;
 #elif XGMII_WIDTH == 32
-    // 32-bit bus. Sample the lower half of the data on the rising clock edge.
-    if (tx_edge == CLK_EDGE_RISING) {
+    if (*s->rx_clk) {
+        // Rising edge: latch the lower half of the TX word, advance the RX
+        // state, place the lower half of the RX word on the bus and keep the
+        // upper half for the falling edge.
         s->tx_data_posedge = *s->tx_data_signal;
         s->tx_ctl_posedge = *s->tx_ctl_signal;
-    }
 
-    // Sample the higher half of the data on the falling clock edge and process
-    // the joint data from the rising and falling edges.
-    if (tx_edge == CLK_EDGE_FALLING) {
+        xgmii_bus_snapshot_t rx_bus = xgmii_ethernet_rx_adv(s, time_ps);
+        *s->rx_data_signal = (xgmii_data_signal_t) rx_bus.data;
+        *s->rx_ctl_signal = rx_bus.ctl & XGMII_CTL_SIGNAL_MASK;
+        s->rx_data_negedge = (xgmii_data_signal_t)
+            (rx_bus.data >> XGMII_UPPER_DATA_SHIFT);
+        s->rx_ctl_negedge = rx_bus.ctl >> XGMII_UPPER_CTL_SHIFT;
+    } else {
+        // Falling edge: process the TX word joined with the upper half, and
+        // place the upper half of the RX word on the bus.
         xgmii_bus_snapshot_t tx_bus = {
             .data =
                 (xgmii_data_t) (*s->tx_data_signal) << XGMII_UPPER_DATA_SHIFT
                 | (xgmii_data_t) s->tx_data_posedge,
             .ctl =
-                (xgmii_ctl_t) (*s->tx_ctl_signal) << XGMII_UPPER_CTL_SHIFT
-                | (xgmii_ctl_t) s->tx_ctl_posedge,
+                (xgmii_ctl_t) ((*s->tx_ctl_signal) << XGMII_UPPER_CTL_SHIFT)
+                | s->tx_ctl_posedge,
         };
-
         xgmii_ethernet_tx_adv(s, time_ps, tx_bus);
-    }
-#endif
-
-    // ---------- RX BUS (TAP -> Sim) ----------
-
-    // Determine the current RX clock edge. Depending on the XGMII_WIDTH, we
-    // must act on both the rising and falling clock edge.
-    clk_edge_t rx_edge = clk_edge(&s->rx_clk_edge, *s->rx_clk);
 
-    if (rx_edge == CLK_EDGE_RISING) {
-        // Positive clock edge, advance the RX state and place new contents on
-        // the XGMII RX bus.
-        xgmii_bus_snapshot_t rx_bus = xgmii_ethernet_rx_adv(s, time_ps);
-
-#if XGMII_WIDTH == 64
-        // 64-bit wide bus. We can transmit everything on the positive clock
-        // edge.
-        *s->rx_data_signal = rx_bus.data;
-        *s->rx_ctl_signal = rx_bus.ctl;
-#elif XGMII_WIDTH == 32
-        // 32-bit wide bus. We must transmit the lower half of bits on the
-        // positive, and the upper half of bits on the negative clock edge.
-        *s->rx_data_signal = (xgmii_data_signal_t)
-            rx_bus.data & XGMII_DATA_SIGNAL_MASK;
-        *s->rx_ctl_signal = (xgmii_ctl_signal_t)
-            rx_bus.ctl & XGMII_CTL_SIGNAL_MASK;
-        s->rx_data_negedge = (xgmii_data_signal_t)
-            ((rx_bus.data >> XGMII_UPPER_DATA_SHIFT) & XGMII_DATA_SIGNAL_MASK);
-        s->rx_ctl_negedge = (xgmii_ctl_signal_t)
-            ((rx_bus.ctl >> XGMII_UPPER_CTL_SHIFT) & XGMII_CTL_SIGNAL_MASK);
-#endif
-    }
-
-#if XGMII_WIDTH == 32
-    if (rx_edge == CLK_EDGE_FALLING) {
-        // 32-bit wide bus and negative clock edge. Transmit the data prepared
-        // on the previous positive clock edge.
         *s->rx_data_signal = s->rx_data_negedge;
         *s->rx_ctl_signal = s->rx_ctl_negedge;
     }
@@ -583,65 +644,13 @@ static int xgmii_ethernet_tick(void *state, uint64_t time_ps) {
     return RC_OK;
 }
 
-int litex_sim_module_get_args(char *args, char *arg, char **val) {
-    int ret = RC_OK;
-    json_object *jsobj = NULL;
-    json_object *obj = NULL;
-    char *value = NULL;
-    int r;
-
-    jsobj = json_tokener_parse(args);
-    if (NULL == jsobj) {
-        fprintf(stderr, "[xgmii_ethernet]: error parsing json arg: %s\n", args);
-        ret = RC_JSERROR;
-        goto out;
-    }
-
-    if (!json_object_is_type(jsobj, json_type_object)) {
-        fprintf(stderr, "[xgmii_ethernet]: arg must be type object!: %s\n",
-                args);
-        ret = RC_JSERROR;
-        goto out;
-    }
-
-    obj = NULL;
-    r = json_object_object_get_ex(jsobj, arg, &obj);
-    if (!r) {
-        fprintf(stderr, "[xgmii_ethernet]: could not find object: \"%s\" "
-                "(%s)\n", arg, args);
-        ret = RC_JSERROR;
-        goto out;
-    }
-    value = strdup(json_object_get_string(obj));
-
- out:
-    *val = value;
-    return ret;
-}
-
-static int litex_sim_module_pads_get(struct pad_s *pads, char *name,
-                                     void **signal) {
-    int ret = RC_OK;
-    void *sig = NULL;
-    int i;
-
-    if (!pads || !name || !signal) {
-        ret=RC_INVARG;
-        goto out;
-    }
-
-    i = 0;
-    while (pads[i].name) {
-        if (!strcmp(pads[i].name, name)) {
-            sig=(void*)pads[i].signal;
-            break;
-        }
-        i++;
-    }
+static int xgmii_ethernet_clock_domain(void *state, char **clk,
+                                       clk_edge_t *edge) {
+    xgmii_ethernet_state_t *s = (xgmii_ethernet_state_t*) state;
 
- out:
-    *signal=sig;
-    return ret;
+    *clk = (char *) s->rx_clk;
+    *edge = XGMII_CLK_EDGES;
+    return RC_OK;
 }
 
 void event_handler(int tap_fd, short event, void *arg) {
@@ -649,8 +658,22 @@ void event_handler(int tap_fd, short event, void *arg) {
 
     // Expect a new TAP packet if the socket has become readable
     if (event & EV_READ) {
-        eth_packet_queue_t *rx_pkt =
-            malloc(sizeof(eth_packet_queue_t));
+        struct pkt_s *rx_pkt = pkt_pool_get(&s->rx_pool);
+        uint8_t drop[ETH_LEN];
+
+        if (!rx_pkt) {
+            // All buffers are queued or in use by the simulation: leave the
+            // frames to the host with backpressure, drain the TAP interface
+            // (tail drop) otherwise.
+            if (eth_queue_rx_full(&s->q, s->ev)) {
+                return;
+            }
+            if (s->q.rx_dropped == 1) {
+                fprintf(stderr, "[xgmii_ethernet]: RX queue full, dropping packets\n");
+            }
+            tapcfg_read(s->tapcfg, drop, ETH_LEN);
+            return;
+        }
 
         // Read the TAP packet into the buffer, extending its length
         // to the minimum required Ethernet frame length if necessary.
@@ -659,7 +682,7 @@ void event_handler(int tap_fd, short event, void *arg) {
             // An error occured while reading from the TAP interface,
             // report, free the packet and abort.
             fprintf(stderr, "[xgmii_ethernet]: TAP read error %d\n", read_len);
-            free(rx_pkt);
+            pkt_pool_put(&s->rx_pool, rx_pkt);
             return;
         } else if (read_len < MIN_ETH_LEN) {
             // To avoid leaking any data, set the packet's contents
@@ -672,44 +695,50 @@ void event_handler(int tap_fd, short event, void *arg) {
             rx_pkt->len = read_len;
         }
 
-        // Packet is inserted into the back of the queue, thus no next
-        // packet.
-        rx_pkt->next = NULL;
+        // Hand the received packet over to the simulation thread. This is
+        // the only producer of the ring, which can hold the whole pool.
+        ring_push(&s->rx_ring, &rx_pkt, 1);
+    }
+}
 
-        // CRITICAL REGION {
-        // Append the received packet to the packet queue
-        if (!s->pending_rx_pkt_head) {
-            s->pending_rx_pkt_head = rx_pkt;
-            s->pending_rx_pkt_tail = rx_pkt;
-        } else {
-            s->pending_rx_pkt_tail->next = rx_pkt;
-            s->pending_rx_pkt_tail = rx_pkt;
-        }
-        // } CRITICAL REGION
+void tx_handler(int fd, short event, void *arg) {
+    xgmii_ethernet_state_t *s = arg;
+    struct pkt_s *tx_pkt;
+
+    // Write out all packets transmitted by the simulation since the last call
+    // and give their buffers back to the simulation
+    while (ring_pop(&s->tx_ring, &tx_pkt, 1)) {
+        tapcfg_write(s->tapcfg, tx_pkt->data, tx_pkt->len);
+        pkt_pool_put(&s->tx_pool, tx_pkt);
     }
+
+    // RX buffers were freed by the simulation since TAP reads were paused
+    eth_queue_rx_resume(&s->q, &s->rx_pool, s->ev);
 }
 
 static int xgmii_ethernet_add_pads(void *state, struct pad_list_s *plist) {
     int ret = RC_OK;
     xgmii_ethernet_state_t *s = (xgmii_ethernet_state_t*) state;
-    struct pad_s *pads;
     if (!state || !plist) {
         ret = RC_INVARG;
         goto out;
     }
-    pads = plist->pads;
     if (!strcmp(plist->name, "xgmii_eth")) {
-        litex_sim_module_pads_get(pads, "rx_data", (void**) &s->rx_data_signal);
-        litex_sim_module_pads_get(pads, "rx_ctl", (void**) &s->rx_ctl_signal);
-        litex_sim_module_pads_get(pads, "tx_data", (void**) &s->tx_data_signal);
-        litex_sim_module_pads_get(pads, "tx_ctl", (void**) &s->tx_ctl_signal);
+        struct pad_bind_s binds[] = {
+            PAD_BIND("rx_data", &s->rx_data_signal),
+            PAD_BIND("rx_ctl", &s->rx_ctl_signal),
+            PAD_BIND("tx_data", &s->tx_data_signal),
+            PAD_BIND("tx_ctl", &s->tx_ctl_signal),
+            PAD_BIND_END
+        };
+        litex_sim_pads_bind(plist, binds);
     }
 
     if (!strcmp(plist->name, "sys_clk")) {
         // TODO: currently the single sys_clk signal is used for both the RX and
         // TX XGMII clock signals. This should be changed. Also, using sys_clk
         // does not make sense for the 32-bit DDR bus.
-        litex_sim_module_pads_get(pads, "sys_clk", (void**)&s->rx_clk);
+        litex_sim_pads_bind(plist, (struct pad_bind_s[]) { PAD_BIND("sys_clk", &s->rx_clk), PAD_BIND_END });
         s->tx_clk = s->rx_clk;
     }
 
@@ -723,30 +752,118 @@ static int xgmii_ethernet_start(void *b) {
   return RC_OK;
 }
 
+/**
+ * Open the optional pcap_in/pcap_out capture files, switching to offline mode
+ *
+ * The pacing argument selects how pcap_in is replayed: "timestamp" (default)
+ * queues packets at their capture time relative to the first one, "fast" as
+ * soon as a buffer is free.
+ */
+static int xgmii_ethernet_open_pcap(xgmii_ethernet_state_t *s, json_object *args) {
+    const char *pcap_in = litex_sim_args_opt_string(args, "pcap_in", NULL);
+    const char *pcap_out = litex_sim_args_opt_string(args, "pcap_out", NULL);
+    const char *pacing = litex_sim_args_opt_string(args, "pacing", "timestamp");
+
+    if (pcap_in) {
+        if (pcap_open_read(&s->pcap_in.pcap, pcap_in)) {
+            fprintf(stderr, "[xgmii_ethernet]: can't read capture %s\n", pcap_in);
+            return RC_ERROR;
+        }
+        s->offline = true;
+    }
+    if (pcap_out) {
+        if (pcap_open_write(&s->pcap_out, pcap_out, ETH_LEN)) {
+            fprintf(stderr, "[xgmii_ethernet]: can't write capture %s\n", pcap_out);
+            return RC_ERROR;
+        }
+        s->offline = true;
+    }
+    s->pcap_in.fast = !strcmp(pacing, "fast");
+    return RC_OK;
+}
+
+/**
+ * Attach to a shared memory switch, switching to offline mode
+ *
+ * Backend "shm" connects to the switch named by the switch argument (default
+ * "litex") instead of a TAP interface, see ethsw.h. Backend "tap" (default)
+ * leaves the TAP interface in use.
+ */
+static int xgmii_ethernet_open_switch(xgmii_ethernet_state_t *s, json_object *args) {
+    const char *backend = litex_sim_args_opt_string(args, "backend", "tap");
+    const char *name = litex_sim_args_opt_string(args, "switch", "litex");
+    int port;
+
+    if (!strcmp(backend, "tap")) {
+        return RC_OK;
+    }
+    if (strcmp(backend, "shm")) {
+        fprintf(stderr, "[xgmii_ethernet]: unknown backend %s\n", backend);
+        return RC_ERROR;
+    }
+    port = ethsw_open(&s->sw, name);
+    if (port < 0) {
+        fprintf(stderr, "[xgmii_ethernet]: can't attach to switch %s\n", name);
+        return RC_ERROR;
+    }
+    printf("[xgmii_ethernet] switch %s, port %d\n", name, port);
+    s->offline = true;
+    return RC_OK;
+}
+
 static int xgmii_ethernet_new(void **state, char *args) {
     int ret = RC_OK;
     char *c_tap = NULL;
     char *c_tap_ip = NULL;
+    json_object *jargs = NULL;
     xgmii_ethernet_state_t *s = NULL;
     struct timeval tv = {10, 0};
+    struct timeval tx_tv = {0, 1000};
 
     if (!state) {
         ret = RC_INVARG;
         goto out;
     }
 
+    jargs = litex_sim_args_parse("xgmii_ethernet", args);
+    if (!jargs) {
+        ret = RC_JSERROR;
+        goto out;
+    }
+
     s = (xgmii_ethernet_state_t*)malloc(sizeof(xgmii_ethernet_state_t));
     if (!s) {
         ret = RC_NOENMEM;
         goto out;
     }
     memset(s, 0, sizeof(xgmii_ethernet_state_t));
+    eth_queue_args(&s->q, jargs);
+    if (pkt_pool_init(&s->rx_pool, s->q.depth,
+                      ETH_LEN + sizeof(uint32_t) + sizeof(xgmii_data_t))
+        || pkt_pool_init(&s->tx_pool, s->q.depth, ETH_LEN)
+        || ring_init(&s->rx_ring, s->q.depth, sizeof(struct pkt_s *))
+        || ring_init(&s->tx_ring, s->q.depth, sizeof(struct pkt_s *))) {
+        ret = RC_NOENMEM;
+        goto out;
+    }
 
-    ret = litex_sim_module_get_args(args, "interface", &c_tap);
+    ret = xgmii_ethernet_open_pcap(s, jargs);
+    if (ret == RC_OK) {
+        ret = xgmii_ethernet_open_switch(s, jargs);
+    }
+    s->stim = eth_queue_stim_open("xgmii_ethernet", nsessions++);
+    if (eth_queue_stim_replaying(s->stim)) {
+        s->offline = true;
+    }
+    if (ret != RC_OK || s->offline) {
+        goto out;
+    }
+
+    ret = litex_sim_args_get_string(jargs, "interface", &c_tap);
     if (ret != RC_OK) {
         goto out;
     }
-    ret = litex_sim_module_get_args(args, "ip", &c_tap_ip);
+    ret = litex_sim_args_get_string(jargs, "ip", &c_tap_ip);
     if (ret != RC_OK) {
         goto out;
     }
@@ -762,19 +879,138 @@ static int xgmii_ethernet_new(void **state, char *args) {
 
     s->ev = event_new(base, s->tap_fd, EV_READ | EV_PERSIST, event_handler, s);
     event_add(s->ev, &tv);
+    s->tx_ev = event_new(base, -1, EV_PERSIST, tx_handler, s);
+    event_add(s->tx_ev, &tx_tv);
 
 out:
+    litex_sim_args_free(jargs);
     *state = (void*) s;
     return ret;
 }
 
+static int xgmii_ethernet_close(void *state) {
+    xgmii_ethernet_state_t *s = (xgmii_ethernet_state_t*) state;
+
+    eth_queue_print("xgmii_ethernet", &s->q);
+    pcap_close(&s->pcap_in.pcap);
+    pcap_close(&s->pcap_out);
+    ethsw_close(&s->sw);
+    return RC_OK;
+}
+
+static int xgmii_ethernet_io_pending(void *state) {
+    xgmii_ethernet_state_t *s = (xgmii_ethernet_state_t*) state;
+
+    // Frames sent by the other switch ports are waiting
+    if (s->sw.shm && ethsw_pending(&s->sw)) {
+        return 1;
+    }
+
+    // Nothing comes from the host while replaying captures
+    if (s->offline && !s->sw.shm) {
+        return 0;
+    }
+
+    // Received packets are still queued or being fed into the simulation
+    return ring_count(&s->rx_ring) != 0 || s->current_rx_len != 0;
+}
+
+// Write/read a single state field, bailing out on I/O errors
+#define XGMII_CKPT_FIELD(op, f, field)                                  \
+    do {                                                                \
+        if (op(&(field), sizeof(field), 1, f) != 1) {                   \
+            return RC_ERROR;                                            \
+        }                                                               \
+    } while (0)
+
+#define XGMII_CKPT_DATA(op, f, data, len)                               \
+    do {                                                                \
+        if (op((data), 1, (len), f) != (len)) {                         \
+            return RC_ERROR;                                            \
+        }                                                               \
+    } while (0)
+
+static int xgmii_ethernet_save(void *state, FILE *f) {
+    xgmii_ethernet_state_t *s = (xgmii_ethernet_state_t*) state;
+
+    // Only the bus and state machine state is saved. Packets in flight
+    // between the TAP interface and the I/O thread are not part of the
+    // simulation and are lost.
+#if XGMII_WIDTH == 32
+    XGMII_CKPT_FIELD(fwrite, f, s->tx_data_posedge);
+    XGMII_CKPT_FIELD(fwrite, f, s->tx_ctl_posedge);
+    XGMII_CKPT_FIELD(fwrite, f, s->rx_data_negedge);
+    XGMII_CKPT_FIELD(fwrite, f, s->rx_ctl_negedge);
+#endif
+    XGMII_CKPT_FIELD(fwrite, f, s->tx_state);
+    XGMII_CKPT_FIELD(fwrite, f, s->current_tx_len);
+    if (s->tx_state == XGMII_TX_STATE_TRANSMIT) {
+        XGMII_CKPT_DATA(fwrite, f, s->current_tx_pkt->data,
+                        s->current_tx_len);
+    }
+    XGMII_CKPT_FIELD(fwrite, f, s->rx_state);
+    XGMII_CKPT_FIELD(fwrite, f, s->current_rx_len);
+    XGMII_CKPT_FIELD(fwrite, f, s->current_rx_progress);
+    if (s->current_rx_len) {
+        XGMII_CKPT_DATA(fwrite, f, s->current_rx_pkt->data,
+                        s->current_rx_len);
+    }
+
+    return RC_OK;
+}
+
+static int xgmii_ethernet_restore(void *state, FILE *f) {
+    xgmii_ethernet_state_t *s = (xgmii_ethernet_state_t*) state;
+
+#if XGMII_WIDTH == 32
+    XGMII_CKPT_FIELD(fread, f, s->tx_data_posedge);
+    XGMII_CKPT_FIELD(fread, f, s->tx_ctl_posedge);
+    XGMII_CKPT_FIELD(fread, f, s->rx_data_negedge);
+    XGMII_CKPT_FIELD(fread, f, s->rx_ctl_negedge);
+#endif
+    XGMII_CKPT_FIELD(fread, f, s->tx_state);
+    XGMII_CKPT_FIELD(fread, f, s->current_tx_len);
+    if (s->tx_state == XGMII_TX_STATE_TRANSMIT) {
+        if (!xgmii_ethernet_tx_get(s) || s->current_tx_len > ETH_LEN) {
+            return RC_ERROR;
+        }
+        XGMII_CKPT_DATA(fread, f, s->current_tx_pkt->data,
+                        s->current_tx_len);
+    }
+    XGMII_CKPT_FIELD(fread, f, s->rx_state);
+    XGMII_CKPT_FIELD(fread, f, s->current_rx_len);
+    XGMII_CKPT_FIELD(fread, f, s->current_rx_progress);
+    if (s->current_rx_len) {
+        if (!s->current_rx_pkt) {
+            s->current_rx_pkt = pkt_pool_get(&s->rx_pool);
+        }
+        if (!s->current_rx_pkt
+            || s->current_rx_len > ETH_LEN + sizeof(uint32_t)) {
+            return RC_ERROR;
+        }
+        XGMII_CKPT_DATA(fread, f, s->current_rx_pkt->data,
+                        s->current_rx_len);
+    } else if (s->current_rx_pkt) {
+        pkt_pool_put(&s->rx_pool, s->current_rx_pkt);
+        s->current_rx_pkt = NULL;
+    }
+
+    return RC_OK;
+}
+
 static struct ext_module_s ext_mod = {
     "xgmii_ethernet",
     xgmii_ethernet_start,
     xgmii_ethernet_new,
     xgmii_ethernet_add_pads,
+    xgmii_ethernet_close,
+    xgmii_ethernet_tick,
+    xgmii_ethernet_clock_domain,
     NULL,
-    xgmii_ethernet_tick
+    xgmii_ethernet_io_pending,
+    xgmii_ethernet_save,
+    xgmii_ethernet_restore,
+    EXT_MODULE_THREAD_SAFE
 };
 
 int litex_sim_ext_module_init(int (*register_module)(struct ext_module_s *)) {
@@ -8,11 +8,48 @@
 
 static struct pad_list_s *padlist=NULL;
 
+/* Interface registry, hashed on (name, index) */
+#define PADS_BUCKETS 256
+static struct pad_list_s *padhash[PADS_BUCKETS];
+
+/* Packed signals of all the interfaces, in block order */
+static struct pad_sync_s *pad_syncs;
+static size_t pad_nsyncs;
+
+static int litex_sim_pads_index(struct pad_list_s *pl)
+{
+  struct pad_s *p;
+  uint32_t n = 0;
+  uint32_t size = 4;
+  uint32_t i;
+
+  for(p = pl->pads; p->name; p++)
+    n++;
+  /* Keep the table at most half full */
+  while(size < 2 * n)
+    size <<= 1;
+
+  pl->table = (struct pad_s **)calloc(size, sizeof(struct pad_s *));
+  if(NULL == pl->table)
+  {
+    return RC_NOENMEM;
+  }
+  pl->mask = size - 1;
+
+  for(p = pl->pads; p->name; p++)
+  {
+    for(i = litex_sim_pads_hash(p->name, 0) & pl->mask; pl->table[i]; i = (i + 1) & pl->mask);
+    pl->table[i] = p;
+  }
+  return RC_OK;
+}
+
 int litex_sim_register_pads(struct pad_s *pads, char *interface_name, int index)
 {
   int ret = RC_OK;
 
   struct pad_list_s *pl=NULL;
+  struct pad_list_s **bucket;
   if(!pads || !interface_name)
   {
     ret = RC_INVARG;
@@ -33,14 +70,112 @@ int litex_sim_register_pads(struct pad_s *pads, char *interface_name, int index)
   pl->index = index; /* Do we really need it ?*/
   pl->name = strdup(interface_name);
   pl->pads = pads;
+  if(NULL == pl->name || RC_OK != litex_sim_pads_index(pl))
+  {
+    ret = RC_NOENMEM;
+    eprintf("Not enough mem\n");
+    goto out;
+  }
 
   pl->next = padlist;
   padlist = pl;
+  bucket = &padhash[litex_sim_pads_hash(interface_name, index) % PADS_BUCKETS];
+  pl->hnext = *bucket;
+  *bucket = pl;
 
 out:
   return ret;
 }
 
+/* Largest power of two dividing size, up to 8: the alignment of the Verilator
+ * port types (CData to QData, VlWide arrays of 32-bit words) */
+static size_t litex_sim_pads_align(size_t size)
+{
+  size_t align = 8;
+
+  while(size % align)
+    align >>= 1;
+  return align;
+}
+
+/*
+ * Moves the signals of pads (their model address, sizes[i] bytes) to a
+ * packed block: the most aligned ones first so that no padding is needed,
+ * the block starting on a cache line. Module ticks then touch a few lines
+ * instead of the scattered model ports, at the cost of the copies of
+ * litex_sim_pads_sync_in()/out() around each eval.
+ */
+int litex_sim_pads_pack(struct pad_s *pads, const size_t *sizes)
+{
+  struct pad_sync_s *syncs;
+  uint8_t *block;
+  size_t n, len = 0, off = 0;
+  size_t align, i;
+
+  for(n = 0; pads[n].name; n++)
+    len += sizes[n];
+  if(!n)
+    return RC_OK;
+
+  block = (uint8_t *)aligned_alloc(64, (len + 63) & ~(size_t)63);
+  syncs = (struct pad_sync_s *)realloc(pad_syncs, (pad_nsyncs + n) * sizeof(struct pad_sync_s));
+  if(!block || !syncs)
+  {
+    free(block);
+    eprintf("Not enough mem\n");
+    return RC_NOENMEM;
+  }
+  pad_syncs = syncs;
+
+  for(align = 8; align; align >>= 1)
+  {
+    for(i = 0; i < n; i++)
+    {
+      if(litex_sim_pads_align(sizes[i]) != align)
+        continue;
+      syncs = &pad_syncs[pad_nsyncs++];
+      syncs->model = pads[i].signal;
+      syncs->packed = block + off;
+      syncs->size = sizes[i];
+      memcpy(syncs->packed, syncs->model, sizes[i]);
+      pads[i].signal = syncs->packed;
+      off += sizes[i];
+    }
+  }
+  return RC_OK;
+}
+
+static inline void litex_sim_pads_copy(void *dst, const void *src, size_t size)
+{
+  switch(size)
+  {
+    case 1: *(uint8_t *)dst = *(const uint8_t *)src; break;
+    case 2: *(uint16_t *)dst = *(const uint16_t *)src; break;
+    case 4: *(uint32_t *)dst = *(const uint32_t *)src; break;
+    case 8: *(uint64_t *)dst = *(const uint64_t *)src; break;
+    default: memcpy(dst, src, size); break;
+  }
+}
+
+/* Before eval: the values written by the modules to the model. The outputs
+ * are copied back too, unchanged since sync_out() as modules drive inputs */
+void litex_sim_pads_sync_in(void)
+{
+  size_t i;
+
+  for(i = 0; i < pad_nsyncs; i++)
+    litex_sim_pads_copy(pad_syncs[i].model, pad_syncs[i].packed, pad_syncs[i].size);
+}
+
+/* After eval (and after restoring a checkpoint): the model to the modules */
+void litex_sim_pads_sync_out(void)
+{
+  size_t i;
+
+  for(i = 0; i < pad_nsyncs; i++)
+    litex_sim_pads_copy(pad_syncs[i].packed, pad_syncs[i].model, pad_syncs[i].size);
+}
+
 int litex_sim_pads_get_list(struct pad_list_s **plist)
 {
   int ret=RC_OK;
@@ -69,6 +204,17 @@ int litex_sim_pads_find(struct pad_list_s *first, char *name, int index, struct
     goto out;
   }
 
+  /* The registered list is indexed, only scan lists built elsewhere */
+  if(first == padlist)
+  {
+    for(list = padhash[litex_sim_pads_hash(name, index) % PADS_BUCKETS]; list; list=list->hnext)
+    {
+      if(!strcmp(name, list->name) && (list->index == index))
+        break;
+    }
+    goto out;
+  }
+
   for(list = first; list; list=list->next)
   {
     if(!strcmp(name, list->name) && (list->index == index))
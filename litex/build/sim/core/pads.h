@@ -3,6 +3,10 @@
 #ifndef __PADS_H_
 #define __PADS_H_
 
+#include <stdint.h>
+#include <string.h>
+#include "error.h"
+
 struct pad_s {
   char *name;
   size_t len;
@@ -14,15 +18,98 @@ struct pad_list_s {
   struct pad_s *pads;
   int index;
   struct pad_list_s *next;
+  /* Open addressing table of the pads, indexed by the hash of their name */
+  struct pad_s **table;
+  uint32_t mask;
+  /* Next interface in the same bucket of the interface registry */
+  struct pad_list_s *hnext;
+};
+
+/* Signal to resolve with litex_sim_pads_bind(), lists end with a NULL name */
+struct pad_bind_s {
+  const char *name;
+  void **signal;
 };
 
+#define PAD_BIND(_name, _signal) { _name, (void**)(_signal) }
+#define PAD_BIND_END { NULL, NULL }
+
+/* Packed pads: the signals of an interface are moved out of the model into
+ * one cache line aligned block, copied to the model before each eval and
+ * back after it, see litex_sim_pads_pack() */
+struct pad_sync_s {
+  void *model;
+  void *packed;
+  size_t size;
+};
+
+/* FNV-1a, also mixing in the interface index when looking up interfaces */
+static inline uint32_t litex_sim_pads_hash(const char *name, uint32_t seed)
+{
+  uint32_t h = 2166136261u ^ seed;
+
+  while(*name)
+  {
+    h ^= (uint8_t)*name++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static inline struct pad_s *litex_sim_pad_get(struct pad_list_s *pl, const char *name)
+{
+  struct pad_s *p;
+  uint32_t i;
+
+  if(!pl->table)
+  {
+    for(p = pl->pads; p->name; p++)
+    {
+      if(!strcmp(p->name, name))
+        return p;
+    }
+    return NULL;
+  }
+
+  for(i = litex_sim_pads_hash(name, 0) & pl->mask; pl->table[i]; i = (i + 1) & pl->mask)
+  {
+    if(!strcmp(pl->table[i]->name, name))
+      return pl->table[i];
+  }
+  return NULL;
+}
+
+/* Resolves every signal of binds in one go, missing ones are set to NULL */
+static inline int litex_sim_pads_bind(struct pad_list_s *pl, const struct pad_bind_s *binds)
+{
+  struct pad_s *p;
+  int ret = RC_OK;
+
+  for(; binds->name; binds++)
+  {
+    p = litex_sim_pad_get(pl, binds->name);
+    *binds->signal = p ? p->signal : NULL;
+    if(!p)
+    {
+      ret = RC_ERROR;
+    }
+  }
+  return ret;
+}
+
 int litex_sim_pads_get_list(struct pad_list_s **plist);
 int litex_sim_pads_find(struct pad_list_s *first, char *name, int index,  struct pad_list_s **found);
   
 #ifdef __cplusplus
 extern "C" int litex_sim_register_pads(struct pad_s *pads, char *interface_name, int index);
+extern "C" int litex_sim_pads_pack(struct pad_s *pads, const size_t *sizes);
+extern "C" void litex_sim_pads_sync_in(void);
+extern "C" void litex_sim_pads_sync_out(void);
 #else
 int litex_sim_register_pads(struct pad_s *pads, char *interface_name, int index);
+int litex_sim_pads_pack(struct pad_s *pads, const size_t *sizes);
+void litex_sim_pads_sync_in(void);
+void litex_sim_pads_sync_out(void);
 #endif
 
 #endif
@@ -0,0 +1,202 @@
+#ifndef __PCAP_H_
+#define __PCAP_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "pktpool.h"
+
+/*
+ * Minimal libpcap file format support for the Ethernet modules: replay of
+ * recorded frames into the simulation and recording of transmitted frames,
+ * without a TAP interface. Both microsecond and nanosecond resolution files
+ * of either byte order are read, files are written with nanosecond
+ * timestamps taken from the simulation time. pcapng is not supported.
+ */
+
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_MAGIC_PCAPNG 0x0a0d0d0a
+#define PCAP_LINKTYPE_ETHERNET 1
+
+struct pcap_hdr_s {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+struct pcap_rec_s {
+  uint32_t ts_sec;
+  uint32_t ts_frac;
+  uint32_t incl_len;
+  uint32_t orig_len;
+};
+
+typedef struct pcap {
+  FILE *f;
+  int swapped;
+  uint64_t frac_ps;
+} pcap_t;
+
+static inline uint32_t pcap_u32(pcap_t *p, uint32_t v)
+{
+  return p->swapped ? __builtin_bswap32(v) : v;
+}
+
+static inline int pcap_open_read(pcap_t *p, const char *filename)
+{
+  struct pcap_hdr_s hdr;
+  uint32_t magic;
+
+  memset(p, 0, sizeof(pcap_t));
+  p->f = fopen(filename, "rb");
+  if(!p->f)
+    return -1;
+  if(fread(&hdr, sizeof(hdr), 1, p->f) != 1)
+    goto err;
+
+  magic = hdr.magic;
+  if(magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS))
+  {
+    p->swapped = 1;
+    magic = __builtin_bswap32(magic);
+  }
+  if(magic == PCAP_MAGIC_US)
+    p->frac_ps = 1000000;
+  else if(magic == PCAP_MAGIC_NS)
+    p->frac_ps = 1000;
+  else
+  {
+    if(magic == PCAP_MAGIC_PCAPNG)
+      fprintf(stderr, "[pcap] %s is pcapng, convert it with editcap -F pcap\n", filename);
+    goto err;
+  }
+  if(pcap_u32(p, hdr.linktype) != PCAP_LINKTYPE_ETHERNET)
+    goto err;
+  return 0;
+
+err:
+  fclose(p->f);
+  p->f = NULL;
+  return -1;
+}
+
+static inline int pcap_open_write(pcap_t *p, const char *filename, uint32_t snaplen)
+{
+  struct pcap_hdr_s hdr = {PCAP_MAGIC_NS, 2, 4, 0, 0, snaplen, PCAP_LINKTYPE_ETHERNET};
+
+  memset(p, 0, sizeof(pcap_t));
+  p->f = fopen(filename, "wb");
+  if(!p->f)
+    return -1;
+  p->frac_ps = 1000;
+  if(fwrite(&hdr, sizeof(hdr), 1, p->f) != 1)
+  {
+    fclose(p->f);
+    p->f = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+/* Reads the next frame, truncated to maxlen bytes. Returns 1 on success, 0
+ * at the end of the file and -1 on errors. */
+static inline int pcap_read(pcap_t *p, uint8_t *data, size_t maxlen, size_t *len, uint64_t *time_ps)
+{
+  struct pcap_rec_s rec;
+  size_t incl_len;
+
+  if(fread(&rec, sizeof(rec), 1, p->f) != 1)
+    return feof(p->f) ? 0 : -1;
+  incl_len = pcap_u32(p, rec.incl_len);
+  *len = incl_len < maxlen ? incl_len : maxlen;
+  if(fread(data, 1, *len, p->f) != *len)
+    return -1;
+  if(incl_len > *len && fseek(p->f, incl_len - *len, SEEK_CUR))
+    return -1;
+  *time_ps = (uint64_t)pcap_u32(p, rec.ts_sec) * 1000000000000ULL + (uint64_t)pcap_u32(p, rec.ts_frac) * p->frac_ps;
+  return 1;
+}
+
+static inline int pcap_write(pcap_t *p, const uint8_t *data, size_t len, uint64_t time_ps)
+{
+  struct pcap_rec_s rec;
+
+  rec.ts_sec = time_ps / 1000000000000ULL;
+  rec.ts_frac = (time_ps % 1000000000000ULL) / 1000;
+  rec.incl_len = len;
+  rec.orig_len = len;
+  if(fwrite(&rec, sizeof(rec), 1, p->f) != 1 || fwrite(data, 1, len, p->f) != len)
+    return -1;
+  return 0;
+}
+
+static inline void pcap_close(pcap_t *p)
+{
+  if(p->f)
+    fclose(p->f);
+  p->f = NULL;
+}
+
+/*
+ * Replay of a capture into a module RX ring, on the simulation thread. The
+ * frames are queued at their capture time relative to the first one, or as
+ * soon as a buffer is free when fast is set. Frames shorter than minlen are
+ * zero padded.
+ */
+struct pcap_replay_s {
+  pcap_t pcap;
+  int fast;
+  int started;
+  uint64_t first_ps;
+  struct pkt_s *next;
+  uint64_t next_ps;
+};
+
+static inline void pcap_replay_poll(struct pcap_replay_s *r, pkt_pool_t *pool, ring_t *ring,
+  size_t maxlen, size_t minlen, uint64_t time_ps)
+{
+  uint64_t ts;
+  int ret;
+
+  while(r->pcap.f)
+  {
+    if(!r->next)
+    {
+      r->next = pkt_pool_get(pool);
+      if(!r->next)
+        return;
+      ret = pcap_read(&r->pcap, r->next->data, maxlen, &r->next->len, &ts);
+      if(ret <= 0)
+      {
+        if(ret < 0)
+          fprintf(stderr, "[pcap] read error, replay stopped\n");
+        pcap_close(&r->pcap);
+        pkt_pool_put(pool, r->next);
+        r->next = NULL;
+        return;
+      }
+      if(r->next->len < minlen)
+      {
+        memset(r->next->data + r->next->len, 0, minlen - r->next->len);
+        r->next->len = minlen;
+      }
+      if(!r->started)
+      {
+        r->first_ps = ts;
+        r->started = 1;
+      }
+      r->next_ps = ts > r->first_ps ? ts - r->first_ps : 0;
+    }
+    if(!r->fast && time_ps < r->next_ps)
+      return;
+    ring_push(ring, &r->next, 1);
+    r->next = NULL;
+  }
+}
+
+#endif
@@ -0,0 +1,16 @@
+# Profile-guided optimization (pgo of the Verilator toolchain), the core, the modules and the model
+# being built twice around a training run of a representative workload:
+# - PGO=gen instruments them (GCC -fprofile-generate, Verilator --prof-pgo for the scheduling of
+#   multithreaded models),
+# - PGO=use rebuilds them with the collected profiles and LTO.
+# The GCC profiles are kept in PGO_DIR, out of obj_dir which is removed by each build.
+export PGO_DIR ?= $(abspath pgo)
+
+ifeq ($(PGO),gen)
+PGO_CFLAGS  = -fprofile-generate=$(PGO_DIR) -fprofile-update=atomic
+PGO_LDFLAGS = -fprofile-generate=$(PGO_DIR)
+endif
+ifeq ($(PGO),use)
+PGO_CFLAGS  = -fprofile-use=$(PGO_DIR) -fprofile-correction -Wno-missing-profile -flto=auto
+PGO_LDFLAGS = -fprofile-use=$(PGO_DIR) -flto=auto
+endif
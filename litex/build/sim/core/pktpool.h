@@ -0,0 +1,78 @@
+#ifndef __PKTPOOL_H_
+#define __PKTPOOL_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "ring.h"
+
+/*
+ * Fixed pool of packet buffers, used by the Ethernet modules to hand frames
+ * between the I/O thread and the simulation thread without any per-packet
+ * allocation or copy.
+ *
+ * Each pool serves one direction: buffers are taken (pkt_pool_get) on one
+ * thread, passed by pointer through a ring_t and given back (pkt_pool_put)
+ * on the other thread, so the free list is itself an SPSC ring. As a pool
+ * never holds more buffers than a ring of the same size, pushing a buffer
+ * to such a ring can't fail. The number of buffers must be a power of two.
+ */
+
+struct pkt_s {
+  size_t len;
+  uint8_t data[];
+};
+
+typedef struct pkt_pool {
+  uint8_t *buf;
+  size_t stride;
+  ring_t free;
+} pkt_pool_t;
+
+static inline int pkt_pool_init(pkt_pool_t *p, size_t npkts, size_t data_len)
+{
+  struct pkt_s *pkt;
+  size_t i;
+
+  /* Keep the buffers aligned for word wide accesses */
+  p->stride = (sizeof(struct pkt_s) + data_len + 63) & ~(size_t)63;
+  p->buf = (uint8_t *)aligned_alloc(64, npkts * p->stride);
+  if(!p->buf)
+    return -1;
+  if(ring_init(&p->free, npkts, sizeof(struct pkt_s *)))
+  {
+    free(p->buf);
+    p->buf = NULL;
+    return -1;
+  }
+  for(i = 0; i < npkts; i++)
+  {
+    pkt = (struct pkt_s *)(p->buf + i * p->stride);
+    pkt->len = 0;
+    ring_push(&p->free, &pkt, 1);
+  }
+  return 0;
+}
+
+static inline void pkt_pool_free(pkt_pool_t *p)
+{
+  ring_free(&p->free);
+  free(p->buf);
+  p->buf = NULL;
+}
+
+/* Free buffer, NULL when all of them are in flight */
+static inline struct pkt_s *pkt_pool_get(pkt_pool_t *p)
+{
+  struct pkt_s *pkt;
+
+  if(!ring_pop(&p->free, &pkt, 1))
+    return NULL;
+  return pkt;
+}
+
+static inline void pkt_pool_put(pkt_pool_t *p, struct pkt_s *pkt)
+{
+  ring_push(&p->free, &pkt, 1);
+}
+
+#endif
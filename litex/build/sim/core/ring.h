@@ -0,0 +1,133 @@
+#ifndef __RING_H_
+#define __RING_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+/*
+ * Lock-free single-producer/single-consumer ring of fixed size elements.
+ *
+ * Used to hand data between the I/O thread (running the libevent loop) and
+ * the simulation thread without locks or syscalls. One side must only call
+ * the producer functions (ring_push), the other only the consumer functions
+ * (ring_pop, ring_copy, ring_peek, ring_drop). The number of elements must be a power
+ * of two.
+ */
+
+typedef struct ring {
+  uint8_t *buf;
+  size_t elem_size;
+  size_t mask;
+  _Atomic size_t wr;
+  _Atomic size_t rd;
+} ring_t;
+
+static inline int ring_init(ring_t *r, size_t nelem, size_t elem_size)
+{
+  if(!nelem || (nelem & (nelem - 1)))
+    return -1;
+
+  r->buf = (uint8_t *)malloc(nelem * elem_size);
+  if(!r->buf)
+    return -1;
+  r->elem_size = elem_size;
+  r->mask = nelem - 1;
+  atomic_init(&r->wr, 0);
+  atomic_init(&r->rd, 0);
+  return 0;
+}
+
+static inline void ring_free(ring_t *r)
+{
+  free(r->buf);
+  r->buf = NULL;
+}
+
+/* Number of elements available to the consumer */
+static inline size_t ring_count(ring_t *r)
+{
+  return atomic_load_explicit(&r->wr, memory_order_acquire)
+    - atomic_load_explicit(&r->rd, memory_order_acquire);
+}
+
+/* Number of free elements available to the producer */
+static inline size_t ring_space(ring_t *r)
+{
+  return r->mask + 1 - ring_count(r);
+}
+
+/* Push up to n elements, returns the number actually pushed */
+static inline size_t ring_push(ring_t *r, const void *elems, size_t n)
+{
+  size_t wr = atomic_load_explicit(&r->wr, memory_order_relaxed);
+  size_t rd = atomic_load_explicit(&r->rd, memory_order_acquire);
+  size_t space = r->mask + 1 - (wr - rd);
+  size_t first;
+
+  if(n > space)
+    n = space;
+  if(!n)
+    return 0;
+
+  /* Copy in at most two chunks, wrapping around the end of the buffer */
+  first = r->mask + 1 - (wr & r->mask);
+  if(first > n)
+    first = n;
+  memcpy(r->buf + (wr & r->mask) * r->elem_size, elems, first * r->elem_size);
+  memcpy(r->buf, (const uint8_t *)elems + first * r->elem_size, (n - first) * r->elem_size);
+
+  atomic_store_explicit(&r->wr, wr + n, memory_order_release);
+  return n;
+}
+
+/* Consume n elements previously inspected with ring_peek() */
+static inline void ring_drop(ring_t *r, size_t n)
+{
+  size_t rd = atomic_load_explicit(&r->rd, memory_order_relaxed);
+
+  atomic_store_explicit(&r->rd, rd + n, memory_order_release);
+}
+
+/* Copy up to n of the oldest elements without consuming them */
+static inline size_t ring_copy(ring_t *r, void *elems, size_t n)
+{
+  size_t rd = atomic_load_explicit(&r->rd, memory_order_relaxed);
+  size_t wr = atomic_load_explicit(&r->wr, memory_order_acquire);
+  size_t first;
+
+  if(n > wr - rd)
+    n = wr - rd;
+  if(!n)
+    return 0;
+
+  first = r->mask + 1 - (rd & r->mask);
+  if(first > n)
+    first = n;
+  memcpy(elems, r->buf + (rd & r->mask) * r->elem_size, first * r->elem_size);
+  memcpy((uint8_t *)elems + first * r->elem_size, r->buf, (n - first) * r->elem_size);
+  return n;
+}
+
+/* Pop up to n elements, returns the number actually popped */
+static inline size_t ring_pop(ring_t *r, void *elems, size_t n)
+{
+  n = ring_copy(r, elems, n);
+  if(n)
+    ring_drop(r, n);
+  return n;
+}
+
+/* Oldest element without consuming it, NULL when the ring is empty */
+static inline void *ring_peek(ring_t *r)
+{
+  size_t rd = atomic_load_explicit(&r->rd, memory_order_relaxed);
+  size_t wr = atomic_load_explicit(&r->wr, memory_order_acquire);
+
+  if(wr == rd)
+    return NULL;
+  return r->buf + (rd & r->mask) * r->elem_size;
+}
+
+#endif
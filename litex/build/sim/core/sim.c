@@ -12,10 +12,17 @@
 #include <sys/socket.h>
 #endif
 #include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include "error.h"
 #include "modules.h"
 #include "pads.h"
 #include "veril.h"
+#include "iss.h"
+#include "affinity.h"
+#include "stim.h"
 
 #include <event2/listener.h>
 #include <event2/util.h>
@@ -24,17 +31,96 @@
 void litex_sim_init(void **out);
 void litex_sim_dump();
 
+struct clk_domain_s;
+
 struct session_list_s {
   void *session;
   char tickfirst;
+  /* Ticked by the worker pool, see LITEX_SIM_TICK_THREADS */
+  char parallel;
   struct ext_module_s *module;
+  struct clk_domain_s *domain;
+  clk_edge_t edge;
+  struct session_list_s *dnext;
   struct session_list_s *next;
+  /* Parked by tick() until a wake signal changes, see wake_signals */
+  char idle;
+  char **wake;
+  char wake_last[EXT_MODULE_WAKE_MAX];
+  /* Profiling counters, see LITEX_SIM_PROFILE */
+  uint64_t prof_calls;
+  uint64_t prof_ns;
+  /* tick() calls, see LITEX_SIM_STATS */
+  uint64_t ticks;
+};
+
+/* Sessions ticked on the edges of a common clock signal */
+struct clk_domain_s {
+  char *clk;
+  clk_edge_state_t edge_state;
+  /* Edge detected at the current timestep */
+  clk_edge_t edge;
+  struct session_list_s *sessions;
+  struct clk_domain_s *next;
+  uint64_t rising;
 };
 
 uint64_t timebase_ps = 1;
 uint64_t sim_time_ps = 0;
 struct session_list_s *sesslist=NULL;
+struct clk_domain_s *domlist=NULL;
 struct event_base *base=NULL;
+/* Set when every tickfirst module can report its next input change */
+static int next_edge_sched=0;
+/* Clock domain of the sessions reporting idle cycles, see idle() */
+static struct clk_domain_s *idle_domain=NULL;
+
+static int litex_sim_add_to_domain(struct session_list_s *slist)
+{
+  struct clk_domain_s *d;
+  char *clk=NULL;
+  clk_edge_t edge=CLK_EDGE_NONE;
+  int ret = RC_OK;
+
+  ret = slist->module->clock_domain(slist->session, &clk, &edge);
+  if(RC_OK != ret)
+  {
+    goto out;
+  }
+  if(!clk || CLK_EDGE_NONE == edge)
+  {
+    ret = RC_ERROR;
+    eprintf("Module %s did not report a clock signal\n", slist->module->name);
+    goto out;
+  }
+
+  for(d = domlist; d; d=d->next)
+  {
+    if(d->clk == clk)
+      break;
+  }
+  if(!d)
+  {
+    d=(struct clk_domain_s *)malloc(sizeof(struct clk_domain_s));
+    if(NULL == d)
+    {
+      ret = RC_NOENMEM;
+      eprintf("Not enough memory\n");
+      goto out;
+    }
+    memset(d, 0, sizeof(struct clk_domain_s));
+    d->clk = clk;
+    d->next = domlist;
+    domlist = d;
+  }
+
+  slist->domain = d;
+  slist->edge = edge;
+  slist->dnext = d->sessions;
+  d->sessions = slist;
+out:
+  return ret;
+}
 
 static int litex_sim_initialize_all(void **sim, void *base)
 {
@@ -50,28 +136,35 @@ static int litex_sim_initialize_all(void **sim, void *base)
   int i;
   int ret = RC_OK;
 
-  /* Load external modules */
-  ret = litex_sim_load_ext_modules(&mlist);
+  /* Load configuration */
+  ret = litex_sim_file_parse("sim_config.js", &ml, &timebase_ps);
+  if(RC_OK != ret)
+  {
+    goto out;
+  }
+
+  /* Load and start the external modules it references */
+  ret = litex_sim_load_ext_modules(ml, &mlist);
   if(RC_OK != ret)
   {
     goto out;
   }
   for(pmlist = mlist; pmlist; pmlist=pmlist->next)
   {
-    if(pmlist->module->start)
+    for(mli = ml; mli; mli=mli->next)
+    {
+      if(!strcmp(mli->name, pmlist->module->name))
+        break;
+    }
+    if(mli && pmlist->module->start)
     {
       pmlist->module->start(base);
     }
   }
-
-  /* Load configuration */
-  ret = litex_sim_file_parse("sim_config.js", &ml, &timebase_ps);
-  if(RC_OK != ret)
-  {
-    goto out;
-  }
-  /* Init generated */
+  /* Init generated, placing the threads Verilator starts with the model */
+  litex_sim_affinity_mark();
   litex_sim_init(&vsim);
+  litex_sim_affinity_place(AFFINITY_VERILATOR);
 
   /* Get pads from generated */
   ret = litex_sim_pads_get_list(&plist);
@@ -135,6 +228,28 @@ static int litex_sim_initialize_all(void **sim, void *base)
 	goto out;
       }
     }
+
+    if(pmlist->module->wake_signals)
+    {
+      slist->wake = pmlist->module->wake_signals(slist->session);
+      for(i = 0; slist->wake && slist->wake[i]; i++);
+      if(i > EXT_MODULE_WAKE_MAX)
+      {
+        eprintf("Module %s has too many wake signals\n", pmlist->module->name);
+        ret = RC_ERROR;
+        goto out;
+      }
+    }
+
+    /* Pads are bound, the clock signal of the domain is now known */
+    if(pmlist->module->clock_domain)
+    {
+      ret = litex_sim_add_to_domain(slist);
+      if(RC_OK != ret)
+      {
+        goto out;
+      }
+    }
   }
   *sim = vsim;
 out:
@@ -167,52 +282,929 @@ int litex_sim_sort_session()
   return RC_OK;
 }
 
-struct event *ev;
+static void litex_sim_init_scheduler()
+{
+  struct session_list_s *s;
 
-static void cb(int sock, short which, void *arg)
+  idle_domain = NULL;
+  for(s = sesslist; s; s=s->next)
+  {
+    if(!s->module->idle || !s->domain)
+      continue;
+    if(idle_domain && idle_domain != s->domain)
+    {
+      eprintf("Idle sessions in different clock domains, idle skipping disabled\n");
+      idle_domain = NULL;
+      break;
+    }
+    idle_domain = s->domain;
+  }
+
+  next_edge_sched = 0;
+  for(s = sesslist; s; s=s->next)
+  {
+    if(!s->tickfirst)
+      continue;
+    if(!s->module->next_edge)
+    {
+      next_edge_sched = 0;
+      return;
+    }
+    next_edge_sched = 1;
+  }
+}
+
+static inline uint64_t litex_sim_next_time(uint64_t time_ps)
 {
   struct session_list_s *s;
-  void *vsim=arg;
-  struct timeval tv;
-  tv.tv_sec = 0;
-  tv.tv_usec = 0;
+  uint64_t next_ps = UINT64_MAX;
+  uint64_t edge_ps;
+
+  if(!next_edge_sched)
+    return time_ps + timebase_ps;
+
+  /* Inputs only change on clocker edges, jump straight to the earliest one */
+  for(s = sesslist; s; s=s->next)
+  {
+    if(!s->tickfirst)
+      continue;
+    if(RC_OK != s->module->next_edge(s->session, time_ps, &edge_ps))
+      return time_ps + timebase_ps;
+    if(edge_ps < next_ps)
+      next_ps = edge_ps;
+  }
+
+  return next_ps;
+}
+
+/* Number of steps run per event loop iteration, adapted at runtime */
+#define SLICE_MIN 64
+#define SLICE_MAX (1 << 20)
+#define SLICE_INIT 1000
+/* Upper bound on the wall-clock time of one slice, bounding how late the
+ * simulation thread notices it has to stop */
+#define SLICE_MAX_US 10000
+
+struct slice_stats_s {
+  int slice;
+  uint64_t steps;
+  uint64_t last_us;
+  uint64_t interval_us;
+  /* Progress reporting, totals at the last report and at the start */
+  int enabled;
+  uint64_t total_steps;
+  uint64_t last_edges;
+  uint64_t last_ticks;
+  uint64_t start_us;
+  uint64_t start_ps;
+};
+
+static struct slice_stats_s stats = { SLICE_INIT, 0, 0, 0 };
+
+static uint64_t litex_sim_time_us()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void litex_sim_init_stats()
+{
+  char *interval;
+
+  /* LITEX_SIM_STATS=<seconds> periodically reports the simulation rate on
+   * stderr, and sums it up at the end (only, with 0) */
+  interval = getenv("LITEX_SIM_STATS");
+  if(interval)
+  {
+    stats.enabled = 1;
+    stats.interval_us = strtoull(interval, NULL, 10) * 1000000;
+  }
+  stats.last_us = litex_sim_time_us();
+}
+
+/* Rising edges of the fastest clock, standing for the simulated cycles */
+static uint64_t litex_sim_stats_edges()
+{
+  struct clk_domain_s *d;
+  uint64_t edges = 0;
+
+  for(d = domlist; d; d=d->next)
+  {
+    if(d->rising > edges)
+      edges = d->rising;
+  }
+  return edges;
+}
+
+static uint64_t litex_sim_stats_ticks()
+{
+  struct session_list_s *s;
+  uint64_t ticks = 0;
+
+  for(s = sesslist; s; s=s->next)
+    ticks += s->ticks;
+  return ticks;
+}
+
+static void litex_sim_stats_report(uint64_t now_us)
+{
+  uint64_t edges = litex_sim_stats_edges();
+  uint64_t ticks = litex_sim_stats_ticks();
+  double us = now_us - stats.last_us;
+
+  fprintf(stderr, "[sim] %.3f ms simulated, %.1f kHz, %.0f evals/s, %.0f ticks/s, slice %d steps\n",
+    sim_time_ps / 1e9, (edges - stats.last_edges) * 1e3 / us, stats.steps * 1e6 / us,
+    (ticks - stats.last_ticks) * 1e6 / us, stats.slice);
+  stats.total_steps += stats.steps;
+  stats.steps = 0;
+  stats.last_us = now_us;
+  stats.last_edges = edges;
+  stats.last_ticks = ticks;
+}
+
+static void litex_sim_stats_summary()
+{
+  uint64_t now_us = litex_sim_time_us();
+  double s = (now_us - stats.start_us) / 1e6;
+  double sim_s = (sim_time_ps - stats.start_ps) / 1e12;
+  uint64_t steps = stats.total_steps + stats.steps;
+
+  if(!stats.enabled)
+    return;
+  if(s <= 0)
+    s = 1e-6;
+  fprintf(stderr, "[sim] done at %.3f ms simulated in %.2f s (1/%.0f of real time): %.1f kHz, "
+    "%lu evals (%.0f/s), %lu ticks\n", sim_time_ps / 1e9, s, sim_s > 0 ? s / sim_s : 0,
+    litex_sim_stats_edges() / s / 1e3, (unsigned long)steps, steps / s,
+    (unsigned long)litex_sim_stats_ticks());
+}
+
+static int litex_sim_io_pending()
+{
+  struct session_list_s *s;
+
+  for(s = sesslist; s; s=s->next)
+  {
+    if(s->module->io_pending && s->module->io_pending(s->session))
+      return 1;
+  }
+  return 0;
+}
+
+static void litex_sim_adapt_slice(int steps, uint64_t start_us)
+{
+  uint64_t now_us = litex_sim_time_us();
+
+  /* Shrink while I/O is pending or the slice got too long, grow otherwise */
+  if(litex_sim_io_pending() || now_us - start_us > SLICE_MAX_US)
+  {
+    if(stats.slice > SLICE_MIN)
+      stats.slice /= 2;
+  }
+  else if(stats.slice < SLICE_MAX)
+  {
+    stats.slice *= 2;
+  }
+
+  stats.steps += steps;
+  if(stats.interval_us && now_us - stats.last_us >= stats.interval_us)
+    litex_sim_stats_report(now_us);
+}
+
+/* Checkpointing: LITEX_SIM_SAVE=<file> saves the simulation state when the
+ * simulated time reaches LITEX_SIM_SAVE_AT=<ps> (or on $finish if unset),
+ * LITEX_SIM_RESTORE=<file> restores it before the simulation starts. The
+ * Verilated model goes to <file>, the core and module state to
+ * <file>.modules. */
+#define CHECKPOINT_MAGIC "LXSIMCK1"
+
+static char *save_file=NULL;
+static uint64_t save_at_ps=UINT64_MAX;
+/* LITEX_SIM_RUN_PS=<ps> ends the simulation at a fixed simulated time */
+static uint64_t run_until_ps=UINT64_MAX;
+
+static int litex_sim_save_state(void *vsim, const char *filename)
+{
+  struct session_list_s *s;
+  struct clk_domain_s *d;
+  char name[300];
+  FILE *f=NULL;
+  uint32_t len;
+  uint8_t has_state;
+  int ret = RC_OK;
+
+  if(litex_sim_save_model(vsim, filename))
+  {
+    ret = RC_ERROR;
+    eprintf("Can't save simulation model to %s\n", filename);
+    goto out;
+  }
+
+  snprintf(name, sizeof(name), "%s.modules", filename);
+  f = fopen(name, "wb");
+  if(!f)
+  {
+    ret = RC_ERROR;
+    eprintf("Can't open %s\n", name);
+    goto out;
+  }
+
+  fwrite(CHECKPOINT_MAGIC, 1, 8, f);
+  fwrite(&sim_time_ps, sizeof(sim_time_ps), 1, f);
+  for(d = domlist; d; d=d->next)
+  {
+    fwrite(&d->edge_state, sizeof(d->edge_state), 1, f);
+  }
+
+  /* Sessions are recorded in order, tagged with their module name */
+  for(s = sesslist; s; s=s->next)
+  {
+    len = strlen(s->module->name);
+    has_state = s->module->save != NULL;
+    fwrite(&len, sizeof(len), 1, f);
+    fwrite(s->module->name, 1, len, f);
+    fwrite(&has_state, sizeof(has_state), 1, f);
+    if(has_state)
+    {
+      ret = s->module->save(s->session, f);
+      if(RC_OK != ret)
+      {
+        eprintf("Module %s failed to save its state\n", s->module->name);
+        goto out;
+      }
+    }
+  }
+
+  if(ferror(f))
+  {
+    ret = RC_ERROR;
+    eprintf("Error writing %s\n", name);
+    goto out;
+  }
+  printf("[sim] saved checkpoint %s at %lu ps\n", filename, (unsigned long)sim_time_ps);
+out:
+  if(f)
+  {
+    fclose(f);
+  }
+  return ret;
+}
+
+static int litex_sim_restore_state(void *vsim, const char *filename)
+{
+  struct session_list_s *s;
+  struct clk_domain_s *d;
+  char name[300];
+  char magic[8];
+  FILE *f=NULL;
+  uint32_t len;
+  uint8_t has_state;
+  int ret = RC_OK;
+
+  if(litex_sim_restore_model(vsim, filename))
+  {
+    ret = RC_ERROR;
+    eprintf("Can't restore simulation model from %s\n", filename);
+    goto out;
+  }
+
+  snprintf(name, sizeof(name), "%s.modules", filename);
+  f = fopen(name, "rb");
+  if(!f)
+  {
+    ret = RC_ERROR;
+    eprintf("Can't open %s\n", name);
+    goto out;
+  }
+
+  if(1 != fread(magic, sizeof(magic), 1, f) || memcmp(magic, CHECKPOINT_MAGIC, 8))
+  {
+    ret = RC_ERROR;
+    eprintf("%s is not a simulation checkpoint\n", name);
+    goto out;
+  }
+  if(1 != fread(&sim_time_ps, sizeof(sim_time_ps), 1, f))
+  {
+    ret = RC_ERROR;
+    goto err;
+  }
+  for(d = domlist; d; d=d->next)
+  {
+    if(1 != fread(&d->edge_state, sizeof(d->edge_state), 1, f))
+    {
+      ret = RC_ERROR;
+      goto err;
+    }
+  }
+
+  for(s = sesslist; s; s=s->next)
+  {
+    if(1 != fread(&len, sizeof(len), 1, f) || len >= sizeof(name)
+       || len != fread(name, 1, len, f))
+    {
+      ret = RC_ERROR;
+      goto err;
+    }
+    name[len] = 0;
+    if(strcmp(name, s->module->name))
+    {
+      ret = RC_ERROR;
+      eprintf("Checkpoint has module %s where %s is configured\n", name, s->module->name);
+      goto out;
+    }
+    if(1 != fread(&has_state, sizeof(has_state), 1, f))
+    {
+      ret = RC_ERROR;
+      goto err;
+    }
+    if(has_state && !s->module->restore)
+    {
+      ret = RC_ERROR;
+      eprintf("Module %s can't restore its state\n", s->module->name);
+      goto out;
+    }
+    if(has_state)
+    {
+      ret = s->module->restore(s->session, f);
+      if(RC_OK != ret)
+      {
+        eprintf("Module %s failed to restore its state\n", s->module->name);
+        goto out;
+      }
+    }
+  }
+  printf("[sim] restored checkpoint %s at %lu ps\n", filename, (unsigned long)sim_time_ps);
+  goto out;
+err:
+  eprintf("Truncated checkpoint %s\n", filename);
+out:
+  if(f)
+  {
+    fclose(f);
+  }
+  return ret;
+}
+
+static int litex_sim_init_checkpoint(void *vsim)
+{
+  char *restore_file;
+  char *at;
+
+  save_file = getenv("LITEX_SIM_SAVE");
+  at = getenv("LITEX_SIM_SAVE_AT");
+  if(save_file && at)
+  {
+    save_at_ps = strtoull(at, NULL, 10);
+  }
+
+  at = getenv("LITEX_SIM_RUN_PS");
+  if(at)
+  {
+    run_until_ps = strtoull(at, NULL, 10);
+  }
+
+  restore_file = getenv("LITEX_SIM_RESTORE");
+  if(restore_file)
+  {
+    return litex_sim_restore_state(vsim, restore_file);
+  }
+  return RC_OK;
+}
+
+/* Profiling: LITEX_SIM_PROFILE=1 measures the time spent in each module
+ * tick, in the model evaluation and in the trace dump. The table is printed
+ * on exit and whenever SIGUSR2 is received. */
+struct prof_counter_s {
+  uint64_t calls;
+  uint64_t ns;
+};
+
+static int profile=0;
+static struct prof_counter_s prof_eval;
+static struct prof_counter_s prof_dump;
+static volatile sig_atomic_t prof_report=0;
+
+static inline uint64_t litex_sim_time_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void litex_sim_profile_sigusr2(int sig)
+{
+  prof_report = 1;
+}
+
+static void litex_sim_init_profile()
+{
+  char *p;
+
+  p = getenv("LITEX_SIM_PROFILE");
+  if(p && strcmp(p, "0"))
+  {
+    profile = 1;
+    signal(SIGUSR2, litex_sim_profile_sigusr2);
+  }
+}
+
+static void litex_sim_profile_line(const char *name, uint64_t calls, uint64_t ns)
+{
+  fprintf(stderr, "[sim] %-20s %14lu %16lu %10.1f\n", name,
+    (unsigned long)calls, (unsigned long)ns, calls ? (double)ns / calls : 0.0);
+}
+
+static void litex_sim_profile_report()
+{
+  struct session_list_s *s;
+
+  fprintf(stderr, "[sim] %-20s %14s %16s %10s\n", "module", "calls", "total ns", "ns/call");
+  litex_sim_profile_line("(eval)", prof_eval.calls, prof_eval.ns);
+  litex_sim_profile_line("(trace)", prof_dump.calls, prof_dump.ns);
+  for(s = sesslist; s; s=s->next)
+  {
+    litex_sim_profile_line(s->module->name, s->prof_calls, s->prof_ns);
+  }
+}
+
+/* Idle sessions stay parked while their wake signals keep their values */
+static inline int litex_sim_parked(struct session_list_s *s)
+{
   int i;
 
-  for(i = 0; i < 1000; i++)
+  for(i = 0; s->wake[i]; i++)
   {
-    for(s = sesslist; s; s=s->next)
+    if(*s->wake[i] != s->wake_last[i])
     {
-      if(s->tickfirst)
-        s->module->tick(s->session, sim_time_ps);
+      s->idle = 0;
+      return 0;
     }
+  }
+  return 1;
+}
 
-    litex_sim_eval(vsim, sim_time_ps);
+static inline void litex_sim_park(struct session_list_s *s)
+{
+  int i;
+
+  for(i = 0; s->wake[i]; i++)
+    s->wake_last[i] = *s->wake[i];
+  s->idle = 1;
+}
+
+static inline void litex_sim_tick(struct session_list_s *s, uint64_t time_ps)
+{
+  uint64_t start_ns;
+  int ret;
+
+  if(s->idle && litex_sim_parked(s))
+    return;
+  s->ticks++;
+  if(!profile)
+  {
+    ret = s->module->tick(s->session, time_ps);
+  }
+  else
+  {
+    start_ns = litex_sim_time_ns();
+    ret = s->module->tick(s->session, time_ps);
+    s->prof_ns += litex_sim_time_ns() - start_ns;
+    s->prof_calls++;
+  }
+  if(EXT_MODULE_IDLE == ret && s->wake)
+    litex_sim_park(s);
+}
+
+static inline void litex_sim_eval_dump(void *vsim, uint64_t time_ps)
+{
+  uint64_t start_ns;
+  uint64_t eval_ns;
+
+  if(!profile)
+  {
+    litex_sim_eval(vsim, time_ps);
     litex_sim_dump();
+    return;
+  }
+  start_ns = litex_sim_time_ns();
+  litex_sim_eval(vsim, time_ps);
+  eval_ns = litex_sim_time_ns();
+  litex_sim_dump();
+  prof_dump.ns += litex_sim_time_ns() - eval_ns;
+  prof_dump.calls++;
+  prof_eval.ns += eval_ns - start_ns;
+  prof_eval.calls++;
+}
+
+struct event *ev;
+
+static inline void litex_sim_tick_domains(uint64_t time_ps)
+{
+  struct clk_domain_s *d;
+  struct session_list_s *s;
+  clk_edge_t edge;
+
+  for(d = domlist; d; d=d->next)
+  {
+    edge = d->edge = clk_edge(&d->edge_state, *d->clk);
+    if(CLK_EDGE_NONE == edge)
+      continue;
+    if(CLK_EDGE_RISING == edge)
+      d->rising++;
+
+    for(s = d->sessions; s; s=s->dnext)
+    {
+      if(!s->parallel && (s->edge == edge || s->edge == CLK_EDGE_BOTH))
+        litex_sim_tick(s, time_ps);
+    }
+  }
+}
+
+/* Parallel ticking: LITEX_SIM_TICK_THREADS=<n> ticks the sessions of
+ * thread-safe modules (EXT_MODULE_THREAD_SAFE) on the simulation thread
+ * and n workers after each eval, sessions being split statically among
+ * them. Workers spin between timesteps, so n should leave cores free. */
+#define TICK_POOL_SPINS 1000
+
+struct tick_pool_s {
+  int nthreads;
+  int nsessions;
+  struct session_list_s **sessions;
+  pthread_t *threads;
+  uint64_t time_ps;
+  atomic_uint gen;
+  atomic_int pending;
+  atomic_int stop;
+};
+
+static struct tick_pool_s pool;
+
+static inline void litex_sim_tick_session(struct session_list_s *s, uint64_t time_ps)
+{
+  clk_edge_t edge;
+
+  if(s->domain)
+  {
+    edge = s->domain->edge;
+    if(CLK_EDGE_NONE == edge || (s->edge != edge && s->edge != CLK_EDGE_BOTH))
+      return;
+  }
+  litex_sim_tick(s, time_ps);
+}
+
+static inline void litex_sim_tick_share(int worker, uint64_t time_ps)
+{
+  int i;
+
+  for(i = worker; i < pool.nsessions; i += pool.nthreads + 1)
+  {
+    litex_sim_tick_session(pool.sessions[i], time_ps);
+  }
+}
+
+static void *litex_sim_tick_worker(void *arg)
+{
+  int worker = (int)(intptr_t)arg;
+  unsigned int gen = 0;
+  int spins;
+
+  litex_sim_affinity_set(AFFINITY_WORKERS, worker - 1);
+  for(;;)
+  {
+    for(spins = 0; atomic_load_explicit(&pool.gen, memory_order_acquire) == gen;)
+    {
+      if(spins < TICK_POOL_SPINS)
+        spins++;
+      else
+        sched_yield();
+    }
+    gen++;
+    if(atomic_load(&pool.stop))
+      break;
+    litex_sim_tick_share(worker, pool.time_ps);
+    atomic_fetch_sub_explicit(&pool.pending, 1, memory_order_release);
+  }
+  return NULL;
+}
+
+static inline void litex_sim_tick_parallel(uint64_t time_ps)
+{
+  pool.time_ps = time_ps;
+  atomic_store_explicit(&pool.pending, pool.nthreads, memory_order_relaxed);
+  atomic_fetch_add_explicit(&pool.gen, 1, memory_order_release);
+  litex_sim_tick_share(0, time_ps);
+  while(atomic_load_explicit(&pool.pending, memory_order_acquire));
+}
+
+static int litex_sim_init_pool()
+{
+  struct session_list_s *s;
+  char *n;
+  int i;
+
+  n = getenv("LITEX_SIM_TICK_THREADS");
+  if(!n || (pool.nthreads = atoi(n)) <= 0)
+  {
+    pool.nthreads = 0;
+    return RC_OK;
+  }
+
+  for(s = sesslist; s; s=s->next)
+  {
+    if(!s->tickfirst && (s->module->flags & EXT_MODULE_THREAD_SAFE))
+      pool.nsessions++;
+  }
+  if(pool.nsessions < 2)
+  {
+    pool.nthreads = 0;
+    pool.nsessions = 0;
+    return RC_OK;
+  }
+  if(pool.nthreads > pool.nsessions - 1)
+    pool.nthreads = pool.nsessions - 1;
+
+  pool.sessions = (struct session_list_s **)malloc(pool.nsessions * sizeof(struct session_list_s *));
+  pool.threads = (pthread_t *)malloc(pool.nthreads * sizeof(pthread_t));
+  if(!pool.sessions || !pool.threads)
+  {
+    eprintf("Not enough memory\n");
+    return RC_NOENMEM;
+  }
+
+  i = 0;
+  for(s = sesslist; s; s=s->next)
+  {
+    if(!s->tickfirst && (s->module->flags & EXT_MODULE_THREAD_SAFE))
+    {
+      s->parallel = 1;
+      pool.sessions[i++] = s;
+    }
+  }
+
+  for(i = 0; i < pool.nthreads; i++)
+  {
+    if(pthread_create(&pool.threads[i], NULL, litex_sim_tick_worker, (void *)(intptr_t)(i + 1)))
+    {
+      eprintf("Can't create tick worker\n");
+      pool.nthreads = i;
+      return RC_ERROR;
+    }
+  }
+  printf("[sim] ticking %d sessions on %d threads\n", pool.nsessions, pool.nthreads + 1);
+  return RC_OK;
+}
 
+static void litex_sim_stop_pool()
+{
+  int i;
+
+  if(!pool.nthreads)
+    return;
+  atomic_store(&pool.stop, 1);
+  atomic_fetch_add_explicit(&pool.gen, 1, memory_order_release);
+  for(i = 0; i < pool.nthreads; i++)
+  {
+    pthread_join(pool.threads[i], NULL);
+  }
+}
+
+/* Static schedule: the sessions ticked before the eval (tickfirst, the
+ * clockers) and after it outside any clock domain are gathered in arrays,
+ * so that a step goes through no list nor per-session tests. The number of
+ * tickfirst sessions of the sim config can be given at build time
+ * (LITEX_SIM_SCHED_FIRST, see verilator.py), the first loop then having a
+ * constant trip count; a config that doesn't match falls back to the
+ * runtime count. */
+static struct session_list_s **sched_first;
+static struct session_list_s **sched_late;
+static int sched_nfirst;
+static int sched_nlate;
+#ifdef LITEX_SIM_SCHED_FIRST
+static int sched_static;
+#endif
+
+static int litex_sim_init_schedule()
+{
+  struct session_list_s *s;
+  int n = 0;
+
+  for(s = sesslist; s; s=s->next)
+    n++;
+  sched_first = (struct session_list_s **)malloc((n + 1) * sizeof(struct session_list_s *));
+  sched_late = (struct session_list_s **)malloc((n + 1) * sizeof(struct session_list_s *));
+  if(!sched_first || !sched_late)
+  {
+    eprintf("Not enough memory\n");
+    return RC_NOENMEM;
+  }
+  for(s = sesslist; s; s=s->next)
+  {
+    if(s->tickfirst)
+      sched_first[sched_nfirst++] = s;
+    else if(!s->domain && !s->parallel)
+      sched_late[sched_nlate++] = s;
+  }
+#ifdef LITEX_SIM_SCHED_FIRST
+  sched_static = sched_nfirst == LITEX_SIM_SCHED_FIRST;
+  if(!sched_static)
+    eprintf("%d tickfirst sessions, built for %d, using the generic schedule\n", sched_nfirst, LITEX_SIM_SCHED_FIRST);
+#endif
+  return RC_OK;
+}
+
+static inline void litex_sim_tick_first(uint64_t time_ps)
+{
+  int i;
+
+#ifdef LITEX_SIM_SCHED_FIRST
+  if(sched_static)
+  {
+    for(i = 0; i < LITEX_SIM_SCHED_FIRST; i++)
+      litex_sim_tick(sched_first[i], time_ps);
+    return;
+  }
+#endif
+  for(i = 0; i < sched_nfirst; i++)
+    litex_sim_tick(sched_first[i], time_ps);
+}
+
+static inline void litex_sim_tick_late(uint64_t time_ps)
+{
+  int i;
+
+  for(i = 0; i < sched_nlate; i++)
+    litex_sim_tick(sched_late[i], time_ps);
+}
+
+/* Idle skipping: while the idle sessions allow it and no host I/O is
+ * pending, only the tickfirst sessions (clocks) are ticked, over the allowed
+ * number of rising edges of their domain. The jump ends on a falling edge so
+ * the model sees no rising edge it was not evaluated on; the cycles in
+ * between are reported to the idle sessions with skipped(). Other modules
+ * are not ticked during the jump. While replaying a stimulus log, the jump
+ * ends on the last falling edge before the next logged input (one cycle
+ * being estimated from the previous falling edge). */
+#define IDLE_SKIP_MIN 16
+
+static uint64_t litex_sim_idle_skip(uint64_t time_ps)
+{
+  struct session_list_s *s;
+  struct clk_domain_s *d;
+  uint64_t cycles = UINT64_MAX;
+  uint64_t until_ps = save_file && save_at_ps < run_until_ps ? save_at_ps : run_until_ps;
+  uint64_t stim_ps = litex_sim_stim_next_ps();
+  uint64_t fall_ps = time_ps;
+  uint64_t c;
+  uint64_t n = 0;
+  clk_edge_t edge;
+
+  for(s = sesslist; s; s=s->next)
+  {
+    if(!s->module->idle)
+      continue;
+    if(RC_OK != s->module->idle(s->session, &c))
+      c = 0;
+    if(c < cycles)
+      cycles = c;
+  }
+  if(cycles < IDLE_SKIP_MIN || litex_sim_io_pending())
+    return litex_sim_next_time(time_ps);
+
+  for(;;)
+  {
+    time_ps = litex_sim_next_time(time_ps);
+    litex_sim_tick_first(time_ps);
+    for(d = domlist; d; d=d->next)
+    {
+      edge = clk_edge(&d->edge_state, *d->clk);
+      if(CLK_EDGE_RISING == edge)
+      {
+        d->rising++;
+        if(d == idle_domain)
+          n++;
+      }
+      if(d == idle_domain && CLK_EDGE_FALLING == edge)
+      {
+        if(n >= cycles || time_ps >= until_ps || 2 * time_ps - fall_ps >= stim_ps)
+          goto done;
+        fall_ps = time_ps;
+      }
+    }
+  }
+done:
+  if(n)
+  {
     for(s = sesslist; s; s=s->next)
     {
-      if(!s->tickfirst)
-        s->module->tick(s->session, sim_time_ps);
+      if(s->module->skipped)
+        s->module->skipped(s->session, n);
     }
+  }
+  return time_ps;
+}
 
-    sim_time_ps += timebase_ps;
+/* Runs one slice of simulation steps, returns non-zero on $finish */
+static int litex_sim_run_slice(void *vsim)
+{
+  int i;
+  int finished = 0;
+  uint64_t start_us = litex_sim_time_us();
+
+  for(i = 0; i < stats.slice; i++)
+  {
+    litex_sim_tick_first(sim_time_ps);
 
-    if (litex_sim_got_finish()) {
-        event_base_loopbreak(base);
+    litex_sim_eval_dump(vsim, sim_time_ps);
+
+    litex_sim_tick_domains(sim_time_ps);
+
+    litex_sim_tick_late(sim_time_ps);
+    if(pool.nsessions)
+      litex_sim_tick_parallel(sim_time_ps);
+
+    if(idle_domain)
+      sim_time_ps = litex_sim_idle_skip(sim_time_ps);
+    else
+      sim_time_ps = litex_sim_next_time(sim_time_ps);
+
+    if (save_file && sim_time_ps >= save_at_ps) {
+        litex_sim_save_state(vsim, save_file);
+        save_file = NULL;
+    }
+
+    if (litex_sim_got_finish() || sim_time_ps >= run_until_ps) {
+        finished = 1;
         break;
     }
   }
 
-  if (!evtimer_pending(ev, NULL)) {
-    event_del(ev);
-    evtimer_add(ev, &tv);
+  litex_sim_adapt_slice(i, start_us);
+  litex_sim_fast_forward_restore(sim_time_ps);
+  if(prof_report)
+  {
+    prof_report = 0;
+    litex_sim_profile_report();
+  }
+  return finished;
+}
+
+static void litex_sim_close_sessions()
+{
+  struct session_list_s *s;
+
+  for(s = sesslist; s; s=s->next)
+  {
+    if(s->module->close)
+      s->module->close(s->session);
+  }
+}
+
+/* Set by the I/O thread to stop the simulation thread */
+static atomic_int sim_stop;
+/* Set by the simulation thread once it has returned */
+static atomic_int sim_done;
+
+static void *litex_sim_thread(void *arg)
+{
+  /* The simulation never touches the event base: modules exchange data
+   * with their event handlers through SPSC rings only. */
+  litex_sim_affinity_set(AFFINITY_SIM, 0);
+  stats.last_us = stats.start_us = litex_sim_time_us();
+  stats.start_ps = sim_time_ps;
+  while(!atomic_load(&sim_stop))
+  {
+    if(litex_sim_run_slice(arg))
+      break;
+  }
+  litex_sim_stop_pool();
+  litex_sim_stats_summary();
+  if(save_file)
+  {
+    litex_sim_save_state(arg, save_file);
+  }
+  if(profile)
+  {
+    litex_sim_profile_report();
   }
+  litex_sim_close_sessions();
+  atomic_store(&sim_done, 1);
+  return NULL;
+}
+
+static void cb(int sock, short which, void *arg)
+{
+  if(atomic_load(&sim_done))
+    event_base_loopbreak(base);
 }
 
 int main(int argc, char *argv[])
 {
   void *vsim=NULL;
   struct timeval tv;
+  pthread_t sim_thread;
 
   int ret;
 
@@ -231,6 +1223,17 @@ int main(int argc, char *argv[])
   }
 
   litex_sim_init_cmdargs(argc, argv);
+  if(RC_OK != (ret = litex_sim_init_affinity(argc, argv)))
+  {
+    goto out;
+  }
+#if VM_COVERAGE
+  litex_sim_coverage_init();
+#endif
+  if(RC_OK != (ret = litex_sim_stim_init()))
+  {
+    goto out;
+  }
   if(RC_OK != (ret = litex_sim_initialize_all(&vsim, base)))
   {
     goto out;
@@ -240,15 +1243,54 @@ int main(int argc, char *argv[])
   {
     goto out;
   }
+  litex_sim_init_scheduler();
+  litex_sim_init_stats();
+  litex_sim_init_profile();
+  if(litex_sim_preload(vsim, argc, argv))
+  {
+    ret = RC_ERROR;
+    goto out;
+  }
+  if(RC_OK != (ret = litex_sim_fast_forward(vsim)))
+  {
+    goto out;
+  }
+  if(RC_OK != (ret = litex_sim_init_checkpoint(vsim)))
+  {
+    goto out;
+  }
+  if(RC_OK != (ret = litex_sim_init_pool()))
+  {
+    goto out;
+  }
+  if(RC_OK != (ret = litex_sim_init_schedule()))
+  {
+    goto out;
+  }
 
+  /* The I/O thread (this one) owns the event base, the simulation runs on
+   * its own thread and the loop only polls for its completion. */
+  if(pthread_create(&sim_thread, NULL, litex_sim_thread, vsim))
+  {
+    eprintf("Can't create simulation thread\n");
+    ret=RC_ERROR;
+    goto out;
+  }
   tv.tv_sec = 0;
-  tv.tv_usec = 0;
-  ev = event_new(base, -1, EV_PERSIST, cb, vsim);
+  tv.tv_usec = 10000;
+  ev = event_new(base, -1, EV_PERSIST, cb, NULL);
   event_add(ev, &tv);
   event_base_dispatch(base);
+  atomic_store(&sim_stop, 1);
+  pthread_join(sim_thread, NULL);
+  litex_sim_stim_close();
+  litex_sim_tracer_close();
 #if VM_COVERAGE
   litex_sim_coverage_dump();
 #endif
+#ifdef LITEX_SIM_PGO
+  litex_sim_pgo_close(vsim);
+#endif
 out:
   return ret;
 }
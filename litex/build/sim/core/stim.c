@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "stim.h"
+
+/*
+ * Log file: "LXST", u32 version, u32 number of streams, then for each stream
+ * its name (u8 length, characters), u64 size and events, host byte order.
+ * Events are varint(time delta of the stream, ps), varint(length), data.
+ * The events are kept in memory per stream, so sessions ticked on different
+ * threads never share a buffer.
+ */
+
+#define STIM_MAGIC "LXST"
+#define STIM_VERSION 1
+
+struct stim_stream_s {
+  char *name;
+  uint8_t *buf;
+  size_t len;
+  size_t cap;
+  size_t pos;
+  uint64_t last_ps;
+  uint64_t events;
+};
+
+static int mode = STIM_OFF;
+static char *filename;
+static struct stim_stream_s streams[STIM_MAX_STREAMS];
+static int nstreams = 0;
+
+static struct stim_stream_s *litex_sim_stim_find(const char *name)
+{
+  int i;
+
+  for(i = 0; i < nstreams; i++)
+  {
+    if(!strcmp(streams[i].name, name))
+      return &streams[i];
+  }
+  if(nstreams == STIM_MAX_STREAMS)
+  {
+    eprintf("Too many stimulus streams\n");
+    return NULL;
+  }
+  memset(&streams[nstreams], 0, sizeof(struct stim_stream_s));
+  streams[nstreams].name = strdup(name);
+  return &streams[nstreams++];
+}
+
+static int litex_sim_stim_load(const char *name)
+{
+  struct stim_stream_s *st;
+  char magic[4];
+  char sname[256];
+  uint32_t version, count, i;
+  uint64_t size;
+  uint8_t len;
+  FILE *f;
+
+  f = fopen(name, "rb");
+  if(!f)
+  {
+    eprintf("Can't open stimulus log %s\n", name);
+    return RC_ERROR;
+  }
+  if(fread(magic, 4, 1, f) != 1 || memcmp(magic, STIM_MAGIC, 4) ||
+     fread(&version, 4, 1, f) != 1 || version != STIM_VERSION || fread(&count, 4, 1, f) != 1)
+    goto err;
+  for(i = 0; i < count; i++)
+  {
+    if(fread(&len, 1, 1, f) != 1 || fread(sname, 1, len, f) != len)
+      goto err;
+    sname[len] = 0;
+    if(fread(&size, 8, 1, f) != 1 || !(st = litex_sim_stim_find(sname)))
+      goto err;
+    st->buf = (uint8_t *)malloc(size ? size : 1);
+    if(!st->buf || fread(st->buf, 1, size, f) != size)
+      goto err;
+    st->len = st->cap = size;
+  }
+  fclose(f);
+  return RC_OK;
+
+err:
+  eprintf("Invalid stimulus log %s\n", name);
+  fclose(f);
+  return RC_ERROR;
+}
+
+int litex_sim_stim_init(void)
+{
+  char *record = getenv("LITEX_SIM_STIM_RECORD");
+  char *replay = getenv("LITEX_SIM_STIM_REPLAY");
+
+  if(record && replay)
+  {
+    eprintf("LITEX_SIM_STIM_RECORD and LITEX_SIM_STIM_REPLAY are exclusive\n");
+    return RC_ERROR;
+  }
+  if(record)
+  {
+    mode = STIM_RECORD;
+    filename = record;
+  }
+  if(replay)
+  {
+    mode = STIM_REPLAY;
+    filename = replay;
+    return litex_sim_stim_load(replay);
+  }
+  return RC_OK;
+}
+
+int litex_sim_stim_mode(void)
+{
+  return mode;
+}
+
+struct stim_stream_s *litex_sim_stim_open(const char *name)
+{
+  struct stim_stream_s *st;
+
+  if(mode == STIM_OFF)
+    return NULL;
+  st = litex_sim_stim_find(name);
+  if(st && mode == STIM_REPLAY && !st->len)
+    printf("[stim] no input logged for %s\n", name);
+  return st;
+}
+
+static void litex_sim_stim_put(struct stim_stream_s *st, uint64_t v)
+{
+  do
+  {
+    st->buf[st->len++] = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+    v >>= 7;
+  } while(v);
+}
+
+static uint64_t litex_sim_stim_get(struct stim_stream_s *st, size_t *pos)
+{
+  uint64_t v = 0;
+  int shift = 0;
+  uint8_t b;
+
+  do
+  {
+    b = st->buf[(*pos)++];
+    v |= (uint64_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while((b & 0x80) && *pos < st->len);
+  return v;
+}
+
+void litex_sim_stim_record(struct stim_stream_s *st, uint64_t time_ps, const void *data, size_t len)
+{
+  uint8_t *buf;
+  size_t cap;
+
+  if(!st || mode != STIM_RECORD)
+    return;
+  /* Two varints of at most 10 bytes */
+  if(st->len + len + 20 > st->cap)
+  {
+    cap = st->cap ? st->cap : 65536;
+    while(st->len + len + 20 > cap)
+      cap *= 2;
+    buf = (uint8_t *)realloc(st->buf, cap);
+    if(!buf)
+    {
+      eprintf("Not enough memory, %s not recorded anymore\n", st->name);
+      mode = STIM_OFF;
+      return;
+    }
+    st->buf = buf;
+    st->cap = cap;
+  }
+  litex_sim_stim_put(st, time_ps - st->last_ps);
+  litex_sim_stim_put(st, len);
+  memcpy(st->buf + st->len, data, len);
+  st->len += len;
+  st->last_ps = time_ps;
+  st->events++;
+}
+
+size_t litex_sim_stim_replay(struct stim_stream_s *st, uint64_t time_ps, void *data, size_t size)
+{
+  uint64_t t;
+  size_t pos, len;
+
+  if(!st || mode != STIM_REPLAY || st->pos >= st->len)
+    return 0;
+  pos = st->pos;
+  t = st->last_ps + litex_sim_stim_get(st, &pos);
+  if(t > time_ps)
+    return 0;
+  len = litex_sim_stim_get(st, &pos);
+  if(pos + len > st->len)
+    len = st->len - pos;
+  memcpy(data, st->buf + pos, len < size ? len : size);
+  st->pos = pos + len;
+  st->last_ps = t;
+  st->events++;
+  return len < size ? len : size;
+}
+
+uint64_t litex_sim_stim_next_ps(void)
+{
+  struct stim_stream_s *st;
+  uint64_t t, next_ps = UINT64_MAX;
+  size_t pos;
+  int i;
+
+  if(mode != STIM_REPLAY)
+    return UINT64_MAX;
+  for(i = 0; i < nstreams; i++)
+  {
+    st = &streams[i];
+    if(st->pos >= st->len)
+      continue;
+    pos = st->pos;
+    t = st->last_ps + litex_sim_stim_get(st, &pos);
+    if(t < next_ps)
+      next_ps = t;
+  }
+  return next_ps;
+}
+
+void litex_sim_stim_close(void)
+{
+  struct stim_stream_s *st;
+  uint32_t version = STIM_VERSION;
+  uint32_t count = nstreams;
+  uint64_t size, events = 0;
+  uint8_t len;
+  FILE *f;
+  int i;
+
+  for(i = 0; i < nstreams; i++)
+    events += streams[i].events;
+  if(mode == STIM_REPLAY)
+    printf("[stim] replayed %llu events from %s\n", (unsigned long long)events, filename);
+  if(mode != STIM_RECORD)
+    return;
+  f = fopen(filename, "wb");
+  if(!f)
+  {
+    eprintf("Can't write stimulus log %s\n", filename);
+    return;
+  }
+  fwrite(STIM_MAGIC, 4, 1, f);
+  fwrite(&version, 4, 1, f);
+  fwrite(&count, 4, 1, f);
+  for(i = 0; i < nstreams; i++)
+  {
+    st = &streams[i];
+    len = strlen(st->name);
+    size = st->len;
+    fwrite(&len, 1, 1, f);
+    fwrite(st->name, 1, len, f);
+    fwrite(&size, 8, 1, f);
+    fwrite(st->buf, 1, st->len, f);
+  }
+  fclose(f);
+  printf("[stim] recorded %llu events to %s\n", (unsigned long long)events, filename);
+}
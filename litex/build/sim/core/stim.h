@@ -0,0 +1,41 @@
+#ifndef __STIM_H_
+#define __STIM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Record/replay of the external stimulus of the sim modules, for runs with
+ * identical input (benchmarks, bisection of performance regressions):
+ * - LITEX_SIM_STIM_RECORD=<file>: the host input entering the simulation
+ *   (serial/JTAG bytes, Ethernet frames) is logged per stream with the
+ *   simulation time of the tick taking it, the log being written on exit,
+ * - LITEX_SIM_STIM_REPLAY=<file>: the modules open no socket/TAP interface
+ *   and inject the logged input at the same simulation times instead.
+ *
+ * Streams are opened by name (module and port/interface) from new_sess(),
+ * the record/replay calls are made from the tick of their session.
+ */
+
+#define STIM_OFF    0
+#define STIM_RECORD 1
+#define STIM_REPLAY 2
+
+#define STIM_MAX_STREAMS 32
+
+struct stim_stream_s;
+
+int litex_sim_stim_init(void);
+int litex_sim_stim_mode(void);
+/* Stream of the given name, NULL when neither recording nor replaying */
+struct stim_stream_s *litex_sim_stim_open(const char *name);
+void litex_sim_stim_record(struct stim_stream_s *st, uint64_t time_ps, const void *data, size_t len);
+/* Next logged input of the stream due at time_ps (copied to data, truncated
+ * to size), returns its length or 0 when there is none */
+size_t litex_sim_stim_replay(struct stim_stream_s *st, uint64_t time_ps, void *data, size_t size);
+/* Time of the next logged input of all the streams, UINT64_MAX when there
+ * is none (bounds the idle skipping while replaying) */
+uint64_t litex_sim_stim_next_ps(void);
+void litex_sim_stim_close(void);
+
+#endif
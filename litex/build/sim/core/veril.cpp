@@ -4,13 +4,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <deque>
+#include <string>
 #include "Vsim.h"
 #include "verilated.h"
+#include "veril.h"
+#include "pads.h"
 #ifdef TRACE_FST
 #include "verilated_fst_c.h"
 #else
 #include "verilated_vcd_c.h"
 #endif
+#ifdef SAVABLE
+#include "verilated_save.h"
+#endif
+#if VM_COVERAGE
+#include "verilated_cov.h"
+#endif
 
 #ifdef TRACE_FST
 VerilatedFstC* tfp;
@@ -22,11 +37,127 @@ uint64_t tfp_end;
 uint64_t main_time = 0;
 Vsim *g_sim = nullptr;
 
+/*
+ * Flight recorder: with LITEX_SIM_TRACE_WINDOW=<ps>, the trace is kept in
+ * memory and only the last window is written to disk when triggered by the
+ * sim_trace signal going high, a SIGUSR1 or the end of the simulation.
+ *
+ * The window is recorded as a ring of segments, each a self-contained VCD
+ * started with openNext(), so dropping the oldest segment never loses the
+ * initial values of the remaining ones. Only available with VCD traces, the
+ * FST writer can't be redirected to memory.
+ */
+/*
+ * LITEX_SIM_TRACE_LEVELS=<n> limits the traced hierarchy to n levels below
+ * the top (99 by default). The signals of the sim module itself can be
+ * selected at build time (trace.vlt, see trace_scopes in verilator.py).
+ */
+static int litex_sim_trace_levels()
+{
+  const char *levels = getenv("LITEX_SIM_TRACE_LEVELS");
+
+  return levels ? atoi(levels) : 99;
+}
+
+#ifndef TRACE_FST
+#define TRACE_WINDOW_SEGMENTS 8
+
+class RingVcdFile : public VerilatedVcdFile {
+public:
+  std::deque<std::string> segments;
+
+  bool open(const std::string& name) override {
+    segments.emplace_back();
+    if (segments.size() > TRACE_WINDOW_SEGMENTS + 1)
+      segments.pop_front();
+    return true;
+  }
+  void close() override {}
+  ssize_t write(const char* bufp, ssize_t len) override {
+    segments.back().append(bufp, len);
+    return len;
+  }
+};
+
+static RingVcdFile *ring_file = nullptr;
+static VerilatedVcdC *ring_tfp = nullptr;
+static uint64_t ring_segment_ps;
+static uint64_t ring_segment_start;
+static int ring_flushes = 0;
+static volatile sig_atomic_t ring_trigger = 0;
+
+static void litex_sim_trace_sigusr1(int sig)
+{
+  ring_trigger = 1;
+}
+
+static void litex_sim_init_flight_recorder(Vsim *sim, uint64_t window_ps)
+{
+  ring_segment_ps = window_ps / TRACE_WINDOW_SEGMENTS;
+  if (ring_segment_ps == 0)
+    ring_segment_ps = 1;
+  ring_file = new RingVcdFile;
+  ring_tfp = new VerilatedVcdC(ring_file);
+  sim->trace(ring_tfp, litex_sim_trace_levels());
+  ring_tfp->open("sim.vcd");
+  ring_tfp->set_time_unit("1ps");
+  ring_tfp->set_time_resolution("1ps");
+  signal(SIGUSR1, litex_sim_trace_sigusr1);
+}
+
+static void litex_sim_flush_flight_recorder()
+{
+  char name[32];
+  FILE *f;
+  size_t header;
+  bool first = true;
+
+  ring_tfp->flush();
+  if (ring_flushes == 0)
+    snprintf(name, sizeof(name), "sim.vcd");
+  else
+    snprintf(name, sizeof(name), "sim_%d.vcd", ring_flushes);
+  ring_flushes++;
+
+  f = fopen(name, "w");
+  if (!f) {
+    fprintf(stderr, "Can't open %s\n", name);
+    return;
+  }
+  // Keep the header of the oldest segment only, the others start with a full
+  // dump of all values which merges transparently into a single VCD.
+  for (const std::string& seg : ring_file->segments) {
+    header = 0;
+    if (!first) {
+      header = seg.find("$enddefinitions $end\n");
+      header = header == std::string::npos ? 0 : header + strlen("$enddefinitions $end\n");
+    }
+    fwrite(seg.data() + header, 1, seg.size() - header, f);
+    first = false;
+  }
+  fclose(f);
+  printf("<DUMP %s>", name);
+  fflush(stdout);
+}
+#endif
+
+#if VM_COVERAGE
+static void litex_sim_coverage_poll();
+static uint64_t cov_next_ps = UINT64_MAX;
+static volatile sig_atomic_t cov_trigger = 0;
+#endif
+
 extern "C" void litex_sim_eval(void *vsim, uint64_t time_ps)
 {
   Vsim *sim = (Vsim*)vsim;
+  litex_sim_pads_sync_in();
   sim->eval();
+  litex_sim_pads_sync_out();
   main_time = time_ps;
+#if VM_COVERAGE
+  if (main_time >= cov_next_ps || cov_trigger)
+    litex_sim_coverage_poll();
+#endif
 }
 
 extern "C" void litex_sim_init_cmdargs(int argc, char *argv[])
@@ -40,25 +171,65 @@ extern "C" void litex_sim_init_tracer(void *vsim, long start, long end)
   tfp_start = start;
   tfp_end = end >= 0 ? end : UINT64_MAX;
   Verilated::traceEverOn(true);
+  g_sim = sim;
+  if (getenv("LITEX_SIM_TRACE_WINDOW")) {
+#ifndef TRACE_FST
+    litex_sim_init_flight_recorder(sim, strtoull(getenv("LITEX_SIM_TRACE_WINDOW"), NULL, 10));
+    return;
+#else
+    fprintf(stderr, "LITEX_SIM_TRACE_WINDOW requires VCD traces, ignoring\n");
+#endif
+  }
 #ifdef TRACE_FST
       tfp = new VerilatedFstC;
-      sim->trace(tfp, 99);
+      sim->trace(tfp, litex_sim_trace_levels());
       tfp->open("sim.fst");
 #else
       tfp = new VerilatedVcdC;
-      sim->trace(tfp, 99);
+      sim->trace(tfp, litex_sim_trace_levels());
       tfp->open("sim.vcd");
 #endif
   tfp->set_time_unit("1ps");
   tfp->set_time_resolution("1ps");
-  g_sim = sim;
 }
 
+#ifndef TRACE_FST
+static void litex_sim_flight_recorder_dump()
+{
+  static int last_trigger = 0;
+  int trigger;
+
+  if (tfp_start > main_time || main_time > tfp_end)
+    return;
+
+  if (main_time - ring_segment_start >= ring_segment_ps) {
+    ring_tfp->openNext(false);
+    ring_segment_start = main_time;
+  }
+  ring_tfp->dump((vluint64_t) main_time);
+
+  // sim_trace acts as the trigger, flush on its rising edge
+  trigger = g_sim->sim_trace != 0;
+  if ((trigger && !last_trigger) || ring_trigger) {
+    ring_trigger = 0;
+    litex_sim_flush_flight_recorder();
+  }
+  last_trigger = trigger;
+}
+#endif
+
 extern "C" void litex_sim_tracer_dump()
 {
   static int last_enabled = 0;
   bool dump_enabled = true;
 
+#ifndef TRACE_FST
+  if (ring_tfp != nullptr) {
+    litex_sim_flight_recorder_dump();
+    return;
+  }
+#endif
+
   if (g_sim != nullptr) {
     dump_enabled = g_sim->sim_trace != 0 ? true : false;
     if (last_enabled == 0 && dump_enabled) {
@@ -81,10 +252,329 @@ extern "C" int litex_sim_got_finish()
   return Verilated::gotFinish();
 }
 
+#ifdef LITEX_SIM_PGO
+// Training build of the profile-guided optimization: the model is destroyed
+// on exit for Verilator to write its --prof-pgo profile (profile.vlt)
+extern "C" void litex_sim_pgo_close(void *vsim)
+{
+  Vsim *sim = (Vsim*)vsim;
+
+  sim->final();
+  delete sim;
+  g_sim = nullptr;
+}
+#endif
+
+extern "C" void litex_sim_tracer_close()
+{
+#ifndef TRACE_FST
+  // Keep the window leading to the end of the simulation
+  if (ring_tfp != nullptr) {
+    litex_sim_flush_flight_recorder();
+    return;
+  }
+#endif
+  if (tfp != nullptr)
+    tfp->close();
+}
+
+#ifdef SAVABLE
+extern "C" int litex_sim_save_model(void *vsim, const char *filename)
+{
+  Vsim *sim = (Vsim*)vsim;
+  VerilatedSave os;
+
+  os.open(filename);
+  if (!os.isOpen())
+    return -1;
+  os << main_time;
+  os << *sim;
+  os.close();
+  return 0;
+}
+
+extern "C" int litex_sim_restore_model(void *vsim, const char *filename)
+{
+  Vsim *sim = (Vsim*)vsim;
+  VerilatedRestore os;
+
+  os.open(filename);
+  if (!os.isOpen())
+    return -1;
+  os >> main_time;
+  os >> *sim;
+  os.close();
+  litex_sim_pads_sync_out();
+  return 0;
+}
+#else
+extern "C" int litex_sim_save_model(void *vsim, const char *filename)
+{
+  fprintf(stderr, "Simulation was not built savable, can't save %s\n", filename);
+  return -1;
+}
+
+extern "C" int litex_sim_restore_model(void *vsim, const char *filename)
+{
+  fprintf(stderr, "Simulation was not built savable, can't restore %s\n", filename);
+  return -1;
+}
+#endif
+
+/* Finds a public memory of the top module, words of width bytes are stored
+ * in ent bytes wide elements, size is in bytes. */
+extern "C" int litex_sim_find_mem(const char *mem, uint8_t **data, uint32_t *width, uint32_t *ent, uint32_t *size)
+{
+  const VerilatedScope *scope;
+  VerilatedVar *var = nullptr;
+
+  scope = Verilated::scopeFind("TOP.sim");
+  if (scope)
+    var = scope->varFind(mem);
+  if (!var)
+    return -1;
+
+  *data = (uint8_t *)var->datap();
+  *width = (var->packed().elements() + 7) / 8;
+  *ent = var->entSize();
+  *size = (uint64_t)var->unpacked().elements() * *width;
+  return 0;
+}
+
+/*
+ * Memory preload: LITEX_SIM_PRELOAD=<mem>:<file>[:<offset>],... and the
+ * --load <mem>:<file>[:<offset>] options of Vsim map raw binary files and
+ * copy them straight into the Verilated memory arrays, over the contents
+ * loaded by $readmemh, so that one model runs any firmware. <mem> is a
+ * region name of litex_sim_mem_regions (rom, sram, main_ram...), a bus
+ * address within one of them, or the Verilog name of a memory. The
+ * memories have to be public (public_flat_rw in a .vlt file, see
+ * verilator.py). Words are little-endian, offsets are in bytes.
+ */
+static int litex_sim_preload_mem(const char *mem, const char *filename, uint64_t offset)
+{
+  struct stat st;
+  uint8_t *map;
+  uint8_t *data;
+  uint32_t width, ent, size;
+  uint64_t len, i;
+  int fd;
+
+  if (litex_sim_find_mem(mem, &data, &width, &ent, &size)) {
+    fprintf(stderr, "[preload] memory %s not found, is it public?\n", mem);
+    return -1;
+  }
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st)) {
+    fprintf(stderr, "[preload] can't open %s\n", filename);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  len = st.st_size;
+  if (len == 0) {
+    close(fd);
+    return 0;
+  }
+  map = (uint8_t *)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "[preload] can't map %s\n", filename);
+    return -1;
+  }
+
+  if (offset >= size) {
+    len = 0;
+  } else if (offset + len > size) {
+    fprintf(stderr, "[preload] %s truncated to the %lu bytes of %s\n", filename, (unsigned long)size, mem);
+    len = size - offset;
+  }
+
+  if (width == ent) {
+    memcpy(data + offset, map, len);
+  } else {
+    for (i = 0; i < len; i++)
+      data[((offset + i) / width) * ent + (offset + i) % width] = map[i];
+  }
+  munmap(map, st.st_size);
+  printf("[preload] %s: %lu bytes from %s\n", mem, (unsigned long)len, filename);
+  return 0;
+}
+
+/* Memory of a region name or bus address, target itself otherwise */
+static const char *litex_sim_preload_target(const char *target, uint64_t *offset)
+{
+  const struct litex_sim_mem_region *r;
+  uint8_t *data;
+  uint32_t width, ent, size;
+  uint64_t addr;
+  char *end;
+
+  for (r = litex_sim_mem_regions; r->name; r++) {
+    if (!strcmp(target, r->name))
+      return r->mem;
+  }
+  addr = strtoull(target, &end, 0);
+  if (end == target || *end)
+    return target;
+  for (r = litex_sim_mem_regions; r->name; r++) {
+    if (litex_sim_find_mem(r->mem, &data, &width, &ent, &size))
+      continue;
+    if (addr >= r->base && addr - r->base < size) {
+      *offset += addr - r->base;
+      return r->mem;
+    }
+  }
+  fprintf(stderr, "[preload] no memory at 0x%lx\n", (unsigned long)addr);
+  return NULL;
+}
+
+static int litex_sim_preload_entry(char *entry)
+{
+  const char *mem;
+  char *file, *offset;
+  uint64_t off;
+
+  file = strchr(entry, ':');
+  if (!file) {
+    fprintf(stderr, "[preload] invalid entry %s, expected <mem>:<file>[:<offset>]\n", entry);
+    return -1;
+  }
+  *file++ = 0;
+  offset = strchr(file, ':');
+  if (offset)
+    *offset++ = 0;
+  off = offset ? strtoull(offset, NULL, 0) : 0;
+  mem = litex_sim_preload_target(entry, &off);
+  if (!mem)
+    return -1;
+  return litex_sim_preload_mem(mem, file, off);
+}
+
+extern "C" int litex_sim_preload(void *vsim, int argc, char *argv[])
+{
+  char *env = getenv("LITEX_SIM_PRELOAD");
+  char *list, *entry, *saveptr;
+  bool loaded = false;
+  int ret = 0;
+  int i;
+
+  for (i = 1; i < argc && !ret; i++) {
+    if (strcmp(argv[i], "--load"))
+      continue;
+    if (++i == argc) {
+      fprintf(stderr, "[preload] --load expects <mem>:<file>[:<offset>]\n");
+      return -1;
+    }
+    // Let the initial blocks load the memory init files first
+    if (!loaded)
+      litex_sim_eval(vsim, 0);
+    loaded = true;
+    list = strdup(argv[i]);
+    ret = litex_sim_preload_entry(list);
+    free(list);
+  }
+  if (!env || ret)
+    return ret;
+
+  if (!loaded)
+    litex_sim_eval(vsim, 0);
+  list = strdup(env);
+  for (entry = strtok_r(list, ",", &saveptr); entry; entry = strtok_r(NULL, ",", &saveptr)) {
+    ret = litex_sim_preload_entry(entry);
+    if (ret)
+      break;
+  }
+  free(list);
+  return ret;
+}
+
 #if VM_COVERAGE
+/*
+ * Coverage is written at exit to LITEX_SIM_COVERAGE (default sim.cov, %p
+ * expands to the pid to give parallel runs their own shard).
+ *
+ * With LITEX_SIM_COVERAGE_WINDOW=<start>:<end> (ps), only what is covered
+ * within the window is kept: the counters are cleared when it opens and
+ * written when it closes. SIGRTMIN writes the counters to the next shard
+ * (<name>_<n>.cov) and clears them. Shards add up to the whole window when
+ * merged with verilator_coverage.
+ */
+static std::string cov_name = "sim.cov";
+static int cov_shards = 0;
+static int cov_open = 1;
+static uint64_t cov_end = UINT64_MAX;
+
+static void litex_sim_coverage_sigrtmin(int sig)
+{
+  cov_trigger = 1;
+}
+
+static void litex_sim_coverage_write()
+{
+  std::string name = cov_name;
+  size_t dot = name.rfind('.');
+  size_t slash = name.rfind('/');
+
+  if (cov_shards > 0) {
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+      dot = name.size();
+    name.insert(dot, "_" + std::to_string(cov_shards));
+  }
+  cov_shards++;
+  VerilatedCov::write(name.c_str());
+  VerilatedCov::zero();
+  fprintf(stderr, "[coverage] wrote %s\n", name.c_str());
+}
+
+static void litex_sim_coverage_poll()
+{
+  if (cov_trigger) {
+    cov_trigger = 0;
+    if (cov_open)
+      litex_sim_coverage_write();
+  }
+  if (main_time < cov_next_ps)
+    return;
+  if (!cov_open) {
+    VerilatedCov::zero();
+    cov_open = 1;
+    cov_next_ps = cov_end;
+  } else {
+    litex_sim_coverage_write();
+    cov_open = 0;
+    cov_next_ps = UINT64_MAX;
+  }
+}
+
+extern "C" void litex_sim_coverage_init()
+{
+  char *name = getenv("LITEX_SIM_COVERAGE");
+  char *window = getenv("LITEX_SIM_COVERAGE_WINDOW");
+  char *end;
+  size_t pos;
+
+  if (name && *name) {
+    cov_name = name;
+    pos = cov_name.find("%p");
+    if (pos != std::string::npos)
+      cov_name.replace(pos, 2, std::to_string(getpid()));
+  }
+  if (window) {
+    cov_next_ps = strtoull(window, &end, 0);
+    cov_end = *end == ':' ? strtoull(end + 1, NULL, 0) : UINT64_MAX;
+    cov_open = 0;
+  }
+#ifdef SIGRTMIN
+  signal(SIGRTMIN, litex_sim_coverage_sigrtmin);
+#endif
+}
+
 extern "C" void litex_sim_coverage_dump()
 {
-  VerilatedCov::write("sim.cov");
+  if (cov_open)
+    litex_sim_coverage_write();
 }
 #endif
 
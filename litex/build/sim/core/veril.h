@@ -5,24 +5,52 @@
 
 #include <stdint.h>
 
+/* SoC memories loadable by region name or bus address (--load), the table
+ * is generated in sim_init.cpp and ends with a NULL name */
+struct litex_sim_mem_region {
+  const char *name;
+  const char *mem;
+  uint64_t base;
+};
+
 #ifdef __cplusplus
 extern "C" void litex_sim_init_cmdargs(int argc, char *argv[]);
 extern "C" void litex_sim_eval(void *vsim, uint64_t time_ps);
 extern "C" void litex_sim_init_tracer(void *vsim, long start, long end);
 extern "C" void litex_sim_tracer_dump();
+extern "C" void litex_sim_tracer_close();
 extern "C" int litex_sim_got_finish();
+extern "C" int litex_sim_save_model(void *vsim, const char *filename);
+extern "C" int litex_sim_restore_model(void *vsim, const char *filename);
+extern "C" int litex_sim_preload(void *vsim, int argc, char *argv[]);
+extern "C" const struct litex_sim_mem_region litex_sim_mem_regions[];
+extern "C" int litex_sim_find_mem(const char *mem, uint8_t **data, uint32_t *width, uint32_t *ent, uint32_t *size);
 #if VM_COVERAGE
+extern "C" void litex_sim_coverage_init();
 extern "C" void litex_sim_coverage_dump();
 #endif
+#ifdef LITEX_SIM_PGO
+extern "C" void litex_sim_pgo_close(void *vsim);
+#endif
 #else
 void litex_sim_eval(void *vsim, uint64_t time_ps);
 void litex_sim_init_tracer(void *vsim);
 void litex_sim_tracer_dump();
+void litex_sim_tracer_close();
 int litex_sim_got_finish();
+int litex_sim_save_model(void *vsim, const char *filename);
+int litex_sim_restore_model(void *vsim, const char *filename);
+int litex_sim_preload(void *vsim, int argc, char *argv[]);
+extern const struct litex_sim_mem_region litex_sim_mem_regions[];
+int litex_sim_find_mem(const char *mem, uint8_t **data, uint32_t *width, uint32_t *ent, uint32_t *size);
 void litex_sim_init_cmdargs(int argc, char *argv[]);
 #if VM_COVERAGE
+void litex_sim_coverage_init();
 void litex_sim_coverage_dump();
 #endif
+#ifdef LITEX_SIM_PGO
+void litex_sim_pgo_close(void *vsim);
+#endif
 #endif
 
 #endif
@@ -6,13 +6,19 @@
 # This file is Copyright (c) 2020 Antmicro <www.antmicro.com>
 # SPDX-License-Identifier: BSD-2-Clause
 
-from migen.fhdl.structure import Signal, If, Finish
+import os
+from functools import reduce
+from operator import or_
+
+from migen.fhdl.structure import Signal, If, Mux, Finish, ClockSignal
 from migen.fhdl.module import Module
+from migen.fhdl.specials import Instance
 from migen.genlib.record import Record
 
 from litex.build.generic_platform import GenericPlatform, Pins
 from litex.build.sim import common, verilator
-from litex.soc.interconnect.csr import AutoCSR, CSR, CSRStorage
+from litex.soc.interconnect.csr import AutoCSR, CSR, CSRStorage, CSRStatus
+from litex.soc.interconnect import stream
 
 
 class SimPlatform(GenericPlatform):
@@ -88,3 +94,129 @@ class SimFinish(Module, AutoCSR):
         # set from software
         self.finish = CSR()
         self.sync += If(self.finish.re, Finish())
+
+class SimIdle(Module, AutoCSR):
+    """Let the simulator skip the cycles software spends waiting
+
+    Software sets ``idle`` around its wait loops, and optionally ``cycles`` to the length of the
+    wait. While idle is set and no wake signal (pending interrupt, received UART data...) is
+    active, the idle sim module lets the sim core jump over the cycles left until the end of the
+    wait and until the timer reaches 0, without evaluating the model. The timer (and its uptime)
+    is then advanced by the skipped cycles. Other counters (CPU cycle counters, machine timers)
+    do not see the skipped cycles.
+    """
+    def __init__(self, pads, timer=None, wake=[]):
+        # set from software
+        self.idle   = CSRStorage()
+        self.cycles = CSRStorage(32)
+
+        # # #
+
+        waking = Signal()
+        self.comb += waking.eq(reduce(or_, [w != 0 for w in wake], 0))
+        self.comb += pads.idle.eq(self.idle.storage & ~waking)
+
+        # Cycles left in the wait (when cycles is set), never skipped past
+        left   = Signal(32)
+        budget = Signal(32)
+        self.sync += [
+            If(self.cycles.re,
+                left.eq(self.cycles.storage)
+            ).Elif(left != 0,
+                left.eq(left - 1 - pads.skip)
+            )
+        ]
+        self.comb += [
+            If(self.cycles.storage == 0,
+                budget.eq(2**32 - 1)
+            ).Elif(left != 0,
+                budget.eq(left - 1)
+            )
+        ]
+        if timer is not None:
+            timer.add_skip(pads.skip)
+            self.comb += pads.budget.eq(Mux(timer.skip_budget < budget, timer.skip_budget, budget))
+        else:
+            self.comb += pads.budget.eq(budget)
+
+class SimLoad(Module, AutoCSR):
+    """Load a host file into simulated memory from software
+
+    The request (file index, destination address) is handed to the sim
+    module behind the memory (wishbone_memory) that writes the file into its
+    store by backdoor and returns the loaded length, in zero simulated time.
+    Software polls busy, then reads length (error set if the file could not
+    be loaded).
+    """
+    def __init__(self, pads, base=0):
+        # set from software
+        self.index   = CSRStorage(8)
+        self.address = CSRStorage(32)
+        self.start   = CSR()
+        # set by simulator
+        self.busy    = CSRStatus()
+        self.length  = CSRStatus(32)
+        self.error   = CSRStatus()
+
+        # # #
+
+        busy = self.busy.status
+        self.comb += [
+            pads.index.eq(self.index.storage),
+            pads.addr.eq(self.address.storage - base),
+            pads.start.eq(busy),
+        ]
+        self.sync += [
+            If(self.start.re,
+                busy.eq(1)
+            ).Elif(busy & pads.done,
+                busy.eq(0),
+                self.length.status.eq(pads.length),
+                self.error.status.eq(pads.error),
+            )
+        ]
+
+# DPI channels -------------------------------------------------------------------------------------
+
+def _add_dpi_source(platform):
+    platform.add_source(os.path.join(os.path.abspath(os.path.dirname(__file__)), "verilog", "litex_sim_dpi.sv"))
+
+class SimDPISource(Module):
+    """Stream fed by a sim module through a DPI channel
+
+    One data_width bits word is transferred per clock with a direct call from the model into the
+    sim core (see core/dpi.h), without going through module pads and ticks.
+    """
+    def __init__(self, platform, channel, data_width=8):
+        assert data_width % 8 == 0 and data_width <= 64
+        self.source = source = stream.Endpoint([("data", data_width)])
+
+        # # #
+
+        self.specials += Instance("litex_sim_dpi_source",
+            p_CHANNEL = channel,
+            p_WIDTH   = data_width,
+            i_clk     = ClockSignal(),
+            o_valid   = source.valid,
+            i_ready   = source.ready,
+            o_data    = source.data,
+        )
+        _add_dpi_source(platform)
+
+class SimDPISink(Module):
+    """Stream drained to a sim module through a DPI channel, see SimDPISource"""
+    def __init__(self, platform, channel, data_width=8):
+        assert data_width % 8 == 0 and data_width <= 64
+        self.sink = sink = stream.Endpoint([("data", data_width)])
+
+        # # #
+
+        self.specials += Instance("litex_sim_dpi_sink",
+            p_CHANNEL = channel,
+            p_WIDTH   = data_width,
+            i_clk     = ClockSignal(),
+            i_valid   = sink.valid,
+            o_ready   = sink.ready,
+            i_data    = sink.data,
+        )
+        _add_dpi_source(platform)
@@ -7,6 +7,9 @@
 
 import os
 import sys
+import time
+import shutil
+import hashlib
 import subprocess
 from shutil import which
 
@@ -52,11 +55,15 @@ void litex_sim_init(void **out);
     tools.write_to_file("sim_header.h", content)
 
 
-def _generate_sim_cpp_struct(name, index, siglist):
+def _generate_sim_cpp_struct(name, index, siglist, packed_pads=False):
     content = ''
 
     for i, (signame, sigbits, sigfname) in enumerate(siglist):
         content += '    {}{}[{}].signal = &sim->{};\n'.format(name, index, i, sigfname)
+    if packed_pads:
+        sizes = ", ".join("sizeof(sim->{})".format(sigfname) for _, _, sigfname in siglist)
+        content += '    {{\n        const size_t sizes[] = {{ {} }};\n'.format(sizes)
+        content += '        litex_sim_pads_pack({}{}, sizes);\n    }}\n'.format(name, index)
 
     idx_int = 0 if not index else int(index)
     content += '    litex_sim_register_pads({}{}, (char*)"{}", {});\n\n'.format(name, index, name, idx_int)
@@ -64,7 +71,7 @@ def _generate_sim_cpp_struct(name, index, siglist):
     return content
 
 
-def _generate_sim_cpp(platform, trace=False, trace_start=0, trace_end=-1):
+def _generate_sim_cpp(platform, trace=False, trace_start=0, trace_end=-1, mems=[], packed_pads=False):
     content = """\
 #include <stdio.h>
 #include <stdlib.h>
@@ -72,10 +79,19 @@ def _generate_sim_cpp(platform, trace=False, trace_start=0, trace_end=-1):
 #include "Vsim.h"
 #include <verilated.h>
 #include "sim_header.h"
+#include "veril.h"
 
 extern "C" void litex_sim_init_tracer(void *vsim, long start, long end);
 extern "C" void litex_sim_tracer_dump();
 
+extern "C" const struct litex_sim_mem_region litex_sim_mem_regions[] = {
+"""
+    for name, mem, base in mems:
+        content += "    {{\"{}\", \"{}\", 0x{:x}}},\n".format(name, mem, base)
+    content += """\
+    {NULL, NULL, 0},
+};
+
 extern "C" void litex_sim_dump()
 {
 """
@@ -96,7 +112,7 @@ extern "C" void litex_sim_init(void **out)
 
 """.format(trace_start, trace_end)
     for args in platform.sim_requested:
-        content += _generate_sim_cpp_struct(*args)
+        content += _generate_sim_cpp_struct(*args, packed_pads=packed_pads)
 
     content += """\
     *out=sim;
@@ -105,7 +121,7 @@ extern "C" void litex_sim_init(void **out)
     tools.write_to_file("sim_init.cpp", content)
 
 
-def _generate_sim_variables(include_paths):
+def _generate_sim_variables(include_paths, sched_first=None):
     tapcfg_dir = get_data_mod("misc", "tapcfg").data_location
     include = ""
     for path in include_paths:
@@ -115,6 +131,9 @@ SRC_DIR = {}
 INC_DIR = {}
 TAPCFG_DIRECTORY = {}
 """.format(core_directory, include, tapcfg_dir)
+    # Static schedule: number of tickfirst sessions of the sim config, a constant of the core loop.
+    if sched_first is not None:
+        content += "CFLAGS += -DLITEX_SIM_SCHED_FIRST={}\n".format(sched_first)
     tools.write_to_file("variables.mak", content)
 
 
@@ -123,25 +142,126 @@ def _generate_sim_config(config):
     tools.write_to_file("sim_config.js", content)
 
 
-def _build_sim(build_name, sources, threads, coverage, opt_level="O3", trace_fst=False):
+def _generate_sim_public(names):
+    # Memories accessed directly by the sim core (preload, --load, fast-forward) have to be visible to it.
+    content = ""
+    for name in sorted(set(names)):
+        content += "public_flat_rw -module \"sim\" -var \"{}\"\n".format(name)
+    return content
+
+def _generate_sim_trace_scopes(scopes):
+    # Only the signals/scopes matching the patterns (relative to the sim top, * and ? wildcards) are
+    # traced, the others are not even computed for the trace. Requires Verilator 5.
+    content = "tracing_off -scope \"sim.*\"\n"
+    for scope in scopes:
+        content += "tracing_on -scope \"sim.{}\"\n".format(scope)
+    return content
+
+def _generate_sim_vlt(public, trace_scopes):
+    content = ""
+    if public:
+        content += _generate_sim_public(public)
+    if trace_scopes:
+        content += _generate_sim_trace_scopes(trace_scopes)
+    if not content:
+        return None
+    tools.write_to_file("sim.vlt", "`verilator_config\n" + content)
+    return "sim.vlt"
+
+def _mem_name(mem, ns):
+    return mem if isinstance(mem, str) else ns.get_name(mem)
+
+def _generate_sim_preload(preload, ns):
+    entries = []
+    for mem, filename, offset in preload:
+        entries.append("{}:{}:{}".format(_mem_name(mem, ns), filename, offset))
+    return ",".join(entries)
+
+def _generate_sim_fast_forward(fast_forward, ns):
+    args = []
+    for k in ["pc", "insns", "reset", "uart", "hold"]:
+        if fast_forward.get(k, None) is not None:
+            args.append("{}={}".format(k, hex(fast_forward[k])))
+    mems = ["{}:{}".format(_mem_name(mem, ns), hex(base)) for mem, base in fast_forward["mems"]]
+    return ",".join(args), ",".join(mems)
+
+# Coverage: True for all the Verilator coverage types, or a list of "line", "toggle" and "user", the
+# toggle coverage being the most expensive.
+def _coverage_types(coverage):
+    if coverage is True:
+        return "1"
+    if isinstance(coverage, str):
+        coverage = [coverage]
+    for t in coverage:
+        if t not in ["line", "toggle", "user"]:
+            raise ValueError("Unsupported coverage type {}.".format(t))
+    return " ".join(coverage)
+
+def merge_coverage(files, output="sim.cov"):
+    """Merge the coverage shards of several runs (or of a run) into output"""
+    r = subprocess.call(["verilator_coverage", "--write", output] + list(files))
+    if r != 0:
+        raise OSError("verilator_coverage failed with {}".format(r))
+
+def _build_sim(build_name, sources, threads, coverage, opt_level="O3", trace_fst=False, trace_threads=0, savable=False,
+    output_split=None, vlt=None, static_modules=[], pgo=None):
     makefile = os.path.join(core_directory, 'Makefile')
     cc_srcs = []
     for filename, language, library in sources:
         cc_srcs.append("--cc " + filename + " ")
     build_script_contents = """\
 rm -rf obj_dir/
-make -C . -f {} {} {} {} {} {}
+make -C . -f {} {} {} {} {} {} {} {} {} {} {} {}
 """.format(makefile,
     "CC_SRCS=\"{}\"".format("".join(cc_srcs)),
     "THREADS={}".format(threads) if int(threads) > 1 else "",
-    "COVERAGE=1" if coverage else "",
+    "COVERAGE=\"{}\"".format(_coverage_types(coverage)) if coverage else "",
     "OPT_LEVEL={}".format(opt_level),
     "TRACE_FST=1" if trace_fst else "",
+    "TRACE_THREADS={}".format(trace_threads) if int(trace_threads) > 0 else "",
+    "SAVABLE=1" if savable else "",
+    "OUTPUT_SPLIT={} OUTPUT_SPLIT_CFUNCS={}".format(output_split, output_split//10) if output_split else "",
+    "VLT={}".format(vlt) if vlt else "",
+    "STATIC_MODULES=\"{}\"".format(" ".join(static_modules)) if static_modules else "",
+    "PGO={}".format(pgo) if pgo else "",
     )
     build_script_file = "build_" + build_name + ".sh"
     tools.write_to_file(build_script_file, build_script_contents, force_unix=True)
 
-def _compile_sim(build_name, verbose):
+# Build cache: the key hashes everything the compiled model depends on, the build script (Verilator
+# and compiler options), the design sources and Verilog includes, the generated glue and the sim core
+# and modules sources. sim_config.js and memory init files ($readmemh) are only read at run time, so
+# changing the firmware or the module args reuses the model.
+_build_key_file = os.path.join("obj_dir", ".litex_build_key")
+
+def _sim_build_key(build_name, sources, include_paths, vlt=None):
+    files = [filename for filename, language, library in sources]
+    files += ["build_" + build_name + ".sh", "sim_header.h", "sim_init.cpp", "variables.mak"]
+    if vlt is not None:
+        files.append(vlt)
+    for path in include_paths:
+        files += sorted(os.path.join(path, f) for f in os.listdir(path)
+            if os.path.splitext(f)[1] in [".v", ".vh", ".sv", ".svh"])
+    for root, dirs, names in os.walk(core_directory):
+        dirs.sort()
+        files += [os.path.join(root, f) for f in sorted(names)]
+    h = hashlib.sha256()
+    for filename in files:
+        h.update(filename.encode())
+        with open(filename, "rb") as f:
+            h.update(f.read())
+    return h.hexdigest()
+
+def _sim_cached(key):
+    if key is None or not os.path.exists(os.path.join("obj_dir", "Vsim")) or not os.path.exists(_build_key_file):
+        return False
+    with open(_build_key_file) as f:
+        return f.read() == key
+
+def _compile_sim(build_name, verbose, key=None):
+    if _sim_cached(key):
+        print("[sim] design unchanged, reusing obj_dir/Vsim")
+        return
     build_script_file = "build_" + build_name + ".sh"
     p = subprocess.Popen(["bash", build_script_file], stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
     output, _ = p.communicate()
@@ -154,9 +274,76 @@ def _compile_sim(build_name, verbose):
         raise OSError("Subprocess failed with {}\n{}".format(p.returncode, "\n".join(error_messages)))
     if verbose:
         print(output)
-
-def _run_sim(build_name, as_root=False, interactive=True):
+    if key is not None:
+        tools.write_to_file(_build_key_file, key)
+
+def _time_sim(run_ps, run_env={}):
+    env = dict(os.environ, **run_env)
+    env["LITEX_SIM_RUN_PS"] = str(run_ps)
+    # Tuning/training runs must not overwrite the stimulus log of the actual run.
+    env.pop("LITEX_SIM_STIM_RECORD", None)
+    start = time.monotonic()
+    r = subprocess.call([os.path.join("obj_dir", "Vsim")], env=env,
+        stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL)
+    if r != 0:
+        raise OSError("Tuning run failed with {}".format(r))
+    return time.monotonic() - start
+
+def _tune_sim(build_name, sources, coverage, opt_level, trace_fst, trace_threads, savable, tune_ps, verbose,
+    vlt=None, run_env={}, static_modules=[]):
+    # Smaller output splits give more C++ files and better parallel compilation on large hosts.
+    cpus = os.cpu_count() or 1
+    output_split = max(500, 5000*8//cpus) if cpus > 8 else None
+
+    def measure(threads, opt_level):
+        _build_sim(build_name, sources, threads, coverage, opt_level, trace_fst, trace_threads, savable,
+            output_split, vlt, static_modules)
+        _compile_sim(build_name, verbose=False)
+        elapsed = _time_sim(tune_ps, run_env)
+        if verbose:
+            print("[tune] threads={} opt_level={}: {:.3f}s".format(threads, opt_level, elapsed))
+        return elapsed
+
+    # Thread count: powers of two up to the number of host cores, stop once adding threads hurts
+    # (synchronization costs dominate past the design's available parallelism).
+    best_threads, best_time = 1, measure(1, opt_level)
+    threads = 2
+    while threads <= cpus:
+        elapsed = measure(threads, opt_level)
+        if elapsed >= best_time:
+            break
+        best_threads, best_time = threads, elapsed
+        threads *= 2
+
+    # Optimization level, at the selected thread count.
+    best_opt_level = opt_level
+    for candidate in ["O2", "O3"]:
+        if candidate == opt_level:
+            continue
+        elapsed = measure(best_threads, candidate)
+        if elapsed < best_time:
+            best_opt_level, best_time = candidate, elapsed
+
+    print("[tune] selected threads={} opt_level={}".format(best_threads, best_opt_level))
+    return best_threads, best_opt_level, output_split
+
+# Profile-guided optimization: training build, instrumented, and run of pgo_ps of simulated time (the
+# firmware/workload of the sim config), the next build (PGO=use) being optimized with the collected
+# GCC profiles, LTO and, for multithreaded models, the Verilator scheduling profile (profile.vlt).
+def _pgo_sim(build_name, sources, threads, coverage, opt_level, trace_fst, trace_threads, savable, pgo_ps,
+    verbose, output_split=None, vlt=None, run_env={}, static_modules=[]):
+    shutil.rmtree("pgo", ignore_errors=True)
+    if os.path.exists("profile.vlt"):
+        os.remove("profile.vlt")
+    _build_sim(build_name, sources, threads, coverage, opt_level, trace_fst, trace_threads, savable,
+        output_split, vlt, static_modules, pgo="gen")
+    _compile_sim(build_name, verbose=False)
+    elapsed = _time_sim(pgo_ps, run_env)
+    print("[pgo] training run of {} ps: {:.3f}s".format(pgo_ps, elapsed))
+
+def _run_sim(build_name, as_root=False, interactive=True, env={}):
     run_script_contents = "sudo " if as_root else ""
+    run_script_contents += "".join("{}={} ".format(k, v) for k, v in env.items())
     run_script_contents += "obj_dir/Vsim"
     run_script_file = "run_" + build_name + ".sh"
     tools.write_to_file(run_script_file, run_script_contents, force_unix=True)
@@ -184,12 +371,32 @@ class SimVerilatorToolchain:
             verbose          = True,
             sim_config       = None,
             coverage         = False,
+            coverage_file    = None,
+            coverage_window  = None,
+            stats            = None,
+            affinity         = None,
             opt_level        = "O0",
             trace            = False,
             trace_fst        = False,
             trace_start      = 0,
             trace_end        = -1,
+            trace_threads    = None,
+            trace_scopes     = None,
+            trace_levels     = None,
+            savable          = False,
+            tune_ps          = int(1e9),
+            pgo              = False,
+            pgo_ps           = int(1e9),
+            stim_record      = None,
+            stim_replay      = None,
+            preload          = None,
+            mems             = None,
+            fast_forward     = None,
+            static_modules   = False,
+            static_schedule  = False,
+            cache            = True,
             regular_comb     = False,
+            packed_pads      = False,
             interactive      = True,
             pre_run_callback = None):
 
@@ -197,6 +404,34 @@ class SimVerilatorToolchain:
         os.makedirs(build_dir, exist_ok=True)
         cwd = os.getcwd()
         os.chdir(build_dir)
+        run_env = {}
+        build_key = None
+
+        # Coverage output: coverage_file may contain %p (pid) for parallel runs, coverage_window is a
+        # (start, end) ps tuple restricting the collection.
+        if coverage_file is not None:
+            run_env["LITEX_SIM_COVERAGE"] = coverage_file
+        if coverage_window is not None:
+            run_env["LITEX_SIM_COVERAGE_WINDOW"] = "{}:{}".format(*coverage_window)
+        # Simulation rate reported on stderr every stats seconds, and summed up at the end.
+        if stats is not None:
+            run_env["LITEX_SIM_STATS"] = str(stats)
+        # Thread placement, "<role>=<cpus>;..." with roles sim, io, verilator and workers and cpus
+        # lists of CPUs, ranges and NUMA nodes ("0,2-3", "node1"), see core/affinity.c.
+        if affinity is not None:
+            run_env["LITEX_SIM_AFFINITY"] = affinity
+        # Traced hierarchy depth below the top, the sim module signals being selected at build time
+        # by trace_scopes (list of signal/scope name patterns).
+        if trace_levels is not None:
+            run_env["LITEX_SIM_TRACE_LEVELS"] = str(trace_levels)
+        # External stimulus (serial2tcp/jtagremote input, Ethernet frames) logged with its simulated
+        # time to stim_record, or injected back from stim_replay with no socket/TAP, see core/stim.h.
+        if stim_record is not None and stim_replay is not None:
+            raise ValueError("stim_record and stim_replay are exclusive.")
+        if stim_record is not None:
+            run_env["LITEX_SIM_STIM_RECORD"] = os.path.abspath(os.path.join(cwd, stim_record))
+        if stim_replay is not None:
+            run_env["LITEX_SIM_STIM_REPLAY"] = os.path.abspath(os.path.join(cwd, stim_replay))
 
         if build:
             # Finalize design
@@ -217,15 +452,74 @@ class SimVerilatorToolchain:
 
             # Generate cpp header/main/variables
             _generate_sim_h(platform)
-            _generate_sim_cpp(platform, trace, trace_start, trace_end)
-            _generate_sim_variables(platform.verilog_include_paths)
+            # Loadable memories: (region name, memory, base address) tuples that Vsim --load options
+            # can target by name or address.
+            mems = [(name, _mem_name(mem, v_output.ns), base) for name, mem, base in (mems or [])]
+            # Packed pads: the module-facing signals of each interface live in a contiguous block
+            # synchronized with the model around eval() instead of being scattered in the model.
+            _generate_sim_cpp(platform, trace, trace_start, trace_end, mems, packed_pads)
+            sched_first = None
+            if static_schedule and sim_config:
+                sched_first = sum(1 for m in sim_config.modules if m.get("tickfirst", False))
+            _generate_sim_variables(platform.verilog_include_paths, sched_first)
 
             # Generate sim config
             if sim_config:
                 _generate_sim_config(sim_config)
 
+            # Generate memory preload config: (memory, raw binary file path, byte offset) tuples loaded
+            # by the sim core at startup instead of $readmemh init files.
+            public = [mem for _, mem, _ in mems]
+            if preload:
+                run_env["LITEX_SIM_PRELOAD"] = _generate_sim_preload(preload, v_output.ns)
+                public += [_mem_name(mem, v_output.ns) for mem, _, _ in preload]
+
+            # Generate fast-forward config: software runs on the sim core ISS until pc (or insns
+            # instructions), directly on the mems [(memory, base address)], then the state is handed
+            # to the RTL CPU through a trampoline at the reset address.
+            if fast_forward:
+                run_env["LITEX_SIM_FF"], run_env["LITEX_SIM_FF_MEMS"] = _generate_sim_fast_forward(
+                    fast_forward, v_output.ns)
+                public += [_mem_name(mem, v_output.ns) for mem, _ in fast_forward["mems"]]
+            vlt = _generate_sim_vlt(public, trace_scopes)
+
+            # Modules linked into the simulator instead of loaded at startup: True for all the
+            # modules of the sim config, or a list of module names.
+            if static_modules is True:
+                static_modules = sorted(set(m["module"] for m in sim_config.modules)) if sim_config else []
+            static_modules = static_modules or []
+
             # Build
-            _build_sim(build_name, platform.sources, threads, coverage, opt_level, trace_fst)
+            # FST compression/writes are offloaded to a separate thread by default, Verilator only
+            # supports threaded trace writers for FST.
+            if trace_threads is None:
+                trace_threads = 1 if trace_fst else 0
+            if int(trace_threads) > 0 and not trace_fst:
+                raise ValueError("Threaded trace writer requires FST tracing (trace_fst).")
+            # threads="auto" times short runs (tune_ps of simulated time) of candidate builds and keeps
+            # the fastest thread count and optimization level for this design and host.
+            output_split = None
+            if threads == "auto":
+                if which("verilator") is None:
+                    raise OSError("Verilator is required to tune the simulation build.")
+                threads, opt_level, output_split = _tune_sim(build_name, platform.sources, coverage,
+                    opt_level, trace_fst, trace_threads, savable, tune_ps, verbose, vlt, run_env, static_modules)
+            _build_sim(build_name, platform.sources, threads, coverage, opt_level, trace_fst, trace_threads, savable,
+                output_split, vlt, static_modules, "use" if pgo else None)
+
+            # Skip the Verilator/C++ compilation when the model was already built from the same design.
+            if cache:
+                build_key = _sim_build_key(build_name, platform.sources, platform.verilog_include_paths, vlt)
+
+            # pgo: the build above is the final one, optimized with the profiles of a training run (not
+            # repeated while the design is unchanged).
+            if pgo and not _sim_cached(build_key):
+                if which("verilator") is None:
+                    raise OSError("Verilator is required for the profile-guided simulation build.")
+                _pgo_sim(build_name, platform.sources, threads, coverage, opt_level, trace_fst, trace_threads,
+                    savable, pgo_ps, verbose, output_split, vlt, run_env, static_modules)
+                _build_sim(build_name, platform.sources, threads, coverage, opt_level, trace_fst, trace_threads,
+                    savable, output_split, vlt, static_modules, "use")
 
         # Run
         if run:
@@ -236,13 +530,16 @@ class SimVerilatorToolchain:
                 msg += "- Install Verilator.\n"
                 msg += "- Add Verilator toolchain to your $PATH."
                 raise OSError(msg)
-            _compile_sim(build_name, verbose)
+            _compile_sim(build_name, verbose, build_key)
+            # Ethernet modules need root for their TAP interface, unless replaying/recording captures,
+            # attached to a shared memory switch or replaying a stimulus log.
             run_as_root = False
-            if sim_config.has_module("ethernet") \
-               or sim_config.has_module("xgmii_ethernet") \
-               or sim_config.has_module("gmii_ethernet"):
-                run_as_root = True
-            _run_sim(build_name, as_root=run_as_root, interactive=interactive)
+            for module in ([] if stim_replay is not None else sim_config.modules):
+                if module["module"] in ["ethernet", "xgmii_ethernet", "gmii_ethernet"]:
+                    module_args = module.get("args", {})
+                    if module_args.get("backend", "tap") == "tap" and not {"pcap_in", "pcap_out"} & set(module_args.keys()):
+                        run_as_root = True
+            _run_sim(build_name, as_root=run_as_root, interactive=interactive, env=run_env)
 
         os.chdir(cwd)
 
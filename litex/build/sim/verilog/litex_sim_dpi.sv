@@ -0,0 +1,58 @@
+// DPI-C stream endpoints of the simulator channels (see core/dpi.h): each
+// clock moves one WIDTH bits word (WIDTH multiple of 8, up to 64) between the
+// stream and the named host channel, bytes in little-endian order.
+
+import "DPI-C" function int litex_sim_dpi_open(input string name);
+import "DPI-C" function int litex_sim_dpi_read(input int chan, output longint data, input int len);
+import "DPI-C" function void litex_sim_dpi_write(input int chan, input longint data, input int len);
+import "DPI-C" function int litex_sim_dpi_space(input int chan);
+
+module litex_sim_dpi_source #(
+  parameter CHANNEL = "",
+  parameter WIDTH   = 8
+) (
+  input                  clk,
+  output reg             valid,
+  input                  ready,
+  output reg [WIDTH-1:0] data
+);
+  integer chan;
+  longint word;
+
+  initial begin
+    chan  = litex_sim_dpi_open(CHANNEL);
+    valid = 1'b0;
+    data  = {WIDTH{1'b0}};
+  end
+
+  always @(posedge clk) begin
+    if (!valid || ready) begin
+      valid <= litex_sim_dpi_read(chan, word, WIDTH/8) != 0;
+      data  <= word[WIDTH-1:0];
+    end
+  end
+endmodule
+
+module litex_sim_dpi_sink #(
+  parameter CHANNEL = "",
+  parameter WIDTH   = 8
+) (
+  input             clk,
+  input             valid,
+  output reg        ready,
+  input [WIDTH-1:0] data
+);
+  integer chan;
+
+  initial begin
+    chan  = litex_sim_dpi_open(CHANNEL);
+    ready = 1'b0;
+  end
+
+  always @(posedge clk) begin
+    if (valid && ready)
+      litex_sim_dpi_write(chan, data, WIDTH/8);
+    // Room left for the next word
+    ready <= litex_sim_dpi_space(chan) >= WIDTH/8;
+  end
+endmodule
@@ -8,4 +8,11 @@
 
 #define CSR_DCACHE_INFO 0xCC0
 
+/* Performance counters (libbase/perf, -DPERF_COUNTERS): inhibited at reset,
+   one mhpmcounter by default (NUM_MHPMCOUNTERS), mhpmevent = event bit */
+#define PERF_MCOUNTINHIBIT
+#define PERF_HPM_COUNT  1
+#define PERF_HPM3_NAME  "I-fetch miss cycles"
+#define PERF_HPM3_EVENT (1 << 4)
+
 #endif	/* CSR_DEFS__H */
@@ -0,0 +1,10 @@
+#ifndef CSR_DEFS__H
+#define CSR_DEFS__H
+
+/* Performance counters (libbase/perf, -DPERF_COUNTERS): hard-wired events,
+   read as zero unless the core is built with MHPMCounterNum > 0 */
+#define PERF_HPM_COUNT  2
+#define PERF_HPM3_NAME  "LSU wait cycles"
+#define PERF_HPM4_NAME  "fetch wait cycles"
+
+#endif	/* CSR_DEFS__H */
@@ -59,6 +59,22 @@ __attribute__((unused)) static void flush_cpu_dcache(void)
 		mtspr(SPR_DCBIR, i);
 }
 
+/* Invalidates the blocks of [addr, addr + size), used by libbase/cache */
+#define CPU_DCACHE_RANGE
+__attribute__((unused)) static void flush_cpu_dcache_range(unsigned long addr, unsigned long size)
+{
+	unsigned long dccfgr;
+	unsigned long cache_block_size;
+	unsigned long end;
+
+	dccfgr = mfspr(SPR_DCCFGR);
+	cache_block_size = (dccfgr & SPR_DCCFGR_CBS) ? 32 : 16;
+	end = addr + size;
+
+	for (addr &= ~(cache_block_size - 1); addr < end; addr += cache_block_size)
+		mtspr(SPR_DCBIR, addr);
+}
+
 void flush_l2_cache(void);
 
 void busy_wait(unsigned int ms);
@@ -122,6 +122,7 @@ class RocketRV64(CPU):
         self.interrupt = Signal(4)
 
         mem_dw, mmio_dw, num_cores = CPU_SIZE_PARAMS[self.variant]
+        self.num_cores = num_cores
 
         self.mem_axi   =  mem_axi = axi.AXIInterface(data_width=mem_dw,  address_width=32, id_width=4)
         self.mmio_axi  = mmio_axi = axi.AXIInterface(data_width=mmio_dw, address_width=32, id_width=4)
@@ -304,6 +305,10 @@ class RocketRV64(CPU):
         # Add Verilog sources.
         self.add_sources(platform, variant)
 
+    def add_soc_components(self, soc, soc_region_cls):
+        # Define number of CPUs (secondary harts parked by crt0.S, BIOS SMP jobs).
+        soc.add_config("CPU_COUNT", self.num_cores)
+
     def set_reset_address(self, reset_address):
         assert not hasattr(self, "reset_address")
         self.reset_address = reset_address
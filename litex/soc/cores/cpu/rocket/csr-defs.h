@@ -5,4 +5,12 @@
 
 #define CSR_DCACHE_INFO 0xCC0
 
+/* Performance counters (libbase/perf, -DPERF_COUNTERS with a core configured
+   with them): mhpmevent = (event mask << 8) | event set, set 2 = misses */
+#define PERF_HPM_COUNT  2
+#define PERF_HPM3_NAME  "I$ miss"
+#define PERF_HPM3_EVENT ((1 << 8) | 2)
+#define PERF_HPM4_NAME  "D$ miss"
+#define PERF_HPM4_EVENT ((1 << 9) | 2)
+
 #endif	/* CSR_DEFS__H */
@@ -0,0 +1,113 @@
+#
+# This file is part of LiteX.
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+"""CRC accelerator: CSR fed CRC engine with optional DMA reader of memory buffers."""
+
+from functools import reduce
+from operator import xor
+
+from migen import *
+
+from litex.soc.interconnect.csr import *
+from litex.soc.interconnect import wishbone
+from litex.soc.cores.dma import WishboneDMAReader
+
+# Helpers ------------------------------------------------------------------------------------------
+
+def crc_equations(width, polynomial, reflected, nbits):
+    """Next state of a width-bit CRC register after nbits of data, as the sets of state ("s", i)
+    and data ("d", j) bits XORed into each of its bits, data bit j being the jth processed."""
+    state = [{("s", i)} for i in range(width)]
+    for j in range(nbits):
+        if reflected:
+            feedback = state[0] ^ {("d", j)}
+            state    = state[1:] + [set()]
+            for i in range(width):
+                if (polynomial >> (width - 1 - i)) & 0b1:
+                    state[i] = state[i] ^ feedback
+        else:
+            feedback = state[width - 1] ^ {("d", j)}
+            state    = [set()] + state[:-1]
+            for i in range(width):
+                if (polynomial >> i) & 0b1:
+                    state[i] = state[i] ^ feedback
+    return state
+
+# CRC Engine ---------------------------------------------------------------------------------------
+
+class CRCEngine(Module):
+    """Combinational CRC update of nbytes bytes.
+
+    Bytes are taken in memory order from data (little or big endianness), bit 0 first for
+    reflected CRCs (CRC-32), bit 7 first otherwise (CRC-16/XMODEM).
+    """
+    def __init__(self, width, polynomial, reflected, nbytes, endianness="little"):
+        self.last = Signal(width)
+        self.data = Signal(8*nbytes)
+        self.next = Signal(width)
+
+        # # #
+
+        bits = []
+        for n in range(nbytes):
+            byte = n if endianness == "little" else nbytes - 1 - n
+            byte_bits = [self.data[8*byte + i] for i in range(8)]
+            bits += byte_bits if reflected else byte_bits[::-1]
+
+        for i, terms in enumerate(crc_equations(width, polynomial, reflected, len(bits))):
+            signals = [self.last[n] if kind == "s" else bits[n] for kind, n in sorted(terms)]
+            self.comb += self.next[i].eq(reduce(xor, signals) if signals else 0)
+
+# CRC ----------------------------------------------------------------------------------------------
+
+class CRC(Module, AutoCSR):
+    """CRC accelerator.
+
+    The CRC register is loaded through init, updated by the words written to data and the bytes
+    written to byte, and read back through value (no initial/final XOR: software applies them).
+    With a bus, a DMA reader (dma_ CSRs, see WishboneDMAReader) updates it with length bytes of
+    memory from base (both aligned to the bus width) until done.
+    """
+    def __init__(self, width=32, polynomial=0x04C11DB7, reflected=True, endianness="little", bus=None):
+        self._init  = CSRStorage(width, description="CRC register load.")
+        self._data  = CSRStorage(32,    description="Word (4 bytes, memory order) written to the CRC.")
+        self._byte  = CSRStorage(8,     description="Byte written to the CRC.")
+        self._value = CSRStatus(width,  description="CRC register.")
+
+        # # #
+
+        crc = Signal(width)
+        self.comb += self._value.status.eq(crc)
+
+        word_engine = CRCEngine(width, polynomial, reflected, 4, endianness)
+        byte_engine = CRCEngine(width, polynomial, reflected, 1, endianness)
+        self.submodules += word_engine, byte_engine
+        self.comb += [
+            word_engine.last.eq(crc),
+            word_engine.data.eq(self._data.storage),
+            byte_engine.last.eq(crc),
+            byte_engine.data.eq(self._byte.storage),
+        ]
+        update = [
+            If(self._init.re, crc.eq(self._init.storage)),
+            If(self._data.re, crc.eq(word_engine.next)),
+            If(self._byte.re, crc.eq(byte_engine.next)),
+        ]
+
+        # DMA.
+        if bus is not None:
+            assert isinstance(bus, wishbone.Interface)
+            # Words as on the bus: the engine takes their bytes in memory order.
+            self.submodules.dma = dma = WishboneDMAReader(bus, endianness="big", with_csr=True)
+            dma_engine = CRCEngine(width, polynomial, reflected, bus.data_width//8, endianness)
+            self.submodules += dma_engine
+            self.comb += [
+                dma_engine.last.eq(crc),
+                dma_engine.data.eq(dma.source.data),
+                dma.source.ready.eq(1),
+            ]
+            update.append(If(dma.source.valid, crc.eq(dma_engine.next)))
+
+        self.sync += update
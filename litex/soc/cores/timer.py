@@ -71,7 +71,8 @@ class Timer(Module, AutoCSR, AutoDoc):
 
         # # #
 
-        value = Signal(width)
+        self.width = width
+        self.count = value = Signal(width)
         self.sync += [
             If(self._en.storage,
                 If(value == 0,
@@ -97,4 +98,24 @@ class Timer(Module, AutoCSR, AutoDoc):
 
         self.uptime_cycles = uptime_cycles = Signal(width, reset_less=True)
         self.sync += uptime_cycles.eq(uptime_cycles + 1)
-        self.sync += If(self._uptime_latch.re, self._uptime_cycles.status.eq(uptime_cycles))
\ No newline at end of file
+        self.sync += If(self._uptime_latch.re, self._uptime_cycles.status.eq(uptime_cycles))
+
+    def add_skip(self, skip):
+        """Advance the countdown (and uptime) by ``skip`` cycles more than the current one, for
+        simulators jumping over idle cycles. ``skip_budget`` gives the number of cycles that can be
+        skipped without missing the countdown reaching ``0`` (all ones when it never will)."""
+        self.skip_budget = budget = Signal(self.width)
+
+        # # #
+
+        value = self.count
+        self.comb += [
+            If(~self._en.storage | ((value == 0) & (self._reload.storage == 0)),
+                budget.eq(2**self.width - 1)
+            ).Elif(value != 0,
+                budget.eq(value - 1)
+            )
+        ]
+        self.sync += If((skip != 0) & self._en.storage & (value != 0), value.eq(value - 1 - skip))
+        if self.with_uptime:
+            self.sync += If(skip != 0, self.uptime_cycles.eq(self.uptime_cycles + 1 + skip))
@@ -153,7 +153,9 @@ class Builder:
 
         # Define BIOS Options.
         for bios_option in self.bios_options:
-            assert bios_option in ["TERM_NO_HIST", "TERM_MINI", "TERM_NO_COMPLETE"]
+            assert bios_option in ["TERM_NO_HIST", "TERM_MINI", "TERM_NO_COMPLETE", "FAST_BOOT",
+                "CRC32_SLICING_BY_4", "CRC32_SLICING_BY_8", "BIOS_CRC_COLD_BOOT", "BIOS_CRC_DEFERRED", "ETH_RX_IRQ", "ETH_RX_IN_PLACE", "LOG_BUFFER", "WARM_BOOT", "FATFS_WRITE", "FATFS_LOG", "FATFS_CACHE",
+                "FATFS_NO_LFN", "SDRAM_SPD_TIMINGS", "FATFS_EXFAT"]
             define(bios_option, "1")
 
         return "\n".join(variables_contents)
@@ -1287,6 +1287,9 @@ class LiteXSoC(SoC):
         if with_bist:
             self.submodules.sdram_generator = LiteDRAMBISTGenerator(self.sdram.crossbar.get_port())
             self.submodules.sdram_checker = LiteDRAMBISTChecker(self.sdram.crossbar.get_port())
+            # Geometry (ROW_BANK_COL mapping) for the row hit/miss BIST patterns.
+            self.add_constant("SDRAM_MODULE_ROW_SIZE", 2**module.geom_settings.colbits*phy.settings.databits//8)
+            self.add_constant("SDRAM_MODULE_NBANKS",   2**module.geom_settings.bankbits)
 
         if not with_soc_interconnect: return
 
@@ -1390,6 +1393,8 @@ class LiteXSoC(SoC):
                 litedram_wb = wishbone.Interface(port.data_width)
                 self.submodules += wishbone.Converter(wb_sdram, litedram_wb)
             self.add_config("L2_SIZE", l2_cache_size)
+            if l2_cache_size != 0:
+                self.add_config("L2_LINE_SIZE", l2_cache_data_width//8)
 
             # Wishbone Slave <--> LiteDRAM bridge.
             self.submodules.wishbone_bridge = LiteDRAMWishbone2Native(
@@ -1401,6 +1406,7 @@ class LiteXSoC(SoC):
     def add_ethernet(self, name="ethmac", phy=None, phy_cd="eth", dynamic_ip=False, software_debug=False,
         nrxslots                = 2,
         ntxslots                = 2,
+        mtu                     = 1500,
         with_timestamp          = False,
         with_timing_constraints = True):
         # Imports
@@ -1437,6 +1443,10 @@ class LiteXSoC(SoC):
         if dynamic_ip:
             self.add_constant("ETH_DYNAMIC_IP")
 
+        # MTU (jumbo frames, software limited to the MAC slots).
+        if mtu != 1500:
+            self.add_constant("ETH_MTU", mtu)
+
         # Software Debug
         if software_debug:
             self.add_constant("ETH_UDP_TX_DEBUG")
@@ -1496,6 +1506,29 @@ class LiteXSoC(SoC):
                 self.platform.add_period_constraint(eth_tx_clk, 1e9/phy.tx_clk_freq)
                 self.platform.add_false_path_constraints(self.crg.cd_sys.clk, eth_rx_clk, eth_tx_clk)
 
+    # Add CRC --------------------------------------------------------------------------------------
+    def add_crc(self, name="crc32", with_dma=True):
+        # Imports.
+        from litex.soc.cores.crc import CRC
+
+        # Checks.
+        assert name in ["crc32", "crc16"] # Names the software drivers look for.
+
+        # Core (CRC-32 of zlib/Ethernet or CRC-16/XMODEM of SFL, as computed by libbase).
+        self.check_if_exists(name)
+        bus = None
+        if with_dma:
+            bus = wishbone.Interface(data_width=self.bus.data_width, adr_width=self.bus.address_width)
+            dma_bus = self.bus if not hasattr(self, "dma_bus") else self.dma_bus
+            dma_bus.add_master(name, master=bus)
+        setattr(self.submodules, name, CRC(
+            width      = {"crc32": 32,         "crc16": 16}[name],
+            polynomial = {"crc32": 0x04C11DB7, "crc16": 0x1021}[name],
+            reflected  = {"crc32": True,       "crc16": False}[name],
+            endianness = self.cpu.endianness,
+            bus        = bus,
+        ))
+
     # Add SPI Flash --------------------------------------------------------------------------------
     def add_spi_flash(self, name="spiflash", mode="4x", dummy_cycles=None, clk_freq=None, module=None, phy=None, rate="1:1", **kwargs):
         if module is None:
@@ -1537,9 +1570,18 @@ class LiteXSoC(SoC):
                 self.add_constant("SPIFLASH_MODULE_QUAD_CAPABLE")
             if SpiNorFlashOpCodes.READ_4_4_4 in module.supported_opcodes:
                 self.add_constant("SPIFLASH_MODULE_QPI_CAPABLE")
+            if mode == "4x" and SpiNorFlashOpCodes.PP_1_1_4 in module.supported_opcodes:
+                self.add_constant("SPIFLASH_MODULE_QUAD_PROGRAM")
+            # Read command of the memory-mapped core, checked at boot against the chip's SFDP.
+            self.add_constant("SPIFLASH_PHY_BUS_WIDTH", {"1x": 1, "4x": 4}[mode])
+            read_opcode = getattr(module, "read_opcode", None)
+            if read_opcode is not None:
+                read_code = getattr(read_opcode, "code", read_opcode.value)
+                if isinstance(read_code, int):
+                    self.add_constant("SPIFLASH_MODULE_READ_OPCODE", read_code)
 
     # Add SPI SDCard -------------------------------------------------------------------------------
-    def add_spi_sdcard(self, name="spisdcard", spi_clk_freq=400e3, software_debug=False):
+    def add_spi_sdcard(self, name="spisdcard", spi_clk_freq=400e3, data_width=8, software_debug=False):
         # Imports.
         from litex.soc.cores.spi import SPIMaster
 
@@ -1550,9 +1592,15 @@ class LiteXSoC(SoC):
 
         # Core.
         self.check_if_exists(name)
-        spisdcard = SPIMaster(pads, 8, self.sys_clk_freq, spi_clk_freq)
+        # data_width > 8: Xfers of up to data_width bits, aligned on the LSB so that 8-bit Xfers
+        # are unchanged (CSR layout changes with csr_data_width < data_width).
+        assert data_width in [8, 16, 32]
+        spisdcard = SPIMaster(pads, data_width, self.sys_clk_freq, spi_clk_freq,
+            mode = "raw" if data_width == 8 else "aligned")
         spisdcard.add_clk_divider()
         setattr(self.submodules, name, spisdcard)
+        if data_width > 8:
+            self.add_constant("SPISDCARD_DATA_WIDTH", data_width)
 
         # Debug.
         if software_debug:
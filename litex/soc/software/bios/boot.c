@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <system.h>
 #include <string.h>
@@ -20,21 +21,31 @@
 
 #include "sfl.h"
 #include "boot.h"
+#include "sim_debug.h"
 
 #include <libbase/uart.h>
 
 #include <libbase/console.h>
 #include <libbase/crc.h>
+#include <libbase/lz4.h>
 #include <libbase/jsmn.h>
 #include <libbase/progress.h>
+#include <libbase/alloc.h>
+#include <libbase/smp.h>
+#include <libbase/spiflash.h>
+#include <libbase/task.h>
 
 #include <libliteeth/udp.h>
 #include <libliteeth/tftp.h>
+#include <libliteeth/bulk.h>
 
 #include <liblitesdcard/spisdcard.h>
 #include <liblitesdcard/sdcard.h>
 #include <liblitesata/sata.h>
 #include <libfatfs/ff.h>
+#include <libfatfs/diskio.h>
+#include <libfatfs/fatlog.h>
+#include <liblitespi/spiflash.h>
 
 /*-----------------------------------------------------------------------*/
 /* Helpers                                                               */
@@ -44,15 +55,673 @@
 #define min(x, y) (((x) < (y)) ? (x) : (y))
 
 /*-----------------------------------------------------------------------*/
-/* Boot                                                                  */
+/* Boot Time                                                             */
 /*-----------------------------------------------------------------------*/
 
+/* The BIOS records the start of its phases with the uptime of timer0 (in
+   sys_clk cycles since power-up); each one lasts until the next. */
+
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+
+#define BOOT_TIME_PHASES_MAX 32
+
+struct boot_time_phase {
+	const char *name;
+	uint64_t start;
+};
+
+static struct boot_time_phase boot_time_phases[BOOT_TIME_PHASES_MAX];
+static int boot_time_nphases;
+
+static uint64_t boot_time_cycles(void)
+{
+	timer0_uptime_latch_write(1);
+	return timer0_uptime_cycles_read();
+}
+
+static void boot_time_print(const char *name, uint64_t cycles)
+{
+	unsigned long us;
+
+	us = cycles*1000000/CONFIG_CLOCK_FREQUENCY;
+	printf("  %-16s %8lu.%03lu ms\n", name, us/1000, us%1000);
+}
+
+void boot_time_phase(const char *name)
+{
+	if (boot_time_nphases == BOOT_TIME_PHASES_MAX)
+		return;
+	boot_time_phases[boot_time_nphases].name  = name;
+	boot_time_phases[boot_time_nphases].start = boot_time_cycles();
+	boot_time_nphases++;
+}
+
+void boot_time_report(void)
+{
+	uint64_t now;
+	uint64_t end;
+	int i;
+
+	now = boot_time_cycles();
+	printf("Boot time:\n");
+	if (boot_time_nphases > 0)
+		boot_time_print("reset", boot_time_phases[0].start);
+	for (i = 0; i < boot_time_nphases; i++) {
+		end = (i + 1 < boot_time_nphases) ? boot_time_phases[i+1].start : now;
+		boot_time_print(boot_time_phases[i].name, end - boot_time_phases[i].start);
+	}
+	boot_time_print("total", now);
+}
+
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* Compressed Images                                                     */
+/*-----------------------------------------------------------------------*/
+
+/* Images can be LZ4 frames (lz4 -9 Image Image.lz4): the loaders detect the
+   magic at the start of the data and decompress it while loading. The CRC32
+   of the data as loaded (compressed or not) is computed on the way. */
+
+#if defined(SMP_WORKERS) && defined(MAIN_RAM_BASE) && !defined(IMAGE_LOAD_NO_SMP)
+#define IMAGE_LOAD_SMP
+#endif
+
+struct image_load {
+	char *dst;
+	char *limit;        /* end of the destination, NULL: unlimited */
+	unsigned long length;
+	uint32_t crc;
+	int compressed;
+	struct lz4_stream lz4;
+#ifdef IMAGE_LOAD_SMP
+	/* Frame staged after the decompressed image, decoded on all harts */
+	char *stage;
+	struct lz4_frame_info frame;
+#endif
+};
+
+#ifdef IMAGE_LOAD_SMP
+
+/* With several harts, frames of independent blocks giving their content
+   size (lz4 -9 -B4 -BX --content-size) are loaded as is after the space of
+   the image, then the harts decompress every ncpus-th block each, checking
+   the block checksums when the frame has them. */
+
+static struct {
+	const uint8_t *blocks;
+	const uint8_t *end;
+	uint8_t *dst;
+	uint32_t block_max;
+	int checksums;
+	volatile unsigned long length;
+	volatile int errors[CONFIG_CPU_COUNT];
+} image_smp_job;
+
+static uint32_t image_smp_read32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void image_smp_decode(int hart, int ncpus, void *arg)
+{
+	const uint8_t *p = image_smp_job.blocks;
+	uint8_t *dst = image_smp_job.dst;
+	uint32_t size, len;
+	long n;
+	int block;
+
+	image_smp_job.errors[hart] = 0;
+	/* Every hart walks the block sizes, decoding its share of the blocks */
+	for(block = 0; p + 4 <= image_smp_job.end; block++) {
+		size = image_smp_read32(p);
+		p += 4;
+		if(size == 0)
+			return;
+		len = size & ~LZ4_BLOCK_UNCOMPRESSED;
+		/* Block, its checksum and the next block size (or end mark) */
+		if((len > image_smp_job.block_max) || (image_smp_job.end - p < len + 4*image_smp_job.checksums + 4))
+			break;
+		if((block % ncpus) == hart) {
+			if(image_smp_job.checksums && (lz4_xxh32(p, len, 0) != image_smp_read32(p + len)))
+				break;
+			if(size & LZ4_BLOCK_UNCOMPRESSED) {
+				memcpy(dst, p, len);
+				n = len;
+			} else
+				n = lz4_block_decode(p, len, dst, image_smp_job.block_max);
+			if(n < 0)
+				break;
+			/* Only the last block may be shorter */
+			if(image_smp_read32(p + len + 4*image_smp_job.checksums) == 0)
+				image_smp_job.length = dst + n - image_smp_job.dst;
+			else if(n != image_smp_job.block_max)
+				break;
+		}
+		p += len + 4*image_smp_job.checksums;
+		dst += image_smp_job.block_max;
+	}
+	image_smp_job.errors[hart] = 1;
+}
+
+/* Whether the frame starting in data (whole header) can be decoded once
+   staged: independent blocks, content size, the stage fitting main RAM */
+static int image_load_smp_init(struct image_load *l, const void *data, unsigned long len)
+{
+	if((lz4_frame_info(data, len, &l->frame) < 0) ||
+		!(l->frame.flags & LZ4_FLG_BLOCK_INDEPENDENCE) || (l->frame.content_size == 0))
+		return 0;
+	if(((unsigned long)l->dst < MAIN_RAM_BASE) ||
+		((unsigned long)l->dst + l->frame.content_size >= MAIN_RAM_BASE + MAIN_RAM_SIZE))
+		return 0;
+	if(l->limit && (l->dst + l->frame.content_size >= l->limit))
+		return 0;
+	if(!smp_start())
+		return 0;
+	l->stage = (char *)(((unsigned long)l->dst + (unsigned long)l->frame.content_size + 63) & ~63ul);
+	return 1;
+}
+
+/* Returns the decompressed length, 0 on errors */
+static unsigned long image_load_smp_end(struct image_load *l)
+{
+	int hart;
+
+	image_smp_job.blocks    = (const uint8_t *)l->stage + l->frame.header_length;
+	image_smp_job.end       = (const uint8_t *)l->stage + l->length;
+	image_smp_job.dst       = (uint8_t *)l->dst;
+	image_smp_job.block_max = l->frame.block_max;
+	image_smp_job.checksums = (l->frame.flags & LZ4_FLG_BLOCK_CHECKSUM) ? 1 : 0;
+	image_smp_job.length    = 0;
+	smp_run(image_smp_decode, NULL, CONFIG_CPU_COUNT);
+	for(hart = 0; hart < CONFIG_CPU_COUNT; hart++) {
+		if(image_smp_job.errors[hart]) {
+			printf("LZ4 block error\n");
+			return 0;
+		}
+	}
+	if(image_smp_job.length != l->frame.content_size) {
+		printf("Truncated LZ4 image\n");
+		return 0;
+	}
+	return image_smp_job.length;
+}
+#endif
+
+static void __attribute__((unused)) image_load_init(struct image_load *l, void *dst)
+{
+	l->dst = dst;
+	l->limit = NULL;
+	l->length = 0;
+	l->crc = 0;
+	l->compressed = 0;
+#ifdef IMAGE_LOAD_SMP
+	l->stage = NULL;
+#endif
+}
+
+static int __attribute__((unused)) image_load_data(struct image_load *l, const void *data, unsigned long len)
+{
+	if((l->length == 0) && (len >= 4) && lz4_is_frame(data)) {
+		l->compressed = 1;
+#ifdef IMAGE_LOAD_SMP
+		if(!image_load_smp_init(l, data, len))
+#endif
+		lz4_stream_init(&l->lz4, l->dst, l->limit);
+	}
+	l->length += len;
+#ifdef IMAGE_LOAD_SMP
+	if(l->stage) {
+		if((unsigned long)l->stage + l->length > MAIN_RAM_BASE + MAIN_RAM_SIZE)
+			return -1;
+		if(l->limit && (l->stage + l->length > l->limit))
+			return -1;
+		l->crc = crc32_copy(l->crc, l->stage + l->length - len, data, len);
+		return 0;
+	}
+#endif
+	if(l->compressed) {
+		l->crc = crc32_update(l->crc, data, len);
+		return lz4_stream_feed(&l->lz4, data, len);
+	}
+	if(l->limit && (l->dst + l->length > l->limit)) {
+		printf("Image past 0x%08lx\n", (unsigned long)l->limit);
+		return -1;
+	}
+	l->crc = crc32_copy(l->crc, l->dst + l->length - len, data, len);
+	return 0;
+}
+
+/* Optional check against the CRC32 given for the image (NULL: none) */
+static int __attribute__((unused)) image_check_crc(const uint32_t *expected, uint32_t crc)
+{
+	if(expected && (*expected != crc)) {
+		printf("CRC failed (expected %08x, got %08x)\n", *expected, crc);
+		return 0;
+	}
+	return 1;
+}
+
+static unsigned long __attribute__((unused)) image_load_length(struct image_load *l)
+{
+	if(!l->compressed)
+		return l->length;
+#ifdef IMAGE_LOAD_SMP
+	if(l->stage)
+		return image_load_smp_end(l);
+#endif
+	if(!lz4_stream_done(&l->lz4)) {
+		printf("Truncated LZ4 image\n");
+		return 0;
+	}
+	return lz4_stream_length(&l->lz4);
+}
+
+/* Returns the length loaded to RAM, 0 on errors */
+static unsigned long __attribute__((unused)) image_load_end(struct image_load *l)
+{
+	unsigned long length = image_load_length(l);
+
+	warmboot_image((unsigned long)l->dst, length);
+	return length;
+}
+
+#if defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE) || defined(CSR_SATA_SECTOR2MEM_BASE)
+static int file_is_lz4(FIL *file)
+{
+	unsigned char magic[4];
+	UINT br;
+
+	if((f_read(file, magic, sizeof(magic), &br) != FR_OK) || (f_lseek(file, 0) != FR_OK))
+		return 0;
+	return (br == sizeof(magic)) && lz4_is_frame(magic);
+}
+
+/* Returns the decompressed length, 0 on errors */
+static unsigned long copy_lz4_file_to_ram(FIL *file, unsigned long ram_address, const uint32_t *crc)
+{
+	unsigned char chunk[1024];
+	struct image_load load;
+	uint32_t offset;
+	UINT br;
+
+	image_load_init(&load, (void *) ram_address);
+	init_progression_bar(f_size(file));
+	offset = 0;
+	for (;;) {
+		if (f_read(file, chunk, sizeof(chunk), &br) != FR_OK) {
+			printf("file read error.\n");
+			return 0;
+		}
+		if (br == 0)
+			break;
+		if (image_load_data(&load, chunk, br) < 0) {
+			printf("\nLZ4 decompression error.\n");
+			return 0;
+		}
+		offset += br;
+		if ((offset & (0x8000 - 1)) == 0)
+			show_progress(offset);
+	}
+	show_progress(offset);
+	printf("\n");
+	if(!image_check_crc(crc, load.crc))
+		return 0;
+	return image_load_end(&load);
+}
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* boot.json                                                             */
+/*-----------------------------------------------------------------------*/
+
+#if defined(MAIN_RAM_BASE) && (defined(CSR_ETHMAC_BASE) || defined(CSR_SPISDCARD_BASE) || \
+	defined(CSR_SDCORE_BASE) || defined(CSR_SATA_SECTOR2MEM_BASE))
+
+/* boot.json lists the images to load and the boot arguments:
+     {
+         "Image":       "0x40000000",
+         "rootfs.cpio": "0x41000000,0x1a2b3c4d",
+         "rv32.dtb":    {"addr": "0x40ef0000", "crc32": "0x5e6f7a8b"},
+         "bootargs":    {"r1": "0x40ef0000", "addr": "0x40f00000"}
+     }
+   with an optional CRC32 of the files. Without "addr", the boot address is
+   the one of the last image. The file is read to the end of the main RAM
+   and parsed in place: the file names are terminated in the buffer, the
+   tokens and the image list follow the text. */
+
+#define BOOT_JSON_SIZE 0x10000
+#define BOOT_JSON_BASE (MAIN_RAM_BASE + MAIN_RAM_SIZE - BOOT_JSON_SIZE)
+#define BOOT_JSON_TEXT_MAX (BOOT_JSON_SIZE/2)
+
+struct boot_json_image {
+	const char *name;
+	unsigned long addr;
+	uint32_t crc;
+	int check_crc;
+	unsigned long order;
+};
+
+struct boot_json {
+	unsigned long r1;
+	unsigned long r2;
+	unsigned long r3;
+	unsigned long addr;
+	struct boot_json_image *images;
+	int nimages;
+};
+
+/* Image values: "<address>" or "<address>,<crc32>" */
+static unsigned long json_image_address(const char *value, uint32_t *crc, int *check_crc)
+{
+	unsigned long address;
+	char *end;
+
+	address = strtoul(value, &end, 0);
+	*check_crc = 0;
+	if(*end == ',') {
+		*crc = strtoul(end + 1, NULL, 0);
+		*check_crc = 1;
+	}
+	return address;
+}
+
+static int json_is(const char *json, const jsmntok_t *t, const char *s)
+{
+	int len = t->end - t->start;
+
+	return (t->type == JSMN_STRING) && ((int)strlen(s) == len) && !strncmp(json + t->start, s, len);
+}
+
+static unsigned long json_ulong(const char *json, const jsmntok_t *t)
+{
+	return strtoul(json + t->start, NULL, 0);
+}
+
+/* Index of the token following t[i] and its children */
+static int json_next(const jsmntok_t *t, int i)
+{
+	int n = t[i].size;
+
+	for (i++; n > 0; n--)
+		i = json_next(t, i);
+	return i;
+}
+
+static int json_bootarg(struct boot_json *b, const char *json, const jsmntok_t *key, int *addr_found)
+{
+	if (json_is(json, key, "addr")) {
+		b->addr = json_ulong(json, key + 1);
+		*addr_found = 1;
+	} else if (json_is(json, key, "r1"))
+		b->r1 = json_ulong(json, key + 1);
+	else if (json_is(json, key, "r2"))
+		b->r2 = json_ulong(json, key + 1);
+	else if (json_is(json, key, "r3"))
+		b->r3 = json_ulong(json, key + 1);
+	else
+		return 0;
+	return 1;
+}
+
+/* Parses the len bytes at BOOT_JSON_BASE, returns the number of images,
+   -1 on errors */
+static int boot_json_parse(struct boot_json *b, int len)
+{
+	char *json = (char *) BOOT_JSON_BASE;
+	struct boot_json_image *image;
+	struct arena scratch;
+	jsmn_parser p;
+	jsmntok_t *t;
+	int count;
+	int addr_found = 0;
+	int i, j, k, n;
+
+	memset(b, 0, sizeof(*b));
+	/* Tokens and images after the text */
+	arena_init(&scratch, json + len, BOOT_JSON_SIZE - len);
+
+	/* Count the tokens, then parse */
+	jsmn_init(&p);
+	count = jsmn_parse(&p, json, len, NULL, 0);
+	if (count < 1) {
+		printf("Invalid JSON.\n");
+		return -1;
+	}
+	t = arena_alloc(&scratch, count*sizeof(jsmntok_t));
+	if (t == NULL) {
+		printf("JSON too large.\n");
+		return -1;
+	}
+	jsmn_init(&p);
+	if ((jsmn_parse(&p, json, len, t, count) != count) || (t[0].type != JSMN_OBJECT)) {
+		printf("Invalid JSON.\n");
+		return -1;
+	}
+	/* At most one image per member */
+	b->images = arena_alloc(&scratch, t[0].size*sizeof(struct boot_json_image));
+	if (b->images == NULL) {
+		printf("JSON too large.\n");
+		return -1;
+	}
+
+	for (i = 1, n = 0; n < t[0].size; n++, i = json_next(t, i)) {
+		if ((t[i].type != JSMN_STRING) || (t[i].size != 1)) {
+			printf("Invalid JSON.\n");
+			return -1;
+		}
+		/* Boot arguments, in bootargs or at the top level for compatibility */
+		if (json_is(json, &t[i], "bootargs") && (t[i+1].type == JSMN_OBJECT)) {
+			for (j = i + 2, k = 0; k < t[i+1].size; k++, j = json_next(t, j))
+				json_bootarg(b, json, &t[j], &addr_found);
+			continue;
+		}
+		if (json_bootarg(b, json, &t[i], &addr_found))
+			continue;
+
+		/* Images, with the address in a string or in an object */
+		image = &b->images[b->nimages++];
+		memset(image, 0, sizeof(*image));
+		image->name = json + t[i].start;
+		if (t[i+1].type == JSMN_OBJECT) {
+			for (j = i + 2, k = 0; k < t[i+1].size; k++, j = json_next(t, j)) {
+				if (json_is(json, &t[j], "addr"))
+					image->addr = json_ulong(json, &t[j+1]);
+				else if (json_is(json, &t[j], "crc32")) {
+					image->crc = json_ulong(json, &t[j+1]);
+					image->check_crc = 1;
+				}
+			}
+		} else
+			image->addr = json_image_address(json + t[i+1].start, &image->crc, &image->check_crc);
+		json[t[i].end] = '\0';
+		if (!addr_found)
+			b->addr = image->addr;
+	}
+
+	return b->nimages;
+}
+
+/* The file names live at the end of the main RAM until all the images are
+   loaded */
+static int boot_json_image_overlaps(const struct boot_json_image *image, unsigned long size)
+{
+	if ((image->addr + size > BOOT_JSON_BASE) && (image->addr < BOOT_JSON_BASE + BOOT_JSON_SIZE)) {
+		printf("%s overlaps boot.json at 0x%08lx.\n", image->name, (unsigned long) BOOT_JSON_BASE);
+		return 1;
+	}
+	return 0;
+}
+
+#endif
+
 extern void boot_helper(unsigned long r1, unsigned long r2, unsigned long r3, unsigned long addr);
 
+/*-----------------------------------------------------------------------*/
+/* Warm Boot                                                             */
+/*-----------------------------------------------------------------------*/
+
+/* With the WARM_BOOT BIOS option, the images loaded to main RAM and the
+   arguments of the boot are recorded, with the CRC32 of each image, in a
+   reserved region at the end of main RAM when booting. After a warm reboot
+   (reboot warm, or software writing WARMBOOT_MAGIC to the ctrl scratch
+   register and restarting the CPU only: a SoC reset clears it), the SDRAM
+   controller having kept its calibration, the BIOS skips sdram_init() and
+   boots the recorded images again when they are intact, running the boot
+   sequence otherwise. Images modified by their own execution (kernels
+   reusing their init sections) fail the check. */
+
+#ifdef WARMBOOT
+
+#define WARMBOOT_RECORD_MAGIC 0x4c584257
+#define WARMBOOT_IMAGES 8
+
+struct warmboot_image {
+	unsigned long addr;
+	unsigned long length;
+	uint32_t crc;
+};
+
+struct warmboot_record {
+	uint32_t magic;
+	uint32_t count;
+	unsigned long r1, r2, r3, addr;
+	struct warmboot_image images[WARMBOOT_IMAGES];
+	uint32_t crc;
+};
+
+/* Images loaded since the BIOS started (count > WARMBOOT_IMAGES: too many) */
+static struct {
+	unsigned int count;
+	struct warmboot_image images[WARMBOOT_IMAGES];
+} warmboot_loaded;
+
+static uint32_t warmboot_record_crc(const struct warmboot_record *w)
+{
+	return crc32((const unsigned char *)w, offsetof(struct warmboot_record, crc));
+}
+
+void warmboot_image(unsigned long addr, unsigned long length)
+{
+	struct warmboot_image *image;
+	unsigned int i;
+
+	if((addr < MAIN_RAM_BASE) || (addr + length > MAIN_RAM_BASE + MAIN_RAM_SIZE) || !length)
+		return;
+	/* Loaded again to the same address: replaced, right after an image
+	   (serialboot frames): appended to it */
+	for(i = 0; (i < warmboot_loaded.count) && (i < WARMBOOT_IMAGES); i++) {
+		image = &warmboot_loaded.images[i];
+		if(image->addr + image->length == addr) {
+			image->length += length;
+			return;
+		}
+		if(image->addr == addr)
+			break;
+	}
+	if(i == warmboot_loaded.count)
+		warmboot_loaded.count++;
+	if(i < WARMBOOT_IMAGES) {
+		warmboot_loaded.images[i].addr = addr;
+		warmboot_loaded.images[i].length = length;
+	}
+}
+
+/* Called by boot(), the CRCs taken on the images as they are jumped to */
+static void warmboot_record(unsigned long r1, unsigned long r2, unsigned long r3, unsigned long addr)
+{
+	struct warmboot_record *w = (struct warmboot_record *)WARMBOOT_ADDR;
+	struct warmboot_image *image;
+	unsigned int i;
+
+	w->magic = 0;
+	if(!warmboot_loaded.count || (warmboot_loaded.count > WARMBOOT_IMAGES))
+		return;
+	for(i = 0; i < warmboot_loaded.count; i++) {
+		image = &warmboot_loaded.images[i];
+		if((image->addr < WARMBOOT_ADDR + WARMBOOT_SIZE) && (WARMBOOT_ADDR < image->addr + image->length))
+			return;
+		image->crc = crc32((const unsigned char *)image->addr, image->length);
+	}
+	memcpy(w->images, warmboot_loaded.images, sizeof(w->images));
+	w->count = warmboot_loaded.count;
+	w->r1 = r1;
+	w->r2 = r2;
+	w->r3 = r3;
+	w->addr = addr;
+	w->magic = WARMBOOT_RECORD_MAGIC;
+	w->crc = warmboot_record_crc(w);
+}
+
+int warmboot_detect(void)
+{
+	if(ctrl_scratch_read() != WARMBOOT_MAGIC)
+		return 0;
+	/* Back to its reset value: the next reboot is cold unless requested */
+	ctrl_scratch_write(0x12345678);
+	return 1;
+}
+
+void warmboot_resume(void)
+{
+	struct warmboot_record *w = (struct warmboot_record *)WARMBOOT_ADDR;
+	struct warmboot_image *image;
+	unsigned int i;
+
+	/* Nothing cached from before the reboot */
+	flush_cpu_dcache();
+	flush_l2_cache();
+	if((w->magic != WARMBOOT_RECORD_MAGIC) || (w->count > WARMBOOT_IMAGES) ||
+	   (w->crc != warmboot_record_crc(w))) {
+		printf("Warm boot: no boot record.\n");
+		return;
+	}
+	for(i = 0; i < w->count; i++) {
+		image = &w->images[i];
+		if(crc32((const unsigned char *)image->addr, image->length) != image->crc) {
+			printf("Warm boot: image at 0x%08lx modified.\n", image->addr);
+			return;
+		}
+	}
+	printf("Warm boot: %u image(s) intact.\n", (unsigned int)w->count);
+	memcpy(warmboot_loaded.images, w->images, sizeof(w->images));
+	warmboot_loaded.count = w->count;
+	boot(w->r1, w->r2, w->r3, w->addr);
+}
+
+void __attribute__((noreturn)) warmboot_reboot(void)
+{
+	printf("Warm reboot...\n");
+	ctrl_scratch_write(WARMBOOT_MAGIC);
+#ifdef CSR_UART_BASE
+	uart_sync();
+#endif
+#ifdef CONFIG_CPU_HAS_INTERRUPT
+	irq_setmask(0);
+	irq_setie(0);
+#endif
+	flush_cpu_icache();
+	flush_cpu_dcache();
+	flush_l2_cache();
+	boot_helper(0, 0, 0, CONFIG_CPU_RESET_ADDR);
+	while(1);
+}
+
+#else
+#define warmboot_record(r1, r2, r3, addr)
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* Boot                                                                  */
+/*-----------------------------------------------------------------------*/
+
 void __attribute__((noreturn)) boot(unsigned long r1, unsigned long r2, unsigned long r3, unsigned long addr)
 {
+	boot_time_report();
+	warmboot_record(r1, r2, r3, addr);
 	printf("Executing booted program at 0x%08lx\n\n", addr);
 	printf("--============= \e[1mLiftoff!\e[0m ===============--\n");
+	fatfs_log_stop();
 #ifdef CSR_UART_BASE
 	uart_sync();
 #endif
@@ -143,6 +812,8 @@ static int check_ack(void)
 					recognized = 0;
 			}
 		}
+		/* Background tasks (deferred BIOS CRC) use the wait */
+		task_yield();
 		timer0_update_value_write(1);
 	}
 	return ACK_TIMEOUT;
@@ -158,8 +829,159 @@ static uint32_t get_uint32(unsigned char* data)
 
 #define MAX_FAILURES 256
 
-/* Returns 1 if other boot methods should be tried */
-int serialboot(void)
+static void sfl_window_reply(char ack, unsigned char seq)
+{
+	uart_write(ack);
+	uart_write(seq);
+}
+
+/* Drop the frames in flight until the Host stops sending (window full) */
+static void sfl_window_drain(void)
+{
+	timer0_load(CMD_TIMEOUT_DELAY);
+	while(timer0_value_read()) {
+		if(uart_read_nonblock()) {
+			uart_read();
+			timer0_load(CMD_TIMEOUT_DELAY);
+		}
+		timer0_update_value_write(1);
+	}
+}
+
+/* Returns the payload length, -1 on timeout, -2 on CRC error */
+static int sfl_window_get_frame(struct sfl_window_frame *frame)
+{
+	unsigned char *p = (unsigned char *)frame;
+	unsigned short crc = 0;
+	int length = 0;
+	int i = 0;
+	int n, start;
+
+	while((i == 0) || timer0_value_read()) {
+		/* Length byte by byte, then the rest of the frame in bulk from the RX ring */
+		n = uart_read_buf((char *)&p[i], (i < 2) ? 1 : length + 6 - i);
+		if(n) {
+			if(i == 0)
+				timer0_load(CMD_TIMEOUT_DELAY);
+			/* The CRC covers seq, cmd and payload, computed on the fly */
+			if((i <= 2) && (i + n > 2))
+				crc = crc16_update(crc, &p[2], 1);
+			start = (i > 5) ? i : 5;
+			if(i + n > start)
+				crc = crc16_update(crc, &p[start], i + n - start);
+			i += n;
+			if(i == 2) {
+				length = ((int)frame->payload_length[0] << 8) | frame->payload_length[1];
+				if(length > SFL_WINDOW_PAYLOAD_MAX)
+					return -2;
+			}
+			if((i > 5) && (i == (length + 6))) {
+				if(crc != (((unsigned short)frame->crc[0] << 8) | frame->crc[1]))
+					return -2;
+				return length;
+			}
+		}
+		timer0_update_value_write(1);
+	}
+	return -1;
+}
+
+/* Windowed frames: the Host streams, the BIOS acknowledges every few frames.
+   Jumps are refused unless allow_jump (mem_load). */
+static int serialboot_window(int allow_jump)
+{
+	static struct sfl_window_frame frame;
+	static struct lz4_stream lz4;
+	char *lz4_addr = NULL;
+	unsigned char expected = 0;
+	int failures = 0;
+	int length;
+
+	while(1) {
+		length = sfl_window_get_frame(&frame);
+		if(length < 0) {
+			/* Increment failures and exit when max is reached */
+			failures++;
+			if(failures == MAX_FAILURES) {
+				printf("Too many consecutive errors, aborting");
+				return 1;
+			}
+			/* Ask the Host to rewind once the line is idle */
+			sfl_window_drain();
+			sfl_window_reply((length == -1) ? SFL_ACK_ERROR : SFL_ACK_CRCERROR, expected);
+			continue;
+		}
+
+		/* Frame already received (Host rewound): acknowledge what we have */
+		if(frame.seq != expected) {
+			sfl_window_reply(SFL_ACK_SUCCESS, expected - 1);
+			continue;
+		}
+		expected++;
+		failures = 0;
+
+		switch(frame.cmd) {
+			case SFL_CMD_ABORT:
+				sfl_window_reply(SFL_ACK_SUCCESS, frame.seq);
+				return 1;
+			case SFL_CMD_LOAD: {
+				char *load_addr;
+
+				/* The payload starts with the load address */
+				if(length < 4) {
+					sfl_window_reply(SFL_ACK_ERROR, frame.seq);
+					break;
+				}
+				load_addr = (char *)(uintptr_t) get_uint32(&frame.payload[0]);
+				memcpy(load_addr, &frame.payload[4], length - 4);
+				warmboot_image((unsigned long)load_addr, length - 4);
+
+				/* Cumulative acknowledge, when the Host waits or every few frames */
+				if(!uart_read_nonblock() || (expected % SFL_WINDOW_ACK_INTERVAL) == 0)
+					sfl_window_reply(SFL_ACK_SUCCESS, frame.seq);
+				break;
+			}
+			case SFL_CMD_LOAD_LZ4: {
+				char *load_addr;
+
+				if(length < 4) {
+					sfl_window_reply(SFL_ACK_ERROR, frame.seq);
+					break;
+				}
+				/* A new destination starts a new LZ4 frame */
+				load_addr = (char *)(uintptr_t) get_uint32(&frame.payload[0]);
+				if(load_addr != lz4_addr) {
+					lz4_stream_init(&lz4, load_addr, NULL);
+					lz4_addr = load_addr;
+				}
+				if(lz4_stream_feed(&lz4, &frame.payload[4], length - 4) < 0) {
+					sfl_window_reply(SFL_ACK_UNKNOWN, frame.seq);
+					break;
+				}
+				warmboot_image((unsigned long)lz4_addr, lz4_stream_length(&lz4));
+				if(!uart_read_nonblock() || (expected % SFL_WINDOW_ACK_INTERVAL) == 0)
+					sfl_window_reply(SFL_ACK_SUCCESS, frame.seq);
+				break;
+			}
+			case SFL_CMD_JUMP:
+				if(!allow_jump) {
+					sfl_window_reply(SFL_ACK_UNKNOWN, frame.seq);
+					break;
+				}
+				sfl_window_reply(SFL_ACK_SUCCESS, frame.seq);
+				boot(0, 0, 0, get_uint32(&frame.payload[0]));
+				break;
+			default:
+				sfl_window_reply(SFL_ACK_UNKNOWN, frame.seq);
+				break;
+		}
+	}
+	return 1;
+}
+
+/* Loads the frames of the Host until it aborts (or jumps when allow_jump),
+   returns 1 if other boot methods should be tried */
+static int serialboot_session(int allow_jump)
 {
 	struct sfl_frame frame;
 	int failures;
@@ -167,9 +989,6 @@ int serialboot(void)
 	const char *c;
 	int ack_status;
 
-	printf("Booting from serial...\n");
-	printf("Press Q or ESC to abort boot completely.\n");
-
 	/* Send the serialboot "magic" request to Host and wait for ACK_OK */
 	c = str;
 	while(*c) {
@@ -189,31 +1008,24 @@ int serialboot(void)
 	/* Assume ACK_OK */
 	failures = 0;
 	while(1) {
-		int i;
+		int i, n;
 		int timeout;
 		int computed_crc;
 		int received_crc;
 
-		/* Get one Frame */
+		/* Get one Frame: length, then the rest in bulk from the RX ring */
 		i = 0;
 		timeout = 1;
 		while((i == 0) || timer0_value_read()) {
-			if (uart_read_nonblock()) {
-				if (i == 0) {
-						timer0_load(CMD_TIMEOUT_DELAY);
-						frame.payload_length = uart_read();
+			n = uart_read_buf((char *)&frame + i, (i == 0) ? 1 : frame.payload_length + 4 - i);
+			if (n) {
+				if (i == 0)
+					timer0_load(CMD_TIMEOUT_DELAY);
+				i += n;
+				if ((i > 4) && (i == frame.payload_length + 4)) {
+					timeout = 0;
+					break;
 				}
-				if (i == 1) frame.crc[0] = uart_read();
-				if (i == 2) frame.crc[1] = uart_read();
-				if (i == 3) frame.cmd    = uart_read();
-				if (i >= 4) {
-					frame.payload[i-4] = uart_read();
-					if (i == (frame.payload_length + 4 - 1)) {
-						timeout = 0;
-						break;
-					}
-				}
-				i++;
 			}
 			timer0_update_value_write(1);
 		}
@@ -258,9 +1070,16 @@ int serialboot(void)
 				/* Reset failures */
 				failures = 0;
 
+				/* The payload starts with the load address */
+				if(frame.payload_length < 4) {
+					uart_write(SFL_ACK_ERROR);
+					break;
+				}
+
 				/* Copy payload */
 				load_addr = (char *)(uintptr_t) get_uint32(&frame.payload[0]);
-				memcpy(load_addr, &frame.payload[4], frame.payload_length);
+				memcpy(load_addr, &frame.payload[4], frame.payload_length - 4);
+				warmboot_image((unsigned long)load_addr, frame.payload_length - 4);
 
 				/* Acknowledge and continue */
 				uart_write(SFL_ACK_SUCCESS);
@@ -273,12 +1092,24 @@ int serialboot(void)
 				/* Reset failures */
 				failures = 0;
 
+				if(!allow_jump) {
+					uart_write(SFL_ACK_UNKNOWN);
+					break;
+				}
+
 				/* Acknowledge and jump */
 				uart_write(SFL_ACK_SUCCESS);
 				jump_addr = get_uint32(&frame.payload[0]);
 				boot(0, 0, 0, jump_addr);
 				break;
 			}
+			/* On SFL_CMD_WINDOW, switch to windowed frames */
+			case SFL_CMD_WINDOW:
+				uart_write(SFL_ACK_SUCCESS);
+				uart_write(SFL_WINDOW_PAYLOAD_MAX >> 8);
+				uart_write(SFL_WINDOW_PAYLOAD_MAX & 0xff);
+				uart_write(SFL_WINDOW_ACK_INTERVAL);
+				return serialboot_window(allow_jump);
 			default:
 				/* Increment failures */
 				failures++;
@@ -298,6 +1129,132 @@ int serialboot(void)
 	return 1;
 }
 
+/* Returns 1 if other boot methods should be tried */
+int serialboot(void)
+{
+#if defined(CSR_SIM_LOAD_BASE) && defined(MAIN_RAM_BASE)
+	/* In simulation, the host writes the image into RAM directly */
+	if (sim_load(0, MAIN_RAM_BASE) > 0) {
+		printf("Booting from simulator (sim_load)...\n");
+		boot(0, 0, 0, MAIN_RAM_BASE);
+	}
+#endif
+	printf("Booting from serial...\n");
+	printf("Press Q or ESC to abort boot completely.\n");
+	return serialboot_session(1);
+}
+
+/* mem_load: frames of the Host (litex_memxfer) loaded until it aborts */
+void serial_load(void)
+{
+	printf("Waiting for the Host, press Q or ESC to abort...\n");
+	serialboot_session(0);
+}
+
+/* Returns the reply of the Host to windowed frames (0 on timeout) */
+static char sfl_window_get_reply(unsigned char *seq, int wait)
+{
+	char reply[2];
+	int n = 0;
+
+	if(!wait && !uart_read_nonblock())
+		return 0;
+	timer0_load(ACK_TIMEOUT_DELAY);
+	while(timer0_value_read()) {
+		n += uart_read_buf(&reply[n], 2 - n);
+		if(n == 2) {
+			*seq = reply[1];
+			return reply[0];
+		}
+		timer0_update_value_write(1);
+	}
+	return 0;
+}
+
+static void sfl_window_send(struct sfl_window_frame *frame, unsigned char seq, unsigned char cmd,
+	const char *addr, unsigned int length)
+{
+	unsigned short crc;
+
+	frame->payload_length[0] = (length + 4) >> 8;
+	frame->payload_length[1] = (length + 4) & 0xff;
+	frame->seq = seq;
+	frame->cmd = cmd;
+	frame->payload[0] = (uintptr_t)addr >> 24;
+	frame->payload[1] = (uintptr_t)addr >> 16;
+	frame->payload[2] = (uintptr_t)addr >> 8;
+	frame->payload[3] = (uintptr_t)addr;
+	memcpy(&frame->payload[4], addr, length);
+	crc = crc16_update(crc16(&frame->seq, 1), &frame->cmd, length + 5);
+	frame->crc[0] = crc >> 8;
+	frame->crc[1] = crc & 0xff;
+	uart_write_buf((const char *)frame, length + 10);
+}
+
+/* mem_dump: windowed frames sent to the Host (litex_memxfer), ended by an
+   SFL_CMD_ABORT frame. Go-back-N on the Host replies: cumulative acknowledge,
+   sequence number of the frame to resend on errors. */
+int serial_dump(const char *addr, unsigned long length)
+{
+	static struct sfl_window_frame frame;
+	static const char str[SFL_MAGIC_LEN+1] = SFL_MAGIC_DUMP;
+	unsigned long frames, base, next, n;
+	unsigned int chunk;
+	unsigned char seq;
+	int failures;
+	char reply;
+
+	printf("Waiting for the Host, press Q or ESC to abort...\n");
+	uart_write_buf(str, SFL_MAGIC_LEN);
+	if(check_ack() != ACK_OK)
+		return 0;
+
+	/* Frame index frames is the end frame */
+	frames   = (length + SFL_WINDOW_DATA_MAX - 1)/SFL_WINDOW_DATA_MAX;
+	base     = 0;
+	next     = 0;
+	failures = 0;
+	while(base <= frames) {
+		if((next <= frames) && (next - base < SFL_WINDOW_ACK_INTERVAL)) {
+			chunk = 0;
+			if(next < frames) {
+				chunk = length - next*SFL_WINDOW_DATA_MAX;
+				if(chunk > SFL_WINDOW_DATA_MAX)
+					chunk = SFL_WINDOW_DATA_MAX;
+			}
+			sfl_window_send(&frame, next, (next < frames) ? SFL_CMD_LOAD : SFL_CMD_ABORT,
+				addr + next*SFL_WINDOW_DATA_MAX, chunk);
+			next++;
+		}
+		/* Replies as they come, waiting for one when the window is full */
+		reply = sfl_window_get_reply(&seq, (next > frames) || (next - base == SFL_WINDOW_ACK_INTERVAL));
+		if(reply == 0) {
+			if((next > frames) || (next - base == SFL_WINDOW_ACK_INTERVAL)) {
+				/* Lost replies: resend from the last acknowledged frame */
+				if(++failures == MAX_FAILURES)
+					return 0;
+				next = base;
+			}
+			continue;
+		}
+		/* Map the 8-bit sequence number to the frames in flight */
+		n = base - 1 + ((unsigned char)(seq - (base - 1)));
+		if(reply == SFL_ACK_SUCCESS) {
+			if(n + 1 > base)
+				base = (n + 1 < next) ? n + 1 : next;
+			failures = 0;
+		} else if((reply == SFL_ACK_CRCERROR) || (reply == SFL_ACK_ERROR)) {
+			if(++failures == MAX_FAILURES)
+				return 0;
+			if(n > base)
+				base = (n < next) ? n : next;
+			next = base;
+		} else
+			return 0;
+	}
+	return 1;
+}
+
 #endif
 
 /*-----------------------------------------------------------------------*/
@@ -324,14 +1281,30 @@ static unsigned int remote_ip[4] = {REMOTEIP1, REMOTEIP2, REMOTEIP3, REMOTEIP4};
 static unsigned int remote_ip[4] = {192, 168, 1, 100};
 #endif
 
+static int tftp_image_data(const uint8_t *data, int length, void *arg)
+{
+	return image_load_data(arg, data, length);
+}
+
+/* The image is not written at or past limit (NULL: unlimited) */
 static int copy_file_from_tftp_to_ram(unsigned int ip, unsigned short server_port,
-const char *filename, char *buffer)
+const char *filename, char *buffer, char *limit, const uint32_t *crc)
 {
+	struct image_load load;
 	int size;
 	printf("Copying %s to %p... ", filename, buffer);
-	size = tftp_get(ip, server_port, filename, buffer);
-	if(size > 0)
-		printf("(%d bytes)", size);
+	image_load_init(&load, buffer);
+	load.limit = limit;
+	size = tftp_get_stream(ip, server_port, filename, tftp_image_data, &load);
+	if((size > 0) && !image_check_crc(crc, load.crc))
+		size = 0;
+	if(size > 0) {
+		size = image_load_end(&load);
+		if(load.compressed)
+			printf("(LZ4, %d bytes)", size);
+		else
+			printf("(%d bytes)", size);
+	}
 	printf("\n");
 	return size;
 }
@@ -453,91 +1426,82 @@ void set_mac_addr(const char * mac_address)
 
 #endif
 
-static void netboot_from_json(const char * filename, unsigned int ip, unsigned short tftp_port)
+static int tftp_json_data(const uint8_t *data, int length, void *arg)
 {
-	int size;
-	uint8_t i;
-	uint8_t count;
+	int *size = arg;
 
-	/* FIXME: modify/increase if too limiting */
-	char json_buffer[1024];
-	char json_name[32];
-	char json_value[32];
-
-	unsigned long boot_r1 = 0;
-	unsigned long boot_r2 = 0;
-	unsigned long boot_r3 = 0;
-	unsigned long boot_addr = 0;
+	if (*size + length > BOOT_JSON_TEXT_MAX) {
+		printf("JSON too large.\n");
+		return -1;
+	}
+	memcpy((char *) BOOT_JSON_BASE + *size, data, length);
+	*size += length;
+	return 0;
+}
 
-	uint8_t image_found = 0;
-	uint8_t boot_addr_found = 0;
+static void netboot_from_json(const char * filename, unsigned int ip, unsigned short tftp_port)
+{
+	struct boot_json b;
+	int size = 0;
+	int n;
 
 	/* Read JSON file */
-	size = tftp_get(ip, tftp_port, filename, json_buffer);
-	if (size <= 0)
+	if (tftp_get_stream(ip, tftp_port, filename, tftp_json_data, &size) <= 0)
 		return;
 
 	/* Parse JSON file */
-	jsmntok_t t[32];
-	jsmn_parser p;
-	jsmn_init(&p);
-	count = jsmn_parse(&p, json_buffer, strlen(json_buffer), t, sizeof(t)/sizeof(*t));
-	for (i=0; i<count-1; i++) {
-		memset(json_name,   0, sizeof(json_name));
-		memset(json_value,  0, sizeof(json_value));
-		/* Elements are JSON strings with 1 children */
-		if ((t[i].type == JSMN_STRING) && (t[i].size == 1)) {
-			/* Get Element's filename */
-			memcpy(json_name, json_buffer + t[i].start, t[i].end - t[i].start);
-			/* Get Element's address */
-			memcpy(json_value, json_buffer + t[i+1].start, t[i+1].end - t[i+1].start);
-			/* Skip bootargs (optional) */
-			if (strncmp(json_name, "bootargs", 8) == 0) {
-				continue;
-			}
-			/* Get boot addr (optional) */
-			else if (strncmp(json_name, "addr", 4) == 0) {
-				boot_addr = strtoul(json_value, NULL, 0);
-				boot_addr_found = 1;
-			}
-			/* Get boot r1 (optional) */
-			else if (strncmp(json_name, "r1", 2) == 0) {
-				memcpy(json_name, json_buffer + t[i].start, t[i].end - t[i].start);
-				boot_r1 = strtoul(json_value, NULL, 0);
-			}
-			/* Get boot r2 (optional) */
-			else if (strncmp(json_name, "r2", 2) == 0) {
-				boot_r2 = strtoul(json_value, NULL, 0);
-			}
-			/* Get boot r3 (optional) */
-			else if (strncmp(json_name, "r3", 2) == 0) {
-				boot_r3 = strtoul(json_value, NULL, 0);
-			/* Copy Image from Network to address */
-			} else {
-				size = copy_file_from_tftp_to_ram(ip, tftp_port, json_name, (void *)strtoul(json_value, NULL, 0));
-				if (size <= 0)
-					return;
-				image_found = 1;
-				if (boot_addr_found == 0) /* Boot to last Image address if no bootargs.addr specified */
-					boot_addr = strtoul(json_value, NULL, 0);
-			}
-		}
+	if (boot_json_parse(&b, size) <= 0)
+		return;
+
+	/* Copy Images from Network to address */
+	boot_time_phase("tftp_copy");
+	for (n=0; n<b.nimages; n++) {
+		if (boot_json_image_overlaps(&b.images[n], 1))
+			return;
+		/* The size is only known once received: stop the images below
+		   boot.json before they reach it */
+		if (copy_file_from_tftp_to_ram(ip, tftp_port, b.images[n].name, (void *)b.images[n].addr,
+			(b.images[n].addr < BOOT_JSON_BASE) ? (char *) BOOT_JSON_BASE : NULL,
+			b.images[n].check_crc ? &b.images[n].crc : NULL) <= 0)
+			return;
 	}
 
 	/* Boot */
-	if (image_found)
-		boot(boot_r1, boot_r2, boot_r3, boot_addr);
+	boot(b.r1, b.r2, b.r3, b.addr);
 }
 
 static void netboot_from_bin(const char * filename, unsigned int ip, unsigned short tftp_port)
 {
 	int size;
-	size = copy_file_from_tftp_to_ram(ip, tftp_port, filename, (void *)MAIN_RAM_BASE);
+	size = copy_file_from_tftp_to_ram(ip, tftp_port, filename, (void *)MAIN_RAM_BASE, NULL, NULL);
 	if (size <= 0)
 		return;
 	boot(0, 0, 0, MAIN_RAM_BASE);
 }
 
+static int netboot_started;
+
+void netboot_start(void)
+{
+	if (netboot_started)
+		return;
+	udp_start(macadr, IPTOINT(local_ip[0], local_ip[1], local_ip[2], local_ip[3]));
+	netboot_started = 1;
+}
+
+unsigned int netboot_remote_ip(void)
+{
+	return IPTOINT(remote_ip[0], remote_ip[1], remote_ip[2], remote_ip[3]);
+}
+
+/* Starts the ARP resolution of the TFTP server, the reply waiting in the
+   RX slots of the MAC until netboot() */
+void netboot_prepare(void)
+{
+	netboot_start();
+	udp_arp_request(IPTOINT(remote_ip[0], remote_ip[1], remote_ip[2], remote_ip[3]));
+}
+
 void netboot(int nb_params, char **params)
 {
 	unsigned int ip;
@@ -552,7 +1516,7 @@ void netboot(int nb_params, char **params)
 	printf("Remote IP: %d.%d.%d.%d\n", remote_ip[0], remote_ip[1], remote_ip[2], remote_ip[3]);
 
 	ip = IPTOINT(remote_ip[0], remote_ip[1], remote_ip[2], remote_ip[3]);
-	udp_start(macadr, IPTOINT(local_ip[0], local_ip[1], local_ip[2], local_ip[3]));
+	netboot_start();
 
 	if (filename) {
 		printf("Booting from %s (JSON)...\n", filename);
@@ -571,6 +1535,179 @@ void netboot(int nb_params, char **params)
 	printf("Network boot failed.\n");
 }
 
+struct tftp_buffer {
+	char *buf;
+	unsigned int size;
+	unsigned int length;
+};
+
+static int tftp_buffer_data(const uint8_t *data, int length, void *arg)
+{
+	struct tftp_buffer *b = arg;
+
+	if (b->length + length > b->size) {
+		printf("File too large.\n");
+		return -1;
+	}
+	memcpy(b->buf + b->length, data, length);
+	b->length += length;
+	return 0;
+}
+
+static int netboot_fetch(const char *filename, char *buf, unsigned int size)
+{
+	struct tftp_buffer b = { .buf = buf, .size = size, .length = 0 };
+
+	netboot_start();
+	if (tftp_get_stream(IPTOINT(remote_ip[0], remote_ip[1], remote_ip[2], remote_ip[3]),
+		TFTP_SERVER_PORT, filename, tftp_buffer_data, &b) < 0)
+		return -1;
+	return b.length;
+}
+
+/* Bulk load (litex_netload) to main RAM, the faster TFTP alternative */
+#ifdef MAIN_RAM_BASE
+void netload(int nb_params, char **params)
+{
+	unsigned long addr;
+	char *c;
+	int size;
+
+	addr = MAIN_RAM_BASE;
+	if (nb_params > 0) {
+		addr = strtoul(params[0], &c, 0);
+		if ((*c != 0) || (addr < MAIN_RAM_BASE) || (addr >= MAIN_RAM_BASE + MAIN_RAM_SIZE)) {
+			printf("Incorrect address\n");
+			return;
+		}
+	}
+
+	printf("Local IP: %d.%d.%d.%d, waiting for litex_netload on port %d...\n",
+		local_ip[0], local_ip[1], local_ip[2], local_ip[3], BULK_PORT);
+	netboot_start();
+	size = bulk_load((void *) addr, MAIN_RAM_BASE + MAIN_RAM_SIZE - addr);
+	if (size < 0) {
+		printf("Network load failed.\n");
+		return;
+	}
+	printf("Loaded %d bytes to 0x%08lx.\n", size, addr);
+}
+#endif
+
+/* Network flash update: the TFTP blocks are staged in a ring in main RAM
+   while the flash erases/programs, the flash operations being started
+   without waiting and advanced as the blocks arrive */
+#if defined(MAIN_RAM_BASE) && defined(CSR_SPIFLASH_CORE_MASTER_CS_ADDR)
+
+#define NETFLASH_RING_SIZE 0x40000
+
+struct netflash {
+	uint8_t *ring;
+	uint32_t offset;	/* Flash offset of the image */
+	uint32_t erased;	/* Flash offset erased up to */
+	unsigned long programmed;
+	unsigned long received;
+	uint32_t crc;
+};
+
+/* Starts the next flash operation when the flash is idle, returns 0 when
+   the data received is programmed (a partial last page only when final) */
+static int netflash_pump(struct netflash *f, int final)
+{
+	uint32_t addr;
+	unsigned long n;
+
+	if (spiflash_busy())
+		return 1;
+	addr = f->offset + f->programmed;
+	n = SPIFLASH_MODULE_PAGE_SIZE - (addr % SPIFLASH_MODULE_PAGE_SIZE);
+	if (f->received - f->programmed < n) {
+		if (!final || (f->received == f->programmed))
+			return 0;
+		n = f->received - f->programmed;
+	}
+	if (addr >= f->erased) {
+		spiflash_erase_sector_start(f->erased);
+		f->erased += SPI_FLASH_SECTOR_SIZE;
+		return 1;
+	}
+	/* Pages do not cross the end of the ring, sector aligned in the flash */
+	spiflash_program_start(addr, f->ring + f->programmed % NETFLASH_RING_SIZE, n);
+	f->programmed += n;
+	return 1;
+}
+
+static int netflash_data(const uint8_t *data, int length, void *arg)
+{
+	struct netflash *f = arg;
+	unsigned long index;
+	int n;
+
+	if (f->offset + f->received + length > SPIFLASH_MODULE_TOTAL_SIZE) {
+		printf("Image too large for the flash.\n");
+		return -1;
+	}
+	f->crc = crc32_update(f->crc, data, length);
+	while (f->received + length - f->programmed > NETFLASH_RING_SIZE)
+		netflash_pump(f, 0);
+	while (length > 0) {
+		index = f->received % NETFLASH_RING_SIZE;
+		n = NETFLASH_RING_SIZE - index;
+		if (n > length)
+			n = length;
+		memcpy(f->ring + index, data, n);
+		f->received += n;
+		data += n;
+		length -= n;
+	}
+	while (!spiflash_busy() && netflash_pump(f, 0));
+	return 0;
+}
+
+void netflash(int nb_params, char **params)
+{
+	struct netflash f;
+	unsigned int ip;
+	char *c;
+	int size;
+
+	if (nb_params < 2) {
+		printf("netflash <filename> <offset>\n");
+		return;
+	}
+	f.offset = strtoul(params[1], &c, 0);
+	if ((*c != 0) || (f.offset % SPI_FLASH_SECTOR_SIZE)) {
+		printf("Incorrect offset (4KB aligned)\n");
+		return;
+	}
+	f.ring = (uint8_t *) MAIN_RAM_BASE;
+	f.erased = f.offset;
+	f.programmed = 0;
+	f.received = 0;
+	f.crc = 0;
+
+	printf("Writing %s to flash offset 0x%08lx...\n", params[0], (unsigned long) f.offset);
+	ip = IPTOINT(remote_ip[0], remote_ip[1], remote_ip[2], remote_ip[3]);
+	netboot_start();
+	size = tftp_get_stream(ip, TFTP_SERVER_PORT, params[0], netflash_data, &f);
+	while (netflash_pump(&f, 1));
+	while (spiflash_busy());
+	flush_cpu_dcache();
+	if (size <= 0) {
+		printf("Network flash update failed (%ld bytes written).\n", f.programmed);
+		return;
+	}
+#ifdef SPIFLASH_BASE
+	if (crc32((const unsigned char *) SPIFLASH_BASE + f.offset, size) != f.crc) {
+		printf("Flash verify failed.\n");
+		return;
+	}
+#endif
+	printf("%d bytes written.\n", size);
+}
+
+#endif
+
 #endif
 
 /*-----------------------------------------------------------------------*/
@@ -579,11 +1716,9 @@ void netboot(int nb_params, char **params)
 
 #ifdef FLASH_BOOT_ADDRESS
 
-static unsigned int check_image_in_flash(unsigned int base_address)
+static unsigned int check_image_length_in_flash(unsigned int base_address)
 {
 	uint32_t length;
-	uint32_t crc;
-	uint32_t got_crc;
 
 	length = MMPTR(base_address);
 	if((length < 32) || (length > 16*1024*1024)) {
@@ -591,6 +1726,20 @@ static unsigned int check_image_in_flash(unsigned int base_address)
 		return 0;
 	}
 
+	return length;
+}
+
+#ifndef MAIN_RAM_BASE
+static unsigned int check_image_in_flash(unsigned int base_address)
+{
+	uint32_t length;
+	uint32_t crc;
+	uint32_t got_crc;
+
+	length = check_image_length_in_flash(base_address);
+	if(!length)
+		return 0;
+
 	crc = MMPTR(base_address + 4);
 	got_crc = crc32((unsigned char *)(base_address + 8), length);
 	if(crc != got_crc) {
@@ -601,27 +1750,116 @@ static unsigned int check_image_in_flash(unsigned int base_address)
 	return length;
 }
 
+/* spiflash_init() selects the fastest clock reading the first block of the
+   flash back; executed in place, the whole image has to read correctly: the
+   clock is slowed down until its CRC matches */
+#define FLASHBOOT_XIP_DIVISOR_STEPS 4
+
+static unsigned int check_xip_image_in_flash(unsigned int base_address)
+{
+#ifdef CSR_SPIFLASH_PHY_CLK_DIVISOR_ADDR
+	uint32_t length;
+	uint32_t divisor;
+	int steps;
+
+#ifdef SPIFLASH_SKIP_FREQ_INIT
+	spiflash_freq_init();
+#endif
+	for (steps = 0;; steps++) {
+		length = check_image_in_flash(base_address);
+		if (length || (steps == FLASHBOOT_XIP_DIVISOR_STEPS))
+			return length;
+		divisor = spiflash_phy_clk_divisor_read() + 1;
+		printf("Retrying with SPI Flash clk divisor %d...\n", divisor);
+		spiflash_phy_clk_divisor_write(divisor);
+		flush_cpu_dcache();
+	}
+#else
+	return check_image_in_flash(base_address);
+#endif
+}
+
+/* XIP images can end with the descriptor of a section to run from SRAM,
+   emitted last by the linker script of the firmware:
+     .xip_hot : { LONG(0x54484958) LONG(LOADADDR(.hot)) LONG(ADDR(.hot)) LONG(SIZEOF(.hot)) } > rom
+   It is copied before jumping to the image. */
+#define XIP_HOT_MAGIC 0x54484958 /* "XIHT" */
+#define XIP_HOT_STACK_MARGIN 256
+
+struct xip_hot_section {
+	uint32_t magic;
+	uint32_t src;
+	uint32_t dst;
+	uint32_t size;
+};
+
+static void copy_xip_hot_section(unsigned int base_address, uint32_t length)
+{
+#ifdef SRAM_BASE
+	const struct xip_hot_section *h;
+	unsigned long start = base_address + 2 * sizeof(uint32_t);
+	unsigned long stack = (unsigned long) &h;
+
+	if (length < sizeof(*h))
+		return;
+	h = (const struct xip_hot_section *)(start + length - sizeof(*h));
+	if (h->magic != XIP_HOT_MAGIC)
+		return;
+	/* From the image, to the SRAM below the stack of the BIOS */
+	if ((h->src < start) || (h->src + h->size > start + length) ||
+		(h->dst < SRAM_BASE) || (h->dst + h->size > stack - XIP_HOT_STACK_MARGIN)) {
+		printf("Invalid XIP hot section, ignored.\n");
+		return;
+	}
+	printf("Copying hot section to 0x%08lx (%ld bytes)...\n", (unsigned long) h->dst, (unsigned long) h->size);
+	memcpy((void *) h->dst, (void *) h->src, h->size);
+#endif
+}
+#endif
+
 #if defined(MAIN_RAM_BASE) && defined(FLASH_BOOT_ADDRESS)
+/* Copies (or decompresses) the image and checks its CRC in a single pass
+   over the flash */
 static int copy_image_from_flash_to_ram(unsigned int flash_address, unsigned long ram_address)
 {
+	struct image_load load;
 	uint32_t length;
 	uint32_t offset;
+	uint32_t crc;
+	int compressed;
 
-	length = check_image_in_flash(flash_address);
+	length = check_image_length_in_flash(flash_address);
 	if(length > 0) {
 		printf("Copying 0x%08x to 0x%08lx (%d bytes)...\n", flash_address, ram_address, length);
+		crc = MMPTR(flash_address + 4);
 		offset = 0;
+		compressed = lz4_is_frame((void *) flash_address + 8);
+		image_load_init(&load, (void *) ram_address);
 		init_progression_bar(length);
 		while (length > 0) {
 			uint32_t chunk_length;
-			chunk_length = min(length, 0x8000); /* 32KB chunks */
-			memcpy((void *) ram_address + offset, (void*) flash_address + offset + 8, chunk_length);
+			/* 32KB chunks, small ones when compressed: read from the flash by the
+			   CRC, then from the data cache by the decompressor */
+			chunk_length = min(length, compressed ? 0x800 : 0x8000);
+			if (image_load_data(&load, (void *) flash_address + offset + 8, chunk_length) < 0) {
+				printf("\nLZ4 decompression error.\n");
+				return 0;
+			}
 			offset += chunk_length;
 			length -= chunk_length;
-			show_progress(offset);
+			if (!compressed || (offset & (0x8000 - 1)) == 0)
+				show_progress(offset);
 		}
 		show_progress(offset);
 		printf("\n");
+		if (!image_check_crc(&crc, load.crc))
+			return 0;
+		if (compressed) {
+			length = image_load_end(&load);
+			if (length == 0)
+				return 0;
+			printf("Decompressed to %d bytes.\n", length);
+		}
 		return 1;
 	}
 
@@ -631,17 +1869,17 @@ static int copy_image_from_flash_to_ram(unsigned int flash_address, unsigned lon
 
 void flashboot(void)
 {
-	uint32_t length;
+#ifdef MAIN_RAM_BASE
 	uint32_t result;
+#else
+	uint32_t length;
+#endif
 
 	printf("Booting from flash...\n");
-	length = check_image_in_flash(FLASH_BOOT_ADDRESS);
-	if(!length)
-		return;
 
 #ifdef MAIN_RAM_BASE
 	/* When Main RAM is available, copy the code from the Flash and execute it
-	from Main RAM since faster */
+	from Main RAM since faster (the CRC is checked while copying) */
 	result = copy_image_from_flash_to_ram(FLASH_BOOT_ADDRESS, MAIN_RAM_BASE);
 	if(!result)
 		return;
@@ -649,6 +1887,10 @@ void flashboot(void)
 #else
 	/* When Main RAM is not available, execute the code directly from Flash (XIP).
        The code starts after (a) length and (b) CRC -- both uint32_t */
+	length = check_xip_image_in_flash(FLASH_BOOT_ADDRESS);
+	if(!length)
+		return;
+	copy_xip_hot_section(FLASH_BOOT_ADDRESS, length);
 	boot(0, 0, 0, (FLASH_BOOT_ADDRESS + 2 * sizeof(uint32_t)));
 #endif
 }
@@ -656,158 +1898,485 @@ void flashboot(void)
 #endif
 
 /*-----------------------------------------------------------------------*/
-/* SDCard Boot                                                           */
+/* FatFs Boot (SDCard, SATA)                                             */
 /*-----------------------------------------------------------------------*/
 
-#if defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE)
+#if defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE) || defined(CSR_SATA_SECTOR2MEM_BASE)
+
+/* SD-Mode (or SATA with NCQ): the reads into the image complete in the
+   background, a chunk waiting for its reads only when its CRC is computed */
+#if defined(CSR_SDCORE_BASE) && defined(CSR_SDBLOCK2MEM_BASE)
+#define fatfs_async_start(base, size) sdcard_set_async_buffer(base, size)
+#define fatfs_async_ticket()          sdcard_ticket()
+#define fatfs_async_wait(ticket)      sdcard_wait(ticket)
+#elif defined(CSR_SATA_SECTOR2MEM_TAG_ADDR)
+#define fatfs_async_start(base, size) sata_set_async_buffer(base, size)
+#define fatfs_async_ticket()          sata_ticket()
+#define fatfs_async_wait(ticket)      sata_wait(ticket)
+#else
+#define fatfs_async_start(base, size)
+#define fatfs_async_ticket()          0
+#define fatfs_async_wait(ticket)
+#endif
 
-static int copy_file_from_sdcard_to_ram(const char * filename, unsigned long ram_address)
+/* Files of up to FATFS_CLMT_FRAGMENTS fragments are mapped by a cluster link
+   map table (CLMT, FatFs fast seek): f_read() no longer follows the FAT
+   chain between its reads. Contiguous files (one fragment, or flagged as
+   without FAT chain on exFAT) are read with disk_read() in chunks of
+   FATFS_CONTIGUOUS_CHUNK bytes, straight to the destination. */
+#define FATFS_CLMT_FRAGMENTS  16
+#define FATFS_CHUNK           0x8000
+#define FATFS_CONTIGUOUS_CHUNK 0x40000
+
+/* The filesystem is mounted by the caller */
+static int copy_fatfs_file_to_ram(const char * filename, unsigned long ram_address, const uint32_t *crc)
 {
 	FRESULT fr;
-	FATFS fs;
 	FIL file;
+	DWORD clmt[2 + 2*FATFS_CLMT_FRAGMENTS];
+	LBA_t sector;
 	uint32_t br;
 	uint32_t offset;
+	uint32_t got_crc;
+	uint32_t last_offset, last_length;
+	unsigned int last_ticket;
 	unsigned long length;
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+	uint64_t start;
+	unsigned long us;
+#endif
 
-	fr = f_mount(&fs, "", 1);
-	if (fr != FR_OK)
-		return 0;
 	fr = f_open(&file, filename, FA_READ);
 	if (fr != FR_OK) {
 		printf("%s file not found.\n", filename);
-		f_mount(0, "", 0);
 		return 0;
 	}
 
+	/* Map the file, fragmented beyond the table: FAT chain */
+	sector = 0;
+#if FF_FS_EXFAT
+	/* exFAT contiguous file (NoFatChain flag): nothing to map */
+	if ((file.obj.fs->fs_type == FS_EXFAT) && (file.obj.stat == 2) && file.obj.sclust)
+		sector = file.obj.fs->database + (LBA_t)file.obj.fs->csize*(file.obj.sclust - 2);
+	else
+#endif
+	{
+		clmt[0] = sizeof(clmt)/sizeof(clmt[0]);
+		file.cltbl = clmt;
+		if (f_lseek(&file, CREATE_LINKMAP) != FR_OK)
+			file.cltbl = NULL;
+		else if (clmt[0] == 4)
+			sector = file.obj.fs->database + (LBA_t)file.obj.fs->csize*(clmt[2] - 2);
+	}
+
 	length = f_size(&file);
 	printf("Copying %s to 0x%08lx (%ld bytes)...\n", filename, ram_address, length);
+	if (file_is_lz4(&file)) {
+		length = copy_lz4_file_to_ram(&file, ram_address, crc);
+		if (length > 0)
+			printf("Decompressed to %lu bytes.\n", (unsigned long) length);
+		f_close(&file);
+		return length > 0;
+	}
 	init_progression_bar(length);
 	offset = 0;
+	got_crc = 0;
+	last_offset = 0;
+	last_length = 0;
+	last_ticket = fatfs_async_ticket();
+	fatfs_async_start((void *) ram_address, length);
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+	start = boot_time_cycles();
+#endif
 	for (;;) {
-		fr = f_read(&file, (void*) ram_address + offset,  0x8000, (UINT *)&br);
+		if (sector && (length - offset >= 512)) {
+			/* Whole sectors of a contiguous file, the file pointer following */
+			br = min(length - offset, FATFS_CONTIGUOUS_CHUNK) & ~511;
+			fr = FR_DISK_ERR;
+			if (disk_read(file.obj.fs->pdrv, (void*) ram_address + offset, sector + offset/512, br/512) == RES_OK)
+				fr = f_lseek(&file, offset + br);
+		} else
+			fr = f_read(&file, (void*) ram_address + offset, FATFS_CHUNK, (UINT *)&br);
 		if (fr != FR_OK) {
 			printf("file read error.\n");
+			fatfs_async_wait(fatfs_async_ticket());
+			fatfs_async_start(NULL, 0);
 			f_close(&file);
-			f_mount(0, "", 0);
 			return 0;
 		}
 		if (br == 0)
 			break;
+		/* Read by the disk controller: the CRC needs a pass, only when checked,
+		   done on the previous chunk while this one is read */
+		if (crc) {
+			fatfs_async_wait(last_ticket);
+			got_crc = crc32_update(got_crc, (void*) ram_address + last_offset, last_length);
+		}
+		last_offset = offset;
+		last_length = br;
+		last_ticket = fatfs_async_ticket();
 		offset += br;
 		show_progress(offset);
 	}
+	fatfs_async_wait(fatfs_async_ticket());
+	fatfs_async_start(NULL, 0);
+	if (crc)
+		got_crc = crc32_update(got_crc, (void*) ram_address + last_offset, last_length);
 	show_progress(offset);
 	printf("\n");
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+	us = (boot_time_cycles() - start)*1000000/CONFIG_CLOCK_FREQUENCY;
+	if (us > 0)
+		printf("Copied at %lu.%02lu MB/s.\n", offset/us, (offset%us)*100/us);
+#endif
+
+	f_close(&file);
+
+	if (!image_check_crc(crc, got_crc))
+		return 0;
+	warmboot_image(ram_address, offset);
+	return 1;
+}
+
+/* Volumes of the FatFs drives (libfatfs/diskio.c) */
+static const char * const fatfs_volumes[FF_VOLUMES] = {"sd:", "sata:", "ram:"};
+
+/* Mounts the volume booted from and makes it the current drive, the others
+   being mounted on their first access (the one of the log stays mounted) */
+static FRESULT fatfs_mount(FATFS *fs, const char *volume)
+{
+	FRESULT fr;
+	int i;
+
+	for (i = 0; i < FF_VOLUMES; i++) {
+		if (i == fatlog_drive())
+			continue;
+		fr = f_mount(&fs[i], fatfs_volumes[i], strcmp(fatfs_volumes[i], volume) == 0);
+		if ((fr != FR_OK) && (strcmp(fatfs_volumes[i], volume) == 0))
+			return fr;
+	}
+	return f_chdrive(volume);
+}
+
+static void fatfs_unmount(void)
+{
+	int i;
+
+	for (i = 0; i < FF_VOLUMES; i++)
+		if (i != fatlog_drive())
+			f_mount(0, fatfs_volumes[i], 0);
+}
+
+/* Loads the images of boot.json, names relative to its volume or on
+   another one ("sata:Image"), in the order of their volume and first
+   cluster so that the reads mostly go forward */
+static void fatfs_boot_from_json(const char *volume, const char * filename)
+{
+	FRESULT fr;
+	FATFS fs[FF_VOLUMES];
+	FIL file;
+
+	UINT length;
+	int j, n;
+
+	struct boot_json b;
+	struct boot_json_image image;
+
+	/* Read JSON file */
+	boot_time_phase("fatfs_mount");
+	fr = fatfs_mount(fs, volume);
+	if (fr != FR_OK)
+		goto out;
+	fr = f_open(&file, filename, FA_READ);
+	if (fr != FR_OK) {
+		printf("%s file not found.\n", filename);
+		goto out;
+	}
+	if (f_size(&file) > BOOT_JSON_TEXT_MAX) {
+		printf("JSON too large.\n");
+		f_close(&file);
+		goto out;
+	}
+	fr = f_read(&file, (void *) BOOT_JSON_BASE, f_size(&file), &length);
+
+	/* Close JSON file */
+	f_close(&file);
+	if (fr != FR_OK)
+		goto out;
+
+	/* Parse JSON file */
+	boot_time_phase("fatfs_json");
+	if (boot_json_parse(&b, length) <= 0)
+		goto out;
+
+	/* Sort Images by volume and first cluster (FAT32: below 2^28) */
+	for (n=0; n<b.nimages; n++) {
+		fr = f_open(&file, b.images[n].name, FA_READ);
+		if (fr != FR_OK) {
+			printf("%s file not found.\n", b.images[n].name);
+			goto out;
+		}
+		b.images[n].order = ((unsigned long) file.obj.fs->pdrv << 28) | file.obj.sclust;
+		length = f_size(&file);
+		f_close(&file);
+		if (boot_json_image_overlaps(&b.images[n], length))
+			goto out;
+		image = b.images[n];
+		for (j=n; (j > 0) && (b.images[j-1].order > image.order); j--)
+			b.images[j] = b.images[j-1];
+		b.images[j] = image;
+	}
+
+	/* Copy Images from disk to address */
+	boot_time_phase("fatfs_copy");
+	for (n=0; n<b.nimages; n++) {
+		if (copy_fatfs_file_to_ram(b.images[n].name, b.images[n].addr,
+			b.images[n].check_crc ? &b.images[n].crc : NULL) == 0)
+			goto out;
+	}
+	fatfs_unmount();
+
+	/* Boot */
+	boot(b.r1, b.r2, b.r3, b.addr);
+	return;
+
+out:
+	fatfs_unmount();
+}
+
+static void fatfs_boot_from_bin(const char *volume, const char * filename)
+{
+	FATFS fs[FF_VOLUMES];
+	uint32_t result;
+
+	result = 0;
+	if (fatfs_mount(fs, volume) == FR_OK)
+		result = copy_fatfs_file_to_ram(filename, MAIN_RAM_BASE, NULL);
+	fatfs_unmount();
+	if (result == 0)
+		return;
+	boot(0, 0, 0, MAIN_RAM_BASE);
+}
+
+/*-----------------------------------------------------------------------*/
+/* RAM Disk Boot                                                         */
+/*-----------------------------------------------------------------------*/
+
+/* FAT image loaded to RAM (netload, serial...) */
+void ramdiskboot(unsigned long address, unsigned long size)
+{
+	printf("Booting from RAM disk at 0x%08lx...\n", address);
+	diskio_ramdisk_set((void *) address, size/512);
+
+	/* Boot from boot.json */
+	printf("Booting from boot.json...\n");
+	fatfs_boot_from_json("ram:", "boot.json");
+
+	/* Boot from boot.bin */
+	printf("Booting from boot.bin...\n");
+	fatfs_boot_from_bin("ram:", "boot.bin");
+
+	/* Boot failed if we are here... */
+	diskio_ramdisk_set(NULL, 0);
+	printf("RAM disk boot failed.\n");
+}
+
+/*-----------------------------------------------------------------------*/
+/* FatFs Log                                                             */
+/*-----------------------------------------------------------------------*/
+
+#ifdef FATFS_WRITE
+
+#ifndef FATFS_LOG_BUFFER_SIZE
+#define FATFS_LOG_BUFFER_SIZE 4096
+#endif
+
+static char fatfs_log_buffer[FATFS_LOG_BUFFER_SIZE];
 
-	f_close(&file);
-	f_mount(0, "", 0);
+/* Appends the console output to a file, on the first volume (but ram:)
+   opening it when the name has none. A buffer of a few clusters (in main
+   RAM) makes the writes whole clusters. */
+int fatfs_log_start(const char *filename, void *buffer, unsigned int size)
+{
+	char path[64];
+	FRESULT fr;
+	int i;
 
+	fatfs_log_stop();
+	if (!buffer) {
+		buffer = fatfs_log_buffer;
+		size   = sizeof(fatfs_log_buffer);
+	}
+	if (strchr(filename, ':'))
+		fr = fatlog_open(filename, buffer, size);
+	else {
+		fr = FR_NOT_READY;
+		for (i = 0; (i < DISKIO_RAM) && (fr != FR_OK); i++) {
+			snprintf(path, sizeof(path), "%s%s", fatfs_volumes[i], filename);
+			fr = fatlog_open(path, buffer, size);
+		}
+	}
+	if (fr != FR_OK) {
+		printf("Unable to open log %s (FatFs error %d).\n", filename, fr);
+		return 0;
+	}
+	console_tee = fatlog_putc;
 	return 1;
 }
 
-static void sdcardboot_from_json(const char * filename)
+void fatfs_log_flush(void)
+{
+	if (fatlog_drive() >= 0)
+		fatlog_flush();
+}
+
+void fatfs_log_stop(void)
+{
+	console_tee = NULL;
+	if ((fatlog_drive() >= 0) && (fatlog_close() != FR_OK))
+		printf("Log write error.\n");
+}
+
+#endif
+
+/* Reads a whole file ("sd:script.txt") to buf */
+static int fatfs_fetch(const char *path, char *buf, unsigned int size)
 {
+	FATFS fs[FF_VOLUMES];
+	char volume[8];
 	FRESULT fr;
-	FATFS fs;
 	FIL file;
+	UINT length;
+	int n;
 
-	uint8_t i;
-	uint8_t count;
-	uint32_t length;
-	uint32_t result;
+	n = strchr(path, ':') - path + 1;
+	if (n >= sizeof(volume))
+		return -1;
+	memcpy(volume, path, n);
+	volume[n] = 0;
+	length = 0;
+	fr = fatfs_mount(fs, volume);
+	if (fr == FR_OK)
+		fr = f_open(&file, path, FA_READ);
+	if (fr == FR_OK) {
+		if (f_size(&file) > size) {
+			printf("File too large.\n");
+			fr = FR_INVALID_PARAMETER;
+		} else
+			fr = f_read(&file, buf, f_size(&file), &length);
+		f_close(&file);
+	}
+	fatfs_unmount();
+	if (fr != FR_OK) {
+		printf("Unable to read %s (FatFs error %d).\n", path, fr);
+		return -1;
+	}
+	return length;
+}
 
-	/* FIXME: modify/increase if too limiting */
-	char json_buffer[1024];
-	char json_name[32];
-	char json_value[32];
+#endif
 
-	unsigned long boot_r1 = 0;
-	unsigned long boot_r2 = 0;
-	unsigned long boot_r3 = 0;
-	unsigned long boot_addr = 0;
+/*-----------------------------------------------------------------------*/
+/* File fetch                                                            */
+/*-----------------------------------------------------------------------*/
 
-	uint8_t image_found = 0;
-	uint8_t boot_addr_found = 0;
+/* Small files (BIOS scripts) from the TFTP server ("tftp:name") or a FatFs
+   volume ("sd:name", "sata:name", "ram:name"), returns the length or -1 */
+int file_fetch(const char *name, char *buf, unsigned int size)
+{
+#ifdef CSR_ETHMAC_BASE
+	if (!strncmp(name, "tftp:", 5))
+		return netboot_fetch(name + 5, buf, size);
+#endif
+#if defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE) || defined(CSR_SATA_SECTOR2MEM_BASE)
+	if (strchr(name, ':'))
+		return fatfs_fetch(name, buf, size);
+#endif
+	printf("Unsupported file source: %s\n", name);
+	return -1;
+}
 
-	/* Read JSON file */
-	fr = f_mount(&fs, "", 1);
-	if (fr != FR_OK)
-		return;
-	fr = f_open(&file, filename, FA_READ);
-	if (fr != FR_OK) {
-		printf("%s file not found.\n", filename);
-		f_mount(0, "", 0);
-		return;
-	}
+/*-----------------------------------------------------------------------*/
+/* Raw Boot                                                              */
+/*-----------------------------------------------------------------------*/
 
-	fr = f_read(&file, json_buffer, sizeof(json_buffer), (UINT *) &length);
+/* With RAW_BOOT_LBA (SoC constant), sdcardboot()/sataboot() first look for a
+   raw image at this sector of the medium, e.g. in the gap before the first
+   partition: a header sector (mkmscimg --raw) followed by the image, read
+   to its load address with a single multi-sector disk_read(), without
+   mounting the filesystem. boot.json/boot.bin are tried when there is no
+   valid header. */
 
-	/* Close JSON file */
-	f_close(&file);
-	f_mount(0, "", 0);
+#if defined(RAW_BOOT_LBA) && \
+	(defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE) || defined(CSR_SATA_SECTOR2MEM_BASE))
 
-	/* Parse JSON file */
-	jsmntok_t t[32];
-	jsmn_parser p;
-	jsmn_init(&p);
-	count = jsmn_parse(&p, json_buffer, strlen(json_buffer), t, sizeof(t)/sizeof(*t));
-	for (i=0; i<count-1; i++) {
-		memset(json_name,   0, sizeof(json_name));
-		memset(json_value,  0, sizeof(json_value));
-		/* Elements are JSON strings with 1 children */
-		if ((t[i].type == JSMN_STRING) && (t[i].size == 1)) {
-			/* Get Element's filename */
-			memcpy(json_name, json_buffer + t[i].start, t[i].end - t[i].start);
-			/* Get Element's address */
-			memcpy(json_value, json_buffer + t[i+1].start, t[i+1].end - t[i+1].start);
-			/* Skip bootargs (optional) */
-			if (strncmp(json_name, "bootargs", 8) == 0) {
-				continue;
-			}
-			/* Get boot addr (optional) */
-			else if (strncmp(json_name, "addr", 4) == 0) {
-				boot_addr = strtoul(json_value, NULL, 0);
-				boot_addr_found = 1;
-			}
-			/* Get boot r1 (optional) */
-			else if (strncmp(json_name, "r1", 2) == 0) {
-				memcpy(json_name, json_buffer + t[i].start, t[i].end - t[i].start);
-				boot_r1 = strtoul(json_value, NULL, 0);
-			}
-			/* Get boot r2 (optional) */
-			else if (strncmp(json_name, "r2", 2) == 0) {
-				boot_r2 = strtoul(json_value, NULL, 0);
-			}
-			/* Get boot r3 (optional) */
-			else if (strncmp(json_name, "r3", 2) == 0) {
-				boot_r3 = strtoul(json_value, NULL, 0);
-			/* Copy Image from SDCard to address */
-			} else {
-				result = copy_file_from_sdcard_to_ram(json_name, strtoul(json_value, NULL, 0));
-				if (result == 0)
-					return;
-				image_found = 1;
-				if (boot_addr_found == 0) /* Boot to last Image address if no bootargs.addr specified */
-					boot_addr = strtoul(json_value, NULL, 0);
-			}
-		}
-	}
+#define RAW_BOOT_MAGIC 0x4252584c /* "LXRB" */
 
-	/* Boot */
-	if (image_found)
-		boot(boot_r1, boot_r2, boot_r3, boot_addr);
-}
+struct raw_boot_header {
+	uint32_t magic;
+	uint32_t length;  /* Bytes of the image, from the next sector */
+	uint32_t address; /* Load and boot address */
+	uint32_t crc;     /* CRC32 of the image */
+	uint32_t hcrc;    /* CRC32 of the fields above */
+};
 
-static void sdcardboot_from_bin(const char * filename)
+static void raw_boot(BYTE drv)
 {
-	uint32_t result;
-	result = copy_file_from_sdcard_to_ram(filename, MAIN_RAM_BASE);
-	if (result == 0)
+	static uint32_t sector[512/4];
+	struct raw_boot_header *h = (struct raw_boot_header *) sector;
+	unsigned long address, length;
+	uint32_t crc;
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+	uint64_t start;
+	unsigned long us;
+#endif
+
+	if (disk_initialize(drv) & STA_NOINIT)
 		return;
-	boot(0, 0, 0, MAIN_RAM_BASE);
+	if (disk_read(drv, (BYTE *) sector, RAW_BOOT_LBA, 1) != RES_OK)
+		return;
+	if ((h->magic != RAW_BOOT_MAGIC) || (h->hcrc != crc32((unsigned char *) h, offsetof(struct raw_boot_header, hcrc)))) {
+		printf("No raw image at sector %d.\n", RAW_BOOT_LBA);
+		return;
+	}
+	address = h->address;
+	length  = (h->length + 511) & ~511;
+#ifdef MAIN_RAM_BASE
+	if ((address < MAIN_RAM_BASE) || (address + length > MAIN_RAM_BASE + MAIN_RAM_SIZE) || !h->length) {
+		printf("Raw image out of main RAM (0x%08lx, %ld bytes).\n", address, (unsigned long) h->length);
+		return;
+	}
+#endif
+	printf("Copying raw image to 0x%08lx (%ld bytes)...\n", address, (unsigned long) h->length);
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+	start = boot_time_cycles();
+#endif
+	if (disk_read(drv, (BYTE *) address, RAW_BOOT_LBA + 1, length/512) != RES_OK) {
+		printf("Raw image read error.\n");
+		return;
+	}
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+	us = (boot_time_cycles() - start)*1000000/CONFIG_CLOCK_FREQUENCY;
+	if (us > 0)
+		printf("Copied at %lu.%02lu MB/s.\n", length/us, (length%us)*100/us);
+#endif
+	crc = crc32((unsigned char *) address, h->length);
+	if (!image_check_crc(&h->crc, crc))
+		return;
+	warmboot_image(address, h->length);
+	boot(0, 0, 0, address);
 }
 
+#else
+#define raw_boot(drv)
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* SDCard Boot                                                           */
+/*-----------------------------------------------------------------------*/
+
+#if defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE)
+
 void sdcardboot(void)
 {
 #ifdef CSR_SPISDCARD_BASE
@@ -817,13 +2386,16 @@ void sdcardboot(void)
 	printf("Booting from SDCard in SD-Mode...\n");
 #endif
 
+	/* Boot from the raw image */
+	raw_boot(DISKIO_SD);
+
 	/* Boot from boot.json */
 	printf("Booting from boot.json...\n");
-	sdcardboot_from_json("boot.json");
+	fatfs_boot_from_json("sd:", "boot.json");
 
 	/* Boot from boot.bin */
 	printf("Booting from boot.bin...\n");
-	sdcardboot_from_bin("boot.bin");
+	fatfs_boot_from_bin("sd:", "boot.bin");
 
 	/* Boot failed if we are here... */
 	printf("SDCard boot failed.\n");
@@ -836,166 +2408,269 @@ void sdcardboot(void)
 
 #if defined(CSR_SATA_SECTOR2MEM_BASE)
 
-static int copy_file_from_sata_to_ram(const char * filename, unsigned long ram_address)
+void sataboot(void)
 {
-	FRESULT fr;
-	FATFS fs;
-	FIL file;
-	uint32_t br;
-	uint32_t offset;
-	uint32_t length;
+	printf("Booting from SATA...\n");
 
-	fr = f_mount(&fs, "", 1);
-	if (fr != FR_OK)
-		return 0;
-	fr = f_open(&file, filename, FA_READ);
-	if (fr != FR_OK) {
-		printf("%s file not found.\n", filename);
-		f_mount(0, "", 0);
-		return 0;
-	}
+	/* Boot from the raw image */
+	raw_boot(DISKIO_SATA);
 
-	length = f_size(&file);
-	printf("Copying %s to 0x%08lx (%ld bytes)...\n", filename, ram_address, length);
-	init_progression_bar(length);
-	offset = 0;
-	for (;;) {
-		fr = f_read(&file, (void*) ram_address + offset,  0x8000, (UINT *) &br);
-		if (fr != FR_OK) {
-			printf("file read error.\n");
-			f_close(&file);
-			f_mount(0, "", 0);
-			return 0;
-		}
-		if (br == 0)
-			break;
-		offset += br;
-		show_progress(offset);
-	}
-	show_progress(offset);
-	printf("\n");
+	/* Boot from boot.json */
+	printf("Booting from boot.json...\n");
+	fatfs_boot_from_json("sata:", "boot.json");
 
-	f_close(&file);
-	f_mount(0, "", 0);
+	/* Boot from boot.bin */
+	printf("Booting from boot.bin...\n");
+	fatfs_boot_from_bin("sata:", "boot.bin");
+
+	/* Boot failed if we are here... */
+	printf("SATA boot failed.\n");
+}
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* Boot Sequence                                                         */
+/*-----------------------------------------------------------------------*/
+
+/* The boot media are tried in the order of BIOS_BOOT_ORDER (their names
+   separated by commas, the media absent from the SoC being skipped), or in
+   the order saved with the boot_order command when BOOT_ORDER_FLASH_OFFSET
+   reserves an erase sector of the SPI Flash for it. "netload" (waiting
+   for an image pushed by the host) is not in the default order. */
+
+#ifndef BIOS_BOOT_ORDER
+#define BIOS_BOOT_ORDER "serial,flash,rom,sdcard,sata,net"
+#endif
+
+#define BOOT_ORDER_MAX 64
+
+struct boot_medium {
+	const char *name;
+	int (*boot)(void); /* Returns 0 to stop the sequence */
+};
+
+#ifdef CSR_UART_BASE
+static int boot_medium_serial(void)
+{
+	return serialboot();
+}
+#endif
 
+#ifdef FLASH_BOOT_ADDRESS
+static int boot_medium_flash(void)
+{
+	flashboot();
 	return 1;
 }
+#endif
 
-static void sataboot_from_json(const char * filename)
+#ifdef ROM_BOOT_ADDRESS
+static int boot_medium_rom(void)
 {
-	FRESULT fr;
-	FATFS fs;
-	FIL file;
+	romboot();
+	return 1;
+}
+#endif
 
-	uint8_t i;
-	uint8_t count;
-	uint32_t length;
-	uint32_t result;
+#if defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE)
+static int boot_medium_sdcard(void)
+{
+	sdcardboot();
+	return 1;
+}
+#endif
 
-	/* FIXME: modify/increase if too limiting */
-	char json_buffer[1024];
-	char json_name[32];
-	char json_value[32];
+#if defined(CSR_SATA_SECTOR2MEM_BASE)
+static int boot_medium_sata(void)
+{
+	sataboot();
+	return 1;
+}
+#endif
 
-	unsigned long boot_r1 = 0;
-	unsigned long boot_r2 = 0;
-	unsigned long boot_r3 = 0;
-	unsigned long boot_addr = 0;
+#if defined(CSR_ETHMAC_BASE) && defined(MAIN_RAM_BASE)
+/* Image pushed to main RAM by litex_netload (to one or many boards) */
+static int boot_medium_netload(void)
+{
+	int size;
 
-	uint8_t image_found = 0;
-	uint8_t boot_addr_found = 0;
+#ifdef CSR_ETHPHY_MODE_DETECTION_MODE_ADDR
+	eth_mode();
+#endif
+	printf("Booting from network push...\n");
+	printf("Local IP: %d.%d.%d.%d, waiting for litex_netload on port %d...\n",
+		local_ip[0], local_ip[1], local_ip[2], local_ip[3], BULK_PORT);
+	netboot_start();
+	size = bulk_load((void *) MAIN_RAM_BASE, MAIN_RAM_SIZE);
+	if (size <= 0)
+		return 1;
+	printf("Loaded %d bytes, executing...\n", size);
+	boot(0, 0, 0, MAIN_RAM_BASE);
+	return 1;
+}
+#endif
 
-	/* Read JSON file */
-	fr = f_mount(&fs, "", 1);
-	if (fr != FR_OK)
-		return;
-	fr = f_open(&file, filename, FA_READ);
-	if (fr != FR_OK) {
-		printf("%s file not found.\n", filename);
-		f_mount(0, "", 0);
-		return;
-	}
+#ifdef CSR_ETHMAC_BASE
+static int boot_medium_net(void)
+{
+#ifdef CSR_ETHPHY_MODE_DETECTION_MODE_ADDR
+	eth_mode();
+#endif
+	netboot(0, NULL);
+	return 1;
+}
+#endif
 
-	fr = f_read(&file, json_buffer, sizeof(json_buffer), (UINT *) &length);
+static const struct boot_medium boot_media[] = {
+#ifdef CSR_UART_BASE
+	{"serial", boot_medium_serial},
+#endif
+#ifdef FLASH_BOOT_ADDRESS
+	{"flash",  boot_medium_flash},
+#endif
+#ifdef ROM_BOOT_ADDRESS
+	{"rom",    boot_medium_rom},
+#endif
+#if defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE)
+	{"sdcard", boot_medium_sdcard},
+#endif
+#if defined(CSR_SATA_SECTOR2MEM_BASE)
+	{"sata",   boot_medium_sata},
+#endif
+#ifdef CSR_ETHMAC_BASE
+	{"net",    boot_medium_net},
+#endif
+#if defined(CSR_ETHMAC_BASE) && defined(MAIN_RAM_BASE)
+	{"netload", boot_medium_netload},
+#endif
+};
 
-	/* Close JSON file */
-	f_close(&file);
-	f_mount(0, "", 0);
+#define BOOT_MEDIA_COUNT ((int)(sizeof(boot_media)/sizeof(boot_media[0])))
 
-	/* Parse JSON file */
-	jsmntok_t t[32];
-	jsmn_parser p;
-	jsmn_init(&p);
-	count = jsmn_parse(&p, json_buffer, strlen(json_buffer), t, sizeof(t)/sizeof(*t));
-	for (i=0; i<count-1; i++) {
-		memset(json_name,   0, sizeof(json_name));
-		memset(json_value,  0, sizeof(json_value));
-		/* Elements are JSON strings with 1 children */
-		if ((t[i].type == JSMN_STRING) && (t[i].size == 1)) {
-			/* Get Element's filename */
-			memcpy(json_name, json_buffer + t[i].start, t[i].end - t[i].start);
-			/* Get Element's address */
-			memcpy(json_value, json_buffer + t[i+1].start, t[i+1].end - t[i+1].start);
-			/* Skip bootargs (optional) */
-			if (strncmp(json_name, "bootargs", 8) == 0) {
-				continue;
-			}
-			/* Get boot addr (optional) */
-			else if (strncmp(json_name, "addr", 4) == 0) {
-				boot_addr = strtoul(json_value, NULL, 0);
-				boot_addr_found = 1;
-			}
-			/* Get boot r1 (optional) */
-			else if (strncmp(json_name, "r1", 2) == 0) {
-				memcpy(json_name, json_buffer + t[i].start, t[i].end - t[i].start);
-				boot_r1 = strtoul(json_value, NULL, 0);
-			}
-			/* Get boot r2 (optional) */
-			else if (strncmp(json_name, "r2", 2) == 0) {
-				boot_r2 = strtoul(json_value, NULL, 0);
-			}
-			/* Get boot r3 (optional) */
-			else if (strncmp(json_name, "r3", 2) == 0) {
-				boot_r3 = strtoul(json_value, NULL, 0);
-			/* Copy Image from SDCard to address */
-			} else {
-				result = copy_file_from_sata_to_ram(json_name, strtoul(json_value, NULL, 0));
-				if (result == 0)
-					return;
-				image_found = 1;
-				if (boot_addr_found == 0) /* Boot to last Image address if no bootargs.addr specified */
-					boot_addr = strtoul(json_value, NULL, 0);
+/* Fills media with the media of order, returns their number or -1 (with
+   strict) when a name is unknown */
+static int boot_order_parse(const char *order, const struct boot_medium **media, int strict)
+{
+	const char *end;
+	int count = 0;
+	int len;
+	int i;
+
+	while (*order) {
+		for (end = order; *end && (*end != ',') && (*end != ' '); end++);
+		len = end - order;
+		for (i = 0; i < BOOT_MEDIA_COUNT; i++)
+			if (((int)strlen(boot_media[i].name) == len) && !strncmp(boot_media[i].name, order, len))
+				break;
+		if (len > 0) {
+			if (i < BOOT_MEDIA_COUNT) {
+				if (count < BOOT_MEDIA_COUNT)
+					media[count++] = &boot_media[i];
+			} else if (strict) {
+				printf("Unknown boot medium %.*s.\n", len, order);
+				return -1;
 			}
 		}
+		order = *end ? end + 1 : end;
 	}
+	return count;
+}
 
-	/* Boot */
-	if (image_found)
-		boot(boot_r1, boot_r2, boot_r3, boot_addr);
+#if defined(BOOT_ORDER_FLASH_OFFSET) && defined(SPIFLASH_BASE) && \
+	(defined(CSR_SPIFLASH_CORE_MASTER_CS_ADDR) || (defined(CSR_SPIFLASH_BASE) && defined(SPIFLASH_PAGE_SIZE)))
+
+#define BOOT_ORDER_SAVE
+#define BOOT_ORDER_MAGIC 0x524f4f42 /* "BOOR" */
+
+struct boot_order_record {
+	uint32_t magic;
+	char order[BOOT_ORDER_MAX];
+	uint32_t crc;
+};
+
+static const struct boot_order_record *boot_order_saved(void)
+{
+	const struct boot_order_record *r;
+
+	r = (const struct boot_order_record *)(SPIFLASH_BASE + BOOT_ORDER_FLASH_OFFSET);
+	if ((r->magic != BOOT_ORDER_MAGIC) ||
+		(r->crc != crc32((const unsigned char *) r, offsetof(struct boot_order_record, crc))) ||
+		(r->order[BOOT_ORDER_MAX-1] != '\0'))
+		return NULL;
+	return r;
 }
 
-static void sataboot_from_bin(const char * filename)
+#endif
+
+const char *boot_order_get(void)
 {
-	uint32_t result;
-	result = copy_file_from_sata_to_ram(filename, MAIN_RAM_BASE);
-	if (result == 0)
-		return;
-	boot(0, 0, 0, MAIN_RAM_BASE);
+#ifdef BOOT_ORDER_SAVE
+	const struct boot_order_record *r = boot_order_saved();
+
+	if (r)
+		return r->order;
+#endif
+	return BIOS_BOOT_ORDER;
 }
 
-void sataboot(void)
+void boot_order_list(void)
 {
-	printf("Booting from SATA...\n");
+	int i;
 
-	/* Boot from boot.json */
-	printf("Booting from boot.json...\n");
-	sataboot_from_json("boot.json");
+	for (i = 0; i < BOOT_MEDIA_COUNT; i++)
+		printf("%s%s", i ? " " : "", boot_media[i].name);
+}
 
-	/* Boot from boot.bin */
-	printf("Booting from boot.bin...\n");
-	sataboot_from_bin("boot.bin");
+int boot_order_set(const char *order)
+{
+#ifdef BOOT_ORDER_SAVE
+	const struct boot_medium *media[BOOT_MEDIA_COUNT];
+	struct boot_order_record r;
 
-	/* Boot failed if we are here... */
-	printf("SATA boot failed.\n");
+	memset(&r, 0, sizeof(r));
+	if (order) {
+		if ((strlen(order) >= BOOT_ORDER_MAX) || (boot_order_parse(order, media, 1) < 0))
+			return -1;
+		r.magic = BOOT_ORDER_MAGIC;
+		strcpy(r.order, order);
+		r.crc = crc32((const unsigned char *) &r, offsetof(struct boot_order_record, crc));
+	}
+#ifdef CSR_SPIFLASH_CORE_MASTER_CS_ADDR
+	spiflash_erase_sector(BOOT_ORDER_FLASH_OFFSET);
+	if (order)
+		spiflash_write(BOOT_ORDER_FLASH_OFFSET, (const uint8_t *) &r, sizeof(r));
+#else
+	erase_flash_sector(BOOT_ORDER_FLASH_OFFSET);
+	if (order)
+		write_to_flash(BOOT_ORDER_FLASH_OFFSET, (const unsigned char *) &r, sizeof(r));
+#endif
+	return 0;
+#else
+	printf("No SPI Flash sector for the boot order (BOOT_ORDER_FLASH_OFFSET).\n");
+	return -1;
+#endif
 }
+
+void boot_sequence(void)
+{
+	const struct boot_medium *media[BOOT_MEDIA_COUNT];
+	int count;
+	int i;
+
+	count = boot_order_parse(boot_order_get(), media, 0);
+
+#ifdef CSR_ETHMAC_BASE
+	/* Resolve the TFTP server while the other media are tried */
+	for (i = 1; i < count; i++)
+		if (media[i]->boot == boot_medium_net)
+			netboot_prepare();
 #endif
+
+	for (i = 0; i < count; i++) {
+		boot_time_phase(media[i]->name);
+		if (media[i]->boot() == 0)
+			return;
+	}
+	printf("No boot medium found\n");
+	boot_time_report();
+}
@@ -1,16 +1,76 @@
 #ifndef __BOOT_H
 #define __BOOT_H
 
+#include <generated/csr.h>
+#include <generated/mem.h>
+#include <generated/soc.h>
+
 void set_local_ip(const char * ip_address);
 void set_remote_ip(const char * ip_address);
 void set_mac_addr(const char * mac_address);
 
 void __attribute__((noreturn)) boot(unsigned long r1, unsigned long r2, unsigned long r3, unsigned long addr);
 int serialboot(void);
+void serial_load(void);
+int serial_dump(const char *addr, unsigned long length);
+/* UDP stack started with the BIOS addresses, once, for the network commands */
+void netboot_start(void);
+unsigned int netboot_remote_ip(void);
+void netboot_prepare(void);
 void netboot(int nb_params, char **params);
+void netload(int nb_params, char **params);
+void netflash(int nb_params, char **params);
 void flashboot(void);
 void romboot(void);
 void sdcardboot(void);
 void sataboot(void);
+void ramdiskboot(unsigned long address, unsigned long size);
+
+int file_fetch(const char *name, char *buf, unsigned int size);
+
+void boot_sequence(void);
+const char *boot_order_get(void);
+void boot_order_list(void);
+int boot_order_set(const char *order);
+
+#if defined(FATFS_WRITE) && (defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE) || \
+	defined(CSR_SATA_SECTOR2MEM_BASE))
+int fatfs_log_start(const char *filename, void *buffer, unsigned int size);
+void fatfs_log_flush(void);
+void fatfs_log_stop(void);
+#else
+static inline int fatfs_log_start(const char *filename, void *buffer, unsigned int size) { return 0; }
+static inline void fatfs_log_flush(void) {}
+static inline void fatfs_log_stop(void) {}
+#endif
+
+/* Warm reboots: ctrl scratch value requesting one, boot record region */
+#if defined(WARM_BOOT) && defined(MAIN_RAM_BASE) && defined(CSR_CTRL_SCRATCH_ADDR) && \
+	defined(CONFIG_CPU_RESET_ADDR)
+#define WARMBOOT
+#define WARMBOOT_MAGIC 0x5741524d
+#ifndef WARMBOOT_SIZE
+#define WARMBOOT_SIZE 0x1000
+#endif
+#ifndef WARMBOOT_ADDR
+#define WARMBOOT_ADDR (MAIN_RAM_BASE + MAIN_RAM_SIZE - WARMBOOT_SIZE)
+#endif
+int warmboot_detect(void);
+void warmboot_resume(void);
+void warmboot_image(unsigned long addr, unsigned long length);
+void __attribute__((noreturn)) warmboot_reboot(void);
+#else
+static inline int warmboot_detect(void) { return 0; }
+static inline void warmboot_resume(void) {}
+static inline void warmboot_image(unsigned long addr, unsigned long length) {}
+#endif
+
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+void boot_time_phase(const char *name);
+void boot_time_report(void);
+#else
+static inline void boot_time_phase(const char *name) {}
+static inline void boot_time_report(void) {}
+#endif
 
 #endif /* __BOOT_H */
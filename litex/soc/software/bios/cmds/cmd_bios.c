@@ -2,12 +2,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <system.h>
 
 #include <libbase/crc.h>
+#include <libbase/isr.h>
+#include <libbase/logbuf.h>
+#include <libbase/perf.h>
 
 #include <generated/csr.h>
 
+#include "../boot.h"
 #include "../command.h"
 #include "../helpers.h"
 #include "../sim_debug.h"
@@ -86,6 +91,129 @@ static void uptime_handler(int nb_params, char **params)
 define_command(uptime, uptime_handler, "Uptime of the system since power-up", SYSTEM_CMDS);
 #endif
 
+/**
+ * Command "boottime"
+ *
+ * Duration of the BIOS initialization and boot phases
+ *
+ */
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+static void boottime_handler(int nb_params, char **params)
+{
+	boot_time_report();
+}
+
+define_command(boottime, boottime_handler, "Duration of the BIOS boot phases", SYSTEM_CMDS);
+#endif
+
+/**
+ * Command "perf"
+ *
+ * Run a command and print the cycles, instructions and CPU events it took
+ *
+ */
+static void perf_handler(int nb_params, char **params)
+{
+	struct perf_sample start, end;
+
+	if (nb_params < 1) {
+		printf("perf <command> [params...]");
+		return;
+	}
+
+	perf_init();
+	perf_read(&start);
+	if (!command_dispatcher(params[0], nb_params - 1, params + 1)) {
+		printf("Command not found");
+		return;
+	}
+	perf_read(&end);
+	printf("\n");
+	perf_print(&start, &end);
+}
+
+define_command(perf, perf_handler, "Performance counters of a command", SYSTEM_CMDS);
+
+/**
+ * Command "irq_stats"
+ *
+ * Interrupt lines with an attached handler and their counts
+ *
+ */
+#ifdef CONFIG_CPU_HAS_INTERRUPT
+define_command(irq_stats, irq_stats_print, "Interrupt counts per line", SYSTEM_CMDS);
+#endif
+
+/**
+ * Command "fatfs_log"
+ *
+ * Append the console output to a file
+ *
+ */
+#if defined(FATFS_WRITE) && (defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE) || \
+	defined(CSR_SATA_SECTOR2MEM_BASE))
+static void fatfs_log_handler(int nb_params, char **params)
+{
+	char *c;
+	unsigned long addr;
+	unsigned long size;
+
+	if (nb_params < 1) {
+		printf("fatfs_log <file> [address size] | flush | stop");
+		return;
+	}
+	if (!strcmp(params[0], "flush")) {
+		fatfs_log_flush();
+		return;
+	}
+	if (!strcmp(params[0], "stop")) {
+		fatfs_log_stop();
+		return;
+	}
+	addr = 0;
+	size = 0;
+	if (nb_params > 2) {
+		addr = strtoul(params[1], &c, 0);
+		if (*c != 0) {
+			printf("Incorrect address");
+			return;
+		}
+		size = strtoul(params[2], &c, 0);
+		if (*c != 0) {
+			printf("Incorrect size");
+			return;
+		}
+	}
+	if (fatfs_log_start(params[0], (void *) addr, size))
+		printf("Logging to %s", params[0]);
+}
+
+define_command(fatfs_log, fatfs_log_handler, "Append the console output to a file", SYSTEM_CMDS);
+#endif
+
+/**
+ * Command "dmesg"
+ *
+ * Print the console log again
+ *
+ */
+#ifdef LOG_BUFFER
+static void dmesg_handler(int nb_params, char **params)
+{
+	if (nb_params > 0) {
+		if (strcmp(params[0], "clear")) {
+			printf("dmesg [clear]");
+			return;
+		}
+		logbuf_clear();
+		return;
+	}
+	logbuf_dump();
+}
+
+define_command(dmesg, dmesg_handler, "Print the console log", SYSTEM_CMDS);
+#endif
+
 /**
  * Command "crc"
  *
@@ -120,6 +248,97 @@ static void crc_handler(int nb_params, char **params)
 
 define_command(crc, crc_handler, "Compute CRC32 of a part of the address space", SYSTEM_CMDS);
 
+/**
+ * Command "script"
+ *
+ * Run a script of commands back-to-back with machine-readable status
+ * lines, received from the UART in one burst, read from a file (TFTP,
+ * FatFs) or already in memory.
+ *
+ */
+#ifndef BIOS_SCRIPT_SIZE
+#define BIOS_SCRIPT_SIZE 2048
+#endif
+
+static char script_buffer[BIOS_SCRIPT_SIZE];
+static int script_running;
+
+/* Receives until a line "end" or Ctrl-D */
+static int script_receive(char *buf, unsigned int size)
+{
+	unsigned int length, line;
+	char c;
+
+	printf("Send the script, ended by a line \"end\" (or Ctrl-D)...\n");
+	length = 0;
+	line   = 0;
+	for (;;) {
+		c = getchar();
+		if (c == 0x04)
+			return length;
+		if (c == 0x03) {
+			printf("Aborted");
+			return -1;
+		}
+		if (length >= size) {
+			printf("Script too large (max %u bytes)", size);
+			return -1;
+		}
+		buf[length++] = c;
+		if (c != '\n')
+			continue;
+		if (!strncmp(&buf[line], "end\n", length - line) || !strncmp(&buf[line], "end\r\n", length - line))
+			return line;
+		line = length;
+	}
+}
+
+static void script_handler(int nb_params, char **params)
+{
+	char *c;
+	const char *script;
+	unsigned long length;
+	int size;
+
+	if (nb_params < 1) {
+		printf("script uart | <file> | <addr> <length>\n");
+		printf("file: tftp:<name>, sd:<name>, sata:<name>, ram:<name>");
+		return;
+	}
+	if (script_running) {
+		printf("Nested script");
+		return;
+	}
+
+	if (nb_params > 1) {
+		script = (const char *)strtoul(params[0], &c, 0);
+		if (*c != 0) {
+			printf("Incorrect address");
+			return;
+		}
+		length = strtoul(params[1], &c, 0);
+		if (*c != 0) {
+			printf("Incorrect length");
+			return;
+		}
+	} else {
+		if (!strcmp(params[0], "uart"))
+			size = script_receive(script_buffer, sizeof(script_buffer));
+		else
+			size = file_fetch(params[0], script_buffer, sizeof(script_buffer));
+		if (size < 0)
+			return;
+		script = script_buffer;
+		length = size;
+	}
+
+	script_running = 1;
+	run_script(script, length);
+	script_running = 0;
+}
+
+define_command(script, script_handler, "Run a script of commands", SYSTEM_CMDS);
+
 /**
  * Command "flush_cpu_dcache"
  *
@@ -211,3 +430,40 @@ static void cmd_sim_mark_handler(int nb_params, char **params)
 }
 define_command(mark, cmd_sim_mark_handler, "Set a debug simulation marker", SYSTEM_CMDS);
 #endif
+
+/**
+ * Command "sim_load"
+ *
+ * Load a host file into simulated memory
+ *
+ */
+#ifdef CSR_SIM_LOAD_BASE
+static void cmd_sim_load_handler(int nb_params, char **params)
+{
+  char *c;
+  unsigned long index;
+  unsigned long addr;
+  long len;
+
+  if (nb_params < 2) {
+    printf("sim_load <index> <address>");
+    return;
+  }
+  index = strtoul(params[0], &c, 0);
+  if (*c != 0) {
+    printf("Incorrect index");
+    return;
+  }
+  addr = strtoul(params[1], &c, 0);
+  if (*c != 0) {
+    printf("Incorrect address");
+    return;
+  }
+  len = sim_load(index, addr);
+  if (len < 0)
+    printf("Load failed");
+  else
+    printf("Loaded %ld bytes at 0x%08lx", len, addr);
+}
+define_command(sim_load, cmd_sim_load_handler, "Load a host file into simulated memory", SYSTEM_CMDS);
+#endif
@@ -2,8 +2,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <generated/csr.h>
+#include <generated/mem.h>
 
 #include "../command.h"
 #include "../helpers.h"
@@ -64,16 +66,20 @@ define_command(boot, boot_handler, "Boot from Memory",  BOOT_CMDS);
 /**
  * Command "reboot"
  *
- * Reboot the system
+ * Reboot the system (warm: CPU only, SDRAM and loaded images kept)
  *
  */
 #ifdef CSR_CTRL_RESET_ADDR
 static void reboot_handler(int nb_params, char **params)
 {
+#ifdef WARMBOOT
+	if (nb_params > 0 && !strcmp(params[0], "warm"))
+		warmboot_reboot();
+#endif
 	ctrl_reset_write(1);
 }
 
-define_command(reboot, reboot_handler, "Reboot",  BOOT_CMDS);
+define_command(reboot, reboot_handler, "Reboot [warm]",  BOOT_CMDS);
 #endif
 
 /**
@@ -116,6 +122,26 @@ define_command(serialboot, serialboot, "Boot from Serial (SFL)", BOOT_CMDS);
 define_command(netboot, netboot, "Boot via Ethernet (TFTP)", BOOT_CMDS);
 #endif
 
+/**
+ * Command "netload"
+ *
+ * Load software to main RAM from litex_netload
+ *
+ */
+#if defined(CSR_ETHMAC_BASE) && defined(MAIN_RAM_BASE)
+define_command(netload, netload, "Load to RAM via Ethernet (litex_netload)", BOOT_CMDS);
+#endif
+
+/**
+ * Command "netflash"
+ *
+ * Write a file from TFTP server to SPI flash
+ *
+ */
+#if defined(CSR_ETHMAC_BASE) && defined(MAIN_RAM_BASE) && defined(CSR_SPIFLASH_CORE_MASTER_CS_ADDR)
+define_command(netflash, netflash, "Write to Flash via Ethernet (TFTP)", BOOT_CMDS);
+#endif
+
 /**
  * Command "spisdcardboot"
  *
@@ -136,3 +162,72 @@ define_command(sdcardboot, sdcardboot, "Boot from SDCard", BOOT_CMDS);
 define_command(sataboot, sataboot, "Boot from SATA", BOOT_CMDS);
 #endif
 
+/**
+ * Command "ramdiskboot"
+ *
+ * Boot software from a FAT image in RAM
+ *
+ */
+#if defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE) || defined(CSR_SATA_SECTOR2MEM_BASE)
+static void ramdiskboot_handler(int nb_params, char **params)
+{
+	char *c;
+	unsigned long addr;
+	unsigned long size;
+
+	if (nb_params < 2) {
+		printf("ramdiskboot <address> <size>");
+		return;
+	}
+	addr = strtoul(params[0], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect address");
+		return;
+	}
+	size = strtoul(params[1], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect size");
+		return;
+	}
+	ramdiskboot(addr, size);
+}
+
+define_command(ramdiskboot, ramdiskboot_handler, "Boot from a FAT image in RAM", BOOT_CMDS);
+#endif
+
+/**
+ * Command "boot_order"
+ *
+ * Show or save the order of the boot media
+ *
+ */
+static void boot_order_handler(int nb_params, char **params)
+{
+	char order[64];
+	int i;
+
+	if (nb_params < 1) {
+		printf("Boot order: %s\n", boot_order_get());
+		printf("Boot media: ");
+		boot_order_list();
+		printf("\nboot_order <medium> [medium...] | default");
+		return;
+	}
+	if (!strcmp(params[0], "default")) {
+		boot_order_set(NULL);
+		return;
+	}
+	order[0] = '\0';
+	for (i = 0; i < nb_params; i++) {
+		if (strlen(order) + strlen(params[i]) + 2 > sizeof(order)) {
+			printf("Boot order too long");
+			return;
+		}
+		if (i)
+			strcat(order, ",");
+		strcat(order, params[i]);
+	}
+	if (boot_order_set(order) == 0)
+		printf("Boot order: %s", boot_order_get());
+}
+define_command(boot_order, boot_order_handler, "Show or save the boot order", BOOT_CMDS);
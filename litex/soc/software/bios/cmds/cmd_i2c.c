@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
 #include <generated/csr.h>
@@ -121,6 +122,44 @@ define_command(i2c_read, i2c_read_handler, "Read over I2C", I2C_CMDS);
 #endif
 
 
+/**
+ * Command "i2c_freq"
+ *
+ * Show or set the I2C bus frequency (100k/400k/1M modes or any value in Hz).
+ *
+ */
+#ifdef CSR_I2C_BASE
+static void i2c_freq_handler(int nb_params, char **params)
+{
+	char *c;
+	unsigned int freq_hz;
+
+	if (nb_params < 1) {
+		printf("I2C frequency: %u Hz\n", i2c_get_freq());
+		printf("i2c_freq <100k|400k|1m|freq_hz>");
+		return;
+	}
+
+	if (!strcmp(params[0], "100k"))
+		freq_hz = I2C_FREQ_STANDARD;
+	else if (!strcmp(params[0], "400k"))
+		freq_hz = I2C_FREQ_FAST;
+	else if (!strcmp(params[0], "1m"))
+		freq_hz = I2C_FREQ_FAST_PLUS;
+	else {
+		freq_hz = strtoul(params[0], &c, 0);
+		if (*c != 0 || freq_hz == 0) {
+			printf("Incorrect frequency");
+			return;
+		}
+	}
+
+	i2c_set_freq(freq_hz);
+	printf("I2C frequency: %u Hz", i2c_get_freq());
+}
+define_command(i2c_freq, i2c_freq_handler, "Show or set I2C frequency", I2C_CMDS);
+#endif
+
 /**
  * Command "i2c_scan"
  *
@@ -87,6 +87,89 @@ static void sdram_bist_handler(int nb_params, char **params)
 define_command(sdram_bist, sdram_bist_handler, "Run SDRAM Build-In Self-Test", LITEDRAM_CMDS);
 #endif
 
+/**
+ * Command "sdram_bist_char"
+ *
+ * Characterize SDRAM throughput/latency with the BIST
+ *
+ */
+#if defined(CSR_SDRAM_GENERATOR_BASE) && defined(CSR_SDRAM_CHECKER_BASE)
+static void sdram_bist_char_handler(int nb_params, char **params)
+{
+	if (nb_params > 0 && strcmp(params[0], "hist") != 0) {
+		printf("sdram_bist_char [hist]");
+		return;
+	}
+	sdram_bist_char(nb_params > 0);
+}
+define_command(sdram_bist_char, sdram_bist_char_handler, "Characterize SDRAM with the BIST", LITEDRAM_CMDS);
+#endif
+
+/**
+ * Command "sdram_bist_pattern"
+ *
+ * Run SDRAM BIST with an address pattern over a range
+ *
+ */
+#if defined(CSR_SDRAM_GENERATOR_BASE) && defined(CSR_SDRAM_CHECKER_BASE)
+static void sdram_bist_pattern_handler(int nb_params, char **params)
+{
+	static const char *patterns[] = {"seq", "lfsr", "rowhit", "rowmiss"};
+	char *c;
+	int pattern;
+	unsigned int base;
+	unsigned int size;
+	unsigned int burst_length;
+
+	if (nb_params < 3) {
+		printf("sdram_bist_pattern <seq|lfsr|rowhit|rowmiss> <base> <size> [burst_length]");
+		return;
+	}
+	for (pattern = 0; pattern < 4; pattern++)
+		if (!strcmp(params[0], patterns[pattern]))
+			break;
+	if (pattern == 4) {
+		printf("Incorrect pattern");
+		return;
+	}
+	base = strtoul(params[1], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect base");
+		return;
+	}
+	size = strtoul(params[2], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect size");
+		return;
+	}
+	burst_length = 1;
+	if (nb_params > 3) {
+		burst_length = strtoul(params[3], &c, 0);
+		if (*c != 0 || burst_length == 0) {
+			printf("Incorrect burst_length");
+			return;
+		}
+	}
+	sdram_bist_pattern(pattern, base, size, burst_length);
+}
+define_command(sdram_bist_pattern, sdram_bist_pattern_handler, "Run SDRAM BIST with an address pattern", LITEDRAM_CMDS);
+#endif
+
+/**
+ * Command "sdram_tune"
+ *
+ * Find the fastest stable runtime settings of the SDRAM
+ *
+ */
+#if defined(CSR_SDRAM_GENERATOR_BASE) && defined(CSR_SDRAM_CHECKER_BASE) && \
+	(defined(CSR_DDRPHY_RDPHASE_ADDR) || defined(CSR_DDRPHY_WRPHASE_ADDR))
+static void sdram_tune_handler(int nb_params, char **params)
+{
+	sdram_tune();
+}
+define_command(sdram_tune, sdram_tune_handler, "Find fastest stable SDRAM settings (BIST)", LITEDRAM_CMDS);
+#endif
+
 #ifdef CSR_DDRPHY_RDPHASE_ADDR
 /**
  * Command "sdram_force_rdphase"
@@ -410,6 +493,49 @@ static void sdram_spd_handler(int nb_params, char **params)
 define_command(sdram_spd, sdram_spd_handler, "Read SDRAM SPD EEPROM", LITEDRAM_CMDS);
 #endif
 
+/**
+ * Command "sdram_spd_timings"
+ *
+ * Program the tightest timings supported by the module, read from its SPD EEPROM.
+ *
+ */
+#if defined(CSR_SDRAM_BASE) && defined(CSR_I2C_BASE)
+static void sdram_spd_timings_handler(int nb_params, char **params)
+{
+	char *c;
+	unsigned char spdaddr;
+
+	spdaddr = 0;
+	if (nb_params > 0) {
+		spdaddr = strtoul(params[0], &c, 0);
+		if (*c != 0 || spdaddr > 0b111) {
+			printf("Incorrect address");
+			return;
+		}
+	}
+	sdram_spd_timings(spdaddr);
+}
+define_command(sdram_spd_timings, sdram_spd_timings_handler, "Apply SDRAM timings from SPD (BIST)", LITEDRAM_CMDS);
+#endif
+
+/**
+ * Command "sdram_eye"
+ *
+ * Show the eye map recorded by the last calibration
+ *
+ */
+#if defined(CSR_SDRAM_BASE) && defined(CSR_DDRPHY_BASE) && defined(SDRAM_EYE_MAP)
+static void sdram_eye_handler(int nb_params, char **params)
+{
+	if (nb_params > 0 && strcmp(params[0], "csv") != 0) {
+		printf("sdram_eye [csv]");
+		return;
+	}
+	sdram_eye_map(nb_params > 0);
+}
+define_command(sdram_eye, sdram_eye_handler, "Show SDRAM calibration eye map", LITEDRAM_CMDS);
+#endif
+
 #ifdef SDRAM_DEBUG
 define_command(sdram_debug, sdram_debug, "Run SDRAM debug tests", LITEDRAM_CMDS);
 #endif
@@ -7,6 +7,10 @@
 #include <generated/soc.h>
 
 #include <libliteeth/mdio.h>
+#ifdef CSR_ETHMAC_BASE
+#include <libliteeth/udp.h>
+#include <libliteeth/netperf.h>
+#endif
 
 #include "../command.h"
 #include "../helpers.h"
@@ -107,7 +111,7 @@ static void mdio_dump_handler(int nb_params, char **params)
 	char *c;
 	unsigned int phyadr;
 	unsigned int count;
-	unsigned int val;
+	unsigned short vals[32];
 	int i;
 
 	if (nb_params < 2) {
@@ -127,11 +131,13 @@ static void mdio_dump_handler(int nb_params, char **params)
 		return;
 	}
 
+	if (count > 32)
+		count = 32;
+
 	printf("MDIO dump @0x%x:\n", phyadr);
-	for (i = 0; i < count; i++) {
-		val = mdio_read(phyadr, i);
-		printf("0x%02x 0x%04x\n", i, val);
-	}
+	mdio_read_regs(phyadr, 0, vals, count);
+	for (i = 0; i < count; i++)
+		printf("0x%02x 0x%04x\n", i, vals[i]);
 }
 
 define_command(mdio_dump, mdio_dump_handler, "Dump MDIO registers", LITEETH_CMDS);
@@ -193,3 +199,146 @@ static void eth_mac_addr_handler(int nb_params, char **params)
 }
 define_command(eth_mac_addr, eth_mac_addr_handler, "Set the mac address", LITEETH_CMDS);
 #endif
+
+#ifdef CSR_ETHMAC_BASE
+static int parse_ip4(const char *s, unsigned int *ip)
+{
+	unsigned long v;
+	char *c;
+	int i;
+
+	*ip = 0;
+	for (i = 0; i < 4; i++) {
+		v = strtoul(s, &c, 10);
+		if ((c == s) || (v > 255) || (*c != ((i < 3) ? '.' : 0)))
+			return -1;
+		*ip = (*ip << 8) | v;
+		s = c + 1;
+	}
+	return 0;
+}
+
+/* Optional parameters: the remote IP, then numbers */
+static int netperf_params(int nb_params, char **params, unsigned int *ip,
+	unsigned int *values, const char **names, int nvalues)
+{
+	char *c;
+	int i;
+
+	if (ip) {
+		*ip = netboot_remote_ip();
+		if (nb_params > 0) {
+			if (parse_ip4(params[0], ip) < 0) {
+				printf("Incorrect ip");
+				return -1;
+			}
+			params++;
+			nb_params--;
+		}
+	}
+	for (i = 0; (i < nvalues) && (i < nb_params); i++) {
+		values[i] = strtoul(params[i], &c, 0);
+		if (*c != 0) {
+			printf("Incorrect %s", names[i]);
+			return -1;
+		}
+	}
+	netboot_start();
+	return 0;
+}
+
+static void netperf_print_ip(const char *what, unsigned int ip)
+{
+	printf("%s %d.%d.%d.%d:%d...\n", what,
+		ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff, NETPERF_PORT);
+}
+
+/**
+ * Command "eth_perf_tx"
+ *
+ * UDP throughput test source
+ *
+ */
+static void eth_perf_tx_handler(int nb_params, char **params)
+{
+	static const char *names[] = { "seconds", "size", "rate" };
+	unsigned int values[] = { 10, UDP_PAYLOAD_MAX, 0 };
+	struct netperf_stats s;
+	unsigned int ip;
+
+	if (netperf_params(nb_params, params, &ip, values, names, 3) < 0)
+		return;
+	netperf_print_ip("Sending to", ip);
+	if (netperf_send(ip, NETPERF_PORT, values[1], values[0]*1000, values[2], &s) < 0) {
+		printf("Remote unreachable\n");
+		return;
+	}
+	netperf_print(&s);
+}
+define_command(eth_perf_tx, eth_perf_tx_handler, "Send UDP test traffic (litex_netperf)", LITEETH_CMDS);
+
+/**
+ * Command "eth_perf_rx"
+ *
+ * UDP throughput test sink
+ *
+ */
+static void eth_perf_rx_handler(int nb_params, char **params)
+{
+	static const char *names[] = { "seconds" };
+	unsigned int values[] = { 30 };
+	struct netperf_stats s;
+
+	if (netperf_params(nb_params, params, NULL, values, names, 1) < 0)
+		return;
+	printf("Receiving on port %d...\n", NETPERF_PORT);
+	if (netperf_receive(NETPERF_PORT, values[0]*1000, &s) < 0) {
+		printf("No traffic received\n");
+		return;
+	}
+	netperf_print(&s);
+}
+define_command(eth_perf_rx, eth_perf_rx_handler, "Receive UDP test traffic (litex_netperf)", LITEETH_CMDS);
+
+/**
+ * Command "eth_echo"
+ *
+ * UDP echo responder
+ *
+ */
+static void eth_echo_handler(int nb_params, char **params)
+{
+	static const char *names[] = { "seconds" };
+	unsigned int values[] = { 60 };
+
+	if (netperf_params(nb_params, params, NULL, values, names, 1) < 0)
+		return;
+	printf("Echoing on port %d...\n", NETPERF_PORT);
+	printf("%d requests answered\n", netperf_echo(NETPERF_PORT, values[0]*1000));
+}
+define_command(eth_echo, eth_echo_handler, "Answer UDP echo requests (litex_netperf)", LITEETH_CMDS);
+
+/**
+ * Command "eth_ping"
+ *
+ * UDP round trip time test
+ *
+ */
+static void eth_ping_handler(int nb_params, char **params)
+{
+	static const char *names[] = { "count", "size" };
+	unsigned int values[] = { 10, 64 };
+	struct netperf_stats s;
+	unsigned int ip;
+
+	if (netperf_params(nb_params, params, &ip, values, names, 2) < 0)
+		return;
+	netperf_print_ip("Pinging", ip);
+	if (netperf_ping(ip, NETPERF_PORT, values[0], values[1], &s) == 0) {
+		printf("No reply, %u lost\n", s.lost);
+		return;
+	}
+	netperf_print(&s);
+}
+define_command(eth_ping, eth_ping_handler, "Measure UDP round trip times (litex_netperf)", LITEETH_CMDS);
+#endif
@@ -2,8 +2,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <generated/csr.h>
+#include <generated/mem.h>
 
 #include <liblitesata/sata.h>
 
@@ -100,3 +102,50 @@ static void sata_write_handler(int nb_params, char **params)
 
 define_command(sata_write, sata_write_handler, "Write SATA sector", LITESATA_CMDS);
 #endif
+
+/**
+ * Command "sata_bench"
+ *
+ * Measure SATA throughput
+ *
+ */
+#if defined(CSR_SATA_SECTOR2MEM_BASE) && defined(CSR_TIMER0_BASE) && defined(MAIN_RAM_BASE)
+static void sata_bench_handler(int nb_params, char **params)
+{
+	unsigned int sector;
+	unsigned int count;
+	storage_xfer write;
+	char *c;
+
+	if (nb_params < 2) {
+		printf("sata_bench <sector> <count> [write]");
+		return;
+	}
+
+	sector = strtoul(params[0], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect sector number");
+		return;
+	}
+
+	count = strtoul(params[1], &c, 0);
+	if ((*c != 0) || (count == 0)) {
+		printf("Incorrect count");
+		return;
+	}
+
+	write = NULL;
+	if ((nb_params > 2) && !strcmp(params[2], "write")) {
+#ifdef CSR_SATA_MEM2SECTOR_BASE
+		write = sata_write;
+#else
+		printf("No SATA write support");
+		return;
+#endif
+	}
+
+	storage_bench(sata_read, write, sector, count);
+}
+
+define_command(sata_bench, sata_bench_handler, "Measure SATA throughput", LITESATA_CMDS);
+#endif
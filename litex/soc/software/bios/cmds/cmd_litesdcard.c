@@ -2,8 +2,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <generated/csr.h>
+#include <generated/mem.h>
 
 #include <liblitesdcard/sdcard.h>
 
@@ -144,3 +146,50 @@ static void sdcard_write_handler(int nb_params, char **params)
 
 define_command(sdcard_write, sdcard_write_handler, "Write SDCard block", LITESDCARD_CMDS);
 #endif
+
+/**
+ * Command "sdcard_bench"
+ *
+ * Measure SDCard throughput
+ *
+ */
+#if defined(CSR_SDBLOCK2MEM_BASE) && defined(CSR_TIMER0_BASE) && defined(MAIN_RAM_BASE)
+static void sdcard_bench_handler(int nb_params, char **params)
+{
+	unsigned int block;
+	unsigned int count;
+	storage_xfer write;
+	char *c;
+
+	if (nb_params < 2) {
+		printf("sdcard_bench <block> <count> [write]");
+		return;
+	}
+
+	block = strtoul(params[0], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect block number");
+		return;
+	}
+
+	count = strtoul(params[1], &c, 0);
+	if ((*c != 0) || (count == 0)) {
+		printf("Incorrect count");
+		return;
+	}
+
+	write = NULL;
+	if ((nb_params > 2) && !strcmp(params[2], "write")) {
+#ifdef CSR_SDMEM2BLOCK_BASE
+		write = sdcard_write;
+#else
+		printf("No SDCard write support");
+		return;
+#endif
+	}
+
+	storage_bench(sdcard_read, write, block, count);
+}
+
+define_command(sdcard_bench, sdcard_bench_handler, "Measure SDCard throughput", LITESDCARD_CMDS);
+#endif
@@ -2,11 +2,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <libbase/memtest.h>
+#include <libbase/timing.h>
 
 #include <generated/csr.h>
 #include <generated/mem.h>
 
+#include <liblitedram/bist.h>
+
+#include "../boot.h"
 #include "../command.h"
 #include "../helpers.h"
 
@@ -60,32 +65,74 @@ static void mem_read_handler(int nb_params, char **params)
 
 define_command(mem_read, mem_read_handler, "Read address space", MEM_CMDS);
 
+/*-----------------------------------------------------------------------*/
+/* Access widths                                                         */
+/*-----------------------------------------------------------------------*/
+
+/* Bytes moved per block in "line" mode, match the data cache line */
+#ifndef MEM_CMD_LINE_SIZE
+#define MEM_CMD_LINE_SIZE 32
+#endif
+
+#define MEM_LINE_WORDS (MEM_CMD_LINE_SIZE/sizeof(unsigned long))
+
+static int mem_parse_width(const char *s, unsigned int *width)
+{
+	char *c;
+
+	if (!strcmp(s, "line")) {
+		*width = MEM_CMD_LINE_SIZE;
+		return 1;
+	}
+	*width = strtoul(s, &c, 0);
+	if ((*c != 0) || ((*width != 1) && (*width != 2) && (*width != 4) && (*width != 8))) {
+		printf("Incorrect width (1, 2, 4, 8 or line)");
+		return 0;
+	}
+	return 1;
+}
+
+static void mem_print_speed(const char *name, uint64_t bytes, uint64_t cycles)
+{
+	unsigned long speed;
+
+	if (cycles == 0)
+		cycles = 1;
+	speed = bytes*CONFIG_CLOCK_FREQUENCY/cycles;
+	printf("%s %lu bytes in %lu us: %lu.%02lu MB/s", name, (unsigned long)bytes,
+		(unsigned long)(timing_cycles_to_ns(cycles)/1000),
+		speed/1000000, (speed % 1000000)/10000);
+}
+
 /**
  * Command "mem_write"
  *
- * Memory write
+ * Memory write, with a given access width and stride
  *
  */
 static void mem_write_handler(int nb_params, char **params)
 {
 	char *c;
-	unsigned int *addr;
-	unsigned int value;
+	uintptr_t addr;
+	unsigned long long value;
 	unsigned int count;
-	unsigned int i;
+	unsigned int width;
+	unsigned long stride;
+	unsigned int i, j;
+	uint64_t start;
 
 	if (nb_params < 2) {
-		printf("mem_write <address> <value> [count]");
+		printf("mem_write <address> <value> [count] [width] [stride]");
 		return;
 	}
 
-	addr = (unsigned int *)strtoul(params[0], &c, 0);
+	addr = strtoul(params[0], &c, 0);
 	if (*c != 0) {
 		printf("Incorrect address");
 		return;
 	}
 
-	value = strtoul(params[1], &c, 0);
+	value = strtoull(params[1], &c, 0);
 	if(*c != 0) {
 		printf("Incorrect value");
 		return;
@@ -101,38 +148,122 @@ static void mem_write_handler(int nb_params, char **params)
 		}
 	}
 
-	for (i = 0; i < count; i++)
-		*addr++ = value;
+	width = sizeof(unsigned int);
+	if ((nb_params > 3) && !mem_parse_width(params[3], &width))
+		return;
+
+	stride = width;
+	if (nb_params > 4) {
+		stride = strtoul(params[4], &c, 0);
+		if (*c != 0) {
+			printf("Incorrect stride");
+			return;
+		}
+	}
+
+	start = timing_cycles();
+	for (i = 0; i < count; i++, addr += stride) {
+		switch (width) {
+		case 1:
+			*(volatile uint8_t *)addr = value;
+			break;
+		case 2:
+			*(volatile uint16_t *)addr = value;
+			break;
+		case 4:
+			*(volatile uint32_t *)addr = value;
+			break;
+		case 8:
+			*(volatile uint64_t *)addr = value;
+			break;
+		default:
+			/* Whole line of words, the value being repeated in each */
+			for (j = 0; j < MEM_LINE_WORDS; j++)
+				((volatile unsigned long *)addr)[j] = value;
+			break;
+		}
+	}
+	if (count > 1)
+		mem_print_speed("Wrote", (uint64_t)count*width, timing_cycles() - start);
 }
 
 define_command(mem_write, mem_write_handler, "Write address space", MEM_CMDS);
 
+/**
+ * Command "mem_dump"
+ *
+ * Binary memory read to the Host (litex_memxfer), in CRC-checked SFL frames
+ *
+ */
+#ifdef CSR_UART_BASE
+static void mem_dump_handler(int nb_params, char **params)
+{
+	char *c;
+	const char *addr;
+	unsigned long length;
+
+	if (nb_params < 2) {
+		printf("mem_dump <address> <length>");
+		return;
+	}
+	addr = (const char *)strtoul(params[0], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect address");
+		return;
+	}
+	length = strtoul(params[1], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect length");
+		return;
+	}
+
+	if (!serial_dump(addr, length))
+		printf("Dump failed");
+}
+
+define_command(mem_dump, mem_dump_handler, "Binary read of address space to the Host", MEM_CMDS);
+#endif
+
+/**
+ * Command "mem_load"
+ *
+ * Binary memory write from the Host (litex_memxfer), in CRC-checked SFL frames
+ *
+ */
+#ifdef CSR_UART_BASE
+define_command(mem_load, serial_load, "Binary write of address space from the Host", MEM_CMDS);
+#endif
+
 /**
  * Command "mem_copy"
  *
- * Memory copy
+ * Memory copy, optionally with a given access width
  *
  */
 static void mem_copy_handler(int nb_params, char **params)
 {
 	char *c;
-	unsigned int *dstaddr;
-	unsigned int *srcaddr;
+	uintptr_t dstaddr;
+	uintptr_t srcaddr;
 	unsigned int count;
-	unsigned int i;
+	unsigned int width;
+	unsigned long length;
+	unsigned long line[MEM_LINE_WORDS];
+	unsigned long i, j;
+	uint64_t start;
 
 	if (nb_params < 2) {
-		printf("mem_copy <dst> <src> [count]");
+		printf("mem_copy <dst> <src> [count] [width]");
 		return;
 	}
 
-	dstaddr = (unsigned int *)strtoul(params[0], &c, 0);
+	dstaddr = strtoul(params[0], &c, 0);
 	if (*c != 0) {
 		printf("Incorrect destination address");
 		return;
 	}
 
-	srcaddr = (unsigned int *)strtoul(params[1], &c, 0);
+	srcaddr = strtoul(params[1], &c, 0);
 	if (*c != 0) {
 		printf("Incorrect source address");
 		return;
@@ -148,8 +279,43 @@ static void mem_copy_handler(int nb_params, char **params)
 		}
 	}
 
-	for (i = 0; i < count; i++)
-		*dstaddr++ = *srcaddr++;
+	width = sizeof(unsigned int);
+	if ((nb_params > 3) && !mem_parse_width(params[3], &width))
+		return;
+	length = (unsigned long)count*width;
+
+	start = timing_cycles();
+	if (nb_params <= 3) {
+		/* No width forced: fastest copy, overlapping allowed */
+		memmove((void *)dstaddr, (const void *)srcaddr, length);
+	} else {
+		/* Forced width, forward copy (registers, narrow memories) */
+		for (i = 0; i < length; i += width) {
+			switch (width) {
+			case 1:
+				*(volatile uint8_t *)(dstaddr + i) = *(volatile uint8_t *)(srcaddr + i);
+				break;
+			case 2:
+				*(volatile uint16_t *)(dstaddr + i) = *(volatile uint16_t *)(srcaddr + i);
+				break;
+			case 4:
+				*(volatile uint32_t *)(dstaddr + i) = *(volatile uint32_t *)(srcaddr + i);
+				break;
+			case 8:
+				*(volatile uint64_t *)(dstaddr + i) = *(volatile uint64_t *)(srcaddr + i);
+				break;
+			default:
+				/* Read the whole source line before writing the destination one */
+				for (j = 0; j < MEM_LINE_WORDS; j++)
+					line[j] = ((volatile unsigned long *)(srcaddr + i))[j];
+				for (j = 0; j < MEM_LINE_WORDS; j++)
+					((volatile unsigned long *)(dstaddr + i))[j] = line[j];
+				break;
+			}
+		}
+	}
+	if (count > 1)
+		mem_print_speed("Copied", length, timing_cycles() - start);
 }
 
 define_command(mem_copy, mem_copy_handler, "Copy address space", MEM_CMDS);
@@ -190,6 +356,131 @@ static void mem_test_handler(int nb_params, char **params)
 }
 define_command(mem_test, mem_test_handler, "Test memory access", MEM_CMDS);
 
+/**
+ * Command "mem_test_data"
+ *
+ * Data test of a part of a range: the LFSR data starts at the word offset of
+ * the part, so that a range can be written/verified in parts or resumed
+ *
+ */
+static void mem_test_data_handler(int nb_params, char **params)
+{
+	char *c;
+	unsigned int *addr;
+	unsigned long size;
+	struct memtest_config config = {
+		.show_progress = 1,
+	};
+	int errors;
+
+	if (nb_params < 2) {
+		printf("mem_test_data <addr> <size> [<offset>] [verify]");
+		return;
+	}
+
+	addr = (unsigned int *)strtoul(params[0], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect address");
+		return;
+	}
+
+	size = strtoul(params[1], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect size");
+		return;
+	}
+
+	if (nb_params > 2) {
+		config.offset = strtoul(params[2], &c, 0);
+		if (*c != 0) {
+			printf("Incorrect offset");
+			return;
+		}
+	}
+
+	if (nb_params > 3) {
+		if (strcmp(params[3], "verify") != 0) {
+			printf("Incorrect mode");
+			return;
+		}
+		config.read_only = 1;
+	}
+
+	errors = memtest_data(addr, size, 1, &config);
+	printf("Memtest data %s: %d errors\n", errors ? "KO" : "OK", errors);
+}
+define_command(mem_test_data, mem_test_data_handler, "Test memory data from an offset of the sequence", MEM_CMDS);
+
+/**
+ * Command "mem_march"
+ *
+ * March memory test (c- / mats+ / checkerboard algorithms, linear / complement / stride orders)
+ *
+ */
+static void mem_march_handler(int nb_params, char **params)
+{
+	char *c;
+	unsigned int *addr;
+	unsigned long size;
+	const struct memtest_march *algo = &memtest_march_c_minus;
+	struct memtest_march_config config = {
+		.order         = MEMTEST_ORDER_LINEAR,
+		.background    = 0x55555555,
+		.show_progress = 1,
+	};
+	int errors;
+
+	if (nb_params < 2) {
+		printf("mem_march <addr> <size> [c-|mats+|checkerboard] [linear|complement|<stride>]");
+		return;
+	}
+
+	addr = (unsigned int *)strtoul(params[0], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect address");
+		return;
+	}
+
+	size = strtoul(params[1], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect size");
+		return;
+	}
+
+	if (nb_params >= 3) {
+		if (strcmp(params[2], "c-") == 0)
+			algo = &memtest_march_c_minus;
+		else if (strcmp(params[2], "mats+") == 0)
+			algo = &memtest_mats_plus;
+		else if (strcmp(params[2], "checkerboard") == 0) {
+			algo = &memtest_checkerboard;
+			config.checkerboard = 1;
+		} else {
+			printf("Incorrect algorithm");
+			return;
+		}
+	}
+
+	if (nb_params >= 4) {
+		if (strcmp(params[3], "linear") == 0)
+			config.order = MEMTEST_ORDER_LINEAR;
+		else if (strcmp(params[3], "complement") == 0)
+			config.order = MEMTEST_ORDER_COMPLEMENT;
+		else {
+			config.order  = MEMTEST_ORDER_STRIDE;
+			config.stride = strtoul(params[3], &c, 0);
+			if (*c != 0 || config.stride == 0) {
+				printf("Incorrect order");
+				return;
+			}
+		}
+	}
+
+	errors = memtest_march(addr, size, algo, &config);
+	printf("%s %s: %d errors\n", algo->name, errors ? "KO" : "OK", errors);
+}
+define_command(mem_march, mem_march_handler, "March memory test", MEM_CMDS);
+
 /**
  * Command "mem_speed"
  *
@@ -240,3 +531,128 @@ static void mem_speed_handler(int nb_params, char **params)
 	memspeed(addr, size, read_only, random);
 }
 define_command(mem_speed, mem_speed_handler, "Test memory speed", MEM_CMDS);
+
+/**
+ * Command "mem_bench"
+ *
+ * Memory benchmark (widths, streaming, latency/write-allocate per working set size)
+ *
+ */
+static void mem_bench_handler(int nb_params, char **params)
+{
+	char *c;
+	unsigned int *addr;
+	unsigned long size;
+
+	if (nb_params < 2) {
+		printf("mem_bench <addr> <size>");
+		return;
+	}
+
+	addr = (unsigned int *)strtoul(params[0], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect address");
+		return;
+	}
+
+	size = strtoul(params[1], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect size");
+		return;
+	}
+
+	memspeed_bench(addr, size);
+}
+define_command(mem_bench, mem_bench_handler, "Benchmark memory", MEM_CMDS);
+
+/**
+ * Command "mem_test_dma"
+ *
+ * Memory test/speed of main RAM with the LiteDRAM BIST (bypassing the CPU caches)
+ *
+ */
+#if defined(CSR_SDRAM_GENERATOR_BASE) && defined(CSR_SDRAM_CHECKER_BASE) && defined(MAIN_RAM_BASE)
+static void mem_test_dma_handler(int nb_params, char **params)
+{
+	char *c;
+	unsigned long addr;
+	unsigned long size;
+
+	if (nb_params < 2) {
+		printf("mem_test_dma <addr> <size>");
+		return;
+	}
+
+	addr = strtoul(params[0], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect address");
+		return;
+	}
+
+	size = strtoul(params[1], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect size");
+		return;
+	}
+
+	if ((addr < MAIN_RAM_BASE) || (addr - MAIN_RAM_BASE + size > MAIN_RAM_SIZE)) {
+		printf("Range not in main RAM");
+		return;
+	}
+
+	sdram_bist_memtest(addr - MAIN_RAM_BASE, size);
+}
+define_command(mem_test_dma, mem_test_dma_handler, "Test main RAM with the DRAM BIST (uncached)", MEM_CMDS);
+#endif
+
+/**
+ * Command "mem_test_smp"/"mem_speed_smp"
+ *
+ * Memory test/speed on all the CPUs
+ *
+ */
+#ifdef MEMTEST_SMP
+static int mem_smp_params(int nb_params, char **params, const char *usage,
+	unsigned int **addr, unsigned long *size)
+{
+	char *c;
+
+	if (nb_params < 2) {
+		printf("%s <addr> <size>", usage);
+		return 0;
+	}
+
+	*addr = (unsigned int *)strtoul(params[0], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect address");
+		return 0;
+	}
+
+	*size = strtoul(params[1], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect size");
+		return 0;
+	}
+	return 1;
+}
+
+static void mem_test_smp_handler(int nb_params, char **params)
+{
+	unsigned int *addr;
+	unsigned long size;
+
+	if (mem_smp_params(nb_params, params, "mem_test_smp", &addr, &size))
+		memtest_smp(addr, size);
+}
+define_command(mem_test_smp, mem_test_smp_handler, "Test memory on all CPUs", MEM_CMDS);
+
+static void mem_speed_smp_handler(int nb_params, char **params)
+{
+	unsigned int *addr;
+	unsigned long size;
+
+	if (mem_smp_params(nb_params, params, "mem_speed_smp", &addr, &size))
+		memspeed_smp(addr, size);
+}
+define_command(mem_speed_smp, mem_speed_smp_handler, "Test memory speed on 1-N CPUs", MEM_CMDS);
+#endif
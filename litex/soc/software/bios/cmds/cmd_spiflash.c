@@ -4,6 +4,10 @@
 #include <stdlib.h>
 
 #include <generated/csr.h>
+#include <generated/mem.h>
+
+#include <libbase/spiflash.h>
+#include <liblitespi/spiflash.h>
 
 #include "../command.h"
 #include "../helpers.h"
@@ -73,3 +77,75 @@ static void flash_erase_handler(int nb_params, char **params)
 define_command(flash_erase, flash_erase_handler, "Erase whole flash", SPIFLASH_CMDS);
 #endif
 
+/**
+ * Command "flash_update"
+ *
+ * Write data from a memory buffer to SPI flash, erasing only what differs
+ *
+ */
+#if ((defined CSR_SPIFLASH_BASE && defined SPIFLASH_PAGE_SIZE) || \
+	defined(CSR_SPIFLASH_CORE_MASTER_CS_ADDR)) && defined(SPIFLASH_BASE)
+static void flash_update_handler(int nb_params, char **params)
+{
+	char *c;
+	unsigned int offset;
+	unsigned int addr;
+	unsigned int length;
+
+	if (nb_params < 3) {
+		printf("flash_update <offset> <address> <length>");
+		return;
+	}
+
+	offset = strtoul(params[0], &c, 0);
+	if ((*c != 0) || (offset % 4096)) {
+		printf("Incorrect offset (4KB aligned)");
+		return;
+	}
+
+	addr = strtoul(params[1], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect address");
+		return;
+	}
+
+	length = strtoul(params[2], &c, 0);
+	if (*c != 0) {
+		printf("Incorrect length");
+		return;
+	}
+
+	if (update_flash(offset, (const unsigned char *) addr, length) != 0)
+		printf("Flash verify failed");
+	else
+		printf("Flash updated");
+}
+
+define_command(flash_update, flash_update_handler, "Update flash from memory (skips identical sectors)", SPIFLASH_CMDS);
+#endif
+
+/**
+ * Command "spiflash_bench"
+ *
+ * Benchmark the memory-mapped SPI flash reads
+ *
+ */
+#if defined(CSR_SPIFLASH_CORE_BASE) && defined(CSR_TIMER0_BASE)
+static void spiflash_bench_handler(int nb_params, char **params)
+{
+	char *c;
+	unsigned long size;
+
+	size = 0;
+	if (nb_params > 0) {
+		size = strtoul(params[0], &c, 0);
+		if (*c != 0) {
+			printf("Incorrect size");
+			return;
+		}
+	}
+	spiflash_bench(size);
+}
+
+define_command(spiflash_bench, spiflash_bench_handler, "Benchmark SPI Flash reads (sequential, line fetch, settings)", SPIFLASH_CMDS);
+#endif
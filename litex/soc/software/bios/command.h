@@ -32,6 +32,9 @@ struct command_struct {
 extern struct command_struct *const __bios_cmd_start[];
 extern struct command_struct *const __bios_cmd_end[];
 
+/* Each command gets its own .bios_cmd.<name> section, the linker script sorts
+   them by name so that the table between __bios_cmd_start and __bios_cmd_end
+   is in strcmp order. */
 #define define_command(cmd_name, handler, help_txt, group_id) \
 	struct command_struct s_##cmd_name = {					     \
 		.func = (cmd_handler)handler,					     \
@@ -40,9 +43,11 @@ extern struct command_struct *const __bios_cmd_end[];
 		.group = group_id,						     \
 	};									     \
 	const struct command_struct *__bios_cmd_##cmd_name __attribute__((__used__)) \
-	__attribute__((__section__(".bios_cmd"))) = &s_##cmd_name
+	__attribute__((__section__(".bios_cmd." #cmd_name))) = &s_##cmd_name
 
 
 struct command_struct *command_dispatcher(char *command, int nb_params, char **params);
+int command_table_sorted(void);
+struct command_struct * const *command_lower_bound(const char *name);
 
 #endif
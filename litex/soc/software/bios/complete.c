@@ -99,10 +99,15 @@ static void string_list_print_by_column(void)
 static void command_complete(char *instr)
 {
 	struct command_struct * const *cmd;
+	int len = strlen(instr);
 
-	for (cmd = __bios_cmd_start; cmd != __bios_cmd_end; cmd++)
-		if (!strncmp(instr, (*cmd)->name, strlen(instr)))
+	/* Matches are contiguous from the lower bound in the sorted table */
+	for (cmd = command_lower_bound(instr); cmd != __bios_cmd_end; cmd++) {
+		if (!strncmp(instr, (*cmd)->name, len))
 			string_list_add((*cmd)->name);
+		else if (command_table_sorted())
+			break;
+	}
 }
 
 int complete(char *instr, char **outstr)
@@ -5,8 +5,15 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <generated/csr.h>
+#include <generated/soc.h>
+#include <generated/mem.h>
+
 #include <libbase/console.h>
 #include <libbase/crc.h>
+#include <libbase/lfsr.h>
+#include <libbase/task.h>
+#include <libbase/timing.h>
 
 #include "readline.h"
 #include "helpers.h"
@@ -53,12 +60,70 @@ void dump_bytes(unsigned int *ptr, int count, unsigned long addr)
 	printf("\n");
 }
 
+/*
+ * BIOS self-CRC, over its flat image from _ftext to _edata_rom (run from ROM
+ * or XIP flash). crc32() uses the CRC accelerator of the SoC when it has
+ * one, the fastest software kernel of the build otherwise (Zbc or the
+ * CRC32_SLICING_BY_4/8 BIOS options). With BIOS_CRC_COLD_BOOT, the check is
+ * skipped on warm reboots once it passed for this image, with
+ * BIOS_CRC_DEFERRED it runs by chunks as a task, in the background of the
+ * boot waits (serialboot ACK timeout, network), its result printed by
+ * crcbios_finish() before the console.
+ */
+#ifdef BIOS_CRC_COLD_BOOT
+#define CRCBIOS_PASSED_MAGIC 0x600dc4c5
+/* Expected CRC ^ magic once passed, random on power-up */
+static unsigned int crcbios_passed __attribute__((section(".noinit")));
+#endif
+
+static void crcbios_result(unsigned int expected_crc, unsigned int actual_crc)
+{
+	if (expected_crc == actual_crc) {
+		printf(" BIOS CRC passed (%08x)\n", actual_crc);
+#ifdef BIOS_CRC_COLD_BOOT
+		crcbios_passed = expected_crc ^ CRCBIOS_PASSED_MAGIC;
+#endif
+	} else {
+		printf(" BIOS CRC failed (expected %08x, got %08x)\n", expected_crc, actual_crc);
+		printf(" The system will continue, but expect problems.\n");
+	}
+}
+
+#ifdef BIOS_CRC_DEFERRED
+#define CRCBIOS_CHUNK 4096
+
+struct crcbios_state {
+	const unsigned char *ptr;
+	unsigned long left;
+	unsigned int crc;
+	int pending;
+};
+
+static struct crcbios_state crcbios_state;
+static struct task crcbios_task;
+
+static int crcbios_poll(struct task *t)
+{
+	struct crcbios_state *s = t->arg;
+	unsigned long n;
+
+	TASK_BEGIN(t);
+	while (s->left) {
+		n = (s->left < CRCBIOS_CHUNK) ? s->left : CRCBIOS_CHUNK;
+		s->crc = crc32_update(s->crc, s->ptr, n);
+		s->ptr  += n;
+		s->left -= n;
+		TASK_YIELD(t);
+	}
+	TASK_END(t);
+}
+#endif
+
 void crcbios(void)
 {
 	unsigned long offset_bios;
 	unsigned long length;
 	unsigned int expected_crc;
-	unsigned int actual_crc;
 
 	/*
 	 * _edata_rom is located right after the end of the flat
@@ -69,13 +134,35 @@ void crcbios(void)
 	offset_bios = (unsigned long)&_ftext;
 	expected_crc = _edata_rom;
 	length = (unsigned long)&_edata_rom - offset_bios;
-	actual_crc = crc32((unsigned char *)offset_bios, length);
-	if (expected_crc == actual_crc)
-		printf(" BIOS CRC passed (%08x)\n", actual_crc);
-	else {
-		printf(" BIOS CRC failed (expected %08x, got %08x)\n", expected_crc, actual_crc);
-		printf(" The system will continue, but expect problems.\n");
+#ifdef BIOS_CRC_COLD_BOOT
+	if (crcbios_passed == (expected_crc ^ CRCBIOS_PASSED_MAGIC)) {
+		printf(" BIOS CRC skipped (warm boot)\n");
+		return;
 	}
+#endif
+#ifdef BIOS_CRC_DEFERRED
+	crcbios_state.ptr     = (const unsigned char *)offset_bios;
+	crcbios_state.left    = length;
+	crcbios_state.crc     = 0;
+	crcbios_state.pending = 1;
+	task_start(&crcbios_task, "crcbios", crcbios_poll, &crcbios_state);
+	printf(" BIOS CRC deferred\n");
+#else
+	crcbios_result(expected_crc, crc32((unsigned char *)offset_bios, length));
+#endif
+}
+
+void crcbios_finish(void)
+{
+#ifdef BIOS_CRC_DEFERRED
+	if (!crcbios_state.pending)
+		return;
+	/* Whatever the boot waits left */
+	while (task_active(&crcbios_task))
+		task_poll();
+	crcbios_state.pending = 0;
+	crcbios_result(_edata_rom, crcbios_state.crc);
+#endif
 }
 
 int get_param(char *buf, char **cmd, char **params)
@@ -115,15 +202,54 @@ int get_param(char *buf, char **cmd, char **params)
 	}
 }
 
+/* The command table is sorted at link time; checked once, in case a custom
+   linker script does not sort it (lookups then scan it linearly). */
+int command_table_sorted(void)
+{
+	static int sorted = -1;
+	struct command_struct * const *cmd;
+
+	if (sorted < 0) {
+		sorted = 1;
+		for (cmd = __bios_cmd_start; cmd + 1 < __bios_cmd_end; cmd++)
+			if (strcmp(cmd[0]->name, cmd[1]->name) >= 0)
+				sorted = 0;
+	}
+	return sorted;
+}
+
+/* First command whose name is not smaller than name (__bios_cmd_end if none),
+   the start of the table when it is not sorted. */
+struct command_struct * const *command_lower_bound(const char *name)
+{
+	struct command_struct * const *lo, * const *hi, * const *mid;
+
+	if (!command_table_sorted())
+		return __bios_cmd_start;
+
+	lo = __bios_cmd_start;
+	hi = __bios_cmd_end;
+	while (lo < hi) {
+		mid = lo + (hi - lo)/2;
+		if (strcmp((*mid)->name, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
 struct command_struct *command_dispatcher(char *command, int nb_params, char **params)
 {
 	struct command_struct * const *cmd;
 
-	for (cmd = __bios_cmd_start; cmd != __bios_cmd_end; cmd++) {
+	for (cmd = command_lower_bound(command); cmd != __bios_cmd_end; cmd++) {
 		if (!strcmp(command, (*cmd)->name)) {
 			(*cmd)->func(nb_params, params);
 			return (*cmd);
 		}
+		if (command_table_sorted())
+			break;
 	}
 
 	return NULL;
@@ -135,3 +261,138 @@ void init_dispatcher(void)
 		(*fp)();
 	}
 }
+
+/* BIOS scripts: one command per line (empty lines and # comments skipped),
+   run back-to-back, each one followed by a status line for host tools:
+     @status <line> <command> ok|not_found|too_long <us>
+   and the script by "@end <commands> <errors>". Returns the errors. */
+int run_script(const char *script, unsigned int length)
+{
+	char buffer[CMD_LINE_BUFFER_SIZE];
+	char *params[MAX_PARAM];
+	char *command;
+	const char *result;
+	unsigned int n, line;
+	int nb_params, commands, errors;
+	uint64_t start;
+
+	commands = 0;
+	errors   = 0;
+	line     = 0;
+	while (length > 0) {
+		/* Next line */
+		for (n = 0; (n < length) && (script[n] != '\n'); n++);
+		line++;
+		result = NULL;
+		if (n >= sizeof(buffer))
+			result = "too_long";
+		else {
+			memcpy(buffer, script, n);
+			buffer[n] = 0;
+			if ((n > 0) && (buffer[n - 1] == '\r'))
+				buffer[n - 1] = 0;
+		}
+		script += (n < length) ? n + 1 : n;
+		length -= (n < length) ? n + 1 : n;
+		if (!result) {
+			command = buffer;
+			while (*command == ' ')
+				command++;
+			if ((*command == 0) || (*command == '#'))
+				continue;
+			nb_params = get_param(command, &command, params);
+			start = timing_cycles();
+			result = command_dispatcher(command, nb_params, params) ? "ok" : "not_found";
+			printf("\n@status %u %s %s %lu\n", line, command, result,
+				(unsigned long)(timing_cycles_to_ns(timing_cycles() - start)/1000));
+		} else
+			printf("\n@status %u - %s 0\n", line, result);
+		commands++;
+		if (strcmp(result, "ok"))
+			errors++;
+	}
+	printf("@end %d %d\n", commands, errors);
+	return errors;
+}
+
+/* Storage benchmark (sdcard_bench, sata_bench): sequential and random
+   transfers of several sizes within [first, first + span) sectors, timed
+   with timing_cycles(), the buffer in main RAM. Writes write back the data just
+   read (untimed), leaving the sectors unchanged. */
+#if defined(CSR_TIMER0_BASE) && defined(MAIN_RAM_BASE)
+
+#define STORAGE_BENCH_SECTORS 8192	/* 4MB per sequential run */
+#define STORAGE_BENCH_RANDOM  256	/* Transfers per random run */
+
+static const uint32_t storage_bench_counts[] = {1, 8, 128, 2048};
+
+static uint32_t storage_bench_xfer(storage_xfer xfer, uint32_t sector, uint32_t count, uint8_t *buf)
+{
+	uint64_t start;
+
+	start = timing_cycles();
+	xfer(sector, count, buf);
+	return timing_cycles() - start;
+}
+
+/* Sector of the n-th transfer of count sectors, random when seed */
+static uint32_t storage_bench_sector(uint32_t first, uint32_t span, uint32_t count, int n, uint32_t *seed)
+{
+	if (!seed)
+		return first + n*count;
+	*seed = lfsr(32, *seed);
+	return first + (*seed % (span/count))*count;
+}
+
+static void storage_bench_run(const char *name, storage_xfer read, storage_xfer write,
+	uint32_t first, uint32_t span, uint32_t count, int random)
+{
+	uint8_t *buf = (uint8_t *) MAIN_RAM_BASE;
+	uint64_t cycles, bytes;
+	unsigned long speed, iops;
+	uint32_t sector, seed;
+	int i, n;
+
+	n = random ? STORAGE_BENCH_RANDOM : ((span < STORAGE_BENCH_SECTORS) ? span : STORAGE_BENCH_SECTORS)/count;
+	if (n == 0)
+		n = 1;
+	seed   = 1;
+	cycles = 0;
+	for (i = 0; i < n; i++) {
+		sector = storage_bench_sector(first, span, count, i, random ? &seed : NULL);
+		if (write) {
+			read(sector, count, buf);
+			cycles += storage_bench_xfer(write, sector, count, buf);
+		} else
+			cycles += storage_bench_xfer(read, sector, count, buf);
+	}
+	if (cycles == 0)
+		cycles = 1;
+	bytes = (uint64_t) 512*count*n;
+	speed = bytes*CONFIG_CLOCK_FREQUENCY/cycles;
+	iops  = (uint64_t) n*CONFIG_CLOCK_FREQUENCY/cycles;
+	printf("  %-17s %7lu B: %4lu.%02lu MB/s, %6lu IOPS\n", name, (unsigned long) 512*count,
+		speed/1000000, (speed % 1000000)/10000, iops);
+}
+
+void storage_bench(storage_xfer read, storage_xfer write, uint32_t first, uint32_t span)
+{
+	uint32_t count;
+	int i;
+
+	for (i = 0; i < sizeof(storage_bench_counts)/sizeof(storage_bench_counts[0]); i++) {
+		count = storage_bench_counts[i];
+		if ((count > span) || (512*count > MAIN_RAM_SIZE))
+			break;
+		storage_bench_run("Sequential read", read, NULL, first, span, count, 0);
+		if (count <= 8)
+			storage_bench_run("Random read", read, NULL, first, span, count, 1);
+		if (!write)
+			continue;
+		storage_bench_run("Sequential write", read, write, first, span, count, 0);
+		if (count <= 8)
+			storage_bench_run("Random write", read, write, first, span, count, 1);
+	}
+}
+
+#endif
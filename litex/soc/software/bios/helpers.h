@@ -1,10 +1,18 @@
 #ifndef __HELPERS_H__
 #define __HELPERS_H__
 
+#include <stdint.h>
+
 void dump_bytes(unsigned int *ptr, int count, unsigned long addr);
 void crcbios(void);
+/* Result of a deferred crcbios() (BIOS_CRC_DEFERRED) */
+void crcbios_finish(void);
 int get_param(char *buf, char **cmd, char **params);
 struct command_struct *command_dispatcher(char *command, int nb_params, char **params);
 void init_dispatcher(void);
+int run_script(const char *script, unsigned int length);
+
+typedef void (*storage_xfer)(uint32_t sector, uint32_t count, uint8_t *buf);
+void storage_bench(storage_xfer read, storage_xfer write, uint32_t first, uint32_t span);
 
 #endif
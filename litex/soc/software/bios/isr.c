@@ -7,7 +7,7 @@
 #include <generated/csr.h>
 #include <generated/soc.h>
 #include <irq.h>
-#include <libbase/uart.h>
+#include <libbase/isr.h>
 #include <stdio.h>
 
 #if defined(__microwatt__)
@@ -49,11 +49,7 @@ void isr(void)
 	unsigned int claim;
 
 	while ((claim = *((unsigned int *)PLIC_CLAIM))) {
-		switch (claim - 1) {
-		case UART_INTERRUPT:
-			uart_isr();
-			break;
-		default:
+		if (!irq_handle(claim - 1)) {
 			printf("## PLIC: Unhandled claim: %d\n", claim);
 			printf("# plic_enabled:    %08x\n", irq_getmask());
 			printf("# plic_pending:    %08x\n", irq_pending());
@@ -63,7 +59,6 @@ void isr(void)
 			printf("# mie:     %016lx\n", csrr(mie));
 			printf("# mip:     %016lx\n", csrr(mip));
 			printf("###########################\n\n");
-			break;
 		}
 		*((unsigned int *)PLIC_CLAIM) = claim;
 	}
@@ -81,11 +76,8 @@ void isr(void)
     unsigned int cause = csrr(mcause) & IRQ_MASK;
 
     if (csrr(mcause) & 0x80000000) {
-#ifndef UART_POLLING
-        if (cause == (UART_INTERRUPT+FIRQ_OFFSET)){
-            uart_isr();
-        }
-#endif
+        if (cause >= FIRQ_OFFSET)
+            irq_handle(cause - FIRQ_OFFSET);
     } else {
 #ifdef RISCV_TEST
         int gp;
@@ -114,7 +106,7 @@ void isr(uint64_t vec)
 		uint32_t xirr = xics_icp_readw(PPC_XICS_XIRR);
 		uint32_t irq_source = xirr & 0x00ffffff;
 
-		__attribute__((unused)) unsigned int irqs;
+		unsigned int irqs;
 
 		// Handle IPI interrupts separately
 		if (irq_source == 2) {
@@ -122,13 +114,9 @@ void isr(uint64_t vec)
 			xics_icp_writeb(PPC_XICS_MFRR, 0xff);
 		}
 		else {
-			// External interrupt
+			// External interrupt, to the handlers attached to the lines
 			irqs = irq_pending() & irq_getmask();
-
-#ifndef UART_POLLING
-			if(irqs & (1 << UART_INTERRUPT))
-				uart_isr();
-#endif
+			irq_dispatch(irqs);
 		}
 
 		// Clear interrupt
@@ -147,16 +135,11 @@ void isr_dec(void)
 #else
 void isr(void)
 {
-	__attribute__((unused)) unsigned int irqs;
+	unsigned int irqs;
 
+	/* To the handlers attached to the lines (uart_init, udp_start...) */
 	irqs = irq_pending() & irq_getmask();
-
-#ifdef CSR_UART_BASE
-#ifndef UART_POLLING
-	if(irqs & (1 << UART_INTERRUPT))
-		uart_isr();
-#endif
-#endif
+	irq_dispatch(irqs);
 }
 #endif
 
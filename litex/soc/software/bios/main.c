@@ -47,33 +47,6 @@
 #include <liblitesdcard/sdcard.h>
 #include <liblitesata/sata.h>
 
-static void boot_sequence(void)
-{
-#ifdef CSR_UART_BASE
-	if (serialboot() == 0)
-		return;
-#endif
-#ifdef FLASH_BOOT_ADDRESS
-	flashboot();
-#endif
-#ifdef ROM_BOOT_ADDRESS
-	romboot();
-#endif
-#if defined(CSR_SPISDCARD_BASE) || defined(CSR_SDCORE_BASE)
-	sdcardboot();
-#endif
-#if defined(CSR_SATA_SECTOR2MEM_BASE)
-	sataboot();
-#endif
-#ifdef CSR_ETHMAC_BASE
-#ifdef CSR_ETHPHY_MODE_DETECTION_MODE_ADDR
-	eth_mode();
-#endif
-	netboot(0, NULL);
-#endif
-	printf("No boot medium found\n");
-}
-
 int main(int i, char **c)
 {
 	char buffer[CMD_LINE_BUFFER_SIZE];
@@ -82,6 +55,7 @@ int main(int i, char **c)
 	struct command_struct *cmd;
 	int nb_params;
 	int sdr_ok;
+	int warm;
 
 #ifdef CONFIG_CPU_HAS_INTERRUPT
 	irq_setmask(0);
@@ -90,6 +64,12 @@ int main(int i, char **c)
 #ifdef CSR_UART_BASE
 	uart_init();
 #endif
+	warm = warmboot_detect();
+#ifdef FATFS_LOG
+	boot_time_phase("fatfs_log");
+	fatfs_log_start("bios.log", NULL, 0);
+#endif
+	boot_time_phase("banner");
 
 #ifndef CONFIG_SIM_DISABLE_BIOS_PROMPT
 	printf("\n");
@@ -151,12 +131,20 @@ int main(int i, char **c)
 #if defined(CSR_ETHMAC_BASE) || defined(CSR_SDRAM_BASE) || defined(CSR_SPIFLASH_CORE_BASE)
     printf("--========== \e[1mInitialization\e[0m ============--\n");
 #ifdef CSR_ETHMAC_BASE
+	boot_time_phase("eth_init");
 	eth_init();
 #endif
 #ifdef CSR_SDRAM_BASE
-	sdr_ok = sdram_init();
+	if (warm) {
+		/* Controller not reset, calibration kept */
+		printf("Warm boot, SDRAM initialization skipped.\n");
+	} else {
+		boot_time_phase("sdram_init");
+		sdr_ok = sdram_init();
+	}
 #else
-#ifdef MAIN_RAM_TEST
+#if defined(MAIN_RAM_TEST) && !defined(FAST_BOOT)
+	boot_time_phase("memtest");
 	sdr_ok = memtest();
 #endif
 #endif
@@ -164,6 +152,7 @@ int main(int i, char **c)
 		printf("Memory initialization failed\n");
 #endif
 #ifdef CSR_SPIFLASH_CORE_BASE
+	boot_time_phase("spiflash_init");
 	spiflash_init();
 #endif
 printf("\n");
@@ -176,18 +165,23 @@ printf("\n");
 	video_framebuffer_dma_enable_write(1);
 #endif
 
+	boot_time_phase("init_dispatcher");
 	init_dispatcher();
 
 	if(sdr_ok) {
 		printf("--============== \e[1mBoot\e[0m ==================--\n");
+		if (warm)
+			warmboot_resume();
 		boot_sequence();
 		printf("\n");
 	}
 
+	crcbios_finish();
 	printf("--============= \e[1mConsole\e[0m ================--\n");
 #if !defined(TERM_MINI) && !defined(TERM_NO_HIST)
 	hist_init();
 #endif
+	fatfs_log_flush();
 	printf("\n%s", PROMPT);
 	while(1) {
 		readline(buffer, CMD_LINE_BUFFER_SIZE);
@@ -198,6 +192,7 @@ printf("\n");
 			if (!cmd)
 				printf("Command not found");
 		}
+		fatfs_log_flush();
 		printf("\n%s", PROMPT);
 	}
 	return 0;
@@ -13,6 +13,9 @@
 #include <string.h>
 #include <ctype.h>
 
+#include <generated/csr.h>
+#include <libbase/console.h>
+
 #include "readline.h"
 #include "complete.h"
 
@@ -51,6 +54,12 @@ static int read_key(void)
 {
 	char c;
 	char esc[5];
+#ifdef CSR_SIM_IDLE_BASE
+	/* Let the simulator skip the cycles spent waiting for a key */
+	sim_idle_idle_write(1);
+	while (!readchar_nonblock());
+	sim_idle_idle_write(0);
+#endif
 	c = getchar();
 
 	if (c == 27) {
@@ -7,6 +7,8 @@
 #define SFL_MAGIC_LEN 14
 #define SFL_MAGIC_REQ "sL5DdSMmkekro\n"
 #define SFL_MAGIC_ACK "z6IHG7cYDID6o\n"
+/* mem_dump: the BIOS sends windowed frames to the Host */
+#define SFL_MAGIC_DUMP "d3QpNwT8rvHsl\n"
 
 struct sfl_frame {
 	unsigned char payload_length;
@@ -19,6 +21,32 @@ struct sfl_frame {
 #define SFL_CMD_ABORT		0x00
 #define SFL_CMD_LOAD		0x01
 #define SFL_CMD_JUMP		0x02
+#define SFL_CMD_WINDOW		0x03
+/* Windowed mode only: payload is the destination and a part of an LZ4 frame */
+#define SFL_CMD_LOAD_LZ4	0x04
+
+/*
+ * Windowed mode, requested by the host with SFL_CMD_WINDOW (old BIOSes
+ * reply SFL_ACK_UNKNOWN). The BIOS acknowledges with SFL_ACK_SUCCESS, the
+ * maximum payload length (2 bytes, big endian) and the number of frames
+ * after which it sends an acknowledge. The following frames have a 16-bit
+ * length and a sequence number covered by the CRC, the host sends frames
+ * without waiting for each reply. Replies are the ACK code followed by a
+ * sequence number: cumulative acknowledge of the frames up to it on
+ * success, the next expected frame on errors. After an error, the BIOS
+ * drops frames until the line is idle before replying.
+ */
+#define SFL_WINDOW_DATA_MAX	1024
+#define SFL_WINDOW_PAYLOAD_MAX	(4 + SFL_WINDOW_DATA_MAX)
+#define SFL_WINDOW_ACK_INTERVAL	4
+
+struct sfl_window_frame {
+	unsigned char payload_length[2];
+	unsigned char seq;
+	unsigned char crc[2];
+	unsigned char cmd;
+	unsigned char payload[SFL_WINDOW_PAYLOAD_MAX];
+} __attribute__((packed));
 
 /* Replies */
 #define SFL_ACK_SUCCESS		'K'
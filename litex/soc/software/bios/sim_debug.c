@@ -1,6 +1,7 @@
 #include "sim_debug.h"
 
 #include <stdio.h>
+#include <system.h>
 #include <generated/csr.h>
 
 // 0 is used as no marker
@@ -69,3 +70,25 @@ void sim_finish(void) {
   printf("No sim_finish CSR\n");
 #endif
 }
+
+long sim_load(int index, unsigned long addr) {
+#ifdef CSR_SIM_LOAD_BASE
+  // no dirty line may be written back over the loaded file
+  flush_cpu_dcache();
+  flush_l2_cache();
+  sim_load_index_write(index);
+  sim_load_address_write(addr);
+  sim_load_start_write(1);
+  while (sim_load_busy_read());
+  // drop the stale lines of the loaded range
+  flush_cpu_dcache();
+  flush_l2_cache();
+  flush_cpu_icache();
+  if (sim_load_error_read())
+    return -1;
+  return sim_load_length_read();
+#else
+  printf("No sim_load CSR\n");
+  return -1;
+#endif
+}
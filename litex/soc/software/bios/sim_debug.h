@@ -16,6 +16,8 @@ void sim_trace(int on);
 int sim_trace_on(void);
 // finish simulation
 void sim_finish(void);
+// load host file number index at addr, returns its length or -1
+long sim_load(int index, unsigned long addr);
 
 #ifdef __cplusplus
 }
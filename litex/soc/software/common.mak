@@ -58,6 +58,71 @@ CFLAGS = $(COMMONFLAGS) -fexceptions -Wstrict-prototypes -Wold-style-definition
 CXXFLAGS = $(COMMONFLAGS) -std=c++11 -I$(SOC_DIRECTORY)/software/include/basec++ -fexceptions -fno-rtti -ffreestanding
 LDFLAGS = -nostdlib -nodefaultlibs -Wl,--no-dynamic-linker -Wl,--build-id=none $(CFLAGS) -L$(BUILDINC_DIRECTORY)
 
+# Skip the memory tests/benchmarks of the BIOS initialization
+ifdef FAST_BOOT
+CFLAGS += -DFAST_BOOT
+endif
+
+# Slicing-by-4/8 software CRC32 (ignored by CPUs with Zbc)
+ifdef CRC32_SLICING_BY_4
+CFLAGS += -DCRC32_SLICING=4
+endif
+ifdef CRC32_SLICING_BY_8
+CFLAGS += -DCRC32_SLICING=8
+endif
+
+# BIOS self-CRC skipped on warm reboots once passed, or run in the background of the boot
+ifdef BIOS_CRC_COLD_BOOT
+CFLAGS += -DBIOS_CRC_COLD_BOOT
+endif
+ifdef BIOS_CRC_DEFERRED
+CFLAGS += -DBIOS_CRC_DEFERRED
+endif
+
+# Console output recorded in RAM (dmesg), deferred during the SDRAM leveling
+ifdef LOG_BUFFER
+CFLAGS += -DLOG_BUFFER
+endif
+
+# SDRAM timings read from the SPD EEPROM of the module at boot (I2C, BIST validated)
+ifdef SDRAM_SPD_TIMINGS
+CFLAGS += -DSDRAM_SPD_TIMINGS
+endif
+
+# Warm reboots (reboot warm) skipping the SDRAM initialization, the last booted images reused
+ifdef WARM_BOOT
+CFLAGS += -DWARM_BOOT
+endif
+
+# Ethernet frames received by interrupt, queued in RAM, or with
+# ETH_RX_IN_PLACE left in the RX slots of the MAC and processed there
+ifdef ETH_RX_IRQ
+CFLAGS += -DETH_RX_IRQ
+endif
+ifdef ETH_RX_IN_PLACE
+CFLAGS += -DUDP_RX_QUEUE_SIZE=0
+endif
+
+# Write-enabled FatFs, the BIOS console logged to bios.log of the first FAT volume
+ifdef FATFS_LOG
+FATFS_WRITE = 1
+CFLAGS += -DFATFS_LOG
+endif
+ifdef FATFS_WRITE
+CFLAGS += -DFATFS_WRITE
+endif
+ifdef FATFS_CACHE
+CFLAGS += -DFATFS_CACHE
+endif
+# FatFs with 8.3 names only, without the LFN code and ffunicode.c tables
+ifdef FATFS_NO_LFN
+CFLAGS += -DFATFS_NO_LFN
+endif
+# exFAT volumes and 64-bit LBA (files larger than 4 GB, no FAT chain of contiguous files)
+ifdef FATFS_EXFAT
+CFLAGS += -DFATFS_EXFAT
+endif
+
 define compilexx
 $(CX) -c $(CXXFLAGS) $(1) $< -o $@
 endef
@@ -0,0 +1,315 @@
+// License: BSD
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <generated/soc.h>
+#include <generated/mem.h>
+
+#include <libbase/crc.h>
+#include <libbase/lfsr.h>
+#include <libbase/timing.h>
+
+/*
+ * Benchmark set for comparing CPU variants and CONFIG_CPU_* options: each
+ * benchmark runs its iterations (multiplied by the scale given to the "bench"
+ * command) twice, a warm-up run and a run timed with timing_cycles(), whose
+ * results must match, and reports a score in MB/s or iterations/s. The
+ * summary table can be diffed between builds.
+ */
+
+void bench(unsigned int scale);
+
+#ifdef WITH_CXX
+extern uint32_t bench_cpp(unsigned int iterations);
+#endif
+
+/* Memory benchmarks buffer: upper half of main RAM, away from the app */
+#ifndef BENCH_MEM_SIZE
+#define BENCH_MEM_SIZE 0x10000
+#endif
+#define BENCH_MEM_BASE (MAIN_RAM_BASE + MAIN_RAM_SIZE/2)
+#define BENCH_MEM_BYTES ((BENCH_MEM_SIZE < MAIN_RAM_SIZE/4) ? BENCH_MEM_SIZE : MAIN_RAM_SIZE/4)
+
+/*-----------------------------------------------------------------------*/
+/* Integer (CoreMark-style: list, matrix, state machine, CRC of results) */
+/*-----------------------------------------------------------------------*/
+
+#define LIST_SIZE   32
+#define MATRIX_SIZE 8
+
+struct list_node {
+	struct list_node *next;
+	int16_t data;
+	int16_t idx;
+};
+
+static struct list_node list_nodes[LIST_SIZE];
+
+static struct list_node *list_init(uint32_t seed)
+{
+	int i;
+
+	for (i = 0; i < LIST_SIZE; i++) {
+		list_nodes[i].next = (i < LIST_SIZE - 1) ? &list_nodes[i + 1] : NULL;
+		list_nodes[i].data = (seed ^ (i*0x9e37)) & 0x7fff;
+		list_nodes[i].idx  = i;
+	}
+	return &list_nodes[0];
+}
+
+static struct list_node *list_reverse(struct list_node *l)
+{
+	struct list_node *r = NULL, *next;
+
+	while (l) {
+		next = l->next;
+		l->next = r;
+		r = l;
+		l = next;
+	}
+	return r;
+}
+
+static int list_find(struct list_node *l, int16_t data)
+{
+	for (; l; l = l->next)
+		if ((l->data & 0xff) == (data & 0xff))
+			return l->idx;
+	return -1;
+}
+
+static int32_t matrix_a[MATRIX_SIZE][MATRIX_SIZE];
+static int32_t matrix_b[MATRIX_SIZE][MATRIX_SIZE];
+static int32_t matrix_c[MATRIX_SIZE][MATRIX_SIZE];
+
+static uint16_t matrix_run(uint32_t seed, uint16_t crc)
+{
+	int i, j, k;
+	int32_t sum;
+
+	for (i = 0; i < MATRIX_SIZE; i++)
+		for (j = 0; j < MATRIX_SIZE; j++) {
+			matrix_a[i][j] = (seed + i*MATRIX_SIZE + j) & 0xff;
+			matrix_b[i][j] = ((seed >> 8) + i + j*MATRIX_SIZE) & 0xff;
+		}
+	for (i = 0; i < MATRIX_SIZE; i++)
+		for (j = 0; j < MATRIX_SIZE; j++) {
+			sum = 0;
+			for (k = 0; k < MATRIX_SIZE; k++)
+				sum += matrix_a[i][k]*matrix_b[k][j];
+			matrix_c[i][j] = sum;
+		}
+	for (i = 0; i < MATRIX_SIZE; i++)
+		crc = crc16_update(crc, (const unsigned char *)matrix_c[i], sizeof(matrix_c[i]));
+	return crc;
+}
+
+/* Number scanner: counts integers, decimals and invalid tokens */
+static const char state_input[] =
+	"5012,1234,-874,+122,7.5e3,0x1F,-.5,3.14,abc,42,-17e-2,,9999,1e,+0.7";
+
+static uint32_t state_run(void)
+{
+	enum { START, INT, DEC, EXP, INVALID } state = START;
+	uint32_t ints = 0, decs = 0, invalids = 0;
+	const char *p;
+
+	for (p = state_input; ; p++) {
+		char c = *p;
+		if ((c == ',') || (c == 0)) {
+			if (state == INT)
+				ints++;
+			else if ((state == DEC) || (state == EXP))
+				decs++;
+			else
+				invalids++;
+			state = START;
+			if (c == 0)
+				break;
+			continue;
+		}
+		switch (state) {
+		case START:
+			state = ((c >= '0' && c <= '9') || c == '+' || c == '-') ? INT : (c == '.') ? DEC : INVALID;
+			break;
+		case INT:
+			if (c == '.')
+				state = DEC;
+			else if (c == 'e' || c == 'E')
+				state = EXP;
+			else if (!(c >= '0' && c <= '9'))
+				state = INVALID;
+			break;
+		case DEC:
+			if (c == 'e' || c == 'E')
+				state = EXP;
+			else if (!(c >= '0' && c <= '9'))
+				state = INVALID;
+			break;
+		case EXP:
+			if (!((c >= '0' && c <= '9') || c == '-' || c == '+'))
+				state = INVALID;
+			break;
+		default:
+			break;
+		}
+	}
+	return (ints << 16) | (decs << 8) | invalids;
+}
+
+static uint32_t bench_int(unsigned int iterations)
+{
+	struct list_node *l;
+	uint32_t states;
+	uint16_t crc = 0;
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++) {
+		/* Each iteration seeded by the CRC of the previous ones */
+		l = list_init(crc);
+		l = list_reverse(l);
+		crc = crc16_update(crc, (const unsigned char *)&l->idx, sizeof(l->idx));
+		states = list_find(l, crc) & 0xffff;
+		crc = matrix_run(crc, crc);
+		states |= state_run() << 16;
+		crc = crc16_update(crc, (const unsigned char *)&states, sizeof(states));
+	}
+	return crc;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Memory bandwidth                                                      */
+/*-----------------------------------------------------------------------*/
+
+static uint32_t bench_mem_read(unsigned int iterations)
+{
+	volatile unsigned long *p = (volatile unsigned long *)BENCH_MEM_BASE;
+	unsigned long sum = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < iterations; i++)
+		for (j = 0; j < BENCH_MEM_BYTES/sizeof(unsigned long); j += 4)
+			sum += p[j] + p[j + 1] + p[j + 2] + p[j + 3];
+	return sum;
+}
+
+static uint32_t bench_mem_write(unsigned int iterations)
+{
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++)
+		memset((void *)BENCH_MEM_BASE, i, BENCH_MEM_BYTES);
+	return *(volatile uint32_t *)BENCH_MEM_BASE;
+}
+
+static uint32_t bench_mem_copy(unsigned int iterations)
+{
+	unsigned char *src = (unsigned char *)BENCH_MEM_BASE;
+	unsigned char *dst = src + BENCH_MEM_BYTES/2;
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++)
+		memcpy(dst, src, BENCH_MEM_BYTES/2);
+	return memcmp(dst, src, BENCH_MEM_BYTES/2);
+}
+
+/*-----------------------------------------------------------------------*/
+/* libbase kernels                                                       */
+/*-----------------------------------------------------------------------*/
+
+static uint32_t bench_crc32(unsigned int iterations)
+{
+	uint32_t crc = 0;
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++)
+		crc = crc32((const unsigned char *)BENCH_MEM_BASE, BENCH_MEM_BYTES);
+	return crc;
+}
+
+static uint32_t bench_crc16(unsigned int iterations)
+{
+	uint32_t crc = 0;
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++)
+		crc = crc16((const unsigned char *)BENCH_MEM_BASE, BENCH_MEM_BYTES);
+	return crc;
+}
+
+static uint32_t bench_lfsr(unsigned int iterations)
+{
+	unsigned long state = 1;
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++)
+		state = lfsr(32, state);
+	return state;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Runner                                                                */
+/*-----------------------------------------------------------------------*/
+
+struct bench_entry {
+	const char *name;
+	uint32_t (*run)(unsigned int iterations);
+	unsigned int iterations;	/* Per unit of scale */
+	unsigned int bytes;		/* Per iteration, 0: score in iterations/s */
+};
+
+static const struct bench_entry bench_entries[] = {
+	{"int",       bench_int,       100,   0},
+	{"mem_read",  bench_mem_read,  8,     BENCH_MEM_BYTES},
+	{"mem_write", bench_mem_write, 8,     BENCH_MEM_BYTES},
+	{"mem_copy",  bench_mem_copy,  8,     BENCH_MEM_BYTES/2},
+	{"crc32",     bench_crc32,     2,     BENCH_MEM_BYTES},
+	{"crc16",     bench_crc16,     2,     BENCH_MEM_BYTES},
+	{"lfsr",      bench_lfsr,      10000, 0},
+#ifdef WITH_CXX
+	{"cpp",       bench_cpp,       20,    0},
+#endif
+};
+
+void bench(unsigned int scale)
+{
+	const struct bench_entry *b;
+	uint64_t start, cycles, score;
+	uint32_t reference, result;
+	unsigned int i, iterations;
+	int failures = 0;
+
+	if (scale == 0)
+		scale = 1;
+	printf("Benchmark    Iterations       Cycles     Time (us)          Score  Check\n");
+	for (i = 0; i < sizeof(bench_entries)/sizeof(bench_entries[0]); i++) {
+		b = &bench_entries[i];
+		iterations = b->iterations*scale;
+
+		/* Warm-up run (caches), its result is the reference */
+		reference = b->run(iterations);
+
+		start  = timing_cycles();
+		result = b->run(iterations);
+		cycles = timing_cycles() - start;
+		if (cycles == 0)
+			cycles = 1;
+
+		if (b->bytes)
+			score = ((uint64_t)iterations*b->bytes)*CONFIG_CLOCK_FREQUENCY/cycles/1000;
+		else
+			score = ((uint64_t)iterations)*CONFIG_CLOCK_FREQUENCY*1000/cycles;
+		printf("%-12s %10u %12lu %13lu %9lu.%03lu %s  %s\n",
+			b->name, iterations,
+			(unsigned long)cycles,
+			(unsigned long)(timing_cycles_to_ns(cycles)/1000),
+			(unsigned long)(score/1000), (unsigned long)(score % 1000),
+			b->bytes ? "MB/s " : "it/s ",
+			(result == reference) ? "ok" : "FAIL");
+		if (result != reference)
+			failures++;
+	}
+	printf("CPU: %s @ %dMHz, %d failure(s)\n", CONFIG_CPU_HUMAN_NAME, CONFIG_CLOCK_FREQUENCY/1000000, failures);
+}
@@ -0,0 +1,94 @@
+// License: BSD
+
+#include <stdint.h>
+
+/* C++ container benchmark: a fixed capacity vector (no heap in the demo),
+   filled, sorted with a template heap sort and reduced, per iteration. */
+
+template <typename T, unsigned int N>
+class StaticVector {
+public:
+    StaticVector() : count(0) {}
+
+    bool push_back(const T &v)
+    {
+        if (count >= N)
+            return false;
+        items[count++] = v;
+        return true;
+    }
+    void clear() { count = 0; }
+    unsigned int size() const { return count; }
+
+    T *begin() { return items; }
+    T *end() { return items + count; }
+    T &operator[](unsigned int i) { return items[i]; }
+
+private:
+    T items[N];
+    unsigned int count;
+};
+
+struct Record {
+    uint32_t key;
+    uint16_t value;
+
+    bool operator<(const Record &other) const { return key < other.key; }
+};
+
+template <typename It>
+static void sift_down(It first, unsigned int root, unsigned int size)
+{
+    unsigned int child;
+
+    while ((child = 2*root + 1) < size) {
+        if ((child + 1 < size) && (first[child] < first[child + 1]))
+            child++;
+        if (!(first[root] < first[child]))
+            return;
+        auto tmp = first[root];
+        first[root] = first[child];
+        first[child] = tmp;
+        root = child;
+    }
+}
+
+template <typename It>
+static void heap_sort(It first, It last)
+{
+    unsigned int size = last - first;
+    unsigned int i;
+
+    for (i = size/2; i-- > 0;)
+        sift_down(first, i, size);
+    while (size > 1) {
+        size--;
+        auto tmp = first[0];
+        first[0] = first[size];
+        first[size] = tmp;
+        sift_down(first, 0, size);
+    }
+}
+
+static StaticVector<Record, 256> records;
+
+extern "C" uint32_t bench_cpp(unsigned int iterations);
+uint32_t bench_cpp(unsigned int iterations)
+{
+    uint32_t seed = 1;
+    uint32_t sum = 0;
+
+    for (unsigned int i = 0; i < iterations; i++) {
+        records.clear();
+        do {
+            seed = seed*1664525 + 1013904223;
+        } while (records.push_back(Record{seed, (uint16_t)(seed >> 16)}));
+        heap_sort(records.begin(), records.end());
+        for (unsigned int j = 1; j < records.size(); j++)
+            if (records[j] < records[j - 1])
+                return 0; /* Not sorted */
+        for (const Record &r : records)
+            sum = sum*31 + r.value;
+    }
+    return sum;
+}
@@ -4,7 +4,7 @@
 #include <generated/csr.h>
 #include <generated/soc.h>
 #include <irq.h>
-#include <libbase/uart.h>
+#include <libbase/isr.h>
 
 void isr(void);
 
@@ -12,14 +12,11 @@ void isr(void);
 
 void isr(void)
 {
-	__attribute__((unused)) unsigned int irqs;
+	unsigned int irqs;
 
+	/* To the handlers attached to the lines (uart_init attaches the UART) */
 	irqs = irq_pending() & irq_getmask();
-
-#ifndef UART_POLLING
-	if(irqs & (1 << UART_INTERRUPT))
-		uart_isr();
-#endif
+	irq_dispatch(irqs);
 }
 
 #else
@@ -91,6 +91,7 @@ static void help(void)
 #ifdef WITH_CXX
 	puts("hellocpp           - Hello C++");
 #endif
+	puts("bench [scale]      - Benchmark suite");
 }
 
 /*-----------------------------------------------------------------------*/
@@ -160,6 +161,17 @@ static void hellocpp_cmd(void)
 }
 #endif
 
+extern void bench(unsigned int scale);
+
+static void bench_cmd(char *str)
+{
+	char *token;
+
+	token = get_token(&str);
+	printf("Benchmark suite...\n");
+	bench(strtoul(token, NULL, 0));
+}
+
 /*-----------------------------------------------------------------------*/
 /* Console service / Main                                                */
 /*-----------------------------------------------------------------------*/
@@ -188,6 +200,8 @@ static void console_service(void)
 	else if(strcmp(token, "hellocpp") == 0)
 		hellocpp_cmd();
 #endif
+	else if(strcmp(token, "bench") == 0)
+		bench_cmd(str);
 	prompt();
 }
 
@@ -204,15 +204,51 @@ static inline void csr_wr_uint64(uint64_t v, unsigned long a)
 	} \
 }
 
+/* Byte buffers are the most used (e.g. DFII data), so the common subregister
+ * widths get a direct path; the generic macros above remain the reference. */
 static inline void csr_rd_buf_uint8(unsigned long a, uint8_t *buf, int cnt)
 {
+#if CONFIG_CSR_DATA_WIDTH == 8
+	/* One byte per subregister */
+	for (int i = 0; i < cnt; i++)
+		buf[i] = csr_read_simple(a + i*CSR_OFFSET_BYTES);
+#elif CONFIG_CSR_DATA_WIDTH == 32
+	if ((cnt & 3) == 0) {
+		/* Four bytes per subregister, first byte in the most significant bits */
+		for (int i = 0; i < cnt; i += 4) {
+			uint32_t r = csr_read_simple(a + (i/4)*CSR_OFFSET_BYTES);
+			buf[i + 0] = r >> 24;
+			buf[i + 1] = r >> 16;
+			buf[i + 2] = r >>  8;
+			buf[i + 3] = r;
+		}
+		return;
+	}
+	_csr_rd_buf(a, buf, cnt);
+#else
 	_csr_rd_buf(a, buf, cnt);
+#endif
 }
 
 static inline void csr_wr_buf_uint8(unsigned long a,
 					const uint8_t *buf, int cnt)
 {
+#if CONFIG_CSR_DATA_WIDTH == 8
+	for (int i = 0; i < cnt; i++)
+		csr_write_simple(buf[i], a + i*CSR_OFFSET_BYTES);
+#elif CONFIG_CSR_DATA_WIDTH == 32
+	if ((cnt & 3) == 0) {
+		for (int i = 0; i < cnt; i += 4)
+			csr_write_simple(((uint32_t)buf[i + 0] << 24) |
+					 ((uint32_t)buf[i + 1] << 16) |
+					 ((uint32_t)buf[i + 2] <<  8) |
+					  (uint32_t)buf[i + 3], a + (i/4)*CSR_OFFSET_BYTES);
+		return;
+	}
 	_csr_wr_buf(a, buf, cnt);
+#else
+	_csr_wr_buf(a, buf, cnt);
+#endif
 }
 
 static inline void csr_rd_buf_uint16(unsigned long a, uint16_t *buf, int cnt)
@@ -226,15 +262,27 @@ static inline void csr_wr_buf_uint16(unsigned long a,
 	_csr_wr_buf(a, buf, cnt);
 }
 
+/* Also usable as a bulk access to a byte array CSR of 4*cnt bytes: each word packs
+ * four consecutive bytes, the first one in the most significant bits. */
 static inline void csr_rd_buf_uint32(unsigned long a, uint32_t *buf, int cnt)
 {
+#if CONFIG_CSR_DATA_WIDTH == 32
+	for (int i = 0; i < cnt; i++)
+		buf[i] = csr_read_simple(a + i*CSR_OFFSET_BYTES);
+#else
 	_csr_rd_buf(a, buf, cnt);
+#endif
 }
 
 static inline void csr_wr_buf_uint32(unsigned long a,
 					const uint32_t *buf, int cnt)
 {
+#if CONFIG_CSR_DATA_WIDTH == 32
+	for (int i = 0; i < cnt; i++)
+		csr_write_simple(buf[i], a + i*CSR_OFFSET_BYTES);
+#else
 	_csr_wr_buf(a, buf, cnt);
+#endif
 }
 
 /* NOTE: the macros' "else" branch is unreachable, no need to be warned
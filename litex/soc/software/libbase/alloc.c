@@ -0,0 +1,75 @@
+#include "alloc.h"
+
+#include <stdint.h>
+
+/*-----------------------------------------------------------------------*/
+/* Arena                                                                 */
+/*-----------------------------------------------------------------------*/
+
+void arena_init(struct arena *a, void *buf, size_t size)
+{
+	a->base = buf;
+	a->ptr  = buf;
+	a->end  = (char *)buf + size;
+}
+
+void *arena_alloc_aligned(struct arena *a, size_t size, size_t align)
+{
+	char *p;
+
+	p = (char *)(((uintptr_t)a->ptr + align - 1) & ~(uintptr_t)(align - 1));
+	if((p > a->end) || (size > (size_t)(a->end - p)))
+		return NULL;
+	a->ptr = p + size;
+	return p;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+	return arena_alloc_aligned(a, size, ALLOC_ALIGN);
+}
+
+/*-----------------------------------------------------------------------*/
+/* Pool                                                                  */
+/*-----------------------------------------------------------------------*/
+
+void pool_init(struct pool *p, void *buf, size_t size, unsigned int count)
+{
+	p->buf   = buf;
+	/* Free objects hold the free list link */
+	p->size  = size ? (size + ALLOC_ALIGN - 1) & ~(ALLOC_ALIGN - 1) : ALLOC_ALIGN;
+	p->count = count;
+	pool_reset(p);
+}
+
+void *pool_alloc(struct pool *p)
+{
+	void *obj;
+
+	if(p->free) {
+		obj = p->free;
+		p->free = *(void **)obj;
+	} else if(p->next < p->count) {
+		obj = p->buf + p->next*p->size;
+		p->next++;
+	} else
+		return NULL;
+	p->used++;
+	return obj;
+}
+
+void pool_free(struct pool *p, void *obj)
+{
+	if(obj == NULL)
+		return;
+	*(void **)obj = p->free;
+	p->free = obj;
+	p->used--;
+}
+
+void pool_reset(struct pool *p)
+{
+	p->next = 0;
+	p->free = NULL;
+	p->used = 0;
+}
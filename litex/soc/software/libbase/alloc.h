@@ -0,0 +1,64 @@
+#ifndef __ALLOC_H
+#define __ALLOC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/*
+ * Allocators over a buffer given by the caller (static, stack or a RAM
+ * region), no free list walks nor fragmentation:
+ * - arena: bump allocation, released all at once by arena_reset() or back
+ *   to a mark (LIFO scopes),
+ * - pool: fixed-size objects, allocated and freed in O(1) in any order.
+ * Both return NULL when out of space. C++ code can use them through
+ * placement new.
+ *
+ *   static char scratch[4096];
+ *   struct arena a;
+ *   arena_init(&a, scratch, sizeof(scratch));
+ *   tokens = arena_alloc(&a, count*sizeof(*tokens));
+ */
+
+#define ALLOC_ALIGN sizeof(long long)
+
+struct arena {
+	char *base;
+	char *ptr;
+	char *end;
+};
+
+void arena_init(struct arena *a, void *buf, size_t size);
+/* size bytes aligned to ALLOC_ALIGN / align (power of 2) */
+void *arena_alloc(struct arena *a, size_t size);
+void *arena_alloc_aligned(struct arena *a, size_t size, size_t align);
+static inline void *arena_mark(struct arena *a) { return a->ptr; }
+/* Frees what was allocated since mark */
+static inline void arena_release(struct arena *a, void *mark) { a->ptr = (char *)mark; }
+static inline void arena_reset(struct arena *a) { a->ptr = a->base; }
+static inline size_t arena_used(const struct arena *a) { return a->ptr - a->base; }
+
+struct pool {
+	char *buf;
+	size_t size;
+	unsigned int count;
+	unsigned int next;   /* Objects never allocated from next on */
+	void *free;          /* Freed objects, linked through their first word */
+	unsigned int used;
+};
+
+/* count objects of size bytes (rounded up to ALLOC_ALIGN) in buf */
+void pool_init(struct pool *p, void *buf, size_t size, unsigned int count);
+void *pool_alloc(struct pool *p);
+void pool_free(struct pool *p, void *obj);
+void pool_reset(struct pool *p);
+#define POOL_BUFFER_SIZE(size, count) \
+	((((size) + ALLOC_ALIGN - 1) & ~(ALLOC_ALIGN - 1))*(count))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ALLOC_H */
@@ -0,0 +1,72 @@
+#include "cache.h"
+
+#include <stdint.h>
+
+#include <system.h>
+#include <generated/mem.h>
+#include <generated/soc.h>
+
+static void cpu_dcache_range(uintptr_t addr, unsigned long size)
+{
+#ifdef CPU_DCACHE_RANGE
+	flush_cpu_dcache_range(addr, size);
+#else
+	flush_cpu_dcache();
+#endif
+}
+
+#if defined(CONFIG_L2_SIZE) && defined(MAIN_RAM_BASE)
+
+#ifndef CONFIG_L2_LINE_SIZE
+#define CONFIG_L2_LINE_SIZE 4
+#endif
+
+/* A line holds one address of all those equal modulo CONFIG_L2_SIZE: reading
+   another of them evicts it (written back if dirty). The read has to miss in
+   the CPU D-cache to reach the L2: the alias is dropped from it first. */
+static void l2_evict_range(uintptr_t addr, unsigned long size)
+{
+	uintptr_t end, alias;
+
+	if ((addr < MAIN_RAM_BASE) || (addr >= MAIN_RAM_BASE + MAIN_RAM_SIZE))
+		return;
+	if ((size >= CONFIG_L2_SIZE) || (MAIN_RAM_SIZE < 2*CONFIG_L2_SIZE)) {
+		flush_l2_cache();
+		return;
+	}
+	end = addr + size;
+	if (end > MAIN_RAM_BASE + MAIN_RAM_SIZE)
+		end = MAIN_RAM_BASE + MAIN_RAM_SIZE;
+#ifndef CPU_DCACHE_RANGE
+	flush_cpu_dcache();
+#endif
+	for (addr &= ~(uintptr_t)(CONFIG_L2_LINE_SIZE - 1); addr < end; addr += CONFIG_L2_LINE_SIZE) {
+		alias = addr + CONFIG_L2_SIZE;
+		if (alias >= MAIN_RAM_BASE + MAIN_RAM_SIZE)
+			alias = addr - CONFIG_L2_SIZE;
+#ifdef CPU_DCACHE_RANGE
+		flush_cpu_dcache_range(alias, CONFIG_L2_LINE_SIZE);
+#endif
+		(void)*(volatile unsigned int *)alias;
+	}
+}
+
+#else
+
+static void l2_evict_range(uintptr_t addr, unsigned long size) {}
+
+#endif
+
+void cache_flush_range(const void *addr, unsigned long size)
+{
+	/* Hands the lines of a write-back CPU D-cache to the L2 (nothing to do
+	   for the write-through ones, flush_cpu_dcache() only invalidating) */
+	cpu_dcache_range((uintptr_t)addr, size);
+	l2_evict_range((uintptr_t)addr, size);
+}
+
+void cache_invalidate_range(const void *addr, unsigned long size)
+{
+	cpu_dcache_range((uintptr_t)addr, size);
+	l2_evict_range((uintptr_t)addr, size);
+}
@@ -0,0 +1,28 @@
+#ifndef __CACHE_H
+#define __CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Cache maintenance of a buffer shared with a DMA (CPUs without a coherent
+ * DMA bus), touching only the lines of the buffer when the caches allow it:
+ * - cache_flush_range(): data written by the CPU reaches memory (before a
+ *   DMA reads the buffer) and no dirty line can later overwrite what a DMA
+ *   writes (before a DMA writes the buffer),
+ * - cache_invalidate_range(): data written to memory by a DMA is seen by the
+ *   CPU (after the DMA wrote the buffer).
+ * The CPU D-cache does it per line when its system.h provides
+ * flush_cpu_dcache_range() (CPU_DCACHE_RANGE), by flush_cpu_dcache()
+ * otherwise. The LiteX L2 (direct-mapped, write-back) has its lines of the
+ * range evicted by reads of aliasing addresses, from main RAM only.
+ */
+void cache_flush_range(const void *addr, unsigned long size);
+void cache_invalidate_range(const void *addr, unsigned long size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CACHE_H */
@@ -3,6 +3,8 @@
 
 #include <generated/csr.h>
 
+void (*console_tee)(char c);
+
 int readchar_nonblock(void)
 {
 #ifdef CSR_UART_BASE
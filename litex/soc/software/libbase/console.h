@@ -10,6 +10,9 @@ extern "C" {
 
 int readchar_nonblock(void);
 
+/* Copy of the console output (log file...), NULL when none */
+extern void (*console_tee)(char c);
+
 #ifdef __cplusplus
 }
 #endif
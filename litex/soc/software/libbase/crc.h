@@ -6,7 +6,13 @@ extern "C" {
 #endif
 
 unsigned short crc16(const unsigned char *buffer, int len);
+unsigned short crc16_update(unsigned short crc, const unsigned char *buffer, int len);
 unsigned int crc32(const unsigned char *buffer, unsigned int len);
+/* Continues crc (as returned by crc32(), 0 to start) over buffer */
+unsigned int crc32_update(unsigned int crc, const unsigned char *buffer, unsigned int len);
+/* Copies len bytes and returns crc continued over them, reading src once
+ * (by words once src is word aligned) */
+unsigned int crc32_copy(unsigned int crc, void *dst, const void *src, unsigned int len);
 
 #ifdef __cplusplus
 }
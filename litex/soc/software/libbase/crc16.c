@@ -1,6 +1,26 @@
 #include "crc.h"
 
-#ifndef SMALL_CRC
+#include <generated/csr.h>
+
+#if defined(CSR_CRC16_BASE) && !defined(CRC16_SOFTWARE)
+/* CRC accelerator (soc.add_crc("crc16")), fed by words once aligned */
+unsigned short crc16_update(unsigned short crc, const unsigned char *buffer, int len)
+{
+	crc16_init_write(crc);
+	while((len > 0) && ((unsigned long)buffer & 3)) {
+		crc16_byte_write(*buffer++);
+		len--;
+	}
+	while(len >= 4) {
+		crc16_data_write(*(const unsigned int *)buffer);
+		buffer += 4;
+		len -= 4;
+	}
+	while(len-- > 0)
+		crc16_byte_write(*buffer++);
+	return crc16_value_read();
+}
+#elif !defined(SMALL_CRC)
 static const unsigned int crc16_table[256] = {
 	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
 	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
@@ -36,20 +56,16 @@ static const unsigned int crc16_table[256] = {
 	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
 };
 
-unsigned short crc16(const unsigned char *buffer, int len)
+unsigned short crc16_update(unsigned short crc, const unsigned char *buffer, int len)
 {
-	unsigned short crc;
-
-	crc = 0;
 	while(len-- > 0)
 	    crc = crc16_table[((crc >> 8) ^ (*buffer++)) & 0xFF] ^ (crc << 8);
 
 	return crc;
 }
 #else
-unsigned short crc16(const unsigned char* data_p, int length) {
+unsigned short crc16_update(unsigned short crc, const unsigned char* data_p, int length) {
     unsigned char x;
-    unsigned short crc = 0;
 
     while (length--){
         x = crc >> 8 ^ *data_p++;
@@ -59,3 +75,8 @@ unsigned short crc16(const unsigned char* data_p, int length) {
     return crc;
 }
 #endif
+
+unsigned short crc16(const unsigned char *buffer, int len)
+{
+	return crc16_update(0, buffer, len);
+}
@@ -5,7 +5,88 @@
 
 #include "crc.h"
 
-#ifndef SMALL_CRC
+#include <generated/csr.h>
+
+#if defined(CSR_CRC32_BASE) && !defined(CRC32_SOFTWARE)
+#include <generated/soc.h>
+
+#include "cache.h"
+
+/* CRC accelerator (soc.add_crc("crc32")): words and bytes written to its
+ * CSRs, the bus words of buffers of CRC32_DMA_MIN bytes or more read by its
+ * DMA when it has one */
+#ifndef CRC32_DMA_MIN
+#define CRC32_DMA_MIN 256
+#endif
+
+static void crc32_feed(const unsigned char *buffer, unsigned int len)
+{
+	while(len && ((unsigned long)buffer & 3)) {
+		crc32_byte_write(*buffer++);
+		len--;
+	}
+	while(len >= 4) {
+		crc32_data_write(*(const unsigned int *)buffer);
+		buffer += 4;
+		len -= 4;
+	}
+	while(len--)
+		crc32_byte_write(*buffer++);
+}
+
+unsigned int crc32_update(unsigned int crc, const unsigned char *buffer, unsigned int len)
+{
+	crc32_init_write(crc ^ 0xffffffff);
+#ifdef CSR_CRC32_DMA_BASE
+	if(len >= CRC32_DMA_MIN) {
+		unsigned int head = -(unsigned long)buffer & (CONFIG_BUS_DATA_WIDTH/8 - 1);
+		unsigned int n = (len - head) & ~(CONFIG_BUS_DATA_WIDTH/8 - 1);
+
+		crc32_feed(buffer, head);
+		buffer += head;
+		len -= head;
+		cache_flush_range(buffer, n);
+		crc32_dma_enable_write(0);
+		crc32_dma_base_write((unsigned long)buffer);
+		crc32_dma_length_write(n);
+		crc32_dma_loop_write(0);
+		crc32_dma_enable_write(1);
+		while(!crc32_dma_done_read());
+		crc32_dma_enable_write(0);
+		buffer += n;
+		len -= n;
+	}
+#endif
+	crc32_feed(buffer, len);
+	return crc32_value_read() ^ 0xffffffff;
+}
+
+unsigned int crc32_copy(unsigned int crc, void *dst, const void *src, unsigned int len)
+{
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+
+	crc32_init_write(crc ^ 0xffffffff);
+	while(len && ((unsigned long)s & 3)) {
+		*d = *s++;
+		crc32_byte_write(*d++);
+		len--;
+	}
+	while(len >= 4) {
+		unsigned int w = *(const unsigned int *)s;
+		__builtin_memcpy(d, &w, 4);
+		crc32_data_write(w);
+		d += 4;
+		s += 4;
+		len -= 4;
+	}
+	while(len--) {
+		*d = *s++;
+		crc32_byte_write(*d++);
+	}
+	return crc32_value_read() ^ 0xffffffff;
+}
+#elif !defined(SMALL_CRC)
 static const unsigned int crc_table[256] = {
 	0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
 	0x706af48fL, 0xe963a535L, 0x9e6495a3L, 0x0edb8832L, 0x79dcb8a4L,
@@ -61,32 +142,139 @@ static const unsigned int crc_table[256] = {
 	0x2d02ef8dL
 };
 
-#define DO1(buf) crc = crc_table[((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
-#define DO2(buf)  DO1(buf); DO1(buf);
-#define DO4(buf)  DO2(buf); DO2(buf);
-#define DO8(buf)  DO4(buf); DO4(buf);
+#define DOB(b)  crc = crc_table[((int)crc ^ (b)) & 0xff] ^ (crc >> 8);
 
-unsigned int crc32(const unsigned char *buffer, unsigned int len)
+/* Word kernels, w holding 4 bytes in memory order, selected at build time:
+ * the Zbc carry-less multiply when the CPU has it, slicing-by-4/8 tables
+ * with CRC32_SLICING=4/8 (3/7 KiB more of tables), bytes by crc_table
+ * otherwise */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LE32(w) __builtin_bswap32(w)
+#else
+#define LE32(w) (w)
+#endif
+
+#if defined(__riscv_zbc) && (__riscv_xlen == 32)
+/* Barrett reduction of (crc ^ w).x^32 mod P, bit reflected: mu' is
+ * reflect(x^64 / P - x^32), P' is reflect(P - x^32) */
+static inline unsigned int crc32_word(unsigned int crc, unsigned int w)
+{
+	unsigned int t;
+
+	crc ^= LE32(w);
+	__asm__("clmul %0, %1, %2" : "=r"(t) : "r"(crc), "r"(0xfb808b20));
+	t = (t << 1) ^ crc;
+	__asm__("clmulr %0, %1, %2" : "=r"(t) : "r"(t), "r"(0xedb88320));
+	return t;
+}
+#elif defined(CRC32_SLICING)
+#include "crc32_slices.h"
+
+static inline unsigned int crc32_word(unsigned int crc, unsigned int w)
+{
+	crc ^= LE32(w);
+	return crc_slices[2][crc & 0xff] ^ crc_slices[1][(crc >> 8) & 0xff] ^
+		crc_slices[0][(crc >> 16) & 0xff] ^ crc_table[crc >> 24];
+}
+
+#if CRC32_SLICING == 8
+#define HAVE_CRC32_DWORD
+static inline unsigned int crc32_dword(unsigned int crc, unsigned int w0, unsigned int w1)
+{
+	crc ^= LE32(w0);
+	w1 = LE32(w1);
+	return crc_slices[6][crc & 0xff] ^ crc_slices[5][(crc >> 8) & 0xff] ^
+		crc_slices[4][(crc >> 16) & 0xff] ^ crc_slices[3][crc >> 24] ^
+		crc_slices[2][w1 & 0xff] ^ crc_slices[1][(w1 >> 8) & 0xff] ^
+		crc_slices[0][(w1 >> 16) & 0xff] ^ crc_table[w1 >> 24];
+}
+#endif
+#else
+static inline unsigned int crc32_word(unsigned int crc, unsigned int w)
+{
+	int i;
+
+	crc ^= LE32(w);
+	for(i = 0; i < 4; i++)
+		crc = crc_table[crc & 0xff] ^ (crc >> 8);
+	return crc;
+}
+#endif
+
+#ifndef HAVE_CRC32_DWORD
+static inline unsigned int crc32_dword(unsigned int crc, unsigned int w0, unsigned int w1)
+{
+	return crc32_word(crc32_word(crc, w0), w1);
+}
+#endif
+
+unsigned int crc32_update(unsigned int crc, const unsigned char *buffer, unsigned int len)
 {
-	unsigned int crc;
-	crc = 0;
 	crc = crc ^ 0xffffffffL;
+	while(len && ((unsigned long)buffer & 3)) {
+		DOB(*buffer++);
+		len--;
+	}
 	while(len >= 8) {
-		DO8(buffer);
+		crc = crc32_dword(crc, ((const unsigned int *)buffer)[0], ((const unsigned int *)buffer)[1]);
+		buffer += 8;
 		len -= 8;
 	}
-	if(len) do {
-		DO1(buffer);
-	} while(--len);
+	while(len--) {
+		DOB(*buffer++);
+	}
+	return crc ^ 0xffffffffL;
+}
+
+unsigned int crc32_copy(unsigned int crc, void *dst, const void *src, unsigned int len)
+{
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+
+	crc = crc ^ 0xffffffffL;
+	/* The source (e.g. an uncached MAC slot) is read by words once aligned,
+	   the destination written by words when aligned too, by bytes otherwise */
+	while(len && ((unsigned long)s & 3)) {
+		unsigned char b = *s++;
+		*d++ = b;
+		DOB(b);
+		len--;
+	}
+	if(!((unsigned long)d & 3)) {
+		while(len >= 8) {
+			unsigned int w0 = ((const unsigned int *)s)[0];
+			unsigned int w1 = ((const unsigned int *)s)[1];
+			((unsigned int *)d)[0] = w0;
+			((unsigned int *)d)[1] = w1;
+			crc = crc32_dword(crc, w0, w1);
+			d += 8;
+			s += 8;
+			len -= 8;
+		}
+	} else {
+		while(len >= 4) {
+			unsigned int w = *(const unsigned int *)s;
+			__builtin_memcpy(d, &w, 4);
+			crc = crc32_word(crc, w);
+			d += 4;
+			s += 4;
+			len -= 4;
+		}
+	}
+	while(len--) {
+		unsigned char b = *s++;
+		*d++ = b;
+		DOB(b);
+	}
 	return crc ^ 0xffffffffL;
 }
 #else
-unsigned int crc32(const unsigned char *message, unsigned int len) {
+unsigned int crc32_update(unsigned int crc, const unsigned char *message, unsigned int len) {
    int i, j;
-   unsigned int byte, crc, mask;
+   unsigned int byte, mask;
 
    i = 0;
-   crc = 0xFFFFFFFF;
+   crc = ~crc;
    while (i < len) {
       byte = message[i];            // Get next byte.
       crc = crc ^ byte;
@@ -98,4 +286,20 @@ unsigned int crc32(const unsigned char *message, unsigned int len) {
    }
    return ~crc;
 }
+
+unsigned int crc32_copy(unsigned int crc, void *dst, const void *src, unsigned int len)
+{
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+	unsigned int i;
+
+	for(i = 0; i < len; i++)
+		d[i] = s[i];
+	return crc32_update(crc, d, len);
+}
 #endif
+
+unsigned int crc32(const unsigned char *buffer, unsigned int len)
+{
+	return crc32_update(0, buffer, len);
+}
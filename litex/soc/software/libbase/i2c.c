@@ -3,12 +3,17 @@
 
 #include <generated/csr.h>
 
+#include "timing.h"
+
 #ifdef CSR_I2C_BASE
 
-#define I2C_PERIOD_CYCLES (CONFIG_CLOCK_FREQUENCY / I2C_FREQ_HZ)
-#define I2C_DELAY(n)	  cdelay((n)*I2C_PERIOD_CYCLES/4)
+#define I2C_DELAY(n)	  cdelay((n)*i2c_quarter_loops)
+
+/* Delay loop iterations per quarter of SCL period, 0 until first use */
+static unsigned int i2c_quarter_loops;
+static unsigned int i2c_freq_hz = I2C_FREQ_HZ;
 
-static inline void cdelay(int i)
+static void cdelay(int i)
 {
 	while(i > 0) {
 		__asm__ volatile(CONFIG_CPU_NOP);
@@ -16,6 +21,52 @@ static inline void cdelay(int i)
 	}
 }
 
+/*
+ * Measure how many delay loop iterations run per millisecond. A loop
+ * iteration takes several cycles (NOP, decrement, branch, plus fetch
+ * stalls), so assuming one cycle per iteration would run the bus several
+ * times slower than requested.
+ */
+static unsigned int i2c_loops_per_ms(void)
+{
+	const unsigned int loops = 4096;
+	uint64_t cycles;
+
+	cycles = timing_cycles();
+	cdelay(loops);
+	cycles = timing_cycles() - cycles;
+	if (cycles == 0)
+		cycles = 1;
+	return (uint64_t)loops*(CONFIG_CLOCK_FREQUENCY/1000)/cycles;
+}
+
+static void i2c_timing_init(void)
+{
+	static unsigned int loops_per_ms;
+	unsigned int quarter_loops;
+
+	if (loops_per_ms == 0)
+		loops_per_ms = i2c_loops_per_ms();
+	/* Round up: a slightly slow bus is always safe, a fast one is not */
+	quarter_loops = ((unsigned long long)loops_per_ms*1000 + 4*i2c_freq_hz - 1)/(4*i2c_freq_hz);
+	i2c_quarter_loops = quarter_loops ? quarter_loops : 1;
+}
+
+void i2c_set_freq(unsigned int freq_hz)
+{
+	if (freq_hz == 0)
+		freq_hz = I2C_FREQ_HZ;
+	if (freq_hz > I2C_FREQ_FAST_PLUS)
+		freq_hz = I2C_FREQ_FAST_PLUS;
+	i2c_freq_hz = freq_hz;
+	i2c_timing_init();
+}
+
+unsigned int i2c_get_freq(void)
+{
+	return i2c_freq_hz;
+}
+
 static inline void i2c_oe_scl_sda(bool oe, bool scl, bool sda)
 {
 	i2c_w_write(
@@ -28,6 +79,8 @@ static inline void i2c_oe_scl_sda(bool oe, bool scl, bool sda)
 // START condition: 1-to-0 transition of SDA when SCL is 1
 static void i2c_start(void)
 {
+	if (i2c_quarter_loops == 0)
+		i2c_timing_init();
 	i2c_oe_scl_sda(1, 1, 1);
 	I2C_DELAY(1);
 	i2c_oe_scl_sda(1, 1, 0);
@@ -114,6 +167,8 @@ static unsigned char i2c_receive_byte(bool ack)
 void i2c_reset(void)
 {
 	int i;
+	if (i2c_quarter_loops == 0)
+		i2c_timing_init();
 	i2c_oe_scl_sda(1, 1, 1);
 	I2C_DELAY(8);
 	for (i = 0; i < 9; ++i) {
@@ -170,6 +225,39 @@ bool i2c_read(unsigned char slave_addr, unsigned char addr, unsigned char *data,
 	return true;
 }
 
+/*
+ * Read several single-byte registers of a slave in one transfer
+ *
+ * Registers are separated by repeated STARTs so that the bus is held for the
+ * whole batch (no STOP/bus free time between registers):
+ *   START WR(slaveaddr) WR(addrs[0]) START WR(slaveaddr) RD(data[0])
+ *   START WR(slaveaddr) WR(addrs[1]) START WR(slaveaddr) RD(data[1]) ... STOP
+ * Useful to poll sensors whose registers are not contiguous.
+ */
+bool i2c_read_regs(unsigned char slave_addr, const unsigned char *addrs, unsigned char *data, unsigned int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		i2c_start();
+		if(!i2c_transmit_byte(I2C_ADDR_WR(slave_addr)) ||
+		   !i2c_transmit_byte(addrs[i])) {
+			i2c_stop();
+			return false;
+		}
+		i2c_start();
+		if(!i2c_transmit_byte(I2C_ADDR_RD(slave_addr))) {
+			i2c_stop();
+			return false;
+		}
+		data[i] = i2c_receive_byte(false);
+	}
+
+	i2c_stop();
+
+	return true;
+}
+
 /*
  * Write slave memory over I2C starting at given address
  *
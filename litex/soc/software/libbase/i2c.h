@@ -12,13 +12,21 @@ extern "C" {
 #define I2C_FREQ_HZ  50000
 #endif
 
+/* Standard bus speed modes, see i2c_set_freq() */
+#define I2C_FREQ_STANDARD   100000
+#define I2C_FREQ_FAST       400000
+#define I2C_FREQ_FAST_PLUS 1000000
+
 #define I2C_ADDR_WR(addr) ((addr) << 1)
 #define I2C_ADDR_RD(addr) (((addr) << 1) | 1u)
 
 void i2c_reset(void);
 bool i2c_write(unsigned char slave_addr, unsigned char addr, const unsigned char *data, unsigned int len);
 bool i2c_read(unsigned char slave_addr, unsigned char addr, unsigned char *data, unsigned int len, bool send_stop);
+bool i2c_read_regs(unsigned char slave_addr, const unsigned char *addrs, unsigned char *data, unsigned int count);
 bool i2c_poll(unsigned char slave_addr);
+void i2c_set_freq(unsigned int freq_hz);
+unsigned int i2c_get_freq(void);
 
 #ifdef __cplusplus
 }
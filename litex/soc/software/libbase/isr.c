@@ -0,0 +1,91 @@
+#include "isr.h"
+
+#include <stdio.h>
+
+#include <generated/soc.h>
+
+/* CPUs without interrupts (serv, ibex, femtorv...) have no irq_*mask() */
+#ifdef CONFIG_CPU_HAS_INTERRUPT
+
+#include <irq.h>
+
+struct irq_entry {
+	irq_handler handler;
+	void *arg;
+};
+
+static struct irq_entry irq_table[IRQ_TABLE_SIZE];
+static struct irq_stats irq_stats[IRQ_TABLE_SIZE];
+
+int irq_attach(unsigned int irq, irq_handler handler, void *arg)
+{
+	if ((irq >= IRQ_TABLE_SIZE) || !handler)
+		return -1;
+	/* Masked while updating, the line may already be pending */
+	irq_setmask(irq_getmask() & ~(1 << irq));
+	irq_table[irq].handler = handler;
+	irq_table[irq].arg     = arg;
+	irq_setmask(irq_getmask() | (1 << irq));
+	return 0;
+}
+
+void irq_detach(unsigned int irq)
+{
+	if (irq >= IRQ_TABLE_SIZE)
+		return;
+	irq_setmask(irq_getmask() & ~(1 << irq));
+	irq_table[irq].handler = NULL;
+	irq_table[irq].arg     = NULL;
+}
+
+int irq_handle(unsigned int irq)
+{
+	if (irq >= IRQ_TABLE_SIZE)
+		return 0;
+	if (!irq_table[irq].handler) {
+#ifndef IRQ_NO_STATS
+		irq_stats[irq].unhandled++;
+#endif
+		/* Nobody to acknowledge it: mask it rather than loop on it */
+		irq_setmask(irq_getmask() & ~(1 << irq));
+		return 0;
+	}
+#ifndef IRQ_NO_STATS
+	irq_stats[irq].count++;
+#endif
+	irq_table[irq].handler(irq_table[irq].arg);
+	return 1;
+}
+
+unsigned int irq_dispatch(unsigned int pending)
+{
+	unsigned int unhandled = 0;
+	unsigned int irq;
+
+	for (irq = 0; pending; irq++, pending >>= 1)
+		if ((pending & 1) && !irq_handle(irq))
+			unhandled |= 1 << irq;
+	return unhandled;
+}
+
+const struct irq_stats *irq_get_stats(unsigned int irq)
+{
+	if (irq >= IRQ_TABLE_SIZE)
+		return NULL;
+	return &irq_stats[irq];
+}
+
+void irq_stats_print(void)
+{
+	unsigned int irq;
+
+	printf("IRQ  Handler     Count       Unhandled\n");
+	for (irq = 0; irq < IRQ_TABLE_SIZE; irq++) {
+		if (!irq_table[irq].handler && !irq_stats[irq].count && !irq_stats[irq].unhandled)
+			continue;
+		printf("%3u  %-10s  %10lu  %10lu\n", irq, irq_table[irq].handler ? "attached" : "-",
+			(unsigned long)irq_stats[irq].count, (unsigned long)irq_stats[irq].unhandled);
+	}
+}
+
+#endif /* CONFIG_CPU_HAS_INTERRUPT */
@@ -0,0 +1,41 @@
+#ifndef __ISR_H
+#define __ISR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * IRQ dispatch table: drivers attach a handler (and its argument) to their
+ * interrupt line instead of being called from a central switch in isr().
+ * The CPU isr() only reads the pending lines and calls irq_dispatch() (or
+ * irq_handle() for controllers returning one claimed line at a time, PLIC).
+ * Per-line counters are kept unless built with -DIRQ_NO_STATS.
+ */
+#define IRQ_TABLE_SIZE 32
+
+typedef void (*irq_handler)(void *arg);
+
+/* Attaching also unmasks the line, detaching masks it */
+int irq_attach(unsigned int irq, irq_handler handler, void *arg);
+void irq_detach(unsigned int irq);
+
+/* Both return what was not handled: lines without a handler get masked */
+unsigned int irq_dispatch(unsigned int pending);
+int irq_handle(unsigned int irq);
+
+struct irq_stats {
+	uint32_t count;
+	uint32_t unhandled;
+};
+
+const struct irq_stats *irq_get_stats(unsigned int irq);
+void irq_stats_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ISR_H */
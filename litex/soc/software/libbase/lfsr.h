@@ -107,3 +107,41 @@ static inline unsigned long lfsr(unsigned long bits, unsigned long prev)
 
        return prev;
 }
+
+/*
+ * Jump-ahead: the step is linear over GF(2), so the state n steps after prev
+ * is M^n.prev, M being the matrix of the step (its columns, m[i], the steps
+ * of the single bit states 1 << i). M^n is applied by squaring, bits^2 word
+ * operations per bit of n, letting partitioned or resumed tests start the
+ * sequence at any offset.
+ */
+static inline unsigned long lfsr_matrix_apply(unsigned long bits, const unsigned long *m, unsigned long v)
+{
+	unsigned long i, r = 0;
+
+	for (i = 0; i < bits; i++)
+		r ^= (-((v >> i) & 1)) & m[i];
+	return r;
+}
+
+static inline unsigned long lfsr_jump(unsigned long bits, unsigned long prev, unsigned long n)
+{
+	unsigned long m[sizeof(unsigned long)*CHAR_BIT];
+	unsigned long t[sizeof(unsigned long)*CHAR_BIT];
+	unsigned long i;
+
+	for (i = 0; i < bits; i++)
+		m[i] = lfsr(bits, 1ul << i);
+	while (n) {
+		if (n & 1)
+			prev = lfsr_matrix_apply(bits, m, prev);
+		n >>= 1;
+		if (n) {
+			for (i = 0; i < bits; i++)
+				t[i] = lfsr_matrix_apply(bits, m, m[i]);
+			for (i = 0; i < bits; i++)
+				m[i] = t[i];
+		}
+	}
+	return prev;
+}
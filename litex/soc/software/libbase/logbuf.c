@@ -0,0 +1,88 @@
+#include "logbuf.h"
+#include "uart.h"
+
+#include <stdio.h>
+
+#include <generated/csr.h>
+
+#ifdef LOG_BUFFER
+
+#define LOG_BUFFER_MASK (LOG_BUFFER_SIZE - 1)
+
+static char logbuf[LOG_BUFFER_SIZE];
+/* Chars recorded since the start/clear, how many of them went to the UART */
+static unsigned long logbuf_head;
+static unsigned long logbuf_sent;
+static int logbuf_deferred;
+
+/* Outputs the recorded chars from..to (at most LOG_BUFFER_SIZE) */
+static void logbuf_write(unsigned long from, unsigned long to)
+{
+#ifdef CSR_UART_BASE
+	unsigned long n;
+
+	while(from != to) {
+		n = LOG_BUFFER_SIZE - (from & LOG_BUFFER_MASK);
+		if(n > to - from)
+			n = to - from;
+		uart_write_buf(&logbuf[from & LOG_BUFFER_MASK], n);
+		from += n;
+	}
+#endif
+}
+
+static void logbuf_store(char c)
+{
+	if(logbuf_deferred && (logbuf_head - logbuf_sent == LOG_BUFFER_SIZE))
+		logbuf_flush();
+	logbuf[logbuf_head++ & LOG_BUFFER_MASK] = c;
+}
+
+int logbuf_putc(char c)
+{
+	/* Recorded as output by stdio */
+	logbuf_store(c);
+	if(c == '\n')
+		logbuf_store('\r');
+	if(logbuf_deferred)
+		return 1;
+	logbuf_sent = logbuf_head;
+	return 0;
+}
+
+void logbuf_defer_start(void)
+{
+	if(logbuf_deferred++ == 0)
+		fflush(stdout);
+}
+
+void logbuf_defer_stop(void)
+{
+	if(logbuf_deferred && (--logbuf_deferred == 0))
+		logbuf_flush();
+}
+
+void logbuf_flush(void)
+{
+	logbuf_write(logbuf_sent, logbuf_head);
+	logbuf_sent = logbuf_head;
+}
+
+void logbuf_dump(void)
+{
+	fflush(stdout);
+	logbuf_flush();
+	if(logbuf_head > LOG_BUFFER_SIZE)
+		logbuf_write(logbuf_head - LOG_BUFFER_SIZE, logbuf_head);
+	else
+		logbuf_write(0, logbuf_head);
+}
+
+void logbuf_clear(void)
+{
+	logbuf_flush();
+	logbuf_head = 0;
+	logbuf_sent = 0;
+}
+
+#endif /* LOG_BUFFER */
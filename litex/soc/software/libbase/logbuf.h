@@ -0,0 +1,42 @@
+#ifndef __LOGBUF_H
+#define __LOGBUF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Console log (LOG_BUFFER BIOS option): the console output is recorded in a
+ * RAM ring of LOG_BUFFER_SIZE bytes, printed again by logbuf_dump() (dmesg).
+ * Between logbuf_defer_start() and logbuf_defer_stop() (nesting), the output
+ * is only recorded and given to the UART by logbuf_flush() or the last stop,
+ * so that verbose phases (SDRAM leveling) don't wait for the UART; a full
+ * ring is flushed rather than losing output.
+ */
+#ifdef LOG_BUFFER
+
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 2048 /* Power of 2 */
+#endif
+
+/* Records c, returns 1 when deferred (not to be output) */
+int logbuf_putc(char c);
+void logbuf_defer_start(void);
+void logbuf_defer_stop(void);
+void logbuf_flush(void);
+void logbuf_dump(void);
+void logbuf_clear(void);
+
+#else
+
+static inline void logbuf_defer_start(void) {}
+static inline void logbuf_defer_stop(void) {}
+static inline void logbuf_flush(void) {}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOGBUF_H */
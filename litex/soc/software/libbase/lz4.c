@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <string.h>
+
+#include "lz4.h"
+
+#define FLG_VERSION_MASK    0xc0
+#define FLG_VERSION         0x40
+#define FLG_BLOCK_CHECKSUM  0x10
+#define FLG_CONTENT_SIZE    0x08
+#define FLG_CONTENT_CHECKSUM 0x04
+#define FLG_DICT_ID         0x01
+
+#define BLOCK_UNCOMPRESSED  LZ4_BLOCK_UNCOMPRESSED
+#define BLOCK_SIZE_MAX      (4 << 20)
+
+enum {
+	LZ4_MAGIC,
+	LZ4_FLG,
+	LZ4_BD,
+	LZ4_SKIP,
+	LZ4_BLOCK_START,
+	LZ4_BLOCK_SIZE,
+	LZ4_BLOCK_RAW,
+	LZ4_TOKEN,
+	LZ4_LITERALS_LENGTH,
+	LZ4_LITERALS,
+	LZ4_OFFSET_LOW,
+	LZ4_OFFSET_HIGH,
+	LZ4_MATCH_LENGTH,
+	LZ4_MATCH,
+	LZ4_DONE,
+	LZ4_ERROR
+};
+
+static inline uint32_t lz4_read32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int lz4_is_frame(const void *buf)
+{
+	return lz4_read32(buf) == LZ4_FRAME_MAGIC;
+}
+
+int lz4_frame_info(const void *buf, unsigned long len, struct lz4_frame_info *info)
+{
+	const uint8_t *p = buf;
+	uint32_t n;
+
+	if((len < 7) || !lz4_is_frame(p))
+		return -1;
+	info->flags = p[4];
+	if((info->flags & FLG_VERSION_MASK) != FLG_VERSION)
+		return -1;
+	/* Block maximum size: 64KB, 256KB, 1MB or 4MB */
+	n = (p[5] >> 4) & 0x7;
+	if(n < 4)
+		return -1;
+	info->block_max = 1 << (2*n + 8);
+	info->content_size = 0;
+	n = 6;
+	if(info->flags & FLG_CONTENT_SIZE) {
+		if(len < n + 8)
+			return -1;
+		info->content_size = lz4_read32(p + n) | ((uint64_t)lz4_read32(p + n + 4) << 32);
+		n += 8;
+	}
+	if(info->flags & FLG_DICT_ID)
+		n += 4;
+	/* Header checksum */
+	n++;
+	if(len < n)
+		return -1;
+	info->header_length = n;
+	return 0;
+}
+
+long lz4_block_decode(const void *src, unsigned long len, void *dst, unsigned long dst_size)
+{
+	const uint8_t *in = src;
+	const uint8_t *end = in + len;
+	uint8_t *out = dst;
+	uint8_t *limit = out + dst_size;
+	uint8_t *from;
+	uint32_t literals, match, offset, i;
+	uint8_t b;
+
+	while(in < end) {
+		b = *in++;
+		literals = b >> 4;
+		match = (b & 0xf) + 4;
+		if(literals == 15) {
+			do {
+				if(in == end)
+					return -1;
+				b = *in++;
+				literals += b;
+			} while(b == 255);
+		}
+		if((literals > (uint32_t)(end - in)) || (literals > (uint32_t)(limit - out)))
+			return -1;
+		memcpy(out, in, literals);
+		out += literals;
+		in  += literals;
+		/* The last sequence of a block only has literals */
+		if(in == end)
+			break;
+		if(end - in < 2)
+			return -1;
+		offset = in[0] | ((uint32_t)in[1] << 8);
+		in += 2;
+		if((offset == 0) || (offset > (uint32_t)(out - (uint8_t *)dst)))
+			return -1;
+		if(match == 19) {
+			do {
+				if(in == end)
+					return -1;
+				b = *in++;
+				match += b;
+			} while(b == 255);
+		}
+		if(match > (uint32_t)(limit - out))
+			return -1;
+		from = out - offset;
+		if(offset >= match)
+			memcpy(out, from, match);
+		else {
+			/* Overlapping: repeats the last offset bytes */
+			for(i = 0; i < match; i++)
+				out[i] = from[i];
+		}
+		out += match;
+	}
+	return out - (uint8_t *)dst;
+}
+
+#define XXH_PRIME1 2654435761u
+#define XXH_PRIME2 2246822519u
+#define XXH_PRIME3 3266489917u
+#define XXH_PRIME4  668265263u
+#define XXH_PRIME5  374761393u
+
+static inline uint32_t xxh_rotl(uint32_t x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t xxh_round(uint32_t acc, uint32_t input)
+{
+	return xxh_rotl(acc + input*XXH_PRIME2, 13)*XXH_PRIME1;
+}
+
+uint32_t lz4_xxh32(const void *buf, unsigned long len, uint32_t seed)
+{
+	const uint8_t *p = buf;
+	const uint8_t *end = p + len;
+	uint32_t v1, v2, v3, v4, h;
+
+	if(len >= 16) {
+		v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+		v2 = seed + XXH_PRIME2;
+		v3 = seed;
+		v4 = seed - XXH_PRIME1;
+		do {
+			v1 = xxh_round(v1, lz4_read32(p));
+			v2 = xxh_round(v2, lz4_read32(p + 4));
+			v3 = xxh_round(v3, lz4_read32(p + 8));
+			v4 = xxh_round(v4, lz4_read32(p + 12));
+			p += 16;
+		} while(end - p >= 16);
+		h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+	} else
+		h = seed + XXH_PRIME5;
+	h += len;
+	for(; end - p >= 4; p += 4)
+		h = xxh_rotl(h + lz4_read32(p)*XXH_PRIME3, 17)*XXH_PRIME4;
+	for(; p < end; p++)
+		h = xxh_rotl(h + *p*XXH_PRIME5, 11)*XXH_PRIME1;
+	h ^= h >> 15;
+	h *= XXH_PRIME2;
+	h ^= h >> 13;
+	h *= XXH_PRIME3;
+	h ^= h >> 16;
+	return h;
+}
+
+void lz4_stream_init(struct lz4_stream *s, void *dst, void *limit)
+{
+	memset(s, 0, sizeof(*s));
+	s->dst   = dst;
+	s->out   = dst;
+	s->limit = limit;
+	s->state = LZ4_MAGIC;
+	s->count = 4;
+}
+
+int lz4_stream_done(struct lz4_stream *s)
+{
+	return s->state == LZ4_DONE;
+}
+
+static int lz4_error(struct lz4_stream *s)
+{
+	s->state = LZ4_ERROR;
+	return -1;
+}
+
+static void lz4_skip(struct lz4_stream *s, uint32_t count, int next)
+{
+	s->count = count;
+	s->next  = next;
+	s->state = count ? LZ4_SKIP : next;
+}
+
+static void lz4_block_end(struct lz4_stream *s)
+{
+	lz4_skip(s, (s->flags & FLG_BLOCK_CHECKSUM) ? 4 : 0, LZ4_BLOCK_START);
+}
+
+#define NEED_INPUT() do { if(in == end) return 0; } while(0)
+
+int lz4_stream_feed(struct lz4_stream *s, const void *buf, unsigned long len)
+{
+	const uint8_t *in = buf;
+	const uint8_t *end = in + len;
+	uint32_t n;
+
+	for(;;) {
+		switch(s->state) {
+		case LZ4_MAGIC:
+			NEED_INPUT();
+			s->value = (s->value >> 8) | ((uint32_t)*in++ << 24);
+			if(--s->count)
+				break;
+			if(s->value != LZ4_FRAME_MAGIC)
+				return lz4_error(s);
+			s->state = LZ4_FLG;
+			break;
+		case LZ4_FLG:
+			NEED_INPUT();
+			s->flags = *in++;
+			if((s->flags & FLG_VERSION_MASK) != FLG_VERSION)
+				return lz4_error(s);
+			s->state = LZ4_BD;
+			break;
+		case LZ4_BD:
+			/* Block maximum size: the destination is contiguous, not needed */
+			NEED_INPUT();
+			in++;
+			/* Content size, dictionary ID and header checksum */
+			lz4_skip(s, ((s->flags & FLG_CONTENT_SIZE) ? 8 : 0) +
+				((s->flags & FLG_DICT_ID) ? 4 : 0) + 1, LZ4_BLOCK_START);
+			break;
+		case LZ4_SKIP:
+			NEED_INPUT();
+			n = end - in;
+			if(n > s->count)
+				n = s->count;
+			in += n;
+			s->count -= n;
+			if(s->count == 0)
+				s->state = s->next;
+			break;
+		case LZ4_BLOCK_START:
+			s->count = 4;
+			s->value = 0;
+			s->state = LZ4_BLOCK_SIZE;
+			break;
+		case LZ4_BLOCK_SIZE:
+			NEED_INPUT();
+			s->value = (s->value >> 8) | ((uint32_t)*in++ << 24);
+			if(--s->count)
+				break;
+			if(s->value == 0) {
+				/* End mark */
+				lz4_skip(s, (s->flags & FLG_CONTENT_CHECKSUM) ? 4 : 0, LZ4_DONE);
+				break;
+			}
+			s->block = s->value & ~BLOCK_UNCOMPRESSED;
+			if(s->block > BLOCK_SIZE_MAX)
+				return lz4_error(s);
+			s->state = (s->value & BLOCK_UNCOMPRESSED) ? LZ4_BLOCK_RAW : LZ4_TOKEN;
+			break;
+		case LZ4_BLOCK_RAW:
+			NEED_INPUT();
+			n = end - in;
+			if(n > s->block)
+				n = s->block;
+			if(s->limit && (n > (uint32_t)(s->limit - s->out)))
+				return lz4_error(s);
+			memcpy(s->out, in, n);
+			s->out   += n;
+			in       += n;
+			s->block -= n;
+			if(s->block == 0)
+				lz4_block_end(s);
+			break;
+		case LZ4_TOKEN:
+			NEED_INPUT();
+			if(s->block == 0)
+				return lz4_error(s);
+			s->block--;
+			s->literals = *in >> 4;
+			s->match    = (*in & 0xf) + 4;
+			in++;
+			s->state = (s->literals == 15) ? LZ4_LITERALS_LENGTH : LZ4_LITERALS;
+			break;
+		case LZ4_LITERALS_LENGTH:
+			NEED_INPUT();
+			if(s->block == 0)
+				return lz4_error(s);
+			s->block--;
+			s->literals += *in;
+			if(*in++ != 255)
+				s->state = LZ4_LITERALS;
+			break;
+		case LZ4_LITERALS:
+			if(s->literals > s->block)
+				return lz4_error(s);
+			if(s->literals) {
+				NEED_INPUT();
+				n = end - in;
+				if(n > s->literals)
+					n = s->literals;
+				if(s->limit && (n > (uint32_t)(s->limit - s->out)))
+					return lz4_error(s);
+				memcpy(s->out, in, n);
+				s->out      += n;
+				in          += n;
+				s->block    -= n;
+				s->literals -= n;
+				break;
+			}
+			/* The last sequence of a block only has literals */
+			if(s->block == 0)
+				lz4_block_end(s);
+			else
+				s->state = LZ4_OFFSET_LOW;
+			break;
+		case LZ4_OFFSET_LOW:
+			NEED_INPUT();
+			if(s->block < 2)
+				return lz4_error(s);
+			s->block--;
+			s->offset = *in++;
+			s->state = LZ4_OFFSET_HIGH;
+			break;
+		case LZ4_OFFSET_HIGH:
+			NEED_INPUT();
+			s->block--;
+			s->offset |= (uint32_t)*in++ << 8;
+			if((s->offset == 0) || (s->offset > (uint32_t)(s->out - s->dst)))
+				return lz4_error(s);
+			s->state = (s->match == 19) ? LZ4_MATCH_LENGTH : LZ4_MATCH;
+			break;
+		case LZ4_MATCH_LENGTH:
+			NEED_INPUT();
+			if(s->block == 0)
+				return lz4_error(s);
+			s->block--;
+			s->match += *in;
+			if(*in++ != 255)
+				s->state = LZ4_MATCH;
+			break;
+		case LZ4_MATCH: {
+			uint8_t *from = s->out - s->offset;
+
+			if(s->limit && (s->match > (uint32_t)(s->limit - s->out)))
+				return lz4_error(s);
+			if(s->offset >= s->match)
+				memcpy(s->out, from, s->match);
+			else {
+				/* Overlapping: repeats the last offset bytes */
+				for(n = 0; n < s->match; n++)
+					s->out[n] = from[n];
+			}
+			s->out += s->match;
+			s->state = LZ4_TOKEN;
+			break;
+		}
+		case LZ4_DONE:
+			/* Trailing data (padding) is ignored */
+			return 0;
+		default:
+			return -1;
+		}
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef __LZ4_H
+#define __LZ4_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Streaming decoder of LZ4 frames (as written by the lz4 tool). The data is
+ * decompressed to contiguous memory, so matches are copied from what was
+ * already written and no window buffer is needed. Block and content
+ * checksums are skipped: the boot transports have their own CRCs.
+ */
+
+#define LZ4_FRAME_MAGIC 0x184d2204
+
+struct lz4_stream {
+	uint8_t *dst;
+	uint8_t *out;
+	uint8_t *limit;     /* end of the destination, NULL: unlimited */
+	int state;
+	int next;
+	uint8_t flags;
+	uint32_t count;
+	uint32_t value;
+	uint32_t block;     /* bytes left in the current block */
+	uint32_t literals;
+	uint32_t match;
+	uint32_t offset;
+};
+
+int lz4_is_frame(const void *buf);
+void lz4_stream_init(struct lz4_stream *s, void *dst, void *limit);
+/* Returns 0 when the data was consumed, -1 on errors (corrupted or
+ * unsupported frame, output past limit) */
+int lz4_stream_feed(struct lz4_stream *s, const void *buf, unsigned long len);
+/* Returns 1 once the end of the frame was decoded */
+int lz4_stream_done(struct lz4_stream *s);
+static inline unsigned long lz4_stream_length(struct lz4_stream *s)
+{
+	return s->out - s->dst;
+}
+
+/* Frames of independent blocks (the lz4 tool default) can be decoded block
+ * by block in any order: each block but the last decompresses to block_max
+ * bytes. With --content-size and -BX (block checksums), the output size is
+ * known before decoding and each block can be verified on its own. */
+#define LZ4_BLOCK_UNCOMPRESSED	0x80000000
+
+struct lz4_frame_info {
+	uint8_t flags;
+	uint32_t block_max;
+	uint64_t content_size;	/* 0: not given */
+	uint32_t header_length;	/* Offset of the first block size */
+};
+
+#define LZ4_FLG_BLOCK_INDEPENDENCE	0x20
+#define LZ4_FLG_BLOCK_CHECKSUM		0x10
+
+/* Returns 0 when the frame header is complete in buf and valid, -1 otherwise */
+int lz4_frame_info(const void *buf, unsigned long len, struct lz4_frame_info *info);
+/* Decodes one compressed block of len bytes to dst, returns the
+ * decompressed length or -1 (corrupted, longer than dst_size) */
+long lz4_block_decode(const void *src, unsigned long len, void *dst, unsigned long dst_size);
+/* xxHash32, the checksum of the LZ4 blocks and frames */
+uint32_t lz4_xxh32(const void *buf, unsigned long len, uint32_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LZ4_H */
@@ -1,5 +1,8 @@
 #include "memtest.h"
+#include "cache.h"
 #include "lfsr.h"
+#include "timing.h"
+#include "smp.h"
 
 #include <stdio.h>
 #include <system.h>
@@ -10,6 +13,7 @@
 //#define MEMTEST_BUS_DEBUG
 //#define MEMTEST_DATA_DEBUG
 //#define MEMTEST_ADDR_DEBUG
+//#define MEMTEST_MARCH_DEBUG
 
 // Limits the number of errors printed, so that we can still access bios console
 #ifndef MEMTEST_DEBUG_MAX_ERRORS
@@ -32,6 +36,8 @@
 #endif
 
 #define MEMTEST_DATA_RANDOM 1
+// Data test of memtest(): March C- instead of the written/verified LFSR sequence (slower, 10N).
+//#define MEMTEST_MARCH
 
 #ifndef MEMTEST_ADDR_SIZE
 #define MEMTEST_ADDR_SIZE (32*1024)
@@ -48,6 +54,12 @@ static unsigned short seed_to_data_16(unsigned short seed, int random)
 	return random ? lfsr(16, seed) : seed + 1;
 }
 
+/* Seed n words further in the sequence */
+static unsigned int seed_jump_32(unsigned int seed, unsigned long n, int random)
+{
+	return random ? lfsr_jump(32, seed, n) : seed + n;
+}
+
 #ifdef CSR_CTRL_BASE
 int memtest_access(unsigned int *addr)
 {
@@ -71,91 +83,137 @@ int memtest_access(unsigned int *addr)
 }
 #endif
 
-int memtest_bus(unsigned int *addr, unsigned long size)
+/* Fills n words with a constant pattern */
+static inline __attribute__((always_inline)) void memtest_fill(
+	volatile unsigned int *array, unsigned long n, unsigned int pattern)
 {
-	volatile unsigned int *array = addr;
-	int i, errors;
-	unsigned int rdata;
-
-	errors = 0;
+	unsigned long i;
 
-	/* Write One/Zero pattern */
-	for(i=0; i<size/4; i++) {
-		array[i] = ONEZERO;
+	for (i = 0; i + 4 <= n; i += 4) {
+		array[i + 0] = pattern;
+		array[i + 1] = pattern;
+		array[i + 2] = pattern;
+		array[i + 3] = pattern;
 	}
+	for (; i < n; i++)
+		array[i] = pattern;
+}
 
-	/* Flush caches */
-	flush_cpu_dcache();
-	flush_l2_cache();
+/* Counts the words differing from a constant pattern, 4 words compared at once */
+static int memtest_bus_check(volatile unsigned int *array, unsigned long n, unsigned int pattern)
+{
+	unsigned long i, j;
+	unsigned int d[4];
+	int errors;
 
-	/* Read/Verify One/Zero pattern */
-	for(i=0; i<size/4; i++) {
-		rdata = array[i];
-		if(rdata != ONEZERO) {
-			errors++;
+	errors = 0;
+	for (i = 0; i < n; i += 4) {
+		if (i + 4 <= n) {
+			d[0] = array[i + 0];
+			d[1] = array[i + 1];
+			d[2] = array[i + 2];
+			d[3] = array[i + 3];
+			if (((d[0] ^ pattern) | (d[1] ^ pattern) | (d[2] ^ pattern) | (d[3] ^ pattern)) == 0)
+				continue;
+		} else {
+			for (j = 0; i + j < n; j++)
+				d[j] = array[i + j];
+		}
+		for (j = 0; j < 4 && i + j < n; j++) {
+			if (d[j] != pattern) {
+				errors++;
 #ifdef MEMTEST_BUS_DEBUG
-			if (MEMTEST_DEBUG_MAX_ERRORS < 0 || errors <= MEMTEST_DEBUG_MAX_ERRORS)
-				printf("memtest_bus error @ %p: 0x%08x vs 0x%08x\n", addr + i, rdata, ONEZERO);
+				if (MEMTEST_DEBUG_MAX_ERRORS < 0 || errors <= MEMTEST_DEBUG_MAX_ERRORS)
+					printf("memtest_bus error @ %p: 0x%08x vs 0x%08x\n", array + i + j, d[j], pattern);
 #endif
+			}
 		}
 	}
 
-	/* Write Zero/One pattern */
-	for(i=0; i < size/4; i++) {
-		array[i] = ZEROONE;
-	}
+	return errors;
+}
 
-	/* Flush caches */
-	flush_cpu_dcache();
-	flush_l2_cache();
+int memtest_bus(unsigned int *addr, unsigned long size)
+{
+	volatile unsigned int *array = addr;
+	int errors;
 
-	/* Read/Verify One/Zero pattern */
-	for(i=0; i<size/4; i++) {
-		rdata = array[i];
-		if(rdata != ZEROONE) {
-			errors++;
-#ifdef MEMTEST_BUS_DEBUG
-			if (MEMTEST_DEBUG_MAX_ERRORS < 0 || errors <= MEMTEST_DEBUG_MAX_ERRORS)
-				printf("memtest_bus error @ %p:: 0x%08x vs 0x%08x\n", addr + i, rdata, ZEROONE);
-#endif
-		}
-	}
+	errors = 0;
 
+	/* Write/Verify One/Zero pattern */
+	memtest_fill(array, size/4, ONEZERO);
+	cache_invalidate_range(addr, size);
+	errors += memtest_bus_check(array, size/4, ONEZERO);
+
+	/* Write/Verify Zero/One pattern */
+	memtest_fill(array, size/4, ZEROONE);
+	cache_invalidate_range(addr, size);
+	errors += memtest_bus_check(array, size/4, ZEROONE);
+
+	return errors;
+}
+
+static int memtest_addr_error(unsigned int *addr, unsigned short seed, unsigned short rdata, unsigned int i, int errors)
+{
+#ifdef MEMTEST_ADDR_DEBUG
+	if (MEMTEST_DEBUG_MAX_ERRORS < 0 || errors <= MEMTEST_DEBUG_MAX_ERRORS)
+		printf("memtest_addr error @ %p: 0x%08x vs 0x%08x\n", addr + seed, rdata, i);
+#endif
 	return errors;
 }
 
 int memtest_addr(unsigned int *addr, unsigned long size, int random)
 {
 	volatile unsigned int *array = addr;
-	int i, errors;
-	unsigned short seed_16;
-	unsigned short rdata;
+	unsigned int i, n;
+	int errors;
+	unsigned short s0, s1, s2, s3;
+	unsigned short d0, d1, d2, d3;
 
-	errors  = 0;
-	seed_16 = 1;
+	errors = 0;
+	n      = size/4;
 
-	/* Write datas*/
-	for(i=0; i<size/4; i++) {
-		seed_16 = seed_to_data_16(seed_16, random);
-		array[(unsigned int) seed_16] = i;
+	/* Write datas (each word its index in the sequence) */
+	s3 = 1;
+	for(i=0; i<n; i+=4) {
+		s0 = seed_to_data_16(s3, random);
+		s1 = seed_to_data_16(s0, random);
+		s2 = seed_to_data_16(s1, random);
+		s3 = seed_to_data_16(s2, random);
+		array[s0] = i + 0;
+		if (i + 1 < n) array[s1] = i + 1;
+		if (i + 2 < n) array[s2] = i + 2;
+		if (i + 3 < n) array[s3] = i + 3;
 	}
 
 	/* Flush caches */
-	flush_cpu_dcache();
-	flush_l2_cache();
+	cache_invalidate_range(addr, size);
 
 	/* Read/Verify datas */
-	seed_16 = 1;
-	for(i=0; i<size/4; i++) {
-		seed_16 = seed_to_data_16(seed_16, random);
-		rdata = array[(unsigned int) seed_16];
-		if(rdata != i) {
-			errors++;
-#ifdef MEMTEST_ADDR_DEBUG
-			if (MEMTEST_DEBUG_MAX_ERRORS < 0 || errors <= MEMTEST_DEBUG_MAX_ERRORS)
-				printf("memtest_addr error @ %p: 0x%08x vs 0x%08x\n", addr + i, rdata, i);
-#endif
+	s3 = 1;
+	for(i=0; i<n; i+=4) {
+		s0 = seed_to_data_16(s3, random);
+		s1 = seed_to_data_16(s0, random);
+		s2 = seed_to_data_16(s1, random);
+		s3 = seed_to_data_16(s2, random);
+		if (i + 4 <= n) {
+			d0 = array[s0];
+			d1 = array[s1];
+			d2 = array[s2];
+			d3 = array[s3];
+			if (((d0 ^ (unsigned short)(i + 0)) | (d1 ^ (unsigned short)(i + 1)) |
+			     (d2 ^ (unsigned short)(i + 2)) | (d3 ^ (unsigned short)(i + 3))) == 0)
+				continue;
+		} else {
+			d0 = array[s0];
+			d1 = i + 1 < n ? array[s1] : i + 1;
+			d2 = i + 2 < n ? array[s2] : i + 2;
+			d3 = i + 3;
 		}
+		if (d0 != (unsigned short)(i + 0)) errors = memtest_addr_error(addr, s0, d0, i + 0, errors + 1);
+		if (d1 != (unsigned short)(i + 1)) errors = memtest_addr_error(addr, s1, d1, i + 1, errors + 1);
+		if (d2 != (unsigned short)(i + 2)) errors = memtest_addr_error(addr, s2, d2, i + 2, errors + 1);
+		if (d3 != (unsigned short)(i + 3)) errors = memtest_addr_error(addr, s3, d3, i + 3, errors + 1);
 	}
 
 	return errors;
@@ -184,10 +242,93 @@ static void print_progress(const char * header, unsigned int offset, unsigned in
 	printf("   \r");
 }
 
+/* Words between progress updates */
+#define MEMTEST_DATA_BLOCK 0x8000
+
+/* Writes the n next words of the sequence, returns the last one */
+static inline __attribute__((always_inline)) unsigned int memtest_data_write(
+	volatile unsigned int *array, unsigned long n, unsigned int seed, const int random)
+{
+	unsigned long i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		unsigned int s0 = seed_to_data_32(seed, random);
+		unsigned int s1 = seed_to_data_32(s0, random);
+		unsigned int s2 = seed_to_data_32(s1, random);
+		unsigned int s3 = seed_to_data_32(s2, random);
+		array[i + 0] = s0;
+		array[i + 1] = s1;
+		array[i + 2] = s2;
+		array[i + 3] = s3;
+		seed = s3;
+	}
+	for (; i < n; i++) {
+		seed = seed_to_data_32(seed, random);
+		array[i] = seed;
+	}
+	return seed;
+}
+
+/* Verifies the n next words of the sequence, reading each word once. Returns the index of the
+   first mismatch (with its expected/read data in seed/rdata) or n (with the last word in seed). */
+static inline __attribute__((always_inline)) unsigned long memtest_data_verify(
+	volatile unsigned int *array, unsigned long n, unsigned int *seed, unsigned int *rdata, const int random)
+{
+	unsigned long i;
+	unsigned int s = *seed;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		unsigned int s0 = seed_to_data_32(s, random);
+		unsigned int s1 = seed_to_data_32(s0, random);
+		unsigned int s2 = seed_to_data_32(s1, random);
+		unsigned int s3 = seed_to_data_32(s2, random);
+		unsigned int d0 = array[i + 0];
+		unsigned int d1 = array[i + 1];
+		unsigned int d2 = array[i + 2];
+		unsigned int d3 = array[i + 3];
+		if (((d0 ^ s0) | (d1 ^ s1) | (d2 ^ s2) | (d3 ^ s3)) != 0) {
+			if (d0 != s0) { *seed = s0; *rdata = d0; return i + 0; }
+			if (d1 != s1) { *seed = s1; *rdata = d1; return i + 1; }
+			if (d2 != s2) { *seed = s2; *rdata = d2; return i + 2; }
+			*seed = s3; *rdata = d3; return i + 3;
+		}
+		s = s3;
+	}
+	for (; i < n; i++) {
+		unsigned int d;
+		s = seed_to_data_32(s, random);
+		d = array[i];
+		if (d != s) {
+			*seed = s;
+			*rdata = d;
+			return i;
+		}
+	}
+	*seed = s;
+	return n;
+}
+
+static unsigned int memtest_data_write_block(volatile unsigned int *array, unsigned long n,
+	unsigned int seed, int random)
+{
+	if (random)
+		return memtest_data_write(array, n, seed, 1);
+	return memtest_data_write(array, n, seed, 0);
+}
+
+static unsigned long memtest_data_verify_block(volatile unsigned int *array, unsigned long n,
+	unsigned int *seed, unsigned int *rdata, int random)
+{
+	if (random)
+		return memtest_data_verify(array, n, seed, rdata, 1);
+	return memtest_data_verify(array, n, seed, rdata, 0);
+}
+
 int memtest_data(unsigned int *addr, unsigned long size, int random, struct memtest_config *config)
 {
 	volatile unsigned int *array = addr;
-	int i, errors;
+	unsigned long i, end;
+	int errors;
 	int j, ok_at;
 	int progress;
 	unsigned int seed_32;
@@ -195,54 +336,60 @@ int memtest_data(unsigned int *addr, unsigned long size, int random, struct memt
 
 	progress = config == NULL ? 1 : config->show_progress;
 	errors  = 0;
-	seed_32 = 1;
+	seed_32 = seed_jump_32(1, config == NULL ? 0 : config->offset, random);
 
 	if (config == NULL || !config->read_only) {
 		/* Write datas */
-		for(i=0; i<size/4; i++) {
-			seed_32 = seed_to_data_32(seed_32, random);
-			array[i] = seed_32;
-			if (i%0x8000 == 0)
-				print_progress("  Write:", (unsigned long)addr, 4*i);
+		for(i=0; i<size/4; i+=MEMTEST_DATA_BLOCK) {
+			print_progress("  Write:", (unsigned long)addr, 4*i);
+			end = i + MEMTEST_DATA_BLOCK < size/4 ? i + MEMTEST_DATA_BLOCK : size/4;
+			seed_32 = memtest_data_write_block(&array[i], end - i, seed_32, random);
 		}
-		print_progress("  Write:", (unsigned long)addr, 4*i);
+		print_progress("  Write:", (unsigned long)addr, 4*(size/4));
 		printf("\n");
 	}
 
 	/* Flush caches */
-	flush_cpu_dcache();
-	flush_l2_cache();
+	cache_invalidate_range(addr, size);
 
 	/* Read/Verify datas */
-	seed_32 = 1;
-	for(i=0; i<size/4; i++) {
-		seed_32 = seed_to_data_32(seed_32, random);
-
-		ok_at = -1;
-		for (j = 0; j < MEMTEST_DATA_RETRIES + 1; ++j) {
-			rdata = array[i];
-			if (rdata == seed_32) {
-				ok_at = j;
+	seed_32 = seed_jump_32(1, config == NULL ? 0 : config->offset, random);
+	for(i=0; i<size/4;) {
+		if (progress)
+			print_progress("   Read:", (unsigned long)addr, 4*i);
+		end = i + MEMTEST_DATA_BLOCK < size/4 ? i + MEMTEST_DATA_BLOCK : size/4;
+		while (i < end) {
+			/* Fast path, stops at the first mismatch */
+			i += memtest_data_verify_block(&array[i], end - i, &seed_32, &rdata, random);
+			if (i == end)
 				break;
+
+			/* Mismatch: retry reading */
+			ok_at = -1;
+			for (j = 1; j < MEMTEST_DATA_RETRIES + 1; ++j) {
+				rdata = array[i];
+				if (rdata == seed_32) {
+					ok_at = j;
+					break;
+				}
 			}
-		}
-		if (ok_at > 0)
-			printf("@%p: Redeemed at %d. attempt\n", addr + i, ok_at + 1);
-
-		if(rdata != seed_32) {
-			errors++;
-			if (config != NULL && config->on_error != NULL) {
-				// call the handler, if non-zero status is returned finish now
-				if (config->on_error((unsigned long) (addr + i), rdata, seed_32, config->arg) != 0)
-					return errors;
-			}
+			if (ok_at > 0)
+				printf("@%p: Redeemed at %d. attempt\n", addr + i, ok_at + 1);
+
+			if(rdata != seed_32) {
+				errors++;
+				if (config != NULL && config->on_error != NULL) {
+					// call the handler, if non-zero status is returned finish now
+					if (config->on_error((unsigned long) (addr + i), rdata, seed_32, config->arg) != 0)
+						return errors;
+				}
 #ifdef MEMTEST_DATA_DEBUG
-			if (MEMTEST_DEBUG_MAX_ERRORS < 0 || errors <= MEMTEST_DEBUG_MAX_ERRORS)
-				printf("memtest_data error @ %p: 0x%08x vs 0x%08x\n", addr + i, rdata, seed_32);
+				if (MEMTEST_DEBUG_MAX_ERRORS < 0 || errors <= MEMTEST_DEBUG_MAX_ERRORS)
+					printf("memtest_data error @ %p: 0x%08x vs 0x%08x\n", addr + i, rdata, seed_32);
 #endif
+			}
+			i++;
 		}
-		if (i%0x8000 == 0 && progress)
-			print_progress("   Read:", (unsigned long)addr, 4*i);
 	}
 	if (progress) {
 		print_progress("   Read:", (unsigned long)addr, 4*i);
@@ -252,12 +399,260 @@ int memtest_data(unsigned int *addr, unsigned long size, int random, struct memt
 	return errors;
 }
 
+/*-----------------------------------------------------------------------*/
+/* March tests                                                           */
+/*-----------------------------------------------------------------------*/
+
+/* A March test is a sequence of elements, each a pass over the range in ascending or descending
+   address order applying its operations to every word before moving to the next one: a read of
+   the background ("0") or of its complement ("1"), then a write of one of them. March C- (10N)
+   detects the stuck-at, transition, address decoder and the coupling faults between any two words,
+   MATS+ (5N) the stuck-at and address decoder ones. The caches are invalidated between elements,
+   so that the reads of an element come from the memory.
+
+   The words are bus wide (unsigned long) and the linear order is unrolled by 4, the other orders
+   change which word is the next one: address complement (0, N-1, 1, N-2..., toggling most of the
+   address lines at each access) and stride (the words of a column of stride words, then the next
+   column, so that consecutive accesses go to different DRAM rows/banks). */
+
+static const struct memtest_march_element memtest_march_c_minus_elements[] = {
+	{MEMTEST_MARCH_UP,   MEMTEST_MARCH_NONE, MEMTEST_MARCH_0},
+	{MEMTEST_MARCH_UP,   MEMTEST_MARCH_0,    MEMTEST_MARCH_1},
+	{MEMTEST_MARCH_UP,   MEMTEST_MARCH_1,    MEMTEST_MARCH_0},
+	{MEMTEST_MARCH_DOWN, MEMTEST_MARCH_0,    MEMTEST_MARCH_1},
+	{MEMTEST_MARCH_DOWN, MEMTEST_MARCH_1,    MEMTEST_MARCH_0},
+	{MEMTEST_MARCH_UP,   MEMTEST_MARCH_0,    MEMTEST_MARCH_NONE},
+};
+
+static const struct memtest_march_element memtest_mats_plus_elements[] = {
+	{MEMTEST_MARCH_UP,   MEMTEST_MARCH_NONE, MEMTEST_MARCH_0},
+	{MEMTEST_MARCH_UP,   MEMTEST_MARCH_0,    MEMTEST_MARCH_1},
+	{MEMTEST_MARCH_DOWN, MEMTEST_MARCH_1,    MEMTEST_MARCH_0},
+};
+
+/* Writes/verifies the background, then its complement (use a checkerboard background) */
+static const struct memtest_march_element memtest_checkerboard_elements[] = {
+	{MEMTEST_MARCH_UP,   MEMTEST_MARCH_NONE, MEMTEST_MARCH_0},
+	{MEMTEST_MARCH_UP,   MEMTEST_MARCH_0,    MEMTEST_MARCH_NONE},
+	{MEMTEST_MARCH_UP,   MEMTEST_MARCH_NONE, MEMTEST_MARCH_1},
+	{MEMTEST_MARCH_UP,   MEMTEST_MARCH_1,    MEMTEST_MARCH_NONE},
+};
+
+#define MEMTEST_MARCH_ALGO(_name, _elements) \
+	{ .name = _name, .nelements = sizeof(_elements)/sizeof(_elements[0]), .elements = _elements }
+
+const struct memtest_march memtest_march_c_minus = MEMTEST_MARCH_ALGO("March C-",     memtest_march_c_minus_elements);
+const struct memtest_march memtest_mats_plus     = MEMTEST_MARCH_ALGO("MATS+",        memtest_mats_plus_elements);
+const struct memtest_march memtest_checkerboard  = MEMTEST_MARCH_ALGO("Checkerboard", memtest_checkerboard_elements);
+
+struct memtest_march_state {
+	volatile unsigned long *array;
+	unsigned long n;
+	unsigned long bg[2]; /* "0" of the even/odd words */
+	const struct memtest_march_config *config;
+	int errors;
+	int stop;
+};
+
+static void memtest_march_error(struct memtest_march_state *m, unsigned long i,
+	unsigned long rdata, unsigned long refdata)
+{
+	m->errors++;
+	if (m->config->on_error != NULL) {
+		if (m->config->on_error((unsigned long) (m->array + i), rdata, refdata, m->config->arg) != 0)
+			m->stop = 1;
+	}
+#ifdef MEMTEST_MARCH_DEBUG
+	if (MEMTEST_DEBUG_MAX_ERRORS < 0 || m->errors <= MEMTEST_DEBUG_MAX_ERRORS)
+		printf("memtest_march error @ %p: 0x%08lx vs 0x%08lx\n", m->array + i, rdata, refdata);
+#endif
+}
+
+static inline __attribute__((always_inline)) unsigned long memtest_march_value(
+	struct memtest_march_state *m, unsigned long i, int op)
+{
+	return op == MEMTEST_MARCH_1 ? ~m->bg[i & 1] : m->bg[i & 1];
+}
+
+static inline __attribute__((always_inline)) void memtest_march_word(
+	struct memtest_march_state *m, unsigned long i, const struct memtest_march_element *e)
+{
+	unsigned long rdata, refdata;
+
+	if (e->read != MEMTEST_MARCH_NONE) {
+		rdata   = m->array[i];
+		refdata = memtest_march_value(m, i, e->read);
+		if (rdata != refdata)
+			memtest_march_error(m, i, rdata, refdata);
+	}
+	if (e->write != MEMTEST_MARCH_NONE)
+		m->array[i] = memtest_march_value(m, i, e->write);
+}
+
+/* Linear order, 4 words at once (their operations still done word after word) */
+static void memtest_march_linear(struct memtest_march_state *m, const struct memtest_march_element *e)
+{
+	volatile unsigned long *array = m->array;
+	unsigned long r0, r1, w0, w1, d0, d1, d2, d3;
+	unsigned long i, j;
+	int read  = e->read  != MEMTEST_MARCH_NONE;
+	int write = e->write != MEMTEST_MARCH_NONE;
+
+	/* Read/written values of the even/odd words */
+	r0 = memtest_march_value(m, 0, e->read);
+	r1 = memtest_march_value(m, 1, e->read);
+	w0 = memtest_march_value(m, 0, e->write);
+	w1 = memtest_march_value(m, 1, e->write);
+
+	if (e->order == MEMTEST_MARCH_UP) {
+		for (i = 0; i + 4 <= m->n && !m->stop; i += 4) {
+			if (read && write) {
+				d0 = array[i + 0]; array[i + 0] = w0;
+				d1 = array[i + 1]; array[i + 1] = w1;
+				d2 = array[i + 2]; array[i + 2] = w0;
+				d3 = array[i + 3]; array[i + 3] = w1;
+			} else if (read) {
+				d0 = array[i + 0];
+				d1 = array[i + 1];
+				d2 = array[i + 2];
+				d3 = array[i + 3];
+			} else {
+				array[i + 0] = w0;
+				array[i + 1] = w1;
+				array[i + 2] = w0;
+				array[i + 3] = w1;
+				continue;
+			}
+			if (((d0 ^ r0) | (d1 ^ r1) | (d2 ^ r0) | (d3 ^ r1)) != 0) {
+				if (d0 != r0) memtest_march_error(m, i + 0, d0, r0);
+				if (d1 != r1) memtest_march_error(m, i + 1, d1, r1);
+				if (d2 != r0) memtest_march_error(m, i + 2, d2, r0);
+				if (d3 != r1) memtest_march_error(m, i + 3, d3, r1);
+			}
+		}
+		for (; i < m->n && !m->stop; i++)
+			memtest_march_word(m, i, e);
+	} else {
+		/* The n%4 last words first, then the 4 words blocks */
+		for (i = m->n; i % 4 && !m->stop; i--)
+			memtest_march_word(m, i - 1, e);
+		for (; i >= 4 && !m->stop; i -= 4) {
+			j = i - 4;
+			if (read && write) {
+				d3 = array[j + 3]; array[j + 3] = w1;
+				d2 = array[j + 2]; array[j + 2] = w0;
+				d1 = array[j + 1]; array[j + 1] = w1;
+				d0 = array[j + 0]; array[j + 0] = w0;
+			} else if (read) {
+				d3 = array[j + 3];
+				d2 = array[j + 2];
+				d1 = array[j + 1];
+				d0 = array[j + 0];
+			} else {
+				array[j + 3] = w1;
+				array[j + 2] = w0;
+				array[j + 1] = w1;
+				array[j + 0] = w0;
+				continue;
+			}
+			if (((d0 ^ r0) | (d1 ^ r1) | (d2 ^ r0) | (d3 ^ r1)) != 0) {
+				if (d3 != r1) memtest_march_error(m, j + 3, d3, r1);
+				if (d2 != r0) memtest_march_error(m, j + 2, d2, r0);
+				if (d1 != r1) memtest_march_error(m, j + 1, d1, r1);
+				if (d0 != r0) memtest_march_error(m, j + 0, d0, r0);
+			}
+		}
+	}
+}
+
+/* Address complement order: 0, N-1, 1, N-2... (reversed when descending) */
+static void memtest_march_complement(struct memtest_march_state *m, const struct memtest_march_element *e)
+{
+	unsigned long k, j;
+
+	for (k = 0; k < m->n && !m->stop; k++) {
+		j = e->order == MEMTEST_MARCH_UP ? k : m->n - 1 - k;
+		memtest_march_word(m, (j & 1) ? m->n - 1 - j/2 : j/2, e);
+	}
+}
+
+/* Stride order: words 0, s, 2s... then 1, s+1, 2s+1... (reversed when descending) */
+static void memtest_march_stride(struct memtest_march_state *m, const struct memtest_march_element *e)
+{
+	unsigned long stride = m->config->stride;
+	unsigned long col, i;
+
+	if (stride == 0 || stride > m->n)
+		stride = 1;
+	if (e->order == MEMTEST_MARCH_UP) {
+		for (col = 0; col < stride && !m->stop; col++)
+			for (i = col; i < m->n && !m->stop; i += stride)
+				memtest_march_word(m, i, e);
+	} else {
+		for (col = stride; col > 0 && !m->stop; col--) {
+			/* Last word of the column first */
+			i = col - 1 + ((m->n - col) / stride) * stride;
+			for (;; i -= stride) {
+				memtest_march_word(m, i, e);
+				if (i < stride || m->stop)
+					break;
+			}
+		}
+	}
+}
+
+int memtest_march(unsigned int *addr, unsigned long size, const struct memtest_march *algo,
+	const struct memtest_march_config *config)
+{
+	static const struct memtest_march_config default_config = {
+		.order         = MEMTEST_ORDER_LINEAR,
+		.background    = ZEROONE,
+		.show_progress = 1,
+	};
+	struct memtest_march_state m;
+	int k;
+
+	if (config == NULL)
+		config = &default_config;
+
+	m.array  = (volatile unsigned long *)addr;
+	m.n      = size/sizeof(unsigned long);
+	m.config = config;
+	m.errors = 0;
+	m.stop   = 0;
+	/* Background replicated to the bus width, complemented on the odd words for a checkerboard */
+	m.bg[0]  = (unsigned long)config->background * (~0UL / 0xffffffffUL);
+	m.bg[1]  = config->checkerboard ? ~m.bg[0] : m.bg[0];
+
+	for (k = 0; k < algo->nelements && !m.stop; k++) {
+		if (config->show_progress)
+			printf("  %s: %d/%d   \r", algo->name, k + 1, algo->nelements);
+		switch (config->order) {
+		case MEMTEST_ORDER_COMPLEMENT:
+			memtest_march_complement(&m, &algo->elements[k]);
+			break;
+		case MEMTEST_ORDER_STRIDE:
+			memtest_march_stride(&m, &algo->elements[k]);
+			break;
+		default:
+			memtest_march_linear(&m, &algo->elements[k]);
+			break;
+		}
+		/* Invalidate caches */
+		cache_invalidate_range(addr, size);
+	}
+	if (config->show_progress)
+		printf("\n");
+
+	return m.errors;
+}
+
 void memspeed(unsigned int *addr, unsigned long size, bool read_only, bool random)
 {
 	volatile unsigned long *array = (unsigned long *)addr;
 	int i;
 	unsigned int seed_32 = 0;
-	uint32_t start, end;
+	uint64_t start, end;
 	unsigned long write_speed = 0;
 	unsigned long read_speed;
 	__attribute__((unused)) unsigned long data;
@@ -271,23 +666,15 @@ void memspeed(unsigned int *addr, unsigned long size, bool read_only, bool rando
 	print_size(size);
 	printf(")...\n");
 
-	/* Init timer */
-	timer0_en_write(0);
-	timer0_reload_write(0);
-	timer0_load_write(0xffffffff);
-	timer0_en_write(1);
-
 	/* Measure Write speed */
 	if (!read_only) {
-		timer0_update_value_write(1);
-		start = timer0_value_read();
+		start = timing_cycles();
 		for(i = 0; i < size/sz; i++) {
 			array[i] = -1ul;
 		}
-		timer0_update_value_write(1);
-		end = timer0_value_read();
+		end = timing_cycles();
 		uint64_t numerator   = ((uint64_t)size)*((uint64_t)CONFIG_CLOCK_FREQUENCY);
-		uint64_t denominator = ((uint64_t)start - (uint64_t)end);
+		uint64_t denominator = end - start;
 		write_speed = numerator/denominator;
 		printf("  Write speed: ");
 		print_speed(write_speed);
@@ -299,9 +686,7 @@ void memspeed(unsigned int *addr, unsigned long size, bool read_only, bool rando
 	flush_l2_cache();
 
 	/* Measure Read speed */
-	timer0_en_write(1);
-	timer0_update_value_write(1);
-	start = timer0_value_read();
+	start = timing_cycles();
 
 	int num = size/sz;
 
@@ -316,16 +701,230 @@ void memspeed(unsigned int *addr, unsigned long size, bool read_only, bool rando
 		}
 	}
 
-	timer0_update_value_write(1);
-	end = timer0_value_read();
+	end = timing_cycles();
 	uint64_t numerator   = ((uint64_t)size)*((uint64_t)CONFIG_CLOCK_FREQUENCY);
-	uint64_t denominator = ((uint64_t)start - (uint64_t)end);
+	uint64_t denominator = end - start;
 	read_speed = numerator/denominator;
 	printf("   Read speed: ");
 	print_speed(read_speed);
 	printf("\n");
 }
 
+/* Memory benchmark: load/store widths, unrolled fill/copy, and per working set size the
+   pointer-chasing latency and the write speed to cold (flushed) vs resident (just read)
+   lines, which exposes the cache boundaries and the write-allocate cost. */
+
+#ifndef MEMSPEED_LINE_SIZE
+#define MEMSPEED_LINE_SIZE 64
+#endif
+#define MEMSPEED_LATENCY_MIN_SIZE (1*KIB)
+#define MEMSPEED_LATENCY_STEPS    (64*KIB)
+
+static void memspeed_flush(void)
+{
+	flush_cpu_dcache();
+	flush_l2_cache();
+}
+
+static void memspeed_print(const char *name, unsigned long size, uint32_t ticks)
+{
+	printf("  %-12s ", name);
+	if (ticks == 0) {
+		printf("-\n");
+		return;
+	}
+	print_speed(((uint64_t)size)*CONFIG_CLOCK_FREQUENCY/ticks);
+	printf("\n");
+}
+
+#define MEMSPEED_WIDTH(type) \
+static uint32_t memspeed_write_##type(void *addr, unsigned long size) \
+{ \
+	volatile type *array = addr; \
+	unsigned long i; \
+	uint64_t start = timing_cycles(); \
+	for (i = 0; i < size/sizeof(type); i++) \
+		array[i] = (type) i; \
+	return timing_cycles() - start; \
+} \
+ \
+static uint32_t memspeed_read_##type(void *addr, unsigned long size) \
+{ \
+	volatile type *array = addr; \
+	unsigned long i; \
+	__attribute__((unused)) type data; \
+	uint64_t start = timing_cycles(); \
+	for (i = 0; i < size/sizeof(type); i++) \
+		data = array[i]; \
+	return timing_cycles() - start; \
+}
+
+MEMSPEED_WIDTH(uint8_t)
+MEMSPEED_WIDTH(uint16_t)
+MEMSPEED_WIDTH(uint32_t)
+MEMSPEED_WIDTH(uint64_t)
+
+static const struct {
+	const char *name;
+	unsigned int width;
+	uint32_t (*write)(void *addr, unsigned long size);
+	uint32_t (*read)(void *addr, unsigned long size);
+} memspeed_widths[] = {
+	{ "8-bit",  1, memspeed_write_uint8_t,  memspeed_read_uint8_t  },
+	{ "16-bit", 2, memspeed_write_uint16_t, memspeed_read_uint16_t },
+	{ "32-bit", 4, memspeed_write_uint32_t, memspeed_read_uint32_t },
+	{ "64-bit", 8, memspeed_write_uint64_t, memspeed_read_uint64_t },
+};
+
+/* Streaming accesses, unrolled on the native width */
+static uint32_t memspeed_fill(void *addr, unsigned long size)
+{
+	volatile unsigned long *array = addr;
+	unsigned long i;
+	uint64_t start = timing_cycles();
+	for (i = 0; i + 8 <= size/sizeof(unsigned long); i += 8) {
+		array[i + 0] = -1ul;
+		array[i + 1] = -1ul;
+		array[i + 2] = -1ul;
+		array[i + 3] = -1ul;
+		array[i + 4] = -1ul;
+		array[i + 5] = -1ul;
+		array[i + 6] = -1ul;
+		array[i + 7] = -1ul;
+	}
+	return timing_cycles() - start;
+}
+
+static uint32_t memspeed_stream_read(void *addr, unsigned long size)
+{
+	volatile unsigned long *array = addr;
+	unsigned long i;
+	unsigned long data = 0;
+	uint64_t start = timing_cycles();
+	for (i = 0; i + 8 <= size/sizeof(unsigned long); i += 8) {
+		data ^= array[i + 0];
+		data ^= array[i + 1];
+		data ^= array[i + 2];
+		data ^= array[i + 3];
+		data ^= array[i + 4];
+		data ^= array[i + 5];
+		data ^= array[i + 6];
+		data ^= array[i + 7];
+	}
+	array[0] = data;
+	return timing_cycles() - start;
+}
+
+static uint32_t memspeed_copy(void *dst, const void *src, unsigned long size)
+{
+	volatile unsigned long *d = dst;
+	volatile const unsigned long *s = src;
+	unsigned long i;
+	uint64_t start = timing_cycles();
+	for (i = 0; i + 8 <= size/sizeof(unsigned long); i += 8) {
+		d[i + 0] = s[i + 0];
+		d[i + 1] = s[i + 1];
+		d[i + 2] = s[i + 2];
+		d[i + 3] = s[i + 3];
+		d[i + 4] = s[i + 4];
+		d[i + 5] = s[i + 5];
+		d[i + 6] = s[i + 6];
+		d[i + 7] = s[i + 7];
+	}
+	return timing_cycles() - start;
+}
+
+/* Links the lines of the working set in a single random cycle (Sattolo) and follows it,
+   returns the average access time in 1/10 ns */
+static unsigned long memspeed_latency(void *addr, unsigned long size)
+{
+	unsigned long n = size/MEMSPEED_LINE_SIZE;
+	unsigned long i, j, tmp;
+	unsigned int seed = 1;
+	uint32_t ticks;
+	void **p;
+
+#define MEMSPEED_LINE(i) ((unsigned long *)((char *)addr + (i)*MEMSPEED_LINE_SIZE))
+	for (i = 0; i < n; i++)
+		*MEMSPEED_LINE(i) = i;
+	for (i = n - 1; i > 0; i--) {
+		seed = lfsr(32, seed);
+		j = seed % i;
+		tmp = *MEMSPEED_LINE(i);
+		*MEMSPEED_LINE(i) = *MEMSPEED_LINE(j);
+		*MEMSPEED_LINE(j) = tmp;
+	}
+	for (i = 0; i < n; i++)
+		*(void **) MEMSPEED_LINE(i) = MEMSPEED_LINE(*MEMSPEED_LINE(i));
+#undef MEMSPEED_LINE
+	memspeed_flush();
+
+	/* Warm up with one lap, then measure */
+	p = addr;
+	for (i = 0; i < n; i++)
+		p = *p;
+	ticks = timing_cycles();
+	for (i = 0; i < MEMSPEED_LATENCY_STEPS; i++)
+		p = *p;
+	ticks = timing_cycles() - ticks;
+	*(void * volatile *) addr = p;
+
+	return ((uint64_t)ticks)*10000000000ull/CONFIG_CLOCK_FREQUENCY/MEMSPEED_LATENCY_STEPS;
+}
+
+void memspeed_bench(unsigned int *addr, unsigned long size)
+{
+	unsigned long set;
+	unsigned long latency;
+	uint32_t ticks;
+	int i;
+
+	printf("Memory benchmark at %p (", addr);
+	print_size(size);
+	printf(")...\n");
+
+	/* Widths */
+	for (i = 0; i < sizeof(memspeed_widths)/sizeof(memspeed_widths[0]); i++) {
+		/* Up to the bus width (or the native width of the CPU) */
+		if (memspeed_widths[i].width > CONFIG_BUS_DATA_WIDTH/8 &&
+		    memspeed_widths[i].width > sizeof(unsigned long))
+			continue;
+		memspeed_flush();
+		printf("  %s accesses:\n", memspeed_widths[i].name);
+		memspeed_print("  Write:", size, memspeed_widths[i].write(addr, size));
+		memspeed_flush();
+		memspeed_print("  Read:", size, memspeed_widths[i].read(addr, size));
+	}
+
+	/* Streaming */
+	printf("  Streaming (%d-bit, unrolled):\n", (int) (8*sizeof(unsigned long)));
+	memspeed_flush();
+	memspeed_print("  Fill:", size, memspeed_fill(addr, size));
+	memspeed_flush();
+	memspeed_print("  Read:", size, memspeed_stream_read(addr, size));
+	memspeed_flush();
+	memspeed_print("  Copy:", size/2, memspeed_copy((char *)addr + size/2, addr, size/2));
+
+	/* Working set sweep */
+	printf("  Working set  Latency       Write (cold)   Write (resident)\n");
+	for (set = MEMSPEED_LATENCY_MIN_SIZE; set <= size; set *= 2) {
+		latency = memspeed_latency(addr, set);
+		printf("  ");
+		print_size(set);
+		printf("\t%5lu.%lu ns\t", latency/10, latency%10);
+		memspeed_flush();
+		ticks = memspeed_fill(addr, set);
+		if (ticks)
+			print_speed(((uint64_t)set)*CONFIG_CLOCK_FREQUENCY/ticks);
+		printf("\t");
+		memspeed_stream_read(addr, set);
+		ticks = memspeed_fill(addr, set);
+		if (ticks)
+			print_speed(((uint64_t)set)*CONFIG_CLOCK_FREQUENCY/ticks);
+		printf("\n");
+	}
+}
+
 int memtest(unsigned int *addr, unsigned long maxsize)
 {
 	int bus_errors, data_errors, addr_errors;
@@ -344,15 +943,159 @@ int memtest(unsigned int *addr, unsigned long maxsize)
 
 	bus_errors  = memtest_bus(addr, bus_size);
 	addr_errors = memtest_addr(addr, addr_size, MEMTEST_ADDR_RANDOM);
+#ifdef MEMTEST_MARCH
+	data_errors = memtest_march(addr, data_size, &memtest_march_c_minus, NULL);
+#else
 	data_errors = memtest_data(addr, data_size, MEMTEST_DATA_RANDOM, NULL);
+#endif
 
 	if(bus_errors + addr_errors + data_errors != 0) {
 		printf("  bus errors:  %d/%ld\n", bus_errors,  2*bus_size/4);
 		printf("  addr errors: %d/%ld\n", addr_errors, addr_size/4);
+#ifdef MEMTEST_MARCH
+		printf("  data errors: %d/%ld\n", data_errors, 5*data_size/sizeof(unsigned long));
+#else
 		printf("  data errors: %d/%ld\n", data_errors, data_size/4);
+#endif
+		printf("Memtest KO\n");
+		return 0;
+	}
+	printf("Memtest OK\n");
+	return 1;
+}
+
+#ifdef MEMTEST_SMP
+
+/* Multi-hart memtest/memspeed: the secondary harts (see smp.h) run the jobs on their partition
+   of the range. */
+
+enum {
+	MEMTEST_SMP_WRITE,
+	MEMTEST_SMP_VERIFY,
+	MEMTEST_SMP_FILL,
+	MEMTEST_SMP_READ,
+};
+
+static struct {
+	int op;
+	unsigned int *addr;
+	unsigned long size;
+	int random;
+	volatile int errors[CONFIG_CPU_COUNT];
+} memtest_smp_job;
+
+static void memtest_smp_run(int hart, int ncpus, void *arg)
+{
+	volatile unsigned long *array;
+	unsigned long chunk, n, i;
+	unsigned int seed_32, rdata;
+	int errors = 0;
+
+	/* Partition the range, the last hart gets the remainder. Each part starts
+	   at its offset of the sequence: the data is the one of memtest_data(). */
+	chunk = (memtest_smp_job.size/4)/ncpus;
+	n     = hart == ncpus - 1 ? memtest_smp_job.size/4 - hart*chunk : chunk;
+	array = (volatile unsigned long *)(memtest_smp_job.addr + hart*chunk);
+	seed_32 = seed_jump_32(1, hart*chunk, memtest_smp_job.random);
+
+	switch (memtest_smp_job.op) {
+	case MEMTEST_SMP_WRITE:
+		memtest_data_write_block((volatile unsigned int *) array, n, seed_32, memtest_smp_job.random);
+		break;
+	case MEMTEST_SMP_VERIFY:
+		flush_cpu_dcache();
+		for (i = 0; i < n;) {
+			i += memtest_data_verify_block((volatile unsigned int *) array + i, n - i, &seed_32, &rdata,
+				memtest_smp_job.random);
+			if (i < n) {
+				errors++;
+				i++;
+			}
+		}
+		break;
+	case MEMTEST_SMP_FILL:
+		for (i = 0; i < 4*n/sizeof(unsigned long); i++)
+			array[i] = -1ul;
+		break;
+	case MEMTEST_SMP_READ:
+		flush_cpu_dcache();
+		for (i = 0; i < 4*n/sizeof(unsigned long); i++)
+			rdata = array[i];
+		break;
+	}
+	memtest_smp_job.errors[hart] = errors;
+}
+
+/* Runs op on ncpus harts (hart 0 included), returns the elapsed timer ticks */
+static uint32_t memtest_smp_job_run(int op, int ncpus, unsigned int *addr, unsigned long size, int random)
+{
+	uint64_t start;
+	int hart;
+
+	memtest_smp_job.op     = op;
+	memtest_smp_job.addr   = addr;
+	memtest_smp_job.size   = size;
+	memtest_smp_job.random = random;
+	for (hart = 0; hart < CONFIG_CPU_COUNT; hart++)
+		memtest_smp_job.errors[hart] = 0;
+
+	start = timing_cycles();
+	smp_run(memtest_smp_run, NULL, ncpus);
+	return timing_cycles() - start;
+}
+
+int memtest_smp(unsigned int *addr, unsigned long size)
+{
+	int hart, errors;
+
+	printf("Memtest at %p (", addr);
+	print_size(size);
+	printf(") on %d CPUs...\n", CONFIG_CPU_COUNT);
+	if (!smp_start())
+		return 0;
+
+	memtest_smp_job_run(MEMTEST_SMP_WRITE, CONFIG_CPU_COUNT, addr, size, MEMTEST_DATA_RANDOM);
+	flush_cpu_dcache();
+	flush_l2_cache();
+	memtest_smp_job_run(MEMTEST_SMP_VERIFY, CONFIG_CPU_COUNT, addr, size, MEMTEST_DATA_RANDOM);
+
+	errors = 0;
+	for (hart = 0; hart < CONFIG_CPU_COUNT; hart++) {
+		if (memtest_smp_job.errors[hart])
+			printf("  CPU%d data errors: %d\n", hart, memtest_smp_job.errors[hart]);
+		errors += memtest_smp_job.errors[hart];
+	}
+	if (errors != 0) {
+		printf("  data errors: %d/%ld\n", errors, size/4);
 		printf("Memtest KO\n");
 		return 0;
 	}
 	printf("Memtest OK\n");
 	return 1;
 }
+
+void memspeed_smp(unsigned int *addr, unsigned long size)
+{
+	uint32_t ticks;
+	int ncpus;
+
+	printf("Memspeed at %p (", addr);
+	print_size(size);
+	printf(") on 1-%d CPUs...\n", CONFIG_CPU_COUNT);
+	if (!smp_start())
+		return;
+
+	for (ncpus = 1; ncpus <= CONFIG_CPU_COUNT; ncpus++) {
+		printf("  %d CPU(s):\n", ncpus);
+		flush_cpu_dcache();
+		flush_l2_cache();
+		ticks = memtest_smp_job_run(MEMTEST_SMP_FILL, ncpus, addr, size, 0);
+		memspeed_print("  Write:", size, ticks);
+		flush_cpu_dcache();
+		flush_l2_cache();
+		ticks = memtest_smp_job_run(MEMTEST_SMP_READ, ncpus, addr, size, 0);
+		memspeed_print("  Read:", size, ticks);
+	}
+}
+
+#endif /* MEMTEST_SMP */
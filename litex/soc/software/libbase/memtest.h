@@ -3,16 +3,21 @@
 
 #include <stdbool.h>
 
+#include <generated/soc.h>
+
+#include "smp.h"
+
 // Called when an error is encountered. Can return non-zero to stop the memtest.
 // `arg` can be used to pass arbitrary data to the callback via `memtest_config.arg`.
 typedef int (*on_error_callback)(unsigned int addr, unsigned int rdata, unsigned int refdata, void *arg);
 
-// Optional memtest configuration. If NULL, then we default to progress=1, read_only=0.
+// Optional memtest configuration. If NULL, then we default to progress=1, read_only=0, offset=0.
 struct memtest_config {
 	int show_progress;
 	int read_only;
 	on_error_callback on_error;
 	void *arg;
+	unsigned long offset; // Words of the data sequence before addr, to test a range in parts/resume.
 };
 
 int memtest_access(unsigned int *addr);
@@ -20,7 +25,58 @@ int memtest_bus(unsigned int *addr, unsigned long size);
 int memtest_addr(unsigned int *addr, unsigned long size, int random);
 int memtest_data(unsigned int *addr, unsigned long size, int random, struct memtest_config *config);
 
+// March tests: sequences of elements, each a read and/or a write of every word in an address order.
+#define MEMTEST_MARCH_UP   0
+#define MEMTEST_MARCH_DOWN 1
+
+#define MEMTEST_MARCH_NONE 0 // No read/write.
+#define MEMTEST_MARCH_0    1 // Background.
+#define MEMTEST_MARCH_1    2 // Complemented background.
+
+struct memtest_march_element {
+	unsigned char order;
+	unsigned char read;
+	unsigned char write;
+};
+
+struct memtest_march {
+	const char *name;
+	int nelements;
+	const struct memtest_march_element *elements;
+};
+
+extern const struct memtest_march memtest_march_c_minus;
+extern const struct memtest_march memtest_mats_plus;
+extern const struct memtest_march memtest_checkerboard;
+
+// Address orders of the elements (reversed when descending).
+#define MEMTEST_ORDER_LINEAR     0 // 0, 1, 2...
+#define MEMTEST_ORDER_COMPLEMENT 1 // 0, N-1, 1, N-2...
+#define MEMTEST_ORDER_STRIDE     2 // 0, s, 2s... 1, s+1, 2s+1...
+
+// March configuration. If NULL, then we default to linear, 0x55555555 background, progress=1.
+struct memtest_march_config {
+	int order;
+	unsigned long stride;      // Words, for MEMTEST_ORDER_STRIDE.
+	unsigned int background;   // Replicated to the bus width.
+	int checkerboard;          // Background complemented on the odd words.
+	int show_progress;
+	on_error_callback on_error;
+	void *arg;
+};
+
+int memtest_march(unsigned int *addr, unsigned long size, const struct memtest_march *algo,
+	const struct memtest_march_config *config);
+
 void memspeed(unsigned int *addr, unsigned long size, bool read_only, bool random);
+void memspeed_bench(unsigned int *addr, unsigned long size);
 int memtest(unsigned int *addr, unsigned long maxsize);
 
+// Multi-hart variants, partitioning the range across all the CPUs.
+#ifdef SMP_WORKERS
+#define MEMTEST_SMP
+int memtest_smp(unsigned int *addr, unsigned long size);
+void memspeed_smp(unsigned int *addr, unsigned long size);
+#endif
+
 #endif /* __MEMTEST_H */
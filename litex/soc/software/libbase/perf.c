@@ -0,0 +1,115 @@
+#include "perf.h"
+
+#include <stdio.h>
+
+#include <system.h>
+
+#include "timing.h"
+
+#if defined(PERF_COUNTERS) && defined(__riscv)
+#define PERF_CPU_COUNTERS
+#endif
+
+#if !defined(PERF_CPU_COUNTERS) || !defined(PERF_HPM_COUNT)
+#undef  PERF_HPM_COUNT
+#define PERF_HPM_COUNT 0
+#endif
+
+#ifdef PERF_CPU_COUNTERS
+
+/* 64-bit counter, re-read on RV32 when the low word wrapped between reads */
+#if __riscv_xlen == 32
+#define perf_counter(name) ({ uint32_t __hi, __lo, __hi2; \
+	do { \
+		__asm__ volatile("csrr %0, " #name "h" : "=r"(__hi)); \
+		__asm__ volatile("csrr %0, " #name     : "=r"(__lo)); \
+		__asm__ volatile("csrr %0, " #name "h" : "=r"(__hi2)); \
+	} while (__hi != __hi2); \
+	((uint64_t)__hi << 32) | __lo; })
+#else
+#define perf_counter(name) ({ uint64_t __v; \
+	__asm__ volatile("csrr %0, " #name : "=r"(__v)); __v; })
+#endif
+
+static const char *const perf_hpm_names[] = {
+#ifdef PERF_HPM3_NAME
+	PERF_HPM3_NAME,
+#endif
+#ifdef PERF_HPM4_NAME
+	PERF_HPM4_NAME,
+#endif
+};
+
+#endif
+
+int perf_init(void)
+{
+#ifdef PERF_CPU_COUNTERS
+#ifdef PERF_MCOUNTINHIBIT
+	__asm__ volatile("csrw 0x320, zero"); /* mcountinhibit */
+#endif
+#ifdef PERF_HPM3_EVENT
+	__asm__ volatile("csrw mhpmevent3, %0" :: "r"(PERF_HPM3_EVENT));
+#endif
+#ifdef PERF_HPM4_EVENT
+	__asm__ volatile("csrw mhpmevent4, %0" :: "r"(PERF_HPM4_EVENT));
+#endif
+#endif
+	return PERF_HPM_COUNT;
+}
+
+void perf_read(struct perf_sample *s)
+{
+	int i;
+
+	for (i = 0; i < PERF_HPM_MAX; i++)
+		s->hpm[i] = 0;
+	s->instret = 0;
+#ifdef PERF_CPU_COUNTERS
+#if PERF_HPM_COUNT > 0
+	s->hpm[0] = perf_counter(mhpmcounter3);
+#endif
+#if PERF_HPM_COUNT > 1
+	s->hpm[1] = perf_counter(mhpmcounter4);
+#endif
+	s->instret = perf_counter(minstret);
+#endif
+	s->cycles = timing_cycles();
+}
+
+/* Integer ratio with 3 decimals */
+static void perf_print_ratio(uint64_t num, uint64_t den)
+{
+	uint64_t r;
+
+	if (den == 0)
+		den = 1;
+	r = num*1000/den;
+	printf("%lu.%03lu", (unsigned long)(r/1000), (unsigned long)(r % 1000));
+}
+
+void perf_print(const struct perf_sample *start, const struct perf_sample *end)
+{
+	uint64_t cycles = end->cycles - start->cycles;
+	uint64_t instret = end->instret - start->instret;
+	int i;
+
+	printf("%-22s %12lu (%lu us)\n", "cycles", (unsigned long)cycles,
+		(unsigned long)(timing_cycles_to_ns(cycles)/1000));
+#ifdef PERF_CPU_COUNTERS
+	printf("%-22s %12lu (IPC ", "instret", (unsigned long)instret);
+	perf_print_ratio(instret, cycles);
+	printf(")\n");
+	for (i = 0; i < PERF_HPM_COUNT; i++) {
+		uint64_t n = end->hpm[i] - start->hpm[i];
+
+		printf("%-22s %12lu (", perf_hpm_names[i], (unsigned long)n);
+		perf_print_ratio(n*1000, instret);
+		printf(" per 1k instr)\n");
+	}
+#else
+	(void)instret;
+	(void)i;
+	printf("(build with -DPERF_COUNTERS for instructions and CPU events)\n");
+#endif
+}
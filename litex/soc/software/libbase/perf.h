@@ -0,0 +1,34 @@
+#ifndef __PERF_H
+#define __PERF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * CPU performance counters around a piece of code. Cycles always come from
+ * timing_cycles(). Retired instructions and the events of the core
+ * (PERF_HPM* in the csr-defs.h of the CPU: cache misses, stalls) are read
+ * when built with -DPERF_COUNTERS on RISC-V: the counters are optional in
+ * most cores and reading absent ones traps.
+ */
+#define PERF_HPM_MAX 4
+
+struct perf_sample {
+	uint64_t cycles;
+	uint64_t instret;
+	uint64_t hpm[PERF_HPM_MAX];
+};
+
+/* Number of hpm events read, 0 without -DPERF_COUNTERS */
+int perf_init(void);
+void perf_read(struct perf_sample *s);
+void perf_print(const struct perf_sample *start, const struct perf_sample *end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PERF_H */
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <system.h>
+
+#include <generated/soc.h>
+#include <generated/csr.h>
+
+#include "smp.h"
+
+#ifdef SMP_WORKERS
+
+#ifndef SMP_STACK_SHIFT
+#define SMP_STACK_SHIFT 8 /* 256 bytes per secondary hart */
+#endif
+
+#define _SMP_STR(x) #x
+#define SMP_STR(x) _SMP_STR(x)
+
+/* Park loop of the secondary harts (crt0.S): they jump to the target with
+   the args once the flag is set, by boot_helper or smp_start() */
+#ifdef CONFIG_CPU_TYPE_ROCKET
+extern volatile unsigned long smp_ap_target;
+extern volatile unsigned long smp_ap_ready;
+extern volatile unsigned long smp_ap_args[3];
+#define smp_release_target smp_ap_target
+#define smp_release_flag   smp_ap_ready
+#define smp_release_args   smp_ap_args
+#else
+extern volatile unsigned long smp_lottery_target;
+extern volatile unsigned long smp_lottery_lock;
+extern volatile unsigned long smp_lottery_args[3];
+#define smp_release_target smp_lottery_target
+#define smp_release_flag   smp_lottery_lock
+#define smp_release_args   smp_lottery_args
+#endif
+
+unsigned char smp_stacks[CONFIG_CPU_COUNT - 1][1 << SMP_STACK_SHIFT] __attribute__((aligned(16)));
+
+static struct {
+	volatile int seq;
+	volatile int ncpus;
+	volatile smp_job_fn fn;
+	void * volatile arg;
+	volatile int ready[CONFIG_CPU_COUNT];
+	volatile int done[CONFIG_CPU_COUNT];
+} smp_job;
+
+static int smp_started;
+
+void smp_entry(void);
+void __attribute__((noreturn)) smp_worker(void);
+
+/* Secondary harts entry: hart n uses the stack slot n-1 */
+__asm__(
+	".section .text\n"
+	".global smp_entry\n"
+	"smp_entry:\n"
+	"  csrr t0, mhartid\n"
+	"  slli t0, t0, " SMP_STR(SMP_STACK_SHIFT) "\n"
+	"  la sp, smp_stacks\n"
+	"  add sp, sp, t0\n"
+	"  j smp_worker\n"
+);
+
+void __attribute__((noreturn)) smp_worker(void)
+{
+	int hart = csrr(mhartid);
+	int seq = 0;
+
+	/* Check in, then wait for hart 0 to park the others again */
+	smp_job.ready[hart] = 1;
+	while (smp_release_flag != 0);
+
+	while (1) {
+		/* Released by boot_helper: proceed as the park loop does */
+		if (smp_release_flag != 0) {
+			__asm__ volatile("fence r, r");
+#ifdef CONFIG_CPU_TYPE_ROCKET
+			__asm__ volatile("fence.i");
+#else
+			flush_cpu_icache();
+#endif
+			((void (*)(unsigned long, unsigned long, unsigned long)) smp_release_target)(
+				smp_release_args[0], smp_release_args[1], smp_release_args[2]);
+		}
+		if (smp_job.seq != seq) {
+			seq = smp_job.seq;
+			if (hart < smp_job.ncpus)
+				smp_job.fn(hart, smp_job.ncpus, smp_job.arg);
+			__asm__ volatile("fence w, w");
+			smp_job.done[hart] = seq;
+		}
+	}
+}
+
+int smp_start(void)
+{
+	int hart, timeout;
+
+	if (smp_started)
+		return 1;
+
+	smp_release_target = (unsigned long) smp_entry;
+	__asm__ volatile("fence w, w");
+	smp_release_flag = 1;
+	for (timeout = 0; timeout < 1000; timeout++) {
+		for (hart = 1; hart < CONFIG_CPU_COUNT; hart++)
+			if (!smp_job.ready[hart])
+				break;
+		if (hart == CONFIG_CPU_COUNT)
+			break;
+		busy_wait(1);
+	}
+	smp_release_flag = 0;
+	if (timeout == 1000) {
+		printf("Secondary CPUs not responding.\n");
+		return 0;
+	}
+	smp_started = 1;
+	return 1;
+}
+
+void smp_run(smp_job_fn fn, void *arg, int ncpus)
+{
+	int hart, seq;
+
+	smp_job.fn    = fn;
+	smp_job.arg   = arg;
+	smp_job.ncpus = ncpus;
+	__asm__ volatile("fence w, w");
+
+	seq = smp_job.seq + 1;
+	smp_job.seq = seq;
+	fn(0, ncpus, arg);
+	for (hart = 1; hart < CONFIG_CPU_COUNT; hart++)
+		while (smp_job.done[hart] != seq);
+	__asm__ volatile("fence r, r");
+}
+
+#endif /* SMP_WORKERS */
@@ -0,0 +1,29 @@
+#ifndef __SMP_H
+#define __SMP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <generated/soc.h>
+
+/* Secondary harts of multi-core CPUs running jobs for the BIOS: released
+ * from the boot park loop of crt0.S into a worker loop, which still hands
+ * them over to the program a later boot() starts. */
+#if defined(CONFIG_CPU_COUNT) && (CONFIG_CPU_COUNT > 1) && \
+	(defined(CONFIG_CPU_TYPE_VEXRISCV_SMP) || defined(CONFIG_CPU_TYPE_ROCKET))
+#define SMP_WORKERS
+
+typedef void (*smp_job_fn)(int hart, int ncpus, void *arg);
+
+/* Returns 1 once the secondary harts wait for jobs, 0 if they don't respond */
+int smp_start(void);
+/* Runs fn on harts 0 (the caller) to ncpus-1, returns when all are done */
+void smp_run(smp_job_fn fn, void *arg, int ncpus);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SMP_H */
@@ -1,8 +1,13 @@
-#include <generated/csr.h>
+#include <string.h>
+#include <system.h>
 
-#if (defined CSR_SPIFLASH_BASE && defined SPIFLASH_PAGE_SIZE)
+#include <generated/csr.h>
+#include <generated/mem.h>
 
 #include "spiflash.h"
+#include "task.h"
+
+#if (defined CSR_SPIFLASH_BASE && defined SPIFLASH_PAGE_SIZE)
 
 #define PAGE_PROGRAM_CMD 0x02
 #define WRDI_CMD         0x04
@@ -10,6 +15,7 @@
 #define WREN_CMD         0x06
 #define CE_CMD           0xc7
 #define SE_CMD           0xd8
+#define SE_4K_CMD        0x20
 
 #define BITBANG_CLK         (1 << 1)
 #define BITBANG_CS_N        (1 << 2)
@@ -17,12 +23,15 @@
 
 #define SR_WIP              1
 
+/* Erase sizes: 4KB sectors, SPIFLASH_SECTOR_SIZE blocks (SE_CMD) */
+#define FLASH_PAGE_SIZE     SPIFLASH_PAGE_SIZE
+#define FLASH_SECTOR_SIZE   4096
+#define FLASH_BLOCK_SIZE    SPIFLASH_SECTOR_SIZE
+
 static void flash_write_byte(unsigned char b);
 static void flash_write_addr(unsigned int addr);
 static void wait_for_device_ready(void);
 
-#define min(a,b)  (a>b?b:a)
-
 static void flash_write_byte(unsigned char b)
 {
     int i;
@@ -51,23 +60,64 @@ static void flash_write_addr(unsigned int addr)
     spiflash_bitbang_write(0);
 }
 
-static void wait_for_device_ready(void)
+static int flash_busy(void)
 {
     unsigned char sr;
     unsigned char i;
-    do {
-        sr = 0;
-        flash_write_byte(RDSR_CMD);
-        spiflash_bitbang_write(BITBANG_DQ_INPUT);
-        for(i = 0; i < 8; i++) {
-            sr <<= 1;
-            spiflash_bitbang_write(BITBANG_CLK | BITBANG_DQ_INPUT);
-            sr |= spiflash_miso_read();
-            spiflash_bitbang_write(0           | BITBANG_DQ_INPUT);
-        }
-        spiflash_bitbang_write(0);
-        spiflash_bitbang_write(BITBANG_CS_N);
-    } while(sr & SR_WIP);
+
+    spiflash_bitbang_en_write(1);
+    sr = 0;
+    flash_write_byte(RDSR_CMD);
+    spiflash_bitbang_write(BITBANG_DQ_INPUT);
+    for(i = 0; i < 8; i++) {
+        sr <<= 1;
+        spiflash_bitbang_write(BITBANG_CLK | BITBANG_DQ_INPUT);
+        sr |= spiflash_miso_read();
+        spiflash_bitbang_write(0           | BITBANG_DQ_INPUT);
+    }
+    spiflash_bitbang_write(0);
+    spiflash_bitbang_write(BITBANG_CS_N);
+    return sr & SR_WIP;
+}
+
+static void wait_for_device_ready(void)
+{
+    while(flash_busy())
+        task_yield();
+}
+
+/* Flash idle, back in memory-mapped mode */
+static void flash_wait(void)
+{
+    wait_for_device_ready();
+    spiflash_bitbang_en_write(0);
+}
+
+static void flash_erase_start(unsigned int addr, unsigned int size)
+{
+    spiflash_bitbang_en_write(1);
+
+    flash_write_byte(WREN_CMD);
+    spiflash_bitbang_write(BITBANG_CS_N);
+
+    flash_write_byte((size == FLASH_SECTOR_SIZE) ? SE_4K_CMD : SE_CMD);
+    flash_write_addr(addr);
+    spiflash_bitbang_write(BITBANG_CS_N);
+}
+
+static void flash_program_start(unsigned int addr, const unsigned char *c, unsigned int len)
+{
+    spiflash_bitbang_en_write(1);
+
+    flash_write_byte(WREN_CMD);
+    spiflash_bitbang_write(BITBANG_CS_N);
+    flash_write_byte(PAGE_PROGRAM_CMD);
+    flash_write_addr(addr);
+    while(len--)
+        flash_write_byte(*c++);
+
+    spiflash_bitbang_write(BITBANG_CS_N);
+    spiflash_bitbang_write(0);
 }
 
 void erase_flash_sector(unsigned int addr)
@@ -109,8 +159,6 @@ void erase_flash(void)
 
 void write_to_flash_page(unsigned int addr, const unsigned char *c, unsigned int len)
 {
-    unsigned int i;
-
     if(len > SPIFLASH_PAGE_SIZE)
         len = SPIFLASH_PAGE_SIZE;
 
@@ -118,42 +166,188 @@ void write_to_flash_page(unsigned int addr, const unsigned char *c, unsigned int
 
     wait_for_device_ready();
 
-    flash_write_byte(WREN_CMD);
-    spiflash_bitbang_write(BITBANG_CS_N);
-    flash_write_byte(PAGE_PROGRAM_CMD);
-    flash_write_addr((unsigned int)addr);
-    for(i = 0; i < len; i++)
-        flash_write_byte(*c++);
-
-    spiflash_bitbang_write(BITBANG_CS_N);
-    spiflash_bitbang_write(0);
+    flash_program_start(addr, c, len);
 
     wait_for_device_ready();
 
     spiflash_bitbang_en_write(0);
 }
 
-#define SPIFLASH_PAGE_MASK (SPIFLASH_PAGE_SIZE - 1)
+#elif defined(CSR_SPIFLASH_CORE_MASTER_CS_ADDR)
+
+/* LiteSPI core: programmed/erased through the master interface (liblitespi) */
+#include <liblitespi/spiflash.h>
+
+#define FLASH_PAGE_SIZE     SPIFLASH_MODULE_PAGE_SIZE
+#define FLASH_SECTOR_SIZE   SPI_FLASH_SECTOR_SIZE
+#define FLASH_BLOCK_SIZE    SPI_FLASH_ERASE_BLOCK_SIZE
+
+static void flash_wait(void)
+{
+    while(spiflash_busy())
+        task_yield();
+}
+
+static void flash_erase_start(unsigned int addr, unsigned int size)
+{
+    if(size == FLASH_BLOCK_SIZE)
+        spiflash_erase_block_start(addr);
+    else
+        spiflash_erase_sector_start(addr);
+}
+
+static void flash_program_start(unsigned int addr, const unsigned char *c, unsigned int len)
+{
+    spiflash_program_start(addr, c, len);
+}
+
+void erase_flash_sector(unsigned int addr)
+{
+    spiflash_erase_sector(addr & ~(FLASH_SECTOR_SIZE - 1));
+}
+
+void write_to_flash_page(unsigned int addr, const unsigned char *c, unsigned int len)
+{
+    if(len > FLASH_PAGE_SIZE)
+        len = FLASH_PAGE_SIZE;
+    flash_wait();
+    flash_program_start(addr, c, len);
+    flash_wait();
+}
+
+#endif
+
+#ifdef FLASH_PAGE_SIZE
+
+#define FLASH_PAGE_MASK (FLASH_PAGE_SIZE - 1)
+
+/* Pages of the data left erased (all 0xff) need no programming */
+static int flash_data_erased(const unsigned char *c, unsigned int len)
+{
+    while(len--)
+        if(*c++ != 0xff)
+            return 0;
+    return 1;
+}
+
+/* Length of the first page of [addr, addr + len) */
+static unsigned int flash_page_length(unsigned int addr, unsigned int len)
+{
+    unsigned int n = FLASH_PAGE_SIZE - (addr & FLASH_PAGE_MASK);
+    return (n < len) ? n : len;
+}
+
+/* Programs an erased area: the next page to program is looked for while
+   the flash programs the previous one */
+static void flash_program(unsigned int addr, const unsigned char *c, unsigned int len)
+{
+    unsigned int n;
+
+    while(len > 0) {
+        n = flash_page_length(addr, len);
+        if(!flash_data_erased(c, n)) {
+            flash_wait();
+            flash_program_start(addr, c, n);
+        }
+        c += n;
+        addr += n;
+        len -= n;
+    }
+}
 
 void write_to_flash(unsigned int addr, const unsigned char *c, unsigned int len)
 {
-   unsigned int written = 0;
+    flash_wait();
+    flash_program(addr, c, len);
+    flash_wait();
+    flush_cpu_dcache();
+}
+
+#ifdef SPIFLASH_BASE
 
-   if(addr & SPIFLASH_PAGE_MASK) {
-       written = min(SPIFLASH_PAGE_SIZE - (addr & SPIFLASH_PAGE_MASK), len);
-       write_to_flash_page(addr, c, written);
-       c += written;
-       addr += written;
-       len -= written;
-   }
+#define FLASH_IDENTICAL 0
+#define FLASH_PROGRAM   1 /* Only bits to clear: programmed over */
+#define FLASH_ERASE     2
 
-   while(len > 0) {
-       written = min(len, SPIFLASH_PAGE_SIZE);
-       write_to_flash_page(addr, c, written);
-       c += written;
-       addr += written;
-       len -= written;
-   }
+/* Compares the data with the flash contents (flash idle) */
+static int flash_compare(unsigned int addr, const unsigned char *c, unsigned int len)
+{
+    const unsigned char *f = (const unsigned char *)(SPIFLASH_BASE + addr);
+    int state = FLASH_IDENTICAL;
+
+    for(; len > 0; len--, f++, c++) {
+        if(*f == *c)
+            continue;
+        if((*f & *c) != *c)
+            return FLASH_ERASE;
+        state = FLASH_PROGRAM;
+    }
+    return state;
+}
+
+/* One block erase when at least a quarter of its sectors need erasing */
+static int flash_block_erase(unsigned int addr, const unsigned char *c)
+{
+    unsigned int i;
+    unsigned int n = 0;
+
+    for(i = 0; i < FLASH_BLOCK_SIZE; i += FLASH_SECTOR_SIZE)
+        if(flash_compare(addr + i, c + i, FLASH_SECTOR_SIZE) == FLASH_ERASE)
+            n++;
+    return n && (4*n >= FLASH_BLOCK_SIZE/FLASH_SECTOR_SIZE);
 }
 
-#endif /* CSR_SPIFLASH_BASE && SPIFLASH_PAGE_SIZE */
+/* Writes len bytes at addr with the least erasing and programming: the
+   sectors already holding the data are skipped, the ones needing only
+   bits cleared are programmed over (their identical pages skipped), the
+   others erased (whole blocks when most of a block is rewritten). Sectors
+   are erased whole: the rest of a partially written one is left erased.
+   Returns 0 when the flash verifies. */
+int update_flash(unsigned int addr, const unsigned char *c, unsigned int len)
+{
+    const unsigned char *data = c;
+    unsigned int start = addr;
+    unsigned int end = addr + len;
+    unsigned int n, i, m;
+
+    flash_wait();
+    flush_cpu_dcache();
+    while(addr < end) {
+        /* Whole block */
+        if(((addr & (FLASH_BLOCK_SIZE - 1)) == 0) && (end - addr >= FLASH_BLOCK_SIZE) &&
+           (FLASH_BLOCK_SIZE > FLASH_SECTOR_SIZE) && flash_block_erase(addr, c)) {
+            flash_erase_start(addr, FLASH_BLOCK_SIZE);
+            flash_program(addr, c, FLASH_BLOCK_SIZE);
+            n = FLASH_BLOCK_SIZE;
+        } else {
+            n = FLASH_SECTOR_SIZE - (addr & (FLASH_SECTOR_SIZE - 1));
+            if(n > end - addr)
+                n = end - addr;
+            switch(flash_compare(addr, c, n)) {
+            case FLASH_ERASE:
+                flash_erase_start(addr & ~(FLASH_SECTOR_SIZE - 1), FLASH_SECTOR_SIZE);
+                flash_program(addr, c, n);
+                break;
+            case FLASH_PROGRAM:
+                /* Compared page by page, the flash idle */
+                for(i = 0; i < n; i += m) {
+                    m = flash_page_length(addr + i, n - i);
+                    flash_wait();
+                    if(flash_compare(addr + i, c + i, m) != FLASH_IDENTICAL)
+                        flash_program_start(addr + i, c + i, m);
+                }
+                break;
+            }
+        }
+        /* Flash idle (memory-mapped) before the next comparison */
+        flash_wait();
+        flush_cpu_dcache();
+        c += n;
+        addr += n;
+    }
+    return memcmp((const void *)(SPIFLASH_BASE + start), data, len) ? -1 : 0;
+}
+
+#endif /* SPIFLASH_BASE */
+
+#endif /* FLASH_PAGE_SIZE */
@@ -5,5 +5,6 @@ void write_to_flash_page(unsigned int addr, const unsigned char *c, unsigned int
 void erase_flash_sector(unsigned int addr);
 void erase_flash(void);
 void write_to_flash(unsigned int addr, const unsigned char *c, unsigned int len);
+int update_flash(unsigned int addr, const unsigned char *c, unsigned int len);
 
 #endif /* __SPIFLASH_H */
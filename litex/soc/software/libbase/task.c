@@ -0,0 +1,101 @@
+#include "task.h"
+
+#include <stddef.h>
+
+#include <generated/soc.h>
+
+#include "timing.h"
+
+static struct task *task_list;
+static int task_depth;
+
+void task_start(struct task *t, const char *name, task_func func, void *arg)
+{
+	struct task **p;
+
+	/* Restarting a task resets it */
+	task_cancel(t);
+	t->name    = name;
+	t->func    = func;
+	t->arg     = arg;
+	t->resume  = 0;
+	t->wake    = 0;
+	t->running = 0;
+	t->next    = NULL;
+	for (p = &task_list; *p; p = &(*p)->next);
+	*p = t;
+}
+
+void task_cancel(struct task *t)
+{
+	struct task **p;
+
+	for (p = &task_list; *p; p = &(*p)->next) {
+		if (*p == t) {
+			*p = t->next;
+			return;
+		}
+	}
+}
+
+int task_active(const struct task *t)
+{
+	const struct task *i;
+
+	for (i = task_list; i; i = i->next)
+		if (i == t)
+			return 1;
+	return 0;
+}
+
+int task_poll(void)
+{
+	struct task *t, *next;
+	int done, left;
+
+	if (task_depth >= TASK_MAX_DEPTH)
+		return -1;
+	task_depth++;
+	for (t = task_list; t; t = next) {
+		/* Tasks waiting in a driver (they yielded to us) are skipped */
+		if (t->running) {
+			next = t->next;
+			continue;
+		}
+		t->running = 1;
+		done = t->func(t) == TASK_DONE;
+		t->running = 0;
+		/* Read after the call, the task may have started/cancelled others */
+		next = t->next;
+		if (done)
+			task_cancel(t);
+	}
+	task_depth--;
+
+	left = 0;
+	for (t = task_list; t; t = t->next)
+		left++;
+	return left;
+}
+
+void task_run(void)
+{
+	while (task_list)
+		task_poll();
+}
+
+void task_yield(void)
+{
+	if (task_list)
+		task_poll();
+}
+
+uint64_t task_deadline(unsigned int us)
+{
+	return timing_cycles() + (uint64_t)us*(CONFIG_CLOCK_FREQUENCY/1000000);
+}
+
+int task_expired(uint64_t deadline)
+{
+	return (int64_t)(timing_cycles() - deadline) >= 0;
+}
@@ -0,0 +1,77 @@
+#ifndef __TASK_H
+#define __TASK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Cooperative tasks: stackless (protothread-like) poll functions, run in a
+ * round-robin by task_run()/task_poll() and by task_yield(), which drivers
+ * call while they wait on their hardware. A task body is a switch on its
+ * resume point, locals do not survive a TASK_YIELD/TASK_WAIT: keep the state
+ * in the task argument.
+ *
+ *   static int prefetch(struct task *t)
+ *   {
+ *       struct prefetch_state *s = t->arg;
+ *       TASK_BEGIN(t);
+ *       s->ticket = sdcard_read_submit(s->block, s->count, s->buf);
+ *       TASK_WAIT(t, sdcard_done(s->ticket));
+ *       TASK_END(t);
+ *   }
+ *
+ * Tasks polled from task_yield() run on the stack of the waiting code,
+ * nesting is bounded by TASK_MAX_DEPTH. A task must not use a driver that a
+ * waiting task (the one yielding) is in the middle of.
+ */
+
+#define TASK_PENDING 0
+#define TASK_DONE    1
+
+struct task;
+typedef int (*task_func)(struct task *t);
+
+struct task {
+	const char *name;
+	task_func func;
+	void *arg;
+	unsigned int resume;
+	uint64_t wake;
+	int running;
+	struct task *next;
+};
+
+#define TASK_BEGIN(t)  switch ((t)->resume) { case 0:
+#define TASK_END(t)    } (t)->resume = 0; return TASK_DONE
+#define TASK_YIELD(t)  do { (t)->resume = __LINE__; return TASK_PENDING; case __LINE__:; } while (0)
+#define TASK_WAIT(t, cond) \
+	do { (t)->resume = __LINE__; case __LINE__: if (!(cond)) return TASK_PENDING; } while (0)
+#define TASK_SLEEP_US(t, us) \
+	do { (t)->wake = task_deadline(us); TASK_WAIT(t, task_expired((t)->wake)); } while (0)
+
+#ifndef TASK_MAX_DEPTH
+#define TASK_MAX_DEPTH 2
+#endif
+
+void task_start(struct task *t, const char *name, task_func func, void *arg);
+void task_cancel(struct task *t);
+int task_active(const struct task *t);
+
+/* Polls each idle task once, returns the number of tasks left */
+int task_poll(void);
+/* Polls until all the tasks are done */
+void task_run(void);
+/* For drivers waiting on their hardware: lets the other tasks progress */
+void task_yield(void);
+
+uint64_t task_deadline(unsigned int us);
+int task_expired(uint64_t deadline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TASK_H */
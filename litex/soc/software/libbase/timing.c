@@ -0,0 +1,113 @@
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <generated/csr.h>
+
+#if defined(TIMING_CPU_CYCLES) && defined(__riscv)
+
+uint64_t timing_cycles(void)
+{
+#if __riscv_xlen == 32
+	uint32_t hi, lo, hi2;
+
+	/* Re-read when the low word wrapped between the reads */
+	do {
+		__asm__ volatile("csrr %0, mcycleh" : "=r"(hi));
+		__asm__ volatile("csrr %0, mcycle"  : "=r"(lo));
+		__asm__ volatile("csrr %0, mcycleh" : "=r"(hi2));
+	} while (hi != hi2);
+	return ((uint64_t)hi << 32) | lo;
+#else
+	uint64_t cycles;
+
+	__asm__ volatile("csrr %0, mcycle" : "=r"(cycles));
+	return cycles;
+#endif
+}
+
+#elif defined(CSR_TIMER0_UPTIME_CYCLES_ADDR)
+
+uint64_t timing_cycles(void)
+{
+	timer0_uptime_latch_write(1);
+	return timer0_uptime_cycles_read();
+}
+
+#elif defined(CSR_TIMER0_BASE)
+
+static bool timing_armed;
+static uint32_t timing_last;
+static uint64_t timing_total;
+
+static void timing_timer0_arm(void)
+{
+	timer0_en_write(0);
+	timer0_reload_write(0xffffffff);
+	timer0_load_write(0xffffffff);
+	timer0_en_write(1);
+	timer0_update_value_write(1);
+	timing_last  = timer0_value_read();
+	timing_armed = true;
+}
+
+uint64_t timing_cycles(void)
+{
+	uint32_t now;
+
+	if (!timing_armed || timer0_reload_read() != 0xffffffff || !timer0_en_read())
+		timing_timer0_arm();
+	timer0_update_value_write(1);
+	now = timer0_value_read();
+	timing_total += (uint32_t)(timing_last - now);
+	timing_last   = now;
+	return timing_total;
+}
+
+#else
+#error "libbase/timing requires timer0 (or -DTIMING_CPU_CYCLES)"
+#endif
+
+void timing_delay_cycles(uint64_t cycles)
+{
+	uint64_t start = timing_cycles();
+
+#if defined(CSR_SIM_IDLE_BASE) && !defined(TIMING_CPU_CYCLES)
+	/* timer0 counts the cycles the simulator skips while idle */
+	sim_idle_cycles_write(cycles < 0xffffffff ? cycles : 0xffffffff);
+	sim_idle_idle_write(1);
+#endif
+	while (timing_cycles() - start < cycles);
+#if defined(CSR_SIM_IDLE_BASE) && !defined(TIMING_CPU_CYCLES)
+	sim_idle_idle_write(0);
+	sim_idle_cycles_write(0);
+#endif
+}
+
+uint64_t timing_scope_end(struct timing_scope *s)
+{
+	uint64_t cycles = timing_cycles() - s->start;
+
+	s->total += cycles;
+	if (cycles < s->min)
+		s->min = cycles;
+	if (cycles > s->max)
+		s->max = cycles;
+	s->count++;
+	return cycles;
+}
+
+void timing_scope_print(const struct timing_scope *s)
+{
+	if (s->count == 0) {
+		printf("%s: -\n", s->name);
+		return;
+	}
+	printf("%s: %u calls, total %lu us, min/avg/max %lu/%lu/%lu ns\n",
+		s->name, s->count,
+		(unsigned long)(timing_cycles_to_ns(s->total)/1000),
+		(unsigned long)timing_cycles_to_ns(s->min),
+		(unsigned long)timing_cycles_to_ns(s->total/s->count),
+		(unsigned long)timing_cycles_to_ns(s->max));
+}
@@ -0,0 +1,54 @@
+#ifndef __TIMING_H
+#define __TIMING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include <generated/soc.h>
+
+/*
+ * Monotonic sys_clk cycle counter, in order of preference:
+ * - the CPU cycle counter (mcycle) when built with -DTIMING_CPU_CYCLES (the
+ *   counter is optional in most RISC-V cores, reading it would trap otherwise),
+ * - the uptime counter of timer0 (--timer-uptime),
+ * - timer0 running free, extended to 64-bit in software (timer0 is re-armed
+ *   if code reprograms it, elapsed time is then lost).
+ * Nothing is shared between measurements: timings nest freely.
+ */
+uint64_t timing_cycles(void);
+
+static inline uint64_t timing_cycles_to_ns(uint64_t cycles)
+{
+	return (cycles/CONFIG_CLOCK_FREQUENCY)*1000000000ull +
+		(cycles % CONFIG_CLOCK_FREQUENCY)*1000000000ull/CONFIG_CLOCK_FREQUENCY;
+}
+
+static inline uint64_t time_ns(void) { return timing_cycles_to_ns(timing_cycles()); }
+static inline uint64_t time_us(void) { return time_ns()/1000; }
+
+void timing_delay_cycles(uint64_t cycles);
+
+/* Profiling scope: accumulates the duration of begin/end pairs */
+struct timing_scope {
+	const char *name;
+	uint64_t start;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	unsigned int count;
+};
+
+#define TIMING_SCOPE_INIT(_name) { .name = (_name), .min = UINT64_MAX }
+
+static inline void timing_scope_begin(struct timing_scope *s) { s->start = timing_cycles(); }
+uint64_t timing_scope_end(struct timing_scope *s);
+void timing_scope_print(const struct timing_scope *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TIMING_H */
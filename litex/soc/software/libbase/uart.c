@@ -1,28 +1,41 @@
 #include "uart.h"
 
+#include <stddef.h>
 #include <irq.h>
 #include <generated/csr.h>
 
+#include "isr.h"
+
 #ifdef CSR_UART_BASE
 
 /*
  * Buffer sizes must be a power of 2 so that modulos can be computed
- * with logical AND.
+ * with logical AND. They can be overridden at build time (-DUART_RINGBUFFER_SIZE_TX=1024).
  */
 
 //#define UART_POLLING
 
 #ifndef UART_POLLING
 
+#ifndef UART_RINGBUFFER_SIZE_RX
 #define UART_RINGBUFFER_SIZE_RX 128
+#endif
 #define UART_RINGBUFFER_MASK_RX (UART_RINGBUFFER_SIZE_RX-1)
+#if (UART_RINGBUFFER_SIZE_RX & UART_RINGBUFFER_MASK_RX) != 0
+#error "UART_RINGBUFFER_SIZE_RX must be a power of 2"
+#endif
 
 static char rx_buf[UART_RINGBUFFER_SIZE_RX];
 static volatile unsigned int rx_produce;
 static unsigned int rx_consume;
 
+#ifndef UART_RINGBUFFER_SIZE_TX
 #define UART_RINGBUFFER_SIZE_TX 128
+#endif
 #define UART_RINGBUFFER_MASK_TX (UART_RINGBUFFER_SIZE_TX-1)
+#if (UART_RINGBUFFER_SIZE_TX & UART_RINGBUFFER_MASK_TX) != 0
+#error "UART_RINGBUFFER_SIZE_TX must be a power of 2"
+#endif
 
 static char tx_buf[UART_RINGBUFFER_SIZE_TX];
 static unsigned int tx_produce;
@@ -30,19 +43,22 @@ static volatile unsigned int tx_consume;
 
 void uart_isr(void)
 {
-	unsigned int stat, rx_produce_next;
+	unsigned int stat, produce, produce_next;
 
 	stat = uart_ev_pending_read();
 
 	if(stat & UART_EV_RX) {
+		/* Clearing the event pops the FIFO, so it is done for each char */
+		produce = rx_produce;
 		while(!uart_rxempty_read()) {
-			rx_produce_next = (rx_produce + 1) & UART_RINGBUFFER_MASK_RX;
-			if(rx_produce_next != rx_consume) {
-				rx_buf[rx_produce] = uart_rxtx_read();
-				rx_produce = rx_produce_next;
+			produce_next = (produce + 1) & UART_RINGBUFFER_MASK_RX;
+			if(produce_next != rx_consume) {
+				rx_buf[produce] = uart_rxtx_read();
+				produce = produce_next;
 			}
 			uart_ev_pending_write(UART_EV_RX);
 		}
+		rx_produce = produce;
 	}
 
 	if(stat & UART_EV_TX) {
@@ -75,6 +91,19 @@ int uart_read_nonblock(void)
 	return (rx_consume != rx_produce);
 }
 
+/* Copies up to len received chars without waiting, returns their number */
+unsigned int uart_read_buf(char *buf, unsigned int len)
+{
+	unsigned int produce = rx_produce;
+	unsigned int n = 0;
+
+	while((n < len) && (rx_consume != produce)) {
+		buf[n++] = rx_buf[rx_consume];
+		rx_consume = (rx_consume + 1) & UART_RINGBUFFER_MASK_RX;
+	}
+	return n;
+}
+
 void uart_write(char c)
 {
 	unsigned int oldmask;
@@ -97,6 +126,38 @@ void uart_write(char c)
 	irq_setmask(oldmask);
 }
 
+/* Same as uart_write for each char, with the interrupt masked once per ring refill */
+void uart_write_buf(const char *buf, unsigned int len)
+{
+	unsigned int oldmask;
+	unsigned int i = 0;
+
+	while(i < len) {
+		if(((tx_produce + 1) & UART_RINGBUFFER_MASK_TX) == tx_consume) {
+			if(!irq_getie())
+				return;
+			while(((tx_produce + 1) & UART_RINGBUFFER_MASK_TX) == tx_consume);
+		}
+
+		oldmask = irq_getmask();
+		irq_setmask(oldmask & ~(1 << UART_INTERRUPT));
+		/* Straight to the FIFO while nothing is queued */
+		while((i < len) && (tx_consume == tx_produce) && !uart_txfull_read())
+			uart_rxtx_write(buf[i++]);
+		/* Then queue what fits */
+		while((i < len) && (((tx_produce + 1) & UART_RINGBUFFER_MASK_TX) != tx_consume)) {
+			tx_buf[tx_produce] = buf[i++];
+			tx_produce = (tx_produce + 1) & UART_RINGBUFFER_MASK_TX;
+		}
+		irq_setmask(oldmask);
+	}
+}
+
+static void uart_irq(void *arg)
+{
+	uart_isr();
+}
+
 void uart_init(void)
 {
 	rx_produce = 0;
@@ -107,7 +168,7 @@ void uart_init(void)
 
 	uart_ev_pending_write(uart_ev_pending_read());
 	uart_ev_enable_write(UART_EV_TX | UART_EV_RX);
-	irq_setmask(irq_getmask() | (1 << UART_INTERRUPT));
+	irq_attach(UART_INTERRUPT, uart_irq, NULL);
 }
 
 void uart_sync(void)
@@ -135,6 +196,17 @@ int uart_read_nonblock(void)
 	return (uart_rxempty_read() == 0);
 }
 
+unsigned int uart_read_buf(char *buf, unsigned int len)
+{
+	unsigned int n = 0;
+
+	while ((n < len) && !uart_rxempty_read()) {
+		buf[n++] = uart_rxtx_read();
+		uart_ev_pending_write(UART_EV_RX);
+	}
+	return n;
+}
+
 void uart_write(char c)
 {
 	while (uart_txfull_read());
@@ -142,6 +214,12 @@ void uart_write(char c)
 	uart_ev_pending_write(UART_EV_TX);
 }
 
+void uart_write_buf(const char *buf, unsigned int len)
+{
+	while (len--)
+		uart_write(*buf++);
+}
+
 void uart_init(void)
 {
 	uart_ev_pending_write(uart_ev_pending_read());
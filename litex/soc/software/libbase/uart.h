@@ -13,8 +13,10 @@ void uart_isr(void);
 void uart_sync(void);
 
 void uart_write(char c);
+void uart_write_buf(const char *buf, unsigned int len);
 char uart_read(void);
 int uart_read_nonblock(void);
+unsigned int uart_read_buf(char *buf, unsigned int len);
 
 #ifdef __cplusplus
 }
@@ -7,26 +7,71 @@
 #include <stdio.h>
 
 #include <libbase/console.h>
+#include <libbase/logbuf.h>
 #include <libbase/uart.h>
 
 #include <generated/csr.h>
 
+/*
+ * Output is gathered per line and given to the UART in bulk; the buffer is flushed on
+ * '\n'/'\r', when full, before reading and on fflush().
+ */
+#ifndef LITEX_STDIO_BUFFER_SIZE
+#define LITEX_STDIO_BUFFER_SIZE 64
+#endif
+
+#ifdef CSR_UART_BASE
+static char litex_stdio_buf[LITEX_STDIO_BUFFER_SIZE];
+static unsigned int litex_stdio_len;
+
+static void
+litex_stdio_flush(void)
+{
+	if (litex_stdio_len) {
+		uart_write_buf(litex_stdio_buf, litex_stdio_len);
+		litex_stdio_len = 0;
+	}
+}
+#endif
+
 static int
 litex_putc(char c, FILE *file)
 {
 	(void) file; /* Not used in this function */
+	if (console_tee)
+		console_tee(c);
+#ifdef LOG_BUFFER
+	if (logbuf_putc(c))
+		return c;
+#endif
 #ifdef CSR_UART_BASE
-	uart_write(c);
+	litex_stdio_buf[litex_stdio_len++] = c;
 	if (c == '\n')
-		litex_putc('\r', NULL);
+		litex_stdio_buf[litex_stdio_len++] = '\r';
+	if ((c == '\n') || (c == '\r') || (litex_stdio_len > LITEX_STDIO_BUFFER_SIZE - 2))
+		litex_stdio_flush();
 #endif
 	return c;
 }
 
+static int
+litex_flush(FILE *file)
+{
+	(void) file; /* Not used in this function */
+#ifdef CSR_UART_BASE
+	litex_stdio_flush();
+#endif
+	return 0;
+}
+
 static int
 litex_getc(FILE *file)
 {
 	(void) file; /* Not used in this function */
+#ifdef CSR_UART_BASE
+	litex_stdio_flush();
+#endif
+	logbuf_flush();
 	while(1) {
 #ifdef CSR_UART_BASE
 		if(uart_read_nonblock())
@@ -35,7 +80,7 @@ litex_getc(FILE *file)
 	}
 }
 
-static FILE __stdio = FDEV_SETUP_STREAM(litex_putc, litex_getc, NULL, _FDEV_SETUP_RW);
+static FILE __stdio = FDEV_SETUP_STREAM(litex_putc, litex_getc, litex_flush, _FDEV_SETUP_RW);
 
 FILE *const stdout = &__stdio;
 FILE *const stderr = &__stdio;
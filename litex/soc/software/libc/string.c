@@ -0,0 +1,165 @@
+/* memcpy/memmove/memset replacing the picolibc ones, which are byte loops
+ * when optimizing for size (the -Os of LiteX builds).
+ *
+ * Accesses are word-wise (32-bit on LM32/OR1K/RV32, 64-bit on RV64) and
+ * unrolled. These CPUs trap on (or slowly emulate) unaligned accesses, so
+ * copies between buffers of different alignment read aligned source words
+ * and merge them with shifts, in the byte order of the CPU.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned long __attribute__((may_alias)) word_t;
+
+#define WSIZE sizeof(word_t)
+#define WMASK (WSIZE - 1)
+
+/* Word made of the last bytes of a followed by the first bytes of b */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WMERGE(a, b, ls, rs) (((a) << (ls)) | ((b) >> (rs)))
+#else
+#define WMERGE(a, b, ls, rs) (((a) >> (ls)) | ((b) << (rs)))
+#endif
+
+/* Keep GCC from turning the loops below into calls to themselves */
+#if defined(__GNUC__) && !defined(__clang__)
+#define NO_LIBCALL __attribute__((optimize("no-tree-loop-distribute-patterns")))
+#else
+#define NO_LIBCALL
+#endif
+
+/* Forward copy, also valid for overlapping buffers when dst < src */
+static NO_LIBCALL void copy_forward(unsigned char *d, const unsigned char *s, size_t n)
+{
+	if (n >= 2*WSIZE) {
+		/* Align the destination */
+		while ((uintptr_t)d & WMASK) {
+			*d++ = *s++;
+			n--;
+		}
+		if (((uintptr_t)s & WMASK) == 0) {
+			word_t *dw = (word_t *)d;
+			const word_t *sw = (const word_t *)s;
+
+			for (; n >= 4*WSIZE; n -= 4*WSIZE) {
+				dw[0] = sw[0];
+				dw[1] = sw[1];
+				dw[2] = sw[2];
+				dw[3] = sw[3];
+				dw += 4;
+				sw += 4;
+			}
+			for (; n >= WSIZE; n -= WSIZE)
+				*dw++ = *sw++;
+			d = (unsigned char *)dw;
+			s = (const unsigned char *)sw;
+		} else {
+			unsigned int off = (uintptr_t)s & WMASK;
+			unsigned int ls = 8*off;
+			unsigned int rs = 8*(WSIZE - off);
+			/* Aligned reads never cross into a page without source bytes */
+			const word_t *sw = (const word_t *)(s - off);
+			word_t *dw = (word_t *)d;
+			word_t a, b;
+
+			a = *sw++;
+			for (; n >= 2*WSIZE; n -= 2*WSIZE) {
+				b = *sw++;
+				dw[0] = WMERGE(a, b, ls, rs);
+				a = *sw++;
+				dw[1] = WMERGE(b, a, ls, rs);
+				dw += 2;
+			}
+			if (n >= WSIZE) {
+				b = *sw;
+				*dw++ = WMERGE(a, b, ls, rs);
+				n -= WSIZE;
+			}
+			s += (unsigned char *)dw - d;
+			d = (unsigned char *)dw;
+		}
+	}
+	while (n--)
+		*d++ = *s++;
+}
+
+/* Backward copy, for overlapping buffers when dst > src */
+static NO_LIBCALL void copy_backward(unsigned char *d, const unsigned char *s, size_t n)
+{
+	d += n;
+	s += n;
+	if ((n >= 2*WSIZE) && ((((uintptr_t)d ^ (uintptr_t)s) & WMASK) == 0)) {
+		word_t *dw;
+		const word_t *sw;
+
+		while ((uintptr_t)d & WMASK) {
+			*--d = *--s;
+			n--;
+		}
+		dw = (word_t *)d;
+		sw = (const word_t *)s;
+		for (; n >= 4*WSIZE; n -= 4*WSIZE) {
+			dw -= 4;
+			sw -= 4;
+			dw[3] = sw[3];
+			dw[2] = sw[2];
+			dw[1] = sw[1];
+			dw[0] = sw[0];
+		}
+		for (; n >= WSIZE; n -= WSIZE)
+			*--dw = *--sw;
+		d = (unsigned char *)dw;
+		s = (const unsigned char *)sw;
+	}
+	while (n--)
+		*--d = *--s;
+}
+
+void *memcpy(void *restrict dst, const void *restrict src, size_t n)
+{
+	copy_forward(dst, src, n);
+	return dst;
+}
+
+void *memmove(void *dst, const void *src, size_t n)
+{
+	if ((uintptr_t)dst - (uintptr_t)src >= n)
+		copy_forward(dst, src, n);
+	else
+		copy_backward(dst, src, n);
+	return dst;
+}
+
+NO_LIBCALL void *memset(void *dst, int c, size_t n)
+{
+	unsigned char *d = dst;
+
+	if (n >= 2*WSIZE) {
+		word_t w = (unsigned char)c;
+		word_t *dw;
+
+		w |= w << 8;
+		w |= w << 16;
+		if (WSIZE > 4)
+			w |= (w << 16) << 16;
+		while ((uintptr_t)d & WMASK) {
+			*d++ = c;
+			n--;
+		}
+		dw = (word_t *)d;
+		for (; n >= 4*WSIZE; n -= 4*WSIZE) {
+			dw[0] = w;
+			dw[1] = w;
+			dw[2] = w;
+			dw[3] = w;
+			dw += 4;
+		}
+		for (; n >= WSIZE; n -= WSIZE)
+			*dw++ = w;
+		d = (unsigned char *)dw;
+	}
+	while (n--)
+		*d++ = c;
+	return dst;
+}
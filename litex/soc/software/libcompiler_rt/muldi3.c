@@ -0,0 +1,80 @@
+/* 64-bit multiply for CPUs without multiplier, replacing the compiler-rt one
+ * (four 16x16 __mulsi3 partial products plus two cross products). The low
+ * words are multiplied with a single shift-add over the smaller one, the
+ * cross products are skipped when zero (operands fitting in 32 bits, the
+ * common case of speed/size computations). */
+typedef unsigned long long du_int;
+typedef unsigned int su_int;
+
+long __mulsi3(unsigned long a, unsigned long b);
+long long __muldi3(long long a, long long b);
+
+#if __SIZEOF_LONG__ == 4
+
+static du_int mul32x32(su_int a, su_int b)
+{
+	du_int res = 0;
+	du_int bw;
+	su_int t;
+
+	if (a > b) {
+		t = a;
+		a = b;
+		b = t;
+	}
+	bw = b;
+	while (a) {
+		if (a & 1)
+			res += bw;
+		if (a & 2)
+			res += bw << 1;
+		bw <<= 2;
+		a >>= 2;
+	}
+	return res;
+}
+
+long long
+__muldi3(long long a, long long b)
+{
+	du_int ua = a;
+	du_int ub = b;
+	su_int al = ua, ah = ua >> 32;
+	su_int bl = ub, bh = ub >> 32;
+	du_int res;
+
+	res = mul32x32(al, bl);
+	if (ah)
+		res += (du_int)(su_int)__mulsi3(ah, bl) << 32;
+	if (bh)
+		res += (du_int)(su_int)__mulsi3(al, bh) << 32;
+	return res;
+}
+
+#else
+
+long long
+__muldi3(long long a, long long b)
+{
+	du_int ua = a;
+	du_int ub = b;
+	du_int res = 0;
+	du_int t;
+
+	if (ua > ub) {
+		t = ua;
+		ua = ub;
+		ub = t;
+	}
+	while (ua) {
+		if (ua & 1)
+			res += ub;
+		if (ua & 2)
+			res += ub << 1;
+		ub <<= 2;
+		ua >>= 2;
+	}
+	return res;
+}
+
+#endif
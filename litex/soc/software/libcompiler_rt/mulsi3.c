@@ -1,16 +1,23 @@
-
+/* Shift-add multiply for CPUs without multiplier (rv32i SERV/FemtoRV/
+ * PicoRV32 minimal), two bits per iteration over the smaller operand. */
 long
 __mulsi3(unsigned long a, unsigned long b)
 {
-long res = 0;
-while (a)
-{
-if (a & 1)
-{
-res += b;
-}
-b <<= 1;
-a >>=1;
+	unsigned long res = 0;
+	unsigned long t;
+
+	if (a > b) {
+		t = a;
+		a = b;
+		b = t;
+	}
+	while (a) {
+		if (a & 1)
+			res += b;
+		if (a & 2)
+			res += b << 1;
+		b <<= 2;
+		a >>= 2;
+	}
+	return res;
 }
-return res;
-}
\ No newline at end of file
@@ -0,0 +1,203 @@
+// License: BSD
+
+#include <string.h>
+
+#include <generated/csr.h>
+
+#include "ff.h"
+#include "diskio.h"
+
+/*-----------------------------------------------------------------------*/
+/* RAM disk                                                              */
+/*-----------------------------------------------------------------------*/
+
+static BYTE *ramdisk_base;
+static LBA_t ramdisk_sectors;
+
+void diskio_ramdisk_set(void *base, LBA_t sectors) {
+	ramdisk_base    = base;
+	ramdisk_sectors = sectors;
+}
+
+static DSTATUS ramdisk_status(void) {
+	return ramdisk_base ? 0 : STA_NOINIT;
+}
+
+static DRESULT ramdisk_read(BYTE *buf, LBA_t sector, UINT count) {
+	if (sector + count > ramdisk_sectors)
+		return RES_PARERR;
+	memcpy(buf, ramdisk_base + 512*sector, 512*count);
+	return RES_OK;
+}
+
+#if !FF_FS_READONLY
+static DRESULT ramdisk_write(const BYTE *buf, LBA_t sector, UINT count) {
+	if (sector + count > ramdisk_sectors)
+		return RES_PARERR;
+	memcpy(ramdisk_base + 512*sector, buf, 512*count);
+	return RES_OK;
+}
+#endif
+
+static const struct diskio_driver ramdisk_diskio = {
+	.initialize = ramdisk_status,
+	.status     = ramdisk_status,
+	.read       = ramdisk_read,
+#if !FF_FS_READONLY
+	.write      = ramdisk_write,
+#endif
+};
+
+/*-----------------------------------------------------------------------*/
+/* Sector cache                                                          */
+/*-----------------------------------------------------------------------*/
+
+/* LRU cache of aligned lines of FATFS_CACHE_READAHEAD sectors between FatFs and
+ * the SD/SATA drivers: single sector reads (FAT, directories, tiny mode window)
+ * are served from it, a miss reads the whole line ahead. Multi-sector reads go
+ * to the driver, writes go through and update the cached copies. */
+#ifdef FATFS_CACHE
+
+#ifndef FATFS_CACHE_SECTORS
+#define FATFS_CACHE_SECTORS   16
+#endif
+#ifndef FATFS_CACHE_READAHEAD
+#define FATFS_CACHE_READAHEAD 4
+#endif
+#define FATFS_CACHE_LINES     (FATFS_CACHE_SECTORS/FATFS_CACHE_READAHEAD)
+
+struct cache_line {
+	BYTE drv;       /* Drive + 1, 0: invalid */
+	LBA_t sector;   /* First sector, FATFS_CACHE_READAHEAD aligned */
+	unsigned int used;
+	BYTE data[FATFS_CACHE_READAHEAD*512] __attribute__((aligned(4)));
+};
+
+static struct cache_line cache_lines[FATFS_CACHE_LINES];
+static unsigned int cache_clock;
+
+static void cache_invalidate(BYTE drv) {
+	int i;
+	for (i = 0; i < FATFS_CACHE_LINES; i++)
+		if (cache_lines[i].drv == drv + 1) {
+			cache_lines[i].drv  = 0;
+			cache_lines[i].used = 0;
+		}
+}
+
+static DRESULT cache_read(const struct diskio_driver *driver, BYTE drv, BYTE *buf, LBA_t sector) {
+	struct cache_line *line, *lru;
+	LBA_t first;
+	int i;
+
+	first = sector - (sector % FATFS_CACHE_READAHEAD);
+	lru   = &cache_lines[0];
+	for (i = 0; i < FATFS_CACHE_LINES; i++) {
+		line = &cache_lines[i];
+		if ((line->drv == drv + 1) && (line->sector == first)) {
+			line->used = ++cache_clock;
+			memcpy(buf, line->data + 512*(sector - first), 512);
+			return RES_OK;
+		}
+		if (line->used < lru->used)
+			lru = line;
+	}
+
+	/* Miss: read the line ahead, or only the sector when that fails (end of the medium) */
+	lru->drv = 0;
+	if (driver->read(lru->data, first, FATFS_CACHE_READAHEAD) != RES_OK)
+		return driver->read(buf, sector, 1);
+	lru->drv    = drv + 1;
+	lru->sector = first;
+	lru->used   = ++cache_clock;
+	memcpy(buf, lru->data + 512*(sector - first), 512);
+	return RES_OK;
+}
+
+#if !FF_FS_READONLY
+static void cache_write(BYTE drv, const BYTE *buf, LBA_t sector, UINT count) {
+	struct cache_line *line;
+	LBA_t s;
+	int i;
+
+	for (i = 0; i < FATFS_CACHE_LINES; i++) {
+		line = &cache_lines[i];
+		if (line->drv != drv + 1)
+			continue;
+		for (s = line->sector; s < line->sector + FATFS_CACHE_READAHEAD; s++)
+			if ((s >= sector) && (s < sector + count))
+				memcpy(line->data + 512*(s - line->sector), buf + 512*(s - sector), 512);
+	}
+}
+#endif
+
+#endif /* FATFS_CACHE */
+
+/*-----------------------------------------------------------------------*/
+/* FatFs disk functions                                                  */
+/*-----------------------------------------------------------------------*/
+
+static const struct diskio_driver *diskio_drivers[FF_VOLUMES] = {
+#if defined(CSR_SDCORE_BASE)
+	[DISKIO_SD]   = &sdcard_diskio,
+#elif defined(CSR_SPISDCARD_BASE)
+	[DISKIO_SD]   = &spisdcard_diskio,
+#endif
+#ifdef CSR_SATA_SECTOR2MEM_BASE
+	[DISKIO_SATA] = &sata_diskio,
+#endif
+	[DISKIO_RAM]  = &ramdisk_diskio,
+};
+
+DSTATUS disk_initialize(BYTE drv) {
+	if ((drv >= FF_VOLUMES) || !diskio_drivers[drv])
+		return STA_NOINIT;
+#ifdef FATFS_CACHE
+	cache_invalidate(drv);
+#endif
+	return diskio_drivers[drv]->initialize() | (diskio_drivers[drv]->write ? 0 : STA_PROTECT);
+}
+
+DSTATUS disk_status(BYTE drv) {
+	if ((drv >= FF_VOLUMES) || !diskio_drivers[drv])
+		return STA_NOINIT;
+	return diskio_drivers[drv]->status() | (diskio_drivers[drv]->write ? 0 : STA_PROTECT);
+}
+
+DRESULT disk_read(BYTE drv, BYTE *buf, LBA_t sector, UINT count) {
+	if ((drv >= FF_VOLUMES) || !diskio_drivers[drv])
+		return RES_NOTRDY;
+#ifdef FATFS_CACHE
+	if ((count == 1) && (drv != DISKIO_RAM))
+		return cache_read(diskio_drivers[drv], drv, buf, sector);
+#endif
+	return diskio_drivers[drv]->read(buf, sector, count);
+}
+
+#if !FF_FS_READONLY
+DRESULT disk_write(BYTE drv, const BYTE *buf, LBA_t sector, UINT count) {
+	if ((drv >= FF_VOLUMES) || !diskio_drivers[drv])
+		return RES_NOTRDY;
+	if (!diskio_drivers[drv]->write)
+		return RES_WRPRT;
+#ifdef FATFS_CACHE
+	if (diskio_drivers[drv]->write(buf, sector, count) != RES_OK) {
+		cache_invalidate(drv);
+		return RES_ERROR;
+	}
+	cache_write(drv, buf, sector, count);
+	return RES_OK;
+#else
+	return diskio_drivers[drv]->write(buf, sector, count);
+#endif
+}
+
+/* Writes of the drivers are complete on return: nothing to sync */
+DRESULT disk_ioctl(BYTE drv, BYTE cmd, void *buf) {
+	if ((drv >= FF_VOLUMES) || !diskio_drivers[drv])
+		return RES_NOTRDY;
+	if (cmd == CTRL_SYNC)
+		return RES_OK;
+	return RES_PARERR;
+}
+#endif
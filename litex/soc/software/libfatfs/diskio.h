@@ -34,6 +34,26 @@ DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 
 
+/* Drivers of the physical drives (sd:, sata:, ram:), dispatched by diskio.c */
+#define DISKIO_SD	0
+#define DISKIO_SATA	1
+#define DISKIO_RAM	2
+
+struct diskio_driver {
+	DSTATUS (*initialize)(void);
+	DSTATUS (*status)(void);
+	DRESULT (*read)(BYTE* buff, LBA_t sector, UINT count);
+	DRESULT (*write)(const BYTE* buff, LBA_t sector, UINT count); /* NULL: read-only */
+};
+
+extern const struct diskio_driver sdcard_diskio;
+extern const struct diskio_driver spisdcard_diskio;
+extern const struct diskio_driver sata_diskio;
+
+/* FAT image of sectors*512 bytes at base, as the ram: drive */
+void diskio_ramdisk_set(void *base, LBA_t sectors);
+
+
 /* Disk Status Bits (DSTATUS) */
 #define STA_NOINIT		0x01	/* Drive not initialized */
 #define STA_NODISK		0x02	/* No medium in the drive */
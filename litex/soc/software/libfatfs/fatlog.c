@@ -0,0 +1,156 @@
+// License: BSD
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "ff.h"
+#include "fatlog.h"
+
+#if !FF_FS_READONLY
+
+#define FATLOG_LINE_SIZE 128
+
+static FATFS fatlog_fs;
+static FIL fatlog_file;
+static char fatlog_volume[8];
+static char *fatlog_buffer;
+static unsigned int fatlog_batch;
+static unsigned int fatlog_level;
+static unsigned int fatlog_limit; /* Level written at once, file offset at a batch boundary */
+static FRESULT fatlog_result;
+static int fatlog_busy;
+
+/* Next write up to a batch boundary: the first one after opening or a flush
+   realigns the file, the others are whole batches */
+static void fatlog_realign(void) {
+	fatlog_level = 0;
+	fatlog_limit = fatlog_batch - f_tell(&fatlog_file) % fatlog_batch;
+}
+
+static void fatlog_write_buffer(void) {
+	UINT bw;
+
+	if (fatlog_result != FR_OK)
+		return;
+	/* Nothing is logged from the disk drivers while writing */
+	fatlog_busy = 1;
+	fatlog_result = f_write(&fatlog_file, fatlog_buffer, fatlog_level, &bw);
+	if ((fatlog_result == FR_OK) && (bw != fatlog_level))
+		fatlog_result = FR_DENIED; /* Volume full */
+	fatlog_busy = 0;
+}
+
+FRESULT fatlog_open(const char *path, void *buffer, unsigned int size) {
+	const char *colon;
+	unsigned int cluster;
+	FRESULT fr;
+
+	if (fatlog_buffer)
+		fatlog_close();
+
+	/* Volume of the path, the current drive without */
+	fatlog_volume[0] = '\0';
+	colon = strchr(path, ':');
+	if (colon && (colon - path + 2 <= sizeof(fatlog_volume))) {
+		memcpy(fatlog_volume, path, colon - path + 1);
+		fatlog_volume[colon - path + 1] = '\0';
+	}
+	fr = f_mount(&fatlog_fs, fatlog_volume, 1);
+	if (fr != FR_OK)
+		return fr;
+	fr = f_open(&fatlog_file, path, FA_WRITE | FA_OPEN_APPEND);
+	if (fr != FR_OK)
+		goto unmount;
+
+	/* Largest batch of whole clusters (or sectors) fitting the buffer */
+	cluster = FF_MIN_SS*fatlog_fs.csize;
+	if (size >= cluster)
+		fatlog_batch = size - size % cluster;
+	else
+		fatlog_batch = size - size % FF_MIN_SS;
+	if (fatlog_batch == 0) {
+		fr = FR_INVALID_PARAMETER;
+		f_close(&fatlog_file);
+		goto unmount;
+	}
+	fatlog_buffer = buffer;
+	fatlog_result = FR_OK;
+	fatlog_realign();
+	return FR_OK;
+
+unmount:
+	f_mount(0, fatlog_volume, 0);
+	return fr;
+}
+
+void fatlog_write(const void *data, unsigned int length) {
+	unsigned int n;
+
+	if (!fatlog_buffer || fatlog_busy)
+		return;
+	while (length) {
+		n = fatlog_limit - fatlog_level;
+		if (n > length)
+			n = length;
+		memcpy(fatlog_buffer + fatlog_level, data, n);
+		fatlog_level += n;
+		data          = (const char *) data + n;
+		length       -= n;
+		if (fatlog_level == fatlog_limit) {
+			fatlog_write_buffer();
+			fatlog_level = 0;
+			fatlog_limit = fatlog_batch;
+		}
+	}
+}
+
+void fatlog_printf(const char *fmt, ...) {
+	char line[FATLOG_LINE_SIZE];
+	va_list args;
+	int length;
+
+	va_start(args, fmt);
+	length = vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+	if (length >= (int) sizeof(line))
+		length = sizeof(line) - 1;
+	if (length > 0)
+		fatlog_write(line, length);
+}
+
+void fatlog_putc(char c) {
+	fatlog_write(&c, 1);
+}
+
+/* Writes the pending data and updates the directory entry: the log is
+   readable up to there if the board is powered off */
+FRESULT fatlog_flush(void) {
+	if (!fatlog_buffer)
+		return FR_INVALID_OBJECT;
+	if (fatlog_level)
+		fatlog_write_buffer();
+	if (fatlog_result == FR_OK)
+		fatlog_result = f_sync(&fatlog_file);
+	fatlog_realign();
+	return fatlog_result;
+}
+
+FRESULT fatlog_close(void) {
+	FRESULT fr;
+
+	fr = fatlog_flush();
+	if (fr == FR_INVALID_OBJECT)
+		return fr;
+	f_close(&fatlog_file);
+	f_mount(0, fatlog_volume, 0);
+	fatlog_buffer = NULL;
+	return fr;
+}
+
+/* Physical drive of the log, -1 when closed */
+int fatlog_drive(void) {
+	return fatlog_buffer ? fatlog_fs.pdrv : -1;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __FATLOG_H
+#define __FATLOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ff.h"
+
+/* Append-only log file, buffered and written in batches of whole clusters
+   (whole sectors when the buffer is smaller than a cluster), so that FatFs
+   hands them to the disk as multi-block writes */
+
+#if !FF_FS_READONLY
+
+FRESULT fatlog_open(const char *path, void *buffer, unsigned int size);
+void fatlog_write(const void *data, unsigned int length);
+void fatlog_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void fatlog_putc(char c);
+FRESULT fatlog_flush(void);
+FRESULT fatlog_close(void);
+int fatlog_drive(void);
+
+#else
+
+static inline int fatlog_drive(void) { return -1; }
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FATLOG_H */
@@ -6,10 +6,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <uart.h>
 #include <time.h>
 #include <console.h>
 
+#include <generated/mem.h>
+#include <generated/soc.h>
+
+#include <libbase/lfsr.h>
+
 #include <liblitedram/bist.h>
 
 #define SDRAM_TEST_BASE 0x00000000
@@ -66,6 +72,26 @@ static uint32_t pseudo_random_bases[128] = {
 	0x00027e36,0x000e51ae,0x002e7627,0x00275c9f,
 };
 
+static void sdram_generator_prepare(uint32_t base, uint32_t length, uint32_t random) {
+	sdram_generator_reset_write(1);
+	sdram_generator_reset_write(0);
+	sdram_generator_random_write(random);
+	sdram_generator_base_write(base);
+	sdram_generator_end_write(base + length);
+	sdram_generator_length_write(length);
+	cdelay(100);
+}
+
+static void sdram_checker_prepare(uint32_t base, uint32_t length, uint32_t random) {
+	sdram_checker_reset_write(1);
+	sdram_checker_reset_write(0);
+	sdram_checker_random_write(random);
+	sdram_checker_base_write(base);
+	sdram_checker_end_write(base + length);
+	sdram_checker_length_write(length);
+	cdelay(100);
+}
+
 void sdram_bist_loop(uint32_t loop, uint32_t burst_length, uint32_t random) {
 	int i;
 	uint32_t base;
@@ -80,24 +106,12 @@ void sdram_bist_loop(uint32_t loop, uint32_t burst_length, uint32_t random) {
 			base = SDRAM_TEST_BASE + ((i+loop)%128)*SDRAM_TEST_DATA_BYTES;
 		if (i == 0) {
 			/* Prepare first write */
-			sdram_generator_reset_write(1);
-			sdram_generator_reset_write(0);
-			sdram_generator_random_write(1); /* Random data */
-			sdram_generator_base_write(base);
-			sdram_generator_end_write(base + length);
-			sdram_generator_length_write(length);
-			cdelay(100);
+			sdram_generator_prepare(base, length, 1); /* Random data */
 		}
 		/* Start write */
 		sdram_generator_start_write(1);
 		/* Prepare next read */
-		sdram_checker_reset_write(1);
-		sdram_checker_reset_write(0);
-		sdram_checker_random_write(1); /* Random data */
-		sdram_checker_base_write(base);
-		sdram_checker_end_write(base + length);
-		sdram_checker_length_write(length);
-		cdelay(100);
+		sdram_checker_prepare(base, length, 1); /* Random data */
 		/* Wait write */
 		while(sdram_generator_done_read() == 0);
 		/* Get write results */
@@ -111,13 +125,7 @@ void sdram_bist_loop(uint32_t loop, uint32_t burst_length, uint32_t random) {
 			else
 				base = SDRAM_TEST_BASE + ((i+1+loop)%128)*SDRAM_TEST_DATA_BYTES;
 			/* Prepare next write */
-			sdram_generator_reset_write(1);
-			sdram_generator_reset_write(0);
-			sdram_generator_random_write(1); /* Random data */
-			sdram_generator_base_write(base);
-			sdram_generator_end_write(base + length);
-			sdram_generator_length_write(length);
-			cdelay(100);
+			sdram_generator_prepare(base, length, 1); /* Random data */
 		}
 		/* Wait read */
 		while(sdram_checker_done_read() == 0);
@@ -128,6 +136,28 @@ void sdram_bist_loop(uint32_t loop, uint32_t burst_length, uint32_t random) {
 	}
 }
 
+/* Writes length bytes from base with the generator */
+void sdram_bist_write(uint32_t base, uint32_t length, uint32_t random) {
+	sdram_generator_prepare(base, length, random);
+	sdram_generator_start_write(1);
+	while(sdram_generator_done_read() == 0);
+}
+
+/* Checks length bytes from base written by sdram_bist_write, returns the errors */
+uint32_t sdram_bist_read(uint32_t base, uint32_t length, uint32_t random) {
+	sdram_checker_prepare(base, length, random);
+	sdram_checker_start_write(1);
+	while(sdram_checker_done_read() == 0);
+
+	return sdram_checker_errors_read();
+}
+
+/* Writes length bytes from base with the generator then checks them, returns the errors */
+uint32_t sdram_bist_check(uint32_t base, uint32_t length, uint32_t random) {
+	sdram_bist_write(base, length, random);
+	return sdram_bist_read(base, length, random);
+}
+
 static uint32_t compute_speed_mibs(uint32_t length, uint32_t ticks) {
 	uint32_t speed;
 	//printf("(%u, %u)", length, ticks);
@@ -135,6 +165,36 @@ static uint32_t compute_speed_mibs(uint32_t length, uint32_t ticks) {
 	return speed;
 }
 
+/* Writes then checks count consecutive bursts of length bytes from base, adds the ticks
+   of the writes/reads to wr_ticks/rd_ticks, returns the errors */
+uint32_t sdram_bist_measure(uint32_t base, uint32_t length, uint32_t count, uint32_t *wr_ticks, uint32_t *rd_ticks) {
+	uint32_t errors;
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		sdram_generator_prepare(base + i*length, length, 1);
+		sdram_generator_start_write(1);
+		while(sdram_generator_done_read() == 0);
+		*wr_ticks += sdram_generator_ticks_read();
+	}
+	errors = 0;
+	for (i = 0; i < count; i++) {
+		sdram_checker_prepare(base + i*length, length, 1);
+		sdram_checker_start_write(1);
+		while(sdram_checker_done_read() == 0);
+		*rd_ticks += sdram_checker_ticks_read();
+		errors   += sdram_checker_errors_read();
+	}
+
+	return errors;
+}
+
+static uint32_t sdram_bist_mibs(uint64_t length, uint64_t ticks) {
+	if (ticks == 0)
+		return 0;
+	return length*CONFIG_CLOCK_FREQUENCY/ticks/(1024*1024);
+}
+
 void sdram_bist(uint32_t burst_length, uint32_t random)
 {
 	uint32_t i;
@@ -178,4 +238,310 @@ void sdram_bist(uint32_t burst_length, uint32_t random)
 	}
 }
 
+/*-----------------------------------------------------------------------*/
+/* Address Patterns                                                      */
+/*-----------------------------------------------------------------------*/
+
+/* Bursts placed over [base, base + size): sequentially, from an LFSR, or from the
+   DRAM geometry (row-bank-col mapping) to get only row hits (all the bursts in one
+   row) or only row misses (all the bursts in one bank, each in another row). */
+
+#define SDRAM_BIST_PATTERN_BURSTS 128
+
+static uint32_t sdram_bist_pattern_slots(int pattern, uint32_t size, uint32_t length) {
+	switch (pattern) {
+#if defined(SDRAM_MODULE_ROW_SIZE) && defined(SDRAM_MODULE_NBANKS)
+	case SDRAM_BIST_PATTERN_ROW_HIT:
+		return SDRAM_MODULE_ROW_SIZE/length;
+	case SDRAM_BIST_PATTERN_ROW_MISS:
+		return size/(SDRAM_MODULE_ROW_SIZE*SDRAM_MODULE_NBANKS);
+#endif
+	case SDRAM_BIST_PATTERN_SEQUENTIAL:
+	case SDRAM_BIST_PATTERN_LFSR:
+		return size/length;
+	default:
+		return 0;
+	}
+}
+
+static uint32_t sdram_bist_pattern_offset(int pattern, uint32_t slot, uint32_t length) {
+#if defined(SDRAM_MODULE_ROW_SIZE) && defined(SDRAM_MODULE_NBANKS)
+	if (pattern == SDRAM_BIST_PATTERN_ROW_MISS)
+		return slot*SDRAM_MODULE_ROW_SIZE*SDRAM_MODULE_NBANKS;
+#endif
+	return slot*length;
+}
+
+/* Next slot of the LFSR over [0, slots) (values of the LFSR out of range skipped) */
+static uint32_t sdram_bist_lfsr_slot(uint32_t *state, uint32_t bits, uint32_t slots) {
+	do {
+		*state = lfsr(bits, *state);
+	} while (*state > slots);
+	return *state - 1;
+}
+
+void sdram_bist_pattern(int pattern, uint32_t base, uint32_t size, uint32_t burst_length)
+{
+	static const char *names[] = {"sequential", "lfsr", "row hit", "row miss"};
+	uint32_t length;
+	uint32_t slots, slot;
+	uint32_t bits;
+	uint32_t state, seed;
+	uint32_t loop;
+	uint32_t offset;
+	uint64_t wr_len, wr_tck, rd_len, rd_tck;
+	uint64_t total_length;
+	uint32_t errors, total_errors;
+	int pass;
+	int i;
+
+	length = burst_length*SDRAM_TEST_DATA_BYTES;
+	slots  = sdram_bist_pattern_slots(pattern, size, length);
+	if (slots < 1) {
+		printf("Pattern not available for this range/burst length\n");
+		return;
+	}
+	for (bits = 2; bits < 32 && ((1UL << bits) - 1) < slots; bits++);
+
+	printf("Starting SDRAM BIST with %s pattern over 0x%08x-0x%08x (%u slots), burst_length=%u\n",
+		names[pattern], base, base + size, slots, burst_length);
+
+	seed = 1;
+	total_length = 0;
+	total_errors = 0;
+	wr_len = wr_tck = rd_len = rd_tck = errors = 0;
+	for (loop = 0;; loop++) {
+		/* Exit on key pressed */
+		if (readchar_nonblock())
+			break;
+
+		/* Write then read/check the same bursts */
+		for (pass = 0; pass < 2; pass++) {
+			state = seed;
+			for (i = 0; i < SDRAM_BIST_PATTERN_BURSTS; i++) {
+				if (pattern == SDRAM_BIST_PATTERN_LFSR)
+					slot = sdram_bist_lfsr_slot(&state, bits, slots);
+				else
+					slot = (loop*SDRAM_BIST_PATTERN_BURSTS + i)%slots;
+				offset = base + sdram_bist_pattern_offset(pattern, slot, length);
+				if (pass == 0) {
+					sdram_generator_prepare(offset, length, 1);
+					sdram_generator_start_write(1);
+					while(sdram_generator_done_read() == 0);
+					wr_len += length;
+					wr_tck += sdram_generator_ticks_read();
+				} else {
+					sdram_checker_prepare(offset, length, 1);
+					sdram_checker_start_write(1);
+					while(sdram_checker_done_read() == 0);
+					rd_len += length;
+					rd_tck += sdram_checker_ticks_read();
+					errors += sdram_checker_errors_read();
+				}
+			}
+		}
+		seed = state;
+
+		/* Results */
+		if (loop%1000 == 0)
+			printf("WR-SPEED(MiB/s) RD-SPEED(MiB/s)  TESTED(MiB)       ERRORS\n");
+		if (loop%100 == 100-1) {
+			total_length += wr_len;
+			total_errors += errors;
+			printf("%15u %15u %12u %12u\n",
+				sdram_bist_mibs(wr_len, wr_tck),
+				sdram_bist_mibs(rd_len, rd_tck),
+				(uint32_t)(total_length/(1024*1024)),
+				total_errors);
+			wr_len = wr_tck = rd_len = rd_tck = errors = 0;
+		}
+	}
+}
+
+/*-----------------------------------------------------------------------*/
+/* Characterization                                                      */
+/*-----------------------------------------------------------------------*/
+
+/* Sweeps burst length and access pattern, the generator writing a region
+   while the checker reads/checks the previous one (disjoint), and records
+   the ticks of each burst (min/avg/max and log2 histogram). */
+
+#ifndef SDRAM_BIST_CHAR_SIZE
+#ifdef MAIN_RAM_SIZE
+#define SDRAM_BIST_CHAR_SIZE MAIN_RAM_SIZE
+#else
+#define SDRAM_BIST_CHAR_SIZE (16*1024*1024)
+#endif
+#endif
+
+#define SDRAM_BIST_CHAR_RUNS    256
+#define SDRAM_BIST_CHAR_BUCKETS 24 /* Bucket n: ticks in [2^n, 2^(n+1)) */
+
+struct sdram_bist_stats {
+	uint32_t runs;
+	uint32_t min;
+	uint32_t max;
+	uint64_t ticks;
+	uint32_t hist[SDRAM_BIST_CHAR_BUCKETS];
+};
+
+static void sdram_bist_stats_add(struct sdram_bist_stats *s, uint32_t ticks) {
+	int n;
+
+	if (s->runs == 0 || ticks < s->min)
+		s->min = ticks;
+	if (ticks > s->max)
+		s->max = ticks;
+	s->runs++;
+	s->ticks += ticks;
+	for (n = 0; (n < SDRAM_BIST_CHAR_BUCKETS - 1) && (ticks >> (n + 1)); n++);
+	s->hist[n]++;
+}
+
+static void sdram_bist_stats_print_hist(const char *name, const struct sdram_bist_stats *s) {
+	int n;
+
+	printf("    %s:", name);
+	for (n = 0; n < SDRAM_BIST_CHAR_BUCKETS; n++)
+		if (s->hist[n])
+			printf(" 2^%d:%u", n, s->hist[n]);
+	printf("\n");
+}
+
+/* Runs SDRAM_BIST_CHAR_RUNS bursts of length bytes, returns the errors */
+static uint32_t sdram_bist_char_run(uint32_t length, uint32_t random, int hist) {
+	struct sdram_bist_stats wr, rd;
+	uint32_t regions;
+	uint32_t region, previous;
+	uint32_t errors;
+	int i;
+
+	memset(&wr, 0, sizeof(wr));
+	memset(&rd, 0, sizeof(rd));
+	regions  = SDRAM_BIST_CHAR_SIZE/length;
+	errors   = 0;
+	previous = 0;
+	for (i = 0; i <= SDRAM_BIST_CHAR_RUNS; i++) {
+		/* Next write region, never the previous one (being checked) */
+		region = random ? pseudo_random_bases[i%128]%regions : i%regions;
+		if (i > 0 && region == previous)
+			region = (region + 1)%regions;
+
+		/* Write region i while checking region i-1 */
+		if (i < SDRAM_BIST_CHAR_RUNS)
+			sdram_generator_prepare(SDRAM_TEST_BASE + region*length, length, 1);
+		if (i > 0)
+			sdram_checker_prepare(SDRAM_TEST_BASE + previous*length, length, 1);
+		if (i < SDRAM_BIST_CHAR_RUNS)
+			sdram_generator_start_write(1);
+		if (i > 0)
+			sdram_checker_start_write(1);
+		if (i < SDRAM_BIST_CHAR_RUNS) {
+			while(sdram_generator_done_read() == 0);
+			sdram_bist_stats_add(&wr, sdram_generator_ticks_read());
+		}
+		if (i > 0) {
+			while(sdram_checker_done_read() == 0);
+			sdram_bist_stats_add(&rd, sdram_checker_ticks_read());
+			errors += sdram_checker_errors_read();
+		}
+		previous = region;
+	}
+
+	printf("%8u %6s %8u %8u %6u/%6u/%6u %6u/%6u/%6u %8u\n",
+		length, random ? "random" : "seq",
+		sdram_bist_mibs((uint64_t)wr.runs*length, wr.ticks),
+		sdram_bist_mibs((uint64_t)rd.runs*length, rd.ticks),
+		wr.min, (uint32_t)(wr.ticks/wr.runs), wr.max,
+		rd.min, (uint32_t)(rd.ticks/rd.runs), rd.max,
+		errors);
+	if (hist) {
+		sdram_bist_stats_print_hist("wr", &wr);
+		sdram_bist_stats_print_hist("rd", &rd);
+	}
+
+	return errors;
+}
+
+void sdram_bist_char(int hist)
+{
+	uint32_t burst_length;
+	uint32_t random;
+	uint32_t sweeps;
+	uint32_t total_errors;
+
+	printf("Starting SDRAM BIST characterization over %u MiB (press a key to stop)\n",
+		(unsigned int)(SDRAM_BIST_CHAR_SIZE/(1024*1024)));
+
+	total_errors = 0;
+	for (sweeps = 0;; sweeps++) {
+		printf("   BYTES PATTERN WR-MiB/s RD-MiB/s  WR-TICKS(MIN/AVG/MAX)  RD-TICKS(MIN/AVG/MAX)   ERRORS\n");
+		for (burst_length = 1; burst_length <= 1024; burst_length *= 4) {
+			if (burst_length*SDRAM_TEST_DATA_BYTES*2 > SDRAM_BIST_CHAR_SIZE)
+				break;
+			for (random = 0; random < 2; random++) {
+				total_errors += sdram_bist_char_run(burst_length*SDRAM_TEST_DATA_BYTES, random, hist);
+				if (readchar_nonblock()) {
+					printf("%u sweep(s), %u error(s)\n", sweeps + 1, total_errors);
+					return;
+				}
+			}
+		}
+	}
+}
+
+/*-----------------------------------------------------------------------*/
+/* Memtest                                                               */
+/*-----------------------------------------------------------------------*/
+
+/* Memtest/throughput of a DRAM range with the generator/checker, which access the DRAM port
+   directly: no CPU cache involved in the data or in the measured bandwidth. The whole range
+   is written before being checked. */
+
+#ifndef SDRAM_BIST_MEMTEST_CHUNK
+#define SDRAM_BIST_MEMTEST_CHUNK (1024*1024)
+#endif
+
+uint32_t sdram_bist_memtest(uint32_t base, uint32_t size)
+{
+	uint64_t wr_tck, rd_tck;
+	uint32_t offset, length;
+	uint32_t errors;
+	int pass;
+
+	size -= size%SDRAM_TEST_DATA_BYTES;
+	printf("SDRAM BIST memtest over 0x%08x-0x%08x...\n", base, base + size);
+
+	wr_tck = rd_tck = 0;
+	errors = 0;
+	for (pass = 0; pass < 2; pass++) {
+		for (offset = 0; offset < size; offset += length) {
+			length = size - offset < SDRAM_BIST_MEMTEST_CHUNK ? size - offset : SDRAM_BIST_MEMTEST_CHUNK;
+			if (pass == 0) {
+				sdram_generator_prepare(base + offset, length, 1);
+				sdram_generator_start_write(1);
+				while(sdram_generator_done_read() == 0);
+				wr_tck += sdram_generator_ticks_read();
+			} else {
+				sdram_checker_prepare(base + offset, length, 1);
+				sdram_checker_start_write(1);
+				while(sdram_checker_done_read() == 0);
+				rd_tck += sdram_checker_ticks_read();
+				errors += sdram_checker_errors_read();
+			}
+			printf("  %s: 0x%08x-0x%08x\r", pass == 0 ? "Write" : " Read", base, base + offset + length);
+		}
+		printf("\n");
+	}
+	printf("  Write speed: %u MiB/s\n", sdram_bist_mibs(size, wr_tck));
+	printf("   Read speed: %u MiB/s\n", sdram_bist_mibs(size, rd_tck));
+	if (errors != 0) {
+		printf("  errors: %u\n", errors);
+		printf("Memtest KO\n");
+	} else
+		printf("Memtest OK\n");
+
+	return errors;
+}
+
 #endif
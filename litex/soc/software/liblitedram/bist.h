@@ -5,6 +5,19 @@
 #define __SDRAM_BIST_H
 
 void sdram_bist_loop(uint32_t loop, uint32_t burst_length, uint32_t random);
+void sdram_bist_write(uint32_t base, uint32_t length, uint32_t random);
+uint32_t sdram_bist_read(uint32_t base, uint32_t length, uint32_t random);
+uint32_t sdram_bist_check(uint32_t base, uint32_t length, uint32_t random);
+uint32_t sdram_bist_measure(uint32_t base, uint32_t length, uint32_t count, uint32_t *wr_ticks, uint32_t *rd_ticks);
 void sdram_bist(uint32_t burst_length, uint32_t random);
+void sdram_bist_char(int hist);
+uint32_t sdram_bist_memtest(uint32_t base, uint32_t size);
+
+#define SDRAM_BIST_PATTERN_SEQUENTIAL 0
+#define SDRAM_BIST_PATTERN_LFSR       1
+#define SDRAM_BIST_PATTERN_ROW_HIT    2
+#define SDRAM_BIST_PATTERN_ROW_MISS   3
+
+void sdram_bist_pattern(int pattern, uint32_t base, uint32_t size, uint32_t burst_length);
 
 #endif /* __SDRAM_BIST_H */
@@ -14,9 +14,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 
 #include <libbase/memtest.h>
 #include <libbase/lfsr.h>
+#include <libbase/crc.h>
+#include <libbase/logbuf.h>
+#include <libbase/spiflash.h>
+#include <libbase/i2c.h>
+
+#include <liblitespi/spiflash.h>
 
 #ifdef CSR_SDRAM_BASE
 #include <generated/sdram_phy.h>
@@ -26,11 +35,14 @@
 
 #include <liblitedram/sdram.h>
 #include <liblitedram/sdram_dbg.h>
+#include <liblitedram/bist.h>
 
 //#define SDRAM_TEST_DISABLE
 //#define SDRAM_WRITE_LEVELING_CMD_DELAY_DEBUG
 //#define SDRAM_WRITE_LATENCY_CALIBRATION_DEBUG
 //#define SDRAM_LEVELING_SCAN_DISPLAY_HEX_DIV 10
+//#define SDRAM_LEVELING_PARALLEL
+//#define SDRAM_LEVELING_BIST
 
 #ifdef CSR_SDRAM_BASE
 
@@ -51,6 +63,50 @@ __attribute__((unused)) void cdelay(int i)
 #endif
 }
 
+/* Calibration delays are derived from the sys_clk frequency rather than given as loop counts: an
+   iteration of the cdelay loop can't take less than a sys_clk cycle, so cdelay(n) lasts at least
+   n cycles on any CPU and no longer than needed on fast ones. */
+#define SDRAM_NS_TO_CYCLES(ns) \
+	((int)(((uint64_t)(ns)*CONFIG_CLOCK_FREQUENCY + 999999999)/1000000000))
+
+/* After a DFII command: tRCD/tRP/tWR/tRTP plus the CL/CWL and DFI/PHY pipeline */
+#ifndef SDRAM_DFII_CMD_DELAY_NS
+#define SDRAM_DFII_CMD_DELAY_NS 50
+#endif
+#ifndef SDRAM_DFII_CMD_DELAY_CYCLES
+#define SDRAM_DFII_CMD_DELAY_CYCLES 16
+#endif
+
+/* After a Mode Register write: tMOD and tWLDQSEN (write leveling) */
+#ifndef SDRAM_DFII_MR_DELAY_NS
+#define SDRAM_DFII_MR_DELAY_NS 200
+#endif
+
+/* After a delay line (IDELAY/ODELAY) tap reset/increment */
+#ifndef SDRAM_TAP_DELAY_NS
+#define SDRAM_TAP_DELAY_NS 100
+#endif
+
+/* PHY reset assertion/release */
+#ifndef SDRAM_PHY_RST_DELAY_NS
+#define SDRAM_PHY_RST_DELAY_NS 10000
+#endif
+
+__attribute__((unused)) static void sdram_cmd_delay(void)
+{
+	cdelay(SDRAM_NS_TO_CYCLES(SDRAM_DFII_CMD_DELAY_NS) + SDRAM_DFII_CMD_DELAY_CYCLES);
+}
+
+__attribute__((unused)) static void sdram_mr_delay(void)
+{
+	cdelay(SDRAM_NS_TO_CYCLES(SDRAM_DFII_MR_DELAY_NS) + SDRAM_DFII_CMD_DELAY_CYCLES);
+}
+
+__attribute__((unused)) static void sdram_tap_delay(void)
+{
+	cdelay(SDRAM_NS_TO_CYCLES(SDRAM_TAP_DELAY_NS));
+}
+
 /*-----------------------------------------------------------------------*/
 /* Constants                                                             */
 /*-----------------------------------------------------------------------*/
@@ -129,16 +185,6 @@ static void sdram_dfii_pix_address_write(unsigned char phase, unsigned int value
 	}
 }
 
-static void sdram_dfii_pird_address_write(unsigned int value) {
-	unsigned char rdphase = sdram_dfii_get_rdphase();
-	sdram_dfii_pix_address_write(rdphase, value);
-}
-
-static void sdram_dfii_piwr_address_write(unsigned int value) {
-	unsigned char wrphase = sdram_dfii_get_wrphase();
-	sdram_dfii_pix_address_write(wrphase, value);
-}
-
 static void sdram_dfii_pix_baddress_write(unsigned char phase, unsigned int value) {
 #if (SDRAM_PHY_PHASES > 8)
 	#error "More than 8 DFI phases not supported"
@@ -161,16 +207,6 @@ static void sdram_dfii_pix_baddress_write(unsigned char phase, unsigned int valu
 	}
 }
 
-static void sdram_dfii_pird_baddress_write(unsigned int value) {
-	unsigned char rdphase = sdram_dfii_get_rdphase();
-	sdram_dfii_pix_baddress_write(rdphase, value);
-}
-
-static void sdram_dfii_piwr_baddress_write(unsigned int value) {
-	unsigned char wrphase = sdram_dfii_get_wrphase();
-	sdram_dfii_pix_baddress_write(wrphase, value);
-}
-
 static void command_px(unsigned char phase, unsigned int value) {
 #if (SDRAM_PHY_PHASES > 8)
 	#error "More than 8 DFI phases not supported"
@@ -193,14 +229,34 @@ static void command_px(unsigned char phase, unsigned int value) {
 	}
 }
 
-static void command_prd(unsigned int value) {
-	unsigned char rdphase = sdram_dfii_get_rdphase();
-	command_px(rdphase, value);
-}
-
-static void command_pwr(unsigned int value) {
-	unsigned char wrphase = sdram_dfii_get_wrphase();
-	command_px(wrphase, value);
+/* Batched DFII commands: issued in order on their phase, each followed by the command delay. The
+   address/bank CSRs of a phase are only written when they differ from the previous command of
+   the sequence on this phase. */
+struct sdram_dfii_cmd {
+	unsigned char phase;
+	unsigned char command;
+	unsigned char baddress;
+	unsigned int address;
+};
+
+static void sdram_dfii_sequence(const struct sdram_dfii_cmd *cmds, int n) {
+	unsigned int written = 0; /* Phases with valid address/bank */
+	unsigned int address[SDRAM_PHY_PHASES];
+	unsigned char baddress[SDRAM_PHY_PHASES];
+	int i, p;
+
+	for (i = 0; i < n; i++) {
+		p = cmds[i].phase;
+		if (!(written & (1 << p)) || address[p] != cmds[i].address)
+			sdram_dfii_pix_address_write(p, cmds[i].address);
+		if (!(written & (1 << p)) || baddress[p] != cmds[i].baddress)
+			sdram_dfii_pix_baddress_write(p, cmds[i].baddress);
+		address[p]  = cmds[i].address;
+		baddress[p] = cmds[i].baddress;
+		written    |= 1 << p;
+		command_px(p, cmds[i].command);
+		sdram_cmd_delay();
+	}
 }
 
 #endif
@@ -256,24 +312,37 @@ void sdram_mode_register_write(char reg, int value) {
 #ifdef CSR_DDRPHY_BASE
 
 /*-----------------------------------------------------------------------*/
-/* Leveling Centering (Common for Read/Write Leveling)                   */
+/* Calibration Results                                                   */
 /*-----------------------------------------------------------------------*/
 
-typedef void (*delay_callback)(int module);
+/* The delays/bitslips of the PHY can only be reset and incremented: the
+   leveling records the values it settles on so that they can be replayed
+   on the next boots (see sdram_calibration_restore()). */
+
+struct sdram_calibration_module {
+	uint16_t wdly;     /* Write leveling DQ/DQS delay */
+	uint16_t wdly_dq;  /* Write DQ-DQS training DQ delay */
+	uint16_t wbitslip; /* Write latency bitslip */
+	uint16_t rdly;     /* Read DQ delay */
+	uint16_t rbitslip; /* Read bitslip */
+};
+
+struct sdram_calibration {
+	uint32_t magic;
+	uint32_t signature;
+	uint32_t temperature;
+	int32_t  cdly;
+	struct sdram_calibration_module modules[SDRAM_PHY_MODULES];
+	uint32_t crc;
+};
+
+static struct sdram_calibration _sdram_calibration;
 
-static void sdram_activate_test_row(void) {
-	sdram_dfii_pi0_address_write(0);
-	sdram_dfii_pi0_baddress_write(0);
-	command_p0(DFII_COMMAND_RAS|DFII_COMMAND_CS);
-	cdelay(15);
-}
+/*-----------------------------------------------------------------------*/
+/* Leveling Centering (Common for Read/Write Leveling)                   */
+/*-----------------------------------------------------------------------*/
 
-static void sdram_precharge_test_row(void) {
-	sdram_dfii_pi0_address_write(0);
-	sdram_dfii_pi0_baddress_write(0);
-	command_p0(DFII_COMMAND_RAS|DFII_COMMAND_WE|DFII_COMMAND_CS);
-	cdelay(15);
-}
+typedef void (*delay_callback)(int module);
 
 // Count number of bits in a 32-bit word, faster version than a while loop
 // see: https://www.johndcook.com/blog/2020/02/21/popcount/
@@ -303,141 +372,314 @@ static void print_scan_errors(unsigned int errors) {
 
 #define READ_CHECK_TEST_PATTERN_MAX_ERRORS (8*SDRAM_PHY_PHASES*DFII_PIX_DATA_BYTES/SDRAM_PHY_MODULES)
 
-static unsigned int sdram_write_read_check_test_pattern(int module, unsigned int seed) {
+/* The pattern is handled as 32-bit words (4 bytes per CSR access) when possible */
+#if ((DFII_PIX_DATA_BYTES) % 4) == 0
+#define DFII_PIX_DATA_WORDS ((DFII_PIX_DATA_BYTES)/4)
+#endif
+
+/* Errors of each module (byte lane) on one write/read burst of the pattern */
+static void sdram_write_read_check_test_pattern_modules(unsigned int seed, unsigned int *errors) {
 	int p, i;
-	unsigned int errors;
+	int module;
 	unsigned int prv;
+#ifdef DFII_PIX_DATA_WORDS
+	uint32_t tst[DFII_PIX_DATA_WORDS];
+	uint32_t prs[SDRAM_PHY_PHASES][DFII_PIX_DATA_WORDS];
+#else
 	unsigned char tst[DFII_PIX_DATA_BYTES];
 	unsigned char prs[SDRAM_PHY_PHASES][DFII_PIX_DATA_BYTES];
+#endif
+	/* Activate, write, read and precharge the test row */
+	const struct sdram_dfii_cmd cmds[4] = {
+		{0,                        DFII_COMMAND_RAS|DFII_COMMAND_CS,                                      0, 0},
+		{sdram_dfii_get_wrphase(), DFII_COMMAND_CAS|DFII_COMMAND_WE|DFII_COMMAND_CS|DFII_COMMAND_WRDATA, 0, 0},
+		{sdram_dfii_get_rdphase(), DFII_COMMAND_CAS|DFII_COMMAND_CS|DFII_COMMAND_RDDATA,                 0, 0},
+		{0,                        DFII_COMMAND_RAS|DFII_COMMAND_WE|DFII_COMMAND_CS,                      0, 0},
+	};
 
 	/* Generate pseudo-random sequence */
 	prv = seed;
 	for(p=0;p<SDRAM_PHY_PHASES;p++) {
 		for(i=0;i<DFII_PIX_DATA_BYTES;i++) {
 			prv = lfsr(32, prv);
+#ifdef DFII_PIX_DATA_WORDS
+			prs[p][i/4] = ((i%4) ? (prs[p][i/4] << 8) : 0) | (prv & 0xff);
+#else
 			prs[p][i] = prv;
+#endif
 		}
 	}
 
-	/* Activate */
-	sdram_activate_test_row();
-
-	/* Write pseudo-random sequence */
+	/* Load pseudo-random sequence */
 	for(p=0;p<SDRAM_PHY_PHASES;p++)
+#ifdef DFII_PIX_DATA_WORDS
+		csr_wr_buf_uint32(sdram_dfii_pix_wrdata_addr(p), prs[p], DFII_PIX_DATA_WORDS);
+#else
 		csr_wr_buf_uint8(sdram_dfii_pix_wrdata_addr(p), prs[p], DFII_PIX_DATA_BYTES);
-	sdram_dfii_piwr_address_write(0);
-	sdram_dfii_piwr_baddress_write(0);
-	command_pwr(DFII_COMMAND_CAS|DFII_COMMAND_WE|DFII_COMMAND_CS|DFII_COMMAND_WRDATA);
-	cdelay(15);
+#endif
 
+	/* Write/Read it back */
 #ifdef SDRAM_PHY_ECP5DDRPHY
+	sdram_dfii_sequence(cmds, 2);
 	ddrphy_burstdet_clr_write(1);
+	sdram_dfii_sequence(cmds + 2, 2);
+#else
+	sdram_dfii_sequence(cmds, 4);
 #endif
 
-	/* Read/Check pseudo-random sequence */
-	sdram_dfii_pird_address_write(0);
-	sdram_dfii_pird_baddress_write(0);
-	command_prd(DFII_COMMAND_CAS|DFII_COMMAND_CS|DFII_COMMAND_RDDATA);
-	cdelay(15);
-
-	/* Precharge */
-	sdram_precharge_test_row();
-
-	errors = 0;
+	for(module=0;module<SDRAM_PHY_MODULES;module++)
+		errors[module] = 0;
 	for(p=0;p<SDRAM_PHY_PHASES;p++) {
+#ifdef DFII_PIX_DATA_WORDS
+		/* Read back test pattern */
+		csr_rd_buf_uint32(sdram_dfii_pix_rddata_addr(p), tst, DFII_PIX_DATA_WORDS);
+		/* Attribute errors to the module of each byte, skipping the matching words */
+		for (i = 0; i < DFII_PIX_DATA_WORDS; ++i) {
+			uint32_t diff = prs[p][i] ^ tst[i];
+			if (diff == 0)
+				continue;
+			for (int b = 0; b < 4; ++b) {
+				int j = p * DFII_PIX_DATA_BYTES + 4*i + b;
+				errors[SDRAM_PHY_MODULES-1-(j % SDRAM_PHY_MODULES)] += popcount((diff >> (24 - 8*b)) & 0xff);
+			}
+		}
+#else
 		/* Read back test pattern */
 		csr_rd_buf_uint8(sdram_dfii_pix_rddata_addr(p), tst, DFII_PIX_DATA_BYTES);
-		/* Verify bytes matching current 'module' */
+		/* Attribute errors to the module of each byte */
 		for (int i = 0; i < DFII_PIX_DATA_BYTES; ++i) {
 			int j = p * DFII_PIX_DATA_BYTES + i;
-			if (j % SDRAM_PHY_MODULES == SDRAM_PHY_MODULES-1-module) {
-				errors += popcount(prs[p][i] ^ tst[i]);
-			}
+			errors[SDRAM_PHY_MODULES-1-(j % SDRAM_PHY_MODULES)] += popcount(prs[p][i] ^ tst[i]);
 		}
+#endif
 	}
 
 #ifdef SDRAM_PHY_ECP5DDRPHY
-	if (((ddrphy_burstdet_seen_read() >> module) & 0x1) != 1)
-		errors += 1;
+	for(module=0;module<SDRAM_PHY_MODULES;module++)
+		if (((ddrphy_burstdet_seen_read() >> module) & 0x1) != 1)
+			errors[module] += 1;
+#endif
+}
+
+static unsigned int sdram_write_read_check_test_pattern(int module, unsigned int seed) {
+	unsigned int errors[SDRAM_PHY_MODULES];
+
+	sdram_write_read_check_test_pattern_modules(seed, errors);
+
+	return errors[module];
+}
+
+/* The delays are scanned coarse to fine: every SDRAM_LEVELING_STRIDE taps, then
+   tap by tap after the last coarse result on each side of a window edge. */
+#ifndef SDRAM_LEVELING_STRIDE
+#if SDRAM_PHY_DELAYS > 32
+#define SDRAM_LEVELING_STRIDE (SDRAM_PHY_DELAYS/32)
+#else
+#define SDRAM_LEVELING_STRIDE 1
+#endif
+#endif
+
+#if SDRAM_PHY_DELAYS > 32
+#define SDRAM_LEVELING_SHOW_DELAY(delay) ((delay)%16 == 0)
+#else
+#define SDRAM_LEVELING_SHOW_DELAY(delay) 1
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* Eye Map                                                               */
+/*-----------------------------------------------------------------------*/
+
+/* With SDRAM_EYE_MAP, the scans of the leveling are kept: DQS sampled high
+   per write leveling tap, errors per (coarse) read delay of each bitslip
+   scanned by the read leveling. Dumped by sdram_eye_map(). */
+#ifdef SDRAM_EYE_MAP
+
+#define SDRAM_EYE_POINTS     (SDRAM_PHY_DELAYS/SDRAM_LEVELING_STRIDE)
+#define SDRAM_EYE_NOT_TESTED 0xff
+
+struct sdram_eye {
+	uint32_t wlevel[SDRAM_PHY_MODULES][(SDRAM_PHY_DELAYS+31)/32];
+	uint8_t  rerrors[SDRAM_PHY_MODULES][SDRAM_PHY_BITSLIPS][SDRAM_EYE_POINTS]; /* Saturated at 254 */
+};
+
+static struct sdram_eye _sdram_eye;
+
+static void sdram_eye_wlevel_record(int module, const unsigned char *taps, int count) {
+	int i;
+
+	memset(_sdram_eye.wlevel[module], 0, sizeof(_sdram_eye.wlevel[module]));
+	for(i = 0; i < count; i++)
+		if (taps[i])
+			_sdram_eye.wlevel[module][i/32] |= 1 << (i%32);
+}
+
+static void sdram_eye_read_clear(void) {
+	memset(_sdram_eye.rerrors, SDRAM_EYE_NOT_TESTED, sizeof(_sdram_eye.rerrors));
+}
+
+static void sdram_eye_read_record(int module, int bitslip, int delay, unsigned int errors) {
+	_sdram_eye.rerrors[module][bitslip][delay/SDRAM_LEVELING_STRIDE] = min(errors, SDRAM_EYE_NOT_TESTED - 1);
+}
+
+void sdram_eye_map(int csv)
+{
+	int module, bitslip;
+	int i, run, width;
+	const uint8_t *e;
+
+	if (csv)
+		printf("sdram_eye,%d,%d,%d,%d,%d\n",
+			SDRAM_PHY_MODULES, SDRAM_PHY_BITSLIPS, SDRAM_PHY_DELAYS, SDRAM_LEVELING_STRIDE, sdram_get_freq());
+#ifdef SDRAM_PHY_WRITE_LEVELING_CAPABLE
+	if (!csv)
+		printf("Write leveling (DQS sampled high):\n");
+	for(module=0; module<SDRAM_PHY_MODULES; module++) {
+		printf(csv ? "wlevel,%d," : "  m%d: |", module);
+		for(i = 0; i < SDRAM_PHY_DELAYS; i++)
+			if (csv || SDRAM_LEVELING_SHOW_DELAY(i))
+				printf("%d", (_sdram_eye.wlevel[module][i/32] >> (i%32)) & 1);
+		printf(csv ? "\n" : "|\n");
+	}
+#endif
+	if (!csv)
+		printf("Read leveling (working delays, width in taps):\n");
+	for(module=0; module<SDRAM_PHY_MODULES; module++) {
+		for(bitslip=0; bitslip<SDRAM_PHY_BITSLIPS; bitslip++) {
+			e = _sdram_eye.rerrors[module][bitslip];
+			if (e[0] == SDRAM_EYE_NOT_TESTED)
+				continue;
+			if (csv) {
+				printf("read,%d,%d", module, bitslip);
+				for(i = 0; i < SDRAM_EYE_POINTS; i++)
+					printf(",%d", e[i]);
+				printf("\n");
+				continue;
+			}
+			printf("  m%d, b%02d: |", module, bitslip);
+			run   = 0;
+			width = 0;
+			for(i = 0; i < SDRAM_EYE_POINTS; i++) {
+				print_scan_errors(e[i]);
+				run   = e[i] == 0 ? run + 1 : 0;
+				width = max(width, run);
+			}
+			printf("| %d\n", width*SDRAM_LEVELING_STRIDE);
+		}
+	}
+}
+
+#endif /* SDRAM_EYE_MAP */
+
+/* With SDRAM_LEVELING_BIST and the BIST generator/checker, the windows found with the
+   DFII patterns are centered again with SDRAM_LEVELING_BIST_LENGTH bytes of random data
+   written/checked at the controller speed (in hardware control). The checker only
+   counts errors for the whole data width: the other modules stay at their centers. */
+#if defined(SDRAM_LEVELING_BIST) && defined(CSR_SDRAM_GENERATOR_BASE) && defined(CSR_SDRAM_CHECKER_BASE)
+
+#define SDRAM_LEVELING_WITH_BIST
+
+#ifndef SDRAM_LEVELING_BIST_LENGTH
+#define SDRAM_LEVELING_BIST_LENGTH (16*1024)
+#endif
+
+static int _sdram_leveling_bist;
+
+static unsigned int sdram_leveling_bist_check(void) {
+	unsigned int errors;
+
+	sdram_dfii_control_write(DFII_CONTROL_HARDWARE);
+	errors = sdram_bist_check(0, SDRAM_LEVELING_BIST_LENGTH, 1);
+	sdram_dfii_control_write(DFII_CONTROL_SOFTWARE);
+
+	return errors;
+}
+
 #endif
 
+static unsigned int sdram_leveling_check_module(int module) {
+	unsigned int errors;
+
+#ifdef SDRAM_LEVELING_WITH_BIST
+	if (_sdram_leveling_bist)
+		return sdram_leveling_bist_check();
+#endif
+
+	errors  = sdram_write_read_check_test_pattern(module, 42);
+	errors += sdram_write_read_check_test_pattern(module, 84);
+
 	return errors;
 }
 
-static void sdram_leveling_center_module(
-	int module, int show_short, int show_long, delay_callback rst_delay, delay_callback inc_delay)
+/* Returns the first delay from start (by steps of stride) where the check is working (or
+   failing), SDRAM_PHY_DELAYS if none. Delays only increment: start is reached from a reset. */
+static int sdram_leveling_search_module(int module, int start, int stride, int working, int show,
+	delay_callback rst_delay, delay_callback inc_delay)
 {
 	int i;
-	int show;
-	int working;
+	int delay;
 	unsigned int errors;
-	int delay, delay_mid, delay_range;
+
+	rst_delay(module);
+	for(i = 0; i < start && i < SDRAM_PHY_DELAYS - 1; i++)
+		inc_delay(module);
+
+	for(delay = start; delay < SDRAM_PHY_DELAYS; delay += stride) {
+		errors = sdram_leveling_check_module(module);
+		if (show && SDRAM_LEVELING_SHOW_DELAY(delay))
+			print_scan_errors(errors);
+		if ((errors == 0) == working)
+			return delay;
+		for(i = 0; i < stride && delay + i + 1 < SDRAM_PHY_DELAYS; i++)
+			inc_delay(module);
+	}
+
+	return SDRAM_PHY_DELAYS;
+}
+
+/* Returns the delay set, in the middle of the working ones */
+static int sdram_leveling_center_module(
+	int module, int show_short, int show_long, delay_callback rst_delay, delay_callback inc_delay)
+{
+	int i;
+	int start;
+	int delay_mid, delay_range;
 	int delay_min = -1, delay_max = -1;
 
 	if (show_long)
 		printf("m%d: |", module);
 
 	/* Find smallest working delay */
-	delay = 0;
-	rst_delay(module);
-	while(1) {
-		errors  = sdram_write_read_check_test_pattern(module, 42);
-		errors += sdram_write_read_check_test_pattern(module, 84);
-		working = errors == 0;
-		show = show_long;
-#if SDRAM_PHY_DELAYS > 32
-		show = show && (delay%16 == 0);
-#endif
-		if (show)
-			print_scan_errors(errors);
-		if(working && delay_min < 0) {
-			delay_min = delay;
-			break;
-		}
-		delay++;
-		if(delay >= SDRAM_PHY_DELAYS)
-			break;
-		inc_delay(module);
-	}
-
-	/* Get a bit further into the working zone */
+	delay_min = sdram_leveling_search_module(module, 0, SDRAM_LEVELING_STRIDE, 1, show_long,
+		rst_delay, inc_delay);
+	if (delay_min > 0 && SDRAM_LEVELING_STRIDE > 1) /* Refine after the last failing */
+		delay_min = sdram_leveling_search_module(module, delay_min - SDRAM_LEVELING_STRIDE + 1, 1, 1, 0,
+			rst_delay, inc_delay);
+
+	if (delay_min >= SDRAM_PHY_DELAYS) {
+		delay_min = -1;
+		delay_max = -1;
+	} else {
+		/* Get a bit further into the working zone */
 #if SDRAM_PHY_DELAYS > 32
-	for(i=0;i<16;i++) {
-		delay += 1;
-		inc_delay(module);
-	}
+		start = delay_min + 16;
 #else
-	delay++;
-	inc_delay(module);
+		start = delay_min + 1;
 #endif
 
-	/* Find largest working delay */
-	while(1) {
-		errors  = sdram_write_read_check_test_pattern(module, 42);
-		errors += sdram_write_read_check_test_pattern(module, 84);
-		working = errors == 0;
-		show = show_long;
-#if SDRAM_PHY_DELAYS > 32
-		show = show && (delay%16 == 0);
-#endif
-		if (show)
-			print_scan_errors(errors);
-		if(!working && delay_max < 0) {
-			delay_max = delay;
-		}
-		delay++;
-		if(delay >= SDRAM_PHY_DELAYS)
-			break;
-		inc_delay(module);
-	}
-	if(delay_max < 0) {
-		delay_max = delay;
+		/* Find largest working delay (first failing one), refine after the last working */
+		delay_max = sdram_leveling_search_module(module,
+			(start + SDRAM_LEVELING_STRIDE - 1)/SDRAM_LEVELING_STRIDE*SDRAM_LEVELING_STRIDE,
+			SDRAM_LEVELING_STRIDE, 0, show_long, rst_delay, inc_delay);
+		if (SDRAM_LEVELING_STRIDE > 1)
+			delay_max = sdram_leveling_search_module(module,
+				max(delay_max - SDRAM_LEVELING_STRIDE + 1, start), 1, 0, 0,
+				rst_delay, inc_delay);
 	}
 
 	if (show_long)
 		printf("| ");
 
-	delay_mid = (delay_min+delay_max)/2 % SDRAM_PHY_DELAYS;
+	delay_mid = delay_min < 0 ? 0 : (delay_min+delay_max)/2 % SDRAM_PHY_DELAYS;
 	delay_range = (delay_max-delay_min)/2;
 	if (show_short) {
 		if (delay_min < 0)
@@ -451,13 +693,162 @@ static void sdram_leveling_center_module(
 
 	/* Set delay to the middle */
 	rst_delay(module);
-    cdelay(100);
+	sdram_tap_delay();
 	for(i = 0; i < delay_mid; i++) {
 		inc_delay(module);
-		cdelay(100);
+		sdram_tap_delay();
+	}
+
+	return delay_mid;
+}
+
+/* Sets the delays of all the modules: the resets, then each increment step, are applied to all
+   the modules before a single tap delay, the waits of the modules overlapping instead of adding
+   up (max(delays)+1 waits instead of sum(delays)+modules). */
+__attribute__((unused)) static void sdram_leveling_set_delays(const int *delays,
+	delay_callback rst_delay, delay_callback inc_delay)
+{
+	int i;
+	int module;
+	int pending;
+
+	for(module=0; module<SDRAM_PHY_MODULES; module++)
+		rst_delay(module);
+	sdram_tap_delay();
+	for(i = 0; ; i++) {
+		pending = 0;
+		for(module=0; module<SDRAM_PHY_MODULES; module++) {
+			if (i < delays[module]) {
+				inc_delay(module);
+				pending = 1;
+			}
+		}
+		if (!pending)
+			break;
+		sdram_tap_delay();
+	}
+}
+
+/* With SDRAM_LEVELING_PARALLEL, the modules are scanned together: each burst of the
+   test pattern checks all the byte lanes, every module advancing its own delay. */
+#ifdef SDRAM_LEVELING_PARALLEL
+
+static void sdram_leveling_check_modules(unsigned int *errors) {
+	int module;
+	unsigned int errors84[SDRAM_PHY_MODULES];
+
+	sdram_write_read_check_test_pattern_modules(42, errors);
+	sdram_write_read_check_test_pattern_modules(84, errors84);
+	for(module=0; module<SDRAM_PHY_MODULES; module++)
+		errors[module] += errors84[module];
+}
+
+/* sdram_leveling_search_module() on all the modules, start >= SDRAM_PHY_DELAYS skipping one */
+static void sdram_leveling_search_modules(const int *start, int stride, int working, int *found,
+	delay_callback rst_delay, delay_callback inc_delay)
+{
+	int i;
+	int module;
+	int pending;
+	int delay[SDRAM_PHY_MODULES];
+	unsigned int errors[SDRAM_PHY_MODULES];
+
+	pending = 0;
+	for(module=0; module<SDRAM_PHY_MODULES; module++) {
+		found[module] = SDRAM_PHY_DELAYS;
+		delay[module] = start[module];
+		if (delay[module] >= SDRAM_PHY_DELAYS)
+			continue;
+		rst_delay(module);
+		for(i = 0; i < delay[module]; i++)
+			inc_delay(module);
+		pending++;
+	}
+
+	while(pending) {
+		sdram_leveling_check_modules(errors);
+		pending = 0;
+		for(module=0; module<SDRAM_PHY_MODULES; module++) {
+			if (found[module] < SDRAM_PHY_DELAYS || delay[module] >= SDRAM_PHY_DELAYS)
+				continue;
+			if ((errors[module] == 0) == working) {
+				found[module] = delay[module];
+				continue;
+			}
+			for(i = 0; i < stride && delay[module] + i + 1 < SDRAM_PHY_DELAYS; i++)
+				inc_delay(module);
+			delay[module] += stride;
+			if (delay[module] < SDRAM_PHY_DELAYS)
+				pending++;
+		}
+	}
+}
+
+/* sdram_leveling_center_module() on all the modules, the delays set returned in delays */
+static void sdram_leveling_center_modules(int show, int *delays,
+	delay_callback rst_delay, delay_callback inc_delay)
+{
+	int module;
+	int start[SDRAM_PHY_MODULES];
+	int found[SDRAM_PHY_MODULES];
+	int delay_min[SDRAM_PHY_MODULES];
+	int delay_max[SDRAM_PHY_MODULES];
+	int skip[SDRAM_PHY_MODULES];
+
+	/* Find smallest working delays */
+	for(module=0; module<SDRAM_PHY_MODULES; module++)
+		start[module] = 0;
+	sdram_leveling_search_modules(start, SDRAM_LEVELING_STRIDE, 1, delay_min, rst_delay, inc_delay);
+	if (SDRAM_LEVELING_STRIDE > 1) {
+		for(module=0; module<SDRAM_PHY_MODULES; module++)
+			start[module] = delay_min[module] > 0 ? delay_min[module] - SDRAM_LEVELING_STRIDE + 1 : SDRAM_PHY_DELAYS;
+		sdram_leveling_search_modules(start, 1, 1, found, rst_delay, inc_delay);
+		for(module=0; module<SDRAM_PHY_MODULES; module++)
+			if (start[module] < SDRAM_PHY_DELAYS)
+				delay_min[module] = found[module];
+	}
+
+	/* Get a bit further into the working zones, find largest working delays */
+	for(module=0; module<SDRAM_PHY_MODULES; module++) {
+#if SDRAM_PHY_DELAYS > 32
+		skip[module] = delay_min[module] + 16;
+#else
+		skip[module] = delay_min[module] + 1;
+#endif
+		start[module] = SDRAM_PHY_DELAYS;
+		if (delay_min[module] < SDRAM_PHY_DELAYS)
+			start[module] = (skip[module] + SDRAM_LEVELING_STRIDE - 1)/SDRAM_LEVELING_STRIDE*SDRAM_LEVELING_STRIDE;
 	}
+	sdram_leveling_search_modules(start, SDRAM_LEVELING_STRIDE, 0, delay_max, rst_delay, inc_delay);
+	if (SDRAM_LEVELING_STRIDE > 1) {
+		for(module=0; module<SDRAM_PHY_MODULES; module++) {
+			start[module] = SDRAM_PHY_DELAYS;
+			if (delay_min[module] < SDRAM_PHY_DELAYS)
+				start[module] = max(delay_max[module] - SDRAM_LEVELING_STRIDE + 1, skip[module]);
+		}
+		sdram_leveling_search_modules(start, 1, 0, found, rst_delay, inc_delay);
+		for(module=0; module<SDRAM_PHY_MODULES; module++)
+			if (start[module] < SDRAM_PHY_DELAYS)
+				delay_max[module] = found[module];
+	}
+
+	/* Set delays to the middle */
+	for(module=0; module<SDRAM_PHY_MODULES; module++) {
+		if (delay_min[module] >= SDRAM_PHY_DELAYS) {
+			delays[module] = 0;
+			if (show)
+				printf("m%d:- ", module);
+		} else {
+			delays[module] = (delay_min[module]+delay_max[module])/2 % SDRAM_PHY_DELAYS;
+			if (show)
+				printf("m%d:%02d+-%02d ", module, delays[module], (delay_max[module]-delay_min[module])/2);
+		}
+	}
+	sdram_leveling_set_delays(delays, rst_delay, inc_delay);
 }
 
+#endif /* SDRAM_LEVELING_PARALLEL */
+
 /*-----------------------------------------------------------------------*/
 /* Write Leveling                                                        */
 /*-----------------------------------------------------------------------*/
@@ -474,6 +865,26 @@ int _sdram_write_leveling_dat_delays[16];
 int _sdram_write_leveling_cdly_range_start = -1;
 int _sdram_write_leveling_cdly_range_end   = -1;
 
+/* Samples after which a tap is decided when all of them agree */
+#ifndef SDRAM_WRITE_LEVELING_UNANIMOUS_SAMPLES
+#define SDRAM_WRITE_LEVELING_UNANIMOUS_SAMPLES 4
+#endif
+
+/* Results of the Cmd/Clk delays already scanned, re-used by the refinement passes */
+#define SDRAM_WRITE_LEVELING_CDLY_CACHE 64
+
+struct sdram_write_leveling_cdly_result {
+	int cdly;
+	int ok;
+	unsigned int error;
+	unsigned int count;
+};
+
+struct sdram_write_leveling_cdly_cache {
+	int len;
+	struct sdram_write_leveling_cdly_result results[SDRAM_WRITE_LEVELING_CDLY_CACHE];
+};
+
 static void sdram_write_leveling_on(void)
 {
 	// Flip write leveling bit in the Mode Register, as it is disabled by default
@@ -518,10 +929,10 @@ void sdram_write_leveling_force_cmd_delay(int taps, int show) {
 	if (show)
 		printf("Forcing Cmd delay to %d taps\n", taps);
 	ddrphy_cdly_rst_write(1);
-	cdelay(100);
+	sdram_tap_delay();
 	for (i=0; i<taps; i++) {
 		ddrphy_cdly_inc_write(1);
-		cdelay(100);
+		sdram_tap_delay();
 	}
 }
 
@@ -560,13 +971,13 @@ static void sdram_write_leveling_rst_delay(int module) {
 	/* Reset DQS delay */
 	while (ddrphy_wdly_dqs_inc_count_read() != 0) {
 		ddrphy_wdly_dqs_inc_write(1);
-		cdelay(100);
+		sdram_tap_delay();
 	}
 #else
 	/* Reset DQ/DQS delay */
 	ddrphy_wdly_dq_rst_write(1);
 	ddrphy_wdly_dqs_rst_write(1);
-	cdelay(100);
+	sdram_tap_delay();
 #endif
 
 	/* Un-select module */
@@ -598,20 +1009,21 @@ static int sdram_write_leveling_scan(int *delays, int loops, int show)
 	int one_window_count, one_window_best_count;
 
 	unsigned char buf[DFII_PIX_DATA_BYTES];
+	int wdly[SDRAM_PHY_MODULES];
 
 	int ok;
 
 	err_ddrphy_wdly = SDRAM_PHY_DELAYS - _sdram_tck_taps/4;
 
 	sdram_write_leveling_on();
-	cdelay(100);
+	sdram_mr_delay();
 	for(i=0;i<SDRAM_PHY_MODULES;i++) {
 		if (show)
 			printf("  m%d: |", i);
 
 		/* Reset delay */
 		sdram_write_leveling_rst_delay(i);
-		cdelay(100);
+		sdram_tap_delay();
 
 		/* Scan write delay taps */
 		for(j=0;j<err_ddrphy_wdly;j++) {
@@ -623,12 +1035,17 @@ static int sdram_write_leveling_scan(int *delays, int loops, int show)
 #endif
 			for (k=0; k<loops; k++) {
 				ddrphy_wlevel_strobe_write(1);
-				cdelay(100);
+				sdram_cmd_delay();
 				csr_rd_buf_uint8(sdram_dfii_pix_rddata_addr(0), buf, DFII_PIX_DATA_BYTES);
 				if (buf[SDRAM_PHY_MODULES-1-i] != 0)
 					one_count++;
 				else
 					zero_count++;
+				/* Stop when the majority is reached or when the first samples are unanimous */
+				if ((2*one_count > loops) || (2*zero_count >= loops))
+					break;
+				if ((k + 1 >= SDRAM_WRITE_LEVELING_UNANIMOUS_SAMPLES) && (one_count == 0 || zero_count == 0))
+					break;
 			}
 			if (one_count > zero_count)
 				taps_scan[j] = 1;
@@ -637,10 +1054,13 @@ static int sdram_write_leveling_scan(int *delays, int loops, int show)
 			if (show_iter)
 				printf("%d", taps_scan[j]);
 			sdram_write_leveling_inc_delay(i);
-			cdelay(100);
+			sdram_tap_delay();
 		}
 		if (show)
 			printf("|");
+#ifdef SDRAM_EYE_MAP
+		sdram_eye_wlevel_record(i, taps_scan, err_ddrphy_wdly);
+#endif
 
 		/* Find longer 1 window and set delay at the 0/1 transition */
 		one_window_active = 0;
@@ -667,19 +1087,9 @@ static int sdram_write_leveling_scan(int *delays, int loops, int show)
 			}
 		}
 
-		/* Reset delay */
-		sdram_write_leveling_rst_delay(i);
-		cdelay(100);
-
 		/* Use forced delay if configured */
 		if (_sdram_write_leveling_dat_delays[i] >= 0) {
 			delays[i] = _sdram_write_leveling_dat_delays[i];
-
-			/* Configure write delay */
-			for(j=0; j<delays[i]; j++)  {
-				sdram_write_leveling_inc_delay(i);
-				cdelay(100);
-			}
 		/* Succeed only if the start of a 1s window has been found: */
 		} else if (
 			/* Start of 1s window directly seen after 0. */
@@ -692,13 +1102,9 @@ static int sdram_write_leveling_scan(int *delays, int loops, int show)
 			one_window_start -= min(one_window_start, 16);
 #endif
 			delays[i] = one_window_best_start;
-
-			/* Configure write delay */
-			for(j=0; j<delays[i]; j++) {
-				sdram_write_leveling_inc_delay(i);
-				cdelay(100);
-			}
 		}
+		_sdram_calibration.modules[i].wdly = max(delays[i], 0);
+		wdly[i] = _sdram_calibration.modules[i].wdly;
 		if (show) {
 			if (delays[i] == -1)
 				printf(" delay: -\n");
@@ -707,6 +1113,9 @@ static int sdram_write_leveling_scan(int *delays, int loops, int show)
 		}
 	}
 
+	/* Configure the write delays of all the modules at once */
+	sdram_leveling_set_delays(wdly, sdram_write_leveling_rst_delay, sdram_write_leveling_inc_delay);
+
 	sdram_write_leveling_off();
 
 	ok = 1;
@@ -718,31 +1127,51 @@ static int sdram_write_leveling_scan(int *delays, int loops, int show)
 	return ok;
 }
 
+static struct sdram_write_leveling_cdly_result *sdram_write_leveling_cdly_cache_find(
+		struct sdram_write_leveling_cdly_cache *cache, int cdly)
+{
+	int i;
+	for (i = 0; i < cache->len; i++)
+		if (cache->results[i].cdly == cdly)
+			return &cache->results[i];
+	return NULL;
+}
+
 static void sdram_write_leveling_find_cmd_delay(unsigned int *best_error, unsigned int *best_count, int *best_cdly,
-		int cdly_start, int cdly_stop, int cdly_step)
+		int cdly_start, int cdly_stop, int cdly_step, struct sdram_write_leveling_cdly_cache *cache)
 {
 	int cdly;
 	int cdly_actual = 0;
 	int delays[SDRAM_PHY_MODULES];
-#ifndef SDRAM_WRITE_LEVELING_CMD_DELAY_DEBUG
 	int ok;
-#endif
+	struct sdram_write_leveling_cdly_result *cached;
 
 	/* Scan through the range */
 	ddrphy_cdly_rst_write(1);
-	cdelay(100);
+	sdram_tap_delay();
 	for (cdly = cdly_start; cdly < cdly_stop; cdly += cdly_step) {
 		/* Increment cdly to current value */
 		while (cdly_actual < cdly) {
 			ddrphy_cdly_inc_write(1);
-			cdelay(100);
+			sdram_tap_delay();
 			cdly_actual++;
 		}
 
+		/* Already scanned by a previous pass, nothing new to learn */
+		cached = sdram_write_leveling_cdly_cache_find(cache, cdly);
+		if (cached != NULL) {
+#ifdef SDRAM_WRITE_LEVELING_CMD_DELAY_DEBUG
+			printf("Cmd/Clk delay: %d (already scanned)\n", cdly);
+#else
+			printf("%d", cached->ok);
+#endif
+			continue;
+		}
+
 		/* Write level using this delay */
 #ifdef SDRAM_WRITE_LEVELING_CMD_DELAY_DEBUG
 		printf("Cmd/Clk delay: %d\n", cdly);
-		sdram_write_leveling_scan(delays, 8, 1);
+		ok = sdram_write_leveling_scan(delays, 8, 1);
 #else
 		ok = sdram_write_leveling_scan(delays, 8, 0);
 #endif
@@ -771,6 +1200,13 @@ static void sdram_write_leveling_find_cmd_delay(unsigned int *best_error, unsign
 				*best_count = delay_count;
 			}
 		}
+		if (cache->len < SDRAM_WRITE_LEVELING_CDLY_CACHE) {
+			cache->results[cache->len].cdly  = cdly;
+			cache->results[cache->len].ok    = ok;
+			cache->results[cache->len].error = error;
+			cache->results[cache->len].count = delay_count;
+			cache->len++;
+		}
 #ifdef SDRAM_WRITE_LEVELING_CMD_DELAY_DEBUG
 		printf("Delay mean: %d, ideal: %d\n", delay_mean, ideal_delay);
 #else
@@ -788,7 +1224,9 @@ int sdram_write_leveling(void)
 	int cdly_range_start;
 	int cdly_range_end;
 	int cdly_range_step;
+	static struct sdram_write_leveling_cdly_cache cdly_cache;
 
+	cdly_cache.len = 0;
 	_sdram_tck_taps = ddrphy_half_sys8x_taps_read()*4;
 	printf("  tCK equivalent taps: %d\n", _sdram_tck_taps);
 
@@ -813,7 +1251,7 @@ int sdram_write_leveling(void)
 		while (cdly_range_step > 0) {
 			printf("  |");
 			sdram_write_leveling_find_cmd_delay(&best_error, &best_count, &best_cdly,
-					cdly_range_start, cdly_range_end, cdly_range_step);
+					cdly_range_start, cdly_range_end, cdly_range_step, &cdly_cache);
 
 			/* Small optimization - stop if we have zero error */
 			if (best_error == 0)
@@ -834,13 +1272,14 @@ int sdram_write_leveling(void)
 		best_cdly = _sdram_write_leveling_cmd_delay;
 	}
 	printf("  Setting Cmd/Clk delay to %d taps.\n", best_cdly);
+	_sdram_calibration.cdly = best_cdly;
 	/* Set working or forced delay */
 	if (best_cdly >= 0) {
 		ddrphy_cdly_rst_write(1);
-		cdelay(100);
+		sdram_tap_delay();
 		for (int i = 0; i < best_cdly; ++i) {
 			ddrphy_cdly_inc_write(1);
-			cdelay(100);
+			sdram_tap_delay();
 		}
 	}
 
@@ -918,33 +1357,35 @@ static void sdram_read_leveling_inc_bitslip(char m)
 	ddrphy_dly_sel_write(0);
 }
 
+/* Any score above this one has working delays */
+#define READ_LEVELING_SCORE_WORKING (2*READ_CHECK_TEST_PATTERN_MAX_ERRORS*SDRAM_PHY_DELAYS)
+
 static unsigned int sdram_read_leveling_scan_module(int module, int bitslip, int show)
 {
 	const unsigned int max_errors = 2*READ_CHECK_TEST_PATTERN_MAX_ERRORS;
-	int i;
+	int i, j;
 	unsigned int score;
 	unsigned int errors;
 
-	/* Check test pattern for each delay value */
+	/* Check test pattern for each (coarse) delay value */
 	score = 0;
 	if (show)
 		printf("  m%d, b%02d: |", module, bitslip);
 	sdram_read_leveling_rst_delay(module);
-	for(i=0;i<SDRAM_PHY_DELAYS;i++) {
+	for(i=0;i<SDRAM_PHY_DELAYS;i+=SDRAM_LEVELING_STRIDE) {
 		int working;
-		int _show = show;
-#if SDRAM_PHY_DELAYS > 32
-		_show = (i%16 == 0) & show;
+		errors = sdram_leveling_check_module(module);
+#ifdef SDRAM_EYE_MAP
+		sdram_eye_read_record(module, bitslip, i, errors);
 #endif
-		errors  = sdram_write_read_check_test_pattern(module, 42);
-		errors += sdram_write_read_check_test_pattern(module, 84);
 		working = errors == 0;
 		/* When any scan is working then the final score will always be higher then if no scan was working */
-		score += (working * max_errors*SDRAM_PHY_DELAYS) + (max_errors - errors);
-		if (_show) {
+		score += SDRAM_LEVELING_STRIDE*((working * max_errors*SDRAM_PHY_DELAYS) + (max_errors - errors));
+		if (show && SDRAM_LEVELING_SHOW_DELAY(i)) {
 			print_scan_errors(errors);
 		}
-		sdram_read_leveling_inc_delay(module);
+		for(j=0;j<SDRAM_LEVELING_STRIDE;j++)
+			sdram_read_leveling_inc_delay(module);
 	}
 	if (show)
 		printf("| ");
@@ -952,6 +1393,34 @@ static unsigned int sdram_read_leveling_scan_module(int module, int bitslip, int
 	return score;
 }
 
+#ifdef SDRAM_LEVELING_PARALLEL
+static void sdram_read_leveling_scan_modules(int bitslip, unsigned int *scores)
+{
+	const unsigned int max_errors = 2*READ_CHECK_TEST_PATTERN_MAX_ERRORS;
+	int i, j;
+	int module;
+	unsigned int errors[SDRAM_PHY_MODULES];
+
+	/* Check test pattern for each (coarse) delay value, on all the modules at once */
+	for(module=0; module<SDRAM_PHY_MODULES; module++) {
+		scores[module] = 0;
+		sdram_read_leveling_rst_delay(module);
+	}
+	for(i=0;i<SDRAM_PHY_DELAYS;i+=SDRAM_LEVELING_STRIDE) {
+		sdram_leveling_check_modules(errors);
+		for(module=0; module<SDRAM_PHY_MODULES; module++) {
+#ifdef SDRAM_EYE_MAP
+			sdram_eye_read_record(module, bitslip, i, errors[module]);
+#endif
+			scores[module] += SDRAM_LEVELING_STRIDE*(((errors[module] == 0) * max_errors*SDRAM_PHY_DELAYS) +
+				(max_errors - errors[module]));
+			for(j=0;j<SDRAM_LEVELING_STRIDE;j++)
+				sdram_read_leveling_inc_delay(module);
+		}
+	}
+}
+#endif
+
 #endif /* CSR_DDRPHY_BASE */
 
 #endif /* CSR_SDRAM_BASE */
@@ -960,32 +1429,102 @@ static unsigned int sdram_read_leveling_scan_module(int module, int bitslip, int
 
 #if defined(SDRAM_PHY_WRITE_LEVELING_CAPABLE) || defined(SDRAM_PHY_READ_LEVELING_CAPABLE)
 
+#ifdef SDRAM_LEVELING_PARALLEL
 void sdram_read_leveling(void)
 {
 	int module;
 	int bitslip;
-	unsigned int score;
-	unsigned int best_score;
-	int best_bitslip;
+	int done;
+	int delays[SDRAM_PHY_MODULES];
+	unsigned int scores[SDRAM_PHY_MODULES];
+	unsigned int best_scores[SDRAM_PHY_MODULES];
+	int best_bitslips[SDRAM_PHY_MODULES];
 
+#ifdef SDRAM_EYE_MAP
+	sdram_eye_read_clear();
+#endif
 	for(module=0; module<SDRAM_PHY_MODULES; module++) {
-		/* Scan possible read windows */
-		best_score = 0;
+		best_scores[module]   = 0;
+		best_bitslips[module] = 0;
+		sdram_read_leveling_rst_bitslip(module);
+	}
+
+	/* Scan possible read windows of all the modules */
+	for(bitslip=0; bitslip<SDRAM_PHY_BITSLIPS; bitslip++) {
+		printf("  b%02d: ", bitslip);
+		sdram_read_leveling_scan_modules(bitslip, scores);
+		sdram_leveling_center_modules(1, delays,
+			sdram_read_leveling_rst_delay, sdram_read_leveling_inc_delay);
+		printf("\n");
+		done = 1;
+		for(module=0; module<SDRAM_PHY_MODULES; module++) {
+			if (scores[module] > best_scores[module]) {
+				best_bitslips[module] = bitslip;
+				best_scores[module]   = scores[module];
+			}
+			if (best_scores[module] <= READ_LEVELING_SCORE_WORKING || scores[module] > READ_LEVELING_SCORE_WORKING)
+				done = 0;
+		}
+		/* Exit (once past the read window of every module) */
+		if (done || bitslip == SDRAM_PHY_BITSLIPS-1)
+			break;
+		for(module=0; module<SDRAM_PHY_MODULES; module++)
+			sdram_read_leveling_inc_bitslip(module);
+	}
+
+	/* Select best read windows */
+	printf("  best: ");
+	for(module=0; module<SDRAM_PHY_MODULES; module++) {
+		printf("m%d:b%02d ", module, best_bitslips[module]);
+		sdram_read_leveling_rst_bitslip(module);
+		for (bitslip=0; bitslip<best_bitslips[module]; bitslip++)
+			sdram_read_leveling_inc_bitslip(module);
+		_sdram_calibration.modules[module].rbitslip = best_bitslips[module];
+	}
+	printf("\n        ");
+
+	/* Re-do leveling on best read windows */
+	sdram_leveling_center_modules(1, delays,
+		sdram_read_leveling_rst_delay, sdram_read_leveling_inc_delay);
+	for(module=0; module<SDRAM_PHY_MODULES; module++)
+		_sdram_calibration.modules[module].rdly = delays[module];
+	printf("\n");
+}
+#else
+void sdram_read_leveling(void)
+{
+	int module;
+	int bitslip;
+	unsigned int score;
+	unsigned int best_score;
+	int best_bitslip;
+
+#ifdef SDRAM_EYE_MAP
+	sdram_eye_read_clear();
+#endif
+	for(module=0; module<SDRAM_PHY_MODULES; module++) {
+		/* Scan possible read windows */
+		best_score = 0;
 		best_bitslip = 0;
 		sdram_read_leveling_rst_bitslip(module);
 		for(bitslip=0; bitslip<SDRAM_PHY_BITSLIPS; bitslip++) {
 			/* Compute score */
 			score = sdram_read_leveling_scan_module(module, bitslip, 1);
-			sdram_leveling_center_module(module, 1, 0,
-				sdram_read_leveling_rst_delay, sdram_read_leveling_inc_delay);
+			if (score > READ_LEVELING_SCORE_WORKING)
+				sdram_leveling_center_module(module, 1, 0,
+					sdram_read_leveling_rst_delay, sdram_read_leveling_inc_delay);
+			else
+				printf("delays: -");
 			printf("\n");
 			if (score > best_score) {
 				best_bitslip = bitslip;
 				best_score = score;
 			}
-			/* Exit */
+			/* Exit (the read window spans consecutive bitslips: done after it) */
 			if (bitslip == SDRAM_PHY_BITSLIPS-1)
 				break;
+			if (best_score > READ_LEVELING_SCORE_WORKING && score <= READ_LEVELING_SCORE_WORKING)
+				break;
 			/* Increment bitslip */
 			sdram_read_leveling_inc_bitslip(module);
 		}
@@ -997,11 +1536,13 @@ void sdram_read_leveling(void)
 			sdram_read_leveling_inc_bitslip(module);
 
 		/* Re-do leveling on best read window*/
-		sdram_leveling_center_module(module, 1, 0,
+		_sdram_calibration.modules[module].rbitslip = best_bitslip;
+		_sdram_calibration.modules[module].rdly = sdram_leveling_center_module(module, 1, 0,
 			sdram_read_leveling_rst_delay, sdram_read_leveling_inc_delay);
 		printf("\n");
 	}
 }
+#endif
 
 /*-----------------------------------------------------------------------*/
 /* Write latency calibration                                             */
@@ -1069,6 +1610,7 @@ static void sdram_write_latency_calibration(void) {
 #endif
 
 		/* Select best write window */
+		_sdram_calibration.modules[module].wbitslip = max(bitslip, 0);
 		ddrphy_dly_sel_write(1 << module);
 
 		/* Reset bitslip */
@@ -1099,13 +1641,13 @@ static void sdram_write_dq_dqs_training_rst_delay(int module) {
 	int dq_count = ddrphy_wdly_dqs_inc_count_read();
 	while (dq_count != SDRAM_PHY_DELAYS) {
 		ddrphy_wdly_dq_inc_write(1);
-		cdelay(100);
+		sdram_tap_delay();
 		dq_count++;
 	}
 #else
 	/* Reset DQ delay */
 	ddrphy_wdly_dq_rst_write(1);
-	cdelay(100);
+	sdram_tap_delay();
 #endif
 
 	/* Un-select module */
@@ -1117,7 +1659,7 @@ static void sdram_write_dq_dqs_training_inc_delay(int module) {
 	ddrphy_dly_sel_write(1 << module);
 	/* Increment delay */
 	ddrphy_wdly_dq_inc_write(1);
-	cdelay(100);
+	sdram_tap_delay();
 	/* Un-select module */
 	ddrphy_dly_sel_write(0);
 }
@@ -1132,14 +1674,14 @@ static void sdram_read_leveling_best_bitslip(int module)
 	sdram_read_leveling_rst_bitslip(module);
 	for(bitslip=0; bitslip<SDRAM_PHY_BITSLIPS; bitslip++) {
 		score = sdram_read_leveling_scan_module(module, bitslip, 0);
-		sdram_leveling_center_module(module, 0, 0,
-			sdram_read_leveling_rst_delay, sdram_read_leveling_inc_delay);
 		if (score > best_score) {
 			best_bitslip = bitslip;
 			best_score = score;
 		}
 		if (bitslip == SDRAM_PHY_BITSLIPS-1)
 			break;
+		if (best_score > READ_LEVELING_SCORE_WORKING && score <= READ_LEVELING_SCORE_WORKING)
+			break;
 		sdram_read_leveling_inc_bitslip(module);
 	}
 
@@ -1147,25 +1689,88 @@ static void sdram_read_leveling_best_bitslip(int module)
 	sdram_read_leveling_rst_bitslip(module);
 	for (bitslip=0; bitslip<best_bitslip; bitslip++)
 		sdram_read_leveling_inc_bitslip(module);
-	sdram_leveling_center_module(module, 0, 0,
+	_sdram_calibration.modules[module].rbitslip = best_bitslip;
+	_sdram_calibration.modules[module].rdly = sdram_leveling_center_module(module, 0, 0,
 		sdram_read_leveling_rst_delay, sdram_read_leveling_inc_delay);
 }
 
 static void sdram_write_dq_dqs_training(void)
 {
 	int module;
+#ifdef SDRAM_LEVELING_PARALLEL
+	int delays[SDRAM_PHY_MODULES];
 
+	/* Find best bitslips, then center the DQ-DQS windows of all the modules together */
+	for(module=0; module<SDRAM_PHY_MODULES; module++)
+		sdram_read_leveling_best_bitslip(module);
+	printf("  ");
+	sdram_leveling_center_modules(1, delays,
+		sdram_write_dq_dqs_training_rst_delay, sdram_write_dq_dqs_training_inc_delay);
+	printf("\n");
+	for(module=0; module<SDRAM_PHY_MODULES; module++)
+		_sdram_calibration.modules[module].wdly_dq = delays[module];
+#else
 	for(module=0; module<SDRAM_PHY_MODULES; module++) {
 		/* Find best bitslip */
 		sdram_read_leveling_best_bitslip(module);
 		/* Center DQ-DQS window */
-		sdram_leveling_center_module(module, 1, 1,
+		_sdram_calibration.modules[module].wdly_dq = sdram_leveling_center_module(module, 1, 1,
 			sdram_write_dq_dqs_training_rst_delay, sdram_write_dq_dqs_training_inc_delay);
 	}
+#endif
 }
 
 #endif /* SDRAM_PHY_WRITE_DQ_DQS_TRAINING_CAPABLE */
 
+/*-----------------------------------------------------------------------*/
+/* BIST Refinement                                                       */
+/*-----------------------------------------------------------------------*/
+
+#ifdef SDRAM_LEVELING_WITH_BIST
+
+static void sdram_leveling_bist_refine_module(int module, const char *name, uint16_t *delay,
+	delay_callback rst_delay, delay_callback inc_delay)
+{
+	int i;
+
+	printf("  %s m%d: ", name, module);
+	i = sdram_leveling_center_module(module, 1, 0, rst_delay, inc_delay);
+	if (sdram_leveling_bist_check() == 0)
+		*delay = i;
+	else {
+		/* No working window with the BIST patterns, keep the DFII one */
+		printf(" (kept %02d)", *delay);
+		rst_delay(module);
+		for(i = 0; i < *delay; i++)
+			inc_delay(module);
+	}
+	printf("\n");
+}
+
+static void sdram_leveling_bist_refine(void)
+{
+	int module;
+
+	_sdram_leveling_bist = 1;
+	if (sdram_leveling_bist_check() != 0)
+		printf("  Errors with the DFII leveling, skipped\n");
+	else {
+		for(module=0; module<SDRAM_PHY_MODULES; module++) {
+#ifdef SDRAM_PHY_WRITE_DQ_DQS_TRAINING_CAPABLE
+			sdram_leveling_bist_refine_module(module, "wdly_dq", &_sdram_calibration.modules[module].wdly_dq,
+				sdram_write_dq_dqs_training_rst_delay, sdram_write_dq_dqs_training_inc_delay);
+#endif
+#ifdef SDRAM_PHY_READ_LEVELING_CAPABLE
+			sdram_leveling_bist_refine_module(module, "rdly", &_sdram_calibration.modules[module].rdly,
+				sdram_read_leveling_rst_delay, sdram_read_leveling_inc_delay);
+#endif
+		}
+	}
+	_sdram_leveling_bist = 0;
+}
+
+#endif /* SDRAM_LEVELING_WITH_BIST */
+
 /*-----------------------------------------------------------------------*/
 /* Leveling                                                              */
 /*-----------------------------------------------------------------------*/
@@ -1173,8 +1778,13 @@ static void sdram_write_dq_dqs_training(void)
 int sdram_leveling(void)
 {
 	int module;
+	/* The scans print while leveling, the UART at the end */
+	logbuf_defer_start();
 	sdram_software_control_on();
 
+	memset(&_sdram_calibration, 0, sizeof(_sdram_calibration));
+	_sdram_calibration.cdly = -1;
+
 	for(module=0; module<SDRAM_PHY_MODULES; module++) {
 #ifdef SDRAM_PHY_WRITE_LEVELING_CAPABLE
 		sdram_write_leveling_rst_delay(module);
@@ -1203,10 +1813,493 @@ int sdram_leveling(void)
 	sdram_read_leveling();
 #endif
 
+#ifdef SDRAM_LEVELING_WITH_BIST
+	printf("BIST leveling refinement:\n");
+	sdram_leveling_bist_refine();
+#endif
+
 	sdram_software_control_off();
+	logbuf_defer_stop();
+
+	return 1;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Calibration Cache                                                     */
+/*-----------------------------------------------------------------------*/
+
+/* With SDRAM_CALIBRATION_FLASH_OFFSET (offset of an erase sector reserved
+   in the SPI Flash), the results of the leveling are saved to the flash and
+   replayed on the next boots, the full leveling only running again when
+   the gateware, the temperature or the verification of the replayed values
+   change. The flash is written before spiflash_init() (still in SPI mode). */
+
+#if defined(SDRAM_CALIBRATION_FLASH_OFFSET) && defined(SPIFLASH_BASE) && \
+	(defined(CSR_SPIFLASH_CORE_MASTER_CS_ADDR) || (defined(CSR_SPIFLASH_BASE) && defined(SPIFLASH_PAGE_SIZE)))
+
+#define SDRAM_CALIBRATION_CACHE
+
+#define SDRAM_CALIBRATION_MAGIC 0x4c434453 /* "SDCL" */
+
+/* Maximum temperature drift (in raw XADC units, ~8/°C on 7-Series) */
+#ifndef SDRAM_CALIBRATION_TEMPERATURE_DELTA
+#define SDRAM_CALIBRATION_TEMPERATURE_DELTA 80
+#endif
+
+#define SDRAM_CALIBRATION_CHECK_PATTERNS 8
+
+static uint32_t sdram_calibration_signature(void)
+{
+	const uint32_t params[] = {
+		SDRAM_PHY_MODULES, SDRAM_PHY_DELAYS, SDRAM_PHY_BITSLIPS,
+		CONFIG_CLOCK_FREQUENCY, sizeof(struct sdram_calibration)
+	};
+	uint32_t signature;
+#ifdef CSR_IDENTIFIER_MEM_BASE
+	unsigned char c;
+	int i;
+#endif
+
+	signature = crc32((const unsigned char *) params, sizeof(params));
+#ifdef CSR_IDENTIFIER_MEM_BASE
+	/* The identifier holds the build date of the gateware */
+	for(i=0;i<256;i++) {
+		c = MMPTR(CSR_IDENTIFIER_MEM_BASE + CONFIG_CSR_ALIGNMENT/8*i);
+		if (c == 0)
+			break;
+		signature = crc32_update(signature, &c, 1);
+	}
+#endif
+	return signature;
+}
+
+static uint32_t sdram_calibration_temperature(void)
+{
+#ifdef CSR_XADC_TEMPERATURE_ADDR
+	return xadc_temperature_read();
+#else
+	return 0;
+#endif
+}
+
+static void sdram_calibration_replay(const struct sdram_calibration *c)
+{
+	const struct sdram_calibration_module *m;
+	int delays[SDRAM_PHY_MODULES];
+	int module;
+	int i;
+
+#ifdef SDRAM_PHY_WRITE_LEVELING_CAPABLE
+	if (c->cdly >= 0) {
+		ddrphy_cdly_rst_write(1);
+		sdram_tap_delay();
+		for (i=0; i<c->cdly; i++) {
+			ddrphy_cdly_inc_write(1);
+			sdram_tap_delay();
+		}
+	}
+#endif
+#ifdef SDRAM_PHY_WRITE_LEVELING_CAPABLE
+	for(module=0; module<SDRAM_PHY_MODULES; module++)
+		delays[module] = c->modules[module].wdly;
+	sdram_leveling_set_delays(delays, sdram_write_leveling_rst_delay, sdram_write_leveling_inc_delay);
+#endif
+	for(module=0; module<SDRAM_PHY_MODULES; module++) {
+		m = &c->modules[module];
+#ifdef SDRAM_PHY_WRITE_LATENCY_CALIBRATION_CAPABLE
+		ddrphy_dly_sel_write(1 << module);
+		ddrphy_wdly_dq_bitslip_rst_write(1);
+		for (i=0; i<m->wbitslip; i++)
+			ddrphy_wdly_dq_bitslip_write(1);
+		ddrphy_dly_sel_write(0);
+#endif
+#ifdef SDRAM_PHY_WRITE_DQ_DQS_TRAINING_CAPABLE
+		sdram_write_dq_dqs_training_rst_delay(module);
+		for (i=0; i<m->wdly_dq; i++)
+			sdram_write_dq_dqs_training_inc_delay(module);
+#endif
+		sdram_read_leveling_rst_bitslip(module);
+		for (i=0; i<m->rbitslip; i++)
+			sdram_read_leveling_inc_bitslip(module);
+		delays[module] = m->rdly;
+	}
+	sdram_leveling_set_delays(delays, sdram_read_leveling_rst_delay, sdram_read_leveling_inc_delay);
+}
+
+/* Quick verification: a few test patterns on each module */
+static int sdram_calibration_check(void)
+{
+	int module;
+	int n;
+
+	for(module=0; module<SDRAM_PHY_MODULES; module++) {
+		for(n=1; n<=SDRAM_CALIBRATION_CHECK_PATTERNS; n++) {
+			if (sdram_write_read_check_test_pattern(module, 42*n) != 0)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+static int sdram_calibration_restore(void)
+{
+	struct sdram_calibration c;
+	uint32_t temperature;
+	int ok;
+
+	memcpy(&c, (void *)(SPIFLASH_BASE + SDRAM_CALIBRATION_FLASH_OFFSET), sizeof(c));
+	if ((c.magic != SDRAM_CALIBRATION_MAGIC) ||
+		(c.crc != crc32((const unsigned char *) &c, offsetof(struct sdram_calibration, crc))))
+		return 0;
+	if (c.signature != sdram_calibration_signature()) {
+		printf("Saved calibration is for another gateware.\n");
+		return 0;
+	}
+	temperature = sdram_calibration_temperature();
+	if (abs((int) temperature - (int) c.temperature) > SDRAM_CALIBRATION_TEMPERATURE_DELTA) {
+		printf("Saved calibration is for another temperature.\n");
+		return 0;
+	}
+
+	printf("Restoring saved calibration...\n");
+	sdram_software_control_on();
+	sdram_calibration_replay(&c);
+	ok = sdram_calibration_check();
+	sdram_software_control_off();
+	if (!ok) {
+		printf("Saved calibration verification failed.\n");
+		return 0;
+	}
+	_sdram_calibration = c;
+
+	return 1;
+}
+
+static void sdram_calibration_save(void)
+{
+	struct sdram_calibration *c = &_sdram_calibration;
+	int ok;
+
+	/* Only save values that pass the verification */
+	sdram_software_control_on();
+	ok = sdram_calibration_check();
+	sdram_software_control_off();
+	if (!ok)
+		return;
+
+	c->magic       = SDRAM_CALIBRATION_MAGIC;
+	c->signature   = sdram_calibration_signature();
+	c->temperature = sdram_calibration_temperature();
+	c->crc         = crc32((const unsigned char *) c, offsetof(struct sdram_calibration, crc));
+	if (memcmp(c, (void *)(SPIFLASH_BASE + SDRAM_CALIBRATION_FLASH_OFFSET), sizeof(*c)) == 0)
+		return;
+
+	printf("Saving calibration to SPI Flash @0x%08lx...\n",
+		(unsigned long) (SPIFLASH_BASE + SDRAM_CALIBRATION_FLASH_OFFSET));
+#ifdef CSR_SPIFLASH_CORE_MASTER_CS_ADDR
+	spiflash_erase_sector(SDRAM_CALIBRATION_FLASH_OFFSET);
+	spiflash_write(SDRAM_CALIBRATION_FLASH_OFFSET, (const uint8_t *) c, sizeof(*c));
+#else
+	erase_flash_sector(SDRAM_CALIBRATION_FLASH_OFFSET);
+	write_to_flash(SDRAM_CALIBRATION_FLASH_OFFSET, (const unsigned char *) c, sizeof(*c));
+#endif
+}
+
+#endif
+
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* SPD Timings                                                           */
+/*-----------------------------------------------------------------------*/
+
+/* Reads the SPD EEPROM of a DDR3/DDR4 module over I2C and derives, at the
+   SDRAM clock of the SoC, the tightest CAS latencies and timings the module
+   supports (JEDEC rounding). Timings exposed by the controller as runtime
+   CSRs (sdram_timings_<name>) are programmed and validated with the BIST
+   memtest, the build values being restored on errors. CL/CWL set the PHY
+   latencies and the init sequence at build time: they are checked against
+   the module, tighter ones reported for the next build. */
+
+#ifdef CSR_I2C_BASE
+
+#define SDRAM_SPD_CAPABLE
+
+#ifndef SDRAM_SPD_ADDR
+#define SDRAM_SPD_ADDR 0
+#endif
+
+#define SDRAM_SPD_I2C_ADDR(a210) (0x50 | ((a210) & 0b111))
+#define SDRAM_SPD_READ_SIZE      128
+#define SDRAM_SPD_TREFI_PS       7800000 /* Normal temperature range (0-85°C) */
+
+#define SDRAM_SPD_TYPE_DDR3 0x0b
+#define SDRAM_SPD_TYPE_DDR4 0x0c
+
+/* Module limits, times in ps */
+struct sdram_spd {
+	uint32_t tck;
+	uint32_t cls; /* Supported CAS latencies: bit n for CL cl_base+n */
+	int cl_base;
+	uint32_t taa, trcd, trp, tras, trc, twr, trfc;
+};
+
+static uint32_t sdram_spd_time(uint32_t mtb, int8_t ftb, uint32_t mtb_ps, int ftb_dividend, int ftb_divisor)
+{
+	return mtb*mtb_ps + (int32_t)ftb*ftb_dividend/ftb_divisor;
+}
+
+static int sdram_spd_parse(const unsigned char *b, struct sdram_spd *spd)
+{
+	uint32_t mtb_ps;
+	int ftb_dividend, ftb_divisor;
+
+#define T(mtb, ftb) sdram_spd_time(mtb, ftb, mtb_ps, ftb_dividend, ftb_divisor)
+	switch (b[2]) {
+	case SDRAM_SPD_TYPE_DDR3:
+		/* Medium timebase in ns (bytes 10/11), fine timebase in ps (byte 9) */
+		if (!b[11] || !(b[9] & 0xf))
+			return 0;
+		mtb_ps       = 1000*b[10]/b[11];
+		ftb_dividend = b[9] >> 4;
+		ftb_divisor  = b[9] & 0xf;
+		spd->tck     = T(b[12], b[34]);
+		spd->cls     = b[14] | (b[15] << 8);
+		spd->cl_base = 4;
+		spd->taa     = T(b[16], b[35]);
+		spd->twr     = T(b[17], 0);
+		spd->trcd    = T(b[18], b[36]);
+		spd->trp     = T(b[20], b[37]);
+		spd->tras    = T(((b[21] & 0xf) << 8) | b[22], 0);
+		spd->trc     = T(((b[21] >> 4) << 8) | b[23], b[38]);
+		spd->trfc    = T((b[25] << 8) | b[24], 0);
+		return 1;
+	case SDRAM_SPD_TYPE_DDR4:
+		/* 125 ps medium and 1 ps fine timebases (byte 17 = 0) */
+		if (b[17] != 0)
+			return 0;
+		mtb_ps       = 125;
+		ftb_dividend = 1;
+		ftb_divisor  = 1;
+		spd->tck     = T(b[18], b[125]);
+		spd->cls     = (b[20] | (b[21] << 8) | (b[22] << 16) | (b[23] << 24)) & 0x3fffffff;
+		spd->cl_base = (b[23] & 0x80) ? 23 : 7;
+		spd->taa     = T(b[24], b[123]);
+		spd->trcd    = T(b[25], b[122]);
+		spd->trp     = T(b[26], b[121]);
+		spd->tras    = T(((b[27] & 0xf) << 8) | b[28], 0);
+		spd->trc     = T(((b[27] >> 4) << 8) | b[29], b[120]);
+		spd->trfc    = T((b[31] << 8) | b[30], 0); /* tRFC1 (1x refresh) */
+		spd->twr     = T(((b[41] & 0xf) << 8) | b[42], 0);
+		return 1;
+	}
+#undef T
+	return 0;
+}
+
+/* Clock cycles of a time, with the 2.5% guardband of the JEDEC rounding */
+static int sdram_spd_nck(uint32_t t, uint32_t tck)
+{
+	return ((uint64_t)t*1000/tck + 974)/1000;
+}
+
+/* Controller (sys_clk) cycles of a time */
+static int sdram_spd_sys(uint32_t t, uint32_t tck)
+{
+	return (sdram_spd_nck(t, tck) + SDRAM_PHY_PHASES - 1)/SDRAM_PHY_PHASES;
+}
+
+/* CAS write latency of the speed bin of tCK */
+static int sdram_spd_cwl(int type, uint32_t tck)
+{
+	static const uint16_t ddr3_tck[] = {2500, 1875, 1500, 1250, 1071, 938};
+	static const uint16_t ddr4_tck[] = {1250, 1071, 937, 833, 750};
+	static const uint8_t  ddr4_cwl[] = {   9,   10,  11,  12,  14, 16};
+	int i;
+
+	if (type == SDRAM_SPD_TYPE_DDR3) {
+		for (i = 0; i < sizeof(ddr3_tck)/sizeof(ddr3_tck[0]); i++)
+			if (tck >= ddr3_tck[i])
+				break;
+		return 5 + i;
+	}
+	for (i = 0; i < sizeof(ddr4_tck)/sizeof(ddr4_tck[0]); i++)
+		if (tck >= ddr4_tck[i])
+			break;
+	return ddr4_cwl[i];
+}
+
+#if defined(CSR_SDRAM_GENERATOR_BASE) && defined(CSR_SDRAM_CHECKER_BASE) && \
+	(defined(CSR_SDRAM_TIMINGS_TRP_ADDR) || defined(CSR_SDRAM_TIMINGS_TRCD_ADDR) || \
+	 defined(CSR_SDRAM_TIMINGS_TWR_ADDR) || defined(CSR_SDRAM_TIMINGS_TRAS_ADDR) || \
+	 defined(CSR_SDRAM_TIMINGS_TRC_ADDR) || defined(CSR_SDRAM_TIMINGS_TRFC_ADDR) || \
+	 defined(CSR_SDRAM_TIMINGS_TREFI_ADDR))
 
+#define SDRAM_SPD_PROGRAM
+
+enum {
+	SDRAM_SPD_TRP, SDRAM_SPD_TRCD, SDRAM_SPD_TWR, SDRAM_SPD_TRAS, SDRAM_SPD_TRC,
+	SDRAM_SPD_TRFC, SDRAM_SPD_TREFI, SDRAM_SPD_TIMINGS
+};
+
+struct sdram_spd_timing {
+	const char *name;
+	int index;
+	int (*get)(void);
+	void (*set)(int value);
+};
+
+#ifdef CSR_SDRAM_TIMINGS_TRP_ADDR
+static int  sdram_spd_get_trp(void)       { return sdram_timings_trp_read(); }
+static void sdram_spd_set_trp(int value)  { sdram_timings_trp_write(value); }
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TRCD_ADDR
+static int  sdram_spd_get_trcd(void)      { return sdram_timings_trcd_read(); }
+static void sdram_spd_set_trcd(int value) { sdram_timings_trcd_write(value); }
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TWR_ADDR
+static int  sdram_spd_get_twr(void)       { return sdram_timings_twr_read(); }
+static void sdram_spd_set_twr(int value)  { sdram_timings_twr_write(value); }
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TRAS_ADDR
+static int  sdram_spd_get_tras(void)      { return sdram_timings_tras_read(); }
+static void sdram_spd_set_tras(int value) { sdram_timings_tras_write(value); }
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TRC_ADDR
+static int  sdram_spd_get_trc(void)       { return sdram_timings_trc_read(); }
+static void sdram_spd_set_trc(int value)  { sdram_timings_trc_write(value); }
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TRFC_ADDR
+static int  sdram_spd_get_trfc(void)      { return sdram_timings_trfc_read(); }
+static void sdram_spd_set_trfc(int value) { sdram_timings_trfc_write(value); }
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TREFI_ADDR
+static int  sdram_spd_get_trefi(void)      { return sdram_timings_trefi_read(); }
+static void sdram_spd_set_trefi(int value) { sdram_timings_trefi_write(value); }
+#endif
+
+static const struct sdram_spd_timing sdram_spd_timings_csrs[] = {
+#ifdef CSR_SDRAM_TIMINGS_TRP_ADDR
+	{"tRP",   SDRAM_SPD_TRP,   sdram_spd_get_trp,   sdram_spd_set_trp},
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TRCD_ADDR
+	{"tRCD",  SDRAM_SPD_TRCD,  sdram_spd_get_trcd,  sdram_spd_set_trcd},
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TWR_ADDR
+	{"tWR",   SDRAM_SPD_TWR,   sdram_spd_get_twr,   sdram_spd_set_twr},
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TRAS_ADDR
+	{"tRAS",  SDRAM_SPD_TRAS,  sdram_spd_get_tras,  sdram_spd_set_tras},
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TRC_ADDR
+	{"tRC",   SDRAM_SPD_TRC,   sdram_spd_get_trc,   sdram_spd_set_trc},
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TRFC_ADDR
+	{"tRFC",  SDRAM_SPD_TRFC,  sdram_spd_get_trfc,  sdram_spd_set_trfc},
+#endif
+#ifdef CSR_SDRAM_TIMINGS_TREFI_ADDR
+	{"tREFI", SDRAM_SPD_TREFI, sdram_spd_get_trefi, sdram_spd_set_trefi},
+#endif
+};
+
+#define SDRAM_SPD_CSRS (sizeof(sdram_spd_timings_csrs)/sizeof(sdram_spd_timings_csrs[0]))
+
+/* Programs the timings (sys_clk cycles), validated with the BIST memtest */
+static int sdram_spd_program(const int *values)
+{
+	const struct sdram_spd_timing *timing;
+	int build[SDRAM_SPD_CSRS];
+	uint32_t errors;
+	int i;
+
+	printf("SPD: programming");
+	for (i = 0; i < SDRAM_SPD_CSRS; i++) {
+		timing   = &sdram_spd_timings_csrs[i];
+		build[i] = timing->get();
+		printf(" %s %d->%d", timing->name, build[i], values[timing->index]);
+		timing->set(values[timing->index]);
+	}
+	printf("\n");
+
+	errors = sdram_bist_memtest(0, MEMTEST_DATA_SIZE);
+	if (errors == 0)
+		return 1;
+	printf("SPD: %u errors, back to the build timings.\n", errors);
+	for (i = 0; i < SDRAM_SPD_CSRS; i++)
+		sdram_spd_timings_csrs[i].set(build[i]);
+	return 0;
+}
+
+#endif
+
+int sdram_spd_timings(unsigned char spdaddr)
+{
+	unsigned char buf[SDRAM_SPD_READ_SIZE];
+	struct sdram_spd spd;
+	uint32_t tck;
+	int type, cl, cwl;
+
+#ifdef SDRAM_PHY_DDR4
+	type = SDRAM_SPD_TYPE_DDR4;
+#elif defined(SDRAM_PHY_DDR3)
+	type = SDRAM_SPD_TYPE_DDR3;
+#else
+	printf("SPD: DDR3/DDR4 SDRAM only.\n");
+	return 0;
+#endif
+	if (!i2c_read(SDRAM_SPD_I2C_ADDR(spdaddr), 0, buf, sizeof(buf), true)) {
+		printf("SPD: no EEPROM at address %d.\n", spdaddr);
+		return 0;
+	}
+	if ((buf[2] != type) || !sdram_spd_parse(buf, &spd)) {
+		printf("SPD: unsupported module (type 0x%02x).\n", buf[2]);
+		return 0;
+	}
+	printf("SPD: tCKmin %u ps, tAA %u ps, tRCD %u ps, tRP %u ps, tRFC %u ps.\n",
+		spd.tck, spd.taa, spd.trcd, spd.trp, spd.trfc);
+
+	/* SDRAM clock period */
+	tck = 1000000000000ULL/(SDRAM_PHY_PHASES*CONFIG_CLOCK_FREQUENCY);
+	if (tck < spd.tck) {
+		printf("SPD: module too slow for tCK %u ps, build timings kept.\n", tck);
+		return 0;
+	}
+
+	/* CAS latencies: lowest supported one covering tAA */
+	for (cl = sdram_spd_nck(spd.taa, tck); cl < spd.cl_base + 32; cl++)
+		if ((cl >= spd.cl_base) && (spd.cls & (1 << (cl - spd.cl_base))))
+			break;
+	if (cl == spd.cl_base + 32) {
+		printf("SPD: no supported CL for tAA %u ps.\n", spd.taa);
+		return 0;
+	}
+	cwl = sdram_spd_cwl(type, tck);
+	printf("SPD: CL-%d CWL-%d at tCK %u ps, build: CL-%d CWL-%d.\n",
+		cl, cwl, tck, sdram_get_cl(), sdram_get_cwl());
+	if (cl > sdram_get_cl())
+		printf("SPD: warning, build CL below the module's CL-%d.\n", cl);
+
+#ifdef SDRAM_SPD_PROGRAM
+	{
+		int values[SDRAM_SPD_TIMINGS];
+
+		values[SDRAM_SPD_TRP]   = sdram_spd_sys(spd.trp,  tck);
+		values[SDRAM_SPD_TRCD]  = sdram_spd_sys(spd.trcd, tck);
+		values[SDRAM_SPD_TWR]   = sdram_spd_sys(spd.twr,  tck);
+		values[SDRAM_SPD_TRAS]  = sdram_spd_sys(spd.tras, tck);
+		values[SDRAM_SPD_TRC]   = sdram_spd_sys(spd.trc,  tck);
+		values[SDRAM_SPD_TRFC]  = sdram_spd_sys(spd.trfc, tck);
+		values[SDRAM_SPD_TREFI] = (uint64_t)SDRAM_SPD_TREFI_PS/(tck*SDRAM_PHY_PHASES);
+		return sdram_spd_program(values);
+	}
+#else
+	printf("SPD: tRP %d, tRCD %d, tWR %d, tRFC %d, tREFI %d sys_clk cycles (no timing CSRs).\n",
+		sdram_spd_sys(spd.trp, tck), sdram_spd_sys(spd.trcd, tck), sdram_spd_sys(spd.twr, tck),
+		sdram_spd_sys(spd.trfc, tck), (int)((uint64_t)SDRAM_SPD_TREFI_PS/(tck*SDRAM_PHY_PHASES)));
 	return 1;
+#endif
 }
+
 #endif
 
 /*-----------------------------------------------------------------------*/
@@ -1238,9 +2331,9 @@ int sdram_init(void)
 	sdram_software_control_on();
 #if CSR_DDRPHY_RST_ADDR
 	ddrphy_rst_write(1);
-	cdelay(1000);
+	cdelay(SDRAM_NS_TO_CYCLES(SDRAM_PHY_RST_DELAY_NS));
 	ddrphy_rst_write(0);
-	cdelay(1000);
+	cdelay(SDRAM_NS_TO_CYCLES(SDRAM_PHY_RST_DELAY_NS));
 #endif
 
 #ifdef CSR_DDRCTRL_BASE
@@ -1248,11 +2341,19 @@ int sdram_init(void)
 	ddrctrl_init_error_write(0);
 #endif
 	init_sequence();
-#if defined(SDRAM_PHY_WRITE_LEVELING_CAPABLE) || defined(SDRAM_PHY_READ_LEVELING_CAPABLE)
+#ifdef SDRAM_CALIBRATION_CACHE
+	if (!sdram_calibration_restore()) {
+		sdram_leveling();
+		sdram_calibration_save();
+	}
+#elif defined(SDRAM_PHY_WRITE_LEVELING_CAPABLE) || defined(SDRAM_PHY_READ_LEVELING_CAPABLE)
 	sdram_leveling();
 #endif
 	sdram_software_control_off();
-#ifndef SDRAM_TEST_DISABLE
+#if defined(SDRAM_SPD_TIMINGS) && defined(SDRAM_SPD_CAPABLE)
+	sdram_spd_timings(SDRAM_SPD_ADDR);
+#endif
+#if !defined(SDRAM_TEST_DISABLE) && !defined(FAST_BOOT)
 	if(!memtest((unsigned int *) MAIN_RAM_BASE, MEMTEST_DATA_SIZE)) {
 #ifdef CSR_DDRCTRL_BASE
 		ddrctrl_init_error_write(1);
@@ -1269,6 +2370,136 @@ int sdram_init(void)
 	return 1;
 }
 
+/*-----------------------------------------------------------------------*/
+/* Tuning                                                                */
+/*-----------------------------------------------------------------------*/
+
+/* Sweeps the runtime settings of the PHY/controller (knobs), re-initializing and
+   re-leveling the SDRAM for each combination, validates it with the BIST and keeps
+   the fastest stable one (bandwidth, then latency of single word reads). Only the
+   read/write phases are runtime settings of the current PHYs: other knobs (refresh,
+   timings) go in sdram_tune_knobs[] when exposed as CSRs. */
+
+#if defined(CSR_SDRAM_GENERATOR_BASE) && defined(CSR_SDRAM_CHECKER_BASE) && \
+	(defined(CSR_DDRPHY_RDPHASE_ADDR) || defined(CSR_DDRPHY_WRPHASE_ADDR))
+
+#define SDRAM_TUNE_BURST_LENGTH (16*1024)
+#define SDRAM_TUNE_BURSTS       16
+#define SDRAM_TUNE_LATENCY_RUNS 64
+
+struct sdram_tune_knob {
+	const char *name;
+	int count; /* Values: 0 to count-1 */
+	int reset;
+	void (*set)(int value);
+};
+
+#ifdef CSR_DDRPHY_RDPHASE_ADDR
+static void sdram_tune_rdphase(int value) { ddrphy_rdphase_write(value); }
+#endif
+#ifdef CSR_DDRPHY_WRPHASE_ADDR
+static void sdram_tune_wrphase(int value) { ddrphy_wrphase_write(value); }
+#endif
+
+static const struct sdram_tune_knob sdram_tune_knobs[] = {
+#ifdef CSR_DDRPHY_RDPHASE_ADDR
+	{"rdphase", SDRAM_PHY_PHASES, SDRAM_PHY_RDPHASE, sdram_tune_rdphase},
+#endif
+#ifdef CSR_DDRPHY_WRPHASE_ADDR
+	{"wrphase", SDRAM_PHY_PHASES, SDRAM_PHY_WRPHASE, sdram_tune_wrphase},
+#endif
+};
+
+#define SDRAM_TUNE_KNOBS (sizeof(sdram_tune_knobs)/sizeof(sdram_tune_knobs[0]))
+
+static void sdram_tune_apply(const int *values)
+{
+	int i;
+
+	for (i = 0; i < SDRAM_TUNE_KNOBS; i++) {
+		printf("%s=%d ", sdram_tune_knobs[i].name, values[i]);
+		sdram_tune_knobs[i].set(values[i]);
+	}
+	printf("\n");
+	sdram_software_control_on();
+	init_sequence();
+#if defined(SDRAM_PHY_WRITE_LEVELING_CAPABLE) || defined(SDRAM_PHY_READ_LEVELING_CAPABLE)
+	sdram_leveling();
+#endif
+	sdram_software_control_off();
+}
+
+/* Returns the errors, the bandwidth (MiB/s, writes + reads) and the read latency (ticks) */
+static uint32_t sdram_tune_trial(uint32_t *mibs, uint32_t *latency)
+{
+	uint32_t errors;
+	uint32_t wr_ticks, rd_ticks;
+
+	wr_ticks = rd_ticks = 0;
+	errors = sdram_bist_measure(0, SDRAM_TUNE_BURST_LENGTH, SDRAM_TUNE_BURSTS, &wr_ticks, &rd_ticks);
+	*mibs  = (uint64_t)SDRAM_TUNE_BURST_LENGTH*SDRAM_TUNE_BURSTS*CONFIG_CLOCK_FREQUENCY/(wr_ticks ? wr_ticks : 1)/(1024*1024);
+	*mibs += (uint64_t)SDRAM_TUNE_BURST_LENGTH*SDRAM_TUNE_BURSTS*CONFIG_CLOCK_FREQUENCY/(rd_ticks ? rd_ticks : 1)/(1024*1024);
+
+	wr_ticks = rd_ticks = 0;
+	errors += sdram_bist_measure(0, DFII_PIX_DATA_BYTES*SDRAM_PHY_PHASES, SDRAM_TUNE_LATENCY_RUNS,
+		&wr_ticks, &rd_ticks);
+	*latency = rd_ticks/SDRAM_TUNE_LATENCY_RUNS;
+
+	return errors;
+}
+
+int sdram_tune(void)
+{
+	int i;
+	int found;
+	int values[SDRAM_TUNE_KNOBS];
+	int best[SDRAM_TUNE_KNOBS];
+	uint32_t errors, mibs, latency;
+	uint32_t best_mibs, best_latency;
+
+	found = 0;
+	best_mibs = 0;
+	best_latency = 0;
+	for (i = 0; i < SDRAM_TUNE_KNOBS; i++)
+		values[i] = 0;
+	for (;;) {
+		/* Trial */
+		printf("--- Trial: ");
+		sdram_tune_apply(values);
+		errors = sdram_tune_trial(&mibs, &latency);
+		printf("--- Errors: %u, WR+RD: %u MiB/s, RD latency: %u ticks\n", errors, mibs, latency);
+		if (errors == 0 && (!found || mibs > best_mibs || (mibs == best_mibs && latency < best_latency))) {
+			found        = 1;
+			best_mibs    = mibs;
+			best_latency = latency;
+			memcpy(best, values, sizeof(best));
+		}
+
+		/* Next combination */
+		for (i = 0; i < SDRAM_TUNE_KNOBS; i++) {
+			if (++values[i] < sdram_tune_knobs[i].count)
+				break;
+			values[i] = 0;
+		}
+		if (i == SDRAM_TUNE_KNOBS)
+			break;
+	}
+
+	if (!found) {
+		printf("No stable configuration, back to the defaults: ");
+		for (i = 0; i < SDRAM_TUNE_KNOBS; i++)
+			values[i] = sdram_tune_knobs[i].reset;
+		sdram_tune_apply(values);
+		return 0;
+	}
+	printf("Fastest stable configuration (%u MiB/s, %u ticks): ", best_mibs, best_latency);
+	sdram_tune_apply(best);
+
+	return 1;
+}
+
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Debugging                                                             */
 /*-----------------------------------------------------------------------*/
@@ -1289,19 +2520,31 @@ int sdram_init(void)
 
 #define _SINGLE_READBACK (SDRAM_DEBUG_READBACK_MEM_SIZE/SDRAM_DEBUG_READBACK_COUNT)
 #define _READBACK_ERRORS_SIZE (_SINGLE_READBACK - sizeof(struct readback))
-#define SDRAM_DEBUG_READBACK_LEN (_READBACK_ERRORS_SIZE / sizeof(struct memory_error))
+#define SDRAM_DEBUG_READBACK_LEN (_READBACK_ERRORS_SIZE / sizeof(struct memory_error_range))
+
+/* Readbacks from the BIST checker: each block is written/checked as its own BIST run, so
+   failing blocks can be located from the error counts without the CPU reading the data. */
+#if defined(CSR_SDRAM_GENERATOR_BASE) && defined(CSR_SDRAM_CHECKER_BASE)
+#define SDRAM_DEBUG_READBACK_CHECKER
+#ifndef SDRAM_DEBUG_READBACK_CHECKER_BLOCK
+#define SDRAM_DEBUG_READBACK_CHECKER_BLOCK 4096
+#endif
+#ifndef SDRAM_DEBUG_READBACK_CHECKER_SIZE
+#define SDRAM_DEBUG_READBACK_CHECKER_SIZE MAIN_RAM_SIZE
 #endif
+#endif
+#endif
+
+struct sdram_debug_error_stats_ctx {
+	struct error_stats stats;
+	struct error_stats_acc acc;
+};
 
 static int sdram_debug_error_stats_on_error(
 	unsigned int addr, unsigned int rdata, unsigned int refdata, void *arg)
 {
-	struct error_stats *stats = (struct error_stats *) arg;
-	struct memory_error error = {
-		.addr = addr,
-		.data = rdata,
-		.ref = refdata,
-	};
-	error_stats_update(stats, error);
+	struct sdram_debug_error_stats_ctx *ctx = (struct sdram_debug_error_stats_ctx *) arg;
+	error_stats_acc_add(&ctx->acc, &ctx->stats, addr, rdata ^ refdata);
 	return 0;
 }
 
@@ -1309,14 +2552,15 @@ static void sdram_debug_error_stats(void) {
 	printf("Running initial memtest to fill memory ...\n");
 	memtest_data((unsigned int *) MAIN_RAM_BASE, SDRAM_DEBUG_STATS_MEMTEST_SIZE, 1, NULL);
 
-	struct error_stats stats;
-	error_stats_init(&stats);
+	static struct sdram_debug_error_stats_ctx ctx;
+	error_stats_init(&ctx.stats);
+	error_stats_acc_init(&ctx.acc);
 
 	struct memtest_config config = {
 		.show_progress = 0,
 		.read_only = 1,
 		.on_error = sdram_debug_error_stats_on_error,
-		.arg = &stats,
+		.arg = &ctx,
 	};
 
 	printf("Running read-only memtests ... \n");
@@ -1326,7 +2570,8 @@ static void sdram_debug_error_stats(void) {
 	}
 
 	printf("\n");
-	error_stats_print(&stats);
+	error_stats_acc_flush(&ctx.acc, &ctx.stats);
+	error_stats_print(&ctx.stats);
 }
 
 #ifdef SDRAM_DEBUG_READBACK_MEM_ADDR
@@ -1343,6 +2588,44 @@ static int sdram_debug_readback_on_error(
 	return readback_add(readback, SDRAM_DEBUG_READBACK_LEN, error) != 1;
 }
 
+static void sdram_debug_readback_print_usage(void)
+{
+	for (int i = 0; i < SDRAM_DEBUG_READBACK_COUNT; ++i) {
+		struct readback *readback = (struct readback *)
+			(SDRAM_DEBUG_READBACK_MEM_ADDR + i * READBACK_SIZE(SDRAM_DEBUG_READBACK_LEN));
+		printf("  Readback %d: %u/%u ranges%s\n", i, readback->len, (unsigned int) SDRAM_DEBUG_READBACK_LEN,
+			readback->len >= SDRAM_DEBUG_READBACK_LEN ? " (full)" : "");
+	}
+}
+
+static void sdram_debug_readback_compare(void)
+{
+
+	// Iterate over all combinations
+	for (int i = 0; i < SDRAM_DEBUG_READBACK_COUNT; ++i) {
+		struct readback *first = (struct readback *)
+			(SDRAM_DEBUG_READBACK_MEM_ADDR + i * READBACK_SIZE(SDRAM_DEBUG_READBACK_LEN));
+
+		for (int j = i + 1; j < SDRAM_DEBUG_READBACK_COUNT; ++j) {
+			int nums[] = {i, j};
+			struct readback *readbacks[] = {
+				(struct readback *) (SDRAM_DEBUG_READBACK_MEM_ADDR + i * READBACK_SIZE(SDRAM_DEBUG_READBACK_LEN)),
+				(struct readback *) (SDRAM_DEBUG_READBACK_MEM_ADDR + j * READBACK_SIZE(SDRAM_DEBUG_READBACK_LEN)),
+			};
+
+			// Compare i vs j and j vs i
+			for (int k = 0; k < 2; ++k) {
+				printf("Comparing readbacks %d vs %d:\n", nums[k], nums[1 - k]);
+				int missing = readback_compare(readbacks[k], readbacks[1 - k], SDRAM_DEBUG_READBACK_VERBOSE);
+				if (missing == 0)
+					printf("  OK\n");
+				else
+					printf("  N missing = %d\n", missing);
+			}
+		}
+	}
+}
+
 static void sdram_debug_readback(void)
 {
 	printf("Using storage @0x%08x with size 0x%08x for %d readbacks.\n",
@@ -1368,32 +2651,45 @@ static void sdram_debug_readback(void)
 	}
 	printf("\n");
 
+	sdram_debug_readback_print_usage();
+	sdram_debug_readback_compare();
+}
+
+#ifdef SDRAM_DEBUG_READBACK_CHECKER
+static void sdram_debug_readback_checker(void)
+{
+	unsigned int block;
+
+	printf("Using storage @0x%08x with size 0x%08x for %d checker readbacks (%d bytes blocks).\n",
+		SDRAM_DEBUG_READBACK_MEM_ADDR, SDRAM_DEBUG_READBACK_MEM_SIZE, SDRAM_DEBUG_READBACK_COUNT,
+		SDRAM_DEBUG_READBACK_CHECKER_BLOCK);
+
+	printf("Filling memory with the BIST generator ...\n");
+	for (block = 0; block < SDRAM_DEBUG_READBACK_CHECKER_SIZE/SDRAM_DEBUG_READBACK_CHECKER_BLOCK; block++)
+		sdram_bist_write(block*SDRAM_DEBUG_READBACK_CHECKER_BLOCK, SDRAM_DEBUG_READBACK_CHECKER_BLOCK, 1);
 
-	// Iterate over all combinations
 	for (int i = 0; i < SDRAM_DEBUG_READBACK_COUNT; ++i) {
-		struct readback *first = (struct readback *)
+		struct readback *readback = (struct readback *)
 			(SDRAM_DEBUG_READBACK_MEM_ADDR + i * READBACK_SIZE(SDRAM_DEBUG_READBACK_LEN));
+		readback_init(readback);
 
-		for (int j = i + 1; j < SDRAM_DEBUG_READBACK_COUNT; ++j) {
-			int nums[] = {i, j};
-			struct readback *readbacks[] = {
-				(struct readback *) (SDRAM_DEBUG_READBACK_MEM_ADDR + i * READBACK_SIZE(SDRAM_DEBUG_READBACK_LEN)),
-				(struct readback *) (SDRAM_DEBUG_READBACK_MEM_ADDR + j * READBACK_SIZE(SDRAM_DEBUG_READBACK_LEN)),
-			};
-
-			// Compare i vs j and j vs i
-			for (int k = 0; k < 2; ++k) {
-				printf("Comparing readbacks %d vs %d:\n", nums[k], nums[1 - k]);
-				int missing = readback_compare(readbacks[k], readbacks[1 - k], SDRAM_DEBUG_READBACK_VERBOSE);
-				if (missing == 0)
-					printf("  OK\n");
-				else
-					printf("  N missing = %d\n", missing);
-			}
+		printf("Running checker readback %3d/%3d ... \r", i + 1, SDRAM_DEBUG_READBACK_COUNT);
+		for (block = 0; block < SDRAM_DEBUG_READBACK_CHECKER_SIZE/SDRAM_DEBUG_READBACK_CHECKER_BLOCK; block++) {
+			if (sdram_bist_read(block*SDRAM_DEBUG_READBACK_CHECKER_BLOCK, SDRAM_DEBUG_READBACK_CHECKER_BLOCK, 1) == 0)
+				continue;
+			if (readback_add_range(readback, SDRAM_DEBUG_READBACK_LEN,
+				MAIN_RAM_BASE + block*SDRAM_DEBUG_READBACK_CHECKER_BLOCK,
+				SDRAM_DEBUG_READBACK_CHECKER_BLOCK/4, READBACK_MASK_UNKNOWN) != 1)
+				break;
 		}
 	}
+	printf("\n");
+
+	sdram_debug_readback_print_usage();
+	sdram_debug_readback_compare();
 }
 #endif
+#endif
 
 void sdram_debug(void)
 {
@@ -1406,6 +2702,11 @@ void sdram_debug(void)
 	printf("\nReadback:\n");
 	sdram_debug_readback();
 #endif
+
+#ifdef SDRAM_DEBUG_READBACK_CHECKER
+	printf("\nChecker readback:\n");
+	sdram_debug_readback_checker();
+#endif
 }
 #endif
 
@@ -43,11 +43,25 @@ void sdram_read_leveling(void);
 /*-----------------------------------------------------------------------*/
 int sdram_leveling(void);
 
+#ifdef SDRAM_EYE_MAP
+void sdram_eye_map(int csv);
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Initialization                                                        */
 /*-----------------------------------------------------------------------*/
 int sdram_init(void);
 
+/*-----------------------------------------------------------------------*/
+/* Tuning                                                                */
+/*-----------------------------------------------------------------------*/
+int sdram_tune(void);
+
+/*-----------------------------------------------------------------------*/
+/* SPD Timings                                                           */
+/*-----------------------------------------------------------------------*/
+int sdram_spd_timings(unsigned char spdaddr);
+
 /*-----------------------------------------------------------------------*/
 /* Debugging                                                             */
 /*-----------------------------------------------------------------------*/
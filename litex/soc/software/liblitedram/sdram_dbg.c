@@ -26,6 +26,42 @@ void error_stats_update(struct error_stats *stats, struct memory_error err) {
 	}
 }
 
+void error_stats_acc_init(struct error_stats_acc *acc) {
+	memset(acc, 0, sizeof(struct error_stats_acc));
+}
+
+static void error_stats_acc_flush_phase(struct error_stats_acc *acc, struct error_stats *stats, unsigned int phase) {
+	for (int edge = 0; edge < SDRAM_PHY_XDR; ++edge) {
+		for (int bit = 0; bit < SDRAM_PHY_DATABITS; ++bit) {
+			unsigned int shift = SDRAM_PHY_DATABITS*edge + bit;
+			unsigned int count = 0;
+			for (int k = 0; k < ERROR_STATS_ACC_PLANES; ++k)
+				count |= ((acc->phase[phase].planes[k] >> shift) & 1) << k;
+			stats->phase[phase].edge[edge].dq[bit] += count;
+		}
+	}
+	memset(&acc->phase[phase], 0, sizeof(acc->phase[phase]));
+}
+
+void error_stats_acc_add(struct error_stats_acc *acc, struct error_stats *stats, unsigned int addr, unsigned int mask) {
+	unsigned int phase = (addr % (SDRAM_PHY_PHASES*4)) / 4;
+	unsigned int *planes = acc->phase[phase].planes;
+	unsigned int carry = mask;
+	for (int k = 0; k < ERROR_STATS_ACC_PLANES && carry != 0; ++k) {
+		unsigned int next = planes[k] & carry;
+		planes[k] ^= carry;
+		carry = next;
+	}
+	// Flush before any counter can overflow
+	if (++acc->phase[phase].adds == (1u << ERROR_STATS_ACC_PLANES) - 1)
+		error_stats_acc_flush_phase(acc, stats, phase);
+}
+
+void error_stats_acc_flush(struct error_stats_acc *acc, struct error_stats *stats) {
+	for (unsigned int phase = 0; phase < SDRAM_PHY_PHASES; ++phase)
+		error_stats_acc_flush_phase(acc, stats, phase);
+}
+
 void error_stats_print(struct error_stats *stats) {
 	printf("        DQ:");
 	for (int bit = 0; bit < 16; ++bit) {
@@ -49,40 +85,96 @@ void readback_init(struct readback *readback) {
 	readback->len = 0;
 }
 
-int readback_find(struct readback *readback, unsigned int addr) {
-	int left = 0;
-	int right = readback->len - 1;
-	while (left <= right) {
-		int mid = (left + right) / 2;
-		if (readback->errors[mid].addr == addr) {
-			return mid;
-		} else if (readback->errors[mid].addr < addr) {
+// Index of the first range starting above addr.
+static unsigned int readback_upper_bound(struct readback *readback, unsigned int addr) {
+	unsigned int left = 0;
+	unsigned int right = readback->len;
+	while (left < right) {
+		unsigned int mid = (left + right) / 2;
+		if (readback->errors[mid].addr <= addr) {
 			left = mid + 1;
 		} else {
-			right = mid - 1;
+			right = mid;
 		}
 	}
+	return left;
+}
+
+static unsigned int readback_range_end(struct memory_error_range *range) {
+	return range->addr + 4 * range->count;
+}
+
+int readback_find(struct readback *readback, unsigned int addr) {
+	unsigned int at = readback_upper_bound(readback, addr);
+	if (at > 0 && addr < readback_range_end(&readback->errors[at - 1]))
+		return at - 1;
 	return -1;
 }
 
-int readback_add(struct readback *readback, unsigned int max_len, struct memory_error error) {
+int readback_add_range(struct readback *readback, unsigned int max_len,
+	unsigned int addr, unsigned int count, unsigned int mask) {
+	unsigned int at = readback_upper_bound(readback, addr);
+	unsigned int end = addr + 4 * count;
+	struct memory_error_range *prev = at > 0 ? &readback->errors[at - 1] : NULL;
+	struct memory_error_range *next = at < readback->len ? &readback->errors[at] : NULL;
+
+	// Extend the previous range (already covered by it when overlapping)
+	if (prev != NULL && prev->mask == mask && addr <= readback_range_end(prev)) {
+		if (end > readback_range_end(prev))
+			prev->count = (end - prev->addr) / 4;
+		// Join with the next range when the gap is now closed
+		if (next != NULL && next->mask == mask && readback_range_end(prev) >= next->addr) {
+			if (readback_range_end(next) > readback_range_end(prev))
+				prev->count = (readback_range_end(next) - prev->addr) / 4;
+			memmove(next, next + 1, (readback->len - at - 1) * sizeof(*next));
+			readback->len--;
+		}
+		return 1;
+	}
+
+	// Extend the next range downwards
+	if (next != NULL && next->mask == mask && end == next->addr) {
+		next->count += count;
+		next->addr = addr;
+		return 1;
+	}
+
+	// Insert a new range, keeping the entries sorted
 	if (readback->len >= max_len)
 		return 0;
-	readback->errors[readback->len++] = error;
+	memmove(&readback->errors[at + 1], &readback->errors[at],
+		(readback->len - at) * sizeof(readback->errors[0]));
+	readback->errors[at].addr = addr;
+	readback->errors[at].count = count;
+	readback->errors[at].mask = mask;
+	readback->len++;
 	return 1;
 }
 
+int readback_add(struct readback *readback, unsigned int max_len, struct memory_error error) {
+	return readback_add_range(readback, max_len, error.addr, 1, error.data ^ error.ref);
+}
+
 int readback_compare(struct readback *readback, struct readback *other, int verbose) {
 	int missing = 0;
 	for (unsigned int i = 0; i < readback->len ; ++i) {
-		struct memory_error *err = &readback->errors[i];
-		int at = readback_find(other, err->addr);
-		if (at < 0) {
-			if (verbose) {
-				printf("  Missing @0x%08x: 0x%08x vs 0x%08x\n",
-					err->addr, err->data, err->ref);
+		struct memory_error_range *err = &readback->errors[i];
+		unsigned int run = 0;
+		// Walk the words of the range, reporting runs not present in `other`
+		for (unsigned int n = 0; n <= err->count; ++n) {
+			unsigned int addr = err->addr + 4 * n;
+			if (n < err->count && readback_find(other, addr) < 0) {
+				run++;
+				continue;
+			}
+			if (run > 0) {
+				if (verbose) {
+					printf("  Missing @0x%08x (%u words): mask 0x%08x\n",
+						addr - 4 * run, run, err->mask);
+				}
+				missing += run;
+				run = 0;
 			}
-			missing++;
 		}
 	}
 	return missing;
@@ -26,6 +26,36 @@ void error_stats_init(struct error_stats *stats);
 void error_stats_update(struct error_stats *stats, struct memory_error error);
 void error_stats_print(struct error_stats *stats);
 
+/* Accumulates the error masks of each phase in bit-sliced counters: planes[k] holds bit k
+ * of the 32 per-bit counters, so adding a mask is a few word-wide operations (ripple carry)
+ * instead of testing each bit. The counters are added to error_stats on flush, which is
+ * done automatically before they can overflow.
+ */
+#define ERROR_STATS_ACC_PLANES 16
+
+struct error_stats_acc {
+	struct {
+		unsigned int planes[ERROR_STATS_ACC_PLANES];
+		unsigned int adds;
+	} phase[SDRAM_PHY_PHASES];
+};
+
+void error_stats_acc_init(struct error_stats_acc *acc);
+void error_stats_acc_add(struct error_stats_acc *acc, struct error_stats *stats, unsigned int addr, unsigned int mask);
+void error_stats_acc_flush(struct error_stats_acc *acc, struct error_stats *stats);
+
+/* Run of `count` consecutive 32-bit words starting at `addr` with the same error mask
+ * (data ^ ref). A mask of READBACK_MASK_UNKNOWN marks errors located without the data
+ * (e.g. by the BIST checker, which only counts errors).
+ */
+struct memory_error_range {
+	unsigned int addr;
+	unsigned int count;
+	unsigned int mask;
+};
+
+#define READBACK_MASK_UNKNOWN 0xffffffff
+
 /* Allows to store memory error information to compare several readbacks from memory.
  *
  * To achieve sensible results we need to store a lot of data, and we cannot use DRAM
@@ -33,23 +63,29 @@ void error_stats_print(struct error_stats *stats);
  * mapped to some memory region available in the SoC, ideally the SoC has some other
  * memory that can be used, e.g. HyperRAM.
  *
+ * Entries are kept sorted by address and adjacent errors with the same mask are merged
+ * into a single range, so stuck bits or failing rows only use a few entries.
+ *
  * This structure uses flexible array, so user must ensure number of errors fits into
  * memory and must pass maximum size to readback_add when adding new entry.
  */
 struct readback {
 	unsigned int len;
-	struct memory_error errors[];
+	struct memory_error_range errors[];
 };
 
-#define READBACK_SIZE(n) (sizeof(struct readback) + (n) * sizeof(struct memory_error))
+#define READBACK_SIZE(n) (sizeof(struct readback) + (n) * sizeof(struct memory_error_range))
 
 void readback_init(struct readback *readback);
-// Uses binary search to find given address and return its index or -1 if not found.
-// The addresses int the whole readback array must be non-decreasing.
+// Uses binary search to find the range containing given address and return its index or -1 if not found.
 int readback_find(struct readback *readback, unsigned int addr);
-// Add new entry if there is space (depending on max_len). Returns 1 if added new entry.
+// Insert a range of `count` words at its sorted position, merging it with its neighbours when
+// contiguous with the same mask. Returns 1 if stored, 0 if there is no space (depending on max_len).
+int readback_add_range(struct readback *readback, unsigned int max_len,
+	unsigned int addr, unsigned int count, unsigned int mask);
+// Add a single error, errors can be added in any address order. Returns 1 if stored.
 int readback_add(struct readback *readback, unsigned int max_len, struct memory_error error);
-// Print errors that occured in `readback` that didn't occure in `other`. Returns number of errors.
+// Print errors that occured in `readback` that didn't occure in `other`. Returns number of words.
 int readback_compare(struct readback *readback, struct readback *other, int verbose);
 
 #endif /* CSR_SDRAM_BASE */
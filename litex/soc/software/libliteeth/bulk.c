@@ -0,0 +1,193 @@
+// License: BSD
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <generated/soc.h>
+
+#include <libbase/crc.h>
+#include <libbase/progress.h>
+
+#include <libliteeth/inet.h>
+#include <libliteeth/udp.h>
+#include <libliteeth/bulk.h>
+
+/* The chunk and its bulk header fit a UDP payload: 1448 bytes with a 1500
+ * bytes MTU, up to 8948 with jumbo frames */
+#define	BULK_CHUNK_MAX	(UDP_PAYLOAD_MAX - sizeof(struct bulk_header))
+#define	BULK_CHUNK_MIN	64
+
+/* Timeouts in ms: for the host to start, of a session without packets,
+ * of a complete session for the host to get the last NACK */
+#define	BULK_START_TIMEOUT	60000
+#define	BULK_TIMEOUT		5000
+#define	BULK_LINGER_TIMEOUT	1000
+
+/* Ranges of missing chunks per NACK */
+#define	BULK_NACK_RANGES	128
+
+struct bulk_range {
+	uint32_t first;
+	uint32_t count;
+} __attribute__((packed));
+
+static uint8_t *bulk_buffer;
+static unsigned long bulk_size;
+static uint32_t *bitmap;
+static int started;
+static uint32_t session;
+static uint32_t image_length;
+static uint32_t chunk_size;
+static uint32_t chunks;
+static uint32_t missing;
+static uint32_t host_ip;
+static uint16_t host_port;
+static int reply;	/* Type of the reply to send, 0: none */
+static int activity;
+
+static int chunk_received(uint32_t seq)
+{
+	return bitmap[seq/32] & (1 << (seq%32));
+}
+
+static int bulk_start(const struct bulk_header *h)
+{
+	unsigned long bitmap_offset;
+
+	if(started && (ntohl(h->session) == session))
+		return BULK_START_ACK;
+	started = 0;
+	session = ntohl(h->session);
+	chunk_size = ntohl(h->seq);
+	if(chunk_size > BULK_CHUNK_MAX)
+		chunk_size = BULK_CHUNK_MAX;
+	if(chunk_size < BULK_CHUNK_MIN)
+		return BULK_ERROR;
+	image_length = ntohl(h->length);
+	chunks = (image_length + chunk_size - 1)/chunk_size;
+	bitmap_offset = (image_length + 3) & ~3;
+	if((image_length > bulk_size) || (bitmap_offset + 4*((chunks + 31)/32) > bulk_size))
+		return BULK_ERROR;
+	bitmap = (uint32_t *)(bulk_buffer + bitmap_offset);
+	memset(bitmap, 0, 4*((chunks + 31)/32));
+	missing = chunks;
+	started = 1;
+	init_progression_bar(chunks);
+	return BULK_START_ACK;
+}
+
+static void bulk_data(const struct bulk_header *h, unsigned int length)
+{
+	uint32_t seq;
+	uint32_t n;
+
+	if(!started || (ntohl(h->session) != session))
+		return;
+	seq = ntohl(h->seq);
+	n = ntohl(h->length);
+	if((seq >= chunks) || chunk_received(seq))
+		return;
+	if((n != ((seq == chunks - 1) ? image_length - seq*chunk_size : chunk_size)) ||
+		(length < sizeof(struct bulk_header) + n))
+		return;
+	/* A chunk failing its CRC is sent again after the next NACK */
+	if(crc32_copy(0, bulk_buffer + seq*chunk_size, h + 1, n) != ntohl(h->crc))
+		return;
+	bitmap[seq/32] |= 1 << (seq%32);
+	missing--;
+}
+
+static void rx_callback(uint32_t src_ip, uint16_t src_port,
+    uint16_t dst_port, void *data, unsigned int length)
+{
+	const struct bulk_header *h = data;
+
+	if(dst_port != BULK_PORT) return;
+	if(length < sizeof(struct bulk_header)) return;
+	if(ntohl(h->magic) != BULK_MAGIC) return;
+	activity = 1;
+	switch(h->type) {
+		case BULK_START:
+			reply = bulk_start(h);
+			host_ip = src_ip;
+			host_port = src_port;
+			break;
+		case BULK_DATA:
+			bulk_data(h, length);
+			break;
+		case BULK_STATUS:
+			if(started && (ntohl(h->session) == session))
+				reply = BULK_NACK;
+			break;
+	}
+}
+
+static void bulk_send(int type)
+{
+	struct bulk_header *h;
+	struct bulk_range *ranges;
+	uint32_t seq;
+	int n;
+
+	/* The host has sent an ARP request to reach us: it is cached */
+	if(!udp_arp_resolve(host_ip))
+		return;
+	h = udp_get_tx_buffer();
+	ranges = (struct bulk_range *)(h + 1);
+	h->magic = htonl(BULK_MAGIC);
+	h->type = type;
+	memset(h->reserved, 0, sizeof(h->reserved));
+	h->session = htonl(session);
+	h->seq = htonl(type == BULK_NACK ? missing : chunk_size);
+	h->crc = 0;
+	n = 0;
+	if(type == BULK_NACK) {
+		for(seq=0;(seq<chunks) && (n<BULK_NACK_RANGES);seq++) {
+			if(chunk_received(seq))
+				continue;
+			ranges[n].first = htonl(seq);
+			while((seq + 1 < chunks) && !chunk_received(seq + 1))
+				seq++;
+			ranges[n].count = htonl(seq + 1 - ntohl(ranges[n].first));
+			n++;
+		}
+	}
+	h->length = htonl(n);
+	udp_send(BULK_PORT, host_port, sizeof(struct bulk_header) + n*sizeof(struct bulk_range));
+}
+
+int bulk_load(void *buffer, unsigned long size)
+{
+	struct udp_timeout timeout;
+	int complete;
+
+	bulk_buffer = buffer;
+	bulk_size = size;
+	started = 0;
+	reply = 0;
+	complete = 0;
+	udp_set_callback(rx_callback);
+
+	udp_timeout_start(&timeout, BULK_START_TIMEOUT);
+	while(!udp_timeout_expired(&timeout)) {
+		activity = 0;
+		udp_service();
+		if(reply) {
+			bulk_send(reply);
+			if(started && (reply == BULK_NACK)) {
+				show_progress(chunks - missing);
+				complete = (missing == 0);
+			}
+			reply = 0;
+		}
+		if(activity)
+			udp_timeout_start(&timeout, complete ? BULK_LINGER_TIMEOUT :
+				(started ? BULK_TIMEOUT : BULK_START_TIMEOUT));
+	}
+
+	udp_set_callback(NULL);
+	printf("\n");
+
+	return complete ? (int)image_length : -1;
+}
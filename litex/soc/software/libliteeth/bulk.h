@@ -0,0 +1,37 @@
+#ifndef __BULK_H
+#define __BULK_H
+
+#include <stdint.h>
+
+/* Bulk loader (litex_netload): the host sends the image in sequence
+ * numbered chunks carrying their CRC32, then asks for the chunks missing
+ * until there are none. All the fields are big endian. Several boards can
+ * be loaded at once: the START/STATUS requests are sent to each board, the
+ * DATA chunks to all of them or broadcast, in one session. */
+#define BULK_PORT	6070
+#define BULK_MAGIC	0x4c58424c	/* "LXBL" */
+
+enum {
+	BULK_START	= 1,	/* seq: chunk size, length: image length */
+	BULK_START_ACK	= 2,	/* seq: chunk size accepted */
+	BULK_DATA	= 3,	/* seq: chunk, length: payload, crc: of payload */
+	BULK_STATUS	= 4,	/* Chunks missing? */
+	BULK_NACK	= 5,	/* seq: chunks missing, length: ranges {first, count} in payload */
+	BULK_ERROR	= 6,	/* Image refused */
+};
+
+struct bulk_header {
+	uint32_t magic;
+	uint8_t type;
+	uint8_t reserved[3];
+	uint32_t session;
+	uint32_t seq;
+	uint32_t length;
+	uint32_t crc;
+} __attribute__((packed));
+
+/* Receives an image to buffer, at most size bytes with the bitmap of the
+ * chunks received placed after it, returns its length or -1 */
+int bulk_load(void *buffer, unsigned long size);
+
+#endif /* __BULK_H */
@@ -3,14 +3,54 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+#include <generated/soc.h>
 
 #include <libliteeth/mdio.h>
 
+/* MDC half period in sys_clk cycles */
+#define MDIO_HALF_PERIOD ((CONFIG_CLOCK_FREQUENCY + 2*MDIO_FREQUENCY - 1)/(2*MDIO_FREQUENCY))
+
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+/* Waits for the next MDC edge, due a half period after the previous one: the
+ * time spent in the CSR accesses counts in the half period */
+static uint64_t edge;
+
+static uint64_t mdio_uptime(void)
+{
+	timer0_uptime_latch_write(1);
+	return timer0_uptime_cycles_read();
+}
+
+static void mdio_clock_start(void)
+{
+	edge = mdio_uptime();
+}
+
 static void delay(void)
 {
-	volatile int i;
-	for(i=0;i<100;i++);
+	uint64_t now;
+
+	do {
+		now = mdio_uptime();
+	} while(now < edge);
+	edge = now + MDIO_HALF_PERIOD;
 }
+#else
+static void mdio_clock_start(void)
+{
+}
+
+/* At least a cycle per iteration */
+static void delay(void)
+{
+	int i;
+
+	for(i=MDIO_HALF_PERIOD;i>0;i--)
+		__asm__ volatile(CONFIG_CPU_NOP);
+}
+#endif
 
 static void raw_write(unsigned int word, int bitcount)
 {
@@ -64,10 +104,11 @@ static void raw_turnaround(void)
 	ethphy_mdio_w_write(0);
 }
 
-void mdio_write(int phyadr, int reg, int val)
+static void mdio_frame_write(int phyadr, int reg, int val, int preamble)
 {
 	ethphy_mdio_w_write(MDIO_OE);
-	raw_write(MDIO_PREAMBLE, 32);
+	if(preamble)
+		raw_write(MDIO_PREAMBLE, 32);
 	raw_write(MDIO_START, 2);
 	raw_write(MDIO_WRITE, 2);
 	raw_write(phyadr, 5);
@@ -77,12 +118,13 @@ void mdio_write(int phyadr, int reg, int val)
 	raw_turnaround();
 }
 
-int mdio_read(int phyadr, int reg)
+static int mdio_frame_read(int phyadr, int reg, int preamble)
 {
 	int r;
 
 	ethphy_mdio_w_write(MDIO_OE);
-	raw_write(MDIO_PREAMBLE, 32);
+	if(preamble)
+		raw_write(MDIO_PREAMBLE, 32);
 	raw_write(MDIO_START, 2);
 	raw_write(MDIO_READ, 2);
 	raw_write(phyadr, 5);
@@ -94,4 +136,48 @@ int mdio_read(int phyadr, int reg)
 	return r;
 }
 
-#endif
\ No newline at end of file
+/* A batch of more than 2 frames gets the preamble only for the BMSR read when
+ * the PHY accepts frames without it (the turnaround ends them with 2 idle
+ * bits) */
+static int mdio_batch_preamble(int phyadr, int count)
+{
+	if(count <= 2)
+		return 1;
+	return !(mdio_frame_read(phyadr, MDIO_BMSR, 1) & MDIO_BMSR_PREAMBLE_SUPPRESSION);
+}
+
+void mdio_write(int phyadr, int reg, int val)
+{
+	mdio_clock_start();
+	mdio_frame_write(phyadr, reg, val, 1);
+}
+
+int mdio_read(int phyadr, int reg)
+{
+	mdio_clock_start();
+	return mdio_frame_read(phyadr, reg, 1);
+}
+
+void mdio_write_table(int phyadr, const struct mdio_reg *regs, int count)
+{
+	int preamble;
+	int i;
+
+	mdio_clock_start();
+	preamble = mdio_batch_preamble(phyadr, count);
+	for(i=0;i<count;i++)
+		mdio_frame_write(phyadr, regs[i].reg, regs[i].val, preamble);
+}
+
+void mdio_read_regs(int phyadr, int reg, unsigned short *vals, int count)
+{
+	int preamble;
+	int i;
+
+	mdio_clock_start();
+	preamble = mdio_batch_preamble(phyadr, count);
+	for(i=0;i<count;i++)
+		vals[i] = mdio_frame_read(phyadr, reg + i, preamble);
+}
+
+#endif
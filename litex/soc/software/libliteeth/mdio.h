@@ -13,7 +13,24 @@
 #define MDIO_WRITE       0x1
 #define MDIO_TURN_AROUND 0x2
 
+#define MDIO_BMSR                      0x01
+#define MDIO_BMSR_PREAMBLE_SUPPRESSION 0x0040
+
+/* MDC frequency, at most 2.5MHz (IEEE 802.3 clause 22) */
+#ifndef MDIO_FREQUENCY
+#define MDIO_FREQUENCY 2500000
+#endif
+
+struct mdio_reg {
+	unsigned char reg;
+	unsigned short val;
+};
+
 void mdio_write(int phyadr, int reg, int val);
 int mdio_read(int phyadr, int reg);
 
+/* Batches: PHY init tables, consecutive registers */
+void mdio_write_table(int phyadr, const struct mdio_reg *regs, int count);
+void mdio_read_regs(int phyadr, int reg, unsigned short *vals, int count);
+
 #endif /* __MDIO_H */
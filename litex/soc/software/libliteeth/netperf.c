@@ -0,0 +1,279 @@
+// License: BSD
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <generated/csr.h>
+#include <generated/soc.h>
+
+#include <libbase/timing.h>
+
+#include <libliteeth/inet.h>
+#include <libliteeth/udp.h>
+#include <libliteeth/netperf.h>
+
+/* Timeouts in ms: traffic stopped (sink), reply of an echo request */
+#define	NETPERF_IDLE_TIMEOUT	1000
+#define	NETPERF_ECHO_TIMEOUT	1000
+
+/* Bytes of a frame on the wire besides the UDP payload: preamble, Ethernet,
+ * IP and UDP headers, FCS and the inter-frame gap */
+#define	NETPERF_FRAME_OVERHEAD	(8 + 14 + 20 + 8 + 4 + 12)
+
+static struct netperf_stats *stats;
+static unsigned short netperf_port;
+static uint32_t next_seq;
+static uint64_t first_ns;
+static uint64_t last_ns;
+
+/* Echo reply pending, the request being kept until it is sent: answering
+   may need an ARP exchange, which would overwrite the TX slot */
+static uint8_t echo_buffer[UDP_PAYLOAD_MAX];
+static unsigned int echo_length;
+static uint32_t echo_ip;
+static uint16_t echo_port;
+
+static void netperf_header(struct netperf_header *h, int type, uint32_t seq, uint64_t stamp)
+{
+	h->magic = htonl(NETPERF_MAGIC);
+	h->type = type;
+	memset(h->reserved, 0, sizeof(h->reserved));
+	h->seq = htonl(seq);
+	h->stamp_hi = htonl(stamp >> 32);
+	h->stamp_lo = htonl(stamp);
+}
+
+static const struct netperf_header *netperf_check(uint16_t dst_port, void *data, unsigned int length)
+{
+	const struct netperf_header *h = data;
+
+	if(dst_port != netperf_port) return NULL;
+	if(length < sizeof(struct netperf_header)) return NULL;
+	if(ntohl(h->magic) != NETPERF_MAGIC) return NULL;
+	return h;
+}
+
+static void netperf_count(struct netperf_stats *s, unsigned int length, uint64_t now)
+{
+	if(s->packets == 0)
+		first_ns = now;
+	last_ns = now;
+	s->packets++;
+	s->bytes += length;
+	s->ns = last_ns - first_ns;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Source / Sink                                                         */
+/*-----------------------------------------------------------------------*/
+
+int netperf_send(unsigned int ip, unsigned short port, unsigned int length,
+	unsigned int ms, unsigned int mbps, struct netperf_stats *s)
+{
+	struct netperf_header *h;
+	uint64_t start, now, end;
+	uint32_t seq;
+
+	memset(s, 0, sizeof(*s));
+	if(length < sizeof(struct netperf_header))
+		length = sizeof(struct netperf_header);
+	if(length > UDP_PAYLOAD_MAX)
+		length = UDP_PAYLOAD_MAX;
+	if(!udp_arp_resolve(ip))
+		return -1;
+
+	start = now = time_ns();
+	end = start + (uint64_t)ms*1000000;
+	for(seq = 0; now < end; seq++) {
+		/* Pacing: each packet leaves once the payload sent so far fits the rate */
+		if(mbps) {
+			while(now < start + s->bytes*8000/mbps)
+				now = time_ns();
+		}
+		/* Answer ARP requests of the sink, drop the rest */
+		udp_service();
+		h = udp_get_tx_buffer();
+		netperf_header(h, NETPERF_DATA, seq, now);
+		/* The payload stays in the TX slots, written once each */
+		if(seq < ETHMAC_TX_SLOTS)
+			memset(h + 1, 0x5a, length - sizeof(struct netperf_header));
+		udp_send(port, port, length);
+		netperf_count(s, length, now);
+		now = time_ns();
+	}
+	return 0;
+}
+
+static void sink_callback(uint32_t src_ip, uint16_t src_port,
+	uint16_t dst_port, void *data, unsigned int length)
+{
+	const struct netperf_header *h = netperf_check(dst_port, data, length);
+	uint32_t seq;
+
+	if(!h || (h->type != NETPERF_DATA))
+		return;
+	seq = ntohl(h->seq);
+	if(stats->packets == 0)
+		next_seq = seq;
+	if(seq >= next_seq) {
+		stats->lost += seq - next_seq;
+		next_seq = seq + 1;
+	} else {
+		/* Counted as lost when the next ones arrived */
+		stats->reordered++;
+		if(stats->lost)
+			stats->lost--;
+	}
+	netperf_count(stats, length, time_ns());
+}
+
+int netperf_receive(unsigned short port, unsigned int ms, struct netperf_stats *s)
+{
+	struct udp_timeout idle;
+	struct udp_timeout timeout;
+	uint32_t packets;
+
+	memset(s, 0, sizeof(*s));
+	stats = s;
+	netperf_port = port;
+	udp_set_callback(sink_callback);
+
+	udp_timeout_start(&timeout, ms);
+	udp_timeout_start(&idle, ms);
+	while(!udp_timeout_expired(&timeout) && !udp_timeout_expired(&idle)) {
+		packets = s->packets;
+		udp_service();
+		if(s->packets != packets)
+			udp_timeout_start(&idle, NETPERF_IDLE_TIMEOUT);
+	}
+
+	udp_set_callback(NULL);
+	return s->packets ? 0 : -1;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Echo                                                                  */
+/*-----------------------------------------------------------------------*/
+
+static void echo_callback(uint32_t src_ip, uint16_t src_port,
+	uint16_t dst_port, void *data, unsigned int length)
+{
+	const struct netperf_header *h = netperf_check(dst_port, data, length);
+
+	/* One request at a time, the peer waits for the reply */
+	if(!h || (h->type != NETPERF_ECHO_REQUEST) || echo_length || (length > sizeof(echo_buffer)))
+		return;
+	memcpy(echo_buffer, data, length);
+	((struct netperf_header *)echo_buffer)->type = NETPERF_ECHO_REPLY;
+	echo_length = length;
+	echo_ip = src_ip;
+	echo_port = src_port;
+}
+
+int netperf_echo(unsigned short port, unsigned int ms)
+{
+	struct udp_timeout timeout;
+	int replies = 0;
+
+	netperf_port = port;
+	echo_length = 0;
+	udp_set_callback(echo_callback);
+
+	udp_timeout_start(&timeout, ms);
+	while(!udp_timeout_expired(&timeout)) {
+		udp_service();
+		if(!echo_length)
+			continue;
+		/* The peer has sent an ARP request to reach us: it is cached */
+		if(udp_arp_resolve(echo_ip)) {
+			memcpy(udp_get_tx_buffer(), echo_buffer, echo_length);
+			udp_send(port, echo_port, echo_length);
+			replies++;
+		}
+		echo_length = 0;
+	}
+
+	udp_set_callback(NULL);
+	return replies;
+}
+
+static void ping_callback(uint32_t src_ip, uint16_t src_port,
+	uint16_t dst_port, void *data, unsigned int length)
+{
+	const struct netperf_header *h = netperf_check(dst_port, data, length);
+	uint64_t now = time_ns();
+	uint64_t rtt;
+
+	/* Late replies of requests given up are ignored */
+	if(!h || (h->type != NETPERF_ECHO_REPLY) || (ntohl(h->seq) != next_seq))
+		return;
+	rtt = now - (((uint64_t)ntohl(h->stamp_hi) << 32) | ntohl(h->stamp_lo));
+	if(rtt < stats->rtt_min)
+		stats->rtt_min = rtt;
+	if(rtt > stats->rtt_max)
+		stats->rtt_max = rtt;
+	stats->rtt_total += rtt;
+	netperf_count(stats, length, now);
+	next_seq++;
+}
+
+int netperf_ping(unsigned int ip, unsigned short port, unsigned int count,
+	unsigned int length, struct netperf_stats *s)
+{
+	struct udp_timeout timeout;
+	struct netperf_header *h;
+	uint32_t seq;
+
+	memset(s, 0, sizeof(*s));
+	s->rtt_min = UINT64_MAX;
+	if(length < sizeof(struct netperf_header))
+		length = sizeof(struct netperf_header);
+	if(length > UDP_PAYLOAD_MAX)
+		length = UDP_PAYLOAD_MAX;
+	if(!udp_arp_resolve(ip))
+		return 0;
+
+	stats = s;
+	netperf_port = port;
+	udp_set_callback(ping_callback);
+	for(seq = 0; seq < count; seq++) {
+		next_seq = seq;
+		h = udp_get_tx_buffer();
+		/* Stamped last, the payload fill isn't part of the round trip */
+		memset(h + 1, 0x5a, length - sizeof(struct netperf_header));
+		netperf_header(h, NETPERF_ECHO_REQUEST, seq, time_ns());
+		udp_send(port, port, length);
+		udp_timeout_start(&timeout, NETPERF_ECHO_TIMEOUT);
+		while((next_seq == seq) && !udp_timeout_expired(&timeout))
+			udp_service();
+		if(next_seq == seq)
+			s->lost++;
+	}
+	udp_set_callback(NULL);
+	return s->packets;
+}
+
+void netperf_print(const struct netperf_stats *s)
+{
+	uint64_t kbps = 0, wire_kbps = 0, pps = 0;
+
+	if(s->ns) {
+		/* Rates over the packets after the first, which starts the measure */
+		kbps = (s->bytes - s->bytes/s->packets)*8000000/s->ns;
+		wire_kbps = (s->bytes - s->bytes/s->packets +
+			(uint64_t)(s->packets - 1)*NETPERF_FRAME_OVERHEAD)*8000000/s->ns;
+		pps = (uint64_t)(s->packets - 1)*1000000000/s->ns;
+	}
+	printf("%u packets, %lu bytes in %lu us: %lu.%03lu Mbit/s (%lu.%03lu Mbit/s on the wire), %lu packets/s\n",
+		s->packets, (unsigned long)s->bytes, (unsigned long)(s->ns/1000),
+		(unsigned long)(kbps/1000), (unsigned long)(kbps%1000),
+		(unsigned long)(wire_kbps/1000), (unsigned long)(wire_kbps%1000),
+		(unsigned long)pps);
+	if(s->lost || s->reordered)
+		printf("%u lost, %u reordered\n", s->lost, s->reordered);
+	if(s->rtt_total)
+		printf("RTT min/avg/max %lu/%lu/%lu ns\n",
+			(unsigned long)s->rtt_min, (unsigned long)(s->rtt_total/s->packets),
+			(unsigned long)s->rtt_max);
+}
@@ -0,0 +1,58 @@
+#ifndef __NETPERF_H
+#define __NETPERF_H
+
+#include <stdint.h>
+
+/* Network self-test (litex_netperf): UDP source and sink measuring the
+ * throughput and the losses, echo responder and client measuring the round
+ * trip time. Every packet starts with the header, big endian, the sender
+ * timestamp being echoed back unchanged. */
+#define NETPERF_PORT	6071
+#define NETPERF_MAGIC	0x4c584e50	/* "LXNP" */
+
+enum {
+	NETPERF_DATA		= 1,	/* seq: packet number */
+	NETPERF_ECHO_REQUEST	= 2,	/* seq: request number, stamp: of the sender (ns) */
+	NETPERF_ECHO_REPLY	= 3,	/* The request sent back */
+};
+
+struct netperf_header {
+	uint32_t magic;
+	uint8_t type;
+	uint8_t reserved[3];
+	uint32_t seq;
+	uint32_t stamp_hi;
+	uint32_t stamp_lo;
+} __attribute__((packed));
+
+/* Packets and UDP payload bytes over ns, first to last packet */
+struct netperf_stats {
+	uint32_t packets;
+	uint32_t lost;
+	uint32_t reordered;
+	uint64_t bytes;
+	uint64_t ns;
+	/* Round trip times (ns) of the echo replies */
+	uint64_t rtt_min;
+	uint64_t rtt_max;
+	uint64_t rtt_total;
+};
+
+/* Sends length bytes payloads to ip:port for ms, paced to mbps (Mbit/s
+ * of UDP payload, 0: as fast as possible), returns -1 if ip isn't reached */
+int netperf_send(unsigned int ip, unsigned short port, unsigned int length,
+	unsigned int ms, unsigned int mbps, struct netperf_stats *s);
+/* Counts the packets received on port for ms at most, ends once they stop
+ * for NETPERF_IDLE_TIMEOUT ms, returns -1 if none was received */
+int netperf_receive(unsigned short port, unsigned int ms, struct netperf_stats *s);
+/* Sends back the echo requests received on port for ms, returns their number */
+int netperf_echo(unsigned short port, unsigned int ms);
+/* Sends count echo requests of length bytes to ip:port one after the other,
+ * returns the number of replies */
+int netperf_ping(unsigned int ip, unsigned short port, unsigned int count,
+	unsigned int length, struct netperf_stats *s);
+
+/* Prints the rates of s (Mbit/s of payload and on the wire, packets/s) */
+void netperf_print(const struct netperf_stats *s);
+
+#endif /* __NETPERF_H */
@@ -8,9 +8,13 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <generated/soc.h>
+
 #include <libbase/progress.h>
+#include <libbase/task.h>
 
 #include <libliteeth/udp.h>
 #include <libliteeth/tftp.h>
@@ -24,14 +28,44 @@ enum {
 	TFTP_DATA	= 3,	/* Data */
 	TFTP_ACK	= 4,	/* Acknowledgment */
 	TFTP_ERROR	= 5,	/* Error */
+	TFTP_OACK	= 6,	/* Options acknowledgment */
 };
 
 #define	BLOCK_SIZE	512	/* block size in bytes */
 
+/* Downloads negotiate larger blocks (RFC 2348) and windows of blocks sent
+ * before an acknowledge (RFC 7440), servers without options use 512/1 */
+/* The block and its TFTP header fit a UDP payload: 1468 bytes with a 1500
+ * bytes MTU, up to 8968 with jumbo frames */
+#define	BLOCK_SIZE_MAX	(UDP_PAYLOAD_MAX - 4)
+/* Timeouts in ms: reply to a request, silence aborting a transfer, silence
+ * after which the last block is acknowledged again (restarting a window
+ * whose last block was lost without waiting for the server timeout) */
+#define	REQUEST_TIMEOUT	1000
+#define	BLOCK_TIMEOUT	6000
+#define	REACK_TIMEOUT	250
+#ifndef TFTP_WINDOW_SIZE
+#ifdef ETHMAC_RX_SLOTS
+#define TFTP_WINDOW_SIZE ETHMAC_RX_SLOTS
+#else
+#define TFTP_WINDOW_SIZE 1
+#endif
+#endif
+
+#define TFTP_ERROR_OPTIONS 8
+
+static int format_option(uint8_t *buf, const char *name, int value)
+{
+	int len = strlen(name) + 1;
+
+	memcpy(buf, name, len);
+	return len + sprintf((char *)buf + len, "%d", value) + 1;
+}
 
-static int format_request(uint8_t *buf, uint16_t op, const char *filename)
+static int format_request(uint8_t *buf, uint16_t op, const char *filename, int options)
 {
 	int len = strlen(filename);
+	uint8_t *start = buf;
 
 	*buf++ = op >> 8; /* Opcode */
 	*buf++ = op;
@@ -44,7 +78,11 @@ static int format_request(uint8_t *buf, uint16_t op, const char *filename)
 	*buf++ = 'e';
 	*buf++ = 't';
 	*buf++ = 0x00;
-	return 9+strlen(filename);
+	if(options) {
+		buf += format_option(buf, "blksize", BLOCK_SIZE_MAX);
+		buf += format_option(buf, "windowsize", TFTP_WINDOW_SIZE);
+	}
+	return buf - start;
 }
 
 static int format_ack(uint8_t *buf, uint16_t block)
@@ -70,6 +108,57 @@ static uint8_t *packet_data;
 static int total_length;
 static int transfer_finished;
 static uint8_t *dst_buffer;
+static tftp_data_callback data_callback;
+static void *data_arg;
+static int block_size;
+static int window_size;
+static int window_count;
+static uint16_t next_block;
+static int transfer_started; /* first DATA or OACK received */
+static int options_refused;
+
+/* Copies a block out of the uncached RX slot by aligned word reads */
+static void copy_from_slot(uint8_t *dst, const uint8_t *src, int length)
+{
+	uint32_t w;
+
+	while(length && ((unsigned long)src & 3)) {
+		*dst++ = *src++;
+		length--;
+	}
+	while(length >= 4) {
+		w = *(const uint32_t *)src;
+		__builtin_memcpy(dst, &w, 4);
+		dst += 4;
+		src += 4;
+		length -= 4;
+	}
+	while(length--)
+		*dst++ = *src++;
+}
+
+static void parse_options(const uint8_t *data, int length)
+{
+	const char *name, *value;
+	int i = 0;
+
+	while(i < length) {
+		name = (const char *)data + i;
+		i += strnlen(name, length - i) + 1;
+		if(i >= length)
+			break;
+		value = (const char *)data + i;
+		i += strnlen(value, length - i) + 1;
+		if(!strcmp(name, "blksize"))
+			block_size = strtoul(value, NULL, 10);
+		else if(!strcmp(name, "windowsize"))
+			window_size = strtoul(value, NULL, 10);
+	}
+	if((block_size < 8) || (block_size > BLOCK_SIZE_MAX))
+		block_size = BLOCK_SIZE;
+	if((window_size < 1) || (window_size > TFTP_WINDOW_SIZE))
+		window_size = 1;
+}
 static int last_ack; /* signed, so we can use -1 */
 static uint16_t data_port;
 
@@ -79,8 +168,6 @@ static void rx_callback(uint32_t src_ip, uint16_t src_port,
 	uint8_t *data = _data;
 	uint16_t opcode;
 	uint16_t block;
-	int i;
-	int offset;
 
 	if(length < 4) return;
 	if(dst_port != PORT_IN) return;
@@ -91,33 +178,64 @@ static void rx_callback(uint32_t src_ip, uint16_t src_port,
 		last_ack = block;
 		return;
 	}
-	if(block < 1) return;
-	if(opcode == TFTP_DATA) { /* Data */
-		length -= 4;
-		offset = (block-1)*BLOCK_SIZE;
-		for(i=0;i<length;i++)
-			dst_buffer[offset+i] = data[i+4];
-		total_length += length;
-		if(length < BLOCK_SIZE)
-			transfer_finished = 1;
-
+	if(opcode == TFTP_OACK) { /* Options acknowledgement */
+		/* Parsed once, a repeat before data (its ack lost) is acked again */
+		if(total_length != 0)
+			return;
+		if(!transfer_started)
+			parse_options(data + 2, length - 2);
+		transfer_started = 1;
 		packet_data = udp_get_tx_buffer();
-		length = format_ack(packet_data, block);
+		length = format_ack(packet_data, 0);
 		udp_send(PORT_IN, src_port, length);
+		return;
 	}
 	if(opcode == TFTP_ERROR) { /* Error */
+		options_refused = (block == TFTP_ERROR_OPTIONS) && !transfer_started;
 		total_length = -1;
 		transfer_finished = 1;
+		return;
+	}
+	if(opcode == TFTP_DATA) { /* Data */
+		transfer_started = 1;
+		data_port = src_port;
+		length -= 4;
+		/* Blocks are taken in order (the 16-bit block number wrapping
+		   around), the others (retransmitted or after a lost one) only
+		   count towards the acknowledge of the window */
+		if(block == next_block) {
+			if(data_callback) {
+				if(data_callback(data + 4, length, data_arg) < 0) {
+					total_length = -1;
+					transfer_finished = 1;
+					return;
+				}
+			} else
+				copy_from_slot(dst_buffer + total_length, data + 4, length);
+			total_length += length;
+			next_block++;
+			if(length < block_size)
+				transfer_finished = 1;
+		}
+		window_count++;
+		if(!transfer_finished && (window_count < window_size))
+			return;
+		window_count = 0;
+		packet_data = udp_get_tx_buffer();
+		length = format_ack(packet_data, next_block - 1);
+		udp_send(PORT_IN, src_port, length);
 	}
 }
 
-int tftp_get(uint32_t ip, uint16_t server_port, const char *filename,
-    void *buffer)
+static int tftp_get_common(uint32_t ip, uint16_t server_port, const char *filename,
+    void *buffer, tftp_data_callback data, void *arg)
 {
 	int len;
 	int tries;
-	int i;
 	int length_before;
+	int options;
+	struct udp_timeout timeout;
+	struct udp_timeout reack;
 
 	if(!udp_arp_resolve(ip))
 		return -1;
@@ -125,18 +243,33 @@ int tftp_get(uint32_t ip, uint16_t server_port, const char *filename,
 	udp_set_callback(rx_callback);
 
 	dst_buffer = buffer;
+	data_callback = data;
+	data_arg = arg;
 
-	total_length = 0;
-	transfer_finished = 0;
+	options = 1;
 	tries = 5;
 	while(1) {
+		total_length = 0;
+		transfer_finished = 0;
+		block_size = BLOCK_SIZE;
+		window_size = 1;
+		window_count = 0;
+		next_block = 1;
+		transfer_started = 0;
+		options_refused = 0;
 		packet_data = udp_get_tx_buffer();
-		len = format_request(packet_data, TFTP_RRQ, filename);
+		len = format_request(packet_data, TFTP_RRQ, filename, options);
 		udp_send(PORT_IN, server_port, len);
-		for(i=0;i<2000000;i++) {
+		udp_timeout_start(&timeout, REQUEST_TIMEOUT);
+		while(!udp_timeout_expired(&timeout)) {
 			udp_service();
 			if((total_length > 0) || transfer_finished) break;
 		}
+		/* Retry without options for servers refusing them */
+		if(options_refused && options) {
+			options = 0;
+			continue;
+		}
 		if((total_length > 0) || transfer_finished) break;
 		tries--;
 		if(tries == 0) {
@@ -145,21 +278,31 @@ int tftp_get(uint32_t ip, uint16_t server_port, const char *filename,
 		}
 	}
 
-	i = 12000000;
+	udp_timeout_start(&timeout, BLOCK_TIMEOUT);
+	udp_timeout_start(&reack, REACK_TIMEOUT);
 	length_before = total_length;
 	init_progression_bar(0);
 	while(!transfer_finished) {
 		if(length_before != total_length) {
-			i = 12000000;
+			udp_timeout_start(&timeout, BLOCK_TIMEOUT);
+			udp_timeout_start(&reack, REACK_TIMEOUT);
 			length_before = total_length;
 			if ((total_length & (0x8000 - 1)) == 0)
 				show_progress(-1);
 		}
-		if(i-- == 0) {
+		if(udp_timeout_expired(&timeout)) {
 			udp_set_callback(NULL);
 			return -1;
 		}
+		if((window_size > 1) && udp_timeout_expired(&reack)) {
+			udp_timeout_start(&reack, REACK_TIMEOUT);
+			window_count = 0;
+			packet_data = udp_get_tx_buffer();
+			len = format_ack(packet_data, next_block - 1);
+			udp_send(PORT_IN, data_port, len);
+		}
 		udp_service();
+		task_yield();
 	}
 
 	udp_set_callback(NULL);
@@ -167,13 +310,25 @@ int tftp_get(uint32_t ip, uint16_t server_port, const char *filename,
 	return total_length;
 }
 
+int tftp_get(uint32_t ip, uint16_t server_port, const char *filename,
+    void *buffer)
+{
+	return tftp_get_common(ip, server_port, filename, buffer, NULL, NULL);
+}
+
+int tftp_get_stream(uint32_t ip, uint16_t server_port, const char *filename,
+    tftp_data_callback data, void *arg)
+{
+	return tftp_get_common(ip, server_port, filename, NULL, data, arg);
+}
+
 int tftp_put(uint32_t ip, uint16_t server_port, const char *filename,
     const void *buffer, int size)
 {
 	int len, send;
 	int tries;
-	int i;
 	int block = 0, sent = 0;
+	struct udp_timeout timeout;
 
 	if(!udp_arp_resolve(ip))
 		return -1;
@@ -187,9 +342,10 @@ int tftp_put(uint32_t ip, uint16_t server_port, const char *filename,
 	tries = 5;
 	while(1) {
 		packet_data = udp_get_tx_buffer();
-		len = format_request(packet_data, TFTP_WRQ, filename);
+		len = format_request(packet_data, TFTP_WRQ, filename, 0);
 		udp_send(PORT_IN, server_port, len);
-		for(i=0;i<2000000;i++) {
+		udp_timeout_start(&timeout, REQUEST_TIMEOUT);
+		while(!udp_timeout_expired(&timeout)) {
 			last_ack = -1;
 			udp_service();
 			if(last_ack == block)
@@ -211,7 +367,8 @@ send_data:
 			packet_data = udp_get_tx_buffer();
 			len = format_data(packet_data, block, buffer, send);
 			udp_send(PORT_IN, data_port, len);
-			for(i=0;i<12000000;i++) {
+			udp_timeout_start(&timeout, BLOCK_TIMEOUT);
+			while(!udp_timeout_expired(&timeout)) {
 				udp_service();
 				if(transfer_finished)
 					goto fail;
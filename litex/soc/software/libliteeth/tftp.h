@@ -5,6 +5,10 @@
 
 int tftp_get(uint32_t ip, uint16_t server_port, const char *filename,
     void *buffer);
+/* Passes the blocks in order to data(), a negative return aborts */
+typedef int (*tftp_data_callback)(const uint8_t *data, int length, void *arg);
+int tftp_get_stream(uint32_t ip, uint16_t server_port, const char *filename,
+    tftp_data_callback data, void *arg);
 int tftp_put(uint32_t ip, uint16_t server_port, const char *filename,
     const void *buffer, int size);
 
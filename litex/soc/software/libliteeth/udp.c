@@ -14,8 +14,10 @@
 #include <stdio.h>
 
 #include <system.h>
+#include <irq.h>
 
 #include <libbase/crc.h>
+#include <libbase/isr.h>
 
 #include <libliteeth/inet.h>
 #include <libliteeth/udp.h>
@@ -23,6 +25,14 @@
 //#define ETH_UDP_TX_DEBUG
 //#define ETH_UDP_RX_DEBUG
 
+/* Frames received by the interrupt of the MAC (ETH_RX_IRQ) instead of polls */
+#if defined(ETH_RX_IRQ) && defined(ETHMAC_INTERRUPT) && defined(CONFIG_CPU_HAS_INTERRUPT)
+#define UDP_RX_IRQ
+#endif
+
+/* Wait for each ARP reply, in ms */
+#define UDP_ARP_TIMEOUT 50
+
 #define ETHERTYPE_ARP 0x0806
 #define ETHERTYPE_IP  0x0800
 
@@ -30,6 +40,16 @@
 #define HW_PREAMBLE_CRC
 #endif
 
+/* Checksum offload: MACs with a tx_checksum CSR insert the IP and UDP
+   checksums of the frames sent (left to 0 here), with an rx_checksum CSR
+   drop the received frames failing them, both enabled by udp_start() */
+#ifdef CSR_ETHMAC_TX_CHECKSUM_ADDR
+#define HW_TX_CHECKSUM
+#endif
+#ifdef CSR_ETHMAC_RX_CHECKSUM_ADDR
+#define HW_RX_CHECKSUM
+#endif
+
 struct ethernet_header {
 #ifndef HW_PREAMBLE_CRC
 	unsigned char preamble[8];
@@ -131,11 +151,16 @@ static unsigned int txslot;
 static unsigned int txlen;
 static ethernet_buffer *txbuffer;
 
-static void send_packet(void)
+/* The TX slots are sent in order and the command FIFO of the MAC holds one
+   entry per slot: the slot to fill is free once the FIFO has room. Waiting
+   before filling it keeps all the TX slots in flight. */
+static void wait_tx_slot(void)
 {
-	/* wait buffer to be available */
 	while(!(ethmac_sram_reader_ready_read()));
+}
 
+static void send_packet(void)
+{
 	/* fill txbuffer */
 #ifndef HW_PREAMBLE_CRC
 	unsigned int crc;
@@ -180,10 +205,66 @@ void udp_set_mac(const unsigned char *macaddr)
     		my_mac[i] = macaddr[i];
 }
 
-/* ARP cache - one entry only */
+/* ARP cache - ARP_CACHE_SIZE entries replaced in turn, an entry without MAC
+   waiting for the reply to its request. cached_ip/cached_mac are the
+   destination of udp_send(), the last address resolved. */
+#ifndef ARP_CACHE_SIZE
+#define ARP_CACHE_SIZE 4
+#endif
+
+struct arp_entry {
+	unsigned int ip;
+	unsigned char mac[6];
+};
+
+static struct arp_entry arp_cache[ARP_CACHE_SIZE];
+static unsigned int arp_next;
+
 static unsigned char cached_mac[6];
 static unsigned int cached_ip;
 
+static int mac_valid(const unsigned char *mac)
+{
+	int i;
+	for(i=0;i<6;i++)
+		if(mac[i]) return 1;
+	return 0;
+}
+
+static struct arp_entry *arp_lookup(unsigned int ip)
+{
+	int i;
+	for(i=0;i<ARP_CACHE_SIZE;i++)
+		if(arp_cache[i].ip == ip) return &arp_cache[i];
+	return (struct arp_entry *)0;
+}
+
+/* Adds ip or updates its MAC (mac NULL: unresolved/unchanged) */
+static struct arp_entry *arp_add(unsigned int ip, const unsigned char *mac)
+{
+	struct arp_entry *e;
+	int i;
+
+	e = arp_lookup(ip);
+	if(!e) {
+		/* Never evict the destination */
+		if((ARP_CACHE_SIZE > 1) && (arp_cache[arp_next].ip == cached_ip))
+			arp_next = (arp_next + 1)%ARP_CACHE_SIZE;
+		e = &arp_cache[arp_next];
+		arp_next = (arp_next + 1)%ARP_CACHE_SIZE;
+		e->ip = ip;
+		for(i=0;i<6;i++)
+			e->mac[i] = 0;
+	}
+	if(mac)
+		for(i=0;i<6;i++)
+			e->mac[i] = mac[i];
+	if(ip == cached_ip)
+		for(i=0;i<6;i++)
+			cached_mac[i] = e->mac[i];
+	return e;
+}
+
 static void process_arp(void)
 {
 	const struct arp_frame *rx_arp = &rxbuffer->frame.contents.arp;
@@ -195,18 +276,20 @@ static void process_arp(void)
 	if(rx_arp->hwsize != 6) return;
 	if(rx_arp->protosize != 4) return;
 
-	if(ntohs(rx_arp->opcode) == ARP_OPCODE_REPLY) {
-		if(ntohl(rx_arp->sender_ip) == cached_ip) {
-			int i;
-			for(i=0;i<6;i++)
-				cached_mac[i] = rx_arp->sender_mac[i];
-		}
-		return;
-	}
+	/* Replies to our requests and gratuitous ARPs update the entries
+	   (probes have no sender address) */
+	if(rx_arp->sender_ip && arp_lookup(ntohl(rx_arp->sender_ip)))
+		arp_add(ntohl(rx_arp->sender_ip), rx_arp->sender_mac);
+
 	if(ntohs(rx_arp->opcode) == ARP_OPCODE_REQUEST) {
 		if(ntohl(rx_arp->target_ip) == my_ip) {
 			int i;
 
+			/* The sender is about to talk to us */
+			if(rx_arp->sender_ip)
+				arp_add(ntohl(rx_arp->sender_ip), rx_arp->sender_mac);
+
+			wait_tx_slot();
 			fill_eth_header(&txbuffer->frame.eth_header,
 				rx_arp->sender_mac,
 				my_mac,
@@ -231,65 +314,78 @@ static void process_arp(void)
 
 static const unsigned char broadcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 
-int udp_arp_resolve(unsigned int ip)
+static void send_arp_request(unsigned int ip)
 {
 	struct arp_frame *arp;
 	int i;
+
+	wait_tx_slot();
+	fill_eth_header(&txbuffer->frame.eth_header,
+			broadcast,
+			my_mac,
+			ETHERTYPE_ARP);
+	txlen = ARP_PACKET_LENGTH;
+	arp = &txbuffer->frame.contents.arp;
+	arp->hwtype = htons(ARP_HWTYPE_ETHERNET);
+	arp->proto = htons(ARP_PROTO_IP);
+	arp->hwsize = 6;
+	arp->protosize = 4;
+	arp->opcode = htons(ARP_OPCODE_REQUEST);
+	arp->sender_ip = htonl(my_ip);
+	for(i=0;i<6;i++)
+		arp->sender_mac[i] = my_mac[i];
+	arp->target_ip = htonl(ip);
+	for(i=0;i<6;i++)
+		arp->target_mac[i] = 0;
+
+	send_packet();
+}
+
+/* Sends an ARP request without waiting for the reply: it is learnt when
+   received (by any udp_service()), the next udp_arp_resolve() of ip not
+   waiting for it again */
+void udp_arp_request(unsigned int ip)
+{
+	struct arp_entry *e;
+
+	e = arp_add(ip, (unsigned char *)0);
+	if(!mac_valid(e->mac))
+		send_arp_request(ip);
+}
+
+int udp_arp_resolve(unsigned int ip)
+{
 	int tries;
-	int timeout;
+	struct udp_timeout timeout;
 
-	if(cached_ip == ip) {
-		for(i=0;i<6;i++)
-			if(cached_mac[i]) return 1;
-	}
+	if(!arp_lookup(ip))
+		udp_arp_request(ip);
+
+	/* Make ip the destination */
 	cached_ip = ip;
-	for(i=0;i<6;i++)
-		cached_mac[i] = 0;
+	arp_add(ip, (unsigned char *)0);
+	if(mac_valid(cached_mac))
+		return 1;
 
 	for(tries=0;tries<100;tries++) {
-		/* Send an ARP request */
-		fill_eth_header(&txbuffer->frame.eth_header,
-				broadcast,
-				my_mac,
-				ETHERTYPE_ARP);
-		txlen = ARP_PACKET_LENGTH;
-		arp = &txbuffer->frame.contents.arp;
-		arp->hwtype = htons(ARP_HWTYPE_ETHERNET);
-		arp->proto = htons(ARP_PROTO_IP);
-		arp->hwsize = 6;
-		arp->protosize = 4;
-		arp->opcode = htons(ARP_OPCODE_REQUEST);
-		arp->sender_ip = htonl(my_ip);
-		for(i=0;i<6;i++)
-			arp->sender_mac[i] = my_mac[i];
-		arp->target_ip = htonl(ip);
-		for(i=0;i<6;i++)
-			arp->target_mac[i] = 0;
-
-		send_packet();
+		/* Send an ARP request again */
+		if(tries > 0)
+			send_arp_request(ip);
 
 		/* Do we get a reply ? */
-		for(timeout=0;timeout<100000;timeout++) {
+		udp_timeout_start(&timeout, UDP_ARP_TIMEOUT);
+		while(!udp_timeout_expired(&timeout)) {
 			udp_service();
-			for(i=0;i<6;i++)
-				if(cached_mac[i]) return 1;
+			if(mac_valid(cached_mac))
+				return 1;
 		}
 	}
 
 	return 0;
 }
 
-static unsigned short ip_checksum(unsigned int r, void *buffer, unsigned int length, int complete)
+static unsigned short __attribute__((unused)) checksum_fold(unsigned int r, int complete)
 {
-	unsigned char *ptr;
-	unsigned int i;
-
-	ptr = (unsigned char *)buffer;
-	length >>= 1;
-
-	for(i=0;i<length;i++)
-		r += ((unsigned int)(ptr[2*i]) << 8)|(unsigned int)(ptr[2*i+1]) ;
-
 	/* Add overflows */
 	while(r >> 16)
 		r = (r & 0xffff) + (r >> 16);
@@ -302,28 +398,79 @@ static unsigned short ip_checksum(unsigned int r, void *buffer, unsigned int len
 	return r;
 }
 
+/* One's complement sum (RFC 1071) of the 16-bit words of buffer continuing
+   r. The words are summed as loaded, by 32 bits with end around carry once
+   aligned, the byte order being restored on the folded sum. */
+static unsigned short __attribute__((unused)) ip_checksum(unsigned int r, void *buffer, unsigned int length, int complete)
+{
+	const unsigned char *ptr = buffer;
+	unsigned int sum;
+	unsigned int w;
+
+	length &= ~1;
+	if((unsigned long)ptr & 1) {
+		for(;length;length-=2,ptr+=2)
+			r += ((unsigned int)(ptr[0]) << 8)|(unsigned int)(ptr[1]);
+		return checksum_fold(r, complete);
+	}
+
+	sum = htons(checksum_fold(r, 0));
+	if(((unsigned long)ptr & 2) && length) {
+		sum += *(const uint16_t *)ptr;
+		ptr += 2;
+		length -= 2;
+	}
+	for(;length >= 4;length-=4,ptr+=4) {
+		w = *(const uint32_t *)ptr;
+		sum += w;
+		if(sum < w) sum++;
+	}
+	if(length) {
+		w = *(const uint16_t *)ptr;
+		sum += w;
+		if(sum < w) sum++;
+	}
+	return checksum_fold(ntohs(checksum_fold(sum, 0)), complete);
+}
+
+/* Partial sums of the header fields constant for a destination: the
+   headers of a packet only add their length and ports (RFC 1624) */
+static unsigned int header_src_ip;
+static unsigned int header_dst_ip;
+static unsigned int ip_header_sum;
+static unsigned int pseudo_header_sum;
+
+static void __attribute__((unused)) update_header_sums(void)
+{
+	unsigned int ips;
+
+	ips = (my_ip >> 16) + (my_ip & 0xffff) + (cached_ip >> 16) + (cached_ip & 0xffff);
+	ip_header_sum = (IP_IPV4 << 8) + IP_DONT_FRAGMENT + ((IP_TTL << 8) | IP_PROTO_UDP) + ips;
+	pseudo_header_sum = IP_PROTO_UDP + ips;
+	header_src_ip = my_ip;
+	header_dst_ip = cached_ip;
+}
+
 void *udp_get_tx_buffer(void)
 {
+	wait_tx_slot();
 	return txbuffer->frame.contents.udp.payload;
 }
 
-struct pseudo_header {
-	unsigned int src_ip;
-	unsigned int dst_ip;
-	unsigned char zero;
-	unsigned char proto;
-	unsigned short length;
-} __attribute__((packed));
-
 int udp_send(unsigned short src_port, unsigned short dst_port, unsigned int length)
 {
-	struct pseudo_header h;
+#ifndef HW_TX_CHECKSUM
 	unsigned int r;
+#endif
 
-	if((cached_mac[0] == 0) && (cached_mac[1] == 0) && (cached_mac[2] == 0)
-		&& (cached_mac[3] == 0) && (cached_mac[4] == 0) && (cached_mac[5] == 0))
+	if(!mac_valid(cached_mac))
 		return 0;
 
+#ifndef HW_TX_CHECKSUM
+	if((header_src_ip != my_ip) || (header_dst_ip != cached_ip))
+		update_header_sums();
+#endif
+
 	txlen = length + sizeof(struct ethernet_header) + sizeof(struct udp_frame);
 	if(txlen < ARP_PACKET_LENGTH) txlen = ARP_PACKET_LENGTH;
 
@@ -338,27 +485,30 @@ int udp_send(unsigned short src_port, unsigned short dst_port, unsigned int leng
 	txbuffer->frame.contents.udp.ip.identification = htons(0);
 	txbuffer->frame.contents.udp.ip.fragment_offset = htons(IP_DONT_FRAGMENT);
 	txbuffer->frame.contents.udp.ip.ttl = IP_TTL;
-	h.proto = txbuffer->frame.contents.udp.ip.proto = IP_PROTO_UDP;
-	txbuffer->frame.contents.udp.ip.checksum = 0;
-	h.src_ip = txbuffer->frame.contents.udp.ip.src_ip = htonl(my_ip);
-	h.dst_ip = txbuffer->frame.contents.udp.ip.dst_ip = htonl(cached_ip);
-	txbuffer->frame.contents.udp.ip.checksum = htons(ip_checksum(0, &txbuffer->frame.contents.udp.ip,
-		sizeof(struct ip_header), 1));
+	txbuffer->frame.contents.udp.ip.proto = IP_PROTO_UDP;
+	txbuffer->frame.contents.udp.ip.src_ip = htonl(my_ip);
+	txbuffer->frame.contents.udp.ip.dst_ip = htonl(cached_ip);
 
 	txbuffer->frame.contents.udp.udp.src_port = htons(src_port);
 	txbuffer->frame.contents.udp.udp.dst_port = htons(dst_port);
-	h.length = txbuffer->frame.contents.udp.udp.length = htons(length + sizeof(struct udp_header));
+	txbuffer->frame.contents.udp.udp.length = htons(length + sizeof(struct udp_header));
 	txbuffer->frame.contents.udp.udp.checksum = 0;
 
-	h.zero = 0;
-	r = ip_checksum(0, &h, sizeof(struct pseudo_header), 0);
+#ifdef HW_TX_CHECKSUM
+	txbuffer->frame.contents.udp.ip.checksum = 0;
+#else
+	txbuffer->frame.contents.udp.ip.checksum = htons(checksum_fold(ip_header_sum +
+		length + sizeof(struct udp_frame), 1));
+
+	/* Pseudo header and UDP header lengths, ports */
+	r = pseudo_header_sum + 2*(length + sizeof(struct udp_header)) + src_port + dst_port;
 	if(length & 1) {
 		txbuffer->frame.contents.udp.payload[length] = 0;
 		length++;
 	}
-	r = ip_checksum(r, &txbuffer->frame.contents.udp.udp,
-		sizeof(struct udp_header)+length, 1);
+	r = ip_checksum(r, txbuffer->frame.contents.udp.payload, length, 1);
 	txbuffer->frame.contents.udp.udp.checksum = htons(r);
+#endif
 
 	send_packet();
 
@@ -367,11 +517,23 @@ int udp_send(unsigned short src_port, unsigned short dst_port, unsigned int leng
 
 static udp_callback rx_callback;
 
+static int mac_broadcast(const unsigned char *mac)
+{
+	int i;
+	for(i=0;i<6;i++)
+		if(mac[i] != 0xff) return 0;
+	return 1;
+}
+
 static void process_ip(void)
 {
 	if(rxlen < (sizeof(struct ethernet_header)+sizeof(struct udp_frame))) return;
 	struct udp_frame *udp_ip = &rxbuffer->frame.contents.udp;
+#ifdef HW_RX_CHECKSUM
+	/* UDP and IP checksums verified by the MAC */
+#else
 	/* We don't verify UDP and IP checksums and rely on the Ethernet checksum solely */
+#endif
 	if(udp_ip->ip.version != IP_IPV4) return;
 	// check disabled for QEMU compatibility
 	//if(rxbuffer->frame.contents.udp.ip.diff_services != 0) return;
@@ -379,7 +541,9 @@ static void process_ip(void)
 	// check disabled for QEMU compatibility
 	//if(ntohs(rxbuffer->frame.contents.udp.ip.fragment_offset) != IP_DONT_FRAGMENT) return;
 	if(udp_ip->ip.proto != IP_PROTO_UDP) return;
-	if(ntohl(udp_ip->ip.dst_ip) != my_ip) return;
+	/* Datagrams to us, or broadcast (limited or subnet, a host pushing the
+	   same image to several boards) */
+	if((ntohl(udp_ip->ip.dst_ip) != my_ip) && !mac_broadcast(rxbuffer->frame.eth_header.destmac)) return;
 	if(ntohs(udp_ip->udp.length) < sizeof(struct udp_header)) return;
 
 	if(rx_callback)
@@ -428,6 +592,113 @@ static void process_frame(void)
 	else if(ntohs(rxbuffer->frame.eth_header.ethertype) == ETHERTYPE_IP) process_ip();
 }
 
+/* RX queue: udp_isr() moves the frames out of the RX slots of the MAC as
+   they arrive, udp_service() processes them. With a size of 0, the frames
+   are left in the slots (up to ETHMAC_RX_SLOTS frames held, the MAC drops
+   the next ones) and processed in place, saving the copy of each frame:
+   udp_isr() only masks the interrupt, unmasked again by udp_service(). */
+#if defined(UDP_RX_IRQ) && !defined(UDP_RX_QUEUE_SIZE)
+#define UDP_RX_QUEUE_SIZE 4
+#endif
+
+#if defined(UDP_RX_IRQ) && (UDP_RX_QUEUE_SIZE > 0)
+
+static ethernet_buffer rx_queue[UDP_RX_QUEUE_SIZE];
+static unsigned int rx_queue_len[UDP_RX_QUEUE_SIZE];
+static volatile unsigned int rx_produce;
+static unsigned int rx_consume;
+
+void udp_isr(void)
+{
+	const unsigned int *src;
+	unsigned int *dst;
+	unsigned int rx_produce_next;
+	unsigned int len;
+	unsigned int i;
+
+	while(ethmac_sram_writer_ev_pending_read() & ETHMAC_EV_SRAM_WRITER) {
+		rx_produce_next = (rx_produce + 1)%UDP_RX_QUEUE_SIZE;
+		/* Dropped when the queue is full */
+		if(rx_produce_next != rx_consume) {
+			src = (const unsigned int *)(ETHMAC_BASE + ETHMAC_SLOT_SIZE * ethmac_sram_writer_slot_read());
+			dst = (unsigned int *)&rx_queue[rx_produce];
+			len = ethmac_sram_writer_length_read();
+			if(len > ETHMAC_SLOT_SIZE)
+				len = ETHMAC_SLOT_SIZE;
+			for(i=0;i<(len + 3)/4;i++)
+				dst[i] = src[i];
+			rx_queue_len[rx_produce] = len;
+			rx_produce = rx_produce_next;
+		}
+		ethmac_sram_writer_ev_pending_write(ETHMAC_EV_SRAM_WRITER);
+	}
+}
+
+static void udp_irq(void *arg)
+{
+	udp_isr();
+}
+
+static void udp_rx_irq_start(void)
+{
+	rx_produce = 0;
+	rx_consume = 0;
+	ethmac_sram_writer_ev_enable_write(ETHMAC_EV_SRAM_WRITER);
+	irq_attach(ETHMAC_INTERRUPT, udp_irq, NULL);
+}
+
+void udp_service(void)
+{
+	while(rx_consume != rx_produce) {
+		rxbuffer = &rx_queue[rx_consume];
+		rxlen = rx_queue_len[rx_consume];
+		process_frame();
+		rx_consume = (rx_consume + 1)%UDP_RX_QUEUE_SIZE;
+	}
+}
+
+#else
+
+#ifdef UDP_RX_IRQ
+void udp_isr(void)
+{
+	if(ethmac_sram_writer_ev_pending_read() & ETHMAC_EV_SRAM_WRITER)
+		ethmac_sram_writer_ev_enable_write(0);
+}
+
+static void udp_irq(void *arg)
+{
+	udp_isr();
+}
+
+static void udp_rx_irq_start(void)
+{
+	ethmac_sram_writer_ev_enable_write(ETHMAC_EV_SRAM_WRITER);
+	irq_attach(ETHMAC_INTERRUPT, udp_irq, NULL);
+}
+#endif
+
+void udp_service(void)
+{
+	int i;
+
+	/* Drain the RX slots filled */
+	for(i=0;i<ETHMAC_RX_SLOTS;i++) {
+		if(!(ethmac_sram_writer_ev_pending_read() & ETHMAC_EV_SRAM_WRITER))
+			break;
+		rxslot = ethmac_sram_writer_slot_read();
+		rxbuffer = (ethernet_buffer *)(ETHMAC_BASE + ETHMAC_SLOT_SIZE * rxslot);
+		rxlen = ethmac_sram_writer_length_read();
+		process_frame();
+		ethmac_sram_writer_ev_pending_write(ETHMAC_EV_SRAM_WRITER);
+	}
+#ifdef UDP_RX_IRQ
+	ethmac_sram_writer_ev_enable_write(ETHMAC_EV_SRAM_WRITER);
+#endif
+}
+
+#endif
+
 void udp_start(const unsigned char *macaddr, unsigned int ip)
 {
 	int i;
@@ -440,6 +711,9 @@ void udp_start(const unsigned char *macaddr, unsigned int ip)
 	cached_ip = 0;
 	for(i=0;i<6;i++)
 		cached_mac[i] = 0;
+	for(i=0;i<ARP_CACHE_SIZE;i++)
+		arp_cache[i].ip = 0;
+	arp_next = 0;
 
 	txslot = 0;
 	ethmac_sram_reader_slot_write(txslot);
@@ -448,19 +722,49 @@ void udp_start(const unsigned char *macaddr, unsigned int ip)
 	rxslot = 0;
 	rxbuffer = (ethernet_buffer *)(ETHMAC_BASE + ETHMAC_SLOT_SIZE * rxslot);
 	rx_callback = (udp_callback)0;
+#ifdef HW_TX_CHECKSUM
+	ethmac_tx_checksum_write(1);
+#endif
+#ifdef HW_RX_CHECKSUM
+	ethmac_rx_checksum_write(1);
+#endif
+#ifdef UDP_RX_IRQ
+	udp_rx_irq_start();
+#endif
 }
 
-void udp_service(void)
+/* Timeouts: by the uptime of timer0 when the SoC has it, by polls otherwise */
+#ifdef CSR_TIMER0_UPTIME_CYCLES_ADDR
+static uint64_t udp_uptime(void)
 {
-	if(ethmac_sram_writer_ev_pending_read() & ETHMAC_EV_SRAM_WRITER) {
-		rxslot = ethmac_sram_writer_slot_read();
-		rxbuffer = (ethernet_buffer *)(ETHMAC_BASE + ETHMAC_SLOT_SIZE * rxslot);
-		rxlen = ethmac_sram_writer_length_read();
-		process_frame();
-		ethmac_sram_writer_ev_pending_write(ETHMAC_EV_SRAM_WRITER);
-	}
+	timer0_uptime_latch_write(1);
+	return timer0_uptime_cycles_read();
+}
+
+void udp_timeout_start(struct udp_timeout *t, unsigned int ms)
+{
+	t->end = udp_uptime() + (uint64_t)(CONFIG_CLOCK_FREQUENCY/1000)*ms;
 }
 
+int udp_timeout_expired(struct udp_timeout *t)
+{
+	return udp_uptime() >= t->end;
+}
+#else
+void udp_timeout_start(struct udp_timeout *t, unsigned int ms)
+{
+	t->end = (uint64_t)UDP_POLLS_PER_MS*ms;
+}
+
+int udp_timeout_expired(struct udp_timeout *t)
+{
+	if(t->end == 0)
+		return 1;
+	t->end--;
+	return 0;
+}
+#endif
+
 void eth_init(void)
 {
 	printf("Ethernet init...\n");
@@ -1,6 +1,8 @@
 #ifndef __UDP_H
 #define __UDP_H
 
+#include <stdint.h>
+
 #define ETHMAC_EV_SRAM_WRITER	0x1
 #define ETHMAC_EV_SRAM_READER	0x1
 
@@ -8,16 +10,46 @@
 
 #define UDP_BUFSIZE (5*1532)
 
+/* IP MTU of the link: 1500, or up to 9000 for jumbo frames (ETH_MTU constant
+ * of the SoC, with MAC slots large enough to hold them) */
+#ifndef ETH_MTU
+#define ETH_MTU 1500
+#endif
+
+/* Largest UDP payload, fitting the MTU and a MAC slot with its preamble,
+ * Ethernet/IP/UDP headers, FCS and the padding of odd lengths */
+#define UDP_PAYLOAD_MTU (ETH_MTU - 28)
+#if defined(ETHMAC_SLOT_SIZE) && (ETHMAC_SLOT_SIZE - 58 < UDP_PAYLOAD_MTU)
+#define UDP_PAYLOAD_MAX (ETHMAC_SLOT_SIZE - 58)
+#else
+#define UDP_PAYLOAD_MAX UDP_PAYLOAD_MTU
+#endif
+
 typedef void (*udp_callback)(unsigned int src_ip, unsigned short src_port, unsigned short dst_port, void *data, unsigned int length);
 
 void udp_set_ip(unsigned int ip);
 void udp_set_mac(const unsigned char *macaddr);
 void udp_start(const unsigned char *macaddr, unsigned int ip);
+void udp_arp_request(unsigned int ip);
 int udp_arp_resolve(unsigned int ip);
 void *udp_get_tx_buffer(void);
 int udp_send(unsigned short src_port, unsigned short dst_port, unsigned int length);
 void udp_set_callback(udp_callback callback);
 void udp_service(void);
+void udp_isr(void);
+
+/* Timeouts in ms, by the uptime of timer0 when the SoC has it, by checks
+ * (UDP_POLLS_PER_MS of them, each around a udp_service()) otherwise */
+#ifndef UDP_POLLS_PER_MS
+#define UDP_POLLS_PER_MS 2000
+#endif
+
+struct udp_timeout {
+	uint64_t end;
+};
+
+void udp_timeout_start(struct udp_timeout *t, unsigned int ms);
+int udp_timeout_expired(struct udp_timeout *t);
 
 void eth_init(void);
 void eth_mode(void);
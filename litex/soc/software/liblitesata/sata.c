@@ -9,6 +9,8 @@
 #include <generated/mem.h>
 #include <system.h>
 
+#include <libbase/cache.h>
+#include <libbase/task.h>
 #include <libfatfs/ff.h>
 #include <libfatfs/diskio.h>
 #include "sata.h"
@@ -41,53 +43,240 @@ int sata_init(void) {
 
 #endif
 
+/* Sectors per DMA command, when the DMAs have the nsectors CSR (one sector
+   per command otherwise). LiteSATA has a single command in flight, unless
+   its sector2mem DMA has the tag CSR (NCQ, below). */
+#ifndef SATA_SECTORS_MAX
+#define SATA_SECTORS_MAX 128
+#endif
+
+/* Wait before retrying a failed command */
+#define SATA_RETRY_DELAY_US 10
+
 #ifdef CSR_SATA_SECTOR2MEM_BASE
 
+#ifdef CSR_SATA_SECTOR2MEM_TAG_ADDR
+
+/* Native Command Queuing: the sector2mem DMA of a LiteSATA core with FPDMA
+   queued commands takes up to SATA_NCQ_DEPTH tagged reads in flight. A read
+   is started by its tag (written with base/sector/nsectors before start),
+   the tags of the completed reads (and of those in error) are read from
+   the completed/error masks, cleared by writing the completed mask. A
+   request is split into commands of up to SATA_SECTORS_MAX sectors
+   submitted at once, completed by the ticket returned when submitted. */
+#ifndef SATA_NCQ_DEPTH
+#define SATA_NCQ_DEPTH 32
+#endif
+
+struct sata_tag {
+	uint32_t sector;
+	uint32_t nsectors;
+	uint8_t *buf;
+	unsigned int ticket;
+};
+
+static struct sata_tag sata_tags[SATA_NCQ_DEPTH];
+static uint32_t sata_tags_busy;
+static unsigned int sata_submitted;
+
+static void sata_tag_start(int tag)
+{
+	struct sata_tag *t = &sata_tags[tag];
+
+	sata_sector2mem_base_write((uint64_t)(uintptr_t) t->buf);
+	sata_sector2mem_sector_write(t->sector);
+#ifdef CSR_SATA_SECTOR2MEM_NSECTORS_ADDR
+	sata_sector2mem_nsectors_write(t->nsectors);
+#endif
+	sata_sector2mem_tag_write(tag);
+	sata_sector2mem_start_write(1);
+}
+
+/* Reaps the completed reads without waiting, returns the number in flight */
+int sata_poll(void)
+{
+	uint32_t completed, errors;
+	int tag, inflight;
+
+	completed = sata_sector2mem_completed_read() & sata_tags_busy;
+	if (completed) {
+		errors = sata_sector2mem_error_read();
+		sata_sector2mem_completed_write(completed);
+		for (tag = 0; tag < SATA_NCQ_DEPTH; tag++) {
+			if (!(completed & (1UL << tag)))
+				continue;
+			/* Failed reads are retried with the same tag */
+			if (errors & (1UL << tag)) {
+				busy_wait_us(SATA_RETRY_DELAY_US);
+				sata_tag_start(tag);
+				continue;
+			}
+			sata_tags_busy &= ~(1UL << tag);
+#ifndef CONFIG_CPU_HAS_DMA_BUS
+			/* Drop the cached lines of the buffer */
+			cache_invalidate_range(sata_tags[tag].buf, 512*sata_tags[tag].nsectors);
+#endif
+		}
+	}
+
+	inflight = 0;
+	for (tag = 0; tag < SATA_NCQ_DEPTH; tag++)
+		if (sata_tags_busy & (1UL << tag))
+			inflight++;
+	return inflight;
+}
+
+int sata_done(unsigned int ticket)
+{
+	int tag;
+
+	sata_poll();
+	for (tag = 0; tag < SATA_NCQ_DEPTH; tag++)
+		if ((sata_tags_busy & (1UL << tag)) && ((int)(sata_tags[tag].ticket - ticket) <= 0))
+			return 0;
+	return 1;
+}
+
+void sata_wait(unsigned int ticket)
+{
+	while (!sata_done(ticket))
+		task_yield();
+}
+
+unsigned int sata_ticket(void)
+{
+	return sata_submitted;
+}
+
+unsigned int sata_read_submit(uint32_t sector, uint32_t count, uint8_t* buf)
+{
+	struct sata_tag *t;
+	uint32_t nsectors;
+	int tag;
+
+	if (count == 0)
+		return sata_submitted;
+#ifndef CONFIG_CPU_HAS_DMA_BUS
+	/* No dirty line of the buffer must be written back over the DMA data */
+	cache_flush_range(buf, 512*count);
+#endif
+	sata_submitted++;
+	while (count) {
+		nsectors = 1;
+#ifdef CSR_SATA_SECTOR2MEM_NSECTORS_ADDR
+		nsectors = (count < SATA_SECTORS_MAX) ? count : SATA_SECTORS_MAX;
+#endif
+		/* Lowest free tag */
+		for (;;) {
+			for (tag = 0; tag < SATA_NCQ_DEPTH; tag++)
+				if (!(sata_tags_busy & (1UL << tag)))
+					break;
+			if (tag < SATA_NCQ_DEPTH)
+				break;
+			sata_poll();
+		}
+		t = &sata_tags[tag];
+		t->sector   = sector;
+		t->nsectors = nsectors;
+		t->buf      = buf;
+		t->ticket   = sata_submitted;
+		sata_tags_busy |= 1UL << tag;
+		sata_tag_start(tag);
+		sector += nsectors;
+		count  -= nsectors;
+		buf    += 512*nsectors;
+	}
+	return sata_submitted;
+}
+
 void sata_read(uint32_t sector, uint32_t count, uint8_t* buf)
 {
-	uint32_t i;
+	sata_wait(sata_read_submit(sector, count, buf));
+}
 
-	/* Write sectors */
-	for (i=0; i<count; i++) {
-		uint8_t done = 0;
-		while (done == 0) {
+#else
+
+void sata_read(uint32_t sector, uint32_t count, uint8_t* buf)
+{
+	uint8_t *start = buf;
+	uint32_t nsectors;
+
+#ifndef CONFIG_CPU_HAS_DMA_BUS
+	/* No dirty line of the buffer must be written back over the DMA data */
+	cache_flush_range(buf, 512*count);
+#endif
+
+	/* Read sectors */
+	while (count) {
+		nsectors = 1;
+#ifdef CSR_SATA_SECTOR2MEM_NSECTORS_ADDR
+		nsectors = (count < SATA_SECTORS_MAX) ? count : SATA_SECTORS_MAX;
+#endif
+		for (;;) {
 			sata_sector2mem_base_write((uint64_t)(uintptr_t) buf);
-			sata_sector2mem_sector_write(sector + i);
+			sata_sector2mem_sector_write(sector);
+#ifdef CSR_SATA_SECTOR2MEM_NSECTORS_ADDR
+			sata_sector2mem_nsectors_write(nsectors);
+#endif
 			sata_sector2mem_start_write(1);
-			while ((sata_sector2mem_done_read() & 0x1) == 0);
-			done = ((sata_sector2mem_error_read() & 0x1) == 0);
-			busy_wait_us(10);
+			while ((sata_sector2mem_done_read() & 0x1) == 0)
+				task_yield();
+			if ((sata_sector2mem_error_read() & 0x1) == 0)
+				break;
+			busy_wait_us(SATA_RETRY_DELAY_US);
 		}
-		buf += 512;
+		sector += nsectors;
+		count  -= nsectors;
+		buf    += 512*nsectors;
 	}
 
 #ifndef CONFIG_CPU_HAS_DMA_BUS
-	/* Flush caches */
-	flush_cpu_dcache();
-	flush_l2_cache();
+	/* Drop the cached lines of the buffer */
+	cache_invalidate_range(start, buf - start);
 #endif
 }
 
+#endif /* CSR_SATA_SECTOR2MEM_TAG_ADDR */
+
 #endif
 
 #ifdef CSR_SATA_MEM2SECTOR_BASE
 
 void sata_write(uint32_t sector, uint32_t count, uint8_t* buf)
 {
-	uint32_t i;
+	uint32_t nsectors;
+
+#ifndef CONFIG_CPU_HAS_DMA_BUS
+	/* Flush caches (Data to write still in a write-back L2) */
+	cache_flush_range(buf, 512*count);
+#endif
+#ifdef CSR_SATA_SECTOR2MEM_TAG_ADDR
+	/* Queued reads complete in any order: none must see the sectors written */
+	sata_wait(sata_ticket());
+#endif
 
 	/* Write sectors */
-	for (i=0; i<count; i++) {
-		uint8_t done = 0;
-		while (done == 0) {
+	while (count) {
+		nsectors = 1;
+#ifdef CSR_SATA_MEM2SECTOR_NSECTORS_ADDR
+		nsectors = (count < SATA_SECTORS_MAX) ? count : SATA_SECTORS_MAX;
+#endif
+		for (;;) {
 			sata_mem2sector_base_write((uint64_t)(uintptr_t) buf);
-			sata_mem2sector_sector_write(sector + i);
+			sata_mem2sector_sector_write(sector);
+#ifdef CSR_SATA_MEM2SECTOR_NSECTORS_ADDR
+			sata_mem2sector_nsectors_write(nsectors);
+#endif
 			sata_mem2sector_start_write(1);
-			while ((sata_sector2mem_done_read() & 0x1) == 0);
-			done = ((sata_sector2mem_error_read() & 0x1) == 0);
-			busy_wait_us(10);
+			while ((sata_mem2sector_done_read() & 0x1) == 0)
+				task_yield();
+			if ((sata_mem2sector_error_read() & 0x1) == 0)
+				break;
+			busy_wait_us(SATA_RETRY_DELAY_US);
 		}
-		buf += 512;
+		sector += nsectors;
+		count  -= nsectors;
+		buf    += 512*nsectors;
 	}
 }
 
@@ -101,21 +290,54 @@ void sata_write(uint32_t sector, uint32_t count, uint8_t* buf)
 
 static DSTATUS satastatus = STA_NOINIT;
 
-DSTATUS disk_status(BYTE drv) {
-	if (drv) return STA_NOINIT;
+static DSTATUS sata_disk_status(void) {
 	return satastatus;
 }
 
-DSTATUS disk_initialize(BYTE drv) {
-	if (drv) return STA_NOINIT;
+static DSTATUS sata_disk_initialize(void) {
 	if (satastatus)
 		satastatus = sata_init() ? 0 : STA_NOINIT;
 	return satastatus;
 }
 
-DRESULT disk_read(BYTE drv, BYTE *buf, LBA_t sector, UINT count) {
+#ifdef CSR_SATA_SECTOR2MEM_TAG_ADDR
+static uint8_t *sata_async_base;
+static unsigned long sata_async_size;
+
+/* Reads into the buffer are left in flight: FatFs (read-only) does not
+   touch the sectors it reads directly to the caller's buffer */
+void sata_set_async_buffer(void *base, unsigned long size) {
+	sata_async_base = base;
+	sata_async_size = size;
+}
+#endif
+
+static DRESULT sata_disk_read(BYTE *buf, LBA_t sector, UINT count) {
+#ifdef CSR_SATA_SECTOR2MEM_TAG_ADDR
+	if ((buf >= sata_async_base) &&
+	    (buf + 512*count <= sata_async_base + sata_async_size)) {
+		sata_read_submit(sector, count, buf);
+		return RES_OK;
+	}
+#endif
 	sata_read(sector, count, buf);
 	return RES_OK;
 }
 
+#if !FF_FS_READONLY && defined(CSR_SATA_MEM2SECTOR_BASE)
+static DRESULT sata_disk_write(const BYTE *buf, LBA_t sector, UINT count) {
+	sata_write(sector, count, (uint8_t *) buf);
+	return RES_OK;
+}
+#endif
+
+const struct diskio_driver sata_diskio = {
+	.initialize = sata_disk_initialize,
+	.status     = sata_disk_status,
+	.read       = sata_disk_read,
+#if !FF_FS_READONLY && defined(CSR_SATA_MEM2SECTOR_BASE)
+	.write      = sata_disk_write,
+#endif
+};
+
 #endif /* CSR_SATA_SECTOR2MEM_BASE */
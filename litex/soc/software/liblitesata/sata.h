@@ -20,6 +20,17 @@ int sata_init(void);
 
 void sata_read(uint32_t sector, uint32_t count, uint8_t* buf);
 
+#ifdef CSR_SATA_SECTOR2MEM_TAG_ADDR
+/* Queued reads (NCQ): the submit function returns a ticket, the request
+   being complete once sata_done(ticket) */
+unsigned int sata_read_submit(uint32_t sector, uint32_t count, uint8_t* buf);
+unsigned int sata_ticket(void);
+int sata_poll(void);
+int sata_done(unsigned int ticket);
+void sata_wait(unsigned int ticket);
+void sata_set_async_buffer(void *base, unsigned long size);
+#endif
+
 #endif
 
 #ifdef CSR_SATA_MEM2SECTOR_BASE
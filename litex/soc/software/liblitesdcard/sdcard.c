@@ -14,6 +14,8 @@
 #include <generated/soc.h>
 #include <system.h>
 
+#include <libbase/cache.h>
+#include <libbase/task.h>
 #include <libfatfs/ff.h>
 #include <libfatfs/diskio.h>
 #include "sdcard.h"
@@ -21,7 +23,8 @@
 #ifdef CSR_SDCORE_BASE
 
 //#define SDCARD_DEBUG
-//#define SDCARD_CMD23_SUPPORT /* SET_BLOCK_COUNT */
+#define SDCARD_CMD23_SUPPORT /* SET_BLOCK_COUNT (when the SCR of the card has it) */
+#define SDCARD_ACMD23_SUPPORT /* SET_WR_BLK_ERASE_COUNT (pre-erase of multiple block writes) */
 #define SDCARD_CMD18_SUPPORT /* READ_MULTIPLE_BLOCK */
 #define SDCARD_CMD25_SUPPORT /* WRITE_MULTIPLE_BLOCK */
 
@@ -33,6 +36,11 @@
 #define SDCARD_CLK_FREQ 25000000
 #endif
 
+/* Highest SD clk freq of the PHY (3.3V SDR signaling: High Speed) */
+#ifndef SDCARD_CLK_FREQ_MAX
+#define SDCARD_CLK_FREQ_MAX 50000000
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Helpers                                                               */
 /*-----------------------------------------------------------------------*/
@@ -54,9 +62,9 @@ int sdcard_wait_cmd_done(void) {
 #ifdef SDCARD_DEBUG
 		printf("cmdevt: %08x\n", event);
 #endif
-		busy_wait_us(10);
 		if (event & 0x1)
 			break;
+		busy_wait_us(10);
 	}
 #ifdef SDCARD_DEBUG
 	csr_rd_buf_uint32(CSR_SDCORE_CMD_RESPONSE_ADDR,
@@ -104,17 +112,17 @@ static inline uint32_t pow2_round_up(uint32_t r) {
 	return r;
 }
 
-void sdcard_set_clk_freq(unsigned long clk_freq, int show) {
+/* Returns the effective clk_freq */
+unsigned long sdcard_set_clk_freq(unsigned long clk_freq, int show) {
 	uint32_t divider;
 	divider = clk_freq ? CONFIG_CLOCK_FREQUENCY/clk_freq : 256;
 	divider = pow2_round_up(divider);
 	divider = min(max(divider, 2), 256);
+	clk_freq = CONFIG_CLOCK_FREQUENCY/divider;
 #ifdef SDCARD_DEBUG
 	show = 1;
 #endif
 	if (show) {
-		/* this is the *effective* new clk_freq */
-		clk_freq = CONFIG_CLOCK_FREQUENCY/divider;
 		printf("Setting SDCard clk freq to ");
 		if (clk_freq > 1000000)
 			printf("%ld MHz\n", clk_freq/1000000);
@@ -122,6 +130,7 @@ void sdcard_set_clk_freq(unsigned long clk_freq, int show) {
 			printf("%ld KHz\n", clk_freq/1000);
 	}
 	sdphy_clocker_divider_write(divider);
+	return clk_freq;
 }
 
 /*-----------------------------------------------------------------------*/
@@ -306,6 +315,15 @@ int sdcard_send_status(uint16_t rca) {
 	return sdcard_send_command(rca << 16, 13, SDCARD_CTRL_RESPONSE_SHORT);
 }
 
+/* CMD13 with the busy wait of the core: returns once DAT0 is released by a
+   card programming its last blocks */
+int sdcard_send_status_busy(uint16_t rca) {
+#ifdef SDCARD_DEBUG
+	printf("CMD13: SEND_STATUS (busy)\n");
+#endif
+	return sdcard_send_command(rca << 16, 13, SDCARD_CTRL_RESPONSE_SHORT_BUSY);
+}
+
 int sdcard_set_block_count(unsigned int blockcnt) {
 #ifdef SDCARD_DEBUG
 	printf("CMD23: SET_BLOCK_COUNT\n");
@@ -313,6 +331,13 @@ int sdcard_set_block_count(unsigned int blockcnt) {
 	return sdcard_send_command(blockcnt, 23, SDCARD_CTRL_RESPONSE_SHORT);
 }
 
+int sdcard_app_set_wr_blk_erase_count(unsigned int blockcnt) {
+#ifdef SDCARD_DEBUG
+	printf("ACMD23: SET_WR_BLK_ERASE_COUNT\n");
+#endif
+	return sdcard_send_command(blockcnt, 23, SDCARD_CTRL_RESPONSE_SHORT);
+}
+
 uint16_t sdcard_decode_rca(void) {
 	uint32_t r[SD_CMD_RESPONSE_SIZE/4];
 	csr_rd_buf_uint32(CSR_SDCORE_CMD_RESPONSE_ADDR,
@@ -376,12 +401,115 @@ void sdcard_decode_csd(void) {
 }
 #endif
 
+/*-----------------------------------------------------------------------*/
+/* SDCard speed negotiation                                              */
+/*-----------------------------------------------------------------------*/
+
+#ifdef CSR_SDBLOCK2MEM_BASE
+
+/* Receives the data of the next command to buf */
+static void sdcard_dma_start(void *buf, unsigned int length) {
+#ifndef CONFIG_CPU_HAS_DMA_BUS
+	cache_flush_range(buf, length);
+#endif
+	sdblock2mem_dma_enable_write(0);
+	sdblock2mem_dma_base_write((uint64_t)(uintptr_t) buf);
+	sdblock2mem_dma_length_write(length);
+	sdblock2mem_dma_enable_write(1);
+}
+
+static void sdcard_dma_wait(void *buf, unsigned int length) {
+	while ((sdblock2mem_dma_done_read() & 0x1) == 0);
+#ifndef CONFIG_CPU_HAS_DMA_BUS
+	cache_invalidate_range(buf, length);
+#endif
+}
+
+/* 512-bit switch function status of CMD6 */
+static int sdcard_switch_status(unsigned int mode, unsigned int group, unsigned int value, uint8_t *status) {
+	int r;
+	sdcard_dma_start(status, 64);
+	r = sdcard_switch(mode, group, value);
+	sdcard_dma_wait(status, 64);
+	return r;
+}
+
+/* Access modes by decreasing speed; UHS-I ones (SDR104, SDR50) are only
+   advertised by cards switched to 1.8V signaling */
+static const struct {
+	unsigned int function;
+	unsigned long clk_freq;
+	const char *name;
+} sdcard_modes[] = {
+	{SD_SPEED_SDR104, 208000000, "SDR104"},
+	{SD_SPEED_SDR50,  100000000, "SDR50"},
+	{SD_SPEED_SDR25,   50000000, "High Speed"},
+};
+
+/* Switches to the fastest mode supported by the card and the PHY that reads
+   block 0 back as at the Default Speed */
+static void sdcard_speed_negotiate(const uint8_t *scr) {
+	uint8_t status[64] __attribute__((aligned(8)));
+	uint8_t ref[512] __attribute__((aligned(8)));
+	uint8_t buf[512] __attribute__((aligned(8)));
+	unsigned long clk_freq;
+	unsigned int supported;
+	int i, j;
+
+	/* CMD6 is supported from SD_SPEC 1 (version 1.10) */
+	if ((scr[0] & 0xf) == 0)
+		goto default_speed;
+	if (sdcard_switch_status(SD_SWITCH_CHECK, SD_GROUP_ACCESSMODE, 0xf, status) != SD_OK)
+		goto default_speed;
+	supported = status[13]; /* Group 1 functions supported (bits 407:400) */
+	sdcard_read(0, 1, ref);
+
+	for (i = 0; i < sizeof(sdcard_modes)/sizeof(sdcard_modes[0]); i++) {
+		if (!(supported & (1 << sdcard_modes[i].function)))
+			continue;
+		if (sdcard_modes[i].clk_freq > SDCARD_CLK_FREQ_MAX)
+			continue;
+		/* Group 1 function switched to (bits 379:376) */
+		if (sdcard_switch_status(SD_SWITCH_SWITCH, SD_GROUP_ACCESSMODE,
+			sdcard_modes[i].function, status) != SD_OK)
+			continue;
+		if ((status[16] & 0xf) != sdcard_modes[i].function)
+			continue;
+		clk_freq = sdcard_set_clk_freq(sdcard_modes[i].clk_freq, 0);
+		busy_wait(1);
+		for (j = 0; j < 512; j++)
+			buf[j] = ~ref[j];
+		sdcard_read(0, 1, buf);
+		if (memcmp(buf, ref, 512) == 0) {
+			printf("SDCard: %s, %ld MHz (%ld MB/s).\n",
+				sdcard_modes[i].name, clk_freq/1000000, clk_freq/2000000);
+			return;
+		}
+		sdcard_set_clk_freq(SDCARD_CLK_FREQ, 0);
+		busy_wait(1);
+	}
+	sdcard_switch_status(SD_SWITCH_SWITCH, SD_GROUP_ACCESSMODE, SD_SPEED_SDR12, status);
+
+default_speed:
+	clk_freq = sdcard_set_clk_freq(SDCARD_CLK_FREQ, 0);
+	printf("SDCard: Default Speed, %ld MHz (%ld MB/s).\n",
+		clk_freq/1000000, clk_freq/2000000);
+}
+
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* SDCard user functions                                                 */
 /*-----------------------------------------------------------------------*/
 
+static uint16_t sdcard_rca;
+static int sdcard_cmd23; /* SET_BLOCK_COUNT supported: no CMD12 after multiple block transfers */
+
 int sdcard_init(void) {
 	uint16_t rca, timeout;
+#ifdef CSR_SDBLOCK2MEM_BASE
+	uint8_t scr[8] __attribute__((aligned(8)));
+#endif
 
 	/* Set SD clk freq to Initialization frequency */
 	sdcard_set_clk_freq(SDCARD_CLK_FREQ_INIT, 0);
@@ -428,6 +556,7 @@ int sdcard_init(void) {
 	if (sdcard_set_relative_address() != SD_OK)
 		return 0;
 	rca = sdcard_decode_rca();
+	sdcard_rca = rca;
 
 	/* Set CID */
 	if (sdcard_send_cid(rca) != SD_OK)
@@ -453,12 +582,31 @@ int sdcard_init(void) {
 	if(sdcard_app_set_bus_width() != SD_OK)
 		return 0;
 
+#ifdef CSR_SDBLOCK2MEM_BASE
+	/* Send SCR */
+	if (sdcard_app_cmd(rca) != SD_OK)
+		return 0;
+	sdcard_dma_start(scr, sizeof(scr));
+	if (sdcard_app_send_scr() != SD_OK)
+		return 0;
+	sdcard_dma_wait(scr, sizeof(scr));
+#ifdef SDCARD_CMD23_SUPPORT
+	/* CMD_SUPPORT: CMD23 (bit 33) */
+	sdcard_cmd23 = (scr[3] >> 1) & 0x1;
+#endif
+
+	/* Set block length */
+	if (sdcard_app_set_blocklen(512) != SD_OK)
+		return 0;
+
+	/* Switch speed */
+	sdcard_speed_negotiate(scr);
+#else
 	/* Switch speed */
 	if (sdcard_switch(SD_SWITCH_SWITCH, SD_GROUP_ACCESSMODE, SD_SPEED_SDR25) != SD_OK)
 		return 0;
 
 	/* Send SCR */
-	/* FIXME: add scr decoding (optional) */
 	if (sdcard_app_cmd(rca) != SD_OK)
 		return 0;
 	if (sdcard_app_send_scr() != SD_OK)
@@ -467,95 +615,215 @@ int sdcard_init(void) {
 	/* Set block length */
 	if (sdcard_app_set_blocklen(512) != SD_OK)
 		return 0;
+#endif
 
 	return 1;
 }
 
-#ifdef CSR_SDBLOCK2MEM_BASE
+#if defined(CSR_SDBLOCK2MEM_BASE) || defined(CSR_SDMEM2BLOCK_BASE)
 
-void sdcard_read(uint32_t block, uint32_t count, uint8_t* buf)
-{
-	while (count) {
-		uint32_t nblocks;
+/*-----------------------------------------------------------------------*/
+/* SDCard request queue                                                  */
+/*-----------------------------------------------------------------------*/
+
+/* The SD bus carries a transfer at a time: the request at the head of the
+   queue is in flight, the next one is started when it completes. Requests
+   are completed in order, by the ticket returned when submitted. */
+#define SDCARD_QUEUE_SIZE 2
+
+struct sdcard_request {
+	uint32_t block;
+	uint32_t count;
+	uint8_t *buf;
+	int write;
+};
+
+static struct sdcard_request sdcard_queue[SDCARD_QUEUE_SIZE];
+static unsigned int sdcard_queue_head;
+static unsigned int sdcard_queue_level;
+static unsigned int sdcard_submitted;
+static unsigned int sdcard_completed;
+static uint32_t sdcard_inflight; /* Blocks of the head request in flight, 0: none */
+
+static void sdcard_data_command(uint32_t blockaddr, uint8_t cmd, uint32_t nblocks, int transfer) {
+	sdcore_block_length_write(512);
+	sdcore_block_count_write(nblocks);
+	while (sdcard_send_command(blockaddr, cmd,
+	    (transfer << 5) |
+	    SDCARD_CTRL_RESPONSE_SHORT) != SD_OK);
+}
+
+static void sdcard_request_start(struct sdcard_request *r) {
+	uint32_t nblocks;
+
+	nblocks = 1;
+#ifdef CSR_SDMEM2BLOCK_BASE
+	if (r->write) {
+#ifdef SDCARD_CMD25_SUPPORT
+		nblocks = r->count;
+#endif
+#ifndef CONFIG_CPU_HAS_DMA_BUS
+		/* Flush caches (Data to write still in a write-back L2) */
+		cache_flush_range(r->buf, 512*nblocks);
+#endif
+		/* Initialize DMA Reader */
+		sdmem2block_dma_enable_write(0);
+		sdmem2block_dma_base_write((uint64_t)(uintptr_t) r->buf);
+		sdmem2block_dma_length_write(512*nblocks);
+		sdmem2block_dma_enable_write(1);
+
+		if (nblocks > 1) {
+#ifdef SDCARD_ACMD23_SUPPORT
+			/* Pre-erase the blocks, sparing the card read-modify-erase cycles */
+			sdcard_app_cmd(sdcard_rca);
+			sdcard_app_set_wr_blk_erase_count(nblocks);
+#endif
+			if (sdcard_cmd23)
+				sdcard_set_block_count(nblocks);
+		}
+
+		/* Write Block(s) to SDCard */
+		sdcard_data_command(r->block, (nblocks > 1) ? 25 : 24, nblocks, SDCARD_CTRL_DATA_TRANSFER_WRITE);
+
+		/* Stop transmission (Only for open-ended multiple block writes), wait
+		   for the programming of the card otherwise */
+		if ((nblocks > 1) && !sdcard_cmd23)
+			sdcard_stop_transmission();
+		else
+			sdcard_send_status_busy(sdcard_rca);
+	}
+#endif
+#ifdef CSR_SDBLOCK2MEM_BASE
+	if (!r->write) {
 #ifdef SDCARD_CMD18_SUPPORT
-		nblocks = count;
-#else
-		nblocks = 1;
+		nblocks = r->count;
+#endif
+#ifndef CONFIG_CPU_HAS_DMA_BUS
+		/* No dirty line of the buffer must be written back over the DMA data */
+		cache_flush_range(r->buf, 512*nblocks);
 #endif
 		/* Initialize DMA Writer */
 		sdblock2mem_dma_enable_write(0);
-		sdblock2mem_dma_base_write((uint64_t)(uintptr_t) buf);
+		sdblock2mem_dma_base_write((uint64_t)(uintptr_t) r->buf);
 		sdblock2mem_dma_length_write(512*nblocks);
 		sdblock2mem_dma_enable_write(1);
 
 		/* Read Block(s) from SDCard */
-#ifdef SDCARD_CMD23_SUPPORT
-		sdcard_set_block_count(nblocks);
+		if ((nblocks > 1) && sdcard_cmd23)
+			sdcard_set_block_count(nblocks);
+		sdcard_data_command(r->block, (nblocks > 1) ? 18 : 17, nblocks, SDCARD_CTRL_DATA_TRANSFER_READ);
+	}
 #endif
-		if (nblocks > 1)
-			sdcard_read_multiple_block(block, nblocks);
-		else
-			sdcard_read_single_block(block);
-
-		/* Wait for DMA Writer to complete */
-		while ((sdblock2mem_dma_done_read() & 0x1) == 0);
+	sdcard_inflight = nblocks;
+}
 
-		/* Stop transmission (Only for multiple block reads) */
-		if (nblocks > 1)
+/* Returns 1 when the blocks in flight are transferred */
+static int sdcard_request_done(struct sdcard_request *r) {
+#ifdef CSR_SDMEM2BLOCK_BASE
+	if (r->write)
+		return sdmem2block_dma_done_read() & 0x1;
+#endif
+#ifdef CSR_SDBLOCK2MEM_BASE
+	if (!r->write) {
+		if ((sdcore_data_event_read() & 0x1) == 0)
+			return 0;
+		if ((sdblock2mem_dma_done_read() & 0x1) == 0)
+			return 0;
+
+		/* Stop transmission (Only for open-ended multiple block reads) */
+		if ((sdcard_inflight > 1) && !sdcard_cmd23)
 			sdcard_stop_transmission();
+#ifndef CONFIG_CPU_HAS_DMA_BUS
+		/* Drop the cached lines of the buffer */
+		cache_invalidate_range(r->buf, 512*sdcard_inflight);
+#endif
+	}
+#endif
+	return 1;
+}
+
+/* Progresses the queue without waiting, returns the number of requests pending */
+int sdcard_poll(void) {
+	struct sdcard_request *r;
+
+	while (sdcard_queue_level) {
+		r = &sdcard_queue[sdcard_queue_head];
+		if (sdcard_inflight == 0)
+			sdcard_request_start(r);
+		if (!sdcard_request_done(r))
+			break;
 
 		/* Update Block/Buffer/Count */
-		block += nblocks;
-		buf   += 512*nblocks;
-		count -= nblocks;
+		r->block += sdcard_inflight;
+		r->buf   += 512*sdcard_inflight;
+		r->count -= sdcard_inflight;
+		sdcard_inflight = 0;
+		if (r->count)
+			continue;
+		sdcard_queue_head = (sdcard_queue_head + 1) % SDCARD_QUEUE_SIZE;
+		sdcard_queue_level--;
+		sdcard_completed++;
 	}
+	return sdcard_queue_level;
+}
 
-#ifndef CONFIG_CPU_HAS_DMA_BUS
-	/* Flush caches */
-	flush_cpu_dcache();
-	flush_l2_cache();
-#endif
+int sdcard_done(unsigned int ticket) {
+	sdcard_poll();
+	return (int)(sdcard_completed - ticket) >= 0;
+}
+
+void sdcard_wait(unsigned int ticket) {
+	while (!sdcard_done(ticket))
+		task_yield();
+}
+
+unsigned int sdcard_ticket(void) {
+	return sdcard_submitted;
+}
+
+static unsigned int sdcard_submit(uint32_t block, uint32_t count, uint8_t* buf, int write) {
+	struct sdcard_request *r;
+
+	if (count == 0)
+		return sdcard_submitted;
+	while (sdcard_queue_level == SDCARD_QUEUE_SIZE)
+		sdcard_poll();
+	r = &sdcard_queue[(sdcard_queue_head + sdcard_queue_level) % SDCARD_QUEUE_SIZE];
+	r->block = block;
+	r->count = count;
+	r->buf   = buf;
+	r->write = write;
+	sdcard_queue_level++;
+	sdcard_poll();
+	return ++sdcard_submitted;
 }
 
 #endif
 
-#ifdef CSR_SDMEM2BLOCK_BASE
+#ifdef CSR_SDBLOCK2MEM_BASE
 
-void sdcard_write(uint32_t block, uint32_t count, uint8_t* buf)
+unsigned int sdcard_read_submit(uint32_t block, uint32_t count, uint8_t* buf)
 {
-	while (count) {
-		uint32_t nblocks;
-#ifdef SDCARD_CMD25_SUPPORT
-		nblocks = count;
-#else
-		nblocks = 1;
-#endif
-		/* Initialize DMA Reader */
-		sdmem2block_dma_enable_write(0);
-		sdmem2block_dma_base_write((uint64_t)(uintptr_t) buf);
-		sdmem2block_dma_length_write(512*nblocks);
-		sdmem2block_dma_enable_write(1);
+	return sdcard_submit(block, count, buf, 0);
+}
+
+void sdcard_read(uint32_t block, uint32_t count, uint8_t* buf)
+{
+	sdcard_wait(sdcard_read_submit(block, count, buf));
+}
 
-		/* Write Block(s) to SDCard */
-#ifdef SDCARD_CMD23_SUPPORT
-		sdcard_set_block_count(nblocks);
 #endif
-		if (nblocks > 1)
-			sdcard_write_multiple_block(block, nblocks);
-		else
-			sdcard_write_single_block(block);
 
-		/* Stop transmission (Only for multiple block writes) */
-		sdcard_stop_transmission();
+#ifdef CSR_SDMEM2BLOCK_BASE
 
-		/* Wait for DMA Reader to complete */
-		while ((sdmem2block_dma_done_read() & 0x1) == 0);
+unsigned int sdcard_write_submit(uint32_t block, uint32_t count, uint8_t* buf)
+{
+	return sdcard_submit(block, count, buf, 1);
+}
 
-		/* Update Block/Buffer/Count */
-		block += nblocks;
-		buf   += 512*nblocks;
-		count -= nblocks;
-	}
+void sdcard_write(uint32_t block, uint32_t count, uint8_t* buf)
+{
+	sdcard_wait(sdcard_write_submit(block, count, buf));
 }
 #endif
 
@@ -565,21 +833,54 @@ void sdcard_write(uint32_t block, uint32_t count, uint8_t* buf)
 
 static DSTATUS sdcardstatus = STA_NOINIT;
 
-DSTATUS disk_status(BYTE drv) {
-	if (drv) return STA_NOINIT;
+static DSTATUS sdcard_disk_status(void) {
 	return sdcardstatus;
 }
 
-DSTATUS disk_initialize(BYTE drv) {
-	if (drv) return STA_NOINIT;
+static DSTATUS sdcard_disk_initialize(void) {
 	if (sdcardstatus)
 		sdcardstatus = sdcard_init() ? 0 : STA_NOINIT;
 	return sdcardstatus;
 }
 
-DRESULT disk_read(BYTE drv, BYTE *buf, LBA_t block, UINT count) {
+#ifdef CSR_SDBLOCK2MEM_BASE
+static uint8_t *sdcard_async_base;
+static unsigned long sdcard_async_size;
+
+/* Reads into the buffer are left in flight: FatFs (read-only) does not
+   touch the sectors it reads directly to the caller's buffer */
+void sdcard_set_async_buffer(void *base, unsigned long size) {
+	sdcard_async_base = base;
+	sdcard_async_size = size;
+}
+#endif
+
+static DRESULT sdcard_disk_read(BYTE *buf, LBA_t block, UINT count) {
+#ifdef CSR_SDBLOCK2MEM_BASE
+	if ((buf >= sdcard_async_base) &&
+	    (buf + 512*count <= sdcard_async_base + sdcard_async_size)) {
+		sdcard_read_submit(block, count, buf);
+		return RES_OK;
+	}
+#endif
 	sdcard_read(block, count, buf);
 	return RES_OK;
 }
 
+#if !FF_FS_READONLY && defined(CSR_SDMEM2BLOCK_BASE)
+static DRESULT sdcard_disk_write(const BYTE *buf, LBA_t block, UINT count) {
+	sdcard_write(block, count, (uint8_t *) buf);
+	return RES_OK;
+}
+#endif
+
+const struct diskio_driver sdcard_diskio = {
+	.initialize = sdcard_disk_initialize,
+	.status     = sdcard_disk_status,
+	.read       = sdcard_disk_read,
+#if !FF_FS_READONLY && defined(CSR_SDMEM2BLOCK_BASE)
+	.write      = sdcard_disk_write,
+#endif
+};
+
 #endif /* CSR_SDCORE_BASE */
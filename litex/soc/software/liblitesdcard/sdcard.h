@@ -65,7 +65,7 @@ int sdcard_wait_response(void);
 /* SDCard clocker functions                                              */
 /*-----------------------------------------------------------------------*/
 
-void sdcard_set_clk_freq(unsigned long clk_freq, int show);
+unsigned long sdcard_set_clk_freq(unsigned long clk_freq, int show);
 
 /*-----------------------------------------------------------------------*/
 /* SDCard commands functions                                             */
@@ -91,7 +91,9 @@ int sdcard_read_single_block(unsigned int blockaddr);
 int sdcard_read_multiple_block(unsigned int blockaddr, unsigned int blockcnt);
 int sdcard_stop_transmission(void);
 int sdcard_send_status(uint16_t rca);
+int sdcard_send_status_busy(uint16_t rca);
 int sdcard_set_block_count(unsigned int blockcnt);
+int sdcard_app_set_wr_blk_erase_count(unsigned int blockcnt);
 uint16_t sdcard_decode_rca(void);
 void sdcard_decode_cid(void);
 void sdcard_decode_csd(void);
@@ -104,6 +106,16 @@ int sdcard_init(void);
 void sdcard_read(uint32_t sector, uint32_t count, uint8_t* buf);
 void sdcard_write(uint32_t sector, uint32_t count, uint8_t* buf);
 
+/* Non-blocking requests: the submit functions return a ticket, the
+   request being complete once sdcard_done(ticket) */
+unsigned int sdcard_read_submit(uint32_t sector, uint32_t count, uint8_t* buf);
+unsigned int sdcard_write_submit(uint32_t sector, uint32_t count, uint8_t* buf);
+unsigned int sdcard_ticket(void);
+int sdcard_poll(void);
+int sdcard_done(unsigned int ticket);
+void sdcard_wait(unsigned int ticket);
+void sdcard_set_async_buffer(void *base, unsigned long size);
+
 #endif /* CSR_SDCORE_BASE */
 
 #endif /* __SDCARD_H */
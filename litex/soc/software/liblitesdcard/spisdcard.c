@@ -28,6 +28,12 @@
 #define SPISDCARD_CLK_FREQ 20000000
 #endif
 
+/* Bits shifted per SPI Xfer (LSB aligned when > 8) */
+#ifndef SPISDCARD_DATA_WIDTH
+#define SPISDCARD_DATA_WIDTH 8
+#endif
+#define SPISDCARD_XFER_BYTES (SPISDCARD_DATA_WIDTH/8)
+
 /*-----------------------------------------------------------------------*/
 /* Helpers                                                               */
 /*-----------------------------------------------------------------------*/
@@ -69,6 +75,14 @@ static uint8_t spi_xfer(uint8_t byte) {
     return spisdcard_miso_read();
 }
 
+/* Xfers n bytes (n <= SPISDCARD_XFER_BYTES), MSB first */
+static inline uint32_t spi_xfer_bytes(uint32_t word, int n) {
+    spisdcard_mosi_write(word);
+    spisdcard_control_write(8*n*SPI_LENGTH | SPI_START);
+    while(spisdcard_status_read() != SPI_DONE);
+    return spisdcard_miso_read();
+}
+
 /*-----------------------------------------------------------------------*/
 /* SPI SDCard Select/Deselect functions                                  */
 /*-----------------------------------------------------------------------*/
@@ -109,9 +123,17 @@ static int spisdcard_select(void) {
 /*-----------------------------------------------------------------------*/
 
 static void spisdcardwrite_bytes(uint8_t* buf, uint16_t n) {
+    uint32_t word;
     uint16_t i;
-    for (i=0; i<n; i++)
-        spi_xfer(buf[i]);
+    int j, k;
+
+    for (i=0; i<n; i+=k) {
+        k = min(n - i, SPISDCARD_XFER_BYTES);
+        word = 0;
+        for (j=0; j<k; j++)
+            word = (word << 8) | buf[i + j];
+        spi_xfer_bytes(word, k);
+    }
 }
 
 static void spisdcardread_bytes(uint8_t* buf, uint16_t n) {
@@ -127,6 +149,9 @@ static void spisdcardread_bytes(uint8_t* buf, uint16_t n) {
 static uint8_t spisdcardreceive_block(uint8_t *buf) {
     uint16_t i;
     uint32_t timeout;
+#if SPISDCARD_XFER_BYTES > 1
+    uint32_t word;
+#endif
 
     /* Wait 100ms for a start of block */
     timeout = 100000;
@@ -139,17 +164,34 @@ static uint8_t spisdcardreceive_block(uint8_t *buf) {
     if (timeout == 0)
         return 0;
 
-    /* Receive block */
-    spisdcard_mosi_write(0xff);
-    for (i=0; i<512; i++) {
-        spisdcard_control_write(8*SPI_LENGTH | SPI_START);
+    /* Receive block (MOSI held high), SPISDCARD_XFER_BYTES per Xfer */
+    spisdcard_mosi_write(0xffffffff);
+    for (i=0; i<512; i+=SPISDCARD_XFER_BYTES) {
+        spisdcard_control_write(SPISDCARD_DATA_WIDTH*SPI_LENGTH | SPI_START);
         while (spisdcard_status_read() != SPI_DONE);
-        *buf++ = spisdcard_miso_read();
+#if SPISDCARD_XFER_BYTES == 4
+        word = spisdcard_miso_read();
+        buf[0] = word >> 24;
+        buf[1] = word >> 16;
+        buf[2] = word >>  8;
+        buf[3] = word >>  0;
+#elif SPISDCARD_XFER_BYTES == 2
+        word = spisdcard_miso_read();
+        buf[0] = word >> 8;
+        buf[1] = word >> 0;
+#else
+        buf[0] = spisdcard_miso_read();
+#endif
+        buf += SPISDCARD_XFER_BYTES;
     }
 
     /* Discard CRC */
+#if SPISDCARD_XFER_BYTES >= 2
+    spi_xfer_bytes(0xffff, 2);
+#else
     spi_xfer(0xff);
     spi_xfer(0xff);
+#endif
 
     return 1;
 }
@@ -264,13 +306,11 @@ uint8_t spisdcard_init(void) {
 
 static DSTATUS spisdcardstatus = STA_NOINIT;
 
-DSTATUS disk_status(BYTE drv) {
-    if (drv) return STA_NOINIT;
+static DSTATUS spisdcard_disk_status(void) {
     return spisdcardstatus;
 }
 
-DSTATUS disk_initialize(BYTE drv) {
-    if (drv) return STA_NOINIT;
+static DSTATUS spisdcard_disk_initialize(void) {
     if (spisdcardstatus) {
         spisdcardstatus = spisdcard_init() ? 0 : STA_NOINIT;
         spisdcard_deselect();
@@ -278,7 +318,7 @@ DSTATUS disk_initialize(BYTE drv) {
     return spisdcardstatus;
 }
 
-DRESULT disk_read(BYTE drv, BYTE *buf, LBA_t block, UINT count) {
+static DRESULT spisdcard_disk_read(BYTE *buf, LBA_t block, UINT count) {
     uint8_t cmd;
     if (count > 1)
         cmd = CMD18; /* READ_MULTIPLE_BLOCK */
@@ -302,4 +342,10 @@ DRESULT disk_read(BYTE drv, BYTE *buf, LBA_t block, UINT count) {
     return RES_OK;
 }
 
+const struct diskio_driver spisdcard_diskio = {
+    .initialize = spisdcard_disk_initialize,
+    .status     = spisdcard_disk_status,
+    .read       = spisdcard_disk_read,
+};
+
 #endif
@@ -6,6 +6,8 @@
 #include <string.h>
 #include <libbase/memtest.h>
 #include <libbase/crc.h>
+#include <libbase/lfsr.h>
+#include <libbase/timing.h>
 
 #include <generated/csr.h>
 #include <generated/mem.h>
@@ -91,6 +93,338 @@ static void spiflash_master_write(uint32_t val, size_t len, size_t width, uint32
 	spiflash_core_master_cs_write(0);
 }
 
+/* Single-bit transfers of one byte, CS held between spiflash_master_begin()
+   and spiflash_master_end() */
+static void spiflash_master_begin(void)
+{
+	while (spiflash_core_master_status_rx_ready_read())
+		spiflash_core_master_rxtx_read();
+	spiflash_core_master_phyconfig_len_write(8);
+	spiflash_core_master_phyconfig_mask_write(1);
+	spiflash_core_master_phyconfig_width_write(1);
+	spiflash_core_master_cs_write(1);
+}
+
+static uint8_t spiflash_master_byte(uint8_t b)
+{
+	spiflash_core_master_rxtx_write(b);
+	while (!spiflash_core_master_status_rx_ready_read());
+	return spiflash_core_master_rxtx_read();
+}
+
+static void spiflash_master_end(void)
+{
+	spiflash_core_master_cs_write(0);
+}
+
+static void spiflash_master_addr(uint8_t cmd, uint32_t addr)
+{
+	spiflash_master_byte(cmd);
+	spiflash_master_byte(addr >> 16);
+	spiflash_master_byte(addr >> 8);
+	spiflash_master_byte(addr);
+}
+
+/* Data phase of a page program: 4 bytes per Xfer, on 4 lines with Quad
+   Page Program (0x32) */
+#ifdef SPIFLASH_MODULE_QUAD_PROGRAM
+#define SPIFLASH_PROGRAM_CMD	0x32
+#define SPIFLASH_PROGRAM_WIDTH	4
+#define SPIFLASH_PROGRAM_MASK	0xf
+#else
+#define SPIFLASH_PROGRAM_CMD	0x02
+#define SPIFLASH_PROGRAM_WIDTH	1
+#define SPIFLASH_PROGRAM_MASK	0x1
+#endif
+
+static void spiflash_master_data(const uint8_t *buf, int len)
+{
+	spiflash_core_master_phyconfig_len_write(32);
+	spiflash_core_master_phyconfig_width_write(SPIFLASH_PROGRAM_WIDTH);
+	spiflash_core_master_phyconfig_mask_write(SPIFLASH_PROGRAM_MASK);
+	for (; len >= 4; len -= 4, buf += 4) {
+		spiflash_core_master_rxtx_write(
+			((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) |
+			((uint32_t) buf[2] <<  8) | buf[3]);
+		while (!spiflash_core_master_status_rx_ready_read());
+		spiflash_core_master_rxtx_read();
+	}
+	spiflash_core_master_phyconfig_len_write(8);
+	for (; len > 0; len--)
+		spiflash_master_byte(*buf++);
+}
+
+static void spiflash_write_enable(void)
+{
+	spiflash_master_begin();
+	spiflash_master_byte(0x06);
+	spiflash_master_end();
+}
+
+int spiflash_busy(void)
+{
+	uint8_t status;
+
+	spiflash_master_begin();
+	spiflash_master_byte(0x05);
+	status = spiflash_master_byte(0);
+	spiflash_master_end();
+	return status & 0x1;
+}
+
+static void spiflash_wait_ready(void)
+{
+	while (spiflash_busy());
+}
+
+/*-----------------------------------------------------------------------*/
+/* SFDP (JESD216)                                                        */
+/*-----------------------------------------------------------------------*/
+
+#define SFDP_BFPT_DWORDS 20
+
+struct spiflash_read_mode {
+	const char *name;
+	uint8_t addr_width;
+	uint8_t data_width;
+	uint8_t opcode;
+	uint8_t dummy;	/* Dummy + mode clocks */
+};
+
+static void spiflash_sfdp_read(uint32_t addr, uint8_t *buf, int len)
+{
+	spiflash_master_begin();
+	spiflash_master_addr(0x5a, addr);
+	spiflash_master_byte(0); /* 8 dummy clocks */
+	for (; len > 0; len--)
+		*buf++ = spiflash_master_byte(0);
+	spiflash_master_end();
+}
+
+/* Reads the Basic Flash Parameter Table, returns its length in DWORDs
+   (0 without SFDP) */
+static int spiflash_sfdp_bfpt(uint32_t *bfpt)
+{
+	uint8_t b[4*SFDP_BFPT_DWORDS];
+	uint32_t ptr;
+	int n, i;
+
+	/* SFDP header and first parameter header (JEDEC BFPT) */
+	spiflash_sfdp_read(0, b, 16);
+	if ((b[0] != 'S') || (b[1] != 'F') || (b[2] != 'D') || (b[3] != 'P') || (b[8] != 0x00))
+		return 0;
+	n   = b[11];
+	ptr = b[12] | (b[13] << 8) | (b[14] << 16);
+	if (n > SFDP_BFPT_DWORDS)
+		n = SFDP_BFPT_DWORDS;
+	if (n < 9)
+		return 0;
+
+	/* Little-endian DWORDs */
+	spiflash_sfdp_read(ptr, b, 4*n);
+	for (i = 0; i < n; i++)
+		bfpt[i] = b[4*i] | (b[4*i+1] << 8) | (b[4*i+2] << 16) | ((uint32_t) b[4*i+3] << 24);
+	return n;
+}
+
+/* Read modes of the chip (opcode 0: not supported), from the fast read
+   fields of the BFPT: dummy clocks[4:0], mode clocks[7:5], opcode[15:8] */
+static int spiflash_sfdp_modes(const uint32_t *bfpt, int n, struct spiflash_read_mode *modes)
+{
+	static const struct {
+		const char *name;
+		uint8_t addr_width;
+		uint8_t data_width;
+		uint8_t dword;	/* 1-based, as in JESD216 */
+		uint8_t shift;
+		uint8_t support_dword;
+		uint8_t support_bit;
+	} fields[] = {
+		{"1-1-2", 1, 2,  4,  0, 1, 16},
+		{"1-2-2", 2, 2,  4, 16, 1, 20},
+		{"1-1-4", 1, 4,  3, 16, 1, 22},
+		{"1-4-4", 4, 4,  3,  0, 1, 21},
+		{"1-1-8", 1, 8, 17,  0, 0,  0},
+		{"1-8-8", 8, 8, 17, 16, 0,  0},
+	};
+	uint16_t f;
+	int i, m;
+
+	/* 1-1-1 Fast Read, always supported */
+	modes[0].name       = "1-1-1";
+	modes[0].addr_width = 1;
+	modes[0].data_width = 1;
+	modes[0].opcode     = 0x0b;
+	modes[0].dummy      = 8;
+	m = 1;
+	for (i = 0; i < sizeof(fields)/sizeof(fields[0]); i++) {
+		if (fields[i].dword > n)
+			continue;
+		if (fields[i].support_dword && !(bfpt[fields[i].support_dword - 1] & (1 << fields[i].support_bit)))
+			continue;
+		f = bfpt[fields[i].dword - 1] >> fields[i].shift;
+		if ((f >> 8) == 0)
+			continue;
+		modes[m].name       = fields[i].name;
+		modes[m].addr_width = fields[i].addr_width;
+		modes[m].data_width = fields[i].data_width;
+		modes[m].opcode     = f >> 8;
+		modes[m].dummy      = (f & 0x1f) + ((f >> 5) & 0x7);
+		m++;
+	}
+	return m;
+}
+
+/* Clocks of a 32-byte read (a cache line in XIP) */
+static int spiflash_read_clocks(const struct spiflash_read_mode *mode)
+{
+	return 8 + 24/mode->addr_width + mode->dummy + 8*32/mode->data_width;
+}
+
+/* Sets the Quad Enable bit as described by the QER field of the BFPT */
+static void spiflash_quad_enable(int qer)
+{
+	uint8_t sr1, sr2;
+
+	spiflash_master_begin();
+	spiflash_master_byte(0x05);
+	sr1 = spiflash_master_byte(0);
+	spiflash_master_end();
+	/* SR2 readable with 0x35 (0x3f) for QER 3, 5 and 6 only */
+	sr2 = 0;
+	if ((qer == 3) || (qer == 5) || (qer == 6)) {
+		spiflash_master_begin();
+		spiflash_master_byte((qer == 3) ? 0x3f : 0x35);
+		sr2 = spiflash_master_byte(0);
+		spiflash_master_end();
+	}
+
+	spiflash_write_enable();
+	spiflash_master_begin();
+	switch (qer) {
+	case 2: /* Bit 6 of SR1 */
+		spiflash_master_byte(0x01);
+		spiflash_master_byte(sr1 | 0x40);
+		break;
+	case 3: /* Bit 7 of SR2, written with 0x3e */
+		spiflash_master_byte(0x3e);
+		spiflash_master_byte(sr2 | 0x80);
+		break;
+	case 6: /* Bit 1 of SR2, written with 0x31 */
+		spiflash_master_byte(0x31);
+		spiflash_master_byte(sr2 | 0x02);
+		break;
+	default: /* 1, 4, 5: bit 1 of SR2, written with SR1 */
+		spiflash_master_byte(0x01);
+		spiflash_master_byte(sr1);
+		spiflash_master_byte(sr2 | 0x02);
+		break;
+	}
+	spiflash_master_end();
+	while (spiflash_busy());
+}
+
+/* Configures the dummy clocks of the read command of the memory-mapped core
+   from the SFDP of the chip and reports the fastest read mode the chip and
+   the PHY support. Returns the Quad Enable Requirements, -1 when unknown
+   (no SFDP or a JESD216 one without them). */
+static int spiflash_sfdp_setup(void)
+{
+	struct spiflash_read_mode modes[8];
+	const struct spiflash_read_mode *best;
+	uint32_t bfpt[SFDP_BFPT_DWORDS];
+	int n, m, i;
+
+	n = spiflash_sfdp_bfpt(bfpt);
+	if (n == 0)
+		return -1;
+	m = spiflash_sfdp_modes(bfpt, n, modes);
+
+	best = &modes[0];
+	for (i = 1; i < m; i++) {
+#ifdef SPIFLASH_PHY_BUS_WIDTH
+		if (modes[i].data_width > SPIFLASH_PHY_BUS_WIDTH)
+			continue;
+#endif
+		if (spiflash_read_clocks(&modes[i]) < spiflash_read_clocks(best))
+			best = &modes[i];
+	}
+	printf("SFDP: fastest read %s (0x%02x, %d dummy clocks)%s.\n", best->name, best->opcode, best->dummy,
+		(bfpt[0] & (1 << 19)) ? ", DTR capable" : "");
+
+#ifdef SPIFLASH_MODULE_READ_OPCODE
+	for (i = 0; i < m; i++) {
+		if (modes[i].opcode != SPIFLASH_MODULE_READ_OPCODE)
+			continue;
+		if (modes[i].opcode != best->opcode)
+			printf("SFDP: core reads with %s (0x%02x).\n", modes[i].name, modes[i].opcode);
+#ifndef SPIFLASH_MODULE_DUMMY_BITS
+		spiflash_dummy_bits_setup(modes[i].dummy);
+#endif
+		break;
+	}
+#endif
+
+	/* Quad Enable Requirements (DWORD 15, JESD216A) */
+	return (n >= 15) ? (bfpt[14] >> 20) & 0x7 : -1;
+}
+
+/* Starts erasing the 4KB sector at addr (offset in the flash, 3-byte
+   addressing), spiflash_busy() until done */
+void spiflash_erase_sector_start(uint32_t addr)
+{
+	spiflash_write_enable();
+	spiflash_master_begin();
+	spiflash_master_addr(0x20, addr);
+	spiflash_master_end();
+}
+
+/* Starts erasing the 64KB block at addr, spiflash_busy() until done */
+void spiflash_erase_block_start(uint32_t addr)
+{
+	spiflash_write_enable();
+	spiflash_master_begin();
+	spiflash_master_addr(0xd8, addr);
+	spiflash_master_end();
+}
+
+void spiflash_erase_sector(uint32_t addr)
+{
+	spiflash_erase_sector_start(addr);
+	spiflash_wait_ready();
+	flush_cpu_dcache();
+}
+
+/* Starts programming len bytes at addr, within a page of the erased area,
+   spiflash_busy() until done */
+void spiflash_program_start(uint32_t addr, const uint8_t *buf, int len)
+{
+	spiflash_write_enable();
+	spiflash_master_begin();
+	spiflash_master_addr(SPIFLASH_PROGRAM_CMD, addr);
+	spiflash_master_data(buf, len);
+	spiflash_master_end();
+}
+
+/* Programs len bytes at addr (offset in the flash, 3-byte addressing),
+   the area being erased */
+void spiflash_write(uint32_t addr, const uint8_t *buf, int len)
+{
+	int n;
+
+	while (len > 0) {
+		n = SPIFLASH_MODULE_PAGE_SIZE - (addr % SPIFLASH_MODULE_PAGE_SIZE);
+		if (n > len)
+			n = len;
+		spiflash_program_start(addr, buf, n);
+		spiflash_wait_ready();
+		addr += n;
+		buf += n;
+		len -= n;
+	}
+	flush_cpu_dcache();
+}
+
 #endif
 
 void spiflash_memspeed(void) {
@@ -101,8 +435,126 @@ void spiflash_memspeed(void) {
 	memspeed((unsigned int *) SPIFLASH_BASE, 4096, 1, 1);
 }
 
+/*-----------------------------------------------------------------------*/
+/* Benchmark                                                             */
+/*-----------------------------------------------------------------------*/
+
+#ifdef CSR_TIMER0_BASE
+
+#define SPIFLASH_BENCH_LINES      4096
+#define SPIFLASH_BENCH_SWEEP_SIZE 0x40000
+
+/* Linear reads (XIP fetch, image copy) of size bytes, returns the bytes/s,
+   the sum of the words read in *sum to check the data */
+static unsigned long spiflash_bench_sequential(unsigned long size, uint32_t *sum)
+{
+	volatile uint32_t *flash = (uint32_t *) SPIFLASH_BASE;
+	uint64_t start, cycles;
+	uint32_t s;
+	unsigned long i;
+
+	flush_cpu_dcache();
+	flush_l2_cache();
+	s = 0;
+	start = timing_cycles();
+	for (i = 0; i < size/4; i++)
+		s += flash[i];
+	cycles = timing_cycles() - start;
+	*sum = s;
+	return ((uint64_t) size*CONFIG_CLOCK_FREQUENCY)/(cycles ? cycles : 1);
+}
+
+/* Fetches of random 32-byte lines (cache misses of XIP code), returns the
+   latency of a line in ns */
+static unsigned long spiflash_bench_random(unsigned long size)
+{
+	volatile uint32_t *flash = (uint32_t *) SPIFLASH_BASE;
+	__attribute__((unused)) uint32_t data;
+	uint64_t start, cycles;
+	uint32_t seed;
+	int i;
+
+	flush_cpu_dcache();
+	flush_l2_cache();
+	seed = 1;
+	start = timing_cycles();
+	for (i = 0; i < SPIFLASH_BENCH_LINES; i++) {
+		seed = lfsr(32, seed);
+		data = flash[8*(seed % (size/32))];
+	}
+	cycles = timing_cycles() - start;
+	return timing_cycles_to_ns(cycles)/SPIFLASH_BENCH_LINES;
+}
+
+static void spiflash_bench_print(unsigned long speed)
+{
+	printf("%lu.%02lu MB/s", speed/1000000, (speed % 1000000)/10000);
+}
+
+/* One clock divisor/dummy bits setting over a window of the flash, the data
+   compared with the one read at the setting of the BIOS */
+static void spiflash_bench_setting(unsigned int div, unsigned int dummy, uint32_t ref)
+{
+	unsigned long speed;
+	uint32_t sum;
+
+#ifdef CSR_SPIFLASH_PHY_CLK_DIVISOR_ADDR
+	spiflash_phy_clk_divisor_write(div);
+	printf("  div %2u (%3lu MHz)", div, (unsigned long) (SPIFLASH_PHY_FREQUENCY/(2*(1 + div)))/1000000);
+#endif
+	spiflash_core_mmap_dummy_bits_write(dummy);
+	printf(" dummy %2u: ", dummy);
+	speed = spiflash_bench_sequential(SPIFLASH_BENCH_SWEEP_SIZE, &sum);
+	spiflash_bench_print(speed);
+	printf(", line %lu ns, %s\n", spiflash_bench_random(SPIFLASH_BENCH_SWEEP_SIZE),
+		(sum == ref) ? "ok" : "data errors");
+}
+
+void spiflash_bench(unsigned long size)
+{
+	unsigned int div, dummy;
+	uint32_t ref;
+	int i;
+
+	if ((size == 0) || (size > SPIFLASH_MODULE_TOTAL_SIZE))
+		size = SPIFLASH_MODULE_TOTAL_SIZE;
+	div   = 0;
+#ifdef CSR_SPIFLASH_PHY_CLK_DIVISOR_ADDR
+	div   = spiflash_phy_clk_divisor_read();
+#endif
+	dummy = spiflash_core_mmap_dummy_bits_read();
+
+	printf("Sequential read (%lu KB): ", size/1024);
+	spiflash_bench_print(spiflash_bench_sequential(size, &ref));
+	printf("\nRandom 32-byte lines (%d): %lu ns/line\n", SPIFLASH_BENCH_LINES, spiflash_bench_random(size));
+
+	/* Settings around the current one: slower clocks should stay correct,
+	   faster clocks and other dummy bits show the margin */
+	printf("Settings (%lu KB windows):\n", (unsigned long) SPIFLASH_BENCH_SWEEP_SIZE/1024);
+	spiflash_bench_sequential(SPIFLASH_BENCH_SWEEP_SIZE, &ref);
+#ifdef CSR_SPIFLASH_PHY_CLK_DIVISOR_ADDR
+	for (i = (div > 0) ? -1 : 0; i <= 2; i++)
+		spiflash_bench_setting(div + i, dummy, ref);
+#endif
+	for (i = -2; i <= 2; i++)
+		if ((i != 0) && ((int) dummy + i >= 0))
+			spiflash_bench_setting(div, dummy + i, ref);
+
+	/* Restore the BIOS setting */
+#ifdef CSR_SPIFLASH_PHY_CLK_DIVISOR_ADDR
+	spiflash_phy_clk_divisor_write(div);
+#endif
+	spiflash_core_mmap_dummy_bits_write(dummy);
+}
+
+#endif
+
 void spiflash_init(void)
 {
+#ifdef CSR_SPIFLASH_CORE_MASTER_CS_ADDR
+	int qer;
+#endif
+
 	printf("\nInitializing %s SPI Flash @0x%08lx...\n", SPIFLASH_MODULE_NAME, SPIFLASH_BASE);
 
 #ifdef SPIFLASH_MODULE_DUMMY_BITS
@@ -111,11 +563,17 @@ void spiflash_init(void)
 
 #ifdef CSR_SPIFLASH_CORE_MASTER_CS_ADDR
 
-	/* Quad / QPI Configuration. */
+	qer = spiflash_sfdp_setup();
+
+	/* Quad / QPI Configuration (QE bit from the SFDP, the historical
+	   sequence without). */
 #ifdef SPIFLASH_MODULE_QUAD_CAPABLE
 	printf("Enabling Quad mode...\n");
-	spiflash_master_write(0x00000006, 1, 1, 0x1);
-	spiflash_master_write(0x00014307, 3, 1, 0x1);
+	if (qer < 0) {
+		spiflash_master_write(0x00000006, 1, 1, 0x1);
+		spiflash_master_write(0x00014307, 3, 1, 0x1);
+	} else if (qer > 0)
+		spiflash_quad_enable(qer);
 
 #ifdef SPIFLASH_MODULE_QPI_CAPABLE
 	printf("Switching to QPI mode...\n");
@@ -131,8 +589,10 @@ void spiflash_init(void)
 	spiflash_freq_init();
 #endif
 
+#ifndef FAST_BOOT
 	/* Test SPI Flash speed */
 	spiflash_memspeed();
+#endif
 }
 
 #endif
@@ -1,12 +1,27 @@
 #ifndef __LITESPI_FLASH_H
 #define __LITESPI_FLASH_H
 
+#include <stdint.h>
+#include <generated/csr.h>
+
 #define SPI_FLASH_BLOCK_SIZE 256
 #define CRC32_ERASED_FLASH	 0xFEA8A821
 
 int spiflash_freq_init(void);
 void spiflash_dummy_bits_setup(unsigned int dummy_bits);
 void spiflash_memspeed(void);
+void spiflash_bench(unsigned long size);
 void spiflash_init(void);
 
+#ifdef CSR_SPIFLASH_CORE_MASTER_CS_ADDR
+#define SPI_FLASH_SECTOR_SIZE 4096
+#define SPI_FLASH_ERASE_BLOCK_SIZE 65536
+void spiflash_erase_sector(uint32_t addr);
+void spiflash_write(uint32_t addr, const uint8_t *buf, int len);
+int spiflash_busy(void);
+void spiflash_erase_sector_start(uint32_t addr);
+void spiflash_erase_block_start(uint32_t addr);
+void spiflash_program_start(uint32_t addr, const uint8_t *buf, int len);
+#endif
+
 #endif /* __LITESPI_FLASH_H */
@@ -3,6 +3,7 @@
 # This file is Copyright (c) 2020 Franck Jullien <franck.jullien@gmail.com>
 # License: BSD
 
+import os
 import subprocess
 import argparse
 
@@ -50,13 +51,70 @@ def print_usage(bios,regions, triple):
     print("\nROM usage: {:.2f}KiB \t({:.2f}%)".format(rom_usage / 1024.0, rom_usage / rom_size * 100.0))
     print("RAM usage: {:.2f}KiB \t({:.2f}%)\n".format(ram_usage / 1024.0, ram_usage / ram_size * 100.0))
 
+# Size report: symbols (sizes from nm, source files from the debug info, which survives LTO unlike
+# the object names of a link map) grouped by library and by source file.
+
+def symbol_library(location):
+    if location is None:
+        return "(no debug info)", "(no debug info)"
+    path  = location.rsplit(":", 1)[0]
+    parts = path.split(os.sep)
+    for i, part in reversed(list(enumerate(parts[:-1]))):
+        if part.startswith("lib") or part in ["bios", "picolibc", "compiler-rt"]:
+            return part, os.path.join(*parts[i:])
+    if len(parts) > 1:
+        return parts[-2], os.path.join(*parts[-2:])
+    return "other", path
+
+def print_report(bios, triple, top):
+    nm = triple + "-nm"
+
+    result = subprocess.run([nm, "--print-size", "--size-sort", "--line-numbers", "--demangle", bios], stdout=subprocess.PIPE)
+    result = result.stdout.decode('utf-8')
+
+    symbols = []
+    for line in result.split('\n'):
+        fields, _, location = line.partition('\t')
+        tokens = fields.split()
+        if len(tokens) != 4:
+            continue
+        size = int(tokens[1], 16)
+        kind = tokens[2].lower()
+        if kind not in "tdrb":
+            continue
+        region = "RAM" if kind == "b" else "ROM"
+        library, source = symbol_library(location or None)
+        symbols.append((size, region, library, source, tokens[3]))
+
+    for region in ["ROM", "RAM"]:
+        total = sum(s[0] for s in symbols if s[1] == region)
+        if total == 0:
+            continue
+        for title, key in [("library", 2), ("source file", 3)]:
+            groups = {}
+            for s in symbols:
+                if s[1] == region:
+                    groups[s[key]] = groups.get(s[key], 0) + s[0]
+            print("{} by {}:".format(region, title))
+            for name, size in sorted(groups.items(), key=lambda g: -g[1])[:top]:
+                print("  {:<40} {:>9.2f}KiB ({:5.1f}%)".format(name, size/1024.0, size/total*100.0))
+            print()
+        print("Largest {} symbols:".format(region))
+        for size, _, library, source, name in sorted([s for s in symbols if s[1] == region], reverse=True)[:top]:
+            print("  {:<40} {:>9d}B  {}".format(name, size, source))
+        print()
+
 def main():
     parser = argparse.ArgumentParser(description="Print bios memory usage")
     parser.add_argument("input", help="input file")
     parser.add_argument("regions", help="regions definitions")
     parser.add_argument("triple", help="toolchain triple")
+    parser.add_argument("--report", action="store_true", help="Size per library/source file and largest symbols")
+    parser.add_argument("--top",    default=20, type=int, help="Entries per report table")
     args = parser.parse_args()
     print_usage(args.input, args.regions, args.triple)
+    if args.report:
+        print_report(args.input, args.triple, args.top)
 
 
 if __name__ == "__main__":
@@ -29,14 +29,39 @@ def insert_crc(i_filename, fbi_mode=False, o_filename=None, little_endian=False)
             f.write(fcrc)
 
 
+# Raw boot image (RAW_BOOT_LBA of the BIOS): header sector (magic, length, load address, CRC32 of the
+# image, CRC32 of the header) followed by the image, padded to whole sectors, to be written at the LBA.
+def raw_image(i_filename, address, o_filename=None, little_endian=False):
+    endian = "little" if little_endian else "big"
+
+    if o_filename is None:
+        o_filename = i_filename
+
+    with open(i_filename, "rb") as f:
+        fdata = f.read()
+    header  = b"LXRB"[::-1 if endian == "big" else 1]
+    header += len(fdata).to_bytes(4, byteorder=endian)
+    header += address.to_bytes(4, byteorder=endian)
+    header += binascii.crc32(fdata).to_bytes(4, byteorder=endian)
+    header += binascii.crc32(header).to_bytes(4, byteorder=endian)
+
+    with open(o_filename, "wb") as f:
+        f.write(header.ljust(512, b"\x00"))
+        f.write(fdata.ljust((len(fdata) + 511)//512*512, b"\x00"))
+
+
 def main():
     parser = argparse.ArgumentParser(description="CRC32 computation tool and MiSoC image file writer.")
     parser.add_argument("input", help="input file")
     parser.add_argument("-o", "--output", default=None, help="output file (if not specified, use input file)")
     parser.add_argument("-f", "--fbi", default=False, action="store_true", help="build flash boot image (FBI) file")
     parser.add_argument("-l", "--little", default=False, action="store_true", help="Use little endian to write the CRC32")
+    parser.add_argument("-r", "--raw", default=None, help="build raw SD/SATA boot image loaded to this address")
     args = parser.parse_args()
-    insert_crc(args.input, args.fbi, args.output, args.little)
+    if args.raw is not None:
+        raw_image(args.input, int(args.raw, 0), args.output, args.little)
+    else:
+        insert_crc(args.input, args.fbi, args.output, args.little)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+
+#
+# This file is part of LiteX.
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+# Binary memory transfers over the serial port with the BIOS "mem_dump"/"mem_load" commands, in the
+# CRC-checked windowed SFL frames of serialboot (see soc/software/bios/sfl.h).
+
+import sys
+import time
+import argparse
+
+from litex.tools.litex_term import LiteXTerm, SFLFrame, SFLWindowFrame, crc16
+from litex.tools.litex_term import sfl_magic_req, sfl_magic_ack, sfl_cmd_abort
+from litex.tools.litex_term import sfl_ack_success, sfl_ack_crcerror
+
+# Protocol -----------------------------------------------------------------------------------------
+
+sfl_magic_dump   = b"d3QpNwT8rvHsl\n"
+sfl_window_max   = 4 + 1024
+sfl_idle_timeout = 0.1
+
+def wait_magic(port, magic, timeout=5.0):
+    window   = b""
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        c = port.read(1)
+        if len(c):
+            window = (window + c)[-len(magic):]
+            if window == magic:
+                return
+    raise TimeoutError("No reply from the BIOS.")
+
+def drain(port):
+    port.timeout = sfl_idle_timeout
+    while len(port.read(4096)):
+        pass
+
+def read_window_frame(port):
+    # Returns (seq, cmd, payload), None on timeout or CRC error.
+    header = port.read(6)
+    if len(header) < 6:
+        return None
+    length = int.from_bytes(header[0:2], "big")
+    if length > sfl_window_max:
+        return None
+    payload = port.read(length)
+    if len(payload) < length:
+        return None
+    seq, crc, cmd = header[2], int.from_bytes(header[3:5], "big"), header[5]
+    if crc16(bytes([seq, cmd]) + payload) != crc:
+        return None
+    return seq, cmd, payload
+
+# Transfers ----------------------------------------------------------------------------------------
+
+def mem_dump(term, address, length):
+    port = term.port
+    port.write("mem_dump 0x{:x} {}\n".format(address, length).encode())
+    wait_magic(port, sfl_magic_dump)
+    port.write(sfl_magic_ack)
+    data     = bytearray()
+    expected = 0
+    while True:
+        port.timeout = 1.0
+        frame = read_window_frame(port)
+        if frame is None:
+            # Ask the BIOS to rewind once the line is idle.
+            drain(port)
+            port.write(sfl_ack_crcerror + bytes([expected & 0xff]))
+            continue
+        seq, cmd, payload = frame
+        if seq != (expected & 0xff):
+            # Frame already received (BIOS rewound): acknowledge what we have.
+            port.write(sfl_ack_success + bytes([(expected - 1) & 0xff]))
+            continue
+        expected += 1
+        port.write(sfl_ack_success + bytes([seq]))
+        if cmd == sfl_cmd_abort[0]:
+            return bytes(data[:length])
+        data += payload[4:]
+        sys.stdout.write("|{}>{}| {}%\r".format(
+            "=" * (20*len(data)//length),
+            " " * (20-20*len(data)//length),
+            100*len(data)//length))
+        sys.stdout.flush()
+
+def mem_load(term, filename, address):
+    port = term.port
+    port.write(b"mem_load\n")
+    wait_magic(port, sfl_magic_req)
+    port.write(sfl_magic_ack)
+    port.timeout = None
+    term.negotiate_window()
+    length = term.upload(filename, address)
+    # End the session.
+    frame = SFLFrame()
+    frame.cmd = sfl_cmd_abort
+    if term.window_payload is not None:
+        for _ in term.send_window_frames([SFLWindowFrame(term.window_seq, frame.cmd, b"").encode()]):
+            pass
+    else:
+        term.send_frame(frame)
+    return length
+
+# Run ----------------------------------------------------------------------------------------------
+
+def main():
+    parser = argparse.ArgumentParser(description="LiteX binary memory transfers (BIOS mem_dump/mem_load commands)")
+    parser.add_argument("port",                                    help="Serial port (eg /dev/tty*)")
+    parser.add_argument("--speed",   default=115200,   type=int,   help="Serial baudrate")
+    parser.add_argument("--dump",    action="store_true",          help="Read memory to the file (default: write the file to memory)")
+    parser.add_argument("--address", default="0x40000000",         help="Memory address")
+    parser.add_argument("--length",  default=None,                 help="Length to read (bytes, --dump)")
+    parser.add_argument("file",                                    help="File to write (--dump) or to load")
+    args = parser.parse_args()
+
+    term = LiteXTerm(False, None, None, None, False)
+    term.open(args.port, args.speed)
+    drain(term.port)
+    address = int(args.address, 0)
+    start   = time.time()
+    try:
+        if args.dump:
+            if args.length is None:
+                print("--length is required with --dump.")
+                sys.exit(1)
+            data = mem_dump(term, address, int(args.length, 0))
+            with open(args.file, "wb") as f:
+                f.write(data)
+            length = len(data)
+        else:
+            length = mem_load(term, args.file, address)
+    except TimeoutError as e:
+        print(e)
+        sys.exit(1)
+    finally:
+        term.close()
+    duration = time.time() - start
+    print("\nTransferred {} bytes in {:.2f}s ({:.1f} KB/s).".format(length, duration, length/duration/1024))
+
+if __name__ == "__main__":
+    main()
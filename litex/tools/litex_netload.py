@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+
+#
+# This file is part of LiteX.
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+# Bulk loader: sends a file to the main RAM of boards waiting in the BIOS "netload" command (or
+# "netload" boot medium), over UDP at the link rate: sequence numbered chunks carrying their CRC32,
+# then the chunks the boards report missing (NACK) until there are none (see libliteeth/bulk.h).
+# Several boards are loaded in one session, the chunks sent once to a broadcast address with
+# --broadcast (the boards on the same segment), to each board otherwise.
+
+import sys
+import time
+import zlib
+import random
+import socket
+import struct
+import argparse
+
+# Protocol -----------------------------------------------------------------------------------------
+
+BULK_PORT  = 6070
+BULK_MAGIC = 0x4c58424c
+
+BULK_START     = 1
+BULK_START_ACK = 2
+BULK_DATA      = 3
+BULK_STATUS    = 4
+BULK_NACK      = 5
+BULK_ERROR     = 6
+
+HEADER = struct.Struct(">IB3xIIII") # magic, type, session, seq, length, crc
+
+def bulk_packet(type, session, seq=0, length=0, crc=0, payload=b""):
+    return HEADER.pack(BULK_MAGIC, type, session, seq, length, crc) + payload
+
+def bulk_parse(data):
+    if len(data) < HEADER.size:
+        return None
+    magic, type, session, seq, length, crc = HEADER.unpack_from(data)
+    if magic != BULK_MAGIC:
+        return None
+    return type, session, seq, length, data[HEADER.size:]
+
+# Loader -------------------------------------------------------------------------------------------
+
+class NetLoader:
+    def __init__(self, ips, port=BULK_PORT, chunk_size=1448, rate=None, timeout=0.5, retries=20,
+        broadcast=None):
+        self.ips        = [ips] if isinstance(ips, str) else list(ips)
+        self.port       = port
+        self.chunk_size = chunk_size
+        self.rate       = rate # Mbit/s, None: unpaced.
+        self.timeout    = timeout
+        self.retries    = retries
+        self.broadcast  = broadcast
+        self.session    = random.getrandbits(32)
+        self.sock       = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, 4 << 20)
+        if broadcast is not None:
+            self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+        self.sock.settimeout(timeout)
+
+    def request(self, packet, reply_types, ip):
+        for _ in range(self.retries):
+            self.sock.sendto(packet, (ip, self.port))
+            deadline = time.time() + self.timeout
+            while time.time() < deadline:
+                try:
+                    data, addr = self.sock.recvfrom(65536)
+                except socket.timeout:
+                    break
+                reply = bulk_parse(data)
+                if (reply is not None and addr[0] == ip and reply[0] in reply_types and
+                    reply[1] == self.session):
+                    return reply
+        raise TimeoutError("No reply from {}:{}.".format(ip, self.port))
+
+    def send_chunks(self, data, seqs, ips):
+        dests    = [self.broadcast] if self.broadcast is not None else ips
+        interval = None if self.rate is None else (self.chunk_size + 66)*8/(self.rate*1e6)
+        start = time.time()
+        n     = 0
+        for seq in seqs:
+            chunk  = data[seq*self.chunk_size:(seq + 1)*self.chunk_size]
+            packet = bulk_packet(BULK_DATA, self.session, seq, len(chunk), zlib.crc32(chunk), chunk)
+            for dest in dests:
+                self.sock.sendto(packet, (dest, self.port))
+                n += 1
+                if interval is not None:
+                    while time.time() < start + n*interval:
+                        pass
+
+    def start(self, data):
+        sizes = {}
+        for ip in self.ips:
+            reply = self.request(bulk_packet(BULK_START, self.session, self.chunk_size, len(data)),
+                [BULK_START_ACK, BULK_ERROR], ip)
+            if reply[0] == BULK_ERROR:
+                raise ValueError("Image refused by {} (too large for its RAM?).".format(ip))
+            sizes[ip] = reply[2]
+        return sizes
+
+    def load(self, data):
+        # All the boards of the session use the same chunk size: the smallest they accept.
+        sizes = self.start(data)
+        if len(set(sizes.values())) > 1:
+            self.chunk_size = min(sizes.values())
+            self.session    = random.getrandbits(32)
+            sizes = self.start(data)
+        self.chunk_size = min(sizes.values())
+        chunks  = (len(data) + self.chunk_size - 1)//self.chunk_size
+        seqs    = range(chunks)
+        pending = list(self.ips)
+        passes  = 0
+        while True:
+            self.send_chunks(data, seqs, pending)
+            passes += 1
+            # Union of the chunks missing on the boards not complete yet.
+            missing = set()
+            for ip in list(pending):
+                _, _, count, nranges, payload = self.request(bulk_packet(BULK_STATUS, self.session),
+                    [BULK_NACK], ip)
+                if count == 0:
+                    pending.remove(ip)
+                    continue
+                ranges = [struct.unpack_from(">II", payload, 8*n) for n in range(min(nranges, len(payload)//8))]
+                missing.update(seq for first, c in ranges for seq in range(first, first + c))
+            if not pending:
+                return passes
+            seqs = sorted(missing)
+
+# Run ----------------------------------------------------------------------------------------------
+
+def main():
+    parser = argparse.ArgumentParser(description="LiteX bulk loader (BIOS netload command)")
+    parser.add_argument("ip",          nargs="+",                      help="IP address(es) of the board(s)")
+    parser.add_argument("file",                                        help="File to load")
+    parser.add_argument("--port",      default=BULK_PORT, type=int,   help="UDP port of the board(s)")
+    parser.add_argument("--chunk",     default=1448,      type=int,   help="Chunk size (bytes, reduced by the board to fit its MAC/MTU, 8948 for 9000 bytes jumbo frames)")
+    parser.add_argument("--rate",      default=None,      type=float, help="Transmit rate (Mbit/s), unpaced by default")
+    parser.add_argument("--timeout",   default=0.5,       type=float, help="Reply timeout (s)")
+    parser.add_argument("--broadcast", default=None,                  help="Send the chunks once to this broadcast address (e.g. 192.168.1.255) instead of to each board")
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as f:
+        data = f.read()
+    loader = NetLoader(args.ip, args.port, args.chunk, args.rate, args.timeout, broadcast=args.broadcast)
+    start  = time.time()
+    try:
+        passes = loader.load(data)
+    except (TimeoutError, ValueError) as e:
+        print(e)
+        sys.exit(1)
+    duration = time.time() - start
+    print("Loaded {} bytes to {} board(s) in {:.2f}s ({:.2f} MB/s, {} pass(es)).".format(
+        len(data), len(args.ip), duration, len(data)/duration/1e6, passes))
+
+if __name__ == "__main__":
+    main()
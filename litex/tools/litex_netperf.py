@@ -0,0 +1,196 @@
+#!/usr/bin/env python3
+
+#
+# This file is part of LiteX.
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+# Network self-test peer of the BIOS eth_perf_tx/eth_perf_rx/eth_echo/eth_ping commands (see
+# libliteeth/netperf.h): UDP sink and source measuring the throughput and the losses, echo client and
+# responder measuring the round trip time.
+
+import sys
+import time
+import socket
+import struct
+import argparse
+
+# Protocol -----------------------------------------------------------------------------------------
+
+NETPERF_PORT  = 6071
+NETPERF_MAGIC = 0x4c584e50
+
+NETPERF_DATA         = 1
+NETPERF_ECHO_REQUEST = 2
+NETPERF_ECHO_REPLY   = 3
+
+HEADER = struct.Struct(">IB3xIQ") # magic, type, seq, stamp (ns)
+
+# Frame bytes on the wire besides the UDP payload: preamble, Ethernet/IP/UDP headers, FCS, IFG.
+FRAME_OVERHEAD = 8 + 14 + 20 + 8 + 4 + 12
+
+def netperf_packet(type, seq, stamp=0, size=HEADER.size):
+    header = HEADER.pack(NETPERF_MAGIC, type, seq, stamp)
+    return header + bytes([0x5a])*max(size - len(header), 0)
+
+def netperf_parse(data):
+    if len(data) < HEADER.size:
+        return None
+    magic, type, seq, stamp = HEADER.unpack_from(data)
+    if magic != NETPERF_MAGIC:
+        return None
+    return type, seq, stamp
+
+# Stats --------------------------------------------------------------------------------------------
+
+class Stats:
+    def __init__(self):
+        self.packets   = 0
+        self.bytes     = 0
+        self.lost      = 0
+        self.reordered = 0
+        self.first     = None
+        self.last      = None
+        self.rtts      = []
+
+    def count(self, length, now):
+        if self.first is None:
+            self.first = now
+        self.last     = now
+        self.packets += 1
+        self.bytes   += length
+
+    def report(self):
+        duration = (self.last - self.first) if self.packets > 1 else 0
+        print("{} packets, {} bytes in {:.3f}s".format(self.packets, self.bytes, duration), end="")
+        if duration > 0:
+            # Rates over the packets after the first, which starts the measure.
+            payload = self.bytes*(self.packets - 1)/self.packets
+            print(": {:.3f} Mbit/s ({:.3f} Mbit/s on the wire), {:.0f} packets/s".format(
+                payload*8/duration/1e6, (payload + (self.packets - 1)*FRAME_OVERHEAD)*8/duration/1e6,
+                (self.packets - 1)/duration), end="")
+        print()
+        if self.lost or self.reordered:
+            print("{} lost, {} reordered".format(self.lost, self.reordered))
+        if self.rtts:
+            print("RTT min/avg/max {:.1f}/{:.1f}/{:.1f} us".format(
+                min(self.rtts)*1e6, sum(self.rtts)/len(self.rtts)*1e6, max(self.rtts)*1e6))
+
+# Modes --------------------------------------------------------------------------------------------
+
+def sink(sock, duration, idle=1.0):
+    stats    = Stats()
+    next_seq = None
+    end      = time.monotonic() + duration
+    while time.monotonic() < end:
+        sock.settimeout(idle if stats.packets else max(end - time.monotonic(), 0.001))
+        try:
+            data, addr = sock.recvfrom(65536)
+        except socket.timeout:
+            if stats.packets:
+                break
+            continue
+        r = netperf_parse(data)
+        if r is None or r[0] != NETPERF_DATA:
+            continue
+        seq = r[1]
+        if next_seq is None:
+            next_seq = seq
+        if seq >= next_seq:
+            stats.lost += seq - next_seq
+            next_seq    = seq + 1
+        else:
+            stats.reordered += 1
+            stats.lost       = max(stats.lost - 1, 0)
+        stats.count(len(data), time.monotonic())
+    return stats
+
+def source(sock, ip, port, duration, size, rate=None):
+    stats = Stats()
+    start = time.monotonic()
+    seq   = 0
+    now   = start
+    while now < start + duration:
+        if rate is not None:
+            while now < start + stats.bytes*8/(rate*1e6):
+                now = time.monotonic()
+        sock.sendto(netperf_packet(NETPERF_DATA, seq, size=size), (ip, port))
+        stats.count(size, now)
+        seq += 1
+        now  = time.monotonic()
+    return stats
+
+def echo(sock, duration):
+    replies = 0
+    end     = time.monotonic() + duration
+    while time.monotonic() < end:
+        sock.settimeout(max(end - time.monotonic(), 0.001))
+        try:
+            data, addr = sock.recvfrom(65536)
+        except socket.timeout:
+            continue
+        r = netperf_parse(data)
+        if r is None or r[0] != NETPERF_ECHO_REQUEST:
+            continue
+        sock.sendto(data[:4] + bytes([NETPERF_ECHO_REPLY]) + data[5:], addr)
+        replies += 1
+    return replies
+
+def ping(sock, ip, port, count, size, timeout=1.0):
+    stats = Stats()
+    for seq in range(count):
+        sent = time.monotonic()
+        sock.sendto(netperf_packet(NETPERF_ECHO_REQUEST, seq, int(sent*1e9), size), (ip, port))
+        while True:
+            sock.settimeout(max(sent + timeout - time.monotonic(), 0.001))
+            try:
+                data, addr = sock.recvfrom(65536)
+            except socket.timeout:
+                stats.lost += 1
+                break
+            r = netperf_parse(data)
+            # Late replies of requests given up are ignored.
+            if r is not None and r[0] == NETPERF_ECHO_REPLY and r[1] == seq:
+                now = time.monotonic()
+                stats.rtts.append(now - sent)
+                stats.count(len(data), now)
+                break
+    return stats
+
+# Main ---------------------------------------------------------------------------------------------
+
+def main():
+    parser = argparse.ArgumentParser(description="LiteX network self-test (BIOS eth_perf_tx/eth_perf_rx/eth_echo/eth_ping commands)")
+    parser.add_argument("mode",       choices=["sink", "source", "echo", "ping"], help="sink: of eth_perf_tx, source: to eth_perf_rx, echo: for eth_ping, ping: of eth_echo")
+    parser.add_argument("ip",         nargs="?",                          help="IP address of the board (source, ping)")
+    parser.add_argument("--port",     default=NETPERF_PORT, type=int,   help="UDP port")
+    parser.add_argument("--time",     default=10.0,         type=float, help="Duration (s): sent for (source), listened for at most (sink, echo)")
+    parser.add_argument("--size",     default=1472,         type=int,   help="UDP payload size (bytes)")
+    parser.add_argument("--rate",     default=None,         type=float, help="Transmit rate of the source (Mbit/s of payload), unpaced by default")
+    parser.add_argument("--count",    default=10,           type=int,   help="Echo requests (ping)")
+    args = parser.parse_args()
+
+    if args.mode in ["source", "ping"] and args.ip is None:
+        parser.error("{} requires the IP address of the board".format(args.mode))
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+    sock.bind(("", args.port))
+    if args.mode == "sink":
+        stats = sink(sock, args.time)
+        if not stats.packets:
+            print("No traffic received.")
+            sys.exit(1)
+        stats.report()
+    elif args.mode == "source":
+        source(sock, args.ip, args.port, args.time, args.size, args.rate).report()
+    elif args.mode == "echo":
+        print("{} requests answered.".format(echo(sock, args.time)))
+    elif args.mode == "ping":
+        stats = ping(sock, args.ip, args.port, args.count, args.size)
+        stats.report()
+        if not stats.packets:
+            sys.exit(1)
+
+if __name__ == "__main__":
+    main()
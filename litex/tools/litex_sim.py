@@ -8,19 +8,24 @@
 # Copyright (c) 2017 Pierre-Olivier Vauboin <po@lambdaconcept>
 # SPDX-License-Identifier: BSD-2-Clause
 
+import os
 import sys
+import json
 import argparse
 
 from migen import *
 
 from litex.build.generic_platform import *
 from litex.build.sim import SimPlatform
+from litex.build.sim.platform import SimDPISource, SimDPISink, SimLoad, SimIdle
+from litex.build.sim.blockdev import blockdev_io, SimSATA
 from litex.build.sim.config import SimConfig
 
 from litex.soc.integration.common import *
 from litex.soc.integration.soc_core import *
 from litex.soc.integration.builder import *
 from litex.soc.integration.soc import *
+from litex.soc.interconnect import wishbone
 from litex.soc.cores.bitbang import *
 from litex.soc.cores.gpio import GPIOTristate
 from litex.soc.cores.cpu import CPUS
@@ -104,6 +109,50 @@ _io = [
         Subsignal("clk",  Pins(1)),
         Subsignal("dq",   Pins(4)),
     ),
+    # Behavioral main memory (wishbone_memory sim module)
+    ("wishbone_mem", 0,
+        Subsignal("adr",   Pins(30)),
+        Subsignal("dat_w", Pins(32)),
+        Subsignal("dat_r", Pins(32)),
+        Subsignal("sel",   Pins(4)),
+        Subsignal("cyc",   Pins(1)),
+        Subsignal("stb",   Pins(1)),
+        Subsignal("ack",   Pins(1)),
+        Subsignal("we",    Pins(1)),
+    ),
+    # Host file loads into the behavioral main memory (wishbone_memory sim module)
+    ("sim_load", 0,
+        Subsignal("index",  Pins(8)),
+        Subsignal("addr",   Pins(32)),
+        Subsignal("start",  Pins(1)),
+        Subsignal("done",   Pins(1)),
+        Subsignal("length", Pins(32)),
+        Subsignal("error",  Pins(1)),
+    ),
+    # GDB stub bus master (gdbstub sim module)
+    ("sim_gdb", 0,
+        Subsignal("adr",   Pins(30)),
+        Subsignal("dat_w", Pins(32)),
+        Subsignal("dat_r", Pins(32)),
+        Subsignal("sel",   Pins(4)),
+        Subsignal("cyc",   Pins(1)),
+        Subsignal("stb",   Pins(1)),
+        Subsignal("ack",   Pins(1)),
+        Subsignal("we",    Pins(1)),
+    ),
+    # Idle skipping (idle sim module)
+    ("sim_idle", 0,
+        Subsignal("idle",   Pins(1)),
+        Subsignal("budget", Pins(32)),
+        Subsignal("skip",   Pins(32)),
+    ),
+    # Instruction trace (insntrace sim module)
+    ("insntrace", 0,
+        Subsignal("insn_valid", Pins(1)),
+        Subsignal("insn_pc",    Pins(32)),
+        Subsignal("mem_valid",  Pins(1)),
+        Subsignal("mem_addr",   Pins(32)),
+    ),
     # Simulated tristate IO (Verilator does not support top-level
     # tristate signals)
     ("gpio", 0,
@@ -138,11 +187,20 @@ class SimSoC(SoCCore):
         sdram_verbosity       = 0,
         with_i2c              = False,
         with_sdcard           = False,
+        with_sata             = False,
         with_spi_flash        = False,
         spi_flash_init        = [],
         with_gpio             = False,
+        with_crc              = False,
+        with_sim_memory       = False,
+        sim_memory_size       = 0x10000000,
+        with_sim_load         = False,
         sim_debug             = False,
         trace_reset_on        = False,
+        uart_dpi              = False,
+        with_insn_trace       = False,
+        with_idle_skip        = False,
+        with_gdb              = False,
         **kwargs):
         platform     = Platform()
         sys_clk_freq = int(1e6)
@@ -156,6 +214,15 @@ class SimSoC(SoCCore):
         # CRG --------------------------------------------------------------------------------------
         self.submodules.crg = CRG(platform.request("sys_clk"))
 
+        # UART (DPI) -------------------------------------------------------------------------------
+        if uart_dpi:
+            self.submodules.uart_dpi_rx = SimDPISource(platform, "uart")
+            self.submodules.uart_dpi_tx = SimDPISink(platform, "uart")
+            self.comb += [
+                self.uart_dpi_rx.source.connect(self.uart.sink),
+                self.uart.source.connect(self.uart_dpi_tx.sink),
+            ]
+
         # SDRAM ------------------------------------------------------------------------------------
         if not self.integrated_main_ram_size and with_sdram:
             sdram_clk_freq = int(100e6) # FIXME: use 100MHz timings
@@ -188,6 +255,24 @@ class SimSoC(SoCCore):
                 self.add_constant("MEMTEST_DATA_SIZE", 8*1024)
                 self.add_constant("MEMTEST_ADDR_SIZE", 8*1024)
 
+        # Behavioral main memory -------------------------------------------------------------------
+        if not self.integrated_main_ram_size and not with_sdram and with_sim_memory:
+            pads = platform.request("wishbone_mem")
+            bus  = wishbone.Interface(data_width=32)
+            self.comb += [
+                pads.adr.eq(bus.adr),
+                pads.dat_w.eq(bus.dat_w),
+                pads.sel.eq(bus.sel),
+                pads.cyc.eq(bus.cyc),
+                pads.stb.eq(bus.stb),
+                pads.we.eq(bus.we),
+                bus.dat_r.eq(pads.dat_r),
+                bus.ack.eq(pads.ack),
+            ]
+            self.bus.add_slave("main_ram", bus, SoCRegion(origin=self.mem_map["main_ram"], size=sim_memory_size))
+            if with_sim_load:
+                self.submodules.sim_load = SimLoad(platform.request("sim_load"), base=self.mem_map["main_ram"])
+
         # Ethernet / Etherbone PHY -----------------------------------------------------------------
         if with_ethernet or with_etherbone:
             if ethernet_phy_model == "sim":
@@ -280,6 +365,24 @@ class SimSoC(SoCCore):
         if with_sdcard:
             self.add_sdcard("sdcard", use_emulator=True)
 
+        # CRC --------------------------------------------------------------------------------------
+        if with_crc:
+            self.add_crc("crc32")
+            self.add_crc("crc16")
+
+        # SATA (blockdev sim module) ---------------------------------------------------------------
+        if with_sata:
+            platform.add_extension([blockdev_io(self.bus.data_width)])
+            self.submodules.sata = sata = SimSATA(platform.request("blockdev"),
+                data_width = self.bus.data_width,
+                endianness = self.cpu.endianness)
+            self.submodules.sata_phy        = sata.phy
+            self.submodules.sata_sector2mem = sata.sector2mem
+            self.submodules.sata_mem2sector = sata.mem2sector
+            dma_bus = self.bus if not hasattr(self, "dma_bus") else self.dma_bus
+            dma_bus.add_master("sata_sector2mem", master=sata.sector2mem_bus)
+            dma_bus.add_master("sata_mem2sector", master=sata.mem2sector_bus)
+
         # SPI Flash --------------------------------------------------------------------------------
         if with_spi_flash:
             from litespi.phy.model import LiteSPIPHYModel
@@ -297,6 +400,53 @@ class SimSoC(SoCCore):
             self.submodules.gpio = GPIOTristate(platform.request("gpio"), with_irq=True)
             self.irq.add("gpio", use_loc_if_exists=True)
 
+        # Instruction trace ------------------------------------------------------------------------
+        # The CPUs don't expose a retire interface: instructions are traced when fetched on the
+        # instruction bus (whole lines with an instruction cache), accesses on the data bus.
+        if with_insn_trace:
+            assert hasattr(self.cpu, "ibus") and hasattr(self.cpu, "dbus")
+            pads = platform.request("insntrace")
+            ibus = self.cpu.ibus
+            dbus = self.cpu.dbus
+            self.sync += [
+                pads.insn_valid.eq(ibus.cyc & ibus.stb & ibus.ack & ~ibus.we),
+                pads.insn_pc.eq(Cat(Signal(log2_int(ibus.data_width//8)), ibus.adr)),
+                pads.mem_valid.eq(dbus.cyc & dbus.stb & dbus.ack),
+                pads.mem_addr.eq(Cat(Signal(log2_int(dbus.data_width//8)), dbus.adr)),
+            ]
+
+        # Idle skipping ----------------------------------------------------------------------------
+        if with_idle_skip:
+            wake = []
+            if hasattr(self.cpu, "interrupt"):
+                wake.append(self.cpu.interrupt)
+            if hasattr(self, "uart") and hasattr(self.uart, "_rxempty"):
+                wake.append(~self.uart._rxempty.status)
+            self.submodules.sim_idle = SimIdle(platform.request("sim_idle"),
+                timer = getattr(self, "timer0", None),
+                wake  = wake)
+
+        # GDB stub -----------------------------------------------------------------------------------
+        # The gdbstub sim module masters the bus to reach the CPU debug plugin and the memories.
+        if with_gdb:
+            if not hasattr(self.cpu, "debug_bus"):
+                raise ValueError("GDB stub requires a CPU with a debug bus (VexRiscv +debug variants).")
+            self.bus.add_slave("vexriscv_debug", self.cpu.debug_bus,
+                SoCRegion(origin=self.mem_map["vexriscv_debug"], size=0x100, cached=False))
+            pads = platform.request("sim_gdb")
+            bus  = wishbone.Interface(data_width=32)
+            self.comb += [
+                bus.adr.eq(pads.adr),
+                bus.dat_w.eq(pads.dat_w),
+                bus.sel.eq(pads.sel),
+                bus.cyc.eq(pads.cyc),
+                bus.stb.eq(pads.stb),
+                bus.we.eq(pads.we),
+                pads.dat_r.eq(bus.dat_r),
+                pads.ack.eq(bus.ack),
+            ]
+            self.bus.add_master("sim_gdb", master=bus)
+
         # Simulation debugging ----------------------------------------------------------------------
         if sim_debug:
             platform.add_debug(self, reset=1 if trace_reset_on else 0)
@@ -345,10 +495,14 @@ def generate_gtkw_savefile(builder, vns, trace_fst):
 def sim_args(parser):
     builder_args(parser)
     soc_core_args(parser)
-    parser.add_argument("--threads",              default=1,               help="Set number of threads (default=1)")
+    parser.add_argument("--threads",              default=1,               help="Set number of threads (default=1, auto=tune for the host)")
     parser.add_argument("--rom-init",             default=None,            help="rom_init file")
     parser.add_argument("--ram-init",             default=None,            help="ram_init file")
+    parser.add_argument("--ram-preload",          action="store_true",     help="Load ram_init file(s) at sim startup instead of Verilog init")
     parser.add_argument("--with-sdram",           action="store_true",     help="Enable SDRAM support")
+    parser.add_argument("--with-sim-memory",      action="store_true",     help="Enable behavioral main memory (wishbone_memory sim module)")
+    parser.add_argument("--sim-memory-size",      default="0x10000000",    help="Behavioral main memory size (default=256MB)")
+    parser.add_argument("--sim-load",             default=None,            help="Comma separated files software can load into the behavioral main memory (sim_load), the first one by serialboot")
     parser.add_argument("--sdram-module",         default="MT48LC16M16",   help="Select SDRAM chip")
     parser.add_argument("--sdram-data-width",     default=32,              help="Set SDRAM chip data width")
     parser.add_argument("--sdram-init",           default=None,            help="SDRAM init file")
@@ -356,22 +510,60 @@ def sim_args(parser):
     parser.add_argument("--sdram-verbosity",      default=0,               help="Set SDRAM checker verbosity")
     parser.add_argument("--with-ethernet",        action="store_true",     help="Enable Ethernet support")
     parser.add_argument("--ethernet-phy-model",   default="sim",           help="Ethernet PHY to simulate (sim, xgmii, gmii)")
+    parser.add_argument("--ethernet-pcap-in",     default=None,            help="Replay Ethernet frames from a pcap file instead of the TAP interface")
+    parser.add_argument("--ethernet-pcap-out",    default=None,            help="Record transmitted Ethernet frames to a pcap file instead of the TAP interface")
+    parser.add_argument("--ethernet-pcap-pacing", default="timestamp",     help="Replay pacing: timestamp (capture timing) or fast (default=timestamp)")
+    parser.add_argument("--ethernet-queue",       default=64,              help="Frames buffered in each direction between the TAP interface and the simulation (default=64)")
+    parser.add_argument("--ethernet-rx-pause",    action="store_true",     help="Pause the TAP reads while the RX queue is full instead of dropping frames")
+    parser.add_argument("--ethernet-switch",      default=None,            help="Attach Ethernet to this shared memory switch between simulations instead of the TAP interface")
+    parser.add_argument("--ethernet-traffic",     default=None,            help="Generate/check synthetic traffic on the xgmii/gmii PHY pads instead of the TAP interface (JSON ethgen module args, e.g. '{\"sizes\": \"64-1518\", \"rate\": 100}')")
     parser.add_argument("--with-etherbone",       action="store_true",     help="Enable Etherbone support")
     parser.add_argument("--local-ip",             default="192.168.1.50",  help="Local IP address of SoC (default=192.168.1.50)")
     parser.add_argument("--remote-ip",            default="192.168.1.100", help="Remote IP address of TFTP server (default=192.168.1.100)")
     parser.add_argument("--with-analyzer",        action="store_true",     help="Enable Analyzer support")
     parser.add_argument("--with-i2c",             action="store_true",     help="Enable I2C support")
     parser.add_argument("--with-sdcard",          action="store_true",     help="Enable SDCard support")
+    parser.add_argument("--with-sata",            action="store_true",     help="Enable SATA support (blockdev sim module, requires --sata-image)")
+    parser.add_argument("--sata-image",           default=None,            help="SATA disk image, mapped copy-on-write")
+    parser.add_argument("--sata-overlay",         default=None,            help="File keeping the sectors written to the SATA disk across runs")
     parser.add_argument("--with-spi-flash",       action="store_true",     help="Enable SPI Flash (MMAPed)")
+    parser.add_argument("--with-crc",             action="store_true",     help="Enable CRC-32/CRC-16 accelerators")
     parser.add_argument("--spi_flash-init",       default=None,            help="SPI Flash init file")
     parser.add_argument("--with-gpio",            action="store_true",     help="Enable Tristate GPIO (32 pins)")
     parser.add_argument("--trace",                action="store_true",     help="Enable Tracing")
     parser.add_argument("--trace-fst",            action="store_true",     help="Enable FST tracing (default=VCD)")
     parser.add_argument("--trace-start",          default="0",             help="Time to start tracing (ps)")
     parser.add_argument("--trace-end",            default="-1",            help="Time to end tracing (ps)")
+    parser.add_argument("--trace-scopes",         default=None,            help="Only trace these comma separated signals/scopes (wildcards allowed, e.g. main_uart_*,VexRiscv*)")
+    parser.add_argument("--trace-levels",         default=None,            help="Trace this number of hierarchy levels below the top (default=99)")
+    parser.add_argument("--trace-threads",        default=None,            help="Number of FST trace writer threads (default=1 with --trace-fst, 0=synchronous)")
+    parser.add_argument("--coverage",             default=None,            help="Enable coverage (all, or comma separated list of line, toggle, user)")
+    parser.add_argument("--coverage-file",        default=None,            help="Coverage output (default=sim.cov, %%p expands to the pid)")
+    parser.add_argument("--coverage-window",      default=None,            help="Only collect coverage within this time window (<start ps>:<end ps>)")
+    parser.add_argument("--insn-trace",           default=None,            help="Write an instruction trace to this file (see litex_sim_insntrace)")
+    parser.add_argument("--wave-stream",          default=None,            help="Stream signal changes to a client on this TCP port (see litex_sim_wavestream)")
+    parser.add_argument("--wave-stream-pads",     default="serial",        help="Comma separated sim interfaces (or interface.signal) streamed with --wave-stream (default=serial)")
+    parser.add_argument("--gdb-port",             default=None,            help="Serve GDB on this TCP port through the CPU debug plugin (gdbstub sim module, VexRiscv +debug variants)")
+    parser.add_argument("--idle-skip",            default=None,            help="Skip up to N cycles at once while software waits (sim_idle CSR), 0: default bound")
+    parser.add_argument("--sim-stats",            default=None,            help="Report the simulation rate every N seconds on stderr, and a summary at the end (0: summary only)")
+    parser.add_argument("--sim-affinity",         default=None,            help="Pin the simulator threads (<role>=<cpus>;... roles: sim, io, verilator, workers, cpus: 0,2-3,node1)")
     parser.add_argument("--opt-level",            default="O3",            help="Compilation optimization level")
+    parser.add_argument("--savable",              action="store_true",     help="Enable simulation checkpointing (LITEX_SIM_SAVE/LITEX_SIM_RESTORE)")
+    parser.add_argument("--no-build-cache",       action="store_true",     help="Always recompile the simulator, even when the design did not change")
+    parser.add_argument("--static-modules",       action="store_true",     help="Link the sim modules into the simulator (LTO) instead of loading them at startup")
+    parser.add_argument("--pgo",                  action="store_true",     help="Profile-guided simulator build: instrumented training run of --pgo-ps, rebuilt with the profiles and LTO")
+    parser.add_argument("--pgo-ps",               default="1e9",           help="Simulated time of the --pgo training run (ps, default=1e9)")
+    parser.add_argument("--stim-record",          default=None,            help="Log the external stimulus (serial2tcp, jtagremote, Ethernet RX) with its simulated time to this file")
+    parser.add_argument("--stim-replay",          default=None,            help="Replay a --stim-record log instead of opening the sockets/TAP interfaces")
+    parser.add_argument("--static-schedule",      action="store_true",     help="Build the main loop for the tickfirst sessions (clockers) of this sim config")
+    parser.add_argument("--packed-pads",          action="store_true",     help="Give the sim modules packed per-interface copies of the pads, synchronized around each eval")
     parser.add_argument("--sim-debug",            action="store_true",     help="Add simulation debugging modules")
     parser.add_argument("--gtkwave-savefile",     action="store_true",     help="Generate GTKWave savefile")
+    parser.add_argument("--uart-dpi",             action="store_true",     help="Connect the UART to the console through a DPI channel instead of sim pads")
+    parser.add_argument("--uart-lockstep",        default=None,            help="Link the UART to another simulation in lockstep (<shm name>:<node 0/1>)")
+    parser.add_argument("--lockstep-quantum",     default="1e6",           help="Lockstep link latency/synchronization quantum (ps, default=1e6)")
+    parser.add_argument("--fast-forward-pc",      default=None,            help="Run the software on the sim core ISS until this PC, then hand over to the RTL CPU")
+    parser.add_argument("--fast-forward-insns",   default=None,            help="Run at most this number of instructions on the sim core ISS before handing over")
     parser.add_argument("--non-interactive",      action="store_true",     help="Run simulation without user input")
 
 def main():
@@ -393,7 +585,18 @@ def main():
     # UART.
     if soc_kwargs["uart_name"] == "serial":
         soc_kwargs["uart_name"] = "sim"
-        sim_config.add_module("serial2console", "serial")
+        if args.uart_dpi:
+            soc_kwargs["uart_name"] = "stream"
+            sim_config.add_module("serial2console", [], args={"dpi": "uart"})
+        elif args.uart_lockstep:
+            shm, node = args.uart_lockstep.split(":")
+            sim_config.add_module("lockstep", "serial", args={
+                "shm"        : shm,
+                "node"       : int(node),
+                "quantum_ps" : int(float(args.lockstep_quantum)),
+            })
+        else:
+            sim_config.add_module("serial2console", "serial")
 
     # ROM.
     if args.rom_init:
@@ -401,9 +604,29 @@ def main():
 
     # RAM / SDRAM.
     soc_kwargs["integrated_main_ram_size"] = args.integrated_main_ram_size
+    ram_preload = {}
+    # Software loads are written by backdoor into the behavioral main memory.
+    assert args.sim_load is None or (args.with_sim_memory and not args.integrated_main_ram_size)
     if args.integrated_main_ram_size:
-        if args.ram_init is not None:
+        if args.ram_init is not None and args.ram_preload:
+            # Raw images are copied as is into the simulated memory by the sim core.
+            assert cpu.endianness == "little"
+            if os.path.splitext(args.ram_init)[1] == ".json":
+                with open(args.ram_init) as f:
+                    ram_preload = json.load(f)
+            else:
+                ram_preload = {args.ram_init: "0x00000000"}
+        elif args.ram_init is not None:
             soc_kwargs["integrated_main_ram_init"] = get_mem_data(args.ram_init, cpu.endianness)
+    elif args.with_sim_memory:
+        memory_args = {}
+        if args.ram_init is not None:
+            # Raw little-endian image, loaded as is by the module.
+            assert cpu.endianness == "little" and not args.ram_init.endswith(".json")
+            memory_args = {"init": os.path.abspath(args.ram_init), "offset": 0}
+        if args.sim_load is not None:
+            memory_args["load"] = [os.path.abspath(f) for f in args.sim_load.split(",")]
+        sim_config.add_module("wishbone_memory", "wishbone_mem", args=memory_args)
     elif args.with_sdram:
         assert args.ram_init is None
         soc_kwargs["sdram_module"]     = args.sdram_module
@@ -414,12 +637,33 @@ def main():
 
     # Ethernet.
     if args.with_ethernet or args.with_etherbone:
-        if args.ethernet_phy_model == "sim":
-            sim_config.add_module("ethernet", "eth", args={"interface": "tap0", "ip": args.remote_ip})
+        ethernet_args = {"interface": "tap0", "ip": args.remote_ip}
+        if args.ethernet_pcap_in is not None or args.ethernet_pcap_out is not None:
+            # Offline: no TAP interface, frames are replayed from/recorded to capture files.
+            ethernet_args = {"pacing": args.ethernet_pcap_pacing}
+            if args.ethernet_pcap_in is not None:
+                ethernet_args["pcap_in"] = os.path.abspath(args.ethernet_pcap_in)
+            if args.ethernet_pcap_out is not None:
+                ethernet_args["pcap_out"] = os.path.abspath(args.ethernet_pcap_out)
+        ethernet_args["queue"] = int(args.ethernet_queue)
+        if args.ethernet_rx_pause:
+            ethernet_args["backpressure"] = 1
+        if args.ethernet_switch is not None:
+            # No TAP interface either: frames are exchanged with the other simulations on the switch.
+            ethernet_args.pop("interface", None)
+            ethernet_args.pop("ip", None)
+            ethernet_args.update({"backend": "shm", "switch": args.ethernet_switch})
+        if args.ethernet_traffic is not None:
+            # No host either: frames are generated onto the PHY pads and the transmitted ones checked.
+            if args.ethernet_phy_model not in ["xgmii", "gmii"]:
+                raise ValueError("Synthetic Ethernet traffic requires the xgmii or gmii PHY model")
+            sim_config.add_module("ethgen", args.ethernet_phy_model + "_eth", args=json.loads(args.ethernet_traffic))
+        elif args.ethernet_phy_model == "sim":
+            sim_config.add_module("ethernet", "eth", args=ethernet_args)
         elif args.ethernet_phy_model == "xgmii":
-            sim_config.add_module("xgmii_ethernet", "xgmii_eth", args={"interface": "tap0", "ip": args.remote_ip})
+            sim_config.add_module("xgmii_ethernet", "xgmii_eth", args=ethernet_args)
         elif args.ethernet_phy_model == "gmii":
-            sim_config.add_module("gmii_ethernet", "gmii_eth", args={"interface": "tap0", "ip": args.remote_ip})
+            sim_config.add_module("gmii_ethernet", "gmii_eth", args=ethernet_args)
         else:
             raise ValueError("Unknown Ethernet PHY model: " + args.ethernet_phy_model)
 
@@ -427,6 +671,30 @@ def main():
     if args.with_i2c:
         sim_config.add_module("spdeeprom", "i2c")
 
+    # Instruction trace.
+    if args.idle_skip is not None:
+        idle_args = {"max_cycles": int(args.idle_skip, 0)} if int(args.idle_skip, 0) else {}
+        sim_config.add_module("idle", "sim_idle", args=idle_args)
+    if args.insn_trace is not None:
+        sim_config.add_module("insntrace", "insntrace", args={"file": os.path.abspath(args.insn_trace)})
+
+    # Waveform streaming.
+    if args.wave_stream is not None:
+        wave_signals = args.wave_stream_pads.split(",")
+        wave_interfaces = sorted(set(s.split(".")[0] for s in wave_signals))
+        sim_config.add_module("wavestream", wave_interfaces, args={
+            "port"    : int(args.wave_stream),
+            "signals" : args.wave_stream_pads,
+        })
+
+    # SATA.
+    if args.with_sata:
+        assert args.sata_image is not None
+        blockdev_args = {"image": os.path.abspath(args.sata_image)}
+        if args.sata_overlay:
+            blockdev_args["overlay"] = os.path.abspath(args.sata_overlay)
+        sim_config.add_module("blockdev", "blockdev", args=blockdev_args)
+
     trace_start = int(float(args.trace_start))
     trace_end = int(float(args.trace_end))
 
@@ -439,15 +707,29 @@ def main():
         with_analyzer      = args.with_analyzer,
         with_i2c           = args.with_i2c,
         with_sdcard        = args.with_sdcard,
+        with_sata          = args.with_sata,
         with_spi_flash     = args.with_spi_flash,
         with_gpio          = args.with_gpio,
+        with_crc           = args.with_crc,
+        with_sim_memory    = args.with_sim_memory,
+        sim_memory_size    = int(args.sim_memory_size, 0),
+        with_sim_load      = args.sim_load is not None,
         sim_debug          = args.sim_debug,
         trace_reset_on     = trace_start > 0 or trace_end > 0,
+        uart_dpi           = args.uart_dpi,
+        with_insn_trace    = args.insn_trace is not None,
+        with_idle_skip     = args.idle_skip is not None,
+        with_gdb           = args.gdb_port is not None,
         sdram_init         = [] if args.sdram_init is None else get_mem_data(args.sdram_init, cpu.endianness),
         spi_flash_init     = None if args.spi_flash_init is None else get_mem_data(args.spi_flash_init, "big"),
         **soc_kwargs)
     if args.ram_init is not None or args.sdram_init is not None:
         soc.add_constant("ROM_BOOT_ADDRESS", soc.mem_map["main_ram"])
+    if args.gdb_port is not None:
+        sim_config.add_module("gdbstub", "sim_gdb", args={
+            "port"       : int(args.gdb_port, 0),
+            "debug_base" : soc.bus.regions["vexriscv_debug"].origin,
+        })
     if args.with_ethernet:
         for i in range(4):
             soc.add_constant("LOCALIP{}".format(i+1), int(args.local_ip.split(".")[i]))
@@ -459,6 +741,40 @@ def main():
         if args.trace:
             generate_gtkw_savefile(builder, vns, args.trace_fst)
 
+    # Integrated memories firmware images can be loaded into at startup (Vsim --load <region>:<file>).
+    mems = []
+    for name in ["rom", "sram", "main_ram"]:
+        if isinstance(getattr(soc, name, None), wishbone.SRAM):
+            mems.append((name, getattr(soc, name).mem, soc.bus.regions[name].origin))
+
+    preload = None
+    if ram_preload:
+        preload = [(soc.main_ram.mem, os.path.abspath(filename), int(base, 16)) for filename, base in ram_preload.items()]
+
+    # Fast-forward: the ISS runs directly on the integrated memories, peripherals other than the UART
+    # TX are not modeled.
+    fast_forward = None
+    if args.fast_forward_pc is not None or args.fast_forward_insns is not None:
+        if getattr(soc.cpu, "family", None) != "riscv" or soc.cpu.data_width != 32:
+            raise ValueError("Fast-forward is only supported with 32-bit RISC-V CPUs.")
+        fast_forward = {
+            "mems"  : [(mem, base) for _, mem, base in mems],
+            "reset" : soc.cpu.reset_address,
+            "pc"    : None if args.fast_forward_pc is None else int(args.fast_forward_pc, 0),
+            "insns" : None if args.fast_forward_insns is None else int(args.fast_forward_insns, 0),
+        }
+        if hasattr(soc, "uart"):
+            # Allocated now so that the ISS knows the UART CSRs, finalize keeps the location.
+            fast_forward["uart"] = soc.mem_map["csr"] + soc.csr.paging*soc.csr.address_map("uart", None)
+
+    # Coverage.
+    coverage = False
+    if args.coverage is not None:
+        coverage = True if args.coverage == "all" else args.coverage.split(",")
+    coverage_window = None
+    if args.coverage_window is not None:
+        coverage_window = tuple(int(float(t)) for t in args.coverage_window.split(":"))
+
     builder_kwargs["csr_csv"] = "csr.csv"
     builder = Builder(soc, **builder_kwargs)
     soc.platform.toolchain.pre_run_callback = pre_run_callback
@@ -466,10 +782,30 @@ def main():
         threads          = args.threads,
         sim_config       = sim_config,
         opt_level        = args.opt_level,
+        coverage         = coverage,
+        coverage_file    = args.coverage_file,
+        coverage_window  = coverage_window,
+        stats            = args.sim_stats,
+        affinity         = args.sim_affinity,
         trace            = args.trace,
         trace_fst        = args.trace_fst,
         trace_start      = trace_start,
         trace_end        = trace_end,
+        trace_threads    = args.trace_threads,
+        trace_scopes     = None if args.trace_scopes is None else args.trace_scopes.split(","),
+        trace_levels     = args.trace_levels,
+        savable          = args.savable,
+        preload          = preload,
+        mems             = mems,
+        fast_forward     = fast_forward,
+        static_modules   = args.static_modules,
+        pgo              = args.pgo,
+        pgo_ps           = int(float(args.pgo_ps)),
+        stim_record      = args.stim_record,
+        stim_replay      = args.stim_replay,
+        static_schedule  = args.static_schedule,
+        packed_pads      = args.packed_pads,
+        cache            = not args.no_build_cache,
         interactive      = not args.non_interactive,
         pre_run_callback = pre_run_callback
     )
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+
+#
+# This file is part of LiteX.
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+# Simulation throughput benchmark: builds the reference litex_sim SoC in a few configurations, runs
+# each of them for a fixed number of sys_clk cycles and reports the simulated frequency, the wall
+# time and the peak RSS of the simulator as JSON so results can be compared across Verilator
+# versions, thread counts and optimization levels.
+
+import os
+import sys
+import json
+import time
+import argparse
+import subprocess
+
+# Configurations -----------------------------------------------------------------------------------
+
+bench_configs = {
+    "base"      : [],
+    "trace"     : ["--trace"],
+    "trace-fst" : ["--trace", "--trace-fst"],
+    # Requires a TAP interface (root privileges), only run when explicitly selected.
+    "ethernet"  : ["--with-ethernet"],
+}
+
+bench_default_configs = ["base", "trace", "trace-fst"]
+
+sys_clk_freq = int(1e6) # Keep in sync with litex_sim.
+
+# Helpers ------------------------------------------------------------------------------------------
+
+def verilator_version():
+    try:
+        return subprocess.check_output(["verilator", "--version"]).decode("utf-8").strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+def build_config(name, extra_args, args):
+    output_dir = os.path.join(args.output_dir, name)
+    cmd = [sys.executable, "-m", "litex.tools.litex_sim",
+        "--output-dir",      output_dir,
+        "--threads",         str(args.threads),
+        "--opt-level",       args.opt_level,
+        "--non-interactive",
+    ] + extra_args + args.sim_args
+    env = dict(os.environ)
+    env["LITEX_SIM_RUN_PS"] = "1" # Build and exit right away, the run is timed separately.
+    subprocess.check_call(cmd, env=env, stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL)
+    return os.path.join(output_dir, "gateware")
+
+def run_config(gateware_dir, cycles):
+    run_ps = cycles * int(1e12) // sys_clk_freq
+    env = dict(os.environ)
+    env["LITEX_SIM_RUN_PS"] = str(run_ps)
+    start = time.monotonic()
+    p = subprocess.Popen([os.path.join("obj_dir", "Vsim")], cwd=gateware_dir, env=env,
+        stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL)
+    _, status, rusage = os.wait4(p.pid, 0)
+    wall = time.monotonic() - start
+    if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+        raise OSError("Simulation failed with status {}".format(status))
+    return {
+        "cycles"       : cycles,
+        "wall_s"       : round(wall, 3),
+        "khz"          : round(cycles/wall/1e3, 3),
+        "peak_rss_kib" : rusage.ru_maxrss,
+    }
+
+# Main ---------------------------------------------------------------------------------------------
+
+def main():
+    parser = argparse.ArgumentParser(description="LiteX Verilator simulation throughput benchmark.")
+    parser.add_argument("--cycles",     default=1000000,         type=int, help="Number of sys_clk cycles to simulate (default=1000000).")
+    parser.add_argument("--configs",    default=",".join(bench_default_configs), help="Comma separated configurations to run ({}).".format(", ".join(bench_configs.keys())))
+    parser.add_argument("--threads",    default=1,               type=int, help="Verilator threads (default=1).")
+    parser.add_argument("--opt-level",  default="O3",            help="Compilation optimization level (default=O3).")
+    parser.add_argument("--output-dir", default="build/sim_bench", help="Build directory (default=build/sim_bench).")
+    parser.add_argument("--output",     default=None,            help="Write JSON results to file (default=stdout).")
+    parser.add_argument("--no-build",   action="store_true",     help="Reuse previous builds.")
+    parser.add_argument("sim_args",     nargs=argparse.REMAINDER, help="Extra litex_sim arguments (after --).")
+    args = parser.parse_args()
+    if args.sim_args[:1] == ["--"]:
+        args.sim_args = args.sim_args[1:]
+
+    results = {
+        "verilator" : verilator_version(),
+        "threads"   : args.threads,
+        "opt_level" : args.opt_level,
+        "configs"   : {},
+    }
+    for name in args.configs.split(","):
+        if name not in bench_configs:
+            raise ValueError("Unknown configuration {}, supported: {}.".format(name, ", ".join(bench_configs.keys())))
+        if args.no_build:
+            gateware_dir = os.path.join(args.output_dir, name, "gateware")
+        else:
+            gateware_dir = build_config(name, bench_configs[name], args)
+        results["configs"][name] = run_config(gateware_dir, args.cycles)
+        print("{}: {:.3f} kHz".format(name, results["configs"][name]["khz"]), file=sys.stderr)
+
+    content = json.dumps(results, indent=4)
+    if args.output is None:
+        print(content)
+    else:
+        with open(args.output, "w") as f:
+            f.write(content)
+
+if __name__ == "__main__":
+    main()
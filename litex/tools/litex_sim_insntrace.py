@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+
+#
+# This file is part of LiteX.
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+# Instruction trace analysis: decodes the traces written by the insntrace sim module (litex_sim
+# --insn-trace) and reports the cycles spent in each function of the given ELF files (BIOS, user
+# software), the cycles elapsed until the next traced instruction being accounted to the current one.
+
+import sys
+import json
+import struct
+import bisect
+import argparse
+
+# Trace decoding -----------------------------------------------------------------------------------
+
+TAG_MEM      = 1 << 7
+TAG_PC_SEQ4  = 0 << 5
+TAG_PC_SEQ2  = 1 << 5
+TAG_PC_DELTA = 2 << 5
+TAG_PC_NONE  = 3 << 5
+
+def _varint(data, i):
+    v = shift = 0
+    while True:
+        b = data[i]
+        i += 1
+        v |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            return v, i
+
+def _unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+def read_trace(filename):
+    """Yields (cycle, pc, mem_addr) records, pc/mem_addr being None when not traced"""
+    with open(filename, "rb") as f:
+        data = f.read()
+    if data[:4] != b"LXIT":
+        raise ValueError("{} is not an instruction trace.".format(filename))
+    version, = struct.unpack("<I", data[4:8])
+    if version != 1:
+        raise ValueError("Unsupported trace version {}.".format(version))
+    i = 8
+    cycle = pc = addr = 0
+    while i < len(data):
+        tag = data[i]
+        i  += 1
+        cycles = tag & 0x1f
+        if cycles == 0:
+            cycles, i = _varint(data, i)
+        cycle += cycles
+        mode = tag & TAG_PC_NONE
+        if mode == TAG_PC_DELTA:
+            delta, i = _varint(data, i)
+            pc = (pc + 4 + _unzigzag(delta)) & 0xffffffff
+        elif mode == TAG_PC_SEQ4:
+            pc = (pc + 4) & 0xffffffff
+        elif mode == TAG_PC_SEQ2:
+            pc = (pc + 2) & 0xffffffff
+        mem = None
+        if tag & TAG_MEM:
+            delta, i = _varint(data, i)
+            addr = (addr + _unzigzag(delta)) & 0xffffffff
+            mem  = addr
+        yield cycle, None if mode == TAG_PC_NONE else pc, mem
+
+# ELF symbols --------------------------------------------------------------------------------------
+
+def read_elf_functions(filename):
+    """Returns the (address, size, name) function symbols of an ELF32/ELF64 file"""
+    with open(filename, "rb") as f:
+        data = f.read()
+    if data[:4] != b"\x7fELF":
+        raise ValueError("{} is not an ELF file.".format(filename))
+    is64 = data[4] == 2
+    endian = "<" if data[5] == 1 else ">"
+    if is64:
+        shoff, = struct.unpack_from(endian + "Q", data, 0x28)
+        shentsize, shnum = struct.unpack_from(endian + "HH", data, 0x3a)
+        shdr, sym, symsize = "IIQQQQIIQQ", "IBBHQQ", 24
+    else:
+        shoff, = struct.unpack_from(endian + "I", data, 0x20)
+        shentsize, shnum = struct.unpack_from(endian + "HH", data, 0x2e)
+        shdr, sym, symsize = "IIIIIIIIII", "IIIBBH", 16
+    sections = [struct.unpack_from(endian + shdr, data, shoff + n*shentsize) for n in range(shnum)]
+    functions = []
+    for s in sections:
+        if s[1] != 2: # SHT_SYMTAB
+            continue
+        offset, size, link = s[4], s[5], s[6]
+        strtab = sections[link][4]
+        for n in range(size//symsize):
+            fields = struct.unpack_from(endian + sym, data, offset + n*symsize)
+            if is64:
+                name, info, _, shndx, value, sym_size = fields
+            else:
+                name, value, sym_size, info, _, shndx = fields
+            if info & 0xf != 2 or shndx == 0: # STT_FUNC, defined
+                continue
+            end  = data.index(b"\0", strtab + name)
+            functions.append((value, sym_size, data[strtab + name:end].decode()))
+    return functions
+
+class Symbols:
+    def __init__(self, functions):
+        self.functions = sorted(functions)
+        self.starts    = [f[0] for f in self.functions]
+
+    def lookup(self, pc):
+        n = bisect.bisect_right(self.starts, pc) - 1
+        if n >= 0:
+            start, size, name = self.functions[n]
+            if pc < start + max(size, 1):
+                return name
+        return "0x{:08x}".format(pc)
+
+# Histogram ----------------------------------------------------------------------------------------
+
+def histogram(records, symbols):
+    stats = {}
+    current = None
+    last    = 0
+    for cycle, pc, mem in records:
+        if current is not None:
+            stats[current][0] += cycle - last
+        if pc is not None:
+            current = symbols.lookup(pc)
+            stats.setdefault(current, [0, 0])[1] += 1
+        if current is not None:
+            last = cycle
+    return stats
+
+def main():
+    parser = argparse.ArgumentParser(description="LiteX simulation instruction trace analysis")
+    parser.add_argument("trace",                                  help="Trace written by litex_sim --insn-trace")
+    parser.add_argument("--elf",     action="append", default=[], help="ELF file(s) of the traced software (BIOS, user code)")
+    parser.add_argument("--top",     default=30, type=int,        help="Number of functions listed (0 for all)")
+    parser.add_argument("--json",    action="store_true",         help="Output the histogram as JSON")
+    args = parser.parse_args()
+
+    functions = []
+    for elf in args.elf:
+        functions += read_elf_functions(elf)
+    stats = histogram(read_trace(args.trace), Symbols(functions))
+
+    ordered = sorted(stats.items(), key=lambda kv: kv[1][0], reverse=True)
+    if args.top:
+        ordered = ordered[:args.top]
+    if args.json:
+        print(json.dumps({name: {"cycles": c, "insns": i} for name, (c, i) in ordered}, indent=4))
+        return
+    total = sum(c for c, _ in stats.values()) or 1
+    print("{:>12} {:>7} {:>12}  {}".format("cycles", "%", "insns", "function"))
+    for name, (cycles, insns) in ordered:
+        print("{:>12} {:>6.2f}% {:>12}  {}".format(cycles, 100*cycles/total, insns, name))
+
+if __name__ == "__main__":
+    main()
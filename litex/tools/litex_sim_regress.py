@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+
+#
+# This file is part of LiteX.
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+# Simulation regression runner: compiles the litex_sim simulator once (or reuses an existing
+# gateware directory), then runs the instances of a test list in parallel, each in its own working
+# directory with its own sim_config.js (module args), files (memory init files, firmware images)
+# and TCP ports/TAP interfaces, and reports their exit status, UART logs and throughput as JSON.
+#
+# Test list (JSON), relative paths being relative to the test list:
+#
+# {
+#     "instances": [
+#         {
+#             "name"    : "bios",                                 # Working directory name.
+#             "files"   : {"sim_rom.init": "fw/bios.init"},       # Files replacing the gateware ones.
+#             "modules" : {"wishbone_memory": {"init": "a.bin"}}, # Args merged into the module args.
+#             "args"    : ["--load", "main_ram:app.bin"],         # Vsim arguments (run in the working directory).
+#             "env"     : {"LITEX_SIM_TRACE_WINDOW": "1000000"},  # Extra environment.
+#             "run_ps"  : 100000000000,                           # Simulated time limit.
+#             "timeout" : 600,                                    # Wall-clock time limit (s).
+#             "expect"  : "Memtest OK"                            # Regex the UART log must match.
+#         }
+#     ]
+# }
+
+import os
+import re
+import sys
+import json
+import time
+import shutil
+import socket
+import argparse
+import subprocess
+from concurrent.futures import ThreadPoolExecutor
+
+# Modules with host resources an instance can't share ----------------------------------------------
+
+tcp_modules = ["serial2tcp", "jtagremote", "gdbstub"]
+tap_modules = ["ethernet", "xgmii_ethernet", "gmii_ethernet"]
+
+# Summary printed by the sim core on exit with LITEX_SIM_STATS.
+stats_re = re.compile(r"\[sim\] done at ([0-9.]+) ms simulated in ([0-9.]+) s .*: ([0-9.]+) kHz")
+
+# Helpers ------------------------------------------------------------------------------------------
+
+def build_sim(output_dir, sim_args):
+    cmd = [sys.executable, "-m", "litex.tools.litex_sim",
+        "--output-dir",      output_dir,
+        "--non-interactive",
+    ] + sim_args
+    env = dict(os.environ)
+    env["LITEX_SIM_RUN_PS"] = "1" # Build and exit right away, instances are run separately.
+    subprocess.check_call(cmd, env=env, stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL)
+    return os.path.join(output_dir, "gateware")
+
+class PortAllocator:
+    def __init__(self, base):
+        self.next = base
+
+    def get(self):
+        while True:
+            port = self.next
+            self.next += 1
+            with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+                try:
+                    s.bind(("", port))
+                    return port
+                except OSError:
+                    pass
+
+def prepare_instance(index, spec, spec_dir, gateware_dir, workdir, ports):
+    files = {name: os.path.join(spec_dir, f) for name, f in spec.get("files", {}).items()}
+
+    # Working directory: the gateware files (obj_dir, modules, init files) linked, overridden ones copied.
+    if os.path.exists(workdir):
+        shutil.rmtree(workdir)
+    os.makedirs(workdir)
+    for name in os.listdir(gateware_dir):
+        if name == "sim_config.js" or name in files:
+            continue
+        os.symlink(os.path.abspath(os.path.join(gateware_dir, name)), os.path.join(workdir, name))
+    for name, f in files.items():
+        shutil.copy(f, os.path.join(workdir, name))
+
+    # Module args, with the instance's own TCP ports and TAP interfaces.
+    with open(os.path.join(gateware_dir, "sim_config.js")) as f:
+        config = json.load(f)
+    resources = {}
+    for module in config:
+        name = module.get("module", None)
+        if name is None:
+            continue
+        args = module.setdefault("args", {})
+        args.update(spec.get("modules", {}).get(name, {}))
+        if name in tcp_modules:
+            args["port"] = str(ports.get())
+            resources[name] = args["port"]
+        if name in tap_modules and args.get("backend", "tap") == "tap" and not {"pcap_in", "pcap_out"} & set(args.keys()):
+            args["interface"] = "tap{}".format(index)
+            resources[name] = args["interface"]
+    with open(os.path.join(workdir, "sim_config.js"), "w") as f:
+        f.write(json.dumps(config, indent=4))
+    return resources
+
+def run_instance(spec, workdir):
+    env = dict(os.environ, **spec.get("env", {}))
+    env["LITEX_SIM_STATS"] = "0"
+    if "run_ps" in spec:
+        env["LITEX_SIM_RUN_PS"] = str(int(spec["run_ps"]))
+    result = {"status": "pass"}
+
+    start = time.monotonic()
+    with open(os.path.join(workdir, "uart.log"), "wb") as uart_log, \
+         open(os.path.join(workdir, "sim.log"), "wb") as sim_log:
+        vsim = os.path.abspath(os.path.join(workdir, "obj_dir", "Vsim"))
+        p = subprocess.Popen([vsim] + spec.get("args", []), cwd=workdir,
+            env=env, stdin=subprocess.DEVNULL, stdout=uart_log, stderr=sim_log)
+        try:
+            result["returncode"] = p.wait(timeout=spec.get("timeout", None))
+        except subprocess.TimeoutExpired:
+            p.kill()
+            p.wait()
+            result["returncode"] = None
+            result["status"] = "timeout"
+    result["wall_s"] = round(time.monotonic() - start, 3)
+
+    with open(os.path.join(workdir, "sim.log"), errors="replace") as f:
+        m = stats_re.search(f.read())
+    if m is not None:
+        result["sim_ms"] = float(m.group(1))
+        result["khz"]    = float(m.group(3))
+    if result["status"] == "pass" and result["returncode"] != 0:
+        result["status"] = "fail"
+    if result["status"] == "pass" and "expect" in spec:
+        with open(os.path.join(workdir, "uart.log"), errors="replace") as f:
+            if re.search(spec["expect"], f.read()) is None:
+                result["status"] = "fail"
+    return result
+
+def print_summary(instances):
+    print("{:<24} {:>8} {:>10} {:>10} {:>10}".format("Instance", "Status", "Wall (s)", "Sim (ms)", "kHz"),
+        file=sys.stderr)
+    for name, r in instances.items():
+        print("{:<24} {:>8} {:>10} {:>10} {:>10}".format(name, r["status"], r["wall_s"],
+            r.get("sim_ms", "-"), r.get("khz", "-")), file=sys.stderr)
+
+# Main ---------------------------------------------------------------------------------------------
+
+def main():
+    parser = argparse.ArgumentParser(description="LiteX Verilator simulation regression runner.",
+        epilog="litex_sim arguments of the build follow a --.")
+    parser.add_argument("tests",          help="JSON test list.")
+    parser.add_argument("--gateware-dir", default=None,                  help="Reuse this compiled simulator instead of building one.")
+    parser.add_argument("--output-dir",   default="build/sim_regress",  help="Build and instances directory (default=build/sim_regress).")
+    parser.add_argument("--jobs",         default=os.cpu_count() or 1,   type=int, help="Instances run in parallel (default=number of CPUs).")
+    parser.add_argument("--base-port",    default=20000,                 type=int, help="First TCP port given to the instances (default=20000).")
+    parser.add_argument("--output",       default=None,                  help="Write JSON report to file (default=stdout).")
+    argv = sys.argv[1:]
+    sim_args = []
+    if "--" in argv:
+        argv, sim_args = argv[:argv.index("--")], argv[argv.index("--") + 1:]
+    args = parser.parse_args(argv)
+
+    with open(args.tests) as f:
+        tests = json.load(f)
+    spec_dir = os.path.dirname(os.path.abspath(args.tests))
+
+    # Compile once.
+    gateware_dir = args.gateware_dir
+    if gateware_dir is None:
+        gateware_dir = build_sim(os.path.join(args.output_dir, "build"), sim_args)
+
+    # Prepare the instances sequentially (port allocation), run them in parallel.
+    ports     = PortAllocator(args.base_port)
+    instances = {}
+    workdirs  = {}
+    for index, spec in enumerate(tests["instances"]):
+        name = spec.get("name", "instance{}".format(index))
+        if name in instances:
+            raise ValueError("Duplicate instance name {}.".format(name))
+        workdirs[name]  = os.path.join(args.output_dir, name)
+        instances[name] = {"resources": prepare_instance(index, spec, spec_dir, gateware_dir, workdirs[name], ports)}
+
+    start = time.monotonic()
+    with ThreadPoolExecutor(max_workers=args.jobs) as executor:
+        futures = {name: executor.submit(run_instance, spec, workdirs[name])
+            for name, spec in zip(instances.keys(), tests["instances"])}
+        for name, future in futures.items():
+            instances[name].update(future.result())
+            instances[name]["uart_log"] = os.path.join(workdirs[name], "uart.log")
+            print("{}: {}".format(name, instances[name]["status"]), file=sys.stderr)
+
+    report = {
+        "gateware_dir" : gateware_dir,
+        "jobs"         : args.jobs,
+        "wall_s"       : round(time.monotonic() - start, 3),
+        "passed"       : sum(r["status"] == "pass" for r in instances.values()),
+        "failed"       : sum(r["status"] != "pass" for r in instances.values()),
+        "instances"    : instances,
+    }
+    print_summary(instances)
+
+    content = json.dumps(report, indent=4)
+    if args.output is None:
+        print(content)
+    else:
+        with open(args.output, "w") as f:
+            f.write(content)
+    sys.exit(0 if report["failed"] == 0 else 1)
+
+if __name__ == "__main__":
+    main()
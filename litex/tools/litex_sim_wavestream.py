@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+
+#
+# This file is part of LiteX.
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+# Live waveform receiver: connects to the wavestream sim module (litex_sim --wave-stream) and writes
+# the streamed signal changes as VCD, to a file or to stdout to feed a live viewer, e.g.:
+#   litex_sim_wavestream 4444 | shmidcat | gtkwave -v -I sim.gtkw
+
+import sys
+import socket
+import struct
+import argparse
+
+# Stream decoding ----------------------------------------------------------------------------------
+
+class WaveStream:
+    def __init__(self, sock):
+        self.sock = sock
+        self.buf  = b""
+
+    def _read(self, n):
+        while len(self.buf) < n:
+            data = self.sock.recv(65536)
+            if not data:
+                raise EOFError
+            self.buf += data
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def _varint(self):
+        v = shift = 0
+        while True:
+            b = self._read(1)[0]
+            v |= (b & 0x7f) << shift
+            shift += 7
+            if not b & 0x80:
+                return v
+
+    def header(self):
+        """Returns the (name, width) streamed signals"""
+        if self._read(4) != b"LXWS":
+            raise ValueError("Not a wavestream server.")
+        version, count = struct.unpack("<II", self._read(8))
+        if version != 1:
+            raise ValueError("Unsupported stream version {}.".format(version))
+        self.signals = []
+        for _ in range(count):
+            width, length = struct.unpack("<HB", self._read(3))
+            self.signals.append((self._read(length).decode(), width))
+        return self.signals
+
+    def records(self):
+        """Yields (time_ps, [(index, value)]) records until the simulation ends"""
+        time = 0
+        try:
+            while True:
+                delta   = self._varint()
+                full    = delta & 1
+                changes = []
+                for _ in range(self._varint()):
+                    index = self._varint()
+                    width = self.signals[index][1]
+                    value = int.from_bytes(self._read((width + 7)//8), "little")
+                    changes.append((index, value))
+                # Full records (first one, after drops) carry the absolute time.
+                time = (0 if full else time) + (delta >> 1)
+                yield time, changes
+        except EOFError:
+            return
+
+# VCD output ---------------------------------------------------------------------------------------
+
+def _vcd_id(n):
+    chars = "".join(chr(c) for c in range(33, 127))
+    s = chars[n % len(chars)]
+    while n >= len(chars):
+        n  = n//len(chars) - 1
+        s += chars[n % len(chars)]
+    return s
+
+def write_vcd(f, signals, records, flush=False):
+    f.write("$timescale 1ps $end\n")
+    scopes = {}
+    for n, (name, width) in enumerate(signals):
+        scope, signal = name.split(".", 1)
+        scopes.setdefault(scope, []).append((signal, width, _vcd_id(n)))
+    for scope, scope_signals in scopes.items():
+        f.write("$scope module {} $end\n".format(scope))
+        for signal, width, vid in scope_signals:
+            f.write("$var wire {} {} {} $end\n".format(width, vid, signal))
+        f.write("$upscope $end\n")
+    f.write("$enddefinitions $end\n")
+    for time, changes in records:
+        f.write("#{}\n".format(time))
+        for index, value in changes:
+            width = signals[index][1]
+            if width == 1:
+                f.write("{}{}\n".format(value & 1, _vcd_id(index)))
+            else:
+                f.write("b{:b} {}\n".format(value, _vcd_id(index)))
+        if flush:
+            f.flush()
+
+def main():
+    parser = argparse.ArgumentParser(description="LiteX simulation live waveform receiver")
+    parser.add_argument("port",     type=int,                 help="TCP port of litex_sim --wave-stream")
+    parser.add_argument("--host",   default="localhost",      help="Simulation host")
+    parser.add_argument("--output", default=None,             help="VCD file (default=stdout, flushed after each change)")
+    parser.add_argument("--list",   action="store_true",      help="List the streamed signals and exit")
+    args = parser.parse_args()
+
+    sock    = socket.create_connection((args.host, args.port))
+    stream  = WaveStream(sock)
+    signals = stream.header()
+    if args.list:
+        for name, width in signals:
+            print("{:<48} {}".format(name, width))
+        return
+    if args.output is None:
+        write_vcd(sys.stdout, signals, stream.records(), flush=True)
+    else:
+        with open(args.output, "w") as f:
+            write_vcd(f, signals, stream.records())
+
+if __name__ == "__main__":
+    main()
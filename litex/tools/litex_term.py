@@ -214,6 +214,13 @@ sfl_payload_length  = 255
 sfl_cmd_abort       = b"\x00"
 sfl_cmd_load        = b"\x01"
 sfl_cmd_jump        = b"\x02"
+sfl_cmd_window      = b"\x03"
+sfl_cmd_load_lz4    = b"\x04"
+
+# Windowed mode (negotiated with sfl_cmd_window, old BIOSes reply sfl_ack_unknown)
+sfl_window_version  = 2
+sfl_window_frames   = 16
+sfl_window_timeout  = 1.0
 
 # Replies
 sfl_ack_success  = b"K"
@@ -237,6 +244,23 @@ class SFLFrame:
         packet += self.payload
         return packet
 
+# LZ4 frames are decompressed by the BIOS while loading (windowed mode only)
+lz4_frame_magic = b"\x04\x22\x4d\x18"
+
+class SFLWindowFrame:
+    def __init__(self, seq, cmd, payload):
+        self.seq     = seq
+        self.cmd     = cmd
+        self.payload = payload
+
+    def encode(self):
+        packet = len(self.payload).to_bytes(2, "big")
+        packet += bytes([self.seq & 0xff])
+        packet += crc16(bytes([self.seq & 0xff]) + self.cmd + self.payload).to_bytes(2, "big")
+        packet += self.cmd
+        packet += self.payload
+        return packet
+
 # CRC16 --------------------------------------------------------------------------------------------
 
 crc16_table = [
@@ -315,6 +339,11 @@ class LiteXTerm:
         self.length      = 64
         self.outstanding = 0 if safe else 128
 
+        # Windowed mode, when supported by the BIOS.
+        self.window_payload  = None
+        self.window_interval = None
+        self.window_seq      = 0
+
     def open(self, port, baudrate):
         if hasattr(self, "port"):
             return
@@ -427,6 +456,81 @@ class LiteXTerm:
             self.length      = 64
             self.outstanding = 0
 
+    def negotiate_window(self):
+        if self.safe or isinstance(self.port, Nios2Terminal):
+            return
+        frame = SFLFrame()
+        frame.cmd     = sfl_cmd_window
+        frame.payload = bytes([sfl_window_version])
+        self.port.write(frame.encode())
+        reply = self.port.read()
+        if reply != sfl_ack_success:
+            return
+        params = b""
+        while len(params) < 3:
+            params += self.port.read()
+        self.window_payload  = int.from_bytes(params[:2], "big")
+        self.window_interval = params[2]
+        print(f"[LXTERM] Using windowed upload (payload: {self.window_payload}).")
+
+    def receive_window_reply(self, timeout=sfl_window_timeout):
+        deadline = time.time() + timeout
+        while self.port.in_waiting < 2:
+            if time.time() > deadline:
+                return None, None
+            time.sleep(1e-4)
+        reply = self.port.read()
+        return reply, self.port.read()[0]
+
+    def send_window_frames(self, frames):
+        # Go-back-N on the encoded frames, the BIOS replies with cumulative acknowledges and, on
+        # errors, the sequence number of the frame to resend. Yields the number of frames acked.
+        first  = self.window_seq
+        last   = first + len(frames)
+        window = max(sfl_window_frames, 2*self.window_interval)
+        base   = first
+        seq    = first
+        while base < last:
+            while (seq < last) and (seq - base < window):
+                self.port.write(frames[seq - first])
+                seq += 1
+                yield base - first
+            reply, reply_seq = self.receive_window_reply()
+            if reply is None:
+                # Lost replies: resend from the last acknowledged frame.
+                seq = base
+                continue
+            # Map the 8-bit sequence number to the frames in flight.
+            n = base - 1 + ((reply_seq - (base - 1)) & 0xff)
+            if reply == sfl_ack_success:
+                base = max(base, min(n + 1, seq))
+            elif reply in [sfl_ack_crcerror, sfl_ack_error]:
+                base = seq = max(base, min(n, seq))
+            else:
+                print(f"[LXTERM] Got unexpected response from device '{reply}'")
+                sys.exit(1)
+        self.window_seq = last
+
+    def upload_window(self, f, address, length):
+        data_length = self.window_payload - 4
+        compressed  = f.read(4) == lz4_frame_magic
+        f.seek(0, 0)
+        if compressed:
+            print("[LXTERM] LZ4 image, decompressed by the device.")
+        frames = []
+        for offset in range(0, length, data_length):
+            frames.append(SFLWindowFrame(
+                seq     = self.window_seq + len(frames),
+                cmd     = sfl_cmd_load_lz4 if compressed else sfl_cmd_load,
+                payload = (address + (0 if compressed else offset)).to_bytes(4, "big") + f.read(data_length)).encode())
+        for frame in self.send_window_frames(frames):
+            position = min(frame*data_length, length)
+            sys.stdout.write("|{}>{}| {}%\r".format(
+                "=" * (20*position//length),
+                " " * (20-20*position//length),
+                100*position//length))
+            sys.stdout.flush()
+
     def upload(self, filename, address):
         f = open(filename, "rb")
         f.seek(0, 2)
@@ -435,6 +539,18 @@ class LiteXTerm:
 
         print(f"[LXTERM] Uploading {filename} to 0x{address:08x} ({length} bytes)...")
 
+        if self.window_payload is not None:
+            start = time.time()
+            self.upload_window(f, address, length)
+            elapsed = time.time() - start
+            print("[LXTERM] Upload complete ({0:.1f}KB/s).".format(length/(elapsed*1024)))
+            f.close()
+            return length
+
+        if f.read(4) == lz4_frame_magic:
+            print("[LXTERM] LZ4 image but no windowed mode, uploading it as is.")
+        f.seek(0, 0)
+
         # Upload calibration
         if not self.safe:
             self.upload_calibration(address)
@@ -502,6 +618,11 @@ class LiteXTerm:
         frame = SFLFrame()
         frame.cmd = sfl_cmd_jump
         frame.payload = int(self.boot_address, 16).to_bytes(4, "big")
+        if self.window_payload is not None:
+            frame = SFLWindowFrame(self.window_seq, frame.cmd, frame.payload).encode()
+            for _ in self.send_window_frames([frame]):
+                pass
+            return
         self.send_frame(frame)
 
     def detect_prompt(self, data):
@@ -526,6 +647,7 @@ class LiteXTerm:
         print("[LXTERM] Received firmware download request from the device.")
         if(len(self.mem_regions)):
             self.port.write(sfl_magic_ack)
+            self.negotiate_window()
         for filename, base in self.mem_regions.items():
             self.upload(filename, int(base, 16))
         self.boot()
@@ -42,7 +42,14 @@ setup(
             "litex_term=litex.tools.litex_term:main",
             "litex_server=litex.tools.litex_server:main",
             "litex_cli=litex.tools.litex_client:main",
+            "litex_netload=litex.tools.litex_netload:main",
+            "litex_netperf=litex.tools.litex_netperf:main",
+            "litex_memxfer=litex.tools.litex_memxfer:main",
             "litex_sim=litex.tools.litex_sim:main",
+            "litex_sim_bench=litex.tools.litex_sim_bench:main",
+            "litex_sim_insntrace=litex.tools.litex_sim_insntrace:main",
+            "litex_sim_regress=litex.tools.litex_sim_regress:main",
+            "litex_sim_wavestream=litex.tools.litex_sim_wavestream:main",
             "litex_read_verilog=litex.tools.litex_read_verilog:main",
             "litex_json2dts_linux=litex.tools.litex_json2dts_linux:main",
             "litex_json2dts_zephyr=litex.tools.litex_json2dts_zephyr:main",
@@ -0,0 +1,61 @@
+#
+# This file is part of LiteX.
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+import unittest
+import random
+import binascii
+
+from migen import *
+
+from litex.soc.cores.crc import CRCEngine
+
+
+CRC32  = dict(width=32, polynomial=0x04C11DB7, reflected=True)
+XMODEM = dict(width=16, polynomial=0x1021,     reflected=False)
+
+
+def crc32_model(data):
+    return binascii.crc32(data)
+
+def xmodem_model(data):
+    return binascii.crc_hqx(data, 0)
+
+
+class TestCRC(unittest.TestCase):
+    def crc_engine_test(self, crc, nbytes, endianness, init, xorout, model):
+        prng = random.Random(42)
+        data = bytes(prng.randrange(256) for _ in range(16*nbytes))
+        dut  = CRCEngine(nbytes=nbytes, endianness=endianness, **crc)
+        results = []
+
+        def generator(dut):
+            value = init
+            for i in range(0, len(data), nbytes):
+                yield dut.last.eq(value)
+                yield dut.data.eq(int.from_bytes(data[i:i + nbytes], endianness))
+                yield
+                value = (yield dut.next)
+            results.append(value ^ xorout)
+
+        run_simulation(dut, generator(dut))
+        self.assertEqual(results, [model(data)])
+
+    def test_crc32_byte(self):
+        self.crc_engine_test(CRC32, 1, "little", 0xffffffff, 0xffffffff, crc32_model)
+
+    def test_crc32_word_little(self):
+        self.crc_engine_test(CRC32, 4, "little", 0xffffffff, 0xffffffff, crc32_model)
+
+    def test_crc32_word_big(self):
+        self.crc_engine_test(CRC32, 4, "big", 0xffffffff, 0xffffffff, crc32_model)
+
+    def test_xmodem_byte(self):
+        self.crc_engine_test(XMODEM, 1, "little", 0x0000, 0x0000, xmodem_model)
+
+    def test_xmodem_word_little(self):
+        self.crc_engine_test(XMODEM, 4, "little", 0x0000, 0x0000, xmodem_model)
+
+    def test_xmodem_word_big(self):
+        self.crc_engine_test(XMODEM, 4, "big", 0x0000, 0x0000, xmodem_model)
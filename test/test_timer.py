@@ -4,6 +4,18 @@ from migen import *
 
 from litex.soc.cores.timer import Timer
 
+class TimerSkipDUT(Module):
+    def __init__(self, with_uptime=False, skip_budget=False):
+        self.skip = Signal(32)
+        self.submodules.timer = timer = Timer()
+        if with_uptime:
+            timer.add_uptime()
+        timer.add_skip(self.skip)
+        # Skip all the cycles allowed (as the simulator does) while skip_all is set.
+        if skip_budget:
+            self.skip_all = Signal()
+            self.comb += If(self.skip_all, self.skip.eq(timer.skip_budget))
+
 class TestTimer(unittest.TestCase):
     def test_one_shot_software_polling(self):
         def generator(timer):
@@ -61,3 +73,61 @@ class TestTimer(unittest.TestCase):
 
         timer = Timer()
         run_simulation(timer, generator(timer))
+
+    def test_skip_within_budget(self):
+        def generator(dut):
+            timer = dut.timer
+            yield from timer._load.write(1000)
+            yield from timer._reload.write(0)
+            yield from timer._en.write(1)
+            yield
+            value = (yield timer.count)
+            self.assertEqual((yield timer.skip_budget), value - 1)
+            yield dut.skip.eq(10)
+            yield
+            yield dut.skip.eq(0)
+            for i in range(4):
+                yield
+            # 5 cycles, one of them skipping 10 more.
+            self.assertEqual((yield timer.count), value - 5 - 10)
+
+        dut = TimerSkipDUT()
+        run_simulation(dut, generator(dut))
+
+    def test_skip_reload_at_zero(self):
+        def generator(dut):
+            timer = dut.timer
+            yield from timer._load.write(100)
+            yield from timer._reload.write(50)
+            yield from timer._en.write(1)
+            yield
+            yield dut.skip_all.eq(1)
+            yield
+            yield dut.skip_all.eq(0)
+            yield
+            # Skipping the whole budget stops at 0, with nothing left to skip...
+            self.assertEqual((yield timer.count), 0)
+            self.assertEqual((yield timer.skip_budget), 0)
+            self.assertEqual((yield timer.ev.zero.trigger), 1)
+            yield
+            # ...and the timer reloads as without skipping.
+            self.assertEqual((yield timer.count), 50)
+
+        dut = TimerSkipDUT(skip_budget=True)
+        run_simulation(dut, generator(dut))
+
+    def test_skip_uptime(self):
+        def generator(dut):
+            timer = dut.timer
+            yield
+            uptime = (yield timer.uptime_cycles)
+            yield dut.skip.eq(10)
+            yield
+            yield dut.skip.eq(0)
+            for i in range(4):
+                yield
+            # The uptime advances by the skipped cycles even with the timer disabled.
+            self.assertEqual((yield timer.uptime_cycles), uptime + 5 + 10)
+
+        dut = TimerSkipDUT(with_uptime=True)
+        run_simulation(dut, generator(dut))